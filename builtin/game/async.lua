@@ -18,14 +18,32 @@ function job_metatable.__index:cancel()
 	return cancelled
 end
 
-function core.handle_async(func, callback, ...)
-	assert(type(func) == "function" and type(callback) == "function",
-		"Invalid core.handle_async invocation")
+-- Must match AsyncJobPriority
+local priority_lanes = {
+	high = 0,
+	normal = 1,
+	low = 2,
+}
+
+local function queue_async(priority, func, callback, ...)
 	local args = {n = select("#", ...), ...}
 	local mod_origin = core.get_last_run_mod()
 
-	local id = core.do_async_callback(func, args, mod_origin)
+	local id = core.do_async_callback(func, args, mod_origin, priority)
 	core.async_jobs[id] = callback
 
 	return setmetatable({id = id}, job_metatable)
 end
+
+function core.handle_async(func, callback, ...)
+	assert(type(func) == "function" and type(callback) == "function",
+		"Invalid core.handle_async invocation")
+	return queue_async(priority_lanes.normal, func, callback, ...)
+end
+
+function core.handle_async_priority(priority, func, callback, ...)
+	local lane = priority_lanes[priority]
+	assert(lane and type(func) == "function" and type(callback) == "function",
+		"Invalid core.handle_async_priority invocation")
+	return queue_async(lane, func, callback, ...)
+end
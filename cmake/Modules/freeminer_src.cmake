@@ -533,12 +533,18 @@ set(FMcommon_SRCS ${FMcommon_SRCS}
     fm_abm.cpp
     fm_bitset.cpp
     fm_clientiface.cpp
+    fm_emerge_scheduler.cpp
     fm_far_calc.cpp
+    fm_imageblend.cpp
+    fm_light.cpp
     fm_liquid.cpp
     fm_map.cpp
+    fm_pathfinder.cpp
     fm_server.cpp
     fm_serverenvironment.cpp
     fm_util.cpp
+    fm_visibility.cpp
+    fm_weather_grid.cpp
     fm_world_merge.cpp
     key_value_storage.cpp
     log_types.cpp
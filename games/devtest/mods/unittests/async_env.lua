@@ -236,3 +236,46 @@ local function test_async_job_replacement(cb)
 	end, 1)
 end
 unittests.register("test_async_job_replacement", test_async_job_replacement, {async=true})
+
+local function test_handle_async_priority(cb)
+	assert(not pcall(core.handle_async_priority, "urgent", function() end, function() end))
+
+	local pending = 3
+	for _, priority in ipairs({"low", "normal", "high"}) do
+		core.handle_async_priority(priority, function(x)
+			return x
+		end, function(ret)
+			if ret ~= priority then
+				return cb("Wrong result for " .. priority .. " job")
+			end
+			pending = pending - 1
+			if pending == 0 then
+				cb()
+			end
+		end, priority)
+	end
+end
+unittests.register("test_handle_async_priority", test_handle_async_priority, {async=true})
+
+local function test_handle_async_priority_order(cb)
+	-- The workers are kept busy with low jobs, a high job queued after all
+	-- of them has to be started next and finish before the last one
+	local low_left = 200
+	local high_done = false
+	local function busy()
+		local stop = os.clock() + 0.002
+		while os.clock() < stop do end
+	end
+	for _ = 1, low_left do
+		core.handle_async_priority("low", busy, function()
+			low_left = low_left - 1
+			if low_left == 0 then
+				cb(not high_done and "High priority job was not preferred" or nil)
+			end
+		end)
+	end
+	core.handle_async_priority("high", function() end, function()
+		high_done = true
+	end)
+end
+unittests.register("test_handle_async_priority_order", test_handle_async_priority_order, {async=true})
@@ -0,0 +1,130 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <random>
+#include "catch.h"
+#include "collision.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "environment.h"
+#include "nodedef.h"
+
+namespace
+{
+class BenchmarkEnvironment : public Environment
+{
+	DummyMap map;
+	std::unique_ptr<CollisionContext> context;
+
+public:
+	BenchmarkEnvironment(IGameDef *gamedef, v3bpos_t bpmin, v3bpos_t bpmax) :
+			Environment(gamedef), map(gamedef, bpmin, bpmax)
+	{
+		map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	}
+
+	void setUseContext(bool use)
+	{
+		context = use ? std::make_unique<CollisionContext>(m_gamedef) : nullptr;
+	}
+
+	void step(f32 dtime, double uptime, unsigned int max_cycle_ms) override
+	{
+		if (context)
+			context->step();
+	}
+
+	Map &getMap() override { return map; }
+
+	CollisionContext *getCollisionContext() override { return context.get(); }
+
+	void getSelectedActiveObjects(const core::line3d<opos_t> &shootline_on_map,
+			std::vector<PointedThing> &objects,
+			const std::optional<Pointabilities> &pointabilities) override
+	{
+	}
+};
+
+struct FallingItem
+{
+	v3opos_t pos;
+	v3f speed;
+};
+
+// Items fall onto a bumpy floor and come to rest, like a dropped inventory
+std::vector<FallingItem> make_items(size_t count)
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<opos_t> xz(-60 * BS, 60 * BS);
+	std::uniform_real_distribution<opos_t> y(2 * BS, 20 * BS);
+	std::vector<FallingItem> items(count);
+	for (auto &item : items)
+		item.pos = v3opos_t(xz(rng), y(rng), xz(rng));
+	return items;
+}
+}
+
+TEST_CASE("benchmark_collision")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t content_stone;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		content_stone = ndef->set(f.name, f);
+	}
+
+	const v3bpos_t bpmin(-4, -1, -4), bpmax(3, 1, 3);
+	BenchmarkEnvironment env(&gamedef, bpmin, bpmax);
+	for (pos_t z = -64; z < 64; ++z)
+		for (pos_t x = -64; x < 64; ++x)
+			for (pos_t y = -MAP_BLOCKSIZE; y <= ((x ^ z) & 1); ++y)
+				env.getMap().setNode({x, y, z}, MapNode(content_stone));
+
+	const aabb3f box(-0.3f * BS, -0.3f * BS, -0.3f * BS, 0.3f * BS, 0.3f * BS,
+			0.3f * BS);
+	const v3f accel(0, -9.81f * BS, 0);
+	constexpr f32 dtime = 0.05f;
+
+	const auto step_items = [&](std::vector<FallingItem> &items) {
+		env.step(dtime, 0, 0);
+		size_t on_ground = 0;
+		for (auto &item : items)
+			on_ground += collisionMoveSimple(&env, &gamedef, box, 0, dtime, &item.pos,
+					&item.speed, accel, nullptr, false, StepUpMode::LEGACY)
+								 .touching_ground;
+		return on_ground;
+	};
+
+	BENCHMARK_ADVANCED("collisionMoveSimple 5000 falling items, step")
+	(Catch::Benchmark::Chronometer meter)
+	{
+		env.setUseContext(false);
+		auto items = make_items(5000);
+		meter.measure([&] { return step_items(items); });
+	};
+
+	BENCHMARK_ADVANCED("collisionMoveSimple 5000 falling items, step with context")
+	(Catch::Benchmark::Chronometer meter)
+	{
+		env.setUseContext(true);
+		auto items = make_items(5000);
+		meter.measure([&] { return step_items(items); });
+	};
+}
@@ -1,6 +1,7 @@
 #include "catch.h"
 #include "database/database-dummy.h"
 #include "database/database-leveldb.h"
+#include "database/database-mmap.h"
 #include "database/database-sqlite3.h"
 #include "database/database-postgresql.h"
 #include "database/database-redis.h"
@@ -35,6 +36,18 @@ static constexpr std::array<size_t, 5> g_benchmark_block_sizes = {
 };
 static constexpr size_t g_load_benchmark_blocks = 4096;
 
+// Area loads read cubes of blocks around random points of a filled region,
+// like a player joining or the world merger reading an octant
+static constexpr std::array<size_t, 2> g_area_benchmark_block_sizes = {
+		1024,
+		16 * 1024,
+};
+static constexpr bpos_t g_area_benchmark_region = 24;
+static constexpr bpos_t g_area_benchmark_height = 8;
+static constexpr bpos_t g_area_benchmark_side = 5;
+static constexpr size_t g_area_benchmark_blocks =
+		g_area_benchmark_side * g_area_benchmark_side * g_area_benchmark_side;
+
 static std::string getBenchmarkDirectory()
 {
 	return porting::path_share + DIR_DELIM + ".benchmark_tmp";
@@ -90,6 +103,17 @@ static std::unique_ptr<MapDatabase> create_leveldb_database()
 #endif
 }
 
+static std::unique_ptr<MapDatabase> create_leveldb_morton_database()
+{
+#if !USE_LEVELDB
+	return nullptr;
+#else
+	std::string db_path = makeBenchmarkDatabasePath("leveldb_morton_test");
+	fs::CreateAllDirs(db_path);
+	return std::make_unique<Database_LevelDB>(db_path, true);
+#endif
+}
+
 static std::unique_ptr<MapDatabase> create_sqlite3_database()
 {
 #if !USE_SQLITE3
@@ -101,6 +125,28 @@ static std::unique_ptr<MapDatabase> create_sqlite3_database()
 #endif
 }
 
+static std::unique_ptr<MapDatabase> create_sqlite3_morton_database()
+{
+#if !USE_SQLITE3
+	return nullptr;
+#else
+	std::string db_path = makeBenchmarkDatabasePath("sqlite3_morton_test");
+	fs::CreateAllDirs(db_path);
+	return std::make_unique<MapDatabaseSQLite3>(db_path, true);
+#endif
+}
+
+static std::unique_ptr<MapDatabase> create_mmap_database()
+{
+#if !USE_MMAP_DATABASE
+	return nullptr;
+#else
+	std::string db_path = makeBenchmarkDatabasePath("mmap_test");
+	fs::CreateAllDirs(db_path);
+	return std::make_unique<MapDatabaseMmap>(db_path);
+#endif
+}
+
 static std::unique_ptr<MapDatabase> create_postgresql_database()
 {
 #if !USE_POSTGRESQL
@@ -197,6 +243,7 @@ struct ThroughputBenchmarkMetadata
 	std::string operation;
 	std::string db_name;
 	size_t block_size;
+	size_t blocks_per_op;
 };
 
 static std::optional<ThroughputBenchmarkMetadata> parseThroughputBenchmarkName(
@@ -204,15 +251,21 @@ static std::optional<ThroughputBenchmarkMetadata> parseThroughputBenchmarkName(
 {
 	constexpr std::string_view write_prefix = "DBWrite_";
 	constexpr std::string_view read_prefix = "DBRead_";
+	constexpr std::string_view area_prefix = "DBAreaRead_";
 
 	std::string operation;
 	size_t prefix_size = 0;
+	size_t blocks_per_op = 1;
 	if (name.compare(0, write_prefix.size(), write_prefix) == 0) {
 		operation = "write";
 		prefix_size = write_prefix.size();
 	} else if (name.compare(0, read_prefix.size(), read_prefix) == 0) {
 		operation = "read";
 		prefix_size = read_prefix.size();
+	} else if (name.compare(0, area_prefix.size(), area_prefix) == 0) {
+		operation = "area";
+		prefix_size = area_prefix.size();
+		blocks_per_op = g_area_benchmark_blocks;
 	} else {
 		return std::nullopt;
 	}
@@ -238,6 +291,7 @@ static std::optional<ThroughputBenchmarkMetadata> parseThroughputBenchmarkName(
 			operation,
 			name.substr(prefix_size, separator - prefix_size),
 			block_size,
+			blocks_per_op,
 	};
 }
 
@@ -273,8 +327,8 @@ class DatabaseBenchmarkThroughputListener : public Catch::EventListenerBase
 
 		const double operations_per_second = 1000000000.0 / mean_ns;
 		const double mib_per_second = operations_per_second *
-									  static_cast<double>(metadata->block_size) /
-									  (1024.0 * 1024.0);
+									  static_cast<double>(metadata->block_size) *
+									  metadata->blocks_per_op / (1024.0 * 1024.0);
 
 		m_results.push_back({
 				metadata->db_name,
@@ -378,6 +432,48 @@ static void benchmarkLoadBlock(
 	};
 }
 
+template <typename DatabaseFactory>
+static void benchmarkLoadArea(
+		DatabaseFactory factory, const std::string &db_name, size_t block_size)
+{
+	initialize_benchmark_environment();
+	auto db = factory();
+	if (!db)
+		return;
+
+	// Pre-populate a region in random order, as blocks get generated
+	std::vector<v3bpos_t> region;
+	for (bpos_t z = 0; z < g_area_benchmark_region; ++z)
+		for (bpos_t y = 0; y < g_area_benchmark_height; ++y)
+			for (bpos_t x = 0; x < g_area_benchmark_region; ++x)
+				region.emplace_back(x, y, z);
+	std::mt19937 gen(42);
+	std::shuffle(region.begin(), region.end(), gen);
+
+	std::string test_data = generateTestData(block_size);
+	db->beginSave();
+	for (const auto &pos : region)
+		db->saveBlock(pos, test_data);
+	db->endSave();
+
+	std::uniform_int_distribution<int> xz(0, g_area_benchmark_region - g_area_benchmark_side);
+	std::uniform_int_distribution<int> y(0, g_area_benchmark_height - g_area_benchmark_side);
+	std::vector<std::pair<v3bpos_t, std::string>> loaded;
+	BENCHMARK_ADVANCED(makeThroughputBenchmarkName("AreaRead", db_name, block_size))(
+			Catch::Benchmark::Chronometer meter)
+	{
+		std::vector<v3bpos_t> corners(meter.runs());
+		for (auto &corner : corners)
+			corner = v3bpos_t(xz(gen), y(gen), xz(gen));
+		meter.measure([&](int i) {
+			const auto &min = corners[i];
+			loaded.clear();
+			db->loadBlocksArea(min, min + v3bpos_t(g_area_benchmark_side - 1), loaded);
+			return loaded.size();
+		});
+	};
+}
+
 template <typename DatabaseFactory>
 static void benchmarkDeleteBlock(DatabaseFactory factory, const std::string &db_name)
 {
@@ -450,6 +546,9 @@ TEST_CASE("benchmark_database_operations")
 			benchmarkSaveBlock(create_dummy_database, "Dummy", block_size);
 			benchmarkSaveBlock(create_leveldb_database, "LevelDB", block_size);
 			benchmarkSaveBlock(create_sqlite3_database, "SQLite3", block_size);
+			benchmarkSaveBlock(create_leveldb_morton_database, "LevelDBMorton", block_size);
+			benchmarkSaveBlock(create_sqlite3_morton_database, "SQLite3Morton", block_size);
+			benchmarkSaveBlock(create_mmap_database, "Mmap", block_size);
 			if (have_postgresql)
 				benchmarkSaveBlock(create_postgresql_database, "Postgresql", block_size);
 			if (have_redis)
@@ -463,6 +562,9 @@ TEST_CASE("benchmark_database_operations")
 			benchmarkLoadBlock(create_dummy_database, "Dummy", block_size);
 			benchmarkLoadBlock(create_leveldb_database, "LevelDB", block_size);
 			benchmarkLoadBlock(create_sqlite3_database, "SQLite3", block_size);
+			benchmarkLoadBlock(create_leveldb_morton_database, "LevelDBMorton", block_size);
+			benchmarkLoadBlock(create_sqlite3_morton_database, "SQLite3Morton", block_size);
+			benchmarkLoadBlock(create_mmap_database, "Mmap", block_size);
 			if (have_postgresql)
 				benchmarkLoadBlock(create_postgresql_database, "Postgresql", block_size);
 			if (have_redis)
@@ -470,11 +572,25 @@ TEST_CASE("benchmark_database_operations")
 		}
 	}
 
+	SECTION("LoadArea Operations")
+	{
+		for (const size_t block_size : g_area_benchmark_block_sizes) {
+			benchmarkLoadArea(create_leveldb_database, "LevelDB", block_size);
+			benchmarkLoadArea(create_sqlite3_database, "SQLite3", block_size);
+			benchmarkLoadArea(create_leveldb_morton_database, "LevelDBMorton", block_size);
+			benchmarkLoadArea(create_sqlite3_morton_database, "SQLite3Morton", block_size);
+			benchmarkLoadArea(create_mmap_database, "Mmap", block_size);
+			if (have_postgresql)
+				benchmarkLoadArea(create_postgresql_database, "Postgresql", block_size);
+		}
+	}
+
 	SECTION("DeleteBlock Operations")
 	{
 		benchmarkDeleteBlock(create_dummy_database, "Dummy");
 		benchmarkDeleteBlock(create_leveldb_database, "LevelDB");
 		benchmarkDeleteBlock(create_sqlite3_database, "SQLite3");
+		benchmarkDeleteBlock(create_mmap_database, "Mmap");
 		if (have_postgresql)
 			benchmarkDeleteBlock(create_postgresql_database, "Postgresql");
 		if (have_redis)
@@ -486,6 +602,7 @@ TEST_CASE("benchmark_database_operations")
 		benchmarkListAllBlocks(create_dummy_database, "Dummy", iterations2);
 		benchmarkListAllBlocks(create_leveldb_database, "LevelDB", iterations2);
 		benchmarkListAllBlocks(create_sqlite3_database, "SQLite3", iterations2);
+		benchmarkListAllBlocks(create_mmap_database, "Mmap", iterations2);
 		if (have_postgresql)
 			benchmarkListAllBlocks(create_postgresql_database, "Postgresql", iterations2);
 		if (have_redis)
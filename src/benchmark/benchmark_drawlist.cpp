@@ -0,0 +1,87 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include "client/fm_drawlist.h"
+#include "constants.h"
+#include "dummygamedef.h"
+#include "mapblock.h"
+
+#include <vector>
+
+// Draw list updates of ClientMap::updateDrawListFm() while walking across
+// the loaded blocks, a few nodes per update
+TEST_CASE("benchmark_drawlist")
+{
+	const bpos_t range = 12;
+	std::vector<v3bpos_t> loaded;
+	for (bpos_t z = -range; z <= range; ++z)
+		for (bpos_t y = -range / 2; y <= range / 2; ++y)
+			for (bpos_t x = -range; x <= range; ++x)
+				if (x * x + y * y + z * z <= range * range)
+					loaded.emplace_back(x, y, z);
+	DummyGameDef gamedef;
+	const auto block = std::make_shared<MapBlock>(v3bpos_t(), &gamedef);
+
+	std::vector<v3pos_t> path;
+	for (pos_t x = 0; x < MAP_BLOCKSIZE * 4; x += 3)
+		path.emplace_back(x, 8, x / 2);
+
+	const auto update = [&](DrawListBuilder &builder, const v3pos_t &camera) {
+		builder.setCamera(getNodeBlockPos(camera));
+		for (const auto &pos : loaded)
+			builder.insert_or_assign(pos, block);
+		return builder.build().size();
+	};
+
+	BENCHMARK("rebuild")
+	{
+		size_t count = 0;
+		for (const auto &camera : path) {
+			DrawListBuilder builder;
+			count += update(builder, camera);
+		}
+		return count;
+	};
+
+	DrawListBuilder builder;
+	BENCHMARK("incremental")
+	{
+		size_t count = 0;
+		for (const auto &camera : path)
+			count += update(builder, camera);
+		return count;
+	};
+
+	// Tests left over from one update to the next
+	DrawListOcclusion occlusion;
+	BENCHMARK("occlusion")
+	{
+		size_t tests = 0;
+		for (const auto &camera : path)
+			for (int i = 0; i < 4; ++i) {
+				occlusion.begin(camera);
+				for (const auto &pos : loaded)
+					occlusion.add(pos, 1);
+				const auto &retest = occlusion.retest();
+				for (const auto j : retest)
+					occlusion.setOccluded(j, false);
+				tests += retest.size();
+			}
+		return tests;
+	};
+}
@@ -0,0 +1,91 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "filesys.h"
+#include "mapgen/earth/hgt_cache.h"
+
+// Synthetic 1200 cells tiles, like 3 arc second srtm
+static bool make_tile(int lat, int lon, hgt_grid &grid)
+{
+	constexpr uint16_t cells = 1200;
+	grid.cells_x = grid.cells_y = cells;
+	grid.values.resize((cells + 1) * (cells + 1));
+	for (uint32_t y = 0; y <= cells; ++y)
+		for (uint32_t x = 0; x <= cells; ++x)
+			grid.values[y * (cells + 1) + x] =
+					1000 + 500 * std::sin((lat * cells + y) * 0.01) *
+								   std::cos((lon * cells + x) * 0.013);
+	return true;
+}
+
+// Columns of one 80x80 chunk at scale 1, about 30 km from the corner of a 2x2 tile set
+TEST_CASE("benchmark_earth")
+{
+	const std::string folder = fs::CreateTempDir();
+	REQUIRE(!folder.empty());
+
+	constexpr size_t size = 80;
+	constexpr double step = 360.0 / 40075696.0;
+	std::vector<hgt_cache::height_t> out(size * size);
+
+	{
+		hgt_cache cache(folder, make_tile);
+		// Convert and save the tiles
+		cache.get_area(45.5, 10.5, 0.5, 0.5, 2, 2, out.data());
+	}
+
+	hgt_cache cache(folder, nullptr);
+	const double lat = 45.7;
+	BENCHMARK("hgt_get_chunk") {
+		size_t i = 0;
+		for (size_t z = 0; z < size; ++z)
+			for (size_t x = 0; x < size; ++x)
+				out[i++] = cache.get(lat + z * step, 10.7 + x * step);
+		return out[0];
+	};
+
+	BENCHMARK("hgt_get_area_chunk") {
+		cache.get_area(lat, 10.7, step, step, size, size, out.data());
+		return out[0];
+	};
+
+	// Sampling across all tiles with room for one, every switch maps again
+	cache.set_max_bytes(1);
+	BENCHMARK("hgt_get_area_evict") {
+		cache.get_area(45.5, 10.5, 1, 1, 2, 2, out.data());
+		return out[0];
+	};
+	cache.set_max_bytes(512 << 20);
+
+	BENCHMARK("hgt_get_area_chunk_4t") {
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; ++t)
+			threads.emplace_back([&, t] {
+				std::vector<hgt_cache::height_t> heights(size * size);
+				cache.get_area(45.7 + t * 0.3, 10.7 + t * 0.2, step, step, size, size,
+						heights.data());
+			});
+		for (auto &thread : threads)
+			thread.join();
+	};
+
+	fs::RecursiveDelete(folder);
+}
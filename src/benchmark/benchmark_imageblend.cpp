@@ -0,0 +1,212 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include "fm_imageblend.h"
+
+#include <random>
+#include <string>
+#include <vector>
+#include <SColor.h>
+
+// Texture modifier chains run on raw rows, ImageSource needs a video driver
+namespace
+{
+// A node texture pack worth of 16x16 tiles
+constexpr size_t SIDE = 16, TILES = 512;
+
+/*
+	One modifier string over every tile: rows calls a kernel once a row like
+	ImageSource does, scalar is the per pixel code of client/imagesource.cpp
+	for images that are not ARGB, the baseline of the kernels.
+*/
+template <typename Rows, typename Scalar>
+void benchmark_modifier(const std::string &name, const std::vector<u32> &base,
+		const std::vector<u32> &other, std::vector<u32> &dst, Rows rows, Scalar scalar)
+{
+	BENCHMARK(std::string(name))
+	{
+		dst = base;
+		for (size_t tile = 0; tile < TILES; ++tile)
+			rows(&dst[tile * SIDE * SIDE], &other[tile * SIDE * SIDE]);
+		return dst.back();
+	};
+
+	BENCHMARK(name + " scalar")
+	{
+		dst = base;
+		for (size_t i = 0; i < dst.size(); ++i)
+			scalar(dst[i], other[i]);
+		return dst.back();
+	};
+}
+
+// Every row of a tile
+template <typename Row>
+void each_row(u32 *dst, const u32 *other, Row row)
+{
+	for (size_t y = 0; y < SIDE; ++y)
+		row(dst + y * SIDE, other + y * SIDE);
+}
+
+void blit_scalar(u32 &dst, u32 src, bool overlay)
+{
+	video::SColor s(src), d(dst);
+	const u32 sa = s.getAlpha();
+	u32 da = d.getAlpha();
+	if ((overlay && da != 255) || sa == 0)
+		return;
+	if (sa == 255 || da == 0) {
+		dst = src;
+		return;
+	}
+	const u32 r = (d.getRed() * (255 - sa) + s.getRed() * sa) / 255;
+	const u32 g = (d.getGreen() * (255 - sa) + s.getGreen() * sa) / 255;
+	const u32 b = (d.getBlue() * (255 - sa) + s.getBlue() * sa) / 255;
+	if (da != 255)
+		da = da + (255 - da) * sa * sa / (255 * 255);
+	dst = video::SColor(da, r, g, b).color;
+}
+
+float overlay_channel(u32 base, u32 blend)
+{
+	const f32 base_f = base / 255.0f, blend_f = blend / 255.0f;
+	return base_f < 0.5f ? 2 * base_f * blend_f : 1 - 2 * (1 - base_f) * (1 - blend_f);
+}
+}
+
+TEST_CASE("benchmark_imageblend")
+{
+	std::mt19937 rng(1);
+	std::vector<u32> base(TILES * SIDE * SIDE), overlay(base.size()), dst(base.size());
+	for (size_t i = 0; i < base.size(); ++i) {
+		base[i] = rng() | 0xff000000;
+		// Mostly transparent overlay with opaque and antialiased edges
+		const auto r = rng();
+		overlay[i] = r % 4 ? r & 0x00ffffff : r % 8 == 1 ? r | 0xff000000 : r;
+	}
+
+	benchmark_modifier("default_stone.png^default_mineral_coal.png", base, overlay, dst,
+			[](u32 *d, const u32 *o) {
+				each_row(d, o, [](u32 *d, const u32 *o) {
+					image_blit_row(o, d, SIDE, false);
+				});
+			},
+			[](u32 &d, u32 o) { blit_scalar(d, o, false); });
+
+	// Crack tiles are blitted with overlay
+	benchmark_modifier("default_dirt.png^[crack:1:0", base, overlay, dst,
+			[](u32 *d, const u32 *o) {
+				each_row(d, o, [](u32 *d, const u32 *o) {
+					image_blit_row(o, d, SIDE, true);
+				});
+			},
+			[](u32 &d, u32 o) { blit_scalar(d, o, true); });
+
+	const video::SColor red(0xffff0000);
+	benchmark_modifier("wool_white.png^[multiply:#ff0000", base, overlay, dst,
+			[&](u32 *d, const u32 *o) {
+				each_row(d, o, [&](u32 *d, const u32 *) {
+					image_multiply_row(d, SIDE, red.color);
+				});
+			},
+			[&](u32 &d, u32) {
+				video::SColor c(d);
+				c.set(c.getAlpha(), c.getRed() * red.getRed() / 255,
+						c.getGreen() * red.getGreen() / 255,
+						c.getBlue() * red.getBlue() / 255);
+				d = c.color;
+			});
+
+	const video::SColor grey(0xff404040);
+	benchmark_modifier("default_glass.png^[screen:#404040", base, overlay, dst,
+			[&](u32 *d, const u32 *o) {
+				each_row(d, o, [&](u32 *d, const u32 *) {
+					image_screen_row(d, SIDE, grey.color);
+				});
+			},
+			[&](u32 &d, u32) {
+				video::SColor c(d);
+				c.set(c.getAlpha(), 255 - (255 - c.getRed()) * (255 - grey.getRed()) / 255,
+						255 - (255 - c.getGreen()) * (255 - grey.getGreen()) / 255,
+						255 - (255 - c.getBlue()) * (255 - grey.getBlue()) / 255);
+				d = c.color;
+			});
+
+	// Full replacement of the color of the overlay tiles
+	benchmark_modifier("default_mineral_coal.png^[colorize:#ff0000:255", overlay, base,
+			dst,
+			[&](u32 *d, const u32 *o) {
+				each_row(d, o, [&](u32 *d, const u32 *) {
+					image_colorize_row(d, SIDE, red.color, false);
+				});
+			},
+			[&](u32 &d, u32) {
+				if (video::SColor(d).getAlpha() > 0)
+					d = red.color;
+			});
+
+	// Interpolated, the tables are made for every image
+	const video::SColor tint(0x80804000);
+	const float interp = tint.getAlpha() / 255.0f;
+	benchmark_modifier("default_wood.png^[colorize:#80400080", base, overlay, dst,
+			[&](u32 *d, const u32 *o) {
+				image_channel_tables_t tables;
+				for (u32 v = 0; v < 256; v++) {
+					const video::SColor c =
+							tint.getInterpolated(video::SColor(v, v, v, v), interp);
+					tables[0][v] = c.getAlpha();
+					tables[1][v] = c.getRed();
+					tables[2][v] = c.getGreen();
+					tables[3][v] = c.getBlue();
+				}
+				each_row(d, o, [&](u32 *d, const u32 *) {
+					image_remap_row(d, SIDE, tables, true);
+				});
+			},
+			[&](u32 &d, u32) {
+				const video::SColor c(d);
+				if (c.getAlpha() > 0)
+					d = tint.getInterpolated(c, interp).color;
+			});
+
+	benchmark_modifier("default_stone.png^[mask:mask.png", base, overlay, dst,
+			[](u32 *d, const u32 *o) {
+				each_row(d, o, [](u32 *d, const u32 *o) { image_mask_row(o, d, SIDE); });
+			},
+			[](u32 &d, u32 o) {
+				const video::SColor m(o), c(d);
+				d = video::SColor(c.getAlpha() & m.getAlpha(), c.getRed() & m.getRed(),
+						c.getGreen() & m.getGreen(), c.getBlue() & m.getBlue())
+								.color;
+			});
+
+	benchmark_modifier("default_stone.png^[overlay:overlay.png", base, overlay, dst,
+			[](u32 *d, const u32 *o) {
+				each_row(d, o, [](u32 *d, const u32 *o) {
+					image_overlay_row(o, d, d, SIDE);
+				});
+			},
+			[](u32 &d, u32 o) {
+				video::SColor c(d);
+				const video::SColor b(o);
+				c.set(c.getAlpha(), (u32)(overlay_channel(c.getRed(), b.getRed()) * 255),
+						(u32)(overlay_channel(c.getGreen(), b.getGreen()) * 255),
+						(u32)(overlay_channel(c.getBlue(), b.getBlue()) * 255));
+				d = c.color;
+			});
+}
@@ -6,6 +6,7 @@
 #include "voxelalgorithms.h"
 #include "dummygamedef.h"
 #include "dummymap.h"
+#include "fm_light.h"
 
 TEST_CASE("benchmark_lighting")
 {
@@ -68,4 +69,130 @@ TEST_CASE("benchmark_lighting")
 			voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
 		});
 	};
+
+	// Same torch with the flat region engine
+	BENCHMARK_ADVANCED("LightPropagator::spread_unspread")(Catch::Benchmark::Chronometer meter) {
+		std::map<v3bpos_t, MapBlock*> modified_blocks;
+		LightPropagator propagator(&map, ndef);
+		const v3pos_t p(0, 0, 0);
+		meter.measure([&] {
+			MapNode n(content_light);
+			n.setLight(LIGHTBANK_NIGHT, 14, ndef->getLightingFlags(n));
+			map.setNode(p, n);
+			propagator.spread(LIGHTBANK_NIGHT, {p}, modified_blocks);
+
+			std::vector<v3pos_t> light_sources;
+			map.setNode(p, MapNode(CONTENT_AIR));
+			propagator.unspread(LIGHTBANK_NIGHT, {{p, 14}}, light_sources, modified_blocks);
+			propagator.spread(LIGHTBANK_NIGHT, light_sources, modified_blocks);
+		});
+	};
+}
+
+TEST_CASE("benchmark_lighting_torch_in_cave")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	v3pos_t pmin(-32, -32, -32);
+	v3pos_t pmax(31, 31, 31);
+	auto bpmin = getNodeBlockPos(pmin), bpmax = getNodeBlockPos(pmax);
+	DummyMap map(&gamedef, bpmin, bpmax);
+
+	content_t content_wall;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		content_wall = ndef->set(f.name, f);
+	}
+
+	content_t content_light;
+	{
+		ContentFeatures f;
+		f.name = "light";
+		f.param_type = CPT_LIGHT;
+		f.light_propagates = true;
+		f.light_source = 14;
+		content_light = ndef->set(f.name, f);
+	}
+
+	// A dark room in the stone with a tunnel going out of both sides, the
+	// light ends at the walls.
+	map.fill(bpmin, bpmax, MapNode(content_wall));
+	{
+		std::map<v3pos_t, MapBlock*> modified_blocks;
+		MMVManip vm(&map);
+		vm.initialEmerge(bpmin, bpmax, false);
+		for (s16 z = -7; z <= 7; z++)
+		for (s16 y = -2; y <= 4; y++)
+		for (s16 x = -7; x <= 7; x++)
+			vm.setNodeNoEmerge(v3pos_t(x, y, z), MapNode(CONTENT_AIR));
+		for (s16 x = -30; x <= 30; x++)
+		for (s16 y = -2; y <= 0; y++)
+			vm.setNodeNoEmerge(v3pos_t(x, y, 0), MapNode(CONTENT_AIR));
+		voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
+	}
+
+	BENCHMARK_ADVANCED("voxalgo::update_lighting_nodes")(Catch::Benchmark::Chronometer meter) {
+		std::map<v3pos_t, MapBlock*> modified_blocks;
+		meter.measure([&] {
+			map.addNodeAndUpdate(v3pos_t(0, 0, 0), MapNode(content_light), modified_blocks);
+			map.removeNodeAndUpdate(v3pos_t(0, 0, 0), modified_blocks);
+		});
+	};
+}
+
+TEST_CASE("benchmark_lighting_hole_to_sky")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	v3pos_t pmin(-32, -32, -32);
+	v3pos_t pmax(31, 31, 31);
+	auto bpmin = getNodeBlockPos(pmin), bpmax = getNodeBlockPos(pmax);
+	DummyMap map(&gamedef, bpmin, bpmax);
+
+	content_t content_wall;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		content_wall = ndef->set(f.name, f);
+	}
+
+	// A cave under a ceiling as wide as the map, open to the sky above it
+	const pos_t ceiling_y = 8;
+	{
+		std::map<v3pos_t, MapBlock*> modified_blocks;
+		MMVManip vm(&map);
+		vm.initialEmerge(bpmin, bpmax, false);
+		s32 volume = vm.m_area.getVolume();
+		for (s32 i = 0; i < volume; i++)
+			vm.m_data[i] = MapNode(CONTENT_AIR);
+		for (s16 z = pmin.Z; z <= pmax.Z; z++)
+		for (s16 x = pmin.X; x <= pmax.X; x++) {
+			vm.setNodeNoEmerge(v3pos_t(x, pmin.Y, z), MapNode(content_wall));
+			vm.setNodeNoEmerge(v3pos_t(x, ceiling_y, z), MapNode(content_wall));
+		}
+		voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
+	}
+
+	// Take the whole 64x64 ceiling away and put it back, sunlight goes
+	// down every column to the floor and back out
+	BENCHMARK_ADVANCED("voxalgo::blit_back_with_light")(Catch::Benchmark::Chronometer meter) {
+		std::map<v3pos_t, MapBlock*> modified_blocks;
+		MMVManip vm(&map);
+		const v3bpos_t bp = getNodeBlockPos(v3pos_t(0, ceiling_y, 0));
+		vm.initialEmerge(v3bpos_t(bpmin.X, bp.Y, bpmin.Z),
+				v3bpos_t(bpmax.X, bp.Y, bpmax.Z), false);
+		auto set_ceiling = [&](MapNode n) {
+			for (s16 z = pmin.Z; z <= pmax.Z; z++)
+			for (s16 x = pmin.X; x <= pmax.X; x++)
+				vm.setNodeNoEmerge(v3pos_t(x, ceiling_y, z), n);
+			voxalgo::blit_back_with_light(&map, &vm, &modified_blocks);
+		};
+		meter.measure([&] {
+			set_ceiling(MapNode(CONTENT_AIR));
+			set_ceiling(MapNode(content_wall));
+		});
+	};
 }
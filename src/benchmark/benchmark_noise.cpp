@@ -0,0 +1,127 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include "noise.h"
+#include <cstdio>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+// Benchmark names are "noiseMap<dims>_<points>pt_<octaves>oct"
+static std::string makeNoiseBenchmarkName(int dims, u32 points, u16 octaves)
+{
+	return "noiseMap" + std::to_string(dims) + "D_" + std::to_string(points) +
+		   "pt_" + std::to_string(octaves) + "oct";
+}
+
+class NoiseBenchmarkThroughputListener : public Catch::EventListenerBase
+{
+public:
+	using Catch::EventListenerBase::EventListenerBase;
+
+	static std::string getDescription()
+	{
+		return "prints derived noise map throughput";
+	}
+
+	void benchmarkEnded(Catch::BenchmarkStats<> const &stats) override
+	{
+		Result result;
+		unsigned long points;
+		unsigned octaves;
+		if (std::sscanf(stats.info.name.c_str(), "noiseMap%dD_%lupt_%uoct",
+					&result.dims, &points, &octaves) != 3)
+			return;
+
+		const double mean_ns = stats.mean.point.count();
+		if (mean_ns <= 0.0)
+			return;
+
+		result.octaves = octaves;
+		result.points = points;
+		result.mean_ns = mean_ns;
+		result.points_per_second = points * 1000000000.0 / mean_ns;
+		m_results.push_back(result);
+	}
+
+	void testRunEnded(Catch::TestRunStats const &) override
+	{
+		if (m_results.empty())
+			return;
+
+		auto &out = Catch::cerr();
+		const auto old_flags = out.flags();
+		const auto old_precision = out.precision();
+
+		out << "\nNoise map throughput (derived from Catch2 benchmark mean)\n";
+		out << std::left << std::setw(6) << "map" << std::right << std::setw(10)
+			<< "octaves" << std::setw(10) << "points" << std::setw(18)
+			<< "Mpoints/sec" << std::setw(15) << "mean us/map" << '\n';
+		out << std::string(59, '-') << '\n';
+
+		for (const auto &result : m_results) {
+			out << std::left << std::setw(6) << (std::to_string(result.dims) + "D")
+				<< std::right << std::setw(10) << result.octaves << std::setw(10)
+				<< result.points << std::setw(18) << std::fixed
+				<< std::setprecision(2) << result.points_per_second / 1000000.0
+				<< std::setw(15) << std::fixed << std::setprecision(1)
+				<< result.mean_ns / 1000.0 << '\n';
+		}
+
+		out.flags(old_flags);
+		out.precision(old_precision);
+	}
+
+private:
+	struct Result
+	{
+		int dims;
+		u16 octaves;
+		u32 points;
+		double mean_ns;
+		double points_per_second;
+	};
+	std::vector<Result> m_results;
+};
+
+CATCH_REGISTER_LISTENER(NoiseBenchmarkThroughputListener)
+
+TEST_CASE("benchmark_noise")
+{
+	// Typical mapgen sizes: one 80 node chunk, plus a layer for the 3D maps
+	constexpr u32 size_xz = 80, size_y = 82;
+
+	for (u16 octaves : {1, 3, 5}) {
+		NoiseParams np(0, 1, v3f(250, 250, 250), 5934, octaves, 0.6f, 2.0f);
+
+		Noise noise2d(&np, 1337, size_xz, size_xz);
+		float x = 0;
+		BENCHMARK(makeNoiseBenchmarkName(2, size_xz * size_xz, octaves)) {
+			// Move a little each run so the start offsets vary
+			x += 17.25f;
+			return noise2d.noiseMap2D(x, -x)[0];
+		};
+
+		np.flags = NOISE_FLAG_EASED;
+		Noise noise3d(&np, 1337, size_xz, size_y, size_xz);
+		BENCHMARK(makeNoiseBenchmarkName(3, size_xz * size_y * size_xz, octaves)) {
+			x += 17.25f;
+			return noise3d.noiseMap3D(x, -x, x)[0];
+		};
+	}
+}
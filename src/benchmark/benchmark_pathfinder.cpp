@@ -0,0 +1,142 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <random>
+#include <thread>
+#include "catch.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "fm_pathfinder.h"
+#include "nodedef.h"
+#include "pathfinder.h"
+
+namespace
+{
+// Rolling hills with 1 node steps and some pillars on a 128x128 area
+pos_t terrain_height(pos_t x, pos_t z)
+{
+	return std::round(3 * std::sin(x / 9.0) + 3 * std::cos(z / 11.0));
+}
+
+bool terrain_pillar(pos_t x, pos_t z)
+{
+	return (x % 7 == 0) && (z % 5 == 0);
+}
+
+std::vector<PathRequest> make_requests(size_t count, PathAlgorithm algo)
+{
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<pos_t> coord(-60, 59);
+	std::vector<PathRequest> requests;
+	while (requests.size() < count) {
+		const pos_t x1 = coord(rng), z1 = coord(rng), x2 = coord(rng), z2 = coord(rng);
+		if (terrain_pillar(x1, z1) || terrain_pillar(x2, z2))
+			continue;
+		PathRequest request;
+		request.source = {x1, pos_t(terrain_height(x1, z1) + 1), z1};
+		request.destination = {x2, pos_t(terrain_height(x2, z2) + 1), z2};
+		request.searchdistance = 16;
+		request.max_jump = 1;
+		request.max_drop = 2;
+		request.algo = algo;
+		requests.push_back(request);
+	}
+	return requests;
+}
+}
+
+TEST_CASE("benchmark_pathfinder")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t content_stone;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		content_stone = ndef->set(f.name, f);
+	}
+
+	const v3bpos_t bpmin(-4, -1, -4), bpmax(3, 1, 3);
+	DummyMap map(&gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	for (pos_t z = -64; z < 64; ++z)
+		for (pos_t x = -64; x < 64; ++x) {
+			const pos_t top = terrain_height(x, z) + (terrain_pillar(x, z) ? 3 : 0);
+			for (pos_t y = -MAP_BLOCKSIZE; y <= top; ++y)
+				map.setNode({x, y, z}, MapNode(content_stone));
+		}
+
+	const auto plain = make_requests(64, PA_PLAIN_NP);
+	const auto hierarchical = make_requests(64, PA_HIERARCHICAL);
+
+	BENCHMARK("get_path A*_noprefetch, 64 queries")
+	{
+		size_t found = 0;
+		for (const auto &r : plain)
+			found += !get_path(&map, ndef, r.source, r.destination, r.searchdistance,
+					r.max_jump, r.max_drop, r.algo)
+							   .empty();
+		return found;
+	};
+
+	BENCHMARK_ADVANCED("PathNavigator HPA* cold, 64 queries")
+	(Catch::Benchmark::Chronometer meter)
+	{
+		PathNavigator navigator(&map, ndef, 0);
+		meter.measure([&] {
+			navigator.clear();
+			size_t found = 0;
+			for (const auto &r : hierarchical)
+				found += !navigator.getPath(r).empty();
+			return found;
+		});
+	};
+
+	PathNavigator navigator(&map, ndef, 0);
+	for (const auto &r : hierarchical)
+		navigator.getPath(r);
+
+	BENCHMARK("PathNavigator HPA* cached, 64 queries")
+	{
+		size_t found = 0;
+		for (const auto &r : hierarchical)
+			found += !navigator.getPath(r).empty();
+		return found;
+	};
+
+	const size_t threads = std::max(2u, std::thread::hardware_concurrency() / 2);
+	PathNavigator async_navigator(&map, ndef, threads);
+	for (const auto &r : hierarchical)
+		async_navigator.getPath(r);
+
+	BENCHMARK("PathNavigator HPA* cached async, 64 queries")
+	{
+		size_t found = 0, done = 0;
+		for (const auto &r : hierarchical)
+			async_navigator.queuePath(r, [&](PathNavigator::path_t &&path, bool) {
+				found += !path.empty();
+				++done;
+			});
+		while (done < hierarchical.size()) {
+			if (!async_navigator.deliverResults())
+				std::this_thread::yield();
+		}
+		return found;
+	};
+}
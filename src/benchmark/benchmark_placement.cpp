@@ -0,0 +1,115 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "mapgen/mapgen.h"
+#include "mapgen/mg_decoration.h"
+#include "mapgen/mg_ore.h"
+#include "mapgen/mg_tiles.h"
+
+// Ore and decoration placement of one 80x80x80 chunk
+TEST_CASE("benchmark_placement")
+{
+	DummyGameDef gamedef;
+	NodeDefManager *ndef = gamedef.getWritableNodeDefManager();
+
+	content_t c_stone, c_ore, c_plant;
+	{
+		ContentFeatures f;
+		f.name = "stone";
+		f.walkable = true;
+		c_stone = ndef->set(f.name, f);
+		f.name = "ore";
+		c_ore = ndef->set(f.name, f);
+		f.name = "plant";
+		f.walkable = false;
+		c_plant = ndef->set(f.name, f);
+	}
+
+	const v3pos_t nmin(0, 0, 0), nmax(79, 79, 79);
+	const pos_t ground = 40;
+	DummyMap map(&gamedef, getNodeBlockPos(nmin), getNodeBlockPos(nmax));
+	MMVManip vm(&map);
+	vm.initialEmerge(getNodeBlockPos(nmin), getNodeBlockPos(nmax), false);
+	for (pos_t z = nmin.Z; z <= nmax.Z; z++)
+	for (pos_t y = nmin.Y; y <= nmax.Y; y++)
+	for (pos_t x = nmin.X; x <= nmax.X; x++)
+		vm.setNodeNoEmerge(v3pos_t(x, y, z), MapNode(y <= ground ? c_stone : CONTENT_AIR));
+	const std::vector<MapNode> terrain(vm.m_data, vm.m_data + vm.m_area.getVolume());
+
+	std::vector<pos_t> heightmap(80 * 80, ground);
+
+	Mapgen mg;
+	mg.vm = &vm;
+	mg.ndef = ndef;
+	mg.heightmap = heightmap.data();
+
+	OreManager oremgr(&gamedef);
+	for (int i = 0; i < 8; i++) {
+		auto ore = static_cast<OreScatter *>(OreManager::create(ORE_SCATTER));
+		ore->c_ore = c_ore;
+		ore->c_wherein = {c_stone};
+		ore->clust_scarcity = 8 * 8 * 8;
+		ore->clust_num_ores = 8;
+		ore->clust_size = 3;
+		ore->y_min = nmin.Y;
+		ore->y_max = nmax.Y;
+		ore->ore_param2 = 0;
+		oremgr.add(ore);
+	}
+
+	DecorationManager decomgr(&gamedef);
+	for (int i = 0; i < 8; i++) {
+		auto deco = static_cast<DecoSimple *>(DecorationManager::create(DECO_SIMPLE));
+		deco->c_place_on = {c_stone};
+		deco->c_decos = {c_plant};
+		deco->fill_ratio = 0.1f;
+		deco->y_min = nmin.Y;
+		deco->y_max = nmax.Y;
+		deco->nspawnby = -1;
+		deco->deco_height = 1;
+		deco->deco_height_max = 4;
+		deco->deco_param2 = 0;
+		deco->deco_param2_max = 0;
+		decomgr.add(deco);
+	}
+
+	auto place = [&] {
+		std::copy(terrain.begin(), terrain.end(), vm.m_data);
+		oremgr.placeAllOres(&mg, 1234, nmin, nmax);
+		decomgr.placeAllDecos(&mg, 1234, nmin, nmax);
+	};
+
+	BENCHMARK("placement_serial") {
+		mg.tile_placer = nullptr;
+		place();
+	};
+
+	for (size_t threads : {1, 2, 4, 8}) {
+		TilePlacer placer(threads);
+		mg.tile_placer = &placer;
+		BENCHMARK("placement_tiled_" + std::to_string(threads) + "t") {
+			place();
+		};
+		mg.tile_placer = nullptr;
+	}
+}
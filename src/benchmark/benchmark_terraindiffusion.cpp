@@ -0,0 +1,83 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "mapgen/mapgen_terraindiffusion.h"
+#include "mapgen/mapgen_terraindiffusion_native.h"
+
+// Needs exported models, same setup as TestTerrainDiffusion, no disk cache
+TEST_CASE("benchmark_terraindiffusion")
+{
+	const char *model_dir = std::getenv("FREEMINER_TD_MODEL_DIR");
+	if (!model_dir)
+		return;
+
+	// Chunks far apart, every one needs new tiles
+	auto chunk_x = [](int chunk) { return (chunk % 2000 - 1000) * 1000000; };
+	int next_chunk = 0;
+	auto sample_chunk = [&](TerrainDiffusionNativePipeline &pipeline) {
+		const int x = chunk_x(next_chunk++);
+		std::vector<TerrainDiffusionSample> samples;
+		return pipeline.sampleGrid(x, 0, x + 79, 79, samples);
+	};
+
+	auto tiles_per_sec = [&](size_t threads, unsigned int batch_size) {
+		// Pipelines with the same options share tiles and batches
+		std::vector<std::unique_ptr<TerrainDiffusionNativePipeline>> pipelines;
+		for (size_t t = 0; t < threads; ++t) {
+			pipelines.emplace_back(std::make_unique<TerrainDiffusionNativePipeline>(1,
+					30, 1.0f, 0.0f, 0.7f, 256, 1024, "cpu", 0, 8, "", false,
+					batch_size));
+			REQUIRE(pipelines.back()->load(model_dir));
+		}
+		const int first_chunk = next_chunk;
+		next_chunk += 4 * static_cast<int>(threads);
+		const uint64_t before = pipelines[0]->tilesGenerated();
+		const auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; ++t)
+			workers.emplace_back([&, t] {
+				for (int i = 0; i < 4; ++i) {
+					const int x = chunk_x(first_chunk + i * static_cast<int>(threads) +
+										  static_cast<int>(t));
+					std::vector<TerrainDiffusionSample> samples;
+					pipelines[t]->sampleGrid(x, 0, x + 79, 79, samples);
+				}
+			});
+		for (auto &worker : workers)
+			worker.join();
+		const std::chrono::duration<double> elapsed =
+				std::chrono::steady_clock::now() - start;
+		return (pipelines[0]->tilesGenerated() - before) / elapsed.count();
+	};
+
+	TerrainDiffusionNativePipeline pipeline(
+			1, 30, 1.0f, 0.0f, 0.7f, 8, 128, "cpu", 0, 8, "", false);
+	REQUIRE(pipeline.load(model_dir));
+	BENCHMARK("td_chunk_cold") {
+		return sample_chunk(pipeline);
+	};
+
+	WARN("tiles/sec 1 thread batch 1: " << tiles_per_sec(1, 1));
+	WARN("tiles/sec 4 threads batch 1: " << tiles_per_sec(4, 1));
+	WARN("tiles/sec 4 threads batch 4: " << tiles_per_sec(4, 4));
+}
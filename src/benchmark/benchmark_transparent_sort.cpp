@@ -0,0 +1,98 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include "client/mapblock_mesh.h"
+#include "constants.h"
+
+// Water surface with wave bumps and a few glass walls, like a lake block
+static void make_lake(scene::SMeshBuffer *buffer, std::vector<MeshTriangle> &triangles)
+{
+	const auto quad = [&](v3f p0, v3f p1, v3f p2, v3f p3) {
+		const u16 base = buffer->getVertexCount();
+		for (const auto &pos : {p0, p1, p2, p3})
+			buffer->Vertices->Data.emplace_back(pos, v3f(0, 1, 0), video::SColor(), v2f());
+		for (const u16 i : {0, 1, 2, 2, 3, 0})
+			buffer->Indices->Data.push_back(base + i);
+		for (const u16 i : {0, 3}) {
+			MeshTriangle t;
+			t.buffer = buffer;
+			t.p1 = base + i;
+			t.p2 = base + (i + 1) % 4;
+			t.p3 = base + (i + 2) % 4;
+			t.updateAttributes();
+			triangles.push_back(t);
+		}
+	};
+	const f32 h = BS / 2;
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			const v3f c(x * BS, (MAP_BLOCKSIZE / 2) * BS + h - (x + z) % 3 * 0.1f * BS, z * BS);
+			quad(c + v3f(-h, 0, -h), c + v3f(-h, 0, h), c + v3f(h, 0, h), c + v3f(h, 0, -h));
+			if (x % 5 == 2 && z % 3)
+				quad(c + v3f(-h, -BS, -h), c + v3f(-h, 0, -h), c + v3f(-h, 0, h),
+						c + v3f(-h, -BS, h));
+		}
+}
+
+TEST_CASE("benchmark_transparent_sort")
+{
+	irr_ptr<scene::SMeshBuffer> buffer(new scene::SMeshBuffer());
+	std::vector<MeshTriangle> triangles;
+	make_lake(buffer.get(), triangles);
+	MapBlockBspTree tree;
+	tree.buildTree(&triangles, MAP_BLOCKSIZE);
+
+	// Swimming across the block, a bit less than a node per frame
+	std::vector<v3f> path;
+	for (f32 t = 0; t < 1; t += 1.0f / 256)
+		path.emplace_back((t * 3 - 1) * MAP_BLOCKSIZE * BS,
+				(MAP_BLOCKSIZE / 2 + 1.7f) * BS, (0.3f + t * 0.4f) * MAP_BLOCKSIZE * BS);
+
+	std::vector<s32> order;
+	BENCHMARK("traverse")
+	{
+		size_t count = 0;
+		for (const auto &camera : path) {
+			order.clear();
+			tree.traverse(camera, order);
+			count += order.size();
+		}
+		return count;
+	};
+
+	std::vector<u8> sides, last_sides;
+	size_t reordered = 0;
+	BENCHMARK("sides")
+	{
+		reordered = 0;
+		for (const auto &camera : path) {
+			tree.getSides(camera, sides);
+			if (sides != last_sides) {
+				order.clear();
+				tree.traverse(camera, order);
+				sides.swap(last_sides);
+				++reordered;
+			}
+		}
+		return reordered;
+	};
+
+	WARN("triangles: " << triangles.size() << " steps: " << path.size()
+			<< " reordered: " << reordered);
+	CHECK(reordered < path.size());
+}
@@ -0,0 +1,106 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "catch.h"
+#include "constants.h"
+#include "fm_visibility.h"
+#include "noise.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Solid ground with worm caves where two noises are both near zero
+static bool cave_open(pos_t x, pos_t y, pos_t z)
+{
+	const float n1 = noise3d_value(x / 24.0f, y / 12.0f, z / 24.0f, 11, true);
+	const float n2 = noise3d_value(x / 24.0f, y / 12.0f, z / 24.0f, 23, true);
+	return std::fabs(n1) < 0.12f && std::fabs(n2) < 0.12f;
+}
+
+TEST_CASE("benchmark_visibility")
+{
+	const bpos_t size = 16, height = 6, range = 7;
+	const uint16_t side = MAP_BLOCKSIZE;
+	const auto index = [&](const v3bpos_t &pos) {
+		return (pos.Z * height + pos.Y) * size + pos.X;
+	};
+
+	std::vector<std::vector<uint8_t>> opaque(size * height * size);
+	v3bpos_t pos;
+	for (pos.Z = 0; pos.Z < size; ++pos.Z)
+		for (pos.Y = 0; pos.Y < height; ++pos.Y)
+			for (pos.X = 0; pos.X < size; ++pos.X) {
+				auto &nodes = opaque[index(pos)];
+				nodes.resize(side * side * side);
+				const v3pos_t min = pos * MAP_BLOCKSIZE;
+				for (pos_t z = 0; z < side; ++z)
+					for (pos_t y = 0; y < side; ++y)
+						for (pos_t x = 0; x < side; ++x)
+							nodes[(z * side + y) * side + x] =
+									!cave_open(min.X + x, min.Y + y, min.Z + z);
+			}
+
+	std::vector<face_connectivity_t> connectivity(opaque.size());
+	BENCHMARK("face_connectivity")
+	{
+		for (size_t i = 0; i < opaque.size(); ++i)
+			connectivity[i] = face_connectivity(opaque[i], side);
+		return connectivity.size();
+	};
+
+	// Camera in the most open block near the middle
+	v3bpos_t camera(size / 2, height / 2, size / 2);
+	size_t most_open = 0;
+	for (pos.Z = size / 2 - 2; pos.Z <= size / 2 + 2; ++pos.Z)
+		for (pos.Y = 1; pos.Y < height - 1; ++pos.Y)
+			for (pos.X = size / 2 - 2; pos.X <= size / 2 + 2; ++pos.X) {
+				const auto &nodes = opaque[index(pos)];
+				const size_t open = std::count(nodes.begin(), nodes.end(), 0);
+				if (open > most_open) {
+					most_open = open;
+					camera = pos;
+				}
+			}
+
+	const auto get = [&](const v3bpos_t &pos) -> face_connectivity_t {
+		if (pos.X < 0 || pos.Y < 0 || pos.Z < 0 || pos.X >= size || pos.Y >= height ||
+				pos.Z >= size)
+			return 0;
+		return connectivity[index(pos)];
+	};
+
+	unordered_set_v3bpos visible;
+	BENCHMARK("visible_cells")
+	{
+		visible.clear();
+		visible_cells(camera, 1, range, get, visible);
+		return visible.size();
+	};
+
+	size_t in_range = 0, drawn = 0;
+	for (pos.Z = camera.Z - range; pos.Z <= camera.Z + range; ++pos.Z)
+		for (pos.Y = camera.Y - range; pos.Y <= camera.Y + range; ++pos.Y)
+			for (pos.X = camera.X - range; pos.X <= camera.X + range; ++pos.X) {
+				if (pos.X < 0 || pos.Y < 0 || pos.Z < 0 || pos.X >= size ||
+						pos.Y >= height || pos.Z >= size)
+					continue;
+				++in_range;
+				drawn += visible.contains(pos);
+			}
+	WARN("blocks in range: " << in_range << " culled: " << in_range - drawn);
+	CHECK(drawn > 0);
+}
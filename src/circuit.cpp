@@ -28,20 +28,45 @@
 #include "key_value_storage.h"
 #include "filesys.h"
 
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <set>
+#include <unordered_map>
 #include <iomanip>
 #include <cassert>
+#include <cctype>
+#include <cstring>
+#include <functional>
 #include <string>
 #include <sstream>
 #include <fstream>
 
-const u32 Circuit::circuit_simulator_version = 1;
+const u32 Circuit::circuit_simulator_version = 3;
 const char Circuit::elements_states_file[] = "circuit_elements_states";
+const char Circuit::meta_key[] = "meta";
+
+static std::string element_key(u32 id) {
+	return "e" + std::to_string(id);
+}
+
+static std::string virtual_element_key(u32 id) {
+	return "v" + std::to_string(id);
+}
+
+static std::string state_key(u32 id) {
+	return "s" + std::to_string(id);
+}
+
+static std::string block_key(v3bpos_t pos) {
+	return "b" + std::to_string(pos.X) + "," + std::to_string(pos.Y) + "," + std::to_string(pos.Z);
+}
 
 Circuit::Circuit(ServerScripting* script, Map* map, const NodeDefManager* ndef, const std::string & savedir) :
 	m_script(script),
 	m_map(map),
 	m_ndef(ndef),
+	m_graph_changed(true),
 	m_min_update_delay(0.2f),
 	m_since_last_update(0.0f),
 	m_min_save_delay(60.0f),
@@ -54,44 +79,37 @@ Circuit::Circuit(ServerScripting* script, Map* map, const NodeDefManager* ndef,
 
 Circuit::~Circuit() {
 	save();
+	// Virtual elements disconnect the faces of their members
+	m_virtual_elements.clear();
 	m_elements.clear();
 	delete m_database;
-	delete m_virtual_database;
 	m_script = nullptr;
 	m_map = nullptr;
 	m_ndef = nullptr;
 	m_database = nullptr;
-	m_virtual_database = nullptr;
 }
 
 void Circuit::open() {
 	m_database->open();
-	m_virtual_database->open();
 }
 
 void Circuit::close() {
 	m_database->close();
-	m_virtual_database->close();
 }
 
 void Circuit::addBlock(MapBlock* block) {
-	// v3POS pos;
-	// for(pos.X = 0; pos.X < 16; ++pos.X)
-	// {
-	// 	for(pos.Y = 0; pos.Y < 16; ++pos.Y)
-	// 	{
-	// 		for(pos.Z = 0; pos.Z < 16; ++pos.Z)
-	// 		{
-	// 			MapNode tmp_node = block->getNode(pos);
-	// 			if(ndef->get(tmp_node).is_circuit_element)
-	// 			{
-	// 				pos.X = m_pos.X * MAP_BLOCKSIZE + x;
-	// 				pos.Y = m_pos.Y * MAP_BLOCKSIZE + y;
-	// 				pos.Z = m_pos.Z * MAP_BLOCKSIZE + z;
-	// 			}
-	// 		}
-	// 	}
-	// }
+	const auto lock = m_elements_mutex.lock_unique_rec();
+	loadBlock(block->getPos());
+	auto waiting = m_waiting_blocks.find(block->getPos());
+	if(waiting == m_waiting_blocks.end()) {
+		return;
+	}
+	std::vector <v3pos_t> positions;
+	positions.swap(waiting->second);
+	m_waiting_blocks.erase(waiting);
+	for(auto i = positions.begin(); i != positions.end(); ++i) {
+		queuePosition(*i);
+	}
 }
 
 void Circuit::addNode(v3pos_t pos) {
@@ -141,6 +159,7 @@ void Circuit::swapNode(v3pos_t pos, const MapNode& n_old, const MapNode& n_new)
 
 void Circuit::addElement(v3pos_t pos) {
 	const auto lock = m_elements_mutex.lock_unique_rec();
+	m_graph_changed = true;
 
 	bool already_existed[6];
 	bool connected_faces[6] = {0};
@@ -148,15 +167,22 @@ void Circuit::addElement(v3pos_t pos) {
 	std::vector <std::pair <std::list <CircuitElement>::iterator, u8> > connected;
 	MapNode node = m_map->getNode(pos);
 
+	// Saved elements of the block are there before the new one
+	const v3bpos_t block_pos = getNodeBlockPos(pos);
+	loadBlock(block_pos);
 	auto current_element_iterator = m_elements.insert(m_elements.begin(),
 	                                CircuitElement(pos, m_max_id++, m_ndef->get(node).circuit_element_delay));
 	m_pos_to_iterator[pos] = current_element_iterator;
+	m_loaded_ids.insert(current_element_iterator->getId());
+	m_block_elements[block_pos].insert(current_element_iterator->getId());
+	m_dirty_blocks.insert(block_pos);
 
 	// For each face add all other connected faces.
 	for(int i = 0; i < 6; ++i) {
 		if(!connected_faces[i]) {
 			connected.clear();
-			CircuitElement::findConnectedWithFace(connected, m_map, m_ndef, pos, SHIFT_TO_FACE(i), m_pos_to_iterator, connected_faces);
+			CircuitElement::findConnectedWithFace(connected, m_map, m_ndef, pos, SHIFT_TO_FACE(i),
+			                                      std::bind_front(&Circuit::findElement, this), connected_faces);
 			if(connected.size() > 0) {
 				std::list <CircuitElementVirtual>::iterator virtual_element_it;
 				bool found = false;
@@ -195,33 +221,49 @@ void Circuit::addElement(v3pos_t pos) {
 		}
 	}
 
+	queuePosition(pos);
 	for(int i = 0; i < 6; ++i) {
-		if(current_element_iterator->getFace(i).is_connected && !already_existed[i]) {
-			saveVirtualElement(current_element_iterator->getFace(i).list_pointer, true);
+		if(current_element_iterator->getFace(i).is_connected) {
+			queueMembers(*current_element_iterator->getFace(i).list_pointer);
+			if(!already_existed[i]) {
+				saveVirtualElement(current_element_iterator->getFace(i).list_pointer, true);
+			}
 		}
 	}
 	saveElement(current_element_iterator, true);
-
+	saveState(current_element_iterator);
 }
 
 void Circuit::removeElement(v3pos_t pos) {
 	const auto lock = m_elements_mutex.lock_unique_rec();
+	std::list <CircuitElement>::iterator current_element;
+	if(!findElement(pos, current_element)) {
+		return;
+	}
+	m_graph_changed = true;
 
 	std::vector <std::list <CircuitElementVirtual>::iterator> virtual_elements_for_update;
-	std::list <CircuitElement>::iterator current_element = m_pos_to_iterator[pos];
-	m_database->del(itos(current_element->getId()));
+	const u32 id = current_element->getId();
+	const v3bpos_t block_pos = getNodeBlockPos(pos);
+	m_database->del_pending(element_key(id));
+	m_database->del_pending(state_key(id));
+	m_dirty_states.erase(id);
+	m_loaded_ids.erase(id);
+	m_block_elements[block_pos].erase(id);
+	m_dirty_blocks.insert(block_pos);
 
 	current_element->getNeighbors(virtual_elements_for_update);
 
 	m_elements.erase(current_element);
 
 	for(auto i = virtual_elements_for_update.begin(); i != virtual_elements_for_update.end(); ++i) {
+		queueMembers(**i);
 		if((*i)->size() > 1) {
 			std::ostringstream out(std::ios_base::binary);
 			(*i)->serialize(out);
-			m_virtual_database->put(itos((*i)->getId()), out.str());
+			m_database->put_pending(virtual_element_key((*i)->getId()), out.str());
 		} else {
-			m_virtual_database->del(itos((*i)->getId()));
+			m_database->del_pending(virtual_element_key((*i)->getId()));
 			std::list <CircuitElement>::iterator element_to_save;
 			for(auto j = (*i)->begin(); j != (*i)->end(); ++j) {
 				element_to_save = j->element_pointer;
@@ -236,6 +278,7 @@ void Circuit::removeElement(v3pos_t pos) {
 
 void Circuit::addWire(v3pos_t pos) {
 	const auto lock = m_elements_mutex.lock_unique_rec();
+	m_graph_changed = true;
 
 	// This is used for converting elements of current_face_connected to their ids in all_connected.
 	std::vector <std::pair <std::list <CircuitElement>::iterator, u8> > all_connected;
@@ -248,7 +291,7 @@ void Circuit::addWire(v3pos_t pos) {
 	std::vector <std::pair <std::list <CircuitElement>::iterator, u8> > connected_to_face[6];
 	for(int i = 0; i < 6; ++i) {
 		CircuitElement::findConnectedWithFace(connected_to_face[i], m_map, m_ndef, pos, SHIFT_TO_FACE(i),
-		                                      m_pos_to_iterator, connected_faces);
+		                                      std::bind_front(&Circuit::findElement, this), connected_faces);
 	}
 
 	for(int i = 0; i < 6; ++i) {
@@ -285,7 +328,7 @@ void Circuit::addWire(v3pos_t pos) {
 				for(auto i = all_connected.begin(); i != all_connected.end(); ++i) {
 					if(i->first->getFace(i->second).is_connected
 					        && (i->first->getFace(i->second).list_pointer != element_with_virtual.list_pointer)) {
-						m_virtual_database->del(itos(i->first->getFace(i->second).list_pointer->getId()));
+						m_database->del_pending(virtual_element_key(i->first->getFace(i->second).list_pointer->getId()));
 						i->first->disconnectFace(i->second);
 						m_virtual_elements.erase(i->first->getFace(i->second).list_pointer);
 					}
@@ -310,12 +353,14 @@ void Circuit::addWire(v3pos_t pos) {
 	}
 
 	for(u32 i = 0; i < created_virtual_elements.size(); ++i) {
+		queueMembers(*created_virtual_elements[i]);
 		saveVirtualElement(created_virtual_elements[i], true);
 	}
 }
 
 void Circuit::removeWire(v3pos_t pos) {
 	const auto lock = m_elements_mutex.lock_unique_rec();
+	m_graph_changed = true;
 
 	std::vector <std::pair <std::list <CircuitElement>::iterator, u8> > current_face_connected;
 
@@ -329,19 +374,20 @@ void Circuit::removeWire(v3pos_t pos) {
 	for(int i = 0; i < 6; ++i) {
 		if(!connected_faces[i]) {
 			current_face_connected.clear();
-			CircuitElement::findConnectedWithFace(current_face_connected, m_map, m_ndef, pos,
-			                                      SHIFT_TO_FACE(i), m_pos_to_iterator, connected_faces);
+			CircuitElement::findConnectedWithFace(current_face_connected, m_map, m_ndef, pos, SHIFT_TO_FACE(i),
+			                                      std::bind_front(&Circuit::findElement, this), connected_faces);
 			for(auto j = current_face_connected.begin(); j != current_face_connected.end(); ++j) {
 				CircuitElementContainer current_edge = j->first->getFace(j->second);
 				if(current_edge.is_connected) {
 					found_virtual_elements = true;
-					m_virtual_database->del(itos(current_edge.list_pointer->getId()));
+					m_database->del_pending(virtual_element_key(current_edge.list_pointer->getId()));
 					m_virtual_elements.erase(current_edge.list_pointer);
 					break;
 				}
 			}
 
 			for(auto j = current_face_connected.begin(); j != current_face_connected.end(); ++j) {
+				queuePosition(j->first->getPos());
 				saveElement(j->first, false);
 			}
 		}
@@ -357,7 +403,7 @@ void Circuit::removeWire(v3pos_t pos) {
 			if(!connected_faces[i]) {
 				current_face_connected.clear();
 				CircuitElement::findConnectedWithFace(current_face_connected, m_map, m_ndef, pos, SHIFT_TO_FACE(i),
-				                                      m_pos_to_iterator, connected_faces);
+				                                      std::bind_front(&Circuit::findElement, this), connected_faces);
 
 				if(current_face_connected.size() > 1) {
 					auto new_virtual_element = m_virtual_elements.insert(
@@ -385,28 +431,11 @@ void Circuit::update(float dtime) {
 	if(m_since_last_update > m_min_update_delay) {
 		const auto lock = m_elements_mutex.lock_unique_rec();
 		m_since_last_update -= m_min_update_delay;
-		// Each element send signal to other connected virtual elements.
-		bool is_map_loaded = true;
-		for(auto i = m_elements.begin(); i != m_elements.end(); ++i) {
-			i->update();
-		}
-
-		// Each virtual element send signal to other connected elements.
-		for(auto i = m_virtual_elements.begin(); i != m_virtual_elements.end(); ++i) {
-			i->update();
+		if(m_graph_changed) {
+			compile();
 		}
-
-		// Update state of each element.
-		for(auto i = m_elements.begin(); i != m_elements.end(); ++i) {
-			if(!i->updateState(m_script, m_map, m_ndef)) {
-				is_map_loaded = false;
-				break;
-			}
-		}
-		if(!is_map_loaded) {
-			for(auto i = m_elements.begin(); i != m_elements.end(); ++i) {
-				i->resetState();
-			}
+		if(!m_worklist.empty()) {
+			step();
 		}
 	} else {
 		m_since_last_update += dtime;
@@ -420,53 +449,482 @@ void Circuit::update(float dtime) {
 	}
 }
 
+void Circuit::compile() {
+	Graph& g = m_graph;
+	std::unordered_map <const CircuitElement*, u32>& element_ids = g.ids;
+	std::unordered_map <const CircuitElementVirtual*, u32> virtual_ids;
+
+	g.elements.clear();
+	g.positions.clear();
+	element_ids.clear();
+	for(auto i = m_elements.begin(); i != m_elements.end(); ++i) {
+		element_ids[&*i] = g.elements.size();
+		g.elements.push_back(i);
+		g.positions.push_back(i->getPos());
+	}
+	u32 virtual_count = 0;
+	for(auto i = m_virtual_elements.begin(); i != m_virtual_elements.end(); ++i) {
+		virtual_ids[&*i] = virtual_count++;
+	}
+
+	const u32 element_count = g.elements.size();
+	g.edge_begin.assign(element_count + 1, 0);
+	g.edge_virtual.clear();
+	g.edge_shift.clear();
+	g.outputs.resize(element_count);
+	g.drivers.assign(virtual_count, 0);
+	for(u32 i = 0; i < element_count; ++i) {
+		g.edge_begin[i] = g.edge_virtual.size();
+		g.outputs[i] = g.elements[i]->getOutputState();
+		for(int j = 0; j < 6; ++j) {
+			const CircuitElementContainer face = g.elements[i]->getFace(j);
+			if(!face.is_connected) {
+				continue;
+			}
+			auto virtual_id = virtual_ids.find(&*face.list_pointer);
+			if(virtual_id == virtual_ids.end()) {
+				continue;
+			}
+			g.edge_virtual.push_back(virtual_id->second);
+			g.edge_shift.push_back(j);
+			if(g.outputs[i] & SHIFT_TO_FACE(j)) {
+				++g.drivers[virtual_id->second];
+			}
+		}
+	}
+	g.edge_begin[element_count] = g.edge_virtual.size();
+
+	// Components by union of the members of each virtual element
+	std::vector <u32> parent(element_count);
+	for(u32 i = 0; i < element_count; ++i) {
+		parent[i] = i;
+	}
+	auto find = [&parent](u32 i) {
+		while(parent[i] != i) {
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	};
+
+	g.member_begin.assign(virtual_count + 1, 0);
+	g.member_element.clear();
+	u32 virtual_id = 0;
+	for(auto i = m_virtual_elements.begin(); i != m_virtual_elements.end(); ++i, ++virtual_id) {
+		g.member_begin[virtual_id] = g.member_element.size();
+		for(auto j = i->begin(); j != i->end(); ++j) {
+			auto element_id = element_ids.find(&*j->element_pointer);
+			if(element_id == element_ids.end()) {
+				continue;
+			}
+			if(g.member_element.size() > g.member_begin[virtual_id]) {
+				parent[find(element_id->second)] = find(g.member_element[g.member_begin[virtual_id]]);
+			}
+			g.member_element.push_back(element_id->second);
+		}
+	}
+	g.member_begin[virtual_count] = g.member_element.size();
+
+	g.component.resize(element_count);
+	for(u32 i = 0; i < element_count; ++i) {
+		g.component[i] = find(i);
+	}
+
+	// Only the elements touched by the changes, the others keep their inputs
+	m_worklist.clear();
+	g.queued.assign(element_count, false);
+	m_graph_changed = false;
+	std::vector <v3pos_t> queue;
+	queue.swap(m_elements_queue);
+	for(auto i = queue.begin(); i != queue.end(); ++i) {
+		queuePosition(*i);
+	}
+}
+
+inline void Circuit::queueElement(u32 element) {
+	if(!m_graph.queued[element]) {
+		m_graph.queued[element] = true;
+		m_worklist.push_back(element);
+	}
+}
+
+void Circuit::queuePosition(v3pos_t pos) {
+	if(m_graph_changed) {
+		m_elements_queue.push_back(pos);
+		return;
+	}
+	auto element = m_pos_to_iterator.find(pos);
+	if(element == m_pos_to_iterator.end()) {
+		return;
+	}
+	auto id = m_graph.ids.find(&*element->second);
+	if(id != m_graph.ids.end()) {
+		queueElement(id->second);
+	}
+}
+
+void Circuit::queueMembers(const CircuitElementVirtual& virtual_element) {
+	for(auto i = virtual_element.begin(); i != virtual_element.end(); ++i) {
+		queuePosition(i->element_pointer->getPos());
+	}
+}
+
+void Circuit::step() {
+	Graph& g = m_graph;
+	std::vector <MapNode> nodes;
+	std::vector <u8> inputs;
+	// Elements a node callback changed the graph for, looked at in the next update
+	std::vector <v3pos_t> next;
+	std::vector <u32> work;
+	while(!m_worklist.empty()) {
+		work.clear();
+		work.swap(m_worklist);
+		for(auto i = work.begin(); i != work.end(); ++i) {
+			g.queued[*i] = false;
+		}
+		std::sort(work.begin(), work.end(), [&g](u32 a, u32 b) {
+			return g.component[a] != g.component[b] ? g.component[a] < g.component[b] : a < b;
+		});
+
+		bool recompiled = false;
+		for(size_t begin = 0, end = 0; begin < work.size() && !recompiled; begin = end) {
+			end = begin;
+			while(end < work.size() && g.component[work[end]] == g.component[work[begin]]) {
+				++end;
+			}
+
+			// Map not yet loaded, the component keeps its state until addBlock()
+			nodes.clear();
+			bool is_map_loaded = true;
+			for(size_t i = begin; i < end; ++i) {
+				nodes.push_back(m_map->getNode(g.positions[work[i]]));
+				if(!nodes.back()) {
+					auto& waiting = m_waiting_blocks[getNodeBlockPos(g.positions[work[i]])];
+					for(size_t j = begin; j < end; ++j) {
+						waiting.push_back(g.positions[work[j]]);
+					}
+					is_map_loaded = false;
+					break;
+				}
+			}
+			if(!is_map_loaded) {
+				verbosestream << "Circuit simulator: Waiting for map block loading at "
+				              << g.positions[work[begin]] << std::endl;
+				continue;
+			}
+
+			// Inputs are taken from outputs of the previous update
+			inputs.clear();
+			for(size_t i = begin; i < end; ++i) {
+				u8 input = 0;
+				for(u32 j = g.edge_begin[work[i]]; j < g.edge_begin[work[i] + 1]; ++j) {
+					if(g.drivers[g.edge_virtual[j]]) {
+						input |= SHIFT_TO_FACE(g.edge_shift[j]);
+					}
+				}
+				inputs.push_back(input);
+			}
+
+			for(size_t i = begin; i < end; ++i) {
+				const u32 element = work[i];
+				auto element_it = g.elements[element];
+				element_it->setNextInputState(inputs[i - begin]);
+				element_it->updateState(m_script, nodes[i - begin], m_ndef);
+				if(m_graph_changed) {
+					// Changed by a node callback, the element may be gone. It and
+					// its neighbours look again in the next update, as do the
+					// elements queued for it and the ones touched by the change
+					next.insert(next.end(), m_elements_queue.begin(), m_elements_queue.end());
+					m_elements_queue.clear();
+					next.push_back(g.positions[element]);
+					for(u32 j = g.edge_begin[element]; j < g.edge_begin[element + 1]; ++j) {
+						const u32 virtual_id = g.edge_virtual[j];
+						for(u32 k = g.member_begin[virtual_id]; k < g.member_begin[virtual_id + 1]; ++k) {
+							next.push_back(g.positions[g.member_element[k]]);
+						}
+					}
+					for(auto j = m_worklist.begin(); j != m_worklist.end(); ++j) {
+						next.push_back(g.positions[*j]);
+					}
+					// The rest of this update goes on over the new graph
+					for(size_t j = i + 1; j < work.size(); ++j) {
+						m_elements_queue.push_back(g.positions[work[j]]);
+					}
+					compile();
+					recompiled = true;
+					break;
+				}
+
+				const u8 output = element_it->getOutputState();
+				const u8 changed = output ^ g.outputs[element];
+				g.outputs[element] = output;
+				for(u32 j = g.edge_begin[element]; changed && j < g.edge_begin[element + 1]; ++j) {
+					if(!(changed & SHIFT_TO_FACE(g.edge_shift[j]))) {
+						continue;
+					}
+					const u32 virtual_id = g.edge_virtual[j];
+					const bool was_driven = g.drivers[virtual_id];
+					if(output & SHIFT_TO_FACE(g.edge_shift[j])) {
+						++g.drivers[virtual_id];
+					} else {
+						--g.drivers[virtual_id];
+					}
+					if(was_driven != static_cast<bool>(g.drivers[virtual_id])) {
+						for(u32 k = g.member_begin[virtual_id]; k < g.member_begin[virtual_id + 1]; ++k) {
+							queueElement(g.member_element[k]);
+						}
+					}
+				}
+				saveState(element_it);
+				// Delayed signals are still on the way
+				if(!element_it->isSettled()) {
+					queueElement(element);
+				}
+			}
+		}
+		if(!recompiled) {
+			break;
+		}
+	}
+	for(auto i = next.begin(); i != next.end(); ++i) {
+		queuePosition(*i);
+	}
+}
 
 void Circuit::swapElement(const MapNode& n_old, const MapNode& n_new, v3pos_t pos) {
 	const auto lock = m_elements_mutex.lock_unique_rec();
 
+	// Placed without addNode(), by a voxel manipulator or the mapgen
+	std::list <CircuitElement>::iterator current_element;
+	if(!findElement(pos, current_element)) {
+		addElement(pos);
+		return;
+	}
+
 	const ContentFeatures& n_old_features = m_ndef->get(n_old);
 	const ContentFeatures& n_new_features = m_ndef->get(n_new);
-	std::list <CircuitElement>::iterator current_element = m_pos_to_iterator[pos];
+	std::list <CircuitElementVirtual>::iterator old_faces[6];
+	for(int i = 0; i < 6; ++i) {
+		const CircuitElementContainer face = current_element->getFace(i);
+		old_faces[i] = face.is_connected ? face.list_pointer : m_virtual_elements.end();
+	}
 	current_element->swap(n_old, n_old_features, n_new, n_new_features);
-	saveElement(current_element, false);
 
+	// Mostly the same node turned on or off, only a rotation moves the edges
+	bool moved = false;
+	for(int i = 0; i < 6; ++i) {
+		const CircuitElementContainer face = current_element->getFace(i);
+		if((face.is_connected ? face.list_pointer : m_virtual_elements.end()) != old_faces[i]) {
+			moved = true;
+		}
+	}
+	if(moved) {
+		m_graph_changed = true;
+		for(int i = 0; i < 6; ++i) {
+			if(current_element->getFace(i).is_connected) {
+				queueMembers(*current_element->getFace(i).list_pointer);
+			}
+		}
+	}
+	queuePosition(pos);
+	// Shifts of the faces are stored with the virtual elements
+	saveElement(current_element, moved);
+	saveState(current_element);
 }
 
 void Circuit::load() {
-	u32 element_id;
+	m_database = new KeyValueStorage(m_savedir, "circuit");
+	m_graph_changed = true;
+
+	std::string meta;
+	if(!m_database->get(meta_key, meta)) {
+		loadLegacy();
+		return;
+	}
+	// Elements are read with their blocks
+	std::istringstream in(meta, std::ios_base::binary);
 	u32 version = 0;
+	in.read(reinterpret_cast<char*>(&version), sizeof(version));
+	in.read(reinterpret_cast<char*>(&m_max_id), sizeof(m_max_id));
+	in.read(reinterpret_cast<char*>(&m_max_virtual_id), sizeof(m_max_virtual_id));
+	if(!in.good() || version != circuit_simulator_version) {
+		throw SerializationError("Circuit simulator: database meta seems to be corrupted.");
+	}
+}
+
+bool Circuit::findElement(v3pos_t pos, std::list <CircuitElement>::iterator& element) {
+	loadBlock(getNodeBlockPos(pos));
+	auto found = m_pos_to_iterator.find(pos);
+	if(found == m_pos_to_iterator.end()) {
+		return false;
+	}
+	element = found->second;
+	return true;
+}
+
+void Circuit::loadBlock(v3bpos_t pos) {
+	if(m_block_elements.count(pos)) {
+		return;
+	}
+	std::set <u32>& ids = m_block_elements[pos];
+	std::string data;
+	if(!m_database->get(block_key(pos), data)) {
+		return;
+	}
+	for(size_t i = 0; i + sizeof(u32) <= data.size(); i += sizeof(u32)) {
+		u32 id;
+		memcpy(&id, data.data() + i, sizeof(id));
+		ids.insert(id);
+	}
+
+	// New elements are inserted at the front
+	const auto elements_end = m_elements.begin();
+	const auto virtual_elements_end = m_virtual_elements.begin();
+	for(auto i = ids.begin(); i != ids.end(); ++i) {
+		if(!m_loaded_ids.count(*i)) {
+			loadComponent(*i);
+		}
+	}
+	disconnectUnlisted(elements_end, virtual_elements_end);
+}
+
+void Circuit::loadComponent(u32 id) {
+	std::unordered_map <u32, std::string> elements_data, virtual_elements_data;
+	std::vector <u32> elements{id}, virtual_elements;
+	std::string data;
+	u32 element_id;
+
+	// Records of everything connected, ids of the ones missing are skipped
+	while(!elements.empty() || !virtual_elements.empty()) {
+		if(!elements.empty()) {
+			element_id = elements.back();
+			elements.pop_back();
+			if(elements_data.count(element_id) || m_loaded_ids.count(element_id)
+			        || !m_database->get(element_key(element_id), data)) {
+				continue;
+			}
+			// Position, then the virtual element of each face
+			std::istringstream in(data, std::ios_base::binary);
+			in.ignore(sizeof(v3pos_t));
+			for(int i = 0; i < 6; ++i) {
+				u32 virtual_id = 0;
+				in.read(reinterpret_cast<char*>(&virtual_id), sizeof(virtual_id));
+				if(in.good() && virtual_id > 0) {
+					virtual_elements.push_back(virtual_id);
+				}
+			}
+			elements_data[element_id] = data;
+		} else {
+			element_id = virtual_elements.back();
+			virtual_elements.pop_back();
+			if(virtual_elements_data.count(element_id)
+			        || !m_database->get(virtual_element_key(element_id), data)) {
+				continue;
+			}
+			// Number of members, then id and face of each
+			std::istringstream in(data, std::ios_base::binary);
+			u32 connections_num = 0;
+			in.read(reinterpret_cast<char*>(&connections_num), sizeof(connections_num));
+			for(u32 i = 0; i < connections_num && in.good(); ++i) {
+				u32 member_id = 0;
+				in.read(reinterpret_cast<char*>(&member_id), sizeof(member_id));
+				in.ignore(sizeof(u8));
+				elements.push_back(member_id);
+			}
+			virtual_elements_data[element_id] = data;
+		}
+	}
+
+	std::unordered_map <u32, std::list <CircuitElementVirtual>::iterator> id_to_virtual_element;
+	for(auto i = virtual_elements_data.begin(); i != virtual_elements_data.end(); ++i) {
+		id_to_virtual_element[i->first] =
+		    m_virtual_elements.insert(m_virtual_elements.begin(), CircuitElementVirtual(i->first));
+	}
+
+	std::unordered_map <u32, std::list <CircuitElement>::iterator> id_to_element;
 	std::istringstream in(std::ios_base::binary);
+	for(auto i = elements_data.begin(); i != elements_data.end(); ++i) {
+		auto current_element = m_elements.insert(m_elements.begin(), CircuitElement(i->first));
+		id_to_element[i->first] = current_element;
+		in.str(i->second);
+		in.clear();
+		current_element->deSerialize(in, id_to_virtual_element);
+		if(m_database->get(state_key(i->first), data)) {
+			in.str(data);
+			in.clear();
+			// Id is written with the state
+			in.read(reinterpret_cast<char*>(&element_id), sizeof(element_id));
+			current_element->deSerializeState(in);
+		}
+		m_pos_to_iterator[current_element->getPos()] = current_element;
+		m_loaded_ids.insert(i->first);
+		m_graph_changed = true;
+		queuePosition(current_element->getPos());
+	}
 
-	m_database = new KeyValueStorage(m_savedir, "circuit");
-	m_virtual_database = new KeyValueStorage(m_savedir, "circuit_virtual");
+	for(auto i = virtual_elements_data.begin(); i != virtual_elements_data.end(); ++i) {
+		in.str(i->second);
+		in.clear();
+		auto current_element = id_to_virtual_element[i->first];
+		current_element->deSerialize(in, current_element, id_to_element);
+	}
+}
 
-	std::ifstream input_elements_states((m_savedir + DIR_DELIM + elements_states_file).c_str());
+void Circuit::loadLegacy() {
+#if USE_LEVELDB
+	u32 element_id;
+	std::istringstream in(std::ios_base::binary);
+
+	// Opened only when there, not to create them
+	const std::string virtual_path = m_savedir + DIR_DELIM + "circuit_virtual.db";
+	const std::string state_path = m_savedir + DIR_DELIM + "circuit_state.db";
+	const std::string elements_states_path = m_savedir + DIR_DELIM + elements_states_file;
+	std::unique_ptr <KeyValueStorage> virtual_database, state_database;
+	if(fs::PathExists(virtual_path)) {
+		virtual_database.reset(new KeyValueStorage(m_savedir, "circuit_virtual"));
+	}
+	if(fs::PathExists(state_path)) {
+		state_database.reset(new KeyValueStorage(m_savedir, "circuit_state"));
+	}
 
+	std::ifstream input_elements_states(elements_states_path.c_str());
 	if(input_elements_states.good()) {
+		u32 version = 0;
 		input_elements_states.read(reinterpret_cast<char*>(&version), sizeof(version));
 	}
-#if USE_LEVELDB
+
 	// Filling list with empty virtual elements
-	auto virtual_it = m_virtual_database->new_iterator();
-	if (!virtual_it)
-		return;
-	std::map <u32, std::list <CircuitElementVirtual>::iterator> id_to_virtual_element;
-	for(virtual_it->SeekToFirst(); virtual_it->Valid(); virtual_it->Next()) {
-		element_id = stoi(virtual_it->key().ToString());
-		id_to_virtual_element[element_id] =
-		    m_virtual_elements.insert(m_virtual_elements.begin(), CircuitElementVirtual(element_id));
-		if(element_id + 1 > m_max_virtual_id) {
-			m_max_virtual_id = element_id + 1;
+	std::unique_ptr <leveldb::Iterator> virtual_it;
+	if(virtual_database) {
+		virtual_it.reset(virtual_database->new_iterator());
+	}
+	std::unordered_map <u32, std::list <CircuitElementVirtual>::iterator> id_to_virtual_element;
+	if(virtual_it) {
+		for(virtual_it->SeekToFirst(); virtual_it->Valid(); virtual_it->Next()) {
+			element_id = stoi(virtual_it->key().ToString());
+			id_to_virtual_element[element_id] =
+			    m_virtual_elements.insert(m_virtual_elements.begin(), CircuitElementVirtual(element_id));
+			if(element_id + 1 > m_max_virtual_id) {
+				m_max_virtual_id = element_id + 1;
+			}
 		}
 	}
 
-	// Filling list with empty elements
-	auto it = m_database->new_iterator();
-	if (!it)
+	// Filling list with empty elements, keys written by this version are
+	// there when converting was cut short
+	std::unique_ptr <leveldb::Iterator> it(m_database->new_iterator());
+	if(!it) {
 		return;
-	std::map <u32, std::list <CircuitElement>::iterator> id_to_element;
+	}
+	std::vector <std::string> legacy_keys;
+	std::unordered_map <u32, std::list <CircuitElement>::iterator> id_to_element;
 	for(it->SeekToFirst(); it->Valid(); it->Next()) {
-		element_id = stoi(it->key().ToString());
+		const std::string key = it->key().ToString();
+		if(key.empty() || !isdigit(key[0])) {
+			continue;
+		}
+		legacy_keys.push_back(key);
+		element_id = stoi(key);
 		id_to_element[element_id] =
 		    m_elements.insert(m_elements.begin(), CircuitElement(element_id));
 		if(element_id + 1 > m_max_id) {
@@ -485,66 +943,168 @@ void Circuit::load() {
 				                         + elements_states_file + "\" seems to be corrupted.");
 			}
 		}
+	} else if(auto state_it = state_database ? state_database->new_iterator() : nullptr) {
+		for(state_it->SeekToFirst(); state_it->Valid(); state_it->Next()) {
+			auto current_element = id_to_element.find(stoi(state_it->key().ToString()));
+			if(current_element == id_to_element.end()) {
+				continue;
+			}
+			in.str(state_it->value().ToString());
+			in.clear();
+			// Id is written with the state
+			in.read(reinterpret_cast<char*>(&element_id), sizeof(element_id));
+			current_element->second->deSerializeState(in);
+		}
+		delete state_it;
 	}
 
 	// Loading elements data
 	for(it->SeekToFirst(); it->Valid(); it->Next()) {
+		const std::string key = it->key().ToString();
+		if(key.empty() || !isdigit(key[0])) {
+			continue;
+		}
 		in.str(it->value().ToString());
-		element_id = stoi(it->key().ToString());
-		auto current_element = id_to_element[element_id];
+		in.clear();
+		auto current_element = id_to_element[stoi(key)];
 		current_element->deSerialize(in, id_to_virtual_element);
 		m_pos_to_iterator[current_element->getPos()] = current_element;
 	}
-	delete it;
+	it.reset();
 
 	// Loading virtual elements data
-	for(virtual_it->SeekToFirst(); virtual_it->Valid(); virtual_it->Next()) {
-		in.str(virtual_it->value().ToString());
-		element_id = stoi(virtual_it->key().ToString());
-		auto current_element = id_to_virtual_element[element_id];
-		current_element->deSerialize(in, current_element, id_to_element);
+	if(virtual_it) {
+		for(virtual_it->SeekToFirst(); virtual_it->Valid(); virtual_it->Next()) {
+			in.str(virtual_it->value().ToString());
+			in.clear();
+			element_id = stoi(virtual_it->key().ToString());
+			auto current_element = id_to_virtual_element[element_id];
+			current_element->deSerialize(in, current_element, id_to_element);
+		}
+		virtual_it.reset();
 	}
-
-	delete virtual_it;
+	disconnectUnlisted(m_elements.end(), m_virtual_elements.end());
+
+	// Written again with key prefixes, the old keys are read again until
+	// the meta is written after everything else
+	for(auto i = m_elements.begin(); i != m_elements.end(); ++i) {
+		const v3bpos_t block_pos = getNodeBlockPos(i->getPos());
+		m_loaded_ids.insert(i->getId());
+		m_block_elements[block_pos].insert(i->getId());
+		m_dirty_blocks.insert(block_pos);
+		saveElement(i, false);
+		saveState(i);
+		queuePosition(i->getPos());
+	}
+	for(auto i = m_virtual_elements.begin(); i != m_virtual_elements.end(); ++i) {
+		saveVirtualElement(i, false);
+	}
+	saveMeta();
+	if(!flush()) {
+		return;
+	}
+	for(auto i = legacy_keys.begin(); i != legacy_keys.end(); ++i) {
+		m_database->del_pending(*i);
+	}
+	if(!m_database->write_pending()) {
+		return;
+	}
+	virtual_database.reset();
+	state_database.reset();
+	input_elements_states.close();
+	fs::RecursiveDelete(virtual_path);
+	fs::RecursiveDelete(state_path);
+	fs::DeleteSingleFileOrEmptyDirectory(elements_states_path);
 #endif
 }
 
+void Circuit::disconnectUnlisted(std::list <CircuitElement>::iterator elements_end,
+                                 std::list <CircuitElementVirtual>::iterator virtual_elements_end) {
+	std::set <std::pair <const CircuitElement*, u8>> listed;
+	for(auto i = m_virtual_elements.begin(); i != virtual_elements_end; ++i) {
+		for(auto j = i->begin(); j != i->end(); ++j) {
+			listed.emplace(&*j->element_pointer, j->shift);
+		}
+	}
+	for(auto i = m_elements.begin(); i != elements_end; ++i) {
+		for(u8 j = 0; j < 6; ++j) {
+			if(i->getFace(j).is_connected && !listed.count({&*i, j})) {
+				i->disconnectFace(j);
+			}
+		}
+	}
+}
+
 void Circuit::save() {
-	const auto lock = m_elements_mutex.lock_shared_rec();
-	std::ostringstream ostr(std::ios_base::binary);
-	std::ofstream out((m_savedir + DIR_DELIM + elements_states_file).c_str(), std::ios_base::binary);
-	out.write(reinterpret_cast<const char*>(&circuit_simulator_version), sizeof(circuit_simulator_version));
-	for(std::list<CircuitElement>::iterator i = m_elements.begin(); i != m_elements.end(); ++i) {
-		i->serializeState(ostr);
+	const auto lock = m_elements_mutex.lock_unique_rec();
+	flush();
+}
+
+bool Circuit::flush() {
+	for(auto i = m_dirty_states.begin(); i != m_dirty_states.end(); ++i) {
+		std::ostringstream out(std::ios_base::binary);
+		i->second->serializeState(out);
+		m_database->put_pending(state_key(i->first), out.str());
+	}
+	m_dirty_states.clear();
+	for(auto i = m_dirty_blocks.begin(); i != m_dirty_blocks.end(); ++i) {
+		const std::set <u32>& ids = m_block_elements[*i];
+		if(ids.empty()) {
+			m_database->del_pending(block_key(*i));
+			continue;
+		}
+		std::string data;
+		data.reserve(ids.size() * sizeof(u32));
+		for(auto j = ids.begin(); j != ids.end(); ++j) {
+			data.append(reinterpret_cast<const char*>(&*j), sizeof(*j));
+		}
+		m_database->put_pending(block_key(*i), data);
+	}
+	m_dirty_blocks.clear();
+	// Last, a batch written in parts for its size has it in the last one
+	if(m_database->pending_size()) {
+		saveMeta();
 	}
-	out << ostr.str();
+	return m_database->write_pending();
+}
+
+void Circuit::saveMeta() {
+	std::ostringstream out(std::ios_base::binary);
+	out.write(reinterpret_cast<const char*>(&circuit_simulator_version), sizeof(circuit_simulator_version));
+	out.write(reinterpret_cast<const char*>(&m_max_id), sizeof(m_max_id));
+	out.write(reinterpret_cast<const char*>(&m_max_virtual_id), sizeof(m_max_virtual_id));
+	m_database->put_pending(meta_key, out.str());
 }
 
 inline void Circuit::saveElement(std::list<CircuitElement>::iterator element, bool save_edges) {
 	std::ostringstream out(std::ios_base::binary);
 	element->serialize(out);
-	m_database->put(itos(element->getId()), out.str());
+	m_database->put_pending(element_key(element->getId()), out.str());
 	if(save_edges) {
 		for(int i = 0; i < 6; ++i) {
 			CircuitElementContainer tmp_container = element->getFace(i);
 			if(tmp_container.is_connected) {
 				std::ostringstream out(std::ios_base::binary);
 				tmp_container.list_pointer->serialize(out);
-				m_virtual_database->put(itos(tmp_container.list_pointer->getId()), out.str());
+				m_database->put_pending(virtual_element_key(tmp_container.list_pointer->getId()), out.str());
 			}
 		}
 	}
 }
 
+inline void Circuit::saveState(std::list <CircuitElement>::iterator element) {
+	m_dirty_states[element->getId()] = element;
+}
+
 inline void Circuit::saveVirtualElement(std::list <CircuitElementVirtual>::iterator element, bool save_edges) {
 	std::ostringstream out(std::ios_base::binary);
 	element->serialize(out);
-	m_virtual_database->put(itos(element->getId()), out.str());
+	m_database->put_pending(virtual_element_key(element->getId()), out.str());
 	if(save_edges) {
 		for(std::list <CircuitElementVirtualContainer>::iterator i = element->begin(); i != element->end(); ++i) {
 			std::ostringstream out(std::ios_base::binary);
 			i->element_pointer->serialize(out);
-			m_database->put(itos(i->element_pointer->getId()), out.str());
+			m_database->put_pending(element_key(i->element_pointer->getId()), out.str());
 		}
 	}
 }
@@ -21,6 +21,9 @@
 #include <list>
 #include <vector>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "circuit_element.h"
 #include "circuit_element_virtual.h"
@@ -35,9 +38,11 @@ class MapBlock;
 class KeyValueStorage;
 
 class Circuit {
+	friend class TestFmCircuit;
 public:
 	Circuit(ServerScripting* script, Map* map, const NodeDefManager* ndef, const std::string & savedir);
 	~Circuit();
+	// Loads the components of this block and resumes the ones waiting for it
 	void addBlock(MapBlock* block);
 	void addNode(v3pos_t pos);
 	void removeNode(v3pos_t pos, const MapNode& n_old);
@@ -53,21 +58,79 @@ class Circuit {
 	void save();
 	void saveElement(std::list <CircuitElement>::iterator element, bool save_edges);
 	void saveVirtualElement(std::list <CircuitElementVirtual>::iterator element, bool save_edges);
+	void saveState(std::list <CircuitElement>::iterator element);
 	void open();
 	void close();
 
 private:
+	/*
+	 * Flat copy of the element graph, rebuilt after any topology change.
+	 * Edges of element i are [edge_begin[i], edge_begin[i + 1]), members
+	 * of virtual element j are [member_begin[j], member_begin[j + 1]).
+	 */
+	struct Graph {
+		std::vector <std::list <CircuitElement>::iterator> elements;
+		std::vector <u32> edge_begin;
+		std::vector <u32> edge_virtual;
+		std::vector <u8> edge_shift;
+		std::vector <u32> member_begin;
+		std::vector <u32> member_element;
+		// Number of connected faces with an output signal, per virtual element
+		std::vector <u32> drivers;
+		// Output of each element as counted in drivers
+		std::vector <u8> outputs;
+		// Elements of different components never signal each other
+		std::vector <u32> component;
+		std::vector <bool> queued;
+		// Still valid after a node callback removed the element
+		std::vector <v3pos_t> positions;
+		std::unordered_map <const CircuitElement*, u32> ids;
+	};
+
+	// Write pending changes in one batch
+	bool flush();
+	void saveMeta();
+	// Element at pos, the block is loaded first
+	bool findElement(v3pos_t pos, std::list <CircuitElement>::iterator& element);
+	// Components with an element in the block, read once
+	void loadBlock(v3bpos_t pos);
+	// Element with everything connected to it
+	void loadComponent(u32 id);
+	// Databases of older versions, read whole and written again with key prefixes
+	void loadLegacy();
+	// Faces not listed by their virtual element point nowhere, for the
+	// elements and virtual elements inserted before the given ones
+	void disconnectUnlisted(std::list <CircuitElement>::iterator elements_end,
+	                        std::list <CircuitElementVirtual>::iterator virtual_elements_end);
+
+	// Queues the elements of m_elements_queue
+	void compile();
+	void queueElement(u32 element);
+	// Waits in m_elements_queue while the graph is out of date
+	void queuePosition(v3pos_t pos);
+	void queueMembers(const CircuitElementVirtual& virtual_element);
+	// Update queued elements, the ones of not loaded components wait in
+	// m_waiting_blocks. Goes on over the new graph when a node callback
+	// changes it
+	void step();
+
 	std::list <CircuitElement> m_elements;
 	std::list <CircuitElementVirtual> m_virtual_elements;
 
-	std::map <v3pos_t, std::list<CircuitElement>::iterator> m_pos_to_iterator;
+	unordered_map_v3pos <std::list<CircuitElement>::iterator> m_pos_to_iterator;
 	std::map <const unsigned char*, u32> m_func_to_id;
 
 	ServerScripting* m_script;
 	Map* m_map;
 	const NodeDefManager* m_ndef;
 
+	// Elements to look at once the graph is compiled again
 	std::vector <v3pos_t> m_elements_queue;
+	Graph m_graph;
+	bool m_graph_changed;
+	std::vector <u32> m_worklist;
+	// Elements of components with a node in a block not loaded yet
+	unordered_map_v3bpos <std::vector <v3pos_t>> m_waiting_blocks;
 	float m_min_update_delay;
 	float m_since_last_update;
 	float m_min_save_delay;
@@ -78,13 +141,20 @@ class Circuit {
 
 	std::string m_savedir;
 
+	// Elements, virtual elements, states and block indexes by key prefix
 	KeyValueStorage *m_database;
-	KeyValueStorage *m_virtual_database;
+	// Elements with a state changed since the last save
+	std::unordered_map <u32, std::list <CircuitElement>::iterator> m_dirty_states;
+	// Element ids of the loaded blocks
+	unordered_map_v3bpos <std::set <u32>> m_block_elements;
+	unordered_set_v3bpos m_dirty_blocks;
+	std::unordered_set <u32> m_loaded_ids;
 
 	shared_locker m_elements_mutex;
 
 	static const u32 circuit_simulator_version;
 	static const char elements_states_file[];
+	static const char meta_key[];
 };
 
 #endif
@@ -110,23 +110,7 @@ CircuitElement::~CircuitElement() {
 	}
 }
 
-void CircuitElement::update() {
-	if(m_current_output_state) {
-		for(int i = 0; i < 6; ++i) {
-			if(m_faces[i].is_connected) {
-				m_faces[i].list_pointer->addState(static_cast<bool>(m_current_output_state & SHIFT_TO_FACE(i)));
-			}
-		}
-	}
-}
-
-bool CircuitElement::updateState(ServerScripting* m_script, Map* map, const NodeDefManager* ndef) {
-	MapNode node = map->getNode(m_pos);
-	// Map not yet loaded
-	if(!node) {
-		dstream << "Circuit simulator: Waiting for map blocks loading..." << std::endl;
-		return false;
-	}
+void CircuitElement::updateState(ServerScripting* m_script, const MapNode& node, const NodeDefManager* ndef) {
 	const ContentFeatures& node_features = ndef->get(node);
 	// Update delay (may be not synchronized)
 	u32 delay = node_features.circuit_element_delay;
@@ -146,12 +130,15 @@ bool CircuitElement::updateState(ServerScripting* m_script, Map* map, const Node
 	m_prev_input_state = m_current_input_state;
 	m_current_input_state = m_next_input_state;
 	m_next_input_state = 0;
-	return true;
 }
 
-void CircuitElement::resetState() {
-	m_next_input_state = 0;
-	m_current_input_state = m_prev_input_state;
+bool CircuitElement::isSettled() const {
+	for(auto i = m_states_queue.begin(); i != m_states_queue.end(); ++i) {
+		if(*i != m_current_input_state) {
+			return false;
+		}
+	}
+	return true;
 }
 
 void CircuitElement::serialize(std::ostream& out) const {
@@ -177,13 +164,15 @@ void CircuitElement::serializeState(std::ostream& out) const {
 }
 
 void CircuitElement::deSerialize(std::istream& in,
-                                 std::map <u32, std::list <CircuitElementVirtual>::iterator>& id_to_virtual_pointer) {
+                                 std::unordered_map <u32, std::list <CircuitElementVirtual>::iterator>& id_to_virtual_pointer) {
 	u32 current_element_id;
 	in.read(reinterpret_cast<char*>(&m_pos), sizeof(m_pos));
 	for(int i = 0; i < 6; ++i) {
 		in.read(reinterpret_cast<char*>(&current_element_id), sizeof(current_element_id));
-		if(current_element_id > 0) {
-			m_faces[i].list_pointer = id_to_virtual_pointer[current_element_id];
+		auto virtual_element = id_to_virtual_pointer.find(current_element_id);
+		// Id of a virtual element not written, when saving was cut short
+		if(current_element_id > 0 && virtual_element != id_to_virtual_pointer.end()) {
+			m_faces[i].list_pointer = virtual_element->second;
 			m_faces[i].is_connected = true;
 		} else {
 			m_faces[i].is_connected = false;
@@ -222,7 +211,7 @@ void CircuitElement::getNeighbors(std::vector <std::list <CircuitElementVirtual>
 
 void CircuitElement::findConnectedWithFace(std::vector <std::pair <std::list<CircuitElement>::iterator, u8> >& connected,
         Map* map, const NodeDefManager* ndef, v3pos_t pos, u8 face,
-        std::map<v3pos_t, std::list<CircuitElement>::iterator>& pos_to_iterator,
+        const find_element_t& find_element,
         bool connected_faces[6]) {
 	static v3pos_t directions[6] = {v3pos_t(0, 1, 0),
 	                              v3pos_t(0, -1, 0),
@@ -235,6 +224,7 @@ void CircuitElement::findConnectedWithFace(std::vector <std::pair <std::list<Cir
 	std::queue <std::pair <v3pos_t, u8> > q;
 	v3pos_t current_pos, next_pos;
 	MapNode next_node, current_node;
+	std::list <CircuitElement>::iterator element;
 	// used[pos] = or of all faces, that are already processed
 	std::map <v3pos_t, u8> used;
 	u8 face_id = FACE_TO_SHIFT(face);
@@ -284,7 +274,9 @@ void CircuitElement::findConnectedWithFace(std::vector <std::pair <std::list<Cir
 
 					if(is_part_of_circuit && not_used) {
 						if(node_features.is_circuit_element) {
-							connected.emplace_back(pos_to_iterator[next_pos], next_real_shift);
+							if(find_element(next_pos, element)) {
+								connected.emplace_back(element, next_real_shift);
+							}
 						} else {
 							q.emplace(next_pos, node_features.wire_connections[next_real_shift]);
 						}
@@ -298,8 +290,8 @@ void CircuitElement::findConnectedWithFace(std::vector <std::pair <std::list<Cir
 				}
 			}
 		}
-	} else if(current_node_features.is_circuit_element) {
-		connected.emplace_back(pos_to_iterator[current_pos], OPPOSITE_SHIFT(real_face_id));
+	} else if(current_node_features.is_circuit_element && find_element(current_pos, element)) {
+		connected.emplace_back(element, OPPOSITE_SHIFT(real_face_id));
 	}
 }
 
@@ -334,6 +326,14 @@ void CircuitElement::setInputState(u8 state) {
 	m_current_input_state = state;
 }
 
+void CircuitElement::setNextInputState(u8 state) {
+	m_next_input_state = state;
+}
+
+u8 CircuitElement::getOutputState() const {
+	return m_current_output_state;
+}
+
 void CircuitElement::setDelay(u8 delay) {
 	if(m_states_queue.size() >= delay) {
 		while(m_states_queue.size() > delay) {
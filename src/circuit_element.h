@@ -22,11 +22,14 @@
 #include "mapnode.h"
 #include "circuit_element_virtual.h"
 #include "nodedef.h"
+#include "util/unordered_map_hash.h"
 
 #include <list>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <deque>
+#include <functional>
 
 #define OPPOSITE_SHIFT(x) (CircuitElement::opposite_shift[x])
 #define OPPOSITE_FACE(x) (CircuitElement::opposite_face[x])
@@ -79,23 +82,27 @@ class CircuitElement {
 	CircuitElement(u32 id);
 	~CircuitElement();
 	void addConnectedElement();
-	void update();
-	bool updateState(ServerScripting* m_script, Map* map, const NodeDefManager* ndef);
-	void resetState();
+	// Take the input set by setNextInputState(), node is the loaded node of the element
+	void updateState(ServerScripting* m_script, const MapNode& node, const NodeDefManager* ndef);
+	// Delayed inputs are all the current one, another update changes nothing
+	bool isSettled() const;
 
 	void serialize(std::ostream& out) const;
 	void serializeState(std::ostream& out) const;
 	void deSerialize(std::istream& is,
-	                 std::map <u32, std::list <CircuitElementVirtual>::iterator>& id_to_virtual_pointer);
+	                 std::unordered_map <u32, std::list <CircuitElementVirtual>::iterator>& id_to_virtual_pointer);
 	void deSerializeState(std::istream& is);
 
 	void getNeighbors(std::vector <std::list <CircuitElementVirtual>::iterator>& neighbors) const;
 
+	// Element at a position, false if the circuit has none there
+	using find_element_t = std::function<bool(v3pos_t pos, std::list<CircuitElement>::iterator& element)>;
+
 	// First - pointer to object to which connected.
 	// Second - face id.
 	static void findConnectedWithFace(std::vector <std::pair <std::list<CircuitElement>::iterator, u8> >& connected,
 	                                  Map* map, const NodeDefManager* ndef, v3pos_t pos, u8 face,
-	                                  std::map<v3pos_t, std::list<CircuitElement>::iterator>& pos_to_iterator,
+	                                  const find_element_t& find_element,
 	                                  bool connected_faces[6]);
 
 	CircuitElementContainer getFace(int id) const;
@@ -107,15 +114,13 @@ class CircuitElement {
 	void disconnectFace(int id);
 	void setId(u32 id);
 	void setInputState(u8 state);
+	void setNextInputState(u8 state);
+	u8 getOutputState() const;
 	void setDelay(u8 delay);
 
 	void swap(const MapNode& n_old, const ContentFeatures& n_old_features,
 	          const MapNode& n_new, const ContentFeatures& n_new_features);
 
-	inline void addState(u8 state) {
-		m_next_input_state |= state;
-	}
-
 	inline static u8 rotateFace(const MapNode& node, const ContentFeatures& node_features, u8 face) {
 		if(node_features.param_type_2 == CPT2_FACEDIR) {
 			return ROTATE_FACE(face, node.param2);
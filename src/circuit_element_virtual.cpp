@@ -19,7 +19,7 @@
 #include "circuit_element.h"
 #include "debug.h"
 
-CircuitElementVirtual::CircuitElementVirtual(u32 id) : m_state(false) {
+CircuitElementVirtual::CircuitElementVirtual(u32 id) {
 	m_element_id = id;
 }
 
@@ -30,16 +30,6 @@ CircuitElementVirtual::~CircuitElementVirtual() {
 	}
 }
 
-void CircuitElementVirtual::update() {
-	if(m_state) {
-		for(std::list <CircuitElementVirtualContainer>::iterator i = this->begin();
-		        i != this->end(); ++i) {
-			i->element_pointer->addState(SHIFT_TO_FACE(i->shift));
-		}
-		m_state = false;
-	}
-}
-
 void CircuitElementVirtual::serialize(std::ostream& out) {
 	u32 connections_num = this->size();
 	out.write(reinterpret_cast<char*>(&connections_num), sizeof(connections_num));
@@ -53,7 +43,7 @@ void CircuitElementVirtual::serialize(std::ostream& out) {
 }
 
 void CircuitElementVirtual::deSerialize(std::istream& in, std::list <CircuitElementVirtual>::iterator current_element_it,
-                                        std::map <u32, std::list <CircuitElement>::iterator>& id_to_pointer) {
+                                        std::unordered_map <u32, std::list <CircuitElement>::iterator>& id_to_pointer) {
 	u32 connections_num;
 	in.read(reinterpret_cast<char*>(&connections_num), sizeof(connections_num));
 	for(u32 i = 0; i < connections_num; ++i) {
@@ -61,7 +51,16 @@ void CircuitElementVirtual::deSerialize(std::istream& in, std::list <CircuitElem
 		CircuitElementVirtualContainer tmp_container;
 		in.read(reinterpret_cast<char*>(&element_id), sizeof(element_id));
 		in.read(reinterpret_cast<char*>(&(tmp_container.shift)), sizeof(tmp_container.shift));
-		tmp_container.element_pointer = id_to_pointer[element_id];
+		auto element = id_to_pointer.find(element_id);
+		// Only members which were saved with a face on this element
+		if(element == id_to_pointer.end() || tmp_container.shift >= 6) {
+			continue;
+		}
+		const CircuitElementContainer face = element->second->getFace(tmp_container.shift);
+		if(!face.is_connected || face.list_pointer != current_element_it) {
+			continue;
+		}
+		tmp_container.element_pointer = element->second;
 		std::list <CircuitElementVirtualContainer>::iterator it = this->insert(this->begin(), tmp_container);
 		it->element_pointer->connectFace(it->shift, it, current_element_it);
 	}
@@ -19,6 +19,7 @@
 
 #include <list>
 #include <map>
+#include <unordered_map>
 #include <sstream>
 
 #include "irrlichttypes.h"
@@ -35,21 +36,14 @@ class CircuitElementVirtual : public std::list <CircuitElementVirtualContainer>
 	CircuitElementVirtual(u32 id);
 	~CircuitElementVirtual();
 
-	void update();
-
 	void serialize(std::ostream& out);
 	void deSerialize(std::istream& is, std::list <CircuitElementVirtual>::iterator current_element_it,
-	                 std::map <u32, std::list<CircuitElement>::iterator>& id_to_pointer);
+	                 std::unordered_map <u32, std::list<CircuitElement>::iterator>& id_to_pointer);
 
 	void setId(u32 id);
 
 	u32 getId();
 
-	inline void addState(const bool state) {
-		m_state |= state;
-	}
-
 private:
 	u32 m_element_id;
-	bool m_state;
 };
@@ -830,6 +830,7 @@ void Client::step(float dtime)
 				block->mesh = nullptr;
 */
 				block->solid_sides = r.solid_sides;
+				block->face_connectivity = r.face_connectivity;
 
 				minimap_mapblocks = r.mesh->moveMinimapMapblocks();
 				if (minimap_mapblocks.empty())
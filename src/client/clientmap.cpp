@@ -4,6 +4,7 @@
 
 #include "fm_far_calc.h"
 #include "fm_farmesh.h"
+#include "fm_visibility.h"
 
 #include "clientmap.h"
 #include "client.h"
@@ -25,7 +26,10 @@
 #include "util/tracy_wrapper.h"
 #include "client/renderingengine.h"
 #include "util/numeric.h"
+#include "threading/ThreadPool.h"
+#include "threading/thread.h"
 
+#include <atomic>
 #include <limits>
 #include <queue>
 
@@ -211,6 +215,7 @@ static const std::string ClientMap_settings[] = {
 	"transparency_sorting_distance",
 	"occlusion_culler",
 	"enable_raytraced_culling",
+	"visibility_graph_culling",
 };
 
 ClientMap::ClientMap(
@@ -224,12 +229,7 @@ ClientMap::ClientMap(
 		rendering_engine->get_scene_manager(), id),
 	m_client(client),
 	m_rendering_engine(rendering_engine),
-	m_control(control),
-	/*
-	m_drawlist(MapBlockComparer(v3bpos_t(0,0,0)))
-	*/
- 	m_drawlist_0{MapBlockComparer(v3bpos_t(0,0,0))},
- 	m_drawlist_1{MapBlockComparer(v3bpos_t(0,0,0))}
+	m_control(control)
 {
 
 	/*
@@ -239,6 +239,11 @@ ClientMap::ClientMap(
 	Name = "ClientMap";
 	setAutomaticCulling(scene::EAC_OFF);
 
+	if (const auto threads = std::min(Thread::getNumberOfProcessors() / 2, 4u); threads > 1) {
+		m_drawlist_pool = std::make_unique<progschj::ThreadPool>(threads);
+		m_transparent_pool = std::make_unique<progschj::ThreadPool>(threads);
+	}
+
 	for (const auto &name : ClientMap_settings)
 		g_settings->registerChangedCallback(name, on_settings_changed, this);
 	// load all settings at once
@@ -262,6 +267,8 @@ void ClientMap::onSettingChanged(std::string_view name, bool all)
 		m_loops_occlusion_culler = g_settings->get("occlusion_culler") == "loops";
 	if (all || name == "enable_raytraced_culling")
 		m_enable_raytraced_culling = g_settings->getBool("enable_raytraced_culling");
+	if (all || name == "visibility_graph_culling")
+		m_visibility_graph_culling = g_settings->getBool("visibility_graph_culling");
 }
 
 ClientMap::~ClientMap()
@@ -481,9 +488,8 @@ void ClientMap::updateDrawList(float dtime, unsigned int max_cycle_ms)
 	}
 
 	const auto camera_block = getContainerPos(cam_pos_nodes, MAP_BLOCKSIZE);
-	//assert(m_drawlist.empty());
-	//m_drawlist = decltype(m_drawlist)(MapBlockComparer(camera_block));
-	m_drawlist = drawlist_map{MapBlockComparer(camera_block)};
+	DrawListBuilder drawlist;
+	drawlist.setCamera(camera_block);
 
 	auto is_frustum_culled = m_client->getCamera()->getFrustumCuller();
 
@@ -492,12 +498,13 @@ void ClientMap::updateDrawList(float dtime, unsigned int max_cycle_ms)
 	// if (occlusion_culling_enabled && m_control.show_wireframe)
 	// 	occlusion_culling_enabled = porting::getTimeS() & 1;
 
-	const auto &add_to_drawlist = [&m_drawlist] (auto &block) {
-		auto res = m_drawlist.emplace(block->getPos(), block);
-		(void)res;
-		assert(res.second); // must not already exist
-		if (res.second)
-			block->refGrab();
+	const auto &add_to_drawlist = [&drawlist] (auto &block) {
+		// must not already exist
+		assert(!drawlist.contains(block->getPos()));
+		if (drawlist.contains(block->getPos()))
+			return;
+		drawlist.insert_or_assign(block->getPos(), block);
+		block->refGrab();
 	};
 
 	// Set of mesh holding blocks, will be transferred to m_drawlist
@@ -715,7 +722,8 @@ void ClientMap::updateDrawList(float dtime, unsigned int max_cycle_ms)
 			// Note that we don't fill m_keeplist, or call resetUsageTimer() here.
 			// touchMapBlocks() exists to deal with that.
 			if (mesh) {
-				add_to_drawlist(block);
+				if (auto block_ptr = getBlock(block_coord))
+					add_to_drawlist(block_ptr);
 			}
 
 			// Decide which sides to traverse next or to block away
@@ -821,12 +829,13 @@ void ClientMap::updateDrawList(float dtime, unsigned int max_cycle_ms)
 	}
 
 	// must populate either only to avoid duplicates
-	assert(m_drawlist.empty() || shortlist.empty());
+	assert(!drawlist.size() || shortlist.empty());
 	for (auto pos : shortlist) {
 		auto block = getBlock(pos);
 		if (block /*&& block->mesh*/)
 			add_to_drawlist(block);
 	}
+	m_drawlist = drawlist.build();
 
 	g_profiler->avg("MapBlocks occlusion culled [#]", blocks_occlusion_culled);
 	g_profiler->avg("MapBlocks frustum culled [#]", blocks_frustum_culled);
@@ -915,7 +924,8 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 	ScopeProfiler sp(g_profiler, "CM::updateDrawList()", SPT_AVG);
 	TimeTaker timer_step("ClientMap::updateDrawList");
 
-	drawlist_map drawlist{MapBlockComparer(getNodeBlockPos(m_camera_position_node))};
+	auto &drawlist = m_drawlist_builder;
+	drawlist.setCamera(getNodeBlockPos(m_camera_position_node));
 
 	//auto is_frustum_culled = m_client->getCamera()->getFrustumCuller();
 
@@ -941,6 +951,7 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 	u32 blocks_in_range_with_mesh = 0;
 	// Number of blocks occlusion culled
 	u32 blocks_occlusion_culled = 0;
+	u32 blocks_graph_culled = 0;
 
 
 	// Number of blocks in rendering range
@@ -1111,22 +1122,80 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 		}
 	};
 
+	// Per block values without side effects, computed in parallel chunks
+	struct BlockView
+	{
+		bool keep_alive{};
+		bool in_wanted_range{};
+		bool candidate{};
+		std::optional<farmesh::tree_result_t> far_params;
+		uint64_t distance{};
+		block_step_t mesh_step{};
+		MapBlock::mesh_type mesh;
+		int mesh_buffer_count{-1};
+	};
+	std::vector<BlockView> views(vector.size());
+	drawlist_parallel(m_drawlist_pool.get(), vector.size(), 1024,
+			[&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					const auto &[bp, block] = vector[i];
+					auto &view = views[i];
+					if (!block)
+						continue;
+
+					const auto block_min = bp * MAP_BLOCKSIZE;
+					view.keep_alive = m_control.range_all ||
+							farmesh::cellIntersectsRange(block_min, MAP_BLOCKSIZE,
+									m_camera_position_node, requested_range);
+					if (!view.keep_alive) {
+						view.distance = radius_box(block_min, m_camera_position_node);
+						continue;
+					}
+
+					// A client mesh is stored only at the origin of its MeshGrid cell.
+					// Non-origin blocks must never be treated as drawable coverage.
+					if (mesh_grid.getMeshPos(bp) != bp)
+						continue;
+
+					view.in_wanted_range = m_control.range_all ||
+							farmesh::cellIntersectsRange(block_min, near_cell_width,
+									m_camera_position_node, wanted_range);
+					if (use_cell_handoff &&
+							(view.in_wanted_range ||
+									farmesh::cellIntersectsRange(block_min,
+											near_cell_width, m_camera_position_node,
+											requested_range))) {
+						view.far_params = farmesh::getFarParams(
+								m_control, far_camera_block, bp);
+					}
+					// Far cells with a step may be handed over, checked after
+					if (!view.in_wanted_range && !view.far_params)
+						continue;
+
+					view.candidate = true;
+					view.distance = radius_box(block_min, m_camera_position_node);
+					view.mesh_step = farmesh::getLodStep(
+							m_control, camera_block, bp, speedf);
+					view.mesh = block->getLodMesh(view.mesh_step, true);
+					if (view.mesh)
+						view.mesh_buffer_count =
+								view.mesh->getMesh()->getMeshBufferCount();
+				}
+			});
+
 	// Collect loaded near chunks out to the complete handoff-cell boundary.
 	// Missing chunks do not suppress farmesh; they are requested and the far
 	// cell remains the owner until every corresponding near mesh is ready.
-	for (const auto &[bp, block] : vector) {
+	for (size_t i = 0; i < vector.size(); ++i) {
+		const auto &[bp, block] = vector[i];
+		auto &view = views[i];
 		if (!block)
 			continue;
 
-		const auto block_min = bp * MAP_BLOCKSIZE;
-		const bool keep_alive = m_control.range_all ||
-				farmesh::cellIntersectsRange(block_min, MAP_BLOCKSIZE,
-						m_camera_position_node, requested_range);
-		if (!keep_alive) {
+		if (!view.keep_alive) {
 			if (wanted_range > 0) {
-				const auto distance = radius_box(block_min, m_camera_position_node);
-				if (distance > static_cast<uint64_t>(wanted_range) * 4)
-					block->usage_timer_multiplier = distance / wanted_range;
+				if (view.distance > static_cast<uint64_t>(wanted_range) * 4)
+					block->usage_timer_multiplier = view.distance / wanted_range;
 			}
 			continue;
 		}
@@ -1134,24 +1203,10 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 		block->resetUsageTimer();
 		++blocks_in_range;
 
-		// A client mesh is stored only at the origin of its MeshGrid cell.
-		// Non-origin blocks must never be treated as drawable coverage.
-		if (mesh_grid.getMeshPos(bp) != bp)
+		if (!view.candidate)
 			continue;
 
-		const auto near_cell_min = bp * MAP_BLOCKSIZE;
-		const bool in_wanted_range = m_control.range_all ||
-				farmesh::cellIntersectsRange(near_cell_min, near_cell_width,
-						m_camera_position_node, wanted_range);
-
-		std::optional<farmesh::tree_result_t> far_params;
-		if (use_cell_handoff &&
-				(in_wanted_range || farmesh::cellIntersectsRange(near_cell_min,
-						near_cell_width, m_camera_position_node, requested_range))) {
-			far_params = farmesh::getFarParams(
-					m_control, far_camera_block, bp);
-		}
-
+		const auto &far_params = view.far_params;
 		FarCellCoverage *coverage = nullptr;
 		if (far_params && far_params->step) {
 			if (auto it = transition_cells.find(far_params->pos);
@@ -1161,21 +1216,17 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 		}
 		const bool requires_near_mesh = far_params && !far_params->step;
 
-		if (!coverage && !in_wanted_range && !requires_near_mesh)
+		if (!coverage && !view.in_wanted_range && !requires_near_mesh)
 			continue;
 
-		const auto distance = radius_box(near_cell_min, m_camera_position_node);
-		const int range_blocks = distance / MAP_BLOCKSIZE;
-		const auto mesh_step = farmesh::getLodStep(
-				m_control, camera_block, bp, speedf);
-		const auto mesh = block->getLodMesh(mesh_step, true);
-		const bool covers_cell = mesh && mesh->lod_step == mesh_step;
-		const int mesh_buffer_count =
-				mesh ? mesh->getMesh()->getMeshBufferCount() : -1;
+		const int range_blocks = view.distance / MAP_BLOCKSIZE;
+		const auto &mesh = view.mesh;
+		const bool covers_cell = mesh && mesh->lod_step == view.mesh_step;
+		const int mesh_buffer_count = view.mesh_buffer_count;
 
 		if (!covers_cell || mesh_buffer_count == 0)
 			++blocks_in_range_without_mesh;
-		request_mesh(bp, block, mesh_step, mesh, range_blocks);
+		request_mesh(bp, block, view.mesh_step, mesh, range_blocks);
 
 		NearCandidate candidate{bp, block, mesh, mesh_buffer_count,
 				range_blocks, covers_cell};
@@ -1188,14 +1239,81 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 		}
 	}
 
+	/*
+		Cells walled off from the camera cell are culled before the occlusion
+		tests. Meshes are still requested for them, their connectivity comes
+		from the mesh generator. No frustum here, the list is not rebuilt
+		when the camera turns.
+	*/
+	const bool graph_culling = !m_control.range_all && occlusion_culling_enabled &&
+			m_visibility_graph_culling;
+	const auto camera_cell = mesh_grid.getMeshPos(camera_block);
+	const bpos_t graph_range = wanted_range / (MAP_BLOCKSIZE * mesh_grid.cell_size) + 1;
+	unordered_set_v3bpos graph_visible;
+	if (graph_culling) {
+		visible_cells(camera_cell, mesh_grid.cell_size, graph_range,
+				[&](const v3bpos_t &pos) {
+					const auto block = getBlockNoCreateNoEx(pos);
+					return block ? block->face_connectivity.load() : FACES_ALL_CONNECTED;
+				},
+				graph_visible);
+	}
+	const auto graph_hidden = [&](const v3bpos_t &pos) {
+		if (!graph_culling)
+			return false;
+		const auto offset = (pos - camera_cell) / mesh_grid.cell_size;
+		if (std::abs(offset.X) > graph_range || std::abs(offset.Y) > graph_range ||
+				std::abs(offset.Z) > graph_range)
+			return false;
+		return !graph_visible.contains(pos);
+	};
+
+	// Occlusion tests are the most of the cost, most results are kept
+	const bool occlusion_culling = !m_control.range_all &&
+			occlusion_culling_enabled && m_enable_raytraced_culling;
+	size_t occlusion_tests = 0;
+	if (occlusion_culling) {
+		std::vector<const NearCandidate *> tested;
+		m_drawlist_occlusion.begin(m_camera_position_node);
+		const auto collect = [&](const NearCandidate &candidate) {
+			if (!candidate.mesh || candidate.mesh_buffer_count <= 0 ||
+					candidate.range_blocks <= 3 || graph_hidden(candidate.pos))
+				return;
+			m_drawlist_occlusion.add(candidate.pos, candidate.mesh->generation);
+			tested.emplace_back(&candidate);
+		};
+		for (const auto &candidate : direct_near)
+			collect(candidate);
+		for (const auto &[pos, coverage] : transition_cells)
+			for (const auto &candidate : coverage.candidates)
+				collect(candidate);
+
+		const auto &retest = m_drawlist_occlusion.retest();
+		occlusion_tests = retest.size();
+		drawlist_parallel(m_drawlist_pool.get(), retest.size(), 64,
+				[&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i)
+						m_drawlist_occlusion.setOccluded(retest[i],
+								isMeshOccluded(tested[retest[i]]->block.get(),
+										mesh_grid.cell_size, m_camera_position_node));
+				});
+	} else {
+		m_drawlist_occlusion.clear();
+	}
+
 	const auto draw_near = [&](const NearCandidate &candidate) {
 		if (!candidate.mesh || candidate.mesh_buffer_count <= 0)
 			return;
 
-		if (candidate.range_blocks > 3 && !m_control.range_all &&
-				occlusion_culling_enabled && m_enable_raytraced_culling &&
-				isMeshOccluded(candidate.block.get(), mesh_grid.cell_size,
-						m_camera_position_node)) {
+		// Connectivity of a just dug block may lag behind, keep the nearest
+		if (candidate.range_blocks > 1 && graph_hidden(candidate.pos)) {
+			++blocks_occlusion_culled;
+			++blocks_graph_culled;
+			return;
+		}
+
+		if (candidate.range_blocks > 3 && occlusion_culling &&
+				m_drawlist_occlusion.isOccluded(candidate.pos)) {
 			++blocks_occlusion_culled;
 			return;
 		}
@@ -1230,6 +1348,8 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 		}
 	}
 
+	g_profiler->avg("Client: Occlusion tests [#]", occlusion_tests);
+	g_profiler->avg("Client: Visibility graph culled [#]", blocks_graph_culled);
 	g_profiler->avg("Client: Farmesh handoff near cells", near_owned_cells);
 	g_profiler->avg("Client: Farmesh handoff fallback cells", far_fallback_cells);
 	//m_drawlist_last = draw_nearest.size();
@@ -1278,11 +1398,12 @@ void ClientMap::updateDrawListFm(float dtime, unsigned int max_cycle_ms)
 	//	ir.second->refDrop();
 
 	const auto drawlist_size = drawlist.size();
+	auto built_drawlist = drawlist.build();
 	{
 		std::lock_guard<std::recursive_mutex> lock(m_drawlist_mutex);
 		const bool current = m_drawlist_current.load(std::memory_order_relaxed);
 		auto &back_drawlist = current ? m_drawlist_0 : m_drawlist_1;
-		back_drawlist = std::move(drawlist);
+		back_drawlist = std::move(built_drawlist);
 		m_drawlist_current.store(!current, std::memory_order_release);
 	}
 
@@ -2236,6 +2357,9 @@ void ClientMap::updateTransparentMeshBuffers()
 	bool transparency_sorting_enabled = m_cache_transparency_sorting_distance > 0;
 	f32 sorting_distance = m_cache_transparency_sorting_distance * BS;
 
+	// Meshes to order towards the camera, done in parallel below
+	std::vector<std::pair<MapBlock::mesh_type, v3bpos_t>> sort_meshes;
+
 	// Update the order of transparent mesh buffers in each mesh
 	for (auto it = m_drawlist.begin(); it != m_drawlist.end(); it++) {
 /*
@@ -2269,8 +2393,7 @@ void ClientMap::updateTransparentMeshBuffers()
 			}
 
 			if (do_sort_block) {
-				blockmesh->updateTransparentBuffers(m_camera_position, block->getPos(),
-						m_cache_transparency_sorting_group_by_buffers);
+				sort_meshes.emplace_back(blockmesh, block->getPos());
 				++sorted_blocks;
 			} else {
 				blockmesh->consolidateTransparentBuffers();
@@ -2279,7 +2402,27 @@ void ClientMap::updateTransparentMeshBuffers()
 		}
 	}
 
+	// A mesh shared by several entries must be ordered by one thread
+	std::sort(sort_meshes.begin(), sort_meshes.end(),
+			[](const auto &a, const auto &b) { return a.first < b.first; });
+	sort_meshes.erase(std::unique(sort_meshes.begin(), sort_meshes.end(),
+			[](const auto &a, const auto &b) { return a.first == b.first; }),
+			sort_meshes.end());
+
+	// Most meshes keep their order, only the BSP sides are checked then
+	std::atomic<u32> reordered_blocks = 0;
+	drawlist_parallel(m_transparent_pool.get(), sort_meshes.size(), 32,
+			[&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					if (sort_meshes[i].first->updateTransparentBuffers(m_camera_position,
+								sort_meshes[i].second,
+								m_cache_transparency_sorting_group_by_buffers))
+						++reordered_blocks;
+				}
+			});
+
 	g_profiler->avg("CM::Transparent Buffers - Sorted", sorted_blocks);
+	g_profiler->avg("CM::Transparent Buffers - Reordered", reordered_blocks.load());
 	g_profiler->avg("CM::Transparent Buffers - Unsorted", unsorted_blocks);
 	m_needs_update_transparent_meshes = false;
 }
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "CMeshBuffer.h"
+#include "client/fm_drawlist.h"
 #include "fm_weather.h"
 #include "threading/async.h"
 #include "settings.h"
@@ -177,23 +178,6 @@ class ClientMap : public Map, public scene::ISceneNode
 	// update the vertex order in transparent mesh buffers
 	void updateTransparentMeshBuffers();
 
-	// Orders blocks by distance to the camera
-	class MapBlockComparer
-	{
-	public:
-		MapBlockComparer(const v3bpos_t &camera_block) : m_camera_block(camera_block) {}
-
-		bool operator() (const v3bpos_t &left, const v3bpos_t &right) const
-		{
-			auto distance_left = left.getDistanceFromSQ(m_camera_block);
-			auto distance_right = right.getDistanceFromSQ(m_camera_block);
-			return distance_left > distance_right || (distance_left == distance_right && left > right);
-		}
-
-	private:
-		v3bpos_t m_camera_block;
-	};
-
 	Client *m_client;
 	RenderingEngine *m_rendering_engine;
 
@@ -228,7 +212,7 @@ class ClientMap : public Map, public scene::ISceneNode
 	// the resulting server request range; the configured rendering range stays
 	// unchanged for fog, UI, and near-cell selection.
 	std::atomic_int32_t m_near_farmesh_range{};
-	using drawlist_map = std::map<v3bpos_t, MapBlockPtr, MapBlockComparer>;
+	using drawlist_map = DrawList;
 	drawlist_map m_drawlist_0, m_drawlist_1;
 	std::atomic_bool m_drawlist_current = false;
 	std::recursive_mutex m_drawlist_mutex;
@@ -236,6 +220,14 @@ class ClientMap : public Map, public scene::ISceneNode
 	drawlist_shadow_map m_drawlist_shadow_0, m_drawlist_shadow_1;
 	std::atomic_bool m_drawlist_shadow_current = false;
 
+	// Kept between draw list updates, used by the draw list thread
+	DrawListBuilder m_drawlist_builder;
+	DrawListOcclusion m_drawlist_occlusion;
+	// Used by the draw list thread
+	std::unique_ptr<progschj::ThreadPool> m_drawlist_pool;
+	// Used by the main thread, not to wait behind draw list tasks
+	std::unique_ptr<progschj::ThreadPool> m_transparent_pool;
+
 public:
 	async_step_runner update_drawlist_async;
 	async_step_runner update_shadows_async;
@@ -301,6 +293,7 @@ class ClientMap : public Map, public scene::ISceneNode
 
 	bool m_loops_occlusion_culler;
 	bool m_enable_raytraced_culling;
+	bool m_visibility_graph_culling;
 };
 
 bool isOccluded(Map *map, v3pos_t p0, v3pos_t p1, float step, float stepfac,
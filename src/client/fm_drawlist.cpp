@@ -0,0 +1,182 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_drawlist.h"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include "threading/ThreadPool.h"
+#include "threading/async.h"
+
+void DrawListBuilder::setCamera(const v3bpos_t &camera_block)
+{
+	if (camera_block == m_camera_block)
+		return;
+	m_camera_block = camera_block;
+	std::vector<Bucket> buckets;
+	buckets.swap(m_buckets);
+	m_index.clear();
+	for (auto &bucket : buckets)
+		for (auto &entry : bucket.entries)
+			place(std::move(entry));
+}
+
+void DrawListBuilder::place(Entry &&entry)
+{
+	const int64_t dx = entry.pos.X - m_camera_block.X;
+	const int64_t dy = entry.pos.Y - m_camera_block.Y;
+	const int64_t dz = entry.pos.Z - m_camera_block.Z;
+	entry.distance_sq = dx * dx + dy * dy + dz * dz;
+	const auto bucket = static_cast<uint32_t>(std::sqrt(static_cast<double>(entry.distance_sq)));
+	if (bucket >= m_buckets.size())
+		m_buckets.resize(bucket + 1);
+	auto &entries = m_buckets[bucket].entries;
+	m_index.insert_or_assign(entry.pos, std::make_pair(bucket, static_cast<uint32_t>(entries.size())));
+	entries.emplace_back(std::move(entry));
+	m_buckets[bucket].changed = true;
+}
+
+void DrawListBuilder::insert_or_assign(const v3bpos_t &pos, const MapBlockPtr &block)
+{
+	if (const auto it = m_index.find(pos); it != m_index.end()) {
+		auto &entry = m_buckets[it->second.first].entries[it->second.second];
+		entry.block = block;
+		if (entry.seen != m_build) {
+			entry.seen = m_build;
+			++m_assigned;
+		}
+		return;
+	}
+	place({0, pos, block, m_build});
+	++m_assigned;
+}
+
+bool DrawListBuilder::contains(const v3bpos_t &pos) const
+{
+	const auto it = m_index.find(pos);
+	return it != m_index.end() &&
+		   m_buckets[it->second.first].entries[it->second.second].seen == m_build;
+}
+
+DrawList DrawListBuilder::build()
+{
+	DrawList list;
+	list.m_blocks.reserve(m_assigned);
+	for (uint32_t i = m_buckets.size(); i-- > 0;) {
+		auto &bucket = m_buckets[i];
+		auto &entries = bucket.entries;
+		const auto gone = std::partition(entries.begin(), entries.end(),
+				[this](const Entry &entry) { return entry.seen == m_build; });
+		if (gone != entries.end()) {
+			for (auto entry = gone; entry != entries.end(); ++entry)
+				m_index.erase(entry->pos);
+			entries.erase(gone, entries.end());
+			bucket.changed = true;
+		}
+		if (bucket.changed) {
+			std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+				return a.distance_sq > b.distance_sq ||
+					   (a.distance_sq == b.distance_sq && a.pos > b.pos);
+			});
+			for (uint32_t j = 0; j < entries.size(); ++j)
+				m_index[entries[j].pos].second = j;
+			bucket.changed = false;
+		}
+		for (const auto &entry : entries)
+			list.m_blocks.emplace_back(entry.pos, entry.block);
+	}
+	++m_build;
+	m_assigned = 0;
+	return list;
+}
+
+void DrawListBuilder::clear()
+{
+	m_buckets.clear();
+	m_index.clear();
+	m_assigned = 0;
+}
+
+void DrawListOcclusion::begin(const v3pos_t &camera)
+{
+	m_camera = camera;
+	++m_iteration;
+	m_added.clear();
+	m_changed = false;
+}
+
+void DrawListOcclusion::add(const v3bpos_t &pos, uint64_t mesh_generation)
+{
+	auto [it, inserted] = m_results.try_emplace(pos);
+	auto &result = it->second;
+	if (inserted || result.mesh_generation != mesh_generation)
+		m_changed = true;
+	result.mesh_generation = mesh_generation;
+	result.seen = m_iteration;
+	m_added.emplace_back(&result);
+}
+
+const std::vector<size_t> &DrawListOcclusion::retest()
+{
+	// A mesh gone or emptied opens views as well
+	for (auto it = m_results.begin(); it != m_results.end();) {
+		if (it->second.seen != m_iteration) {
+			m_changed = true;
+			it = m_results.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	m_retest.clear();
+	for (size_t i = 0; i < m_added.size(); ++i) {
+		auto &result = *m_added[i];
+		if (m_changed || result.camera != m_camera) {
+			result.camera = m_camera;
+			m_retest.emplace_back(i);
+		}
+	}
+	return m_retest;
+}
+
+bool DrawListOcclusion::isOccluded(const v3bpos_t &pos) const
+{
+	const auto it = m_results.find(pos);
+	return it != m_results.end() && it->second.occluded;
+}
+
+void DrawListOcclusion::clear()
+{
+	m_results.clear();
+	m_added.clear();
+}
+
+void drawlist_parallel(progschj::ThreadPool *pool, size_t size, size_t chunk,
+		const std::function<void(size_t begin, size_t end)> &func)
+{
+	if (!pool || size <= chunk) {
+		func(0, size);
+		return;
+	}
+
+	std::vector<std::future<void>> futures;
+	futures.reserve(size / chunk + 1);
+	for (size_t begin = 0; begin < size; begin += chunk)
+		futures.emplace_back(
+				pool->enqueue(func, begin, std::min(size, begin + chunk)));
+	wait_all(futures);
+}
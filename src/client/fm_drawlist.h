@@ -0,0 +1,142 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "irr_v3d.h"
+#include "util/unordered_map_hash.h"
+
+class MapBlock;
+using MapBlockPtr = std::shared_ptr<MapBlock>;
+
+namespace progschj
+{
+class ThreadPool;
+}
+
+// Blocks to draw in one flat array, farthest from the camera first
+class DrawList
+{
+public:
+	using value_type = std::pair<v3bpos_t, MapBlockPtr>;
+	using container_type = std::vector<value_type>;
+
+	auto begin() const { return m_blocks.begin(); }
+	auto end() const { return m_blocks.end(); }
+	size_t size() const { return m_blocks.size(); }
+	bool empty() const { return m_blocks.empty(); }
+	void clear() { m_blocks.clear(); }
+
+private:
+	friend class DrawListBuilder;
+	container_type m_blocks;
+};
+
+/*
+	Keeps blocks in buckets by whole blocks of distance to the camera.
+	Only the blocks of one bucket are sorted, so the order is the same as
+	a full sort by distance without the cost of a tree. The blocks are kept
+	between builds, only the buckets with blocks added or gone are sorted
+	again. Everything is placed again when the camera moves to another
+	block.
+*/
+class DrawListBuilder
+{
+public:
+	void setCamera(const v3bpos_t &camera_block);
+
+	// A later block for the same position replaces the earlier one
+	void insert_or_assign(const v3bpos_t &pos, const MapBlockPtr &block);
+	// Assigned since the last build
+	bool contains(const v3bpos_t &pos) const;
+	size_t size() const { return m_assigned; }
+
+	// Blocks not assigned since the last build are dropped
+	DrawList build();
+	void clear();
+
+private:
+	struct Entry
+	{
+		int64_t distance_sq;
+		v3bpos_t pos;
+		MapBlockPtr block;
+		uint32_t seen;
+	};
+	struct Bucket
+	{
+		std::vector<Entry> entries;
+		bool changed{};
+	};
+
+	void place(Entry &&entry);
+
+	v3bpos_t m_camera_block;
+	std::vector<Bucket> m_buckets;
+	// Bucket and place in it
+	unordered_map_v3bpos<std::pair<uint32_t, uint32_t>> m_index;
+	uint32_t m_build{1};
+	size_t m_assigned{};
+};
+
+/*
+	Occlusion test results by block position. A result is kept while the
+	camera stays on the same node and no mesh in range changed, a changed
+	mesh may open or close a view to any other block. Meshes are told apart
+	by their generation, a new mesh may get the address of a freed one.
+*/
+class DrawListOcclusion
+{
+public:
+	// Starts the tests of an update from the camera node
+	void begin(const v3pos_t &camera);
+	// Block with a mesh to test, in the order of the tests
+	void add(const v3bpos_t &pos, uint64_t mesh_generation);
+	// Drops the blocks not added since begin(), then gives the added ones
+	// to test again
+	const std::vector<size_t> &retest();
+	// Result for the added block i, may be called in parallel
+	void setOccluded(size_t i, bool occluded) { m_added[i]->occluded = occluded; }
+	bool isOccluded(const v3bpos_t &pos) const;
+	size_t size() const { return m_results.size(); }
+	void clear();
+
+private:
+	struct Result
+	{
+		uint64_t mesh_generation{};
+		v3pos_t camera;
+		bool occluded{};
+		uint32_t seen{};
+	};
+
+	unordered_map_v3bpos<Result> m_results;
+	std::vector<Result *> m_added;
+	std::vector<size_t> m_retest;
+	v3pos_t m_camera;
+	uint32_t m_iteration{};
+	bool m_changed{};
+};
+
+// Call func(begin, end) for chunks of [0, size), on the pool when there is one
+void drawlist_parallel(progschj::ThreadPool *pool, size_t size, size_t chunk,
+		const std::function<void(size_t begin, size_t end)> &func);
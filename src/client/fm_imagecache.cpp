@@ -0,0 +1,206 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_imagecache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <tuple>
+#include <vector>
+#include <IImage.h>
+#include <IVideoDriver.h>
+#include "exceptions.h"
+#include "filesys.h"
+#include "log.h"
+#include "util/hex.h"
+#include "util/numeric.h"
+#include "util/serialize.h"
+
+namespace
+{
+constexpr char cache_magic[4] = {'F', 'M', 'I', 'C'};
+constexpr u8 cache_version = 1;
+}
+
+ImageDiskCache::ImageDiskCache(const std::string &dir, const std::string &fingerprint,
+		uint64_t max_size) :
+		m_dir(dir), m_fingerprint(fingerprint), m_max_size(max_size)
+{
+	if (!fs::CreateAllDirs(m_dir))
+		warningstream << "ImageDiskCache: can not create " << m_dir << std::endl;
+	trim();
+}
+
+std::string ImageDiskCache::getPath(const std::string &key) const
+{
+	const u64 hash = murmur_hash_64_ua(key.data(), key.size(), 0x1337);
+	u8 buf[8];
+	writeU64(buf, hash);
+	return m_dir + DIR_DELIM + hex_encode(reinterpret_cast<const char *>(buf), sizeof(buf));
+}
+
+video::IImage *ImageDiskCache::load(video::IVideoDriver *driver, const std::string &name,
+		const source_hash_t &source_hash, std::set<std::string> &source_image_names) const
+{
+	std::string data;
+	core::dimension2d<u32> dim;
+	std::set<std::string> sources;
+	const size_t offset = read(name, source_hash, sources, data, dim);
+	if (!offset)
+		return nullptr;
+
+	auto *image = driver->createImage(video::ECF_A8R8G8B8, dim);
+	if (!image)
+		return nullptr;
+	memcpy(image->getData(), data.data() + offset, data.size() - offset);
+	source_image_names.merge(sources);
+	return image;
+}
+
+size_t ImageDiskCache::read(const std::string &name, const source_hash_t &source_hash,
+		std::set<std::string> &source_image_names, std::string &data,
+		core::dimension2d<u32> &dim) const
+{
+	const auto key = m_fingerprint + '\n' + name;
+	const auto path = getPath(key);
+	if (!fs::ReadFile(path, data))
+		return 0;
+
+	try {
+		std::istringstream is(data, std::ios_base::binary);
+		char magic[sizeof(cache_magic)];
+		is.read(magic, sizeof(magic));
+		if (!is || memcmp(magic, cache_magic, sizeof(magic)) || readU8(is) != cache_version)
+			return 0;
+		// Another texture string with the same hash
+		if (deSerializeString32(is) != key)
+			return 0;
+
+		std::set<std::string> sources;
+		for (u16 count = readU16(is); count; --count) {
+			auto source = deSerializeString16(is);
+			if (readU64(is) != source_hash(source))
+				return 0;
+			sources.emplace(std::move(source));
+		}
+
+		dim.Width = readU32(is);
+		dim.Height = readU32(is);
+		const size_t size = static_cast<size_t>(dim.Width) * dim.Height * 4;
+		const auto offset = static_cast<size_t>(is.tellg());
+		if (!dim.Width || !dim.Height || data.size() - offset != size)
+			return 0;
+
+		// Used now, trimmed last
+		std::error_code ec;
+		std::filesystem::last_write_time(
+				path, std::filesystem::file_time_type::clock::now(), ec);
+		source_image_names.merge(sources);
+		return offset;
+	} catch (const SerializationError &e) {
+		verbosestream << "ImageDiskCache: broken entry for \"" << name
+					  << "\": " << e.what() << std::endl;
+		return 0;
+	}
+}
+
+void ImageDiskCache::store(const std::string &name,
+		const std::set<std::string> &source_image_names, const source_hash_t &source_hash,
+		video::IImage *image) const
+{
+	if (!image || image->getColorFormat() != video::ECF_A8R8G8B8)
+		return;
+	write(name, source_image_names, source_hash, image->getDimension(), image->getData());
+}
+
+void ImageDiskCache::write(const std::string &name,
+		const std::set<std::string> &source_image_names, const source_hash_t &source_hash,
+		const core::dimension2d<u32> &dim, const void *pixels) const
+{
+	const auto key = m_fingerprint + '\n' + name;
+	std::ostringstream os(std::ios_base::binary);
+	os.write(cache_magic, sizeof(cache_magic));
+	writeU8(os, cache_version);
+	os << serializeString32(key);
+
+	u16 count = 0;
+	for (const auto &source : source_image_names)
+		count += !source.empty();
+	writeU16(os, count);
+	for (const auto &source : source_image_names) {
+		if (source.empty())
+			continue;
+		// Random dummy image in place of a missing one, do not keep it
+		const u64 hash = source_hash(source);
+		if (!hash || source.size() > STRING_MAX_LEN)
+			return;
+		os << serializeString16(source);
+		writeU64(os, hash);
+	}
+
+	writeU32(os, dim.Width);
+	writeU32(os, dim.Height);
+	os.write(static_cast<const char *>(pixels), static_cast<size_t>(dim.Width) * dim.Height * 4);
+
+	const auto path = getPath(key);
+	// File of an outdated image
+	std::error_code ec;
+	const uint64_t replaced = std::filesystem::file_size(path, ec);
+	const auto data = os.str();
+	if (!fs::safeWriteToFile(path, data)) {
+		verbosestream << "ImageDiskCache: can not store \"" << name << "\"" << std::endl;
+		return;
+	}
+	m_size += data.size();
+	if (!ec)
+		m_size -= replaced;
+	if (m_size > m_max_size)
+		trim();
+}
+
+void ImageDiskCache::trim() const
+{
+	const std::lock_guard<std::mutex> lock(m_trim_mutex);
+	std::vector<std::tuple<std::filesystem::file_time_type, uint64_t, std::filesystem::path>>
+			files;
+	uint64_t size = 0;
+	std::error_code ec;
+	for (const auto &entry : std::filesystem::directory_iterator(m_dir, ec)) {
+		// Temporary file of safeWriteToFile() in another thread
+		if (!entry.is_regular_file(ec) || entry.path().filename().string()[0] == '.')
+			continue;
+		const auto file_size = entry.file_size(ec);
+		const auto time = entry.last_write_time(ec);
+		if (ec)
+			continue;
+		files.emplace_back(time, file_size, entry.path());
+		size += file_size;
+	}
+
+	if (size > m_max_size) {
+		std::sort(files.begin(), files.end());
+		const uint64_t target = m_max_size / 4 * 3;
+		for (const auto &[time, file_size, path] : files) {
+			if (size <= target)
+				break;
+			if (std::filesystem::remove(path, ec))
+				size -= file_size;
+		}
+	}
+	m_size = size;
+}
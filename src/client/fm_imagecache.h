@@ -0,0 +1,84 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <dimension2d.h>
+
+namespace video
+{
+class IImage;
+class IVideoDriver;
+}
+
+/*
+	Disk cache of images generated from texture strings. A file is named
+	by the hash of the texture string and stays valid while the content
+	hashes of its source images match the stored ones. Pixels are kept raw
+	A8R8G8B8, a hit is one file read and one copy.
+	Files are dropped by the time of their last use when the cache grows
+	over max_size.
+*/
+class ImageDiskCache
+{
+	friend class TestFmImageCache;
+
+public:
+	// Content hash of a source image, 0 when it can not be loaded
+	using source_hash_t = std::function<uint64_t(const std::string &name)>;
+
+	// fingerprint holds the settings generated images depend on
+	ImageDiskCache(const std::string &dir, const std::string &fingerprint,
+			uint64_t max_size);
+
+	// Returns nullptr when missing or outdated, the image should be dropped.
+	// Thread safe, as is store().
+	video::IImage *load(video::IVideoDriver *driver, const std::string &name,
+			const source_hash_t &source_hash,
+			std::set<std::string> &source_image_names) const;
+
+	void store(const std::string &name, const std::set<std::string> &source_image_names,
+			const source_hash_t &source_hash, video::IImage *image) const;
+
+	// Bytes of the files in the cache
+	uint64_t getSize() const { return m_size; }
+
+private:
+	std::string getPath(const std::string &key) const;
+
+	// Pixels start at the returned offset in data, 0 when missing or outdated
+	size_t read(const std::string &name, const source_hash_t &source_hash,
+			std::set<std::string> &source_image_names, std::string &data,
+			core::dimension2d<u32> &dim) const;
+	void write(const std::string &name, const std::set<std::string> &source_image_names,
+			const source_hash_t &source_hash, const core::dimension2d<u32> &dim,
+			const void *pixels) const;
+	// Drops the files used longest ago, down to 3/4 of m_max_size
+	void trim() const;
+
+	std::string m_dir;
+	std::string m_fingerprint;
+	uint64_t m_max_size;
+	mutable std::atomic<uint64_t> m_size{0};
+	mutable std::mutex m_trim_mutex;
+};
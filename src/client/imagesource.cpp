@@ -5,6 +5,7 @@
 #include "imagesource.h"
 
 #include "exceptions.h"
+#include "fm_imageblend.h"
 #include <IFileSystem.h>
 #include <IReadFile.h>
 #include "imagefilters.h"
@@ -22,6 +23,11 @@
 // SourceImageCache Functions //
 ////////////////////////////////
 
+SourceImageCache::SourceImageCache(SourceImageCache *parent) :
+		m_parent(parent)
+{
+}
+
 SourceImageCache::~SourceImageCache() {
 	for (auto &m_image : m_images) {
 		m_image.second->drop();
@@ -60,6 +66,7 @@ void SourceImageCache::insert(const std::string &name, video::IImage *img, bool
 	if (need_to_grab)
 		toadd->grab();
 	m_images[name] = toadd;
+	m_hashes.erase(name);
 }
 
 video::IImage* SourceImageCache::get(const std::string &name)
@@ -79,6 +86,16 @@ video::IImage* SourceImageCache::getOrLoad(const std::string &name)
 		return n->second;
 	}
 	video::IVideoDriver *driver = RenderingEngine::get_video_driver();
+	if (m_parent) {
+		if (video::IImage *parent_img = m_parent->get(name)) {
+			video::IImage *img = driver->createImage(
+					parent_img->getColorFormat(), parent_img->getDimension());
+			parent_img->copyTo(img);
+			m_images[name] = img;
+			img->grab(); // Grab for caller
+			return img;
+		}
+	}
 	std::string path = getTexturePath(name);
 	if (path.empty()) {
 		infostream << "SourceImageCache::getOrLoad(): No path found for \""
@@ -96,6 +113,26 @@ video::IImage* SourceImageCache::getOrLoad(const std::string &name)
 	return img;
 }
 
+u64 SourceImageCache::getHash(const std::string &name)
+{
+	auto n = m_hashes.find(name);
+	if (n != m_hashes.end())
+		return n->second;
+
+	u64 hash = 0;
+	if (video::IImage *img = getOrLoad(name)) {
+		const auto dim = img->getDimension();
+		hash = murmur_hash_64_ua(img->getData(), img->getImageDataSizeInBytes(),
+				img->getColorFormat());
+		hash ^= (static_cast<u64>(dim.Width) << 32 | dim.Height) * 0x9E3779B97F4A7C15ULL;
+		if (!hash)
+			hash = 1;
+		img->drop();
+	}
+	m_hashes[name] = hash;
+	return hash;
+}
+
 
 ////////////////////////////
 // Image Helper Functions //
@@ -179,6 +216,20 @@ static core::dimension2du imageTransformDimension(u32 transform, core::dimension
 // Apply transform to image data
 static void imageTransform(u32 transform, video::IImage *src, video::IImage *dst);
 
+// Pixels of an ECF_A8R8G8B8 image for the fm_imageblend.h kernels
+static bool is_argb_area(video::IImage *img, v2u32 pos, v2u32 size)
+{
+	const auto dim = img->getDimension();
+	return img->getColorFormat() == video::ECF_A8R8G8B8 &&
+			pos.X + size.X <= dim.Width && pos.Y + size.Y <= dim.Height;
+}
+
+static u32 *argb_row(video::IImage *img, v2u32 pos, u32 y)
+{
+	return reinterpret_cast<u32 *>(static_cast<u8 *>(img->getData()) +
+			(pos.Y + y) * img->getPitch()) + pos.X;
+}
+
 inline static void applyShadeFactor(video::SColor &color, u32 factor)
 {
 	u32 f = core::clamp<u32>(factor, 0, 256);
@@ -360,65 +411,6 @@ static void blitBaseImage(video::IImage* &src, video::IImage* &dst)
 }
 
 
-namespace {
-
-/** Calculate the result of the overlay texture modifier (`^`) for a single
- * pixel
- *
- * This is not alpha blending if both src and dst are semi-transparent. The
- * reason this is that an old implementation did it wrong, and fixing it would
- * break backwards compatibility (see #14847).
- *
- * \tparam overlay If enabled, only modify dst_col if it is fully opaque
- * \param src_col Color of the top pixel
- * \param dst_col Color of the bottom pixel. This color is modified in-place to
- *   store the result.
-*/
-template <bool overlay>
-void blit_pixel(video::SColor src_col, video::SColor &dst_col)
-{
-	u8 dst_a = (u8)dst_col.getAlpha();
-	if constexpr (overlay) {
-		if (dst_a != 255)
-			// The bottom pixel has transparency -> do nothing
-			return;
-	}
-	u8 src_a = (u8)src_col.getAlpha();
-	if (src_a == 0) {
-		// A fully transparent pixel is on top -> do nothing
-		return;
-	}
-	if (src_a == 255 || dst_a == 0) {
-		// The top pixel is fully opaque or the bottom pixel is
-		// fully transparent -> replace the color
-		dst_col = src_col;
-		return;
-	}
-	struct Color { u8 r, g, b; };
-	Color src{(u8)src_col.getRed(), (u8)src_col.getGreen(),
-		(u8)src_col.getBlue()};
-	Color dst{(u8)dst_col.getRed(), (u8)dst_col.getGreen(),
-		(u8)dst_col.getBlue()};
-	if (dst_a == 255) {
-		// A semi-transparent pixel is on top and an opaque one in
-		// the bottom -> lerp r, g, and b
-		dst.r = (dst.r * (255 - src_a) + src.r * src_a) / 255;
-		dst.g = (dst.g * (255 - src_a) + src.g * src_a) / 255;
-		dst.b = (dst.b * (255 - src_a) + src.b * src_a) / 255;
-		dst_col.set(255, dst.r, dst.g, dst.b);
-		return;
-	}
-	// A semi-transparent pixel is on top of a
-	// semi-transparent pixel -> weird overlaying
-	dst.r = (dst.r * (255 - src_a) + src.r * src_a) / 255;
-	dst.g = (dst.g * (255 - src_a) + src.g * src_a) / 255;
-	dst.b = (dst.b * (255 - src_a) + src.b * src_a) / 255;
-	dst_a = dst_a + (255 - dst_a) * src_a * src_a / (255 * 255);
-	dst_col.set(dst_a, dst.r, dst.g, dst.b);
-}
-
-}  // namespace (anonymous)
-
 template<bool overlay>
 static void blit_with_alpha2(video::IImage *src, video::IImage *dst,
 	v2s32 src_pos, v2s32 dst_pos, v2u32 size)
@@ -467,16 +459,9 @@ static void blit_with_alpha2(video::IImage *src, video::IImage *dst,
 		componentwise_min(src_dim - src_pos_u, dst_dim - dst_pos_u));
 
 	// Do it!
-	video::SColor *pixels_src =
-		reinterpret_cast<video::SColor *>(src->getData());
-	video::SColor *pixels_dst =
-		reinterpret_cast<video::SColor *>(dst->getData());
 	for (u32 y0 = 0; y0 < size.Y; ++y0) {
-		size_t i_src = (src_pos_u.Y + y0) * src_dim.X + src_pos_u.X;
-		size_t i_dst = (dst_pos_u.Y + y0) * dst_dim.X + dst_pos_u.X;
-		for (u32 x0 = 0; x0 < size.X; ++x0) {
-			blit_pixel<overlay>(pixels_src[i_src++], pixels_dst[i_dst++]);
-		}
+		image_blit_row(argb_row(src, src_pos_u, y0), argb_row(dst, dst_pos_u, y0),
+				size.X, overlay);
 	}
 }
 
@@ -488,7 +473,24 @@ static void apply_colorize(video::IImage *dst, v2u32 dst_pos, v2u32 size,
 {
 	u32 alpha = color.getAlpha();
 	video::SColor dst_c;
-	if ((ratio == -1 && alpha == 255) || ratio == 255) { // full replacement of color
+	const bool argb = is_argb_area(dst, dst_pos, size);
+	if (argb && ((ratio == -1 && alpha == 255) || ratio == 255)) {
+		for (u32 y = 0; y < size.Y; y++)
+			image_colorize_row(argb_row(dst, dst_pos, y), size.X, color.color, keep_alpha);
+	} else if (argb) {
+		// Every channel of the result depends only on the same channel
+		float interp = (ratio == -1 ? color.getAlpha() / 255.0f : ratio / 255.0f);
+		image_channel_tables_t tables;
+		for (u32 v = 0; v < 256; v++) {
+			dst_c = color.getInterpolated(video::SColor(v, v, v, v), interp);
+			tables[0][v] = dst_c.getAlpha();
+			tables[1][v] = dst_c.getRed();
+			tables[2][v] = dst_c.getGreen();
+			tables[3][v] = dst_c.getBlue();
+		}
+		for (u32 y = 0; y < size.Y; y++)
+			image_remap_row(argb_row(dst, dst_pos, y), size.X, tables, true);
+	} else if ((ratio == -1 && alpha == 255) || ratio == 255) { // full replacement of color
 		if (keep_alpha) { // replace the color with alpha = dest alpha * color alpha
 			dst_c = color;
 			for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
@@ -524,6 +526,12 @@ static void apply_colorize(video::IImage *dst, v2u32 dst_pos, v2u32 size,
 static void apply_multiplication(video::IImage *dst, v2u32 dst_pos, v2u32 size,
 		const video::SColor color)
 {
+	if (is_argb_area(dst, dst_pos, size)) {
+		for (u32 y = 0; y < size.Y; y++)
+			image_multiply_row(argb_row(dst, dst_pos, y), size.X, color.color);
+		return;
+	}
+
 	video::SColor dst_c;
 
 	for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
@@ -545,6 +553,12 @@ static void apply_multiplication(video::IImage *dst, v2u32 dst_pos, v2u32 size,
 static void apply_screen(video::IImage *dst, v2u32 dst_pos, v2u32 size,
 		const video::SColor color)
 {
+	if (is_argb_area(dst, dst_pos, size)) {
+		for (u32 y = 0; y < size.Y; y++)
+			image_screen_row(argb_row(dst, dst_pos, y), size.X, color.color);
+		return;
+	}
+
 	video::SColor dst_c;
 
 	for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
@@ -576,63 +590,79 @@ static void apply_screen(video::IImage *dst, v2u32 dst_pos, v2u32 size,
 static void apply_hue_saturation(video::IImage *dst, v2u32 dst_pos, v2u32 size,
 	s32 hue, s32 saturation, s32 lightness, bool colorize)
 {
-	video::SColorf colorf;
-	video::SColorHSL hsl;
 	f32 norm_s = core::clamp(saturation, -100, 1000) / 100.0f;
 	f32 norm_l = core::clamp(lightness,  -100, 100) / 100.0f;
 
-	if (colorize) {
-		hsl.Saturation = core::clamp((f32)saturation, 0.0f, 100.0f);
-	}
-
-	for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
-		for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
+	const auto adjust = [&](video::SColor dst_c) {
+		video::SColorf colorf;
+		video::SColorHSL hsl;
 
-			if (colorize) {
-				f32 lum = dst->getPixel(x, y).getBrightness() / 255.0f;
-
-				if (norm_l < 0) {
-					lum *= norm_l + 1.0f;
-				} else {
-					lum = lum * (1.0f - norm_l) + norm_l;
-				}
-				hsl.Hue = 0;
-				hsl.Luminance = lum * 100;
+		if (colorize) {
+			hsl.Saturation = core::clamp((f32)saturation, 0.0f, 100.0f);
+			f32 lum = dst_c.getBrightness() / 255.0f;
 
+			if (norm_l < 0) {
+				lum *= norm_l + 1.0f;
 			} else {
-				// convert the RGB to HSL
-				colorf = video::SColorf(dst->getPixel(x, y));
-				hsl.fromRGB(colorf);
-
-				if (norm_l < 0) {
-					hsl.Luminance *= norm_l + 1.0f;
-				} else{
-					hsl.Luminance = hsl.Luminance + norm_l * (100.0f - hsl.Luminance);
-				}
+				lum = lum * (1.0f - norm_l) + norm_l;
+			}
+			hsl.Hue = 0;
+			hsl.Luminance = lum * 100;
 
-				// Adjusting saturation in the same manner as lightness resulted in
-				// muted colors being affected too much and bright colors not
-				// affected enough, so I'm borrowing a leaf out of gimp's book and
-				// using a different scaling approach for saturation.
-				// https://github.com/GNOME/gimp/blob/6cc1e035f1822bf5198e7e99a53f7fa6e281396a/app/operations/gimpoperationhuesaturation.c#L139-L145=
-				// This difference is why values over 100% are not necessary for
-				// lightness but are very useful with saturation. An alternative UI
-				// approach would be to have an upper saturation limit of 100, but
-				// multiply positive values by ~3 to make it a more useful positive
-				// range scale.
-				hsl.Saturation *= norm_s + 1.0f;
-				hsl.Saturation = core::clamp(hsl.Saturation, 0.0f, 100.0f);
+		} else {
+			// convert the RGB to HSL
+			colorf = video::SColorf(dst_c);
+			hsl.fromRGB(colorf);
+
+			if (norm_l < 0) {
+				hsl.Luminance *= norm_l + 1.0f;
+			} else{
+				hsl.Luminance = hsl.Luminance + norm_l * (100.0f - hsl.Luminance);
 			}
 
-			// Apply the specified HSL adjustments
-			hsl.Hue = fmodf(hsl.Hue + hue, 360);
-			if (hsl.Hue < 0)
-				hsl.Hue += 360;
+			// Adjusting saturation in the same manner as lightness resulted in
+			// muted colors being affected too much and bright colors not
+			// affected enough, so I'm borrowing a leaf out of gimp's book and
+			// using a different scaling approach for saturation.
+			// https://github.com/GNOME/gimp/blob/6cc1e035f1822bf5198e7e99a53f7fa6e281396a/app/operations/gimpoperationhuesaturation.c#L139-L145=
+			// This difference is why values over 100% are not necessary for
+			// lightness but are very useful with saturation. An alternative UI
+			// approach would be to have an upper saturation limit of 100, but
+			// multiply positive values by ~3 to make it a more useful positive
+			// range scale.
+			hsl.Saturation *= norm_s + 1.0f;
+			hsl.Saturation = core::clamp(hsl.Saturation, 0.0f, 100.0f);
+		}
+
+		// Apply the specified HSL adjustments
+		hsl.Hue = fmodf(hsl.Hue + hue, 360);
+		if (hsl.Hue < 0)
+			hsl.Hue += 360;
 
-			// Convert back to RGB
-			hsl.toRGB(colorf);
-			dst->setPixel(x, y, colorf.toSColor());
+		// Convert back to RGB
+		hsl.toRGB(colorf);
+		return colorf.toSColor();
+	};
+
+	if (is_argb_area(dst, dst_pos, size)) {
+		// Float per pixel, but textures repeat colors a lot
+		u32 last_in = 0, last_out = adjust(video::SColor(0)).color;
+		for (u32 y = 0; y < size.Y; y++) {
+			u32 *row = argb_row(dst, dst_pos, y);
+			for (u32 x = 0; x < size.X; x++) {
+				if (row[x] != last_in) {
+					last_in = row[x];
+					last_out = adjust(video::SColor(last_in)).color;
+				}
+				row[x] = last_out;
+			}
 		}
+		return;
+	}
+
+	for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
+		for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++)
+			dst->setPixel(x, y, adjust(dst->getPixel(x, y)));
 }
 
 
@@ -648,6 +678,18 @@ static void apply_overlay(video::IImage *blend, video::IImage *dst,
 	v2s32 blend_layer_pos = hardlight ? dst_pos : blend_pos;
 	v2s32 base_layer_pos  = hardlight ? blend_pos : dst_pos;
 
+	if (blend_layer_pos.X >= 0 && blend_layer_pos.Y >= 0 &&
+			base_layer_pos.X >= 0 && base_layer_pos.Y >= 0 &&
+			is_argb_area(blend_layer, v2u32::from(blend_layer_pos), size) &&
+			is_argb_area(base_layer, v2u32::from(base_layer_pos), size) &&
+			is_argb_area(dst, v2u32::from(base_layer_pos), size)) {
+		for (u32 y = 0; y < size.Y; y++)
+			image_overlay_row(argb_row(blend_layer, v2u32::from(blend_layer_pos), y),
+					argb_row(base_layer, v2u32::from(base_layer_pos), y),
+					argb_row(dst, v2u32::from(base_layer_pos), y), size.X);
+		return;
+	}
+
 	for (u32 y = 0; y < size.Y; y++)
 	for (u32 x = 0; x < size.X; x++) {
 		s32 base_x = x + base_layer_pos.X;
@@ -714,6 +756,19 @@ static void apply_brightness_contrast(video::IImage *dst, v2u32 dst_pos, v2u32 s
 	// rounded rather than trunc'd.
 	c += 0.5f;
 
+	if (is_argb_area(dst, dst_pos, size)) {
+		// Same result for the same channel value
+		image_channel_tables_t tables;
+		for (u32 v = 0; v < 256; v++) {
+			tables[0][v] = v;
+			tables[1][v] = tables[2][v] = tables[3][v] =
+					core::clamp((int)(slope * v + c), 0, 255);
+		}
+		for (u32 y = 0; y < size.Y; y++)
+			image_remap_row(argb_row(dst, dst_pos, y), size.X, tables, false);
+		return;
+	}
+
 	video::SColor dst_c;
 	for (u32 y = dst_pos.Y; y < dst_pos.Y + size.Y; y++)
 	for (u32 x = dst_pos.X; x < dst_pos.X + size.X; x++) {
@@ -735,6 +790,15 @@ static void apply_brightness_contrast(video::IImage *dst, v2u32 dst_pos, v2u32 s
 static void apply_mask(video::IImage *mask, video::IImage *dst,
 		v2s32 mask_pos, v2s32 dst_pos, v2u32 size)
 {
+	if (mask_pos.X >= 0 && mask_pos.Y >= 0 && dst_pos.X >= 0 && dst_pos.Y >= 0 &&
+			is_argb_area(mask, v2u32::from(mask_pos), size) &&
+			is_argb_area(dst, v2u32::from(dst_pos), size)) {
+		for (u32 y0 = 0; y0 < size.Y; y0++)
+			image_mask_row(argb_row(mask, v2u32::from(mask_pos), y0),
+					argb_row(dst, v2u32::from(dst_pos), y0), size.X);
+		return;
+	}
+
 	for (u32 y0 = 0; y0 < size.Y; y0++) {
 		for (u32 x0 = 0; x0 < size.X; x0++) {
 			s32 mask_x = x0 + mask_pos.X;
@@ -1806,6 +1870,14 @@ ImageSource::ImageSource() :
 		m_setting_anisotropic_filter{g_settings->getBool("anisotropic_filter")}
 {}
 
+ImageSource::ImageSource(ImageSource &parent) :
+		m_setting_mipmap{parent.m_setting_mipmap},
+		m_setting_trilinear_filter{parent.m_setting_trilinear_filter},
+		m_setting_bilinear_filter{parent.m_setting_bilinear_filter},
+		m_setting_anisotropic_filter{parent.m_setting_anisotropic_filter},
+		m_sourcecache{&parent.m_sourcecache}
+{}
+
 video::IImage* ImageSource::generateImage(std::string_view name,
 		std::set<std::string> &source_image_names)
 {
@@ -1923,3 +1995,8 @@ void ImageSource::insertSourceImage(const std::string &name, video::IImage *img,
 {
 	m_sourcecache.insert(name, img, prefer_local);
 }
+
+u64 ImageSource::getSourceImageHash(const std::string &name)
+{
+	return m_sourcecache.getHash(name);
+}
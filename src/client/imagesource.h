@@ -5,6 +5,7 @@
 #pragma once
 
 #include <IImage.h>
+#include "irrlichttypes.h"
 #include <unordered_map>
 #include <set>
 #include <string>
@@ -18,6 +19,9 @@
 // Does not contain modified images.
 class SourceImageCache {
 public:
+	// parent: cache of another thread to copy images from, it must not
+	// change while this one is used
+	explicit SourceImageCache(SourceImageCache *parent = nullptr);
 	~SourceImageCache();
 
 	void insert(const std::string &name, video::IImage *img, bool prefer_local);
@@ -26,14 +30,25 @@ class SourceImageCache {
 
 	// Primarily fetches from cache, secondarily tries to read from filesystem.
 	video::IImage *getOrLoad(const std::string &name);
+
+	// Content hash of the image, 0 if it can not be loaded
+	u64 getHash(const std::string &name);
 private:
+	SourceImageCache *m_parent = nullptr;
 	std::unordered_map<std::string, video::IImage*> m_images;
+	std::unordered_map<std::string, u64> m_hashes;
 };
 
 // Generates images using texture modifiers, and caches source images.
 struct ImageSource {
 	ImageSource();
 
+	/*! Source for another thread, it copies source images from parent
+	 * because image reference counts are not atomic.
+	 * parent must not be used until this one is destroyed.
+	 */
+	explicit ImageSource(ImageSource &parent);
+
 	/*! Generates an image from a full string like
 	 * "stone.png^mineral_coal.png^[crack:1:0".
 	 * The returned Image should be dropped.
@@ -44,6 +59,9 @@ struct ImageSource {
 	// Insert a source image into the cache without touching the filesystem.
 	void insertSourceImage(const std::string &name, video::IImage *img, bool prefer_local);
 
+	// Content hash of a source image, 0 if it can not be loaded
+	u64 getSourceImageHash(const std::string &name);
+
 	// This was picked so that the image buffer size fits in an s32 (assuming 32bpp).
 	// The exact value is 23170 but this provides some leeway.
 	// In theory something like 33333x123 could be allowed, but there is no strong
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: LGPL-2.1-or-later
 // Copyright (C) 2010-2013 celeron55, Perttu Ahola <celeron55@gmail.com>
 #include "fm_far_calc.h"
+#include "fm_visibility.h"
 
 #include "mapblock_mesh.h"
 #include "CMeshBuffer.h"
@@ -20,6 +21,7 @@
 #include "client/renderingengine.h"
 #include "util/numeric.h"
 #include <array>
+#include <atomic>
 #include <algorithm>
 #include <cmath>
 #include <cassert>
@@ -463,6 +465,14 @@ void MapBlockBspTree::buildTree(const std::vector<MeshTriangle> *triangles, u16
 	} else {
 		root = -1;
 	}
+
+	side_planes.clear();
+	side_planes.reserve(nodes.size());
+	for (const TreeNode &n : nodes) {
+		u8 parts = (n.front_ref >= 0) + (n.back_ref >= 0) + !n.triangle_refs.empty();
+		side_planes.push_back({n.normal, n.origin,
+				(u8)((parts > 1) | (!n.triangle_refs.empty() << 1))});
+	}
 }
 
 /**
@@ -595,6 +605,17 @@ void MapBlockBspTree::traverse(s32 node, v3f viewpoint, std::vector<s32> &output
 }
 
 
+void MapBlockBspTree::getSides(v3f viewpoint, std::vector<u8> &sides) const
+{
+	sides.resize(side_planes.size());
+	for (size_t i = 0; i < side_planes.size(); i++) {
+		const SidePlane &p = side_planes[i];
+		// same expression as traverse(), the side orders the parts of the
+		// node and on the plane its own triangles are skipped
+		float factor = p.normal.dotProduct(viewpoint - p.origin);
+		sides[i] = ((factor > 0) | ((factor != 0) << 1)) & p.mask;
+	}
+}
 
 /*
 	PartialMeshBuffer
@@ -652,6 +673,8 @@ static void applyColorAndMerge(std::vector<PreMeshBuffer> &prebuffers)
 	}), prebuffers.end());
 }
 
+static std::atomic_uint64_t s_mesh_generation{};
+
 MapBlockMesh::MapBlockMesh(Client *client, MeshMakeData *data):
 
 	far_step{data->far_step},
@@ -660,6 +683,7 @@ MapBlockMesh::MapBlockMesh(Client *client, MeshMakeData *data):
 	timestamp{data->timestamp},
 	mesh_revision{data->mesh_revision},
 	last_used{static_cast<u32>(client->m_uptime)},
+	generation{++s_mesh_generation},
 
 	m_tsrc(client->getTextureSource()),
 	m_shdrsrc(client->getShaderSource()),
@@ -925,16 +949,26 @@ bool MapBlockMesh::animate(bool faraway, float time, int crack,
 	return true;
 }
 
-void MapBlockMesh::updateTransparentBuffers(v3opos_t camera_pos, v3pos_t block_pos,
+bool MapBlockMesh::updateTransparentBuffers(v3opos_t camera_pos, v3pos_t block_pos,
 		bool group_by_buffers)
 {
 	// nothing to do if the entire block is opaque
 	if (m_transparent_triangles.empty())
-		return;
+		return false;
 
 	v3opos_t block_posf = intToFloat(block_pos * MAP_BLOCKSIZE, (opos_t)BS);
 	v3f rel_camera_pos = oposToV3f(camera_pos - block_posf);
 
+	// the order only changes when the camera crosses a plane that matters
+	thread_local std::vector<u8> sides;
+	m_bsp_tree.getSides(rel_camera_pos, sides);
+	if (!m_transparent_buffers_consolidated && !m_transparent_buffers.empty() &&
+			group_by_buffers == m_transparent_group_by_buffers &&
+			sides == m_transparent_sides)
+		return false;
+	m_transparent_sides.swap(sides);
+	m_transparent_group_by_buffers = group_by_buffers;
+
 	std::vector<s32> triangle_refs;
 	m_bsp_tree.traverse(rel_camera_pos, triangle_refs);
 
@@ -992,6 +1026,7 @@ void MapBlockMesh::updateTransparentBuffers(v3opos_t camera_pos, v3pos_t block_p
 		for (auto it = ordered_strains.begin(); it != ordered_strains.end(); ++it)
 			m_transparent_buffers.emplace_back(it->first, std::move(it->second));
 	}
+	return true;
 }
 
 void MapBlockMesh::consolidateTransparentBuffers()
@@ -1080,3 +1115,24 @@ u8 get_solid_sides(MeshMakeData *data)
 	}
 	return result;
 }
+
+u16 get_face_connectivity(MeshMakeData *data)
+{
+	// m_side_length is shrunk by lod_step, it would cover only a corner of the cell
+	if (data->lod_step > 0 || data->far_step > 0)
+		return FACES_ALL_CONNECTED;
+
+	const v3pos_t blockpos_nodes = data->m_blockpos * MAP_BLOCKSIZE;
+	const NodeDefManager *ndef = data->m_nodedef;
+	const u16 side = data->m_side_length;
+
+	std::vector<u8> opaque(side * side * side);
+	size_t i = 0;
+	for (pos_t z = 0; z < side; ++z)
+	for (pos_t y = 0; y < side; ++y)
+	for (pos_t x = 0; x < side; ++x) {
+		const MapNode &n = data->m_vmanip.getNodeRefUnsafe(blockpos_nodes + v3pos_t(x, y, z));
+		opaque[i++] = ndef->get(n).visuals->solidness == 2;
+	}
+	return face_connectivity(opaque, side);
+}
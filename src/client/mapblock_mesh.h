@@ -131,6 +131,10 @@ class MapBlockBspTree
 		traverse(root, viewpoint, output);
 	}
 
+	// Side of every split plane the viewpoint is on, as far as it changes
+	// the result of traverse(): equal sides give the same order
+	void getSides(v3f viewpoint, std::vector<u8> &sides) const;
+
 private:
 	// Tree node definition;
 	struct TreeNode
@@ -154,6 +158,15 @@ class MapBlockBspTree
 	const std::vector<MeshTriangle> *triangles = nullptr; // this reference is managed externally
 	std::vector<TreeNode> nodes; // list of nodes
 	s32 root = -1; // index of the root node
+
+	// Split planes of the nodes for getSides(), packed tight
+	struct SidePlane
+	{
+		v3f normal;
+		v3f origin;
+		u8 mask; // 1: the side orders parts, 2: the node has triangles
+	};
+	std::vector<SidePlane> side_planes;
 };
 
 /*
@@ -266,6 +279,8 @@ class MapBlockMesh
 	unsigned int timestamp{};
 	uint64_t mesh_revision{};
 	uint32_t last_used{};
+	// Unique over all meshes, unlike the address a new mesh may reuse
+	const uint64_t generation;
 	// ===
 
 
@@ -281,8 +296,10 @@ class MapBlockMesh
 	 *     wrong order. Triangles within a single buffer are still ordered, and
 	 *     buffers are ordered relative to each other (with respect to their nearest
 	 *     triangle).
+	 * @return false if the order is the same as on the last call, then
+	 *     nothing is rebuilt.
 	 */
-	void updateTransparentBuffers(v3opos_t camera_pos, v3bpos_t block_pos, bool group_by_buffers);
+	bool updateTransparentBuffers(v3opos_t camera_pos, v3bpos_t block_pos, bool group_by_buffers);
 	void consolidateTransparentBuffers();
 
 	/// get the list of transparent buffers
@@ -343,6 +360,9 @@ class MapBlockMesh
 	std::vector<PartialMeshBuffer> m_transparent_buffers;
 	// Is m_transparent_buffers currently in consolidated form?
 	bool m_transparent_buffers_consolidated = false;
+	// BSP sides and grouping m_transparent_buffers were ordered for
+	std::vector<u8> m_transparent_sides;
+	bool m_transparent_group_by_buffers = false;
 };
 
 /*!
@@ -402,3 +422,6 @@ void getNodeTile(MapNode mn, const v3pos_t &p, const v3pos_t &dir, MeshMakeData
 /// Bits:
 /// 0 0 -Z +Z -X +X -Y +Y
 u8 get_solid_sides(MeshMakeData *data);
+
+/// Return pairs of mesh sides joined through non-solid nodes, see fm_visibility.h
+u16 get_face_connectivity(MeshMakeData *data);
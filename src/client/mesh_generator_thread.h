@@ -119,6 +119,7 @@ struct MeshUpdateResult
 	v3bpos_t p = v3bpos_t(-1338, -1338, -1338);
 	MapBlock::mesh_type mesh;
 	u8 solid_sides;
+	u16 face_connectivity;
 	std::vector<v3bpos_t> ack_list;
 	bool urgent = false;
 	std::vector<MapBlockPtr> map_blocks;
@@ -567,6 +567,9 @@ void NodeVisuals::fillNodeVisuals(NodeDefManager *ndef, Client *client, void *pr
 		f.visuals->preUpdateTextures(tsrc, pool, tsettings);
 	});
 
+	/* generate images in parallel, uploads stay on this thread */
+	tsrc->prepareImages(std::vector<std::string>(pool.begin(), pool.end()));
+
 	/* texture pre-loading stage */
 	const size_t arraymax = getArrayTextureMax(shdsrc);
 	// Group by size
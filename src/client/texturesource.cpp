@@ -4,8 +4,14 @@
 
 #include "texturesource.h"
 
+#include <atomic>
 #include <cassert>
+#include <future>
+#include <sstream>
+#include <unordered_set>
 #include <IVideoDriver.h>
+#include "fm_imagecache.h"
+#include "filesys.h"
 #include "guiscalingfilter.h"
 #include "imagefilters.h"
 #include "imagesource.h"
@@ -13,6 +19,8 @@
 #include "renderingengine.h"
 #include "settings.h"
 #include "texturepaths.h"
+#include "threading/ThreadPool.h"
+#include "threading/async.h"
 #include "util/thread.h"
 
 // Represents a to-be-generated texture for queuing purposes
@@ -124,12 +132,19 @@ class TextureSource final : public IWritableTextureSource
 
 	void setImageCaching(bool enabled);
 
+	void prepareImages(const std::vector<std::string> &images);
+
 private:
 	// Gets or generates an image for a texture string
 	// Caller needs to drop the returned image
 	video::IImage *getOrGenerateImage(const std::string &name,
 		std::set<std::string> &source_image_names);
 
+	// Loads an image from the disk cache or generates it with source
+	// Caller needs to drop the returned image
+	video::IImage *generateImage(ImageSource &source, const std::string &name,
+		std::set<std::string> &source_image_names);
+
 	// The id of the thread that is allowed to use irrlicht directly
 	std::thread::id m_main_thread;
 
@@ -137,6 +152,12 @@ class TextureSource final : public IWritableTextureSource
 	// This should be only accessed from the main thread
 	ImageSource m_imagesource;
 
+	// Finished images kept between runs, null if disabled
+	std::unique_ptr<ImageDiskCache> m_disk_cache;
+
+	// Threads for prepareImages, 1 generates on the main thread
+	u16 m_generate_threads = 1;
+
 	// Is the image cache enabled?
 	bool m_image_cache_enabled = false;
 	// Caches finished texture images before they are uploaded to the GPU
@@ -204,6 +225,18 @@ TextureSource::TextureSource()
 			g_settings->getBool("trilinear_filter") ||
 			g_settings->getBool("bilinear_filter") ||
 			g_settings->getBool("anisotropic_filter");
+
+	m_generate_threads = std::max<u16>(1, g_settings->getU16("texture_generate_threads"));
+	if (g_settings->getBool("texture_disk_cache")) {
+		// Everything besides source images that changes generated images
+		std::ostringstream fingerprint;
+		for (const char *name : {"mip_map", "trilinear_filter", "bilinear_filter",
+				"anisotropic_filter", "texture_min_size"})
+			fingerprint << name << '=' << g_settings->get(name) << ';';
+		m_disk_cache = std::make_unique<ImageDiskCache>(
+				porting::path_cache + DIR_DELIM + "textures", fingerprint.str(),
+				g_settings->getU64("texture_disk_cache_size") * 1024 * 1024);
+	}
 }
 
 TextureSource::~TextureSource()
@@ -242,7 +275,7 @@ video::IImage *TextureSource::getOrGenerateImage(const std::string &name,
 	}
 
 	std::set<std::string> tmp;
-	auto *img = m_imagesource.generateImage(name, tmp);
+	auto *img = generateImage(m_imagesource, name, tmp);
 	if (img && m_image_cache_enabled) {
 		img->grab();
 		m_image_cache[name] = {img, tmp};
@@ -251,6 +284,28 @@ video::IImage *TextureSource::getOrGenerateImage(const std::string &name,
 	return img;
 }
 
+video::IImage *TextureSource::generateImage(ImageSource &source,
+		const std::string &name, std::set<std::string> &source_image_names)
+{
+	if (!m_disk_cache)
+		return source.generateImage(name, source_image_names);
+
+	const auto source_hash = [&source](const std::string &source_name) {
+		return source.getSourceImageHash(source_name);
+	};
+	auto *img = m_disk_cache->load(RenderingEngine::get_video_driver(), name,
+			source_hash, source_image_names);
+	if (img)
+		return img;
+
+	std::set<std::string> generated_from;
+	img = source.generateImage(name, generated_from);
+	if (img)
+		m_disk_cache->store(name, generated_from, source_hash, img);
+	source_image_names.merge(generated_from);
+	return img;
+}
+
 u32 TextureSource::processRequestQueued(const TextureRequest &req)
 {
 	if (std::this_thread::get_id() == m_main_thread) {
@@ -683,3 +738,55 @@ void TextureSource::setImageCaching(bool enabled)
 		m_image_cache.clear();
 	}
 }
+
+void TextureSource::prepareImages(const std::vector<std::string> &images)
+{
+	sanity_check(std::this_thread::get_id() == m_main_thread);
+	if (!m_image_cache_enabled || m_generate_threads <= 1)
+		return;
+
+	std::vector<std::string> names;
+	std::unordered_set<std::string_view> seen;
+	for (const auto &name : images) {
+		if (!name.empty() && !m_image_cache.count(name) && seen.insert(name).second)
+			names.emplace_back(name);
+	}
+	if (names.size() < 2)
+		return;
+
+	// Every worker has its own image source, the main one only hands out
+	// copies of inserted source images while this thread waits
+	std::vector<ImageInfo> results(names.size());
+	std::atomic_size_t next{0};
+	const auto work = [&] {
+		ImageSource source(m_imagesource);
+		for (size_t i = next++; i < names.size(); i = next++)
+			results[i].image = generateImage(source, names[i], results[i].sourceImages);
+	};
+	const size_t threads = std::min<size_t>(m_generate_threads, names.size());
+	{
+		progschj::ThreadPool pool(threads);
+		std::vector<std::future<void>> futures;
+		futures.reserve(threads);
+		for (size_t i = 0; i < threads; ++i)
+			futures.emplace_back(pool.enqueue(work));
+		try {
+			wait_all(futures);
+		} catch (...) {
+			for (auto &result : results)
+				if (result.image)
+					result.image->drop();
+			throw;
+		}
+	}
+
+	size_t generated = 0;
+	for (size_t i = 0; i < names.size(); ++i) {
+		if (!results[i].image)
+			continue;
+		m_image_cache[names[i]] = std::move(results[i]);
+		++generated;
+	}
+	infostream << "TextureSource: prepared " << generated << " of " << names.size()
+			<< " images in " << threads << " threads" << std::endl;
+}
@@ -114,6 +114,14 @@ class ITextureSource : public ISimpleTextureSource
 	 * @note Disabling caching will flush the cache.
 	 */
 	virtual void setImageCaching(bool enabled) {};
+
+	/**
+	 * Generates the images of texture strings ahead of their textures,
+	 * in worker threads if enabled. Only useful with image caching on,
+	 * the textures are still uploaded by the main thread when requested.
+	 * Must be called from the main thread.
+	 */
+	virtual void prepareImages(const std::vector<std::string> &images) {};
 };
 
 class IWritableTextureSource : public ITextureSource
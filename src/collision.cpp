@@ -220,6 +220,136 @@ bool wouldCollideWithCeiling(
 	return false;
 }
 
+struct CollisionContext::BlockBoxes
+{
+	enum : u16
+	{
+		NODE_NONE = 0,
+		NODE_IGNORE,
+		// Boxes depend on neighbours, computed on every use
+		NODE_LIVE,
+		NODE_FIRST_ENTRY,
+	};
+
+	struct Entry
+	{
+		u32 first_box;
+		u16 box_count;
+		u8 bouncy;
+	};
+
+	std::weak_ptr<MapBlock> block;
+	u32 revision = 0;
+	std::atomic_uint32_t last_used{};
+	bool air = false;
+	// One of the above per node, or index of its entry + NODE_FIRST_ENTRY
+	std::vector<u16> nodes;
+	std::vector<Entry> entries;
+	// Relative to the node position
+	std::vector<aabb3f> boxes;
+};
+
+void CollisionContext::step()
+{
+	// Blocks not used for this many steps are forgotten
+	constexpr u32 keep_steps = 64;
+
+	const auto step = ++m_step;
+	if (step % keep_steps)
+		return;
+
+	const std::unique_lock lock(m_mutex);
+	for (auto it = m_blocks.begin(); it != m_blocks.end();) {
+		if (step - it->second->last_used > keep_steps)
+			it = m_blocks.erase(it);
+		else
+			++it;
+	}
+}
+
+size_t CollisionContext::size() const
+{
+	const std::shared_lock lock(m_mutex);
+	return m_blocks.size();
+}
+
+std::shared_ptr<const CollisionContext::BlockBoxes> CollisionContext::getBlock(
+		Map *map, v3bpos_t bpos)
+{
+	const auto block = map->getBlock(bpos);
+	if (!block)
+		return nullptr;
+
+	{
+		const std::shared_lock lock(m_mutex);
+		const auto it = m_blocks.find(bpos);
+		if (it != m_blocks.end()) {
+			const auto &cached = it->second;
+			// Same MapBlock object (not reloaded) with unchanged nodes
+			if (cached->revision == block->m_node_revision &&
+					!cached->block.owner_before(block) &&
+					!block.owner_before(cached->block)) {
+				cached->last_used = m_step.load();
+				return cached;
+			}
+		}
+	}
+
+	auto built = std::const_pointer_cast<BlockBoxes>(buildBlock(map, block));
+	built->last_used = m_step.load();
+	const std::unique_lock lock(m_mutex);
+	m_blocks[bpos] = built;
+	return built;
+}
+
+std::shared_ptr<const CollisionContext::BlockBoxes> CollisionContext::buildBlock(
+		Map *map, const std::shared_ptr<MapBlock> &block)
+{
+	const auto *nodedef = m_gamedef->getNodeDefManager();
+	auto result = std::make_shared<BlockBoxes>();
+	result->block = block;
+	// Read before the nodes, a change while building makes the cache stale
+	result->revision = block->m_node_revision;
+	result->air = block->isAir();
+	if (result->air && !nodedef->get(CONTENT_AIR).walkable)
+		return result;
+
+	result->nodes.resize(MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE);
+	thread_local std::vector<aabb3f> nodeboxes;
+
+	const auto lock = block->lock_shared_rec();
+	v3pos_t relp;
+	size_t i = 0;
+	for (relp.Z = 0; relp.Z < MAP_BLOCKSIZE; relp.Z++)
+	for (relp.Y = 0; relp.Y < MAP_BLOCKSIZE; relp.Y++)
+	for (relp.X = 0; relp.X < MAP_BLOCKSIZE; relp.X++, i++) {
+		const MapNode n = block->getNodeNoLock(relp);
+		if (n.getContent() == CONTENT_IGNORE) {
+			result->nodes[i] = BlockBoxes::NODE_IGNORE;
+			continue;
+		}
+
+		const ContentFeatures &f = nodedef->get(n);
+		if (!f.walkable)
+			continue;
+
+		if (f.drawtype == NDT_NODEBOX && f.node_box.type == NODEBOX_CONNECTED) {
+			result->nodes[i] = BlockBoxes::NODE_LIVE;
+			continue;
+		}
+
+		nodeboxes.clear();
+		n.getCollisionBoxes(nodedef, &nodeboxes, 0);
+
+		result->nodes[i] = BlockBoxes::NODE_FIRST_ENTRY + result->entries.size();
+		result->entries.push_back({(u32)result->boxes.size(), (u16)nodeboxes.size(),
+				(u8)abs(itemgroup_get(f.groups, "bouncy"))});
+		result->boxes.insert(result->boxes.end(), nodeboxes.begin(), nodeboxes.end());
+	}
+
+	return result;
+}
+
 static bool add_area_node_boxes(const v3pos_t min, const v3pos_t max, IGameDef *gamedef,
 		Environment *env, std::vector<NearbyCollisionInfo> &cinfo)
 {
@@ -231,6 +361,75 @@ static bool add_area_node_boxes(const v3pos_t min, const v3pos_t max, IGameDef *
 
 	const bool air_walkable = nodedef->get(CONTENT_AIR).walkable;
 
+	if (CollisionContext *context = env->getCollisionContext()) {
+		v3bpos_t last_bp(POS_MAX);
+		std::shared_ptr<const CollisionContext::BlockBoxes> last_boxes;
+
+		v3pos_t p;
+		for (p.Z = min.Z; p.Z <= max.Z; p.Z++)
+		for (p.Y = min.Y; p.Y <= max.Y; p.Y++)
+		for (p.X = min.X; p.X <= max.X; p.X++) {
+			v3bpos_t bp;
+			v3pos_t relp;
+			getNodeBlockPosWithOffset(p, bp, relp);
+			if (bp != last_bp) {
+				last_boxes = context->getBlock(map, bp);
+				last_bp = bp;
+			}
+			const auto *boxes = last_boxes.get();
+
+			if (!boxes) {
+				// Collide with unloaded block, see below
+				v3pos_t rowend(bp.X * MAP_BLOCKSIZE + MAP_BLOCKSIZE - 1, p.Y, p.Z);
+				auto box = getNodeBox(p, BS);
+				box.addInternalBox(getNodeBox(rowend, BS));
+				cinfo.emplace_back(true, 0, p, box);
+				p.X = rowend.X;
+				continue;
+			}
+
+			if (boxes->nodes.empty()) {
+				// Air block
+				any_position_valid = true;
+				p.X = bp.X * MAP_BLOCKSIZE + MAP_BLOCKSIZE - 1;
+				continue;
+			}
+
+			const u16 node = boxes->nodes[(relp.Z * MAP_BLOCKSIZE + relp.Y) *
+					MAP_BLOCKSIZE + relp.X];
+			if (node == CollisionContext::BlockBoxes::NODE_IGNORE) {
+				cinfo.emplace_back(true, 0, p, getNodeBox(p, BS));
+				continue;
+			}
+			any_position_valid = true;
+			if (node == CollisionContext::BlockBoxes::NODE_NONE)
+				continue;
+
+			const auto posf = intToFloat(p, BS);
+			if (node == CollisionContext::BlockBoxes::NODE_LIVE) {
+				const MapNode n = map->getNode(p);
+				const ContentFeatures &f = nodedef->get(n);
+				int n_bouncy_value = abs(itemgroup_get(f.groups, "bouncy"));
+				nodeboxes.clear();
+				n.getCollisionBoxes(nodedef, &nodeboxes, n.getNeighbors(p, map));
+				for (const auto &box : nodeboxes) {
+					aabb3o boxo(v3fToOpos(box.MinEdge) + posf, v3fToOpos(box.MaxEdge) + posf);
+					cinfo.emplace_back(false, n_bouncy_value, p, boxo);
+				}
+				continue;
+			}
+
+			const auto &entry = boxes->entries[node - CollisionContext::BlockBoxes::NODE_FIRST_ENTRY];
+			for (u32 i = entry.first_box; i < entry.first_box + entry.box_count; ++i) {
+				const auto &box = boxes->boxes[i];
+				aabb3o boxo(v3fToOpos(box.MinEdge) + posf, v3fToOpos(box.MaxEdge) + posf);
+				cinfo.emplace_back(false, entry.bouncy, p, boxo);
+			}
+		}
+
+		return any_position_valid;
+	}
+
 	v3pos_t  last_bp(POS_MAX);
 	MapBlock *last_block = nullptr;
 
@@ -5,12 +5,19 @@
 #pragma once
 
 #include "irrlichttypes_bloated.h"
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
 #include <vector>
 #include "object_properties.h"
+#include "util/unordered_map_hash.h"
 
 class IGameDef;
 class Environment;
 class ActiveObject;
+class Map;
+class MapBlock;
 
 enum CollisionType : u8
 {
@@ -49,6 +56,33 @@ struct collisionMoveResult
 	std::vector<CollisionInfo> collisions;
 };
 
+/// Node collision boxes cached per MapBlock, shared by all objects moved by
+/// an environment. A block is rebuilt when its node data changes.
+class CollisionContext
+{
+public:
+	struct BlockBoxes;
+
+	CollisionContext(IGameDef *gamedef) : m_gamedef(gamedef) {}
+
+	/// Called once per environment step, forgets blocks not used for a while.
+	void step();
+
+	/// @returns cached boxes of the block, nullptr if it is not loaded
+	std::shared_ptr<const BlockBoxes> getBlock(Map *map, v3bpos_t bpos);
+
+	size_t size() const;
+
+private:
+	std::shared_ptr<const BlockBoxes> buildBlock(
+			Map *map, const std::shared_ptr<MapBlock> &block);
+
+	IGameDef *m_gamedef;
+	std::atomic_uint32_t m_step{};
+	mutable std::shared_mutex m_mutex;
+	unordered_map_v3bpos<std::shared_ptr<BlockBoxes>> m_blocks;
+};
+
 /// Status if any problems were ever encountered during collision detection.
 /// @warning For unit test use only.
 extern bool g_collision_problems_encountered;
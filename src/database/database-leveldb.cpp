@@ -20,6 +20,7 @@
 #include "util/string.h"
 
 #include "leveldb/db.h"
+#include "leveldb/write_batch.h"
 
 
 #define ENSURE_STATUS_OK(s) \
@@ -29,7 +30,39 @@
 	}
 
 
-Database_LevelDB::Database_LevelDB(const std::string &savedir)
+namespace
+{
+// Stores the key layout, sorts before all block keys
+const std::string layout_key = "#layout";
+
+constexpr size_t morton_key_size = 1 + 8 + 3 * 4;
+
+std::string morton_prefix(u64 morton)
+{
+	std::string key(1 + 8, 'm');
+	writeU64((u8 *)&key[1], morton);
+	return key;
+}
+
+bool is_morton_key(const leveldb::Slice &key)
+{
+	return key.size() == morton_key_size && key[0] == 'm';
+}
+
+u64 morton_from_key(const leveldb::Slice &key)
+{
+	return readU64((const u8 *)key.data() + 1);
+}
+
+v3bpos_t pos_from_morton_key(const leveldb::Slice &key)
+{
+	const u8 *p = (const u8 *)key.data() + 1 + 8;
+	return v3bpos_t((s32)(readU32(p) ^ 0x80000000u),
+			(s32)(readU32(p + 4) ^ 0x80000000u), (s32)(readU32(p + 8) ^ 0x80000000u));
+}
+}
+
+Database_LevelDB::Database_LevelDB(const std::string &savedir, bool morton)
 {
 	leveldb::Options options;
 	options.create_if_missing = true;
@@ -38,13 +71,55 @@ Database_LevelDB::Database_LevelDB(const std::string &savedir)
 		savedir + DIR_DELIM + "map.db", &db);
 	ENSURE_STATUS_OK(status);
 	m_database.reset(db);
+
+	// The block keys tell the layout, the marker keeps it for a database
+	// without blocks. Old keys all sort before the morton ones.
+	std::unique_ptr<leveldb::Iterator> it(m_database->NewIterator(leveldb::ReadOptions()));
+	it->Seek("m");
+	const bool morton_keys = it->Valid() && is_morton_key(it->key());
+	it->SeekToFirst();
+	if (it->Valid() && it->key() == layout_key)
+		it->Next();
+	const bool default_keys = it->Valid() && !is_morton_key(it->key());
+	ENSURE_STATUS_OK(it->status());
+
+	std::string layout;
+	if (morton_keys || default_keys) {
+		if (morton_keys && default_keys)
+			errorstream << "Database_LevelDB: map.db has keys of both layouts, "
+				"blocks in the default layout are not found" << std::endl;
+		m_morton = morton_keys;
+	} else if (m_database->Get(leveldb::ReadOptions(), layout_key, &layout).ok()) {
+		m_morton = layout == "morton";
+	} else if (morton) {
+		// Only a new database gets the requested layout
+		status = m_database->Put(leveldb::WriteOptions(), layout_key, "morton");
+		ENSURE_STATUS_OK(status);
+		m_morton = true;
+	}
+	if (m_morton != morton)
+		infostream << "Database_LevelDB: using existing key layout, "
+			"migrate with --migrate-map-layout to change it" << std::endl;
+}
+
+std::string Database_LevelDB::getBlockKey(const v3bpos_t &pos) const
+{
+	if (!m_morton)
+		return getBlockAsString(pos);
+	std::string key = morton_prefix(getBlockAsMorton(pos));
+	key.resize(morton_key_size);
+	u8 *p = (u8 *)&key[1 + 8];
+	writeU32(p, (u32)(s32)pos.X ^ 0x80000000u);
+	writeU32(p + 4, (u32)(s32)pos.Y ^ 0x80000000u);
+	writeU32(p + 8, (u32)(s32)pos.Z ^ 0x80000000u);
+	return key;
 }
 
 bool Database_LevelDB::saveBlock(const v3bpos_t &pos, std::string_view data)
 {
 	leveldb::Slice data_s(data.data(), data.size());
 	leveldb::Status status = m_database->Put(leveldb::WriteOptions(),
-			getBlockAsString(pos), data_s);
+			getBlockKey(pos), data_s);
 			//i64tos(getBlockAsInteger(pos)), data_s);
 			//getBlockAsStringCompatible(pos), data_s);
 	if (!status.ok()) {
@@ -53,20 +128,47 @@ bool Database_LevelDB::saveBlock(const v3bpos_t &pos, std::string_view data)
 		return false;
 	}
 
+	if (m_morton)
+		return true;
+
         // delete old format
         auto status_del = m_database->Delete(leveldb::WriteOptions(), i64tos(getBlockAsInteger(pos)));
 
 	return true;
 }
 
+size_t Database_LevelDB::saveBlocks(
+		const std::vector<std::pair<v3bpos_t, std::string>> &blocks)
+{
+	leveldb::WriteBatch batch;
+	for (const auto &[pos, data] : blocks) {
+		batch.Put(getBlockKey(pos), data);
+		// delete old format
+		if (!m_morton)
+			batch.Delete(i64tos(getBlockAsInteger(pos)));
+	}
+	leveldb::Status status = m_database->Write(leveldb::WriteOptions(), &batch);
+	if (!status.ok()) {
+		warningstream << "saveBlocks: LevelDB error saving "
+			<< blocks.size() << " blocks: " << status.ToString() << std::endl;
+		return 0;
+	}
+	return blocks.size();
+}
+
 void Database_LevelDB::loadBlock(const v3bpos_t &pos, std::string *block)
 {
 	leveldb::Status status0 = m_database->Get(leveldb::ReadOptions(),
-		getBlockAsString(pos), block);
+		getBlockKey(pos), block);
 
 	if (status0.ok() && !block->empty())
 		return;
 
+	if (m_morton) {
+		block->clear();
+		return;
+	}
+
 	leveldb::Status status = m_database->Get(leveldb::ReadOptions(),
 		getBlockAsStringCompatible(pos), block);
 
@@ -76,7 +178,7 @@ void Database_LevelDB::loadBlock(const v3bpos_t &pos, std::string *block)
 
 bool Database_LevelDB::deleteBlock(const v3bpos_t &pos)
 {
-	auto status = m_database->Delete(leveldb::WriteOptions(), getBlockAsString(pos));
+	auto status = m_database->Delete(leveldb::WriteOptions(), getBlockKey(pos));
 	if (!status.ok()) {
 		warningstream << "deleteBlock: LevelDB error deleting block "
 			<< pos << ": " << status.ToString() << std::endl;
@@ -86,13 +188,45 @@ bool Database_LevelDB::deleteBlock(const v3bpos_t &pos)
 	return true;
 }
 
+void Database_LevelDB::loadBlocksArea(const v3bpos_t &min, const v3bpos_t &max,
+		std::vector<std::pair<v3bpos_t, std::string>> &blocks)
+{
+	if (!m_morton) {
+		MapDatabase::loadBlocksArea(min, max, blocks);
+		return;
+	}
+
+	std::vector<std::pair<u64, u64>> ranges;
+	getMortonRanges(min, max, ranges);
+
+	std::unique_ptr<leveldb::Iterator> it(m_database->NewIterator(leveldb::ReadOptions()));
+	for (const auto &[first, last] : ranges) {
+		for (it->Seek(morton_prefix(first)); it->Valid(); it->Next()) {
+			const auto key = it->key();
+			if (!is_morton_key(key) || morton_from_key(key) > last)
+				break;
+			// Coarse ranges also cover blocks around the area
+			const v3bpos_t p = pos_from_morton_key(key);
+			if (p.X < min.X || p.Y < min.Y || p.Z < min.Z ||
+					p.X > max.X || p.Y > max.Y || p.Z > max.Z)
+				continue;
+			blocks.emplace_back(p, it->value().ToString());
+		}
+	}
+	ENSURE_STATUS_OK(it->status());
+}
+
 void Database_LevelDB::listAllLoadableBlocks(std::vector<v3bpos_t> &dst)
 {
 	std::unique_ptr<leveldb::Iterator> it(m_database->NewIterator(leveldb::ReadOptions()));
 	if (!it)
 		return;
 	for (it->SeekToFirst(); it->Valid(); it->Next()) {
-		dst.push_back(getStringAsBlock(it->key().ToString()));
+		const auto key = it->key();
+		if (is_morton_key(key))
+			dst.push_back(pos_from_morton_key(key));
+		else if (key != layout_key)
+			dst.push_back(getStringAsBlock(key.ToString()));
 	}
 	ENSURE_STATUS_OK(it->status());  // Check for any errors found during the scan
 }
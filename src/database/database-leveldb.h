@@ -17,7 +17,9 @@
 class Database_LevelDB : public MapDatabase
 {
 public:
-	Database_LevelDB(const std::string &savedir);
+	// morton: key layout used when a new database is created, existing
+	// databases keep their layout
+	Database_LevelDB(const std::string &savedir, bool morton = false);
 	~Database_LevelDB() = default;
 
 	/* fmtodo?:
@@ -29,12 +31,23 @@ class Database_LevelDB : public MapDatabase
 	void loadBlock(const v3bpos_t &pos, std::string *block);
 	bool deleteBlock(const v3bpos_t &pos);
 	void listAllLoadableBlocks(std::vector<v3bpos_t> &dst);
+	std::string getKeyLayout() const override { return m_morton ? "morton" : "default"; }
+
+	size_t saveBlocks(
+			const std::vector<std::pair<v3bpos_t, std::string>> &blocks) override;
+	void loadBlocksArea(const v3bpos_t &min, const v3bpos_t &max,
+			std::vector<std::pair<v3bpos_t, std::string>> &blocks) override;
 
 	void beginSave() {}
 	void endSave() {}
 
 private:
+	std::string getBlockKey(const v3bpos_t &pos) const;
+
 	std::unique_ptr<leveldb::DB> m_database;
+	// Keys are 'm', big endian Morton key, big endian biased x, y, z. Sorted by
+	// the Morton key so the blocks of an area are in a few key ranges.
+	bool m_morton = false;
 };
 
 class PlayerDatabaseLevelDB : public PlayerDatabase
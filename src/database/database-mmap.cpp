@@ -0,0 +1,478 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "database-mmap.h"
+
+#if USE_MMAP_DATABASE
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "exceptions.h"
+#include "filesys.h"
+#include "log.h"
+#include "util/serialize.h"
+#include "util/string.h"
+
+/*
+	Record:
+	u32 magic
+	u32 crc32 of everything after it
+	s32 x, y, z
+	u32 data size, TOMBSTONE for a deleted block
+	u8[data size] data
+*/
+
+namespace
+{
+constexpr u32 RECORD_MAGIC = 0x464d4231; // "FMB1"
+constexpr u32 TOMBSTONE = 0xffffffff;
+constexpr size_t HEADER_SIZE = 24;
+
+u32 record_crc(const u8 *record, size_t data_size)
+{
+	return crc32(0, record + 8, HEADER_SIZE - 8 + data_size);
+}
+
+v3bpos_t record_pos(const u8 *record)
+{
+	return v3bpos_t(readS32(record + 8), readS32(record + 12), readS32(record + 16));
+}
+
+std::string errno_string()
+{
+	return std::strerror(errno);
+}
+
+// Make size bytes of the file take disk space, returns 0 or an errno value
+int allocate_file(int fd, size_t size)
+{
+	if (!size)
+		return 0;
+#if defined(__APPLE__)
+	fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0};
+	if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+		return errno;
+	return ftruncate(fd, size) == 0 ? 0 : errno;
+#else
+	return posix_fallocate(fd, 0, size);
+#endif
+}
+}
+
+MapDatabaseMmap::Segment::~Segment()
+{
+	if (data)
+		munmap(data, capacity);
+	if (fd >= 0)
+		close(fd);
+}
+
+MapDatabaseMmap::MapDatabaseMmap(const std::string &savedir, size_t segment_size) :
+		m_path(savedir + DIR_DELIM + "map.mmap"), m_segment_size(segment_size)
+{
+	if (!fs::CreateAllDirs(m_path))
+		throw FileNotGoodException("Failed to create map database directory " + m_path);
+
+	std::vector<u32> ids;
+	for (const auto &node : fs::GetDirListing(m_path)) {
+		if (node.dir || node.name.size() != 12 || !str_ends_with(node.name, ".seg"))
+			continue;
+		ids.push_back(mystoi(node.name.substr(0, 8)));
+	}
+	std::sort(ids.begin(), ids.end());
+
+	for (const auto id : ids) {
+		auto segment = openSegment(id, false);
+		if (!segment->capacity) {
+			fs::DeleteSingleFileOrEmptyDirectory(segment->path);
+			continue;
+		}
+		replaySegment(*segment);
+		m_segments.emplace(id, std::move(segment));
+	}
+	for (const auto &[pos, location] : m_index)
+		location.segment->live += HEADER_SIZE + location.size;
+
+	// Go on with the last segment, a possibly torn record at its end is cut
+	// off before appending
+	if (!m_segments.empty() && m_segments.rbegin()->second->used < m_segment_size) {
+		auto &last = *m_segments.rbegin()->second;
+		mapSegment(last, true, last.used, m_segment_size);
+		m_active = &last;
+	} else {
+		rollSegment(0);
+	}
+
+	infostream << "MapDatabaseMmap: " << m_index.size() << " blocks in "
+			   << m_segments.size() << " segments" << std::endl;
+
+	m_compact_thread = std::make_unique<CompactThread>(this);
+	m_compact_thread->start();
+}
+
+MapDatabaseMmap::~MapDatabaseMmap()
+{
+	m_compact_thread->stop();
+	m_compact_thread->wake();
+	m_compact_thread->wait();
+
+	const std::unique_lock lock(m_mutex);
+	syncSegment(*m_active, true);
+	const auto active_path = m_active->path;
+	const bool active_empty = !m_active->used;
+	if (!active_empty && ftruncate(m_active->fd, m_active->used) != 0)
+		warningstream << "MapDatabaseMmap: cannot truncate " << active_path << ": "
+					  << errno_string() << std::endl;
+	m_active = nullptr;
+	m_segments.clear();
+	if (active_empty)
+		fs::DeleteSingleFileOrEmptyDirectory(active_path);
+}
+
+std::unique_ptr<MapDatabaseMmap::Segment> MapDatabaseMmap::openSegment(
+		u32 id, bool create, size_t capacity)
+{
+	auto segment = std::make_unique<Segment>();
+	segment->id = id;
+	char name[16];
+	snprintf(name, sizeof(name), "%08u.seg", id);
+	segment->path = m_path + DIR_DELIM + name;
+
+	try {
+		mapSegment(*segment, create, 0, capacity);
+	} catch (const DatabaseException &) {
+		if (create) {
+			const auto path = segment->path;
+			segment.reset();
+			fs::DeleteSingleFileOrEmptyDirectory(path);
+		}
+		throw;
+	}
+	return segment;
+}
+
+void MapDatabaseMmap::mapSegment(Segment &segment, bool writable, size_t keep,
+		size_t capacity)
+{
+	if (segment.data)
+		munmap(segment.data, segment.capacity);
+	segment.data = nullptr;
+	if (segment.fd >= 0)
+		close(segment.fd);
+
+	// Sealed segments are never written again
+	segment.fd = open(segment.path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (segment.fd < 0)
+		throw DatabaseException("MapDatabaseMmap: cannot open " + segment.path + ": " +
+								errno_string());
+
+	if (writable) {
+		// Cutting the file also zeroes whatever was after keep
+		if (ftruncate(segment.fd, keep) != 0)
+			throw DatabaseException("MapDatabaseMmap: cannot resize " + segment.path +
+									": " + errno_string());
+		// A write to a sparse mapping on a full disk would be a SIGBUS
+		if (const int err = allocate_file(segment.fd, capacity))
+			throw DatabaseException("MapDatabaseMmap: cannot allocate " +
+									std::to_string(capacity) + " bytes for " +
+									segment.path + ": " + std::strerror(err));
+	} else {
+		struct stat st;
+		if (fstat(segment.fd, &st) != 0)
+			throw DatabaseException("MapDatabaseMmap: cannot stat " + segment.path +
+									": " + errno_string());
+		capacity = st.st_size;
+	}
+	segment.capacity = capacity;
+	if (!capacity)
+		return;
+
+	void *data = mmap(nullptr, capacity, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+			MAP_SHARED, segment.fd, 0);
+	if (data == MAP_FAILED)
+		throw DatabaseException("MapDatabaseMmap: cannot map " + segment.path + ": " +
+								errno_string());
+	segment.data = static_cast<u8 *>(data);
+}
+
+void MapDatabaseMmap::replaySegment(Segment &segment)
+{
+	size_t offset = 0;
+	while (offset + HEADER_SIZE <= segment.capacity) {
+		const u8 *record = segment.data + offset;
+		if (readU32(record) != RECORD_MAGIC)
+			break;
+		const u32 size = readU32(record + 20);
+		const size_t data_size = size == TOMBSTONE ? 0 : size;
+		if (offset + HEADER_SIZE + data_size > segment.capacity ||
+				readU32(record + 4) != record_crc(record, data_size))
+			break;
+
+		const v3bpos_t pos = record_pos(record);
+		if (size == TOMBSTONE)
+			m_index.erase(pos);
+		else
+			m_index[pos] = Location{&segment, (u32)offset, size};
+		offset += HEADER_SIZE + data_size;
+	}
+
+	if (offset + 4 <= segment.capacity && readU32(segment.data + offset) != 0)
+		warningstream << "MapDatabaseMmap: ignoring damaged records from offset "
+					  << offset << " of " << segment.path << std::endl;
+	segment.used = segment.synced = offset;
+}
+
+void MapDatabaseMmap::rollSegment(size_t size)
+{
+	const u32 id = m_segments.empty() ? 1 : m_segments.rbegin()->first + 1;
+	// Opened first, the active segment stays as it is when this throws
+	auto segment = openSegment(id, true, std::max(m_segment_size, size));
+
+	if (m_active) {
+		if (!m_active->used) {
+			const auto path = m_active->path;
+			m_segments.erase(m_active->id);
+			fs::DeleteSingleFileOrEmptyDirectory(path);
+		} else {
+			syncSegment(*m_active, true);
+			if (ftruncate(m_active->fd, m_active->used) != 0)
+				warningstream << "MapDatabaseMmap: cannot truncate " << m_active->path
+							  << ": " << errno_string() << std::endl;
+		}
+		m_active = nullptr;
+	}
+
+	m_active = segment.get();
+	m_segments.emplace(id, std::move(segment));
+
+	if (m_compact_thread)
+		m_compact_thread->wake();
+}
+
+void MapDatabaseMmap::syncSegment(Segment &segment, bool wait)
+{
+	if (segment.synced >= segment.used)
+		return;
+	// msync wants a page aligned address
+	static const size_t page_size = sysconf(_SC_PAGESIZE);
+	const size_t begin = segment.synced / page_size * page_size;
+	if (msync(segment.data + begin, segment.used - begin, wait ? MS_SYNC : MS_ASYNC) != 0)
+		warningstream << "MapDatabaseMmap: cannot sync " << segment.path << ": "
+					  << errno_string() << std::endl;
+	segment.synced = segment.used;
+}
+
+MapDatabaseMmap::Location MapDatabaseMmap::append(
+		const v3bpos_t &pos, std::string_view data, bool tombstone)
+{
+	const size_t data_size = tombstone ? 0 : data.size();
+	if (m_active->used + HEADER_SIZE + data_size > m_active->capacity)
+		rollSegment(HEADER_SIZE + data_size);
+
+	u8 *record = m_active->data + m_active->used;
+	writeS32(record + 8, pos.X);
+	writeS32(record + 12, pos.Y);
+	writeS32(record + 16, pos.Z);
+	writeU32(record + 20, tombstone ? TOMBSTONE : data_size);
+	memcpy(record + HEADER_SIZE, data.data(), data_size);
+	writeU32(record + 4, record_crc(record, data_size));
+	writeU32(record, RECORD_MAGIC);
+
+	const Location location{m_active, (u32)m_active->used, (u32)data_size};
+	m_active->used += HEADER_SIZE + data_size;
+	return location;
+}
+
+void MapDatabaseMmap::putNoLock(const v3bpos_t &pos, std::string_view data)
+{
+	const auto location = append(pos, data, false);
+	location.segment->live += HEADER_SIZE + location.size;
+	const auto [it, inserted] = m_index.try_emplace(pos, location);
+	if (!inserted) {
+		it->second.segment->live -= HEADER_SIZE + it->second.size;
+		it->second = location;
+	}
+}
+
+void MapDatabaseMmap::removeNoLock(const v3bpos_t &pos)
+{
+	const auto it = m_index.find(pos);
+	if (it == m_index.end())
+		return;
+	it->second.segment->live -= HEADER_SIZE + it->second.size;
+	m_index.erase(it);
+	append(pos, {}, true);
+}
+
+bool MapDatabaseMmap::saveBlock(const v3bpos_t &pos, std::string_view data)
+{
+	const std::unique_lock lock(m_mutex);
+	putNoLock(pos, data);
+	return true;
+}
+
+size_t MapDatabaseMmap::saveBlocks(
+		const std::vector<std::pair<v3bpos_t, std::string>> &blocks)
+{
+	const std::unique_lock lock(m_mutex);
+	for (const auto &[pos, data] : blocks)
+		putNoLock(pos, data);
+	return blocks.size();
+}
+
+void MapDatabaseMmap::loadBlock(const v3bpos_t &pos, std::string *block)
+{
+	const std::shared_lock lock(m_mutex);
+	const auto it = m_index.find(pos);
+	if (it == m_index.end()) {
+		block->clear();
+		return;
+	}
+	const auto &location = it->second;
+	block->assign(reinterpret_cast<const char *>(location.segment->data) +
+						  location.offset + HEADER_SIZE,
+			location.size);
+}
+
+void MapDatabaseMmap::loadBlocks(
+		const std::vector<v3bpos_t> &pos, std::vector<std::string> &blocks)
+{
+	blocks.resize(pos.size());
+	const std::shared_lock lock(m_mutex);
+	for (size_t i = 0; i < pos.size(); ++i) {
+		const auto it = m_index.find(pos[i]);
+		if (it == m_index.end()) {
+			blocks[i].clear();
+			continue;
+		}
+		const auto &location = it->second;
+		blocks[i].assign(reinterpret_cast<const char *>(location.segment->data) +
+								 location.offset + HEADER_SIZE,
+				location.size);
+	}
+}
+
+bool MapDatabaseMmap::deleteBlock(const v3bpos_t &pos)
+{
+	const std::unique_lock lock(m_mutex);
+	removeNoLock(pos);
+	return true;
+}
+
+void MapDatabaseMmap::listAllLoadableBlocks(std::vector<v3bpos_t> &dst)
+{
+	const std::shared_lock lock(m_mutex);
+	dst.reserve(dst.size() + m_index.size());
+	for (const auto &[pos, location] : m_index)
+		dst.push_back(pos);
+}
+
+void MapDatabaseMmap::endSave()
+{
+	const std::unique_lock lock(m_mutex);
+	syncSegment(*m_active, true);
+}
+
+size_t MapDatabaseMmap::compact()
+{
+	std::vector<u32> ids;
+	{
+		const std::shared_lock lock(m_mutex);
+		for (const auto &[id, segment] : m_segments)
+			if (segment.get() != m_active && (segment->live * 2 < segment->used ||
+						segment->used < m_segment_size / 4))
+				ids.push_back(id);
+	}
+
+	size_t removed = 0;
+	for (const auto id : ids) {
+		if (m_compact_thread && m_compact_thread->stopRequested())
+			break;
+		removed += compactSegment(id);
+	}
+	return removed;
+}
+
+bool MapDatabaseMmap::compactSegment(u32 id)
+{
+	Segment *victim = nullptr;
+	{
+		const std::shared_lock lock(m_mutex);
+		const auto it = m_segments.find(id);
+		if (it == m_segments.end() || it->second.get() == m_active)
+			return false;
+		victim = it->second.get();
+	}
+
+	// Sealed segments never change and are only removed here, so the victim
+	// is read without the lock
+	size_t offset = 0;
+	while (offset < victim->used) {
+		const u8 *record = victim->data + offset;
+		const v3bpos_t pos = record_pos(record);
+		const u32 size = readU32(record + 20);
+		const bool tombstone = size == TOMBSTONE;
+		{
+			const std::unique_lock lock(m_mutex);
+			const auto it = m_index.find(pos);
+			if (tombstone) {
+				// Still needed while an older segment may have the block
+				if (it == m_index.end() && m_segments.begin()->first < id)
+					append(pos, {}, true);
+			} else if (it != m_index.end() && it->second.segment == victim &&
+					it->second.offset == offset) {
+				putNoLock(pos, {reinterpret_cast<const char *>(record) + HEADER_SIZE,
+									   size});
+			}
+		}
+		offset += HEADER_SIZE + (tombstone ? 0 : size);
+	}
+
+	const std::unique_lock lock(m_mutex);
+	// The copies must be on disk before the originals are gone
+	syncSegment(*m_active, true);
+	const auto path = victim->path;
+	m_segments.erase(id);
+	fs::DeleteSingleFileOrEmptyDirectory(path);
+	verbosestream << "MapDatabaseMmap: compacted " << path << std::endl;
+	return true;
+}
+
+void *MapDatabaseMmap::CompactThread::run()
+{
+	while (!stopRequested()) {
+		m_wake.wait(10000);
+		if (stopRequested())
+			break;
+		try {
+			m_db->compact();
+		} catch (const std::exception &e) {
+			errorstream << "MapDatabaseMmap: compaction failed: " << e.what()
+						<< std::endl;
+		}
+	}
+	return nullptr;
+}
+
+#endif
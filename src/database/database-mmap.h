@@ -0,0 +1,142 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#if !defined(_WIN32)
+#define USE_MMAP_DATABASE 1
+#else
+#define USE_MMAP_DATABASE 0
+#endif
+
+#if USE_MMAP_DATABASE
+
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include "database.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+#include "util/unordered_map_hash.h"
+
+/*
+	Append-only map database.
+
+	Blocks are appended as checksummed records to segment files, which are
+	mapped into memory, reads copy straight out of the mapping. An index of
+	the newest record of each block is rebuilt from the segments on start, a
+	torn or corrupt record ends the replay of its segment. The last segment
+	is appended to again after a restart. Disk space of the active segment
+	is allocated up front, so a full disk fails the allocation instead of a
+	write to the mapping. Deleting appends a tombstone record. A background
+	thread rewrites the live records of mostly dead or small segments and
+	removes them.
+*/
+class MapDatabaseMmap : public MapDatabase
+{
+public:
+	MapDatabaseMmap(const std::string &savedir, size_t segment_size = SEGMENT_SIZE);
+	~MapDatabaseMmap();
+
+	bool saveBlock(const v3bpos_t &pos, std::string_view data) override;
+	void loadBlock(const v3bpos_t &pos, std::string *block) override;
+	bool deleteBlock(const v3bpos_t &pos) override;
+	void listAllLoadableBlocks(std::vector<v3bpos_t> &dst) override;
+
+	void loadBlocks(const std::vector<v3bpos_t> &pos,
+			std::vector<std::string> &blocks) override;
+	size_t saveBlocks(
+			const std::vector<std::pair<v3bpos_t, std::string>> &blocks) override;
+
+	void beginSave() override {}
+	// Flush written records to disk
+	void endSave() override;
+
+	// Rewrite the live records of sealed segments that are less than half
+	// live or below a quarter of the segment size and remove them, returns
+	// count of segments removed
+	size_t compact();
+
+	static constexpr size_t SEGMENT_SIZE = 64 * 1024 * 1024;
+
+private:
+	struct Segment
+	{
+		u32 id;
+		std::string path;
+		int fd = -1;
+		u8 *data = nullptr;
+		size_t capacity = 0;
+		// Bytes of valid records
+		size_t used = 0;
+		// Bytes of records still in the index
+		size_t live = 0;
+		size_t synced = 0;
+
+		~Segment();
+	};
+
+	struct Location
+	{
+		Segment *segment;
+		u32 offset;
+		u32 size;
+	};
+
+	class CompactThread : public Thread
+	{
+	public:
+		CompactThread(MapDatabaseMmap *db) : Thread("MapDbCompact"), m_db(db) {}
+		void wake() { m_wake.post(); }
+
+	protected:
+		void *run() override;
+
+	private:
+		MapDatabaseMmap *m_db;
+		Semaphore m_wake;
+	};
+
+	std::unique_ptr<Segment> openSegment(u32 id, bool create, size_t capacity = 0);
+	// (Re)map a segment read only, or for appending: the file is cut to keep
+	// bytes and capacity bytes are allocated on disk
+	void mapSegment(Segment &segment, bool writable, size_t keep = 0, size_t capacity = 0);
+	void replaySegment(Segment &segment);
+	// Seal the active segment and start a new one for at least size bytes
+	void rollSegment(size_t size);
+	void syncSegment(Segment &segment, bool wait);
+
+	// These need m_mutex held exclusively
+	Location append(const v3bpos_t &pos, std::string_view data, bool tombstone);
+	void putNoLock(const v3bpos_t &pos, std::string_view data);
+	void removeNoLock(const v3bpos_t &pos);
+
+	bool compactSegment(u32 id);
+
+	const std::string m_path;
+	const size_t m_segment_size;
+
+	mutable std::shared_mutex m_mutex;
+	std::map<u32, std::unique_ptr<Segment>> m_segments;
+	Segment *m_active = nullptr;
+	unordered_map_v3bpos<Location> m_index;
+
+	std::unique_ptr<CompactThread> m_compact_thread;
+};
+
+#endif
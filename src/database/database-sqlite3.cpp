@@ -209,9 +209,10 @@ Database_SQLite3::~Database_SQLite3()
  * Map database
  */
 
-MapDatabaseSQLite3::MapDatabaseSQLite3(const std::string &savedir):
+MapDatabaseSQLite3::MapDatabaseSQLite3(const std::string &savedir, bool morton):
 	Database_SQLite3(savedir, "map"),
-	MapDatabase()
+	MapDatabase(),
+	m_create_morton(morton)
 {
 }
 
@@ -221,6 +222,7 @@ MapDatabaseSQLite3::~MapDatabaseSQLite3()
 	FINALIZE_STATEMENT(write)
 	FINALIZE_STATEMENT(list)
 	FINALIZE_STATEMENT(delete)
+	FINALIZE_STATEMENT(area)
 }
 
 
@@ -231,6 +233,25 @@ void MapDatabaseSQLite3::createDatabase()
 	// Note: before 5.12.0 the format was blocks(pos INT, data BLOB).
 	// This function only runs for newly created databases.
 
+	// Morton layout: the key of a block and its neighbours are close, so the
+	// rows of an area are in a few runs of pages. Positions are kept to tell
+	// apart the far blocks with clamped keys.
+	const char *schema_morton =
+		"CREATE TABLE IF NOT EXISTS `blocks` (\n"
+			"`morton` INTEGER,"
+			"`x` INTEGER,"
+			"`y` INTEGER,"
+			"`z` INTEGER,"
+			"`data` BLOB NOT NULL,"
+			"PRIMARY KEY (`morton`, `x`, `y`, `z`)"
+		") WITHOUT ROWID;\n"
+	;
+	if (m_create_morton) {
+		SQLOK(sqlite3_exec(m_database, schema_morton, NULL, NULL, NULL),
+			"Failed to create database table");
+		return;
+	}
+
 	const char *schema =
 		"CREATE TABLE IF NOT EXISTS `blocks` (\n"
 			"`x` INTEGER,"
@@ -252,14 +273,27 @@ void MapDatabaseSQLite3::initStatements()
 {
 	assert(checkTable("blocks"));
 	m_new_format = checkColumn("blocks", "z");
+	m_morton = checkColumn("blocks", "morton");
 	infostream << "MapDatabaseSQLite3: split column format = "
-		<< (m_new_format ? "yes" : "no") << std::endl;
-
-	if (m_new_format) {
+		<< (m_new_format ? "yes" : "no") << ", morton = "
+		<< (m_morton ? "yes" : "no") << std::endl;
+	if (m_morton != m_create_morton)
+		infostream << "MapDatabaseSQLite3: using existing key layout, "
+			"migrate with --migrate-map-layout to change it" << std::endl;
+
+	if (m_morton) {
+		PREPARE_STATEMENT(read, "SELECT `data` FROM `blocks` WHERE `morton` = ? AND `x` = ? AND `y` = ? AND `z` = ? LIMIT 1");
+		PREPARE_STATEMENT(write, "REPLACE INTO `blocks` (`morton`, `x`, `y`, `z`, `data`) VALUES (?, ?, ?, ?, ?)");
+		PREPARE_STATEMENT(delete, "DELETE FROM `blocks` WHERE `morton` = ? AND `x` = ? AND `y` = ? AND `z` = ?");
+		PREPARE_STATEMENT(list, "SELECT `x`, `y`, `z` FROM `blocks`");
+		PREPARE_STATEMENT(area, "SELECT `x`, `y`, `z`, `data` FROM `blocks` WHERE `morton` BETWEEN ? AND ?");
+	} else if (m_new_format) {
 		PREPARE_STATEMENT(read, "SELECT `data` FROM `blocks` WHERE `x` = ? AND `y` = ? AND `z` = ? LIMIT 1");
 		PREPARE_STATEMENT(write, "REPLACE INTO `blocks` (`x`, `y`, `z`, `data`) VALUES (?, ?, ?, ?)");
 		PREPARE_STATEMENT(delete, "DELETE FROM `blocks` WHERE `x` = ? AND `y` = ? AND `z` = ?");
 		PREPARE_STATEMENT(list, "SELECT `x`, `y`, `z` FROM `blocks`");
+		PREPARE_STATEMENT(area, "SELECT `x`, `y`, `z`, `data` FROM `blocks` WHERE "
+			"`x` BETWEEN ? AND ? AND `z` BETWEEN ? AND ? AND `y` BETWEEN ? AND ?");
 	} else {
 		PREPARE_STATEMENT(read, "SELECT `data` FROM `blocks` WHERE `pos` = ? LIMIT 1");
 		PREPARE_STATEMENT(write, "REPLACE INTO `blocks` (`pos`, `data`) VALUES (?, ?)");
@@ -270,7 +304,13 @@ void MapDatabaseSQLite3::initStatements()
 
 inline int MapDatabaseSQLite3::bindPos(sqlite3_stmt *stmt, v3bpos_t pos, int index)
 {
-	if (m_new_format) {
+	if (m_morton) {
+		int64_to_sqlite(stmt, index, getBlockAsMorton(pos));
+		int_to_sqlite(stmt, index + 1, pos.X);
+		int_to_sqlite(stmt, index + 2, pos.Y);
+		int_to_sqlite(stmt, index + 3, pos.Z);
+		return index + 4;
+	} else if (m_new_format) {
 		int_to_sqlite(stmt, index, pos.X);
 		int_to_sqlite(stmt, index + 1, pos.Y);
 		int_to_sqlite(stmt, index + 2, pos.Z);
@@ -333,6 +373,100 @@ void MapDatabaseSQLite3::loadBlock(const v3bpos_t &pos, std::string *block)
 	sqlite3_reset(m_stmt_read);
 }
 
+void MapDatabaseSQLite3::loadBlocks(
+		const std::vector<v3bpos_t> &pos, std::vector<std::string> &blocks)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	verifyDatabase();
+
+	blocks.resize(pos.size());
+	for (size_t i = 0; i < pos.size(); ++i) {
+		bindPos(m_stmt_read, pos[i]);
+		if (sqlite3_step(m_stmt_read) == SQLITE_ROW)
+			blocks[i].assign(sqlite_to_blob(m_stmt_read, 0));
+		else
+			blocks[i].clear();
+		sqlite3_reset(m_stmt_read);
+	}
+}
+
+size_t MapDatabaseSQLite3::saveBlocks(
+		const std::vector<std::pair<v3bpos_t, std::string>> &blocks)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	verifyDatabase();
+
+	// One transaction for the whole batch, unless the caller has one open
+	const bool transaction = sqlite3_get_autocommit(m_database);
+	if (transaction)
+		beginSave();
+	try {
+		for (const auto &[pos, data] : blocks) {
+			int col = bindPos(m_stmt_write, pos);
+			blob_to_sqlite(m_stmt_write, col, data);
+
+			SQLRES(sqlite3_step(m_stmt_write), SQLITE_DONE, "Failed to save block")
+			sqlite3_reset(m_stmt_write);
+		}
+	} catch (...) {
+		sqlite3_reset(m_stmt_write);
+		if (transaction)
+			endSave();
+		throw;
+	}
+	if (transaction)
+		endSave();
+
+	return blocks.size();
+}
+
+void MapDatabaseSQLite3::loadBlocksArea(const v3bpos_t &min, const v3bpos_t &max,
+		std::vector<std::pair<v3bpos_t, std::string>> &blocks)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	verifyDatabase();
+
+	if (!m_stmt_area) {
+		lock.unlock();
+		MapDatabase::loadBlocksArea(min, max, blocks);
+		return;
+	}
+
+	const auto read_rows = [&] {
+		while (sqlite3_step(m_stmt_area) == SQLITE_ROW) {
+			const v3bpos_t p(sqlite_to_int(m_stmt_area, 0),
+					sqlite_to_int(m_stmt_area, 1), sqlite_to_int(m_stmt_area, 2));
+			// Coarse Morton ranges also cover blocks around the area
+			if (p.X < min.X || p.Y < min.Y || p.Z < min.Z ||
+					p.X > max.X || p.Y > max.Y || p.Z > max.Z)
+				continue;
+			blocks.emplace_back(p, sqlite_to_blob(m_stmt_area, 3));
+		}
+		sqlite3_reset(m_stmt_area);
+	};
+
+	if (m_morton) {
+		std::vector<std::pair<u64, u64>> ranges;
+		getMortonRanges(min, max, ranges);
+		for (const auto &[first, last] : ranges) {
+			int64_to_sqlite(m_stmt_area, 1, first);
+			int64_to_sqlite(m_stmt_area, 2, last);
+			read_rows();
+		}
+	} else {
+		int_to_sqlite(m_stmt_area, 1, min.X);
+		int_to_sqlite(m_stmt_area, 2, max.X);
+		int_to_sqlite(m_stmt_area, 3, min.Z);
+		int_to_sqlite(m_stmt_area, 4, max.Z);
+		int_to_sqlite(m_stmt_area, 5, min.Y);
+		int_to_sqlite(m_stmt_area, 6, max.Y);
+		read_rows();
+	}
+}
+
 void MapDatabaseSQLite3::listAllLoadableBlocks(std::vector<v3bpos_t> &dst)
 {
 	verifyDatabase();
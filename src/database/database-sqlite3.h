@@ -170,13 +170,23 @@ class Database_SQLite3 : public Database
 class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 {
 public:
-	MapDatabaseSQLite3(const std::string &savedir);
+	// morton: key layout used when a new database is created, existing
+	// databases keep their layout
+	MapDatabaseSQLite3(const std::string &savedir, bool morton = false);
 	virtual ~MapDatabaseSQLite3();
 
 	bool saveBlock(const v3bpos_t &pos, std::string_view data);
 	void loadBlock(const v3bpos_t &pos, std::string *block);
 	bool deleteBlock(const v3bpos_t &pos);
 	void listAllLoadableBlocks(std::vector<v3bpos_t> &dst);
+	std::string getKeyLayout() const override { return m_morton ? "morton" : "default"; }
+
+	void loadBlocks(const std::vector<v3bpos_t> &pos,
+			std::vector<std::string> &blocks) override;
+	size_t saveBlocks(
+			const std::vector<std::pair<v3bpos_t, std::string>> &blocks) override;
+	void loadBlocksArea(const v3bpos_t &min, const v3bpos_t &max,
+			std::vector<std::pair<v3bpos_t, std::string>> &blocks) override;
 
 	PARENT_CLASS_FUNCS
 
@@ -190,6 +200,9 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 	int bindPos(sqlite3_stmt *stmt, v3bpos_t pos, int index = 1);
 
 	bool m_new_format = false;
+	// Rows are clustered by the Morton key of the position
+	bool m_morton = false;
+	const bool m_create_morton;
 
 	std::mutex mutex;
 
@@ -197,6 +210,7 @@ class MapDatabaseSQLite3 : private Database_SQLite3, public MapDatabase
 	sqlite3_stmt *m_stmt_write = nullptr;
 	sqlite3_stmt *m_stmt_list = nullptr;
 	sqlite3_stmt *m_stmt_delete = nullptr;
+	sqlite3_stmt *m_stmt_area = nullptr;
 };
 
 class PlayerDatabaseSQLite3 : private Database_SQLite3, public PlayerDatabase
@@ -6,6 +6,7 @@
 #include "constants.h"
 #include "irr_v3d.h"
 #include "irrlichttypes.h"
+#include <algorithm>
 #include <sstream>
 #include "util/string.h"
 
@@ -20,6 +21,145 @@ s64 MapDatabase::getBlockAsInteger(const v3bpos_t &pos)
 	return ((s64) pos.Z << 24) + ((s64) pos.Y << 12) + pos.X;
 }
 
+namespace
+{
+constexpr s64 MORTON_BIAS = 1 << 20;
+
+// Coordinate clamped to the 21 bits of a Morton key, made non-negative
+u32 morton_bias(s64 c)
+{
+	return std::clamp<s64>(c, -MORTON_BIAS, MORTON_BIAS - 1) + MORTON_BIAS;
+}
+
+// Spread the low 21 bits of v so there are two zero bits between them
+u64 morton_spread(u32 c)
+{
+	u64 v = c & 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffULL;
+	v = (v | v << 16) & 0x1f0000ff0000ffULL;
+	v = (v | v << 8) & 0x100f00f00f00f00fULL;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+	v = (v | v << 2) & 0x1249249249249249ULL;
+	return v;
+}
+
+u32 morton_compact(u64 v)
+{
+	v &= 0x1249249249249249ULL;
+	v = (v | v >> 2) & 0x10c30c30c30c30c3ULL;
+	v = (v | v >> 4) & 0x100f00f00f00f00fULL;
+	v = (v | v >> 8) & 0x1f0000ff0000ffULL;
+	v = (v | v >> 16) & 0x1f00000000ffffULL;
+	v = (v | v >> 32) & 0x1fffff;
+	return v;
+}
+
+u64 morton_key(u32 x, u32 y, u32 z)
+{
+	return morton_spread(x) | morton_spread(y) << 1 | morton_spread(z) << 2;
+}
+
+struct MortonRanges
+{
+	u32 lo[3], hi[3];
+	size_t max_ranges;
+	std::vector<std::pair<u64, u64>> &ranges;
+
+	void add(u64 first, u64 last)
+	{
+		if (!ranges.empty() && ranges.back().second + 1 == first)
+			ranges.back().second = last;
+		else
+			ranges.emplace_back(first, last);
+	}
+
+	// Walk the octree in key order, a node of level l is an aligned cube with
+	// a side of 2^l blocks and holds a contiguous range of keys
+	void walk(const u32 (&origin)[3], u8 level)
+	{
+		const u32 side = 1u << level;
+		u32 min[3], max[3];
+		bool inside = true;
+		for (int i = 0; i < 3; ++i) {
+			if (origin[i] > hi[i] || origin[i] + side - 1 < lo[i])
+				return;
+			min[i] = std::max(origin[i], lo[i]);
+			max[i] = std::min(origin[i] + side - 1, hi[i]);
+			inside &= min[i] == origin[i] && max[i] == origin[i] + side - 1;
+		}
+		// The key is monotonic on each axis, so the corners of the overlap give
+		// the tightest single range when out of budget
+		if (inside || level == 0 || ranges.size() >= max_ranges) {
+			add(morton_key(min[0], min[1], min[2]),
+					morton_key(max[0], max[1], max[2]));
+			return;
+		}
+		const u32 half = side / 2;
+		for (u8 c = 0; c < 8; ++c) {
+			const u32 child[3] = {origin[0] + (c & 1 ? half : 0),
+					origin[1] + (c & 2 ? half : 0), origin[2] + (c & 4 ? half : 0)};
+			walk(child, level - 1);
+		}
+	}
+};
+}
+
+u64 MapDatabase::getBlockAsMorton(const v3bpos_t &pos)
+{
+	return morton_key(morton_bias(pos.X), morton_bias(pos.Y), morton_bias(pos.Z));
+}
+
+v3bpos_t MapDatabase::getMortonAsBlock(u64 i)
+{
+	return v3bpos_t((s64)morton_compact(i) - MORTON_BIAS,
+			(s64)morton_compact(i >> 1) - MORTON_BIAS,
+			(s64)morton_compact(i >> 2) - MORTON_BIAS);
+}
+
+void MapDatabase::getMortonRanges(const v3bpos_t &min, const v3bpos_t &max,
+		std::vector<std::pair<u64, u64>> &ranges, size_t max_ranges)
+{
+	MortonRanges walker{{morton_bias(min.X), morton_bias(min.Y), morton_bias(min.Z)},
+			{morton_bias(max.X), morton_bias(max.Y), morton_bias(max.Z)},
+			std::max<size_t>(max_ranges, 1), ranges};
+	walker.walk({0, 0, 0}, 21);
+}
+
+void MapDatabase::loadBlocks(
+		const std::vector<v3bpos_t> &pos, std::vector<std::string> &blocks)
+{
+	blocks.resize(pos.size());
+	for (size_t i = 0; i < pos.size(); ++i) {
+		blocks[i].clear();
+		loadBlock(pos[i], &blocks[i]);
+	}
+}
+
+void MapDatabase::loadBlocksArea(const v3bpos_t &min, const v3bpos_t &max,
+		std::vector<std::pair<v3bpos_t, std::string>> &blocks)
+{
+	std::vector<v3bpos_t> pos;
+	for (bpos_t z = min.Z; z <= max.Z; ++z)
+		for (bpos_t y = min.Y; y <= max.Y; ++y)
+			for (bpos_t x = min.X; x <= max.X; ++x)
+				pos.emplace_back(x, y, z);
+
+	std::vector<std::string> data;
+	loadBlocks(pos, data);
+	for (size_t i = 0; i < pos.size(); ++i)
+		if (!data[i].empty())
+			blocks.emplace_back(pos[i], std::move(data[i]));
+}
+
+size_t MapDatabase::saveBlocks(
+		const std::vector<std::pair<v3bpos_t, std::string>> &blocks)
+{
+	size_t saved = 0;
+	for (const auto &[pos, data] : blocks)
+		saved += saveBlock(pos, data);
+	return saved;
+}
+
 v3bpos_t MapDatabase::getIntegerAsBlock(s64 i)
 {
 	// Offset so that all negative coordinates become non-negative
@@ -6,6 +6,7 @@
 
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 #include "irr_v3d.h"
 #include "irrlichttypes.h"
@@ -33,7 +34,27 @@ class MapDatabase : public Database
 	virtual void loadBlock(const v3bpos_t &pos, std::string *block) = 0;
 	virtual bool deleteBlock(const v3bpos_t &pos) = 0;
 
+	// Batched access, backends may override with something faster than
+	// one call per block. blocks gets one (maybe empty) string per position.
+	virtual void loadBlocks(const std::vector<v3bpos_t> &pos,
+			std::vector<std::string> &blocks);
+	// Returns count of blocks saved
+	virtual size_t saveBlocks(
+			const std::vector<std::pair<v3bpos_t, std::string>> &blocks);
+	// Append all existing blocks in the box min..max to blocks
+	virtual void loadBlocksArea(const v3bpos_t &min, const v3bpos_t &max,
+			std::vector<std::pair<v3bpos_t, std::string>> &blocks);
+
 	static s64 getBlockAsInteger(const v3bpos_t &pos);
+	// Z-order curve key, neighbour blocks get near keys. 21 bits per axis,
+	// coordinates outside of [-2^20, 2^20) are clamped so the key is only
+	// unique inside of that.
+	static u64 getBlockAsMorton(const v3bpos_t &pos);
+	static v3bpos_t getMortonAsBlock(u64 i);
+	// Sorted, merged key ranges covering the box min..max. Once max_ranges is
+	// reached ranges get coarser and may also cover blocks outside of the box.
+	static void getMortonRanges(const v3bpos_t &min, const v3bpos_t &max,
+			std::vector<std::pair<u64, u64>> &ranges, size_t max_ranges = 64);
 	static v3bpos_t getIntegerAsBlock(s64 i);
 	
 	static std::string getBlockAsString(const v3bpos_t &pos);
@@ -44,6 +65,9 @@ class MapDatabase : public Database
 	//v3bpos_t getStringAsBlock(const std::string &i) const;
 
 	virtual void listAllLoadableBlocks(std::vector<v3bpos_t> &dst) = 0;
+
+	// Key layout found in the database, see map_key_layout
+	virtual std::string getKeyLayout() const { return "default"; }
 };
 
 class PlayerSAO;
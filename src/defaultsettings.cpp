@@ -138,6 +138,11 @@ void fm_set_default_settings(Settings *settings) {
 	// Filters
 	settings->setDefault("anisotropic_filter", "true"); // "false"
 
+	// Textures
+	settings->setDefault("texture_disk_cache", "true");
+	settings->setDefault("texture_disk_cache_size", "256");
+	settings->setDefault("texture_generate_threads", threads ? "4" : "1");
+
 	// Waving
 	settings->setDefault("enable_waving_leaves", "true"); // "false"
 	settings->setDefault("enable_waving_plants", "true"); // "false"
@@ -197,6 +202,9 @@ void fm_set_default_settings(Settings *settings) {
 	settings->setDefault("liquid_relax", android ? "1" : "2");
 	settings->setDefault("liquid_fast_flood", "-200");
 	settings->setDefault("liquid_pressure", "1");
+
+	// Lighting
+	settings->setDefault("light_threads", threads ? "4" : "1");
 	
 	// Weather
 	settings->setDefault("weather", threads ? "true" : "false");
@@ -253,6 +261,8 @@ void fm_set_default_settings(Settings *settings) {
 	settings->setDefault("emergequeue_limit_generate", ""); // autodetect from number of cpus
 	settings->setDefault("emergequeue_limit_total", ""); // autodetect from number of cpus
 	settings->setDefault("num_emerge_threads", ""); // "1" // Fix and enable auto
+	settings->setDefault("mapgen_noise_cache_size", "32");
+	settings->setDefault("mapgen_placement_threads", "0");
 	settings->setDefault("server_map_save_interval", "300"); // "5.3"
 	settings->setDefault("sqlite_synchronous", "1"); // "2"
 	settings->setDefault("save_generated_block", "true");
@@ -296,6 +306,7 @@ void fm_set_default_settings(Settings *settings) {
 	settings->setDefault("animation_wd_stop", "219");
 */
 	settings->setDefault("more_threads", "true");
+	settings->setDefault("pathfinder_threads", "1");
 	settings->setDefault("console_enabled", debug ? "true" : "false");
 
 	if (win32) {
@@ -527,6 +538,7 @@ void set_default_settings()
 	settings->setDefault("enable_split_login_register", "true");
 	settings->setDefault("occlusion_culler", "bfs");
 	settings->setDefault("enable_raytraced_culling", "true");
+	settings->setDefault("visibility_graph_culling", "true");
 	settings->setDefault("chat_weblink_color", "#8888FF");
 
 	// Keymap
@@ -28,6 +28,7 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include "constants.h"
 #include "irrlicht_changes/printing.h"
 #include "filesys.h"
+#include "fm_emerge_scheduler.h"
 #include "log.h"
 #include "serverenvironment.h"
 #include "servermap.h"
@@ -36,6 +37,7 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include "mapgen/mg_ore.h"
 #include "mapgen/mg_decoration.h"
 #include "mapgen/mg_schematic.h"
+#include "mapgen/mg_tiles.h"
 #include "porting.h"
 #include "profiler.h"
 #include "scripting_server.h"
@@ -65,12 +67,15 @@ EmergeParams::EmergeParams(EmergeManager *parent, const BiomeGen *biomegen,
 	gen_notify_on(parent->gen_notify_on),
 	gen_notify_on_deco_ids(&parent->gen_notify_on_deco_ids),
 	gen_notify_on_custom(&parent->gen_notify_on_custom),
+	noise_cache(parent->m_noise_cache.get()),
+	tile_placer(parent->m_tile_placer.get()),
 	biomemgr(biomemgr->clone()), oremgr(oremgr->clone()),
 	decomgr(decomgr->clone()), schemmgr(schemmgr->clone())
 {
 	env = parent->env;
 
 	this->biomegen = biomegen->clone(this->biomemgr);
+	this->biomegen->setNoiseCache(noise_cache);
 }
 
 ////
@@ -106,6 +111,12 @@ EmergeManager::EmergeManager(Server *server, MetricsBackend *mb)
 			"minetest_emerge_completed", help_str,
 			{{"status", emergeActionStrs[i]}}
 		);
+		m_queue_wait_counter[i] = mb->addCounter(
+			"minetest_emerge_queue_wait_seconds",
+			std::string("Total seconds waited in the emerge queue by emerges with status ") +
+				emergeActionStrs[i],
+			{{"status", emergeActionStrs[i]}}
+		);
 	}
 
 	m_qlimit_total = g_settings->getU32("emergequeue_limit_total");
@@ -116,6 +127,14 @@ EmergeManager::EmergeManager(Server *server, MetricsBackend *mb)
 	m_qlimit_diskonly = rangelim(m_qlimit_diskonly, 2, 1000000);
 	m_qlimit_generate = rangelim(m_qlimit_generate, 1, 1000000);
 	m_qlimit_total = std::max(m_qlimit_total, std::max(m_qlimit_diskonly, m_qlimit_generate));
+
+	const size_t noise_cache_mb = g_settings->getU32("mapgen_noise_cache_size");
+	if (noise_cache_mb)
+		m_noise_cache = std::make_unique<NoiseTileCache>(noise_cache_mb * 1024 * 1024);
+
+	const u16 placement_threads = g_settings->getU16("mapgen_placement_threads");
+	if (placement_threads)
+		m_tile_placer = std::make_unique<TilePlacer>(placement_threads);
 }
 
 
@@ -246,6 +265,7 @@ void EmergeManager::initThreads(bool should_multithread)
 		FATAL_ERROR_IF(!m_threads.empty(), "Threads already initialized.");
 	for (s16 i = 0; i < nthreads; i++)
 		m_threads.push_back(new EmergeThread(m_server, i));
+	m_scheduler = std::make_unique<EmergeScheduler>(nthreads, mgparams->chunksize);
 
 	infostream << "EmergeManager: using " << nthreads << " thread(s)" << std::endl;
 }
@@ -292,6 +312,10 @@ void EmergeManager::stopThreads()
 	for (u32 i = 0; i != m_threads.size(); i++)
 		m_threads[i]->wait();
 
+	// Each thread only cancelled its own chunk, the queue is shared
+	if (!m_threads.empty())
+		m_threads[0]->cancelPendingItems(true);
+
 	m_threads_active = false;
 }
 
@@ -300,7 +324,8 @@ bool EmergeManager::enqueueBlockEmerge(
 	session_t peer_id,
 	v3bpos_t blockpos,
 	bool allow_generate,
-	bool ignore_queue_limits)
+	bool ignore_queue_limits,
+	float priority)
 {
 	u16 flags = 0;
 	if (allow_generate)
@@ -308,7 +333,7 @@ bool EmergeManager::enqueueBlockEmerge(
 	if (ignore_queue_limits)
 		flags |= BLOCK_EMERGE_FORCE_QUEUE;
 
-	return enqueueBlockEmergeEx(blockpos, peer_id, flags, NULL, NULL);
+	return enqueueBlockEmergeEx(blockpos, peer_id, flags, NULL, NULL, priority);
 }
 
 
@@ -317,14 +342,17 @@ bool EmergeManager::enqueueBlockEmergeEx(
 	session_t peer_id,
 	u16 flags,
 	EmergeCompletionCallback callback,
-	void *callback_param)
+	void *callback_param,
+	float priority)
 {
-	EmergeThread *thread = NULL;
+	int wake;
 	bool entry_already_exists = false;
 
 	{
 		MutexAutoLock queuelock(m_queue_mutex);
 
+		FATAL_ERROR_IF(!m_scheduler, "No emerge threads!");
+
 		if (!pushBlockEmergeData(blockpos, peer_id, flags,
 				callback, callback_param, &entry_already_exists))
 			return false;
@@ -332,11 +360,11 @@ bool EmergeManager::enqueueBlockEmergeEx(
 		if (entry_already_exists)
 			return true;
 
-		thread = getOptimalThread();
-		thread->pushBlock(blockpos);
+		wake = m_scheduler->push(blockpos, priority);
 	}
 
-	thread->signal();
+	if (wake >= 0)
+		m_threads[wake]->signal();
 
 	return true;
 }
@@ -438,6 +466,7 @@ bool EmergeManager::pushBlockEmergeData(
 	} else {
 		bedata.flags = flags;
 		bedata.peer_requested = peer_requested;
+		bedata.enqueue_time_us = porting::getTimeUs();
 
 		count_peer++;
 	}
@@ -453,6 +482,8 @@ bool EmergeManager::popBlockEmergeData(v3bpos_t pos, BlockEmergeData *bedata)
 		return false;
 
 	*bedata = it->second;
+	if (bedata->enqueue_time_us)
+		bedata->queue_wait = (porting::getTimeUs() - bedata->enqueue_time_us) / 1000000.0;
 
 	auto it2 = m_peer_queue_count.find(bedata->peer_requested);
 	if (it2 == m_peer_queue_count.end())
@@ -469,30 +500,11 @@ bool EmergeManager::popBlockEmergeData(v3bpos_t pos, BlockEmergeData *bedata)
 }
 
 
-EmergeThread *EmergeManager::getOptimalThread()
-{
-	size_t nthreads = m_threads.size();
-
-	FATAL_ERROR_IF(nthreads == 0, "No emerge threads!");
-
-	size_t index = 0;
-	size_t nitems_lowest = m_threads[0]->m_block_queue.size();
-
-	for (size_t i = 1; i < nthreads; i++) {
-		size_t nitems = m_threads[i]->m_block_queue.size();
-		if (nitems < nitems_lowest) {
-			index = i;
-			nitems_lowest = nitems;
-		}
-	}
-
-	return m_threads[index];
-}
-
-void EmergeManager::reportCompletedEmerge(EmergeAction action)
+void EmergeManager::reportCompletedEmerge(EmergeAction action, double queue_wait)
 {
 	assert((size_t)action < ARRLEN(m_completed_emerge_counter));
 	m_completed_emerge_counter[(int)action]->increment();
+	m_queue_wait_counter[(int)action]->increment(queue_wait);
 }
 
 
@@ -519,35 +531,31 @@ void EmergeThread::signal()
 }
 
 
-bool EmergeThread::pushBlock(v3bpos_t pos)
-{
-	m_block_queue.push(pos);
-	return true;
-}
-
-
-void EmergeThread::cancelPendingItems()
+void EmergeThread::cancelPendingItems(bool all)
 {
 	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
-	while (!m_block_queue.empty()) {
-		BlockEmergeData bedata;
-		v3bpos_t pos;
-
-		pos = m_block_queue.front();
-		m_block_queue.pop();
+	std::vector<v3bpos_t> dropped;
+	if (all)
+		m_emerge->m_scheduler->clear(dropped);
+	else
+		m_emerge->m_scheduler->release(id, dropped);
 
+	for (const auto &pos : dropped) {
+		BlockEmergeData bedata;
 		m_emerge->popBlockEmergeData(pos, &bedata);
 
-		runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata.callbacks);
+		runCompletionCallbacks(pos, EMERGE_CANCELLED, bedata);
 	}
 }
 
 
 void EmergeThread::runCompletionCallbacks(v3bpos_t pos, EmergeAction action,
-	const EmergeCallbackList &callbacks)
+	const BlockEmergeData &bedata)
 {
-	m_emerge->reportCompletedEmerge(action);
+	m_emerge->reportCompletedEmerge(action, bedata.queue_wait);
+
+	const auto &callbacks = bedata.callbacks;
 
 	for (size_t i = 0; i != callbacks.size(); i++) {
 		EmergeCompletionCallback callback;
@@ -565,12 +573,9 @@ bool EmergeThread::popBlockEmerge(v3bpos_t *pos, BlockEmergeData *bedata)
 {
 	MutexAutoLock queuelock(m_emerge->m_queue_mutex);
 
-	if (m_block_queue.empty())
+	if (!m_emerge->m_scheduler->pop(id, *pos))
 		return false;
 
-	*pos = m_block_queue.front();
-	m_block_queue.pop();
-
 	m_emerge->popBlockEmergeData(*pos, bedata);
 
 	return true;
@@ -818,7 +823,7 @@ void *EmergeThread::run()
 			m_trans_liquid = nullptr;
 		}
 
-		runCompletionCallbacks(pos, action, bedata.callbacks);
+		runCompletionCallbacks(pos, action, bedata);
 
 		if (block) {
 			modified_blocks[pos] = block;
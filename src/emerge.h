@@ -9,6 +9,7 @@
 #include "network/networkprotocol.h"
 #include "irr_v3d.h"
 #include "util/metricsbackend.h"
+#include "util/unordered_map_hash.h"
 #include "mapgen/mapgen.h" // for MapgenParams
 #include "map.h"
 
@@ -30,6 +31,9 @@ class DecorationManager;
 class SchematicManager;
 class Server;
 class ModApiMapgen;
+class NoiseTileCache;
+class TilePlacer;
+class EmergeScheduler;
 struct MapDatabaseAccessor;
 
 // Structure containing inputs/outputs for chunk generation
@@ -79,8 +83,15 @@ struct BlockEmergeData {
 	u16 peer_requested;
 	u16 flags;
 	EmergeCallbackList callbacks;
+	// fm: When it was queued and how long it waited for a thread, in seconds
+	u64 enqueue_time_us = 0;
+	double queue_wait = 0;
 };
 
+// fm: Priority of requests not made by a client: after every block a client
+// waits for, first come first served
+constexpr float EMERGE_PRIORITY_FIFO = 1e9f;
+
 class EmergeParams {
 	friend class EmergeManager;
 public:
@@ -97,6 +108,8 @@ class EmergeParams {
 	u32 gen_notify_on;
 	const std::set<u32> *gen_notify_on_deco_ids; // shared
 	const std::set<std::string> *gen_notify_on_custom; // shared
+	NoiseTileCache *noise_cache; // shared, may be null
+	TilePlacer *tile_placer; // shared, may be null
 
 	BiomeGen *biomegen;
 	BiomeManager *biomemgr;
@@ -172,18 +185,21 @@ class EmergeManager {
 	void startThreads();
 	void stopThreads();
 
+	// priority: lower values are emerged first, e.g. distance from the player
 	bool enqueueBlockEmerge(
 		session_t peer_id,
 		v3bpos_t blockpos,
 		bool allow_generate,
-		bool ignore_queue_limits=false);
+		bool ignore_queue_limits=false,
+		float priority=EMERGE_PRIORITY_FIFO);
 
 	bool enqueueBlockEmergeEx(
 		v3bpos_t blockpos,
 		session_t peer_id,
 		u16 flags,
 		EmergeCompletionCallback callback,
-		void *callback_param);
+		void *callback_param,
+		float priority=EMERGE_PRIORITY_FIFO);
 
 	size_t getQueueSize();
 	bool isBlockInQueue(v3bpos_t pos);
@@ -211,8 +227,10 @@ class EmergeManager {
 	MapDatabaseAccessor *m_db = nullptr;
 
 	std::mutex m_queue_mutex;
-	std::map<v3bpos_t, BlockEmergeData> m_blocks_enqueued;
+	unordered_map_v3bpos<BlockEmergeData> m_blocks_enqueued;
 	std::unordered_map<u16, u32> m_peer_queue_count;
+	// Order in which threads take the queued blocks
+	std::unique_ptr<EmergeScheduler> m_scheduler;
 
 	u32 m_qlimit_total;
 	u32 m_qlimit_diskonly;
@@ -220,6 +238,12 @@ class EmergeManager {
 
 	// Emerge metrics
 	MetricCounterPtr m_completed_emerge_counter[5];
+	MetricCounterPtr m_queue_wait_counter[5];
+
+	// 2D noise maps shared by the mapgens
+	std::unique_ptr<NoiseTileCache> m_noise_cache;
+	// Runs ore and decoration placement of a chunk on several threads
+	std::unique_ptr<TilePlacer> m_tile_placer;
 
 	// Managers of various map generation-related components
 	// Note that each Mapgen gets a copy(!) of these to work with
@@ -231,9 +255,6 @@ class EmergeManager {
 	DecorationManager *decomgr;
 	SchematicManager *schemmgr;
 
-	// Requires m_queue_mutex held
-	EmergeThread *getOptimalThread();
-
 	bool pushBlockEmergeData(
 		v3bpos_t pos,
 		u16 peer_requested,
@@ -244,7 +265,8 @@ class EmergeManager {
 
 	bool popBlockEmergeData(v3bpos_t pos, BlockEmergeData *bedata);
 
-	void reportCompletedEmerge(EmergeAction action);
+	// queue_wait: seconds the block waited in the queue
+	void reportCompletedEmerge(EmergeAction action, double queue_wait);
 
 	friend class EmergeThread;
 
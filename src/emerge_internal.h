@@ -37,10 +37,8 @@ class EmergeThread : public thread_vector {
 	void *run();
 	void signal();
 
-	// Requires queue mutex held
-	bool pushBlock(v3bpos_t pos);
-
-	void cancelPendingItems();
+	// Cancel the rest of the claimed chunk, or everything queued if all is set
+	void cancelPendingItems(bool all = false);
 
 	EmergeManager *getEmergeManager() { return m_emerge; }
 	Mapgen *getMapgen() { return m_mapgen; }
@@ -49,7 +47,7 @@ class EmergeThread : public thread_vector {
 
 	void runCompletionCallbacks(
 		v3bpos_t pos, EmergeAction action,
-		const EmergeCallbackList &callbacks);
+		const BlockEmergeData &bedata);
 
 private:
 	Server *m_server;
@@ -62,7 +60,6 @@ class EmergeThread : public thread_vector {
 	UniqueQueue<v3pos_t> *m_trans_liquid; //< non-null only when generating a mapblock
 
 	Event m_queue_event;
-	std::queue<v3bpos_t> m_block_queue;
 
 	bool initScripting();
 
@@ -31,6 +31,7 @@
 #include "util/basic_macros.h"
 #include "line3d.h"
 
+class CollisionContext;
 class IGameDef;
 class Map;
 struct PointedThing;
@@ -64,6 +65,9 @@ class Environment
 
 	virtual Map &getMap() = 0;
 
+	// Shared collision data for objects moved in this environment, optional
+	virtual CollisionContext *getCollisionContext() { return nullptr; }
+
 	u32 getDayNightRatio();
 
 	// 0-23999
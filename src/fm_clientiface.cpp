@@ -41,7 +41,7 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 
 int RemoteClient::GetNextBlocksFm(ServerEnvironment *env, EmergeManager *emerge,
 		float dtime, std::vector<PrioritySortedBlockTransfer> &dest, double m_uptime,
-		u64 max_ms)
+		u64 max_ms, float rtt)
 {
 	const auto lock = try_lock_unique_rec();
 	if (!lock->owns_lock())
@@ -50,18 +50,8 @@ int RemoteClient::GetNextBlocksFm(ServerEnvironment *env, EmergeManager *emerge,
 	auto end_ms = porting::getTimeMs() + max_ms;
 
 	// Increment timers
-	m_nothing_to_send_pause_timer -= dtime;
-	m_nearest_unsent_reset_timer += dtime;
 	m_time_from_building += dtime;
 
-	/*
-	if (m_nearest_unsent_reset) {
-		m_nearest_unsent_reset = 0;
-		m_nearest_unsent_reset_timer = 999;
-		m_nothing_to_send_pause_timer = 0;
-		m_nearest_unsent_d = 0;
-	}
-*/
 	RemotePlayer *player = env->getPlayer(peer_id);
 	// This can happen sometimes; clients and players are not in perfect sync.
 	if (player == NULL)
@@ -71,16 +61,6 @@ int RemoteClient::GetNextBlocksFm(ServerEnvironment *env, EmergeManager *emerge,
 	if (sao == NULL)
 		return 0;
 
-	/*
-		// Won't send anything if already sending
-		if(m_blocks_sending.size() >= g_settings->getU16
-				("max_simultaneous_block_sends_per_client"))
-		{
-			//infostream<<"Not sending any blocks, Queue full."<<std::endl;
-			return;
-		}
-	*/
-
 	auto playerpos = sao->getBasePosition();
 
 	v3f playerspeed = player->getSpeed();
@@ -89,9 +69,11 @@ int RemoteClient::GetNextBlocksFm(ServerEnvironment *env, EmergeManager *emerge,
 	v3f playerspeeddir(0, 0, 0);
 	if (playerspeed.getLength() > 1.0 * BS)
 		playerspeeddir = playerspeed / playerspeed.getLength();
-	// Predict to next block
+	const f32 speed_in_blocks = (playerspeed / (MAP_BLOCKSIZE * BS)).getLength();
+	// Predict to next block, further when moving fast
 	v3opos_t playerpos_predicted =
-			playerpos + v3fToOpos(playerspeeddir) * MAP_BLOCKSIZE * BS;
+			playerpos + v3fToOpos(playerspeeddir) * MAP_BLOCKSIZE * BS *
+								std::max<f32>(1, speed_in_blocks / 2);
 
 	v3pos_t center_nodepos = floatToInt(playerpos_predicted, BS);
 
@@ -103,96 +85,10 @@ int RemoteClient::GetNextBlocksFm(ServerEnvironment *env, EmergeManager *emerge,
 	camera_dir.rotateYZBy(sao->getLookPitch());
 	camera_dir.rotateXZBy(sao->getRotation().Y);
 
-	// infostream<<"camera_dir=("<<camera_dir<<")"<< "
-	// camera_pos="<<camera_pos<<std::endl;
-
-	/*
-		Get the starting value of the block finder radius.
-	*/
-
-	if (m_last_center != center) {
-		m_last_center = center;
-		m_nearest_unsent_reset_timer = 999;
-		m_nothing_to_send_pause_timer = -1;
-	}
-
-	/*
-	if (m_last_direction.getDistanceFrom(camera_dir) > 0.4) { // 1 = 90degm_nothing_to_send_pause_timer
-		m_last_direction = camera_dir;
-		m_nearest_unsent_reset_timer = 999;
-	}
-    */
-
-	/*infostream<<"m_nearest_unsent_reset_timer="
-			<<m_nearest_unsent_reset_timer<<std::endl;*/
-
-	// Reset periodically to workaround for some bugs or stuff
-	if (m_nearest_unsent_reset_timer > 120.0) {
-		m_nearest_unsent_reset_timer = 0;
-		m_nearest_unsent_d = 0;
-		//m_nearest_unsent_reset = 0;
-		m_nothing_to_send_pause_timer = -1;
-		// infostream<<"Resetting m_nearest_unsent_d for "<<peer_id<<std::endl;
-	}
-
-	if (m_nothing_to_send_pause_timer >= 0) {
-		return 0;
-	}
-
-	// s16 last_nearest_unsent_d = m_nearest_unsent_d;
-	short d_start = m_nearest_unsent_d; //.load();
-
-	// infostream<<"d_start="<<d_start<<std::endl;
-
-	thread_local static const u16 max_simul_sends_setting =
-			g_settings->getU16("max_simultaneous_block_sends_per_client");
-	thread_local static const u16 max_simul_sends_usually = max_simul_sends_setting;
-
-	/*
-		Check the time from last addNode/removeNode.
-
-		Decrease send rate if player is building stuff.
-	*/
-
-#if 0
-	thread_local static const auto full_block_send_enable_min_time_from_building =
-			g_settings->getFloat("full_block_send_enable_min_time_from_building");
-	if (m_time_from_building < full_block_send_enable_min_time_from_building) {
-		/*
-		max_simul_sends_usually
-			= LIMITED_MAX_SIMULTANEOUS_BLOCK_SENDS;
-		*/
-		if (d_start <= 1)
-			d_start = 2;
-		++m_nearest_unsent_reset_want;
-	} else if (m_nearest_unsent_reset_want) {
-		m_nearest_unsent_reset_want = 0;
-		m_nearest_unsent_reset_timer = 999; // magical number more than ^ other number 120
-											// - need to reset d on next iteration
-	}
-#endif
-	/*
-		Number of blocks sending + number of blocks selected for sending
-	*/
-	u32 num_blocks_selected = 0;
-	u32 num_blocks_sending = 0;
-
-	/*
-		next time d will be continued from the d from which the nearest
-		unsent block was found this time.
-
-		This is because not necessarily any of the blocks found this
-		time are actually sent.
-	*/
-	s32 new_nearest_unsent_d = -1;
-
 	// get view range and camera fov from the client
 	auto wanted_range = sao->getWantedRange();
 	float camera_fov = sao->getFov();
 	// if FOV, wanted_range are not available (old client), fall back to old default
-	/*
-	if (wanted_range <= 0) wanted_range = 140;
-	*/
 	if (camera_fov <= 0)
 		camera_fov = ((fov + 5) * M_PI / 180) * 4. / 3.;
 
@@ -205,388 +101,195 @@ int RemoteClient::GetNextBlocksFm(ServerEnvironment *env, EmergeManager *emerge,
 			full_d_max = wanted_blocks;
 	}
 
-	/*
-		const s16 full_d_max = MYMIN(g_settings->getS16("max_block_send_distance"),
-	   wanted_range); const s16 d_opt =
-	   MYMIN(g_settings->getS16("block_send_optimize_distance"), wanted_range);
-	*/
-
-	const opos_t d_blocks_in_sight = full_d_max * BS * MAP_BLOCKSIZE;
-	// infostream << "Fov from client " << camera_fov << " full_d_max " << full_d_max <<
-	// std::endl;
-
-	s16 d_max = full_d_max;
 	thread_local static const s16 d_max_gen_s =
 			g_settings->getS16("max_block_generate_distance");
 	s16 d_max_gen = MYMIN(d_max_gen_s, wanted_range);
 
-	// Don't loop very much at a time
-	s16 max_d_increment_at_time = 10;
-	if (d_max > d_start + max_d_increment_at_time)
-		d_max = d_start + max_d_increment_at_time;
-	/*if(d_max_gen > d_start+2)
-		d_max_gen = d_start+2;*/
+	m_last_center = center;
+	m_send_queue.setView({center, camera_pos, camera_dir, camera_fov, full_d_max});
+	m_send_queue.step(m_uptime);
 
-	// infostream<<"Starting from "<<d_start<<std::endl;
+	// Don't loop very much at a time
+	constexpr size_t max_shells_at_time = 4;
+	m_send_queue.scan(max_shells_at_time);
+	m_nearest_unsent_d = m_send_queue.getScanDistance();
 
-	s32 nearest_emerged_d = -1;
-	s32 nearest_emergefull_d = -1;
-	s32 nearest_sent_d = -1;
-	// bool queue_is_full = false;
+	/*
+		Pacing: the number of blocks selected per step follows the connection,
+		it is lowered while the round trip time grows over the lowest seen one
+		and raised slowly while it does not.
+	*/
+	if (rtt > 0) {
+		if (m_send_rtt_min <= 0 || rtt < m_send_rtt_min)
+			m_send_rtt_min = rtt;
+		else // follow route changes
+			m_send_rtt_min += (rtt - m_send_rtt_min) * std::min(1.0f, dtime * 0.01f);
+
+		constexpr float min_pace = 0.1;
+		if (rtt > m_send_rtt_min * 2 + 0.05)
+			m_send_pace = std::max(min_pace, m_send_pace * std::pow(0.5f, dtime));
+		else
+			m_send_pace = std::min(1.0f, m_send_pace + dtime * 0.25f);
+	}
 
-	const f32 speed_in_blocks = (playerspeed / (MAP_BLOCKSIZE * BS)).getLength();
+	thread_local static const u16 max_simul_sends_setting =
+			g_settings->getU16("max_simultaneous_block_sends_per_client");
+	const u32 max_simul_sends_paced =
+			std::max<u32>(1, std::round(max_simul_sends_setting * m_send_pace));
+	g_profiler->avg("Server: Block send pace", m_send_pace);
 
+	u32 num_blocks_selected = 0;
 	int num_blocks_air = 0;
-	int blocks_occlusion_culled = 0;
+
 	thread_local static const bool server_occlusion =
 			g_settings->getBool("server_occlusion");
 	bool occlusion_culling_enabled = server_occlusion;
 
 	auto cam_pos_nodes = floatToInt(playerpos, BS);
 
-	//const auto *nodemgr = env->getGameDef()->getNodeDefManager();
-
-	unordered_map_v3pos<bool> occlude_cache;
-	s16 d;
-	size_t block_skip_retry = 0;
-	s16 first_skipped_d = 0;
-	constexpr auto always_first_ds = 1;
-	for (d = 0; d <= d_max;
-			(d_start > always_first_ds && d == always_first_ds) ? d = d_start : ++d) {
-		/*errorstream<<"checking d="<<d<<" for "
-				<<server->getPlayerName(peer_id)<<std::endl;*/
-		// infostream<<"RemoteClient::SendBlocks(): d="<<d<<" d_start="<<d_start<<"
-		// d_max="<<d_max<<" d_max_gen="<<d_max_gen<<std::endl;
-
-		std::vector<v3pos_t> list;
-		/*
-		if (d > 2 && d == d_start && !m_nearest_unsent_reset_want &&
-				m_nearest_unsent_reset_timer !=
-						999) { // oops, again magic number from up ^
-			list.emplace_back(0, 0, 0);
-		}
-        */
-
-		bool can_skip = d > 1;
-		// Fast fall/move optimize. speed_in_blocks now limited to 6.4
-		if (speed_in_blocks > 0.8 && d <= 2) {
-			can_skip = false;
-			if (d == 0) {
-				for (s16 addn = 0; addn < (speed_in_blocks + 1) * 2; ++addn)
-					list.push_back(floatToInt(playerspeeddir * addn, 1));
-			} else if (d == 1) {
-				for (s16 addn = 0; addn < (speed_in_blocks + 1) * 1.5; ++addn) {
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(0, 0, 1)); // back
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(-1, 0, 0)); // left
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(1, 0, 0)); // right
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(0, 0, -1)); // front
-				}
-			} else if (d == 2) {
-				for (s16 addn = 0; addn < (speed_in_blocks + 1) * 1.5; ++addn) {
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(-1, 0, 1)); // back left
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(1, 0, 1)); // left right
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(-1, 0, -1)); // right left
-					list.push_back(floatToInt(playerspeeddir * addn, 1) +
-								   v3pos_t(1, 0, -1)); // front right
-				}
-			}
-		} else {
-			/*
-				Get the border/face dot coordinates of a "d-radiused"
-				box
-			*/
-			list = FacePositionCache::getFacePositions(d);
-		}
+	// Time to check an unchanged block again, far blocks less often unless moving
+	const auto recheck_time = [&](float d, double checked_time) {
+		const auto dspd = d / (speed_in_blocks ? speed_in_blocks : 1);
+		return checked_time + 1 + (d <= 2 ? 0 : std::min<double>(120, dspd * dspd));
+	};
 
-		for (auto li = list.begin(); li != list.end(); ++li) {
-			const auto p = *li + center;
+	v3bpos_t p;
+	float priority;
+	size_t checked = 0;
+	while (m_send_queue.pop(p, priority)) {
+		// Distance in cube shells around the center
+		const int d = radius_box(p, center);
 
-			/*
-				Send throttling
-				- Don't allow too many simultaneous transfers
-				- EXCEPT when the blocks are very close
-
-				Also, don't send blocks that are already flying.
-			*/
+		/*
+			Send throttling
+			- Don't allow too many simultaneous transfers
+			- EXCEPT when the blocks are very close
+		*/
+		if (num_blocks_selected >=
+				(d <= BLOCK_ALWAYS_SEND_MAX_D ? max_simul_sends_setting
+											  : max_simul_sends_paced)) {
+			m_send_queue.push(p, priority);
+			break;
+		}
 
-			// Start with the usual maximum
-			u16 max_simul_dynamic = max_simul_sends_usually;
+		if ((++checked & 0x3f) == 0 && porting::getTimeMs() > end_ms) {
+			m_send_queue.push(p, priority);
+			break;
+		}
 
-			// If block is very close, allow full maximum
-			if (d <= BLOCK_ALWAYS_SEND_MAX_D)
-				max_simul_dynamic = max_simul_sends_setting;
+		const bool can_skip = d > 1;
 
-			// Don't select too many blocks for sending
-			if (num_blocks_selected + num_blocks_sending >= max_simul_dynamic) {
-				// queue_is_full = true;
-				goto queue_full_break;
-			}
+		// If this is true, inexistent block will be made from scratch
+		bool generate = d <= d_max_gen;
 
-			/*
-				Do not go over-limit
-			*/
-			if (blockpos_over_max_limit(p)) {
-				continue;
+		double block_sent = 0;
+		{
+			const auto lock = m_blocks_sent.lock_shared_rec();
+			if (const auto it = m_blocks_sent.find(p); it != m_blocks_sent.end()) {
+				block_sent = it->second;
 			}
+		}
 
-			// If this is true, inexistent block will be made from scratch
-			bool generate = d <= d_max_gen;
-
-			// infostream<<"d="<<d<<std::endl;
-
-			double block_sent = 0;
-			{
-				const auto lock = m_blocks_sent.lock_shared_rec();
-				if (const auto it = m_blocks_sent.find(p); it != m_blocks_sent.end()) {
-					block_sent = it->second;
-				}
-			}
+		/*
+			Don't send already sent blocks
+			Out of sight blocks come later in the queue anyway
+		*/
+		if (block_sent > 0 && recheck_time(d, block_sent) > m_uptime) {
+			m_send_queue.recheck(p, recheck_time(d, block_sent));
+			continue;
+		}
 
-			/*
-				Don't generate or send if not in sight
-				FIXME This only works if the client uses a small enough
-				FOV setting. The default of 72 degrees is fine.
-			*/
-			if (block_sent > 0 && can_skip &&
-					isBlockInSight(p, camera_pos, camera_dir, camera_fov,
-							d_blocks_in_sight) == false) {
-				// DUMP(p, can_skip, block_sent, "nosight");
+		if (d >= 2 && can_skip && occlusion_culling_enabled) {
+			ScopeProfiler sp(g_profiler, "SMap: Occusion calls");
+			if (env->getMap().isBlockOccluded(p * MAP_BLOCKSIZE, cam_pos_nodes)) {
+				g_profiler->add("SMap: Occlusion skip", 1);
+				m_send_queue.recheck(p, m_uptime + 1);
 				continue;
 			}
-			/*
-				Don't send already sent blocks
-			*/
-			{
-				auto dspd = d / (speed_in_blocks ? speed_in_blocks : 1);
-				if (block_sent > 0 && (/* (block_overflow && d>1) || */ block_sent + 1 +
-													  (d <= 2 ? 0 : dspd * dspd) >
-											  m_uptime)) {
-					continue;
-				}
-			}
-
-			if (d >= 2 && can_skip && occlusion_culling_enabled) {
-				const auto visible = [&](const v3pos_t &p) {
-					ScopeProfiler sp(g_profiler, "SMap: Occusion calls");
-					auto cpn = p * MAP_BLOCKSIZE;
-
-					cpn += v3pos_t(
-							MAP_BLOCKSIZE / 2, MAP_BLOCKSIZE / 2, MAP_BLOCKSIZE / 2);
-
-					v3pos_t spn = cam_pos_nodes + v3pos_t(0, 0, 0);
-					if (env->getMap().isBlockOccluded(p * MAP_BLOCKSIZE, spn)) {
-						g_profiler->add("SMap: Occlusion skip", 1);
-						++blocks_occlusion_culled;
-						return false;
-					}
-					return true;
-				};
-				if (!visible(p)) {
-					continue;
-				}
-			}
+		}
 
-			/*
-				Check if map has this block
-			*/
-
-			MapBlockPtr block;
-			if (0) {
-				const auto lock = env->getMap().m_blocks.try_lock_shared_rec();
-				if (!lock->owns_lock()) {
-					++block_skip_retry;
-					if (!first_skipped_d && d > always_first_ds)
-						first_skipped_d = d;
-					continue;
-				}
-				block = env->getMap().getBlock(p);
-			}
-			block = env->getMap().getBlock(p);
-
-			// bool surely_not_found_on_disk = false;
-			// bool block_is_invalid = false;
-			if (block) {
-				const auto lock = block->lock_shared_rec();
-				if (d >= 2 && block->m_is_mono_block &&
-						block->data[0].param0 == CONTENT_AIR) {
-					uint8_t not_air = 0;
-					for (const auto &dir : g_6dirs) {
-						if (const auto block_near = env->getMap().getBlock(p + dir)) {
-							const auto lock = block_near->lock_shared_rec();
-							if (block_near->m_is_mono_block &&
-									block_near->data[0].param0 != CONTENT_AIR) {
-								++not_air;
-								break;
-							}
+		/*
+			Check if map has this block
+		*/
+		MapBlockPtr block = env->getMap().getBlock(p);
+
+		if (block) {
+			const auto lock = block->lock_shared_rec();
+			if (d >= 2 && block->m_is_mono_block &&
+					block->data[0].param0 == CONTENT_AIR) {
+				uint8_t not_air = 0;
+				for (const auto &dir : g_6dirs) {
+					if (const auto block_near = env->getMap().getBlock(p + dir)) {
+						const auto lock = block_near->lock_shared_rec();
+						if (block_near->m_is_mono_block &&
+								block_near->data[0].param0 != CONTENT_AIR) {
+							++not_air;
+							break;
 						}
 					}
-					if (!not_air) {
-						continue;
-					}
 				}
-
-				if (block_sent > 0 && block_sent >= block->m_changed_timestamp) {
-					// DUMP(p, block_sent, block->m_changed_timestamp,
-					// block->getDiskTimestamp(), block->getActualTimestamp(), "ch");
+				if (!not_air) {
+					m_send_queue.recheck(p, recheck_time(d, m_uptime));
 					continue;
 				}
+			}
 
-				// Reset usage timer, this block will be of use in the future.
-				block->resetUsageTimer();
-
-				const auto complete = block->getLightingComplete();
-				if (!complete) {
-					env->getServerMap().lighting_modified_add(p, d);
-					if (block_sent && can_skip) {
-						continue;
-					}
-				}
-
-				// if (block->lighting_broken > 0 && (block_sent || can_skip))
-				//	continue;
+			if (block_sent > 0 && block_sent >= block->m_changed_timestamp) {
+				m_send_queue.recheck(p, recheck_time(d, m_uptime));
+				continue;
+			}
 
-				// Block is valid if lighting is up-to-date and data exists
-				/*
-								if(block->is isValid() == false)
-								{
-									block_is_invalid = true;
-								}
-				*/
+			// Reset usage timer, this block will be of use in the future.
+			block->resetUsageTimer();
 
-				if (block->isGenerated() == false) {
-					// DUMP(p, block->isGenerated());
+			const auto complete = block->getLightingComplete();
+			if (!complete) {
+				env->getServerMap().lighting_modified_add(p, d);
+				if (block_sent && can_skip) {
+					m_send_queue.recheck(p, m_uptime + 1);
 					continue;
 				}
-
-				/*
-					If block is not close, don't send it unless it is near
-					ground level.
-
-					Block is near ground level if night-time mesh
-					differs from day-time mesh.
-				*/
-				/*
-								if(d >= d_opt)
-								{
-									if(block->getDayNightDiff() == false)
-										continue;
-								}
-				*/
 			}
 
-			/*
-				If block has been marked to not exist on disk (dummy)
-				and generating new ones is not wanted, skip block.
-			*/
-			/*
-			if(generate == false && surely_not_found_on_disk == true)
-			{
-				// get next one.
+			if (block->isGenerated() == false) {
+				m_send_queue.recheck(p, m_uptime + 1);
 				continue;
 			}
-			*/
-
-			/*
-				Add inexistent block to emerge queue.
-			*/
-			if (!block /*|| surely_not_found_on_disk || block_is_invalid*/) {
-				// infostream<<"start gen d="<<d<<" p="<<p<<"
-				// notfound="<<surely_not_found_on_disk<<" invalid="<< block_is_invalid<<"
-				// block="<<block<<" generate="<<generate<<std::endl;
-				if (generate || !env->getServerMap().m_db_miss.contains(p)) {
-
-					if (emerge->enqueueBlockEmerge(peer_id, p, generate)) {
-						if (nearest_emerged_d == -1)
-							nearest_emerged_d = d;
-					} else {
-						if (nearest_emergefull_d == -1)
-							nearest_emergefull_d = d;
-						goto queue_full_break;
-					}
-				} else {
-					// infostream << "skip tryload " << p << "\n";
-				}
-
-				// DUMP(p, nearest_emerged_d,nearest_emergefull_d, "go generate");
-
-				// get next one.
-				continue;
-			}
-
-			if (nearest_sent_d == -1 && d >= d_start)
-				nearest_sent_d = d;
-
-			/*
-				Add block to send queue
-			*/
-
-			PrioritySortedBlockTransfer q((float)d, p, peer_id);
-
-			dest.push_back(q);
-
-			if (block->m_is_mono_block && block->data[0].param0 == CONTENT_AIR)
-				++num_blocks_air;
-			else
-				num_blocks_selected += 1;
 		}
 
-		if (porting::getTimeMs() > end_ms) {
-			break;
-		}
-	}
-queue_full_break:
-
-	// infostream<<"Stopped at "<<d<<" d_start="<<d_start<< " d_max="<<d_max<<"
-	// nearest_emerged_d="<<nearest_emerged_d<<"
-	// nearest_emergefull_d="<<nearest_emergefull_d<< "
-	// new_nearest_unsent_d="<<new_nearest_unsent_d<< " sel="<<num_blocks_selected<<
-	// "+"<<num_blocks_sending << " air="<<num_blocks_air<< " culled=" <<
-	// blocks_occlusion_culled <<" cEN="<<occlusion_culling_enabled<<std::endl;
-	num_blocks_selected += num_blocks_sending;
-	if (block_skip_retry) {
-		if (first_skipped_d) {
-			m_nearest_unsent_d = first_skipped_d;
-		}
-		if (d >= d_max) {
-			m_nothing_to_send_pause_timer = 1;
-		}
-	} else {
-		if (!num_blocks_selected && !num_blocks_air && d_start <= d) {
-			// new_nearest_unsent_d = 0;
-			m_nothing_to_send_pause_timer = 1.0;
-		}
-
-		// If nothing was found for sending and nothing was queued for
-		// emerging, continue next time browsing from here
-		if (nearest_emerged_d != -1 && nearest_emerged_d > nearest_emergefull_d) {
-			new_nearest_unsent_d = nearest_emerged_d;
-		} else if (nearest_emergefull_d != -1) {
-			new_nearest_unsent_d = nearest_emergefull_d;
-		} else {
-			if (d > full_d_max) {
-				new_nearest_unsent_d = 0;
-				m_nothing_to_send_pause_timer = 10.0;
+		/*
+			Add inexistent block to emerge queue.
+		*/
+		if (!block) {
+			if (generate || !env->getServerMap().m_db_miss.contains(p)) {
+				if (!emerge->enqueueBlockEmerge(peer_id, p, generate, false, priority)) {
+					// Emerge queue is full, try again next time
+					m_send_queue.push(p, priority);
+					break;
+				}
+				m_send_queue.recheck(p, m_uptime + 1);
 			} else {
-				if (nearest_sent_d != -1)
-					new_nearest_unsent_d = nearest_sent_d;
-				else
-					new_nearest_unsent_d = d;
+				m_send_queue.recheck(p, m_uptime + 10);
 			}
+			continue;
 		}
 
-		if (new_nearest_unsent_d != -1) {
-			m_nearest_unsent_d = new_nearest_unsent_d;
-		}
+		/*
+			Add block to send queue
+		*/
+		dest.emplace_back(priority, p, peer_id);
+		m_send_queue.recheck(p, recheck_time(d, m_uptime));
+
+		if (block->m_is_mono_block && block->data[0].param0 == CONTENT_AIR)
+			++num_blocks_air;
+		else
+			num_blocks_selected += 1;
 	}
 
-	return num_blocks_selected - num_blocks_sending;
+	g_profiler->avg("Server: Block send queue", m_send_queue.size());
+	g_profiler->add("Server: Block send checks", checked);
+
+	return num_blocks_selected;
 }
 
 uint32_t RemoteClient::SendFarBlocks(const int32_t uptime)
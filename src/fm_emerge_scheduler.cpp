@@ -0,0 +1,180 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_emerge_scheduler.h"
+#include <algorithm>
+#include <functional>
+#include "emerge.h"
+
+EmergeScheduler::EmergeScheduler(size_t threads, v3bpos_t chunksize) :
+		m_chunksize(chunksize), m_threads(threads)
+{
+}
+
+v3bpos_t EmergeScheduler::getChunk(const v3bpos_t &pos) const
+{
+	return EmergeManager::getContainingChunk(pos, m_chunksize);
+}
+
+void EmergeScheduler::pushHeap(const v3bpos_t &chunk_pos, Chunk &chunk)
+{
+	chunk.seq = m_seq++;
+	m_heap.push_back({chunk.priority, chunk.seq, chunk_pos});
+	std::push_heap(m_heap.begin(), m_heap.end(), std::greater<HeapEntry>());
+}
+
+bool EmergeScheduler::isStale(const HeapEntry &entry) const
+{
+	const auto it = m_chunks.find(entry.chunk);
+	return it == m_chunks.end() || it->second.owner != NO_THREAD ||
+		   it->second.seq != entry.seq;
+}
+
+bool EmergeScheduler::isNearClaimed(const v3bpos_t &chunk_pos) const
+{
+	for (const auto &state : m_threads) {
+		if (!state.claimed)
+			continue;
+		const v3bpos_t d = state.chunk - chunk_pos;
+		if (std::abs(d.X) <= m_chunksize.X && std::abs(d.Y) <= m_chunksize.Y &&
+				std::abs(d.Z) <= m_chunksize.Z)
+			return true;
+	}
+	return false;
+}
+
+int EmergeScheduler::push(const v3bpos_t &pos, float priority)
+{
+	const v3bpos_t chunk_pos = getChunk(pos);
+	auto [it, inserted] = m_chunks.try_emplace(chunk_pos);
+	Chunk &chunk = it->second;
+	chunk.blocks.push_back({pos, priority});
+	++m_size;
+
+	if (chunk.owner != NO_THREAD) {
+		// The owner takes it after its current block
+		return NO_THREAD;
+	}
+
+	if (inserted || priority < chunk.priority) {
+		chunk.priority = priority;
+		pushHeap(chunk_pos, chunk);
+	}
+
+	for (size_t i = 0; i < m_threads.size(); ++i) {
+		if (m_threads[i].idle) {
+			m_threads[i].idle = false;
+			return i;
+		}
+	}
+	return NO_THREAD;
+}
+
+bool EmergeScheduler::claim(size_t thread)
+{
+	std::vector<HeapEntry> skipped;
+	const HeapEntry *chosen = nullptr;
+	HeapEntry entry;
+	while (!m_heap.empty()) {
+		std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<HeapEntry>());
+		entry = m_heap.back();
+		m_heap.pop_back();
+		if (isStale(entry))
+			continue;
+		if (skipped.size() < MAX_CANDIDATES && isNearClaimed(entry.chunk)) {
+			skipped.push_back(entry);
+			continue;
+		}
+		chosen = &entry;
+		break;
+	}
+
+	// Everything is next to a claimed chunk, take the most urgent anyway
+	if (!chosen && !skipped.empty()) {
+		entry = skipped.front();
+		skipped.erase(skipped.begin());
+		chosen = &entry;
+	}
+
+	for (const auto &e : skipped) {
+		m_heap.push_back(e);
+		std::push_heap(m_heap.begin(), m_heap.end(), std::greater<HeapEntry>());
+	}
+
+	if (!chosen)
+		return false;
+
+	m_chunks[chosen->chunk].owner = thread;
+	auto &state = m_threads[thread];
+	state.claimed = true;
+	state.chunk = chosen->chunk;
+	return true;
+}
+
+bool EmergeScheduler::pop(size_t thread, v3bpos_t &pos)
+{
+	auto &state = m_threads[thread];
+
+	if (state.claimed) {
+		const auto it = m_chunks.find(state.chunk);
+		if (it->second.blocks.empty()) {
+			// Done with this chunk
+			m_chunks.erase(it);
+			state.claimed = false;
+		}
+	}
+
+	if (!state.claimed && !claim(thread)) {
+		state.idle = true;
+		return false;
+	}
+
+	auto &blocks = m_chunks[state.chunk].blocks;
+	const auto best = std::min_element(blocks.begin(), blocks.end(),
+			[](const Block &a, const Block &b) { return a.priority < b.priority; });
+	pos = best->pos;
+	blocks.erase(best);
+	--m_size;
+	state.idle = false;
+	return true;
+}
+
+void EmergeScheduler::release(size_t thread, std::vector<v3bpos_t> &dropped)
+{
+	auto &state = m_threads[thread];
+	if (!state.claimed)
+		return;
+
+	const auto it = m_chunks.find(state.chunk);
+	for (const auto &block : it->second.blocks)
+		dropped.push_back(block.pos);
+	m_size -= it->second.blocks.size();
+	m_chunks.erase(it);
+	state.claimed = false;
+}
+
+void EmergeScheduler::clear(std::vector<v3bpos_t> &dropped)
+{
+	for (const auto &[chunk_pos, chunk] : m_chunks)
+		for (const auto &block : chunk.blocks)
+			dropped.push_back(block.pos);
+	m_chunks.clear();
+	m_heap.clear();
+	for (auto &state : m_threads)
+		state = ThreadState();
+	m_size = 0;
+}
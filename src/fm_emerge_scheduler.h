@@ -0,0 +1,109 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include "irr_v3d.h"
+#include "irrlichttypes.h"
+#include "util/unordered_map_hash.h"
+
+/*
+	Hands out queued emerge blocks to the emerge threads.
+
+	Blocks are grouped by mapchunk. A thread claims a whole chunk and gets
+	all of its blocks, including ones queued while it works on it, so one
+	chunk is never generated by two threads at once. Chunks are taken in
+	order of their most urgent block. Chunks next to chunks claimed by other
+	threads are passed over while there are others to do, so threads do not
+	wait on each other for the overlapping area. Any idle thread takes the
+	next chunk, there are no per-thread queues to balance.
+
+	Not thread safe, EmergeManager calls it with its queue mutex held.
+*/
+class EmergeScheduler
+{
+public:
+	// Number of chunks looked at to find one away from the claimed ones
+	static constexpr size_t MAX_CANDIDATES = 8;
+
+	EmergeScheduler(size_t threads, v3bpos_t chunksize);
+
+	// Queue a block, lower priority is more urgent. Returns index of an idle
+	// thread to wake, or -1.
+	int push(const v3bpos_t &pos, float priority);
+	// Next block for thread, false if there is nothing to do. The thread is
+	// then idle until returned by push().
+	bool pop(size_t thread, v3bpos_t &pos);
+	// Drop the chunk claimed by thread, its remaining blocks are returned
+	void release(size_t thread, std::vector<v3bpos_t> &dropped);
+	// Drop every queued block, claimed or not. Threads must be stopped.
+	void clear(std::vector<v3bpos_t> &dropped);
+
+	size_t size() const { return m_size; }
+	size_t chunkCount() const { return m_chunks.size(); }
+	v3bpos_t getChunk(const v3bpos_t &pos) const;
+
+private:
+	static constexpr int NO_THREAD = -1;
+
+	struct Block
+	{
+		v3bpos_t pos;
+		float priority;
+	};
+	struct Chunk
+	{
+		std::vector<Block> blocks;
+		// Key of the valid heap entry, while not claimed
+		float priority;
+		u64 seq;
+		int owner = NO_THREAD;
+	};
+	struct HeapEntry
+	{
+		float priority;
+		u64 seq;
+		v3bpos_t chunk;
+
+		bool operator>(const HeapEntry &other) const
+		{
+			return priority != other.priority ? priority > other.priority
+											  : seq > other.seq;
+		}
+	};
+	struct ThreadState
+	{
+		bool claimed = false;
+		bool idle = true;
+		v3bpos_t chunk;
+	};
+
+	void pushHeap(const v3bpos_t &chunk_pos, Chunk &chunk);
+	bool isStale(const HeapEntry &entry) const;
+	bool isNearClaimed(const v3bpos_t &chunk_pos) const;
+	// Find and claim the next chunk for thread
+	bool claim(size_t thread);
+
+	const v3bpos_t m_chunksize;
+	unordered_map_v3bpos<Chunk> m_chunks;
+	// Min heap of unclaimed chunks, entries not matching m_chunks are stale
+	std::vector<HeapEntry> m_heap;
+	std::vector<ThreadState> m_threads;
+	u64 m_seq = 0;
+	size_t m_size = 0;
+};
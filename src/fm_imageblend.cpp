@@ -0,0 +1,303 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_imageblend.h"
+#include <array>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGEBLEND_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+inline uint32_t alpha(uint32_t c)
+{
+	return c >> 24;
+}
+
+inline uint32_t channel(uint32_t c, int shift)
+{
+	return (c >> shift) & 0xff;
+}
+
+inline uint32_t argb(uint32_t a, uint32_t r, uint32_t g, uint32_t b)
+{
+	return (a & 0xff) << 24 | (r & 0xff) << 16 | (g & 0xff) << 8 | (b & 0xff);
+}
+
+/*
+	Result of the overlay texture modifier (^) for a single pixel.
+	This is not alpha blending if both src and dst are semi-transparent, an
+	old implementation did it wrong and fixing it would break backwards
+	compatibility (see #14847).
+*/
+inline void blit_pixel(uint32_t src, uint32_t &dst, bool overlay)
+{
+	uint32_t dst_a = alpha(dst);
+	if (overlay && dst_a != 255)
+		return;
+	const uint32_t src_a = alpha(src);
+	if (src_a == 0)
+		return;
+	if (src_a == 255 || dst_a == 0) {
+		dst = src;
+		return;
+	}
+	uint32_t rgb[3];
+	for (int i = 0; i < 3; ++i) {
+		const int shift = 16 - i * 8;
+		rgb[i] = (channel(dst, shift) * (255 - src_a) + channel(src, shift) * src_a) / 255;
+	}
+	if (dst_a != 255)
+		dst_a = dst_a + (255 - dst_a) * src_a * src_a / (255 * 255);
+	dst = argb(dst_a, rgb[0], rgb[1], rgb[2]);
+}
+
+#if IMAGEBLEND_SSE2
+// x / 255 for 0 <= x <= 255 * 255 in 16 bit lanes
+inline __m128i div255_epu16(__m128i x)
+{
+	return _mm_srli_epi16(
+			_mm_add_epi16(_mm_add_epi16(x, _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8);
+}
+
+// Same in 32 bit lanes
+inline __m128i div255_epu32(__m128i x)
+{
+	return _mm_srli_epi32(
+			_mm_add_epi32(_mm_add_epi32(x, _mm_set1_epi32(1)), _mm_srli_epi32(x, 8)), 8);
+}
+
+inline __m128i select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Alpha of both pixels of 16 bit lanes in all four of their lanes
+inline __m128i broadcast_alpha_epi16(__m128i x)
+{
+	return _mm_shufflehi_epi16(
+			_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+inline __m128i load(const uint32_t *p)
+{
+	return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+inline void store(uint32_t *p, __m128i v)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+// Multiply the channels of 4 pixels by factors in 16 bit lanes and / 255
+inline __m128i mul_div255(__m128i pixels, __m128i factor)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = div255_epu16(_mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), factor));
+	const __m128i hi = div255_epu16(_mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), factor));
+	return _mm_packus_epi16(lo, hi);
+}
+
+// Channels of color for two pixels in 16 bit lanes
+inline __m128i color_epi16(uint32_t color)
+{
+	return _mm_unpacklo_epi8(_mm_set1_epi32(color), _mm_setzero_si128());
+}
+#endif
+}
+
+void image_blit_row(const uint32_t *src, uint32_t *dst, size_t count, bool overlay)
+{
+	size_t i = 0;
+#if IMAGEBLEND_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opaque = _mm_set1_epi32(255);
+	const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+	const __m128i c255 = _mm_set1_epi16(255);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i s = load(src + i);
+		const __m128i d = load(dst + i);
+		const __m128i sa = _mm_srli_epi32(s, 24);
+		const __m128i da = _mm_srli_epi32(d, 24);
+		const __m128i d_opaque = _mm_cmpeq_epi32(da, opaque);
+
+		__m128i keep = _mm_cmpeq_epi32(sa, zero);
+		if (overlay)
+			keep = _mm_or_si128(keep, _mm_andnot_si128(d_opaque, _mm_set1_epi32(-1)));
+		const __m128i copy = _mm_andnot_si128(keep,
+				_mm_or_si128(_mm_cmpeq_epi32(sa, opaque), _mm_cmpeq_epi32(da, zero)));
+		const __m128i decided = _mm_or_si128(keep, copy);
+		const __m128i lerp = _mm_andnot_si128(decided, d_opaque);
+		// Translucent over translucent, rare
+		if (_mm_movemask_epi8(_mm_or_si128(decided, lerp)) != 0xffff) {
+			for (size_t j = i; j < i + 4; ++j)
+				blit_pixel(src[j], dst[j], overlay);
+			continue;
+		}
+
+		__m128i result = select(copy, s, d);
+		if (_mm_movemask_epi8(lerp)) {
+			// d * (255 - a) + s * a, two pixels per half
+			const __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+			const __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+			const __m128i a_lo = broadcast_alpha_epi16(s_lo);
+			const __m128i a_hi = broadcast_alpha_epi16(s_hi);
+			const __m128i lo = div255_epu16(_mm_add_epi16(
+					_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(c255, a_lo)),
+					_mm_mullo_epi16(s_lo, a_lo)));
+			const __m128i hi = div255_epu16(_mm_add_epi16(
+					_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(c255, a_hi)),
+					_mm_mullo_epi16(s_hi, a_hi)));
+			const __m128i mixed = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha_mask);
+			result = select(lerp, mixed, result);
+		}
+		store(dst + i, result);
+	}
+#endif
+	for (; i < count; ++i)
+		blit_pixel(src[i], dst[i], overlay);
+}
+
+void image_multiply_row(uint32_t *dst, size_t count, uint32_t color)
+{
+	size_t i = 0;
+#if IMAGEBLEND_SSE2
+	// a * 255 / 255 keeps alpha
+	const __m128i factor = color_epi16(color | 0xff000000);
+	for (; i + 4 <= count; i += 4)
+		store(dst + i, mul_div255(load(dst + i), factor));
+#endif
+	for (; i < count; ++i) {
+		const uint32_t c = dst[i];
+		dst[i] = argb(alpha(c), channel(c, 16) * channel(color, 16) / 255,
+				channel(c, 8) * channel(color, 8) / 255, channel(c, 0) * channel(color, 0) / 255);
+	}
+}
+
+void image_screen_row(uint32_t *dst, size_t count, uint32_t color)
+{
+	size_t i = 0;
+#if IMAGEBLEND_SSE2
+	const __m128i factor = color_epi16(~color);
+	const __m128i ones = _mm_set1_epi32(-1);
+	const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i d = load(dst + i);
+		const __m128i screened =
+				_mm_xor_si128(mul_div255(_mm_xor_si128(d, ones), factor), ones);
+		store(dst + i, select(alpha_mask, d, screened));
+	}
+#endif
+	for (; i < count; ++i) {
+		const uint32_t c = dst[i];
+		const auto screen = [&](int shift) {
+			return 255 - ((255 - channel(c, shift)) * (255 - channel(color, shift))) / 255;
+		};
+		dst[i] = argb(alpha(c), screen(16), screen(8), screen(0));
+	}
+}
+
+void image_colorize_row(uint32_t *dst, size_t count, uint32_t color, bool keep_alpha)
+{
+	const uint32_t color_alpha = alpha(color);
+	size_t i = 0;
+#if IMAGEBLEND_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgb = _mm_set1_epi32(color & 0x00ffffff);
+	const __m128i full = _mm_set1_epi32(color);
+	const __m128i factor = _mm_set1_epi32(color_alpha);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i d = load(dst + i);
+		const __m128i da = _mm_srli_epi32(d, 24);
+		const __m128i visible = _mm_andnot_si128(_mm_cmpeq_epi32(da, zero), _mm_set1_epi32(-1));
+		__m128i c = full;
+		if (keep_alpha) {
+			// Both below 256, the 16 bit product is the 32 bit one
+			const __m128i a = div255_epu32(_mm_mullo_epi16(da, factor));
+			c = _mm_or_si128(rgb, _mm_slli_epi32(a, 24));
+		}
+		store(dst + i, select(visible, c, d));
+	}
+#endif
+	for (; i < count; ++i) {
+		const uint32_t dst_alpha = alpha(dst[i]);
+		if (!dst_alpha)
+			continue;
+		dst[i] = keep_alpha ? (color & 0x00ffffff) | (dst_alpha * color_alpha / 255) << 24
+							: color;
+	}
+}
+
+void image_mask_row(const uint32_t *mask, uint32_t *dst, size_t count)
+{
+	size_t i = 0;
+#if IMAGEBLEND_SSE2
+	for (; i + 4 <= count; i += 4)
+		store(dst + i, _mm_and_si128(load(dst + i), load(mask + i)));
+#endif
+	for (; i < count; ++i)
+		dst[i] &= mask[i];
+}
+
+void image_remap_row(uint32_t *dst, size_t count, const image_channel_tables_t &tables,
+		bool skip_transparent)
+{
+	// Textures repeat colors a lot
+	uint32_t last_in = 0, last_out = 0;
+	bool have_last = false;
+	for (size_t i = 0; i < count; ++i) {
+		const uint32_t c = dst[i];
+		if (skip_transparent && !alpha(c))
+			continue;
+		if (!have_last || c != last_in) {
+			last_in = c;
+			last_out = argb(tables[0][alpha(c)], tables[1][channel(c, 16)],
+					tables[2][channel(c, 8)], tables[3][channel(c, 0)]);
+			have_last = true;
+		}
+		dst[i] = last_out;
+	}
+}
+
+void image_overlay_row(const uint32_t *blend, const uint32_t *base, uint32_t *out,
+		size_t count)
+{
+	// Same float expression as apply_overlay() in client/imagesource.cpp
+	static const auto table = [] {
+		std::array<uint8_t, 256 * 256> result;
+		for (uint32_t base_v = 0; base_v < 256; ++base_v)
+			for (uint32_t blend_v = 0; blend_v < 256; ++blend_v) {
+				const float blend_f = blend_v / 255.0f;
+				const float base_f = base_v / 255.0f;
+				result[base_v * 256 + blend_v] = static_cast<uint32_t>(
+						(base_f < 0.5f ? 2 * base_f * blend_f
+									   : 1 - 2 * (1 - base_f) * (1 - blend_f)) *
+						255) & 0xff;
+			}
+		return result;
+	}();
+
+	for (size_t i = 0; i < count; ++i) {
+		const uint32_t b = base[i], l = blend[i];
+		out[i] = argb(alpha(b), table[channel(b, 16) * 256 + channel(l, 16)],
+				table[channel(b, 8) * 256 + channel(l, 8)],
+				table[channel(b, 0) * 256 + channel(l, 0)]);
+	}
+}
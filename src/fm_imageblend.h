@@ -0,0 +1,56 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+	Pixel kernels of the texture modifiers over rows of 32 bit ARGB pixels,
+	the layout of video::SColor in ECF_A8R8G8B8 images. Results are the
+	same as the per pixel code in client/imagesource.cpp: integer blends
+	use SSE2 when built for it, float formulas go through tables computed
+	with the very same expressions.
+*/
+
+// Blend src over dst like the ^ modifier, overlay only touches opaque dst
+void image_blit_row(const uint32_t *src, uint32_t *dst, size_t count, bool overlay);
+
+// rgb * color / 255, alpha kept
+void image_multiply_row(uint32_t *dst, size_t count, uint32_t color);
+
+// 255 - (255 - rgb) * (255 - color) / 255, alpha kept
+void image_screen_row(uint32_t *dst, size_t count, uint32_t color);
+
+// Replace the color of pixels that are not fully transparent, keep_alpha
+// multiplies their alpha by the color alpha instead of replacing it
+void image_colorize_row(uint32_t *dst, size_t count, uint32_t color, bool keep_alpha);
+
+// dst &= mask
+void image_mask_row(const uint32_t *mask, uint32_t *dst, size_t count);
+
+// Per channel tables, indexed by channel value: a, r, g, b
+using image_channel_tables_t = uint8_t[4][256];
+
+// Map every channel through its table, skip_transparent leaves alpha 0 pixels
+void image_remap_row(uint32_t *dst, size_t count, const image_channel_tables_t &tables,
+		bool skip_transparent);
+
+// Overlay blend of the rgb of blend onto base, alpha of base, out may be base
+void image_overlay_row(const uint32_t *blend, const uint32_t *base, uint32_t *out,
+		size_t count);
@@ -0,0 +1,496 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_light.h"
+
+#include <algorithm>
+#include <numeric>
+#include "constants.h"
+#include "map.h"
+#include "mapnode.h"
+#include "nodedef.h"
+#include "porting.h"
+
+namespace
+{
+// Directions back, top, right, front, bottom, left
+constexpr u8 DIR_AXIS[6] = {2, 1, 0, 2, 1, 0};
+constexpr bool DIR_UP[6] = {true, true, true, false, false, false};
+constexpr u32 AXIS_SHIFT[3] = {0, 4, 8};
+// The same directions as numbered by voxalgo and MapBlock lighting flags
+constexpr u8 VOXALGO_DIR[6] = {2, 1, 0, 3, 4, 5};
+}
+
+std::vector<std::vector<v3bpos_t>> light_clusters(const std::vector<v3bpos_t> &blocks)
+{
+	// Union find over the xz columns of the blocks
+	using column_t = std::pair<bpos_t, bpos_t>;
+	std::map<column_t, size_t> columns;
+	for (const auto &p : blocks)
+		columns.emplace(column_t(p.X, p.Z), columns.size());
+	std::vector<size_t> parent(columns.size());
+	std::iota(parent.begin(), parent.end(), 0);
+	const auto find = [&parent](size_t i) {
+		while (parent[i] != i)
+			i = parent[i] = parent[parent[i]];
+		return i;
+	};
+	for (const auto &[column, index] : columns)
+		for (bpos_t dz = -LIGHT_CLUSTER_REACH; dz <= LIGHT_CLUSTER_REACH; ++dz)
+			for (bpos_t dx = -LIGHT_CLUSTER_REACH; dx <= LIGHT_CLUSTER_REACH; ++dx) {
+				const auto other = columns.find(
+						column_t(column.first + dx, column.second + dz));
+				if (other != columns.end())
+					parent[find(other->second)] = find(index);
+			}
+
+	std::vector<size_t> cluster_of(columns.size(), SIZE_MAX);
+	std::vector<std::vector<v3bpos_t>> clusters;
+	for (const auto &p : blocks) {
+		const size_t root = find(columns[column_t(p.X, p.Z)]);
+		if (cluster_of[root] == SIZE_MAX) {
+			cluster_of[root] = clusters.size();
+			clusters.emplace_back();
+		}
+		clusters[cluster_of[root]].push_back(p);
+	}
+	for (auto &cluster : clusters)
+		std::stable_sort(cluster.begin(), cluster.end(),
+				[](const v3bpos_t &a, const v3bpos_t &b) { return a.Y > b.Y; });
+	std::stable_sort(clusters.begin(), clusters.end(),
+			[](const auto &a, const auto &b) { return a.size() > b.size(); });
+	return clusters;
+}
+
+LightPropagator::LightPropagator(Map *map, const NodeDefManager *ndef) :
+		m_map(map), m_ndef(ndef)
+{
+}
+
+LightPropagator::~LightPropagator() = default;
+
+template <typename Item, typename Position>
+void LightPropagator::beginPass(const std::vector<Item> &items, Position position,
+		std::vector<Item> &inside, std::vector<Item> &rest)
+{
+	// Light goes less than a block from the start nodes, one block around
+	// their box is enough when it fits
+	v3bpos_t bmin = getNodeBlockPos(position(items.front()));
+	v3bpos_t bmax = bmin;
+	for (const auto &item : items) {
+		const v3bpos_t bp = getNodeBlockPos(position(item));
+		bmin = v3bpos_t(std::min(bmin.X, bp.X), std::min(bmin.Y, bp.Y),
+				std::min(bmin.Z, bp.Z));
+		bmax = v3bpos_t(std::max(bmax.X, bp.X), std::max(bmax.Y, bp.Y),
+				std::max(bmax.Z, bp.Z));
+	}
+	const v3bpos_t first = getNodeBlockPos(position(items.front()));
+	m_min = bmin - v3bpos_t(1, 1, 1);
+	v3bpos_t bmax_region = bmax + v3bpos_t(1, 1, 1);
+	for (int axis = 0; axis < 3; ++axis) {
+		if (bmax_region[axis] - m_min[axis] + 1 > REGION_SIZE) {
+			m_min[axis] = first[axis] - REGION_SIZE / 2 + 1;
+			bmax_region[axis] = m_min[axis] + REGION_SIZE - 1;
+		}
+	}
+	m_size = v3pos_t(bmax_region.X - m_min.X + 1, bmax_region.Y - m_min.Y + 1,
+			bmax_region.Z - m_min.Z + 1);
+	m_slots.clear();
+	m_slots.resize(static_cast<size_t>(m_size.X) * m_size.Y * m_size.Z);
+	m_visited.clear();
+
+	inside.clear();
+	rest.clear();
+	for (const auto &item : items)
+		(contains(position(item)) ? inside : rest).push_back(item);
+}
+
+void LightPropagator::endPass(std::map<v3bpos_t, MapBlock *> &modified_blocks, bool unlit)
+{
+	for (auto &slot : m_slots) {
+		if (slot.written) {
+			if (unlit)
+				slot.block->setLightingComplete(0);
+			modified_blocks[slot.block->getPos()] = slot.block;
+		}
+		slot.lock.reset();
+	}
+	m_slots.clear();
+	for (auto &queue : m_queue)
+		queue.clear();
+}
+
+bool LightPropagator::contains(const v3pos_t &p) const
+{
+	const v3bpos_t bp = getNodeBlockPos(p) - m_min;
+	return bp.X >= 0 && bp.Y >= 0 && bp.Z >= 0 && bp.X < m_size.X && bp.Y < m_size.Y &&
+		   bp.Z < m_size.Z;
+}
+
+u32 LightPropagator::pack(const v3pos_t &p) const
+{
+	v3bpos_t bp;
+	v3pos_t rel;
+	getNodeBlockPosWithOffset(p, bp, rel);
+	bp -= m_min;
+	const u32 slot = (bp.Z * m_size.Y + bp.Y) * m_size.X + bp.X;
+	return slot << NODE_BITS | rel.Z << 8 | rel.Y << 4 | rel.X;
+}
+
+v3pos_t LightPropagator::unpack(u32 packed) const
+{
+	const u32 slot = packed >> NODE_BITS;
+	const v3bpos_t bp(slot % m_size.X, slot / m_size.X % m_size.Y,
+			slot / m_size.X / m_size.Y);
+	return getBlockPosRelative(bp + m_min) +
+		   v3pos_t(packed & 15, packed >> 4 & 15, packed >> 8 & 15);
+}
+
+bool LightPropagator::step(u32 packed, u8 dir, u32 &neighbor) const
+{
+	const u32 shift = AXIS_SHIFT[DIR_AXIS[dir]];
+	const u32 coordinate = packed >> shift & 15;
+	if (DIR_UP[dir] ? coordinate < MAP_BLOCKSIZE - 1 : coordinate > 0) {
+		neighbor = DIR_UP[dir] ? packed + (1U << shift) : packed - (1U << shift);
+		return true;
+	}
+	// Into the next block
+	const u32 slot = packed >> NODE_BITS;
+	u32 stride = 1;
+	u32 block = slot % m_size.X;
+	u32 size = m_size.X;
+	if (DIR_AXIS[dir] == 1) {
+		stride = m_size.X;
+		block = slot / m_size.X % m_size.Y;
+		size = m_size.Y;
+	} else if (DIR_AXIS[dir] == 2) {
+		stride = m_size.X * m_size.Y;
+		block = slot / stride;
+		size = m_size.Z;
+	}
+	if (DIR_UP[dir] ? block + 1 >= size : block == 0)
+		return false;
+	const u32 next_slot = DIR_UP[dir] ? slot + stride : slot - stride;
+	const u32 node = (packed & NODE_MASK & ~(15U << shift)) |
+					 (DIR_UP[dir] ? 0U : (MAP_BLOCKSIZE - 1U) << shift);
+	neighbor = next_slot << NODE_BITS | node;
+	return true;
+}
+
+bool LightPropagator::neighbors(u32 packed, u32 (&neighbor)[6]) const
+{
+	for (u8 dir = 0; dir < 6; ++dir)
+		if (!step(packed, dir, neighbor[dir]))
+			return false;
+	return true;
+}
+
+MapBlock *LightPropagator::fetch(u32 packed, bool wait)
+{
+	Slot &slot = m_slots[packed >> NODE_BITS];
+	if (!slot.fetched) {
+		slot.fetched = true;
+		const u32 index = packed >> NODE_BITS;
+		const v3bpos_t bp = m_min + v3bpos_t(index % m_size.X,
+											index / m_size.X % m_size.Y,
+											index / m_size.X / m_size.Y);
+		slot.block = m_map->getBlockNoCreateNoEx(bp);
+		slot.missing = !slot.block;
+		if (slot.block) {
+			slot.lock = wait ? slot.block->lock_unique_rec()
+							 : slot.block->try_lock_unique_rec();
+			// may cause dark areas
+			if (!slot.lock->owns_lock()) {
+				slot.lock.reset();
+				slot.block = nullptr;
+			}
+		}
+	}
+	return slot.block;
+}
+
+MapNode &LightPropagator::node(u32 packed)
+{
+	return m_slots[packed >> NODE_BITS].block->getNodeNoLock(
+			v3pos_t(packed & 15, packed >> 4 & 15, packed >> 8 & 15));
+}
+
+void LightPropagator::write(u32 packed, const MapNode &n)
+{
+	Slot &slot = m_slots[packed >> NODE_BITS];
+	const v3pos_t rel(packed & 15, packed >> 4 & 15, packed >> 8 & 15);
+	if (slot.written) {
+		slot.block->getNodeNoLock(rel) = n;
+		return;
+	}
+	slot.written = true;
+	slot.block->setNodeNoLock(rel, n);
+}
+
+bool LightPropagator::visit(u32 packed)
+{
+	Slot &slot = m_slots[packed >> NODE_BITS];
+	if (slot.visited == NO_PAGE) {
+		slot.visited = m_visited.size();
+		m_visited.emplace_back();
+		m_visited.back().fill(0);
+	}
+	const u32 index = packed & NODE_MASK;
+	u64 &word = m_visited[slot.visited][index / 64];
+	const u64 bit = u64(1) << (index % 64);
+	const bool was = word & bit;
+	word |= bit;
+	return was;
+}
+
+void LightPropagator::unspread(LightBank bank,
+		const std::vector<std::pair<v3pos_t, u8>> &from_nodes,
+		std::vector<v3pos_t> &light_sources,
+		std::map<v3bpos_t, MapBlock *> &modified_blocks)
+{
+	using Item = std::pair<v3pos_t, u8>;
+	auto position = [](const Item &item) { return item.first; };
+	std::vector<Item> pending = from_nodes;
+	std::vector<Item> inside, deferred;
+	while (!pending.empty()) {
+		beginPass(pending, position, inside, deferred);
+		for (const auto &[p, light] : inside)
+			if (light <= LIGHT_SUN)
+				m_queue[light].push_back(pack(p));
+
+		// Unlit nodes are queued with the light they had, always less than
+		// the node unlighting them
+		for (int light = LIGHT_SUN; light > 0; --light) {
+			auto &queue = m_queue[light];
+			while (!queue.empty()) {
+				const u32 current = queue.back();
+				queue.pop_back();
+				bool left_region = false;
+				for (u8 dir = 0; dir < 6; ++dir) {
+					u32 neighbor;
+					if (!step(current, dir, neighbor)) {
+						if (!left_region)
+							deferred.emplace_back(unpack(current), light);
+						left_region = true;
+						continue;
+					}
+					if (!fetch(neighbor))
+						continue;
+					MapNode n2 = node(neighbor);
+					const auto &f2 = m_ndef->getLightingFlags(n2);
+					const u8 light2 = n2.getLight(bank, f2);
+					if (light2 < light) {
+						if (f2.light_propagates && light2 != 0) {
+							n2.setLight(bank, 0, f2);
+							write(neighbor, n2);
+							m_queue[light2].push_back(neighbor);
+						}
+					} else if (!visit(neighbor)) {
+						light_sources.push_back(unpack(neighbor));
+					}
+				}
+			}
+		}
+		endPass(modified_blocks, true);
+		pending.swap(deferred);
+	}
+}
+
+bool LightPropagator::spread(LightBank bank, const std::vector<v3pos_t> &from_nodes,
+		std::map<v3bpos_t, MapBlock *> &modified_blocks, uint64_t end_ms)
+{
+	auto position = [](const v3pos_t &p) { return p; };
+	std::vector<v3pos_t> pending = from_nodes;
+	std::vector<v3pos_t> inside, deferred;
+	size_t steps = 0;
+	while (!pending.empty()) {
+		beginPass(pending, position, inside, deferred);
+		for (const auto &p : inside) {
+			const u32 packed = pack(p);
+			if (!fetch(packed) || visit(packed))
+				continue;
+			const MapNode &n = node(packed);
+			if (n.getContent() == CONTENT_IGNORE)
+				continue;
+			m_queue[n.getLight(bank, m_ndef->getLightingFlags(n))].push_back(packed);
+		}
+
+		// Lit nodes are queued with less light than the node lighting them,
+		// so a node is final when its level comes
+		for (int light = LIGHT_SUN; light > 1; --light) {
+			auto &queue = m_queue[light];
+			const u8 newlight = diminish_light(light);
+			while (!queue.empty()) {
+				if (end_ms && !(++steps & 1023) && porting::getTimeMs() > end_ms) {
+					endPass(modified_blocks, false);
+					return false;
+				}
+				const u32 current = queue.back();
+				queue.pop_back();
+				bool left_region = false;
+				for (u8 dir = 0; dir < 6; ++dir) {
+					u32 neighbor;
+					if (!step(current, dir, neighbor)) {
+						if (!left_region)
+							deferred.push_back(unpack(current));
+						left_region = true;
+						continue;
+					}
+					if (!fetch(neighbor))
+						continue;
+					MapNode n2 = node(neighbor);
+					const auto &f2 = m_ndef->getLightingFlags(n2);
+					if (f2.light_propagates && n2.getLight(bank, f2) < newlight) {
+						n2.setLight(bank, newlight, f2);
+						write(neighbor, n2);
+						m_queue[newlight].push_back(neighbor);
+					}
+				}
+			}
+		}
+		endPass(modified_blocks, false);
+		pending.swap(deferred);
+	}
+	return true;
+}
+
+void LightPropagator::unspreadRaw(LightBank bank,
+		const std::vector<std::pair<v3pos_t, u8>> &from_nodes,
+		const relight_func &relight, std::map<v3bpos_t, MapBlock *> &modified_blocks)
+{
+	using Item = std::pair<v3pos_t, u8>;
+	auto position = [](const Item &item) { return item.first; };
+	std::vector<Item> pending = from_nodes;
+	std::vector<Item> inside, deferred, busy;
+	bool wait = false;
+	while (!pending.empty() || !busy.empty()) {
+		// Start nodes are unlit already, ones in a block used by another
+		// thread are retried once the rest is done. Then the first block
+		// is waited for while none is locked, each pass takes at least one.
+		if (pending.empty()) {
+			pending.swap(busy);
+			wait = true;
+		}
+		beginPass(pending, position, inside, deferred);
+		for (const auto &[p, light] : inside) {
+			const u32 packed = pack(p);
+			if (light > LIGHT_SUN)
+				continue;
+			if (fetch(packed, wait))
+				m_queue[light].push_back(packed);
+			else if (!missing(packed))
+				busy.emplace_back(p, light);
+			wait = false;
+		}
+
+		// Nodes are done whole in one pass, ones at the region border wait
+		// for a region around them
+		for (int light = LIGHT_SUN; light >= 0; --light) {
+			auto &queue = m_queue[light];
+			while (!queue.empty()) {
+				const u32 current = queue.back();
+				queue.pop_back();
+				u32 neighbor[6];
+				if (!neighbors(current, neighbor)) {
+					deferred.emplace_back(unpack(current), light);
+					continue;
+				}
+				MapBlock *block = m_slots[current >> NODE_BITS].block;
+				const auto &f = m_ndef->getLightingFlags(node(current));
+				// A light source behaves like it had a brighter neighbour
+				u8 brightest = f.light_source + 1;
+				for (u8 dir = 0; dir < 6; ++dir) {
+					if (!fetch(neighbor[dir])) {
+						if (missing(neighbor[dir]))
+							block->setLightingComplete(bank, VOXALGO_DIR[dir], false);
+						continue;
+					}
+					MapNode n2 = node(neighbor[dir]);
+					const auto &f2 = m_ndef->getLightingFlags(n2);
+					u8 light2 = n2.getLightRaw(bank, f2);
+					if (f2.light_propagates && light2 < light) {
+						if (light2 != 0) {
+							n2.setLight(bank, 0, f2);
+							write(neighbor[dir], n2);
+							m_queue[light2].push_back(neighbor[dir]);
+						}
+					} else {
+						light2 = std::max<u8>(light2, f2.light_source);
+						brightest = std::max(brightest, light2);
+					}
+				}
+				if (brightest > 1 && f.light_propagates) {
+					const v3pos_t p = unpack(current);
+					relight(brightest - 1, p - block->getPosRelative(), block->getPos(),
+							block);
+				}
+			}
+		}
+		endPass(modified_blocks, false);
+		pending.swap(deferred);
+	}
+}
+
+void LightPropagator::spreadRaw(LightBank bank,
+		const std::vector<std::pair<v3pos_t, u8>> &from_nodes,
+		std::map<v3bpos_t, MapBlock *> &modified_blocks)
+{
+	using Item = std::pair<v3pos_t, u8>;
+	auto position = [](const Item &item) { return item.first; };
+	std::vector<Item> pending = from_nodes;
+	std::vector<Item> inside, deferred;
+	while (!pending.empty()) {
+		beginPass(pending, position, inside, deferred);
+		for (const auto &[p, light] : inside) {
+			const u32 packed = pack(p);
+			if (light <= LIGHT_SUN && fetch(packed))
+				m_queue[light].push_back(packed);
+		}
+
+		for (int light = LIGHT_SUN; light > 1; --light) {
+			auto &queue = m_queue[light];
+			const u8 newlight = light - 1;
+			while (!queue.empty()) {
+				const u32 current = queue.back();
+				queue.pop_back();
+				u32 neighbor[6];
+				if (!neighbors(current, neighbor)) {
+					deferred.emplace_back(unpack(current), light);
+					continue;
+				}
+				for (u8 dir = 0; dir < 6; ++dir) {
+					if (!fetch(neighbor[dir])) {
+						if (missing(neighbor[dir]))
+							m_slots[current >> NODE_BITS].block->setLightingComplete(
+									bank, VOXALGO_DIR[dir], false);
+						continue;
+					}
+					MapNode n2 = node(neighbor[dir]);
+					const auto &f2 = m_ndef->getLightingFlags(n2);
+					if (f2.light_propagates && n2.getLightRaw(bank, f2) < newlight) {
+						n2.setLight(bank, newlight, f2);
+						write(neighbor[dir], n2);
+						m_queue[newlight].push_back(neighbor[dir]);
+					}
+				}
+			}
+		}
+		// Nodes of level 0 and 1 give no light, endPass() drops them
+		endPass(modified_blocks, false);
+		pending.swap(deferred);
+	}
+}
@@ -0,0 +1,166 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "irr_v3d.h"
+#include "irrlichttypes.h"
+#include "light.h"
+#include "mapblock.h"
+#include "util/numeric.h"
+
+class Map;
+class NodeDefManager;
+
+inline u8 diminish_light(u8 light, float amount = 1)
+{
+	if (light == 0)
+		return 0;
+	if (amount < 1) {
+		amount = myrand_range(0, 1) < amount;
+	}
+	if (light >= LIGHT_MAX)
+		return LIGHT_MAX - amount;
+
+	return light - amount;
+}
+
+inline u8 undiminish_light(u8 light)
+{
+	// We don't know if light should undiminish from this particular 0.
+	// Thus, keep it at 0.
+	if (light == 0)
+		return 0;
+	if (light == LIGHT_MAX)
+		return light;
+
+	return light + 1;
+}
+
+/*
+	Group blocks to relight into clusters that can be lit at the same time.
+	Sunlight goes down through any number of blocks and light spreads about
+	a block sideways from there, so blocks less than LIGHT_CLUSTER_REACH + 1
+	blocks apart in x and z are in one cluster whatever their y. Biggest
+	clusters first, blocks of a cluster from top to bottom.
+*/
+constexpr bpos_t LIGHT_CLUSTER_REACH = 3;
+std::vector<std::vector<v3bpos_t>> light_clusters(const std::vector<v3bpos_t> &blocks);
+
+/*
+	Breadth first light propagation over the loaded blocks of a map.
+
+	Work is done in a region of blocks around the start nodes. Nodes are
+	queued as 32 bit values, block slot in the region << 12 | index in the
+	block, in one queue per light level, brightest first. Every block is
+	looked up and locked once, when first reached, and kept until the pass
+	ends. Nodes outside the region are left for a next pass around them.
+*/
+class LightPropagator
+{
+public:
+	LightPropagator(Map *map, const NodeDefManager *ndef);
+	~LightPropagator();
+
+	/*
+		Remove the light spread from from_nodes, the light of these nodes is
+		already removed and given as the light they had. Lit nodes next to
+		the unlit area are added to light_sources, spread() from them fills
+		the area again.
+	*/
+	void unspread(LightBank bank, const std::vector<std::pair<v3pos_t, u8>> &from_nodes,
+			std::vector<v3pos_t> &light_sources,
+			std::map<v3bpos_t, MapBlock *> &modified_blocks);
+
+	// Spread the light of from_nodes, false when end_ms passed before the end
+	bool spread(LightBank bank, const std::vector<v3pos_t> &from_nodes,
+			std::map<v3bpos_t, MapBlock *> &modified_blocks, uint64_t end_ms = 0);
+
+	/*
+		The same with the rules of voxalgo: raw light, one less per node,
+		light sources do not spread by themselves. A block next to an
+		unloaded one is marked as not lighting complete to that side.
+	*/
+	using relight_func = std::function<void(u8 light, const v3pos_t &rel,
+			const v3bpos_t &blockpos, MapBlock *block)>;
+	// from_nodes have raw light 0 already and are given with the light they
+	// had. Unlit nodes that a neighbour or their own source lights again
+	// are passed to relight with the light they get.
+	void unspreadRaw(LightBank bank, const std::vector<std::pair<v3pos_t, u8>> &from_nodes,
+			const relight_func &relight,
+			std::map<v3bpos_t, MapBlock *> &modified_blocks);
+	// from_nodes have the light they are given already
+	void spreadRaw(LightBank bank, const std::vector<std::pair<v3pos_t, u8>> &from_nodes,
+			std::map<v3bpos_t, MapBlock *> &modified_blocks);
+
+private:
+	static constexpr u32 NODE_BITS = 12;
+	static constexpr u32 NODE_MASK = (1U << NODE_BITS) - 1;
+	// Blocks per region side, MAP_BLOCKSIZE * REGION_SIZE nodes
+	static constexpr pos_t REGION_SIZE = 32;
+	static constexpr u32 NO_PAGE = U32_MAX;
+
+	struct Slot
+	{
+		MapBlock *block = nullptr;
+		std::unique_ptr<MapBlock::lock_rec_unique> lock;
+		u32 visited = NO_PAGE;
+		bool fetched = false;
+		// Not loaded, as opposed to used by another thread
+		bool missing = false;
+		// Expanded by a first setNodeNoLock(), later writes go to the array
+		bool written = false;
+	};
+
+	// Set the region around the first of positions, the ones outside go to rest
+	template <typename Item, typename Position>
+	void beginPass(const std::vector<Item> &items, Position position,
+			std::vector<Item> &inside, std::vector<Item> &rest);
+	void endPass(std::map<v3bpos_t, MapBlock *> &modified_blocks, bool unlit);
+
+	bool contains(const v3pos_t &p) const;
+	u32 pack(const v3pos_t &p) const;
+	v3pos_t unpack(u32 packed) const;
+	// Neighbour of packed in direction dir, false when outside the region
+	bool step(u32 packed, u8 dir, u32 &neighbor) const;
+	// All neighbours of packed, false when one is outside the region
+	bool neighbors(u32 packed, u32 (&neighbor)[6]) const;
+	// Fetched and not loaded
+	bool missing(u32 packed) const { return m_slots[packed >> NODE_BITS].missing; }
+	// Block of packed, nullptr when not loaded or used by another thread.
+	// wait for the other thread instead, only with no block locked.
+	MapBlock *fetch(u32 packed, bool wait = false);
+	MapNode &node(u32 packed);
+	void write(u32 packed, const MapNode &n);
+	// Mark packed, true when it was marked already
+	bool visit(u32 packed);
+
+	Map *m_map;
+	const NodeDefManager *m_ndef;
+	v3bpos_t m_min;
+	v3pos_t m_size;
+	std::vector<Slot> m_slots;
+	std::vector<std::array<u64, 4096 / 64>> m_visited;
+	std::array<std::vector<u32>, LIGHT_SUN + 1> m_queue;
+};
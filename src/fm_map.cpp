@@ -22,6 +22,7 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <future>
 #include <memory>
 #include <vector>
 #include "database/database.h"
@@ -34,6 +35,7 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include "nodedef.h"
 #include "environment.h"
 #include "emerge.h"
+#include "fm_light.h"
 #include "mapgen/mg_biome.h"
 #include "gamedef.h"
 #include "reflowscan.h"
@@ -41,30 +43,12 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include "server/ban.h"
 #include "servermap.h"
 #include "settings.h"
+#include "threading/ThreadPool.h"
+#include "threading/async.h"
 #include "util/directiontables.h"
 #include "serverenvironment.h"
 #include "voxelalgorithms.h"
 
-namespace
-{
-float fm_weather_pressure(float heat, float humidity, pos_t y)
-{
-	// Approximate low pressure from warm/humid air and lower pressure at altitude.
-	return -heat - humidity * 0.25f - static_cast<float>(y) * 0.02f;
-}
-
-weather::wind_t fm_limit_wind(weather::wind_t wind)
-{
-	constexpr float max_wind = 8.0f;
-	if (!std::isfinite(wind.X) || !std::isfinite(wind.Y) || !std::isfinite(wind.Z))
-		return {};
-	const float length = wind.getLength();
-	if (length > max_wind && length > 0.0001f)
-		wind *= max_wind / length;
-	return wind;
-}
-}
-
 #if HAVE_THREAD_LOCAL
 namespace
 {
@@ -75,66 +59,6 @@ thread_local v3bpos_t block_cache_p;
 
 std::atomic_uint ServerMap::time_life{};
 
-namespace
-{
-
-struct BlockWeatherState
-{
-	MapBlockPtr block;
-	v3bpos_t pos;
-	float heat = 0.0f;
-	float humidity = 0.0f;
-	weather::wind_t wind;
-	float pressure = 0.0f;
-	bool active = false;
-};
-
-float clamp_weather_float(float value, float min_value, float max_value)
-{
-	return std::max(min_value, std::min(max_value, value));
-}
-
-template <typename AtomicValue>
-void store_weather_split(
-		AtomicValue &base_ref, AtomicValue &add_ref, float total, float min_value, float max_value)
-{
-	total = clamp_weather_float(total, min_value, max_value);
-
-	float add = static_cast<float>(add_ref.load());
-	float base = total - add;
-	if (base < min_value) {
-		base = min_value;
-		add = total - base;
-	} else if (base > max_value) {
-		base = max_value;
-		add = total - base;
-	}
-
-	const auto base_i = static_cast<short>(std::lround(base));
-	base_ref = base_i;
-	add_ref = static_cast<short>(std::lround(total - static_cast<float>(base_i)));
-}
-
-float heat_transfer_weight(const v3pos_t &dir, float delta)
-{
-	if (dir.Y > 0)
-		return delta < 0.0f ? 1.8f : 0.35f; // lose heat upward, resist heat sinking
-	if (dir.Y < 0)
-		return delta > 0.0f ? 1.8f : 0.35f; // gain heat from below, resist heat sinking
-	return 1.0f;
-}
-
-float humidity_transfer_weight(const v3pos_t &dir, float delta)
-{
-	if (dir.Y > 0)
-		return delta > 0.0f ? 1.6f : 0.45f; // gain humidity from above
-	if (dir.Y < 0)
-		return delta < 0.0f ? 1.6f : 0.45f; // lose humidity downward
-	return 1.0f;
-}
-
-} // namespace
-
 // TODO: REMOVE THIS func and use Map::getBlock
 MapBlockPtr Map::getBlock(v3bpos_t p, bool trylock, bool nocache)
 {
@@ -221,6 +145,7 @@ MapBlockPtr Map::createBlankBlock(const v3pos_t &p)
 	block = createBlankBlockNoInsert(p);
 
 	m_blocks.insert_or_assign(p, block);
+	onBlockInserted(block);
 
 	return block;
 }
@@ -241,6 +166,7 @@ bool Map::insertBlock(MapBlockPtr block)
 
 	// Insert into container
 	m_blocks.insert_or_assign(block_p, block);
+	onBlockInserted(block);
 	return true;
 }
 
@@ -268,6 +194,7 @@ void Map::eraseBlock(const MapBlockPtr block)
 	const auto block_p = block->getPos();
 	(*m_blocks_delete)[block] = 1;
 	m_blocks.erase(block_p);
+	onBlockErased(block);
 #if ENABLE_THREADS && !HAVE_THREAD_LOCAL
 	const auto lock = unique_lock(m_block_cache_mutex);
 #endif
@@ -467,11 +394,13 @@ weather::humidity_t ServerMap::updateBlockHumidity(ServerEnvironment *env,
 u32 ServerMap::stepLoadedBlockWeather(
 		ServerEnvironment *env, float dtime, unsigned int max_cycle_ms)
 {
-	if (!env || !env->m_use_weather)
+	if (!env || !env->m_use_weather) {
+		if (m_weather_grid.isEnabled())
+			m_weather_grid.disable();
 		return 0;
+	}
 
 	const u64 end_ms = porting::getTimeMs() + max_cycle_ms;
-	const float dt = clamp_weather_float(dtime, 0.1f, 20.0f);
 	const float gametime = env->getGameTime() * env->m_time_of_day_speed;
 	const float timeofday = env->getTimeOfDayF();
 	auto *mapgen = m_emerge->getFirstMapgen();
@@ -479,186 +408,26 @@ u32 ServerMap::stepLoadedBlockWeather(
 		return m_weather_update_last;
 	const auto seed = getSeed();
 
-	std::vector<BlockWeatherState> states;
-	unordered_map_v3bpos<size_t> index;
-
-	auto add_state = [&](const v3bpos_t &pos, const MapBlockPtr &block, bool active) {
-		if (!block || !block->isGenerated())
-			return false;
-
-		auto found = index.find(pos);
-		if (found != index.end()) {
-			const bool was_active = states[found->second].active;
-			states[found->second].active = states[found->second].active || active;
-			return active && !was_active;
-		}
-
-		const auto block_lock = block->try_lock_shared_rec();
-		if (!block_lock->owns_lock())
-			return false;
-
-		BlockWeatherState state;
-		state.block = block;
-		state.pos = pos;
-		state.heat = block->heat + block->heat_add;
-		state.humidity = block->humidity + block->humidity_add;
-		state.wind = block->wind;
-		state.pressure = fm_weather_pressure(
-				state.heat, state.humidity, pos.Y * MAP_BLOCKSIZE);
-		state.active = active;
-
-		index.emplace(pos, states.size());
-		states.emplace_back(state);
-		return active;
-	};
-
-	u32 n = 0;
-	u32 active_count = 0;
-	{
-		const auto map_lock = m_blocks.try_lock_shared_rec();
-		if (!map_lock->owns_lock())
-			return m_weather_update_last;
-
-		const size_t blocks_size = m_blocks.size();
-		for (const auto &[pos, block] : m_blocks) {
-			if (n++ < m_weather_update_last)
-				continue;
-
-			if (!add_state(pos, block, true))
-				continue;
-
-			++active_count;
-			for (const auto &dir : g_6dirs) {
-				const auto neighbor_pos = pos + dir;
-				auto neighbor = m_blocks.find(neighbor_pos);
-				if (neighbor != m_blocks.end())
-					add_state(neighbor_pos, neighbor->second, false);
-			}
-
-			if (active_count > std::max<size_t>(64, blocks_size / 20) &&
-					porting::getTimeMs() > end_ms) {
-				m_weather_update_last = n;
-				break;
-			}
-		}
-
-		if (n >= blocks_size || active_count == 0)
-			m_weather_update_last = 0;
+	if (!m_weather_grid.isEnabled()) {
+		m_weather_grid.enable();
+		const auto map_lock = m_blocks.lock_shared_rec();
+		for (const auto &[pos, block] : m_blocks)
+			m_weather_grid.add(block);
 	}
 
-	struct WeatherResult
-	{
-		size_t index;
-		float heat;
-		float humidity;
-		weather::wind_t wind;
-	};
-	std::vector<WeatherResult> results;
-	results.reserve(active_count);
-
-	for (size_t i = 0; i < states.size(); ++i) {
-		const BlockWeatherState &state = states[i];
-		if (!state.active)
-			continue;
-
-		const v3pos_t node_pos = state.pos * MAP_BLOCKSIZE;
-		const float base_heat = mapgen->calcBlockHeat(
+	const auto base = [&](const v3bpos_t &pos, WeatherGrid::base_t &value) {
+		const v3pos_t node_pos = pos * MAP_BLOCKSIZE;
+		value.heat = mapgen->calcBlockHeat(
 				node_pos, seed, timeofday, gametime, env->m_use_weather);
-		const float base_humidity = mapgen->calcBlockHumidity(
+		value.humidity = mapgen->calcBlockHumidity(
 				node_pos, seed, timeofday, gametime, env->m_use_weather);
+		value.has_wind = mapgen->calcBlockWind(
+				node_pos, seed, timeofday, gametime, env->m_use_weather, &value.wind);
+	};
 
-		float heat_diffusion = 0.0f;
-		float humidity_diffusion = 0.0f;
-		float heat_weight_sum = 0.0f;
-		float humidity_weight_sum = 0.0f;
-		float heat_advection = 0.0f;
-		float humidity_advection = 0.0f;
-		weather::wind_t pressure_gradient;
-		int neighbors = 0;
-
-		for (const auto &dir : g_6dirs) {
-			auto found = index.find(state.pos + dir);
-			if (found == index.end())
-				continue;
-
-			const BlockWeatherState &neighbor = states[found->second];
-			const v3f dirf(dir.X, dir.Y, dir.Z);
-			const float heat_delta = neighbor.heat - state.heat;
-			const float humidity_delta = neighbor.humidity - state.humidity;
-			const float pressure_delta = neighbor.pressure - state.pressure;
-			const float inflow = std::max(0.0f, -state.wind.dotProduct(dirf));
-			const float heat_weight = heat_transfer_weight(dir, heat_delta);
-			const float humidity_weight = humidity_transfer_weight(dir, humidity_delta);
-
-			heat_diffusion += heat_delta * heat_weight;
-			humidity_diffusion += humidity_delta * humidity_weight;
-			heat_weight_sum += heat_weight;
-			humidity_weight_sum += humidity_weight;
-			heat_advection += heat_delta * inflow;
-			humidity_advection += humidity_delta * inflow;
-			pressure_gradient += dirf * pressure_delta;
-			++neighbors;
-		}
-
-		if (neighbors > 0) {
-			if (heat_weight_sum > 0.0f)
-				heat_diffusion /= heat_weight_sum;
-			if (humidity_weight_sum > 0.0f)
-				humidity_diffusion /= humidity_weight_sum;
-			heat_advection /= neighbors;
-			humidity_advection /= neighbors;
-			pressure_gradient /= neighbors;
-		}
-
-		weather::wind_t wind = state.wind - pressure_gradient * (0.015f * dt);
-		wind *= std::exp(-0.08f * dt);
-		weather::wind_t mapgen_wind;
-		if (mapgen->calcBlockWind(
-					node_pos, seed, timeofday, gametime, env->m_use_weather, &mapgen_wind)) {
-			mapgen_wind.Y = wind.Y;
-			wind = mapgen_wind * 0.80f + wind * 0.20f;
-		}
-		wind = fm_limit_wind(wind);
-
-		float heat = state.heat;
-		float humidity = state.humidity;
-
-		heat += heat_diffusion * (0.035f * dt);
-		humidity += humidity_diffusion * (0.055f * dt);
-		heat += heat_advection * (0.015f * dt);
-		humidity += humidity_advection * (0.020f * dt);
-
-		heat += (base_heat - heat) * (0.006f * dt);
-		humidity += (base_humidity - humidity) * (0.006f * dt);
-
-		// Warm air can carry more water; cold blocks lose a little humidity.
-		humidity += std::max(0.0f, heat - 25.0f) * (0.002f * dt);
-		humidity -= std::max(0.0f, 5.0f - heat) * (0.003f * dt);
-
-		results.push_back({
-				i,
-				clamp_weather_float(heat, -100.0f, 100.0f),
-				clamp_weather_float(humidity, 0.0f, 100.0f),
-				wind,
-		});
-	}
-
-	const auto next_update = env->getGameTime() + 20;
-	for (const WeatherResult &result : results) {
-		BlockWeatherState &state = states[result.index];
-		const auto block_lock = state.block->try_lock_unique_rec();
-		if (!block_lock->owns_lock()) {
-			continue;
-		}
-
-		store_weather_split(state.block->heat, state.block->heat_add,
-				result.heat, -100.0f, 100.0f);
-		store_weather_split(state.block->humidity, state.block->humidity_add,
-				result.humidity, 0.0f, 100.0f);
-		state.block->wind = result.wind;
-		state.block->heat_last_update = next_update;
-		state.block->humidity_last_update = next_update;
-	}
+	size_t active_count = 0;
+	m_weather_update_last = m_weather_grid.step(m_weather_update_last, dtime, end_ms,
+			env->getGameTime() + 20, base, active_count);
 
 	g_profiler->avg("ServerMap: weather active blocks", active_count);
 	return m_weather_update_last;
@@ -727,7 +496,7 @@ weather::wind_t ServerMap::updateBlockWind(ServerEnvironment *env, const v3pos_t
 		return {
 				.heat = heat,
 				.humidity = humidity,
-				.pressure = fm_weather_pressure(heat, humidity, sample_p.Y),
+				.pressure = WeatherGrid::pressure(heat, humidity, sample_p.Y),
 		};
 	};
 
@@ -758,12 +527,12 @@ weather::wind_t ServerMap::updateBlockWind(ServerEnvironment *env, const v3pos_t
 		wind = mapgen_wind * 0.80f + wind * 0.20f;
 	}
 
-	wind = fm_limit_wind(wind);
+	wind = WeatherGrid::limitWind(wind);
 
 	if (block) {
 		const auto old_wind = block->wind;
 		if (old_wind.getLengthSQ() > 0.0001f)
-			wind = fm_limit_wind(old_wind * 0.80f + wind * 0.20f);
+			wind = WeatherGrid::limitWind(old_wind * 0.80f + wind * 0.20f);
 		block->wind = wind;
 	}
 
@@ -993,58 +762,14 @@ u32 Map::timerUpdate(float uptime, float unload_timeout, s32 max_loaded_blocks,
 }
 
 //#if TODO
-inline u8 diminish_light(u8 light, float amount = 1)
-{
-	if (light == 0)
-		return 0;
-	if (amount < 1) {
-		amount = myrand_range(0, 1) < amount;
-	}
-	if (light >= LIGHT_MAX)
-		return LIGHT_MAX - amount;
-
-	return light - amount;
-}
-
 /*
-inline u8 diminish_light(u8 light, u8 distance)
-{
-	if (distance >= light)
-		return 0;
-	return light - distance;
-}
-*/
-
-inline u8 undiminish_light(u8 light)
-{
-	// We don't know if light should undiminish from this particular 0.
-	// Thus, keep it at 0.
-	if (light == 0)
-		return 0;
-	if (light == LIGHT_MAX)
-		return light;
-
-	return light + 1;
-}
-
-const v3pos_t dirs6[6] = {
-		{0, 0, 1},	// back
-		{0, 1, 0},	// top
-		{1, 0, 0},	// right
-		{0, 0, -1}, // front
-		{0, -1, 0}, // bottom
-		{-1, 0, 0}, // left
-};
+	Goes through the neighbours of the nodes, alters only transparent
+	nodes.
 
-/*
-	Goes recursively through the neighbours of the node.
-
-	Alters only transparent nodes.
-
-	If the lighting of the neighbour is lower than the lighting of
-	the node was (before changing it to 0 at the step before), the
-	lighting of the neighbour is set to 0 and then the same stuff
-	repeats for the neighbour.
+	If the lighting of the neighbour is lower than the lighting of the
+	node was (before changing it to 0 at the step before), the lighting of
+	the neighbour is set to 0 and then the same stuff repeats for the
+	neighbour.
 
 	The ending nodes of the routine are stored in light_sources.
 	This is useful when a light is removed. In such case, this
@@ -1056,321 +781,34 @@ const v3pos_t dirs6[6] = {
 void ServerMap::unspreadLight(enum LightBank bank, std::map<v3pos_t, u8> &from_nodes,
 		std::set<v3pos_t> &light_sources, std::map<v3bpos_t, MapBlock *> &modified_blocks)
 {
-	auto *nodemgr = m_gamedef->ndef();
-
 	if (from_nodes.empty())
 		return;
 
-	u32 blockchangecount = 0;
-
-	std::map<v3pos_t, u8> unlighted_nodes;
-
-	/*
-		Initialize block cache
-	*/
-	v3bpos_t blockpos_last;
-	MapBlock *block = NULL;
-	// Cache this a bit, too
-	bool block_checked_in_modified = false;
-
-	for (auto j = from_nodes.begin(); j != from_nodes.end(); ++j) {
-		auto pos = j->first;
-		auto blockpos = getNodeBlockPos(pos);
-
-		// Only fetch a new block if the block position has changed
-		/*
-				try{
-		*/
-		if (block == NULL || blockpos != blockpos_last) {
-			block = getBlockNoCreateNoEx(blockpos);
-			blockpos_last = blockpos;
-
-			block_checked_in_modified = false;
-			blockchangecount++;
-		}
-		/*
-				}
-				catch(InvalidPositionException &e)
-				{
-					continue;
-				}
-		*/
-
-		if (!block)
-			continue;
-
-		// Calculate relative position in block
-		// v3pos_t relpos = pos - blockpos_last * MAP_BLOCKSIZE;
-
-		// Get node straight from the block
-		// MapNode n = block->getNode(relpos);
-
-		u8 oldlight = j->second;
-
-		// Loop through 6 neighbors
-		for (u16 i = 0; i < 6; i++) {
-			// Get the position of the neighbor node
-			v3pos_t n2pos = pos + dirs6[i];
-
-			// Get the block where the node is located
-			v3bpos_t blockpos;
-			v3pos_t relpos;
-			getNodeBlockPosWithOffset(n2pos, blockpos, relpos);
-
-			// Only fetch a new block if the block position has changed
-			/*
-						try {
-			*/
-			if (block == NULL || blockpos != blockpos_last) {
-				block = getBlockNoCreateNoEx(blockpos);
-
-				if (!block)
-					continue;
-
-				blockpos_last = blockpos;
-
-				block_checked_in_modified = false;
-				blockchangecount++;
-			}
-			/*
-						}
-						catch(InvalidPositionException &e) {
-							continue;
-						}
-			*/
-
-			// Get node straight from the block
-			bool is_valid_position;
-			MapNode n2 = block->getNode(relpos, &is_valid_position);
-			if (!is_valid_position)
-				continue;
-			const auto &f2 = nodemgr->getLightingFlags(n2);
-
-			bool changed = false;
-
-			// TODO: Optimize output by optimizing light_sources?
-
-			/*
-				If the neighbor is dimmer than what was specified
-				as oldlight (the light of the previous node)
-			*/
-			if (n2.getLight(bank, f2) < oldlight) {
-				/*
-					And the neighbor is transparent and it has some light
-				*/
-				if (nodemgr->get(n2).light_propagates && n2.getLight(bank, f2) != 0) {
-					/*
-						Set light to 0 and add to queue
-					*/
-
-					u8 current_light = n2.getLight(bank, f2);
-					n2.setLight(bank, 0, f2);
-					block->setNode(relpos, n2);
-
-					unlighted_nodes[n2pos] = current_light;
-					changed = true;
-
-					/*
-						Remove from light_sources if it is there
-						NOTE: This doesn't happen nearly at all
-					*/
-					/*if(light_sources.find(n2pos))
-					{
-						infostream<<"Removed from light_sources"<<std::endl;
-						light_sources.remove(n2pos);
-					}*/
-				}
-
-				/*// DEBUG
-				if(light_sources.find(n2pos) != NULL)
-					light_sources.remove(n2pos);*/
-			} else {
-				light_sources.insert(n2pos);
-			}
-
-			// Add to modified_blocks
-			if (changed == true && block_checked_in_modified == false) {
-				// If the block is not found in modified_blocks, add.
-				/*
-								if(modified_blocks.find(blockpos) ==
-				   modified_blocks.end())
-								{
-				*/
-				//++block->lighting_broken;
-				block->setLightingComplete(0);
-
-				modified_blocks[blockpos] = block;
-				/*
-								}
-				*/
-				block_checked_in_modified = true;
-			}
-		}
-	}
-
-	/*infostream<<"unspreadLight(): Changed block "
-	<<blockchangecount<<" times"
-	<<" for "<<from_nodes.size()<<" nodes"
-	<<std::endl;*/
-
-	if (!unlighted_nodes.empty())
-		unspreadLight(bank, unlighted_nodes, light_sources, modified_blocks);
+	std::vector<v3pos_t> sources;
+	LightPropagator(this, m_gamedef->ndef())
+			.unspread(bank, {from_nodes.begin(), from_nodes.end()}, sources,
+					modified_blocks);
+	light_sources.insert(sources.begin(), sources.end());
 }
 
 /*
-	Lights neighbors of from_nodes, collects all them and then
-	goes on recursively.
+	Lights neighbors of from_nodes, and their neighbours as far as the
+	light goes.
 */
 void ServerMap::spreadLight(enum LightBank bank, std::set<v3pos_t> &from_nodes,
 		std::map<v3bpos_t, MapBlock *> &modified_blocks, uint64_t end_ms)
 {
-	auto *nodemgr = m_gamedef->ndef();
-
 	if (from_nodes.empty())
 		return;
 
-	u32 blockchangecount = 0;
-
-	std::set<v3pos_t> lighted_nodes;
-
-	/*
-		Initialize block cache
-	*/
-	v3bpos_t blockpos_last;
-	MapBlock *block = NULL;
-	// Cache this a bit, too
-	bool block_checked_in_modified = false;
-
-	for (auto j = from_nodes.begin(); j != from_nodes.end(); ++j) {
-		auto pos = *j;
-		v3bpos_t blockpos;
-		v3pos_t relpos;
-
-		getNodeBlockPosWithOffset(pos, blockpos, relpos);
-
-		// Only fetch a new block if the block position has changed
-		if (block == NULL || blockpos != blockpos_last) {
 #if !ENABLE_THREADS
-			const auto lock = m_nothread_locker.try_lock_shared_rec();
-			if (!lock->owns_lock())
-				continue;
-#endif
-			block = getBlockNoCreateNoEx(blockpos);
-			if (!block)
-				continue;
-			blockpos_last = blockpos;
-
-			block_checked_in_modified = false;
-			blockchangecount++;
-		}
-
-		// const auto lock = block->try_lock_unique_rec();
-		// if (!lock->owns_lock())
-		//	continue;
-
-		// Get node straight from the block
-		bool is_valid_position;
-		MapNode n = block->getNode(relpos, &is_valid_position);
-		if (n.getContent() == CONTENT_IGNORE)
-			continue;
-		const auto &f = nodemgr->getLightingFlags(n);
-
-		u8 oldlight = is_valid_position ? n.getLight(bank, f) : 0;
-		u8 newlight = diminish_light(oldlight);
-
-		// Loop through 6 neighbors
-		for (u16 i = 0; i < 6; i++) {
-			// Get the position of the neighbor node
-			v3pos_t n2pos = pos + dirs6[i];
-
-			// Get the block where the node is located
-			v3bpos_t blockpos;
-			v3pos_t relpos;
-			getNodeBlockPosWithOffset(n2pos, blockpos, relpos);
-
-			// Only fetch a new block if the block position has changed
-			// try {
-			if (block == NULL || blockpos != blockpos_last) {
-				block = getBlockNoCreateNoEx(blockpos);
-				if (!block)
-					continue;
-				blockpos_last = blockpos;
-
-				block_checked_in_modified = false;
-				blockchangecount++;
-			}
-			/*
-						}
-						catch(InvalidPositionException &e) {
-							continue;
-						}
-			*/
-
-			// Get node straight from the block
-			MapNode n2 = block->getNode(relpos, &is_valid_position);
-			if (!is_valid_position)
-				continue;
-			const auto &f2 = nodemgr->getLightingFlags(n);
-
-			bool changed = false;
-			/*
-				If the neighbor is brighter than the current node,
-				add to list (it will light up this node on its turn)
-			*/
-			if (n2.getLight(bank, f2) > undiminish_light(oldlight)) {
-				lighted_nodes.insert(n2pos);
-				changed = true;
-			}
-			/*
-				If the neighbor is dimmer than how much light this node
-				would spread on it, add to list
-			*/
-			if (n2.getLight(bank, f2) < newlight) {
-				if (nodemgr->get(n2).light_propagates) {
-					n2.setLight(bank, newlight, f2);
-					block->setNode(relpos, n2);
-					lighted_nodes.insert(n2pos);
-					changed = true;
-				}
-			}
-
-			// Add to modified_blocks
-			if (changed == true && block_checked_in_modified == false) {
-				// If the block is not found in modified_blocks, add.
-				/*
-								if(modified_blocks.find(blockpos) ==
-				   modified_blocks.end())
-								{
-				*/
-				modified_blocks[blockpos] = block;
-				/*
-								}
-				*/
-				block_checked_in_modified = true;
-			}
-		}
-	}
-
-	/*infostream<<"spreadLight(): Changed block "
-			<<blockchangecount<<" times"
-			<<" for "<<from_nodes.size()<<" nodes"
-			<<std::endl;*/
-
-	if (end_ms && porting::getTimeMs() > end_ms) {
+	const auto lock = m_nothread_locker.try_lock_shared_rec();
+	if (!lock->owns_lock())
 		return;
-	}
-
-	if (!lighted_nodes.empty()) {
-		/*
-																   infostream<<"spreadLight(): recursive("<<recursive<<"): changed="
-															  <<blockchangecount
-																	   <<" from="<<from_nodes.size()
-																	   <<" lighted="<<lighted_nodes.size()
-																	   <<" modifiedB="<<modified_blocks.size()
-																	   <<std::endl;
-														   */
-		spreadLight(bank, lighted_nodes, modified_blocks, end_ms);
-	}
+#endif
+	LightPropagator(this, m_gamedef->ndef())
+			.spread(bank, {from_nodes.begin(), from_nodes.end()}, modified_blocks,
+					end_ms);
 }
 
 u32 ServerMap::updateLighting(concurrent_map<v3pos_t, MapBlock *> &a_blocks,
@@ -1557,33 +995,67 @@ u32 ServerMap::updateLighting(lighting_map_t &a_blocks,
 u32 ServerMap::updateLighting(lighting_map_t &a_blocks,
 		unordered_map_v3pos<int> &processed, unsigned int max_cycle_ms)
 {
-	std::map<v3pos_t, MapBlock *> modified_blocks;
-
 	int ret = 0;
 	int loopcount = 0;
 
 	TimeTaker timer("updateLighting");
 
-	for (auto i = a_blocks.begin(); i != a_blocks.end();) {
-		auto block = getBlockNoCreateNoEx(i->first);
-		if (!block) {
-			i = a_blocks.erase(i);
-			continue;
-		}
-		if (!voxalgo::repair_block_light(this, block, &modified_blocks)) {
-			processed[block->getPos()] = block->getPos().Y;
+	std::vector<v3bpos_t> positions;
+	positions.reserve(a_blocks.size());
+	for (const auto &i : a_blocks)
+		positions.emplace_back(i.first);
+	const auto clusters = light_clusters(positions);
+
+	struct cluster_result
+	{
+		std::map<v3bpos_t, MapBlock *> modified_blocks;
+		std::vector<v3bpos_t> missing;
+		std::vector<v3bpos_t> processed;
+		int loopcount = 0;
+	};
+	std::vector<cluster_result> results(clusters.size());
+
+	// Clusters don't reach each other's blocks, blocks inside one go in order
+	const auto light_cluster = [this, &clusters, &results](size_t index) {
+		auto &result = results[index];
+		for (const auto &pos : clusters[index]) {
+			auto block = getBlockNoCreateNoEx(pos);
+			if (!block) {
+				result.missing.emplace_back(pos);
+				continue;
+			}
+			if (!voxalgo::repair_block_light(this, block, &result.modified_blocks)) {
+				result.processed.emplace_back(pos);
+			}
+			++result.loopcount;
 		}
-		++loopcount;
-		++i;
+	};
+
+	if (m_lighting_pool && clusters.size() > 1) {
+		std::vector<std::future<void>> futures;
+		futures.reserve(clusters.size());
+		for (size_t i = 0; i < clusters.size(); ++i)
+			futures.emplace_back(m_lighting_pool->enqueue(light_cluster, i));
+		wait_all(futures);
+	} else {
+		for (size_t i = 0; i < clusters.size(); ++i)
+			light_cluster(i);
 	}
 
-	for (const auto &i : modified_blocks) {
-		a_blocks.erase(i.first);
+	for (const auto &result : results) {
+		for (const auto &pos : result.missing)
+			a_blocks.erase(pos);
+		for (const auto &pos : result.processed)
+			processed[pos] = pos.Y;
+		for (const auto &i : result.modified_blocks)
+			a_blocks.erase(i.first);
+		loopcount += result.loopcount;
 	}
 	for (const auto &i : processed) {
 		a_blocks.erase(i.first);
 	}
 	g_profiler->add("Server: light blocks", loopcount);
+	g_profiler->add("Server: light clusters", clusters.size());
 
 	return ret;
 }
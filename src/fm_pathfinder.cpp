@@ -0,0 +1,522 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_pathfinder.h"
+#include <algorithm>
+#include <queue>
+#include <tuple>
+#include "log.h"
+#include "map.h"
+#include "mapblock.h"
+#include "nodedef.h"
+#include "profiler.h"
+#include "threading/ThreadPool.h"
+#include "util/numeric.h"
+
+// Navigation blocks kept per navigator
+static constexpr size_t NAV_CACHE_SIZE = 8192;
+// Corridors kept per navigator
+static constexpr size_t CORRIDOR_CACHE_SIZE = 1024;
+// Abstract nodes expanded before giving up on the corridor search
+static constexpr size_t CORRIDOR_MAX_EXPAND = 4096;
+// Jumps and drops higher than this are treated as this in the block graph
+static constexpr unsigned int NAV_MAX_STEP = MAP_BLOCKSIZE;
+
+namespace
+{
+struct AbstractNode
+{
+	v3bpos_t pos;
+	PathNavBlock::region_t region;
+	bool operator==(const AbstractNode &other) const
+	{
+		return pos == other.pos && region == other.region;
+	}
+};
+
+struct AbstractNodeHash
+{
+	size_t operator()(const AbstractNode &n) const
+	{
+		return v3bposHash()(n.pos) ^ (size_t(n.region) << 20);
+	}
+};
+
+struct AbstractInfo
+{
+	int cost{};
+	AbstractNode parent{};
+	bool closed{};
+};
+
+int block_distance(const v3bpos_t &a, const v3bpos_t &b)
+{
+	return (std::abs(a.X - b.X) + std::abs(a.Y - b.Y) + std::abs(a.Z - b.Z)) *
+		   MAP_BLOCKSIZE;
+}
+
+const v3pos_t horizontal_dirs[] = {
+		{1, 0, 0},
+		{-1, 0, 0},
+		{0, 0, 1},
+		{0, 0, -1},
+};
+}
+
+PathNavigator::PathNavigator(Map *map, const NodeDefManager *ndef, size_t threads) :
+		m_map(map), m_ndef(ndef), m_threads(threads)
+{
+}
+
+PathNavigator::~PathNavigator()
+{
+	// Workers may still use the map and the caches
+	m_pool.reset();
+}
+
+PathNavigator::nav_ptr PathNavigator::buildNavBlock(
+		const v3bpos_t &bpos, uint8_t max_jump, uint8_t max_drop)
+{
+	auto block = m_map->getBlock(bpos);
+	if (!block)
+		return {};
+
+	constexpr pos_t BSIZE = MAP_BLOCKSIZE;
+	const v3pos_t base = getBlockPosRelative(bpos);
+
+	// Walkable flags of the block and the node layer below it
+	std::array<bool, BSIZE *(BSIZE + 1) * BSIZE> walkable{};
+	std::array<bool, BSIZE * BSIZE * BSIZE> known{};
+	const auto walk_index = [](pos_t x, pos_t y, pos_t z) {
+		return (z * (BSIZE + 1) + (y + 1)) * BSIZE + x;
+	};
+	{
+		const auto lock = block->lock_shared_rec();
+		for (pos_t z = 0; z < BSIZE; ++z)
+			for (pos_t y = 0; y < BSIZE; ++y)
+				for (pos_t x = 0; x < BSIZE; ++x) {
+					const v3pos_t rel(x, y, z);
+					const auto &n = block->getNodeNoLock(rel);
+					if (n.getContent() == CONTENT_IGNORE)
+						continue;
+					known[PathNavBlock::index(rel)] = true;
+					walkable[walk_index(x, y, z)] = m_ndef->get(n).walkable;
+				}
+	}
+	for (pos_t z = 0; z < BSIZE; ++z)
+		for (pos_t x = 0; x < BSIZE; ++x) {
+			const auto n = m_map->getNode(base + v3pos_t(x, -1, z));
+			walkable[walk_index(x, -1, z)] =
+					n.getContent() != CONTENT_IGNORE && m_ndef->get(n).walkable;
+		}
+
+	const auto is_surface = [&](const v3pos_t &rel) {
+		return known[PathNavBlock::index(rel)] &&
+			   !walkable[walk_index(rel.X, rel.Y, rel.Z)] &&
+			   walkable[walk_index(rel.X, rel.Y - 1, rel.Z)];
+	};
+
+	auto nav = std::make_shared<PathNavBlock>();
+	const core::aabbox3d<pos_t> box(0, 0, 0, BSIZE - 1, BSIZE - 1, BSIZE - 1);
+
+	std::vector<v3pos_t> stack;
+	for (pos_t z = 0; z < BSIZE; ++z)
+		for (pos_t y = 0; y < BSIZE; ++y)
+			for (pos_t x = 0; x < BSIZE; ++x) {
+				const v3pos_t start(x, y, z);
+				if (nav->getRegion(start) != PathNavBlock::REGION_NONE ||
+						!is_surface(start))
+					continue;
+
+				// Components above the limit share the last region, which
+				// only makes the graph more optimistic
+				if (nav->regions_count < PathNavBlock::REGION_MAX) {
+					++nav->regions_count;
+					nav->exits.emplace_back();
+				}
+				const auto region = nav->regions_count;
+				auto &exits = nav->exits[region - 1];
+
+				nav->region[PathNavBlock::index(start)] = region;
+				stack.push_back(start);
+				while (!stack.empty()) {
+					const auto rel = stack.back();
+					stack.pop_back();
+					for (const auto &dir : horizontal_dirs) {
+						for (int dy = -int(max_drop); dy <= int(max_jump); ++dy) {
+							const v3pos_t to = rel + dir + v3pos_t(0, dy, 0);
+							if (!box.isPointInside(to)) {
+								exits.emplace_back(base + to);
+								continue;
+							}
+							if (nav->getRegion(to) != PathNavBlock::REGION_NONE ||
+									!is_surface(to))
+								continue;
+							nav->region[PathNavBlock::index(to)] = region;
+							stack.push_back(to);
+						}
+					}
+				}
+			}
+
+	for (auto &exits : nav->exits) {
+		std::sort(exits.begin(), exits.end(), [](const v3pos_t &a, const v3pos_t &b) {
+			return std::tie(a.X, a.Y, a.Z) < std::tie(b.X, b.Y, b.Z);
+		});
+		exits.erase(std::unique(exits.begin(), exits.end()), exits.end());
+	}
+
+	++m_stats.nav_built;
+	return nav;
+}
+
+PathNavigator::nav_ptr PathNavigator::getNavBlock(
+		const v3bpos_t &bpos, uint8_t max_jump, uint8_t max_drop)
+{
+	const NavKey key{bpos, max_jump, max_drop};
+	uint64_t invalidated;
+	{
+		std::lock_guard<std::mutex> lock(m_cache_mutex);
+		auto it = m_nav_blocks.find(key);
+		if (it != m_nav_blocks.end()) {
+			m_nav_lru.splice(m_nav_lru.begin(), m_nav_lru, it->second.second);
+			return it->second.first;
+		}
+		invalidated = invalidations(bpos);
+	}
+
+	// Built without the lock, a concurrent build of the same block is harmless
+	auto built = buildNavBlock(bpos, max_jump, max_drop);
+	if (!built)
+		return {};
+
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	auto it = m_nav_blocks.find(key);
+	if (it != m_nav_blocks.end())
+		return it->second.first;
+	// The block was edited while building, good for this search only
+	if (invalidations(bpos) != invalidated)
+		return built;
+
+	auto nav = std::const_pointer_cast<PathNavBlock>(built);
+	nav->revision = ++m_revision;
+	m_nav_params.emplace(max_jump, max_drop);
+	m_nav_lru.push_front(key);
+	m_nav_blocks.emplace(key, std::make_pair(built, m_nav_lru.begin()));
+	if (m_nav_blocks.size() > NAV_CACHE_SIZE) {
+		m_nav_blocks.erase(m_nav_lru.back());
+		m_nav_lru.pop_back();
+	}
+	return built;
+}
+
+bool PathNavigator::findSurface(v3pos_t pos, unsigned int max_down, uint8_t max_jump,
+		uint8_t max_drop, v3bpos_t &bpos, PathNavBlock::region_t &region)
+{
+	for (unsigned int i = 0; i <= max_down; ++i, --pos.Y) {
+		bpos = getNodeBlockPos(pos);
+		const auto nav = getNavBlock(bpos, max_jump, max_drop);
+		if (!nav)
+			return false;
+		region = nav->getRegion(pos - getBlockPosRelative(bpos));
+		if (region != PathNavBlock::REGION_NONE)
+			return true;
+	}
+	return false;
+}
+
+PathNavigator::CorridorResult PathNavigator::searchCorridor(
+		const PathRequest &request, uint8_t max_jump, uint8_t max_drop,
+		std::vector<v3bpos_t> &corridor,
+		std::vector<std::pair<v3bpos_t, uint64_t>> &revisions)
+{
+	AbstractNode start, goal;
+	if (!findSurface(request.source, request.max_drop, max_jump, max_drop, start.pos,
+				start.region) ||
+			!findSurface(request.destination, request.max_jump, max_jump, max_drop,
+					goal.pos, goal.region))
+		return CorridorResult::unknown;
+
+	// Same limits as the node search, in blocks
+	const pos_t sd = request.searchdistance;
+	const v3pos_t pmin(std::min(request.source.X, request.destination.X) - sd,
+			std::min(request.source.Y, request.destination.Y) - sd,
+			std::min(request.source.Z, request.destination.Z) - sd);
+	const v3pos_t pmax(std::max(request.source.X, request.destination.X) + sd,
+			std::max(request.source.Y, request.destination.Y) + sd,
+			std::max(request.source.Z, request.destination.Z) + sd);
+	const core::aabbox3d<bpos_t> limits(getNodeBlockPos(pmin), getNodeBlockPos(pmax));
+
+	std::unordered_map<AbstractNode, AbstractInfo, AbstractNodeHash> visited;
+	using open_t = std::pair<int, AbstractNode>;
+	const auto compare = [](const open_t &a, const open_t &b) {
+		return a.first > b.first;
+	};
+	std::priority_queue<open_t, std::vector<open_t>, decltype(compare)> open(compare);
+
+	visited[start] = {0, start, false};
+	open.emplace(block_distance(start.pos, goal.pos), start);
+
+	size_t expanded = 0;
+	bool found = false;
+	std::vector<AbstractNode> neighbours;
+	while (!open.empty()) {
+		const auto current = open.top().second;
+		open.pop();
+		auto &info = visited[current];
+		if (info.closed)
+			continue;
+		info.closed = true;
+		if (current == goal) {
+			found = true;
+			break;
+		}
+		if (++expanded > CORRIDOR_MAX_EXPAND)
+			return CorridorResult::unknown;
+
+		const auto nav = getNavBlock(current.pos, max_jump, max_drop);
+		if (!nav)
+			continue;
+
+		neighbours.clear();
+		for (const auto &exit : nav->exits[current.region - 1]) {
+			const auto bpos = getNodeBlockPos(exit);
+			if (!limits.isPointInside(bpos))
+				continue;
+			const auto next_nav = getNavBlock(bpos, max_jump, max_drop);
+			if (!next_nav)
+				continue;
+			const auto region = next_nav->getRegion(exit - getBlockPosRelative(bpos));
+			if (region == PathNavBlock::REGION_NONE)
+				continue;
+			const AbstractNode next{bpos, region};
+			if (std::find(neighbours.begin(), neighbours.end(), next) == neighbours.end())
+				neighbours.push_back(next);
+		}
+
+		const int cost = info.cost + MAP_BLOCKSIZE;
+		const auto parent = current;
+		for (const auto &next : neighbours) {
+			auto it = visited.find(next);
+			if (it != visited.end() && (it->second.closed || it->second.cost <= cost))
+				continue;
+			visited[next] = {cost, parent, false};
+			open.emplace(cost + block_distance(next.pos, goal.pos), next);
+		}
+	}
+
+	// The block graph is a superset of the node graph, so the node
+	// search would not find anything either
+	if (!found)
+		return CorridorResult::no_path;
+
+	for (auto node = goal;; node = visited[node].parent) {
+		if (std::find(corridor.begin(), corridor.end(), node.pos) == corridor.end())
+			corridor.push_back(node.pos);
+		if (node == start)
+			break;
+	}
+
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	for (const auto &bpos : corridor) {
+		auto it = m_nav_blocks.find({bpos, max_jump, max_drop});
+		revisions.emplace_back(
+				bpos, it == m_nav_blocks.end() ? 0 : it->second.first->revision);
+	}
+	return CorridorResult::found;
+}
+
+PathNavigator::CorridorResult PathNavigator::getCorridor(
+		const PathRequest &request, std::vector<v3bpos_t> &corridor)
+{
+	const uint8_t max_jump = std::min(request.max_jump, NAV_MAX_STEP);
+	const uint8_t max_drop = std::min(request.max_drop, NAV_MAX_STEP);
+	const CorridorKey key{getNodeBlockPos(request.source),
+			getNodeBlockPos(request.destination), max_jump, max_drop};
+
+	{
+		std::lock_guard<std::mutex> lock(m_cache_mutex);
+		auto it = m_corridors.find(key);
+		if (it != m_corridors.end()) {
+			bool valid = true;
+			for (const auto &[bpos, revision] : it->second.first.blocks) {
+				auto nav = m_nav_blocks.find({bpos, max_jump, max_drop});
+				if (nav == m_nav_blocks.end() ||
+						nav->second.first->revision != revision) {
+					valid = false;
+					break;
+				}
+			}
+			if (valid) {
+				++m_stats.corridor_hits;
+				m_corridor_lru.splice(
+						m_corridor_lru.begin(), m_corridor_lru, it->second.second);
+				corridor.clear();
+				for (const auto &block : it->second.first.blocks)
+					corridor.push_back(block.first);
+				return CorridorResult::found;
+			}
+			m_corridor_lru.erase(it->second.second);
+			m_corridors.erase(it);
+		}
+	}
+	++m_stats.corridor_misses;
+
+	Corridor found;
+	corridor.clear();
+	const auto result =
+			searchCorridor(request, max_jump, max_drop, corridor, found.blocks);
+	if (result != CorridorResult::found)
+		return result;
+
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	if (!m_corridors.count(key)) {
+		m_corridor_lru.push_front(key);
+		m_corridors.emplace(key, std::make_pair(std::move(found), m_corridor_lru.begin()));
+		if (m_corridors.size() > CORRIDOR_CACHE_SIZE) {
+			m_corridors.erase(m_corridor_lru.back());
+			m_corridor_lru.pop_back();
+		}
+	}
+	return result;
+}
+
+PathNavigator::path_t PathNavigator::getPath(const PathRequest &request)
+{
+	// The block graph must not be more restrictive than the node search
+	if (request.algo != PA_HIERARCHICAL || request.max_jump > NAV_MAX_STEP ||
+			request.max_drop > NAV_MAX_STEP)
+		return get_path(m_map, m_ndef, request.source, request.destination,
+				request.searchdistance, request.max_jump, request.max_drop,
+				request.algo == PA_HIERARCHICAL ? PA_PLAIN_NP : request.algo);
+
+	std::vector<v3bpos_t> corridor;
+	switch (getCorridor(request, corridor)) {
+	case CorridorResult::no_path:
+		return {};
+	case CorridorResult::found: {
+		// Surface crossing a block border up or down can leave the blocks
+		// of the region path for a while
+		unordered_set_v3bpos blocks;
+		for (const auto &bpos : corridor)
+			for (bpos_t dy = -1; dy <= 1; ++dy)
+				blocks.emplace(bpos + v3bpos_t(0, dy, 0));
+		auto path = get_path(m_map, m_ndef, request.source, request.destination,
+				request.searchdistance, request.max_jump, request.max_drop,
+				PA_HIERARCHICAL, &blocks);
+		if (!path.empty())
+			return path;
+		break;
+	}
+	case CorridorResult::unknown:
+		break;
+	}
+
+	// Head room or unloaded blocks can make the corridor unusable
+	++m_stats.fallbacks;
+	g_profiler->add("Server: Pathfinder fallbacks", 1);
+	return get_path(m_map, m_ndef, request.source, request.destination,
+			request.searchdistance, request.max_jump, request.max_drop, PA_PLAIN_NP);
+}
+
+void PathNavigator::queuePath(const PathRequest &request, callback_t callback)
+{
+	std::call_once(m_pool_started, [this] {
+		if (m_threads && !m_cancelled)
+			m_pool = std::make_unique<progschj::ThreadPool>(m_threads);
+	});
+	if (!m_pool) {
+		auto path = getPath(request);
+		std::lock_guard<std::mutex> lock(m_results_mutex);
+		m_results.emplace_back(std::move(callback), std::move(path));
+		return;
+	}
+
+	m_pool->enqueue([this, request, callback = std::move(callback)]() mutable {
+		path_t path;
+		try {
+			// Requests still queued on cancel() are not searched
+			if (!m_cancelled)
+				path = getPath(request);
+		} catch (const std::exception &e) {
+			errorstream << "Pathfinder: async request failed: " << e.what()
+						<< std::endl;
+		}
+		std::lock_guard<std::mutex> lock(m_results_mutex);
+		m_results.emplace_back(std::move(callback), std::move(path));
+	});
+}
+
+size_t PathNavigator::deliverResults()
+{
+	decltype(m_results) results;
+	{
+		std::lock_guard<std::mutex> lock(m_results_mutex);
+		results.swap(m_results);
+	}
+	for (auto &[callback, path] : results)
+		callback(std::move(path), false);
+	return results.size();
+}
+
+void PathNavigator::cancel()
+{
+	m_cancelled = true;
+	// Waits for the workers, the rest of the queue is skipped
+	m_pool.reset();
+	decltype(m_results) results;
+	{
+		std::lock_guard<std::mutex> lock(m_results_mutex);
+		results.swap(m_results);
+	}
+	for (auto &[callback, path] : results)
+		callback({}, true);
+}
+
+void PathNavigator::invalidateBlock(const v3bpos_t &bpos)
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	// Surface of the block above depends on the top layer of this one
+	for (const auto &pos : {bpos, bpos + v3bpos_t(0, 1, 0)}) {
+		++invalidations(pos);
+		for (const auto &[max_jump, max_drop] : m_nav_params) {
+			auto it = m_nav_blocks.find({pos, max_jump, max_drop});
+			if (it == m_nav_blocks.end())
+				continue;
+			m_nav_lru.erase(it->second.second);
+			m_nav_blocks.erase(it);
+		}
+	}
+}
+
+void PathNavigator::onMapEditEvent(const MapEditEvent &event)
+{
+	for (const auto &bpos : event.modified_blocks)
+		invalidateBlock(bpos);
+}
+
+void PathNavigator::clear()
+{
+	std::lock_guard<std::mutex> lock(m_cache_mutex);
+	m_nav_blocks.clear();
+	m_nav_lru.clear();
+	for (auto &count : m_invalidations)
+		++count;
+	m_corridors.clear();
+	m_corridor_lru.clear();
+	m_nav_params.clear();
+}
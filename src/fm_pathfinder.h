@@ -0,0 +1,231 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "constants.h"
+#include "irr_v3d.h"
+#include "map.h"
+#include "pathfinder.h"
+#include "util/basic_macros.h"
+#include "util/unordered_map_hash.h"
+
+class NodeDefManager;
+namespace progschj
+{
+class ThreadPool;
+}
+
+struct PathRequest
+{
+	v3pos_t source;
+	v3pos_t destination;
+	unsigned int searchdistance{};
+	unsigned int max_jump{};
+	unsigned int max_drop{};
+	PathAlgorithm algo{PA_HIERARCHICAL};
+};
+
+/*
+	Walkable surface of one MapBlock for given jump/drop limits.
+
+	Surface nodes (not walkable, with a walkable node below) are grouped into
+	regions that are connected by moves inside the block. Moves leaving the
+	block are kept as exits, so regions of neighbouring blocks can be linked
+	without reading the block again.
+	The graph is optimistic: head room is not checked, the node level search
+	in the found corridor is authoritative.
+*/
+struct PathNavBlock
+{
+	using region_t = uint8_t;
+	static constexpr region_t REGION_NONE = 0;
+	static constexpr region_t REGION_MAX = 255;
+
+	// Number of the cache generation this block was built in
+	uint64_t revision{};
+	region_t regions_count{};
+	std::array<region_t, MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE> region{};
+	// Surface nodes outside of the block reachable from region i + 1
+	std::vector<std::vector<v3pos_t>> exits;
+
+	static size_t index(const v3pos_t &rel)
+	{
+		return (rel.Z * MAP_BLOCKSIZE + rel.Y) * MAP_BLOCKSIZE + rel.X;
+	}
+	region_t getRegion(const v3pos_t &rel) const { return region[index(rel)]; }
+};
+
+/*
+	Hierarchical pathfinder with cached block navigation data.
+
+	Paths are searched on the graph of block regions first, the node level
+	A* then only looks at the blocks of the found corridor. Navigation data
+	and corridors are cached and dropped when the map reports changed blocks.
+*/
+class PathNavigator : public MapEventReceiver
+{
+public:
+	using path_t = std::vector<v3pos_t>;
+	// cancelled is set when the request was dropped by cancel()
+	using callback_t = std::function<void(path_t &&path, bool cancelled)>;
+
+	PathNavigator(Map *map, const NodeDefManager *ndef, size_t threads = 1);
+	~PathNavigator();
+	DISABLE_CLASS_COPY(PathNavigator);
+
+	// Find a path, may be called from any thread
+	path_t getPath(const PathRequest &request);
+
+	// Find a path on the worker pool, callback is called from deliverResults()
+	// The pool is started by the first request
+	void queuePath(const PathRequest &request, callback_t callback);
+
+	// Run callbacks of finished async requests, returns number of callbacks
+	size_t deliverResults();
+
+	// Stop the workers and call back all pending requests as cancelled,
+	// later requests are searched synchronously
+	void cancel();
+
+	void onMapEditEvent(const MapEditEvent &event) override;
+	void invalidateBlock(const v3bpos_t &bpos);
+	void clear();
+
+	struct Stats
+	{
+		std::atomic_size_t nav_built{};
+		std::atomic_size_t corridor_hits{};
+		std::atomic_size_t corridor_misses{};
+		std::atomic_size_t fallbacks{};
+	};
+	const Stats &getStats() const { return m_stats; }
+
+	enum class CorridorResult
+	{
+		found,
+		// No path exists inside the search distance
+		no_path,
+		// Search gave up, the node level search has to decide
+		unknown,
+	};
+
+	// Find the blocks a path between source and destination has to go through
+	CorridorResult getCorridor(
+			const PathRequest &request, std::vector<v3bpos_t> &corridor);
+
+private:
+	struct NavKey
+	{
+		v3bpos_t pos;
+		uint8_t max_jump;
+		uint8_t max_drop;
+		bool operator==(const NavKey &other) const
+		{
+			return pos == other.pos && max_jump == other.max_jump &&
+				   max_drop == other.max_drop;
+		}
+	};
+	struct NavKeyHash
+	{
+		size_t operator()(const NavKey &k) const
+		{
+			return v3bposHash()(k.pos) ^ (size_t(k.max_jump) << 24) ^
+				   (size_t(k.max_drop) << 16);
+		}
+	};
+	struct CorridorKey
+	{
+		v3bpos_t source;
+		v3bpos_t destination;
+		uint8_t max_jump;
+		uint8_t max_drop;
+		bool operator==(const CorridorKey &other) const
+		{
+			return source == other.source && destination == other.destination &&
+				   max_jump == other.max_jump && max_drop == other.max_drop;
+		}
+	};
+	struct CorridorKeyHash
+	{
+		size_t operator()(const CorridorKey &k) const
+		{
+			return v3bposHash()(k.source) ^ (v3bposHash()(k.destination) << 7) ^
+				   (size_t(k.max_jump) << 24) ^ (size_t(k.max_drop) << 16);
+		}
+	};
+	struct Corridor
+	{
+		// Blocks with the revision of their navigation data
+		std::vector<std::pair<v3bpos_t, uint64_t>> blocks;
+	};
+
+	using nav_ptr = std::shared_ptr<const PathNavBlock>;
+
+	nav_ptr getNavBlock(const v3bpos_t &bpos, uint8_t max_jump, uint8_t max_drop);
+	nav_ptr buildNavBlock(const v3bpos_t &bpos, uint8_t max_jump, uint8_t max_drop);
+	CorridorResult searchCorridor(const PathRequest &request, uint8_t max_jump,
+			uint8_t max_drop, std::vector<v3bpos_t> &corridor,
+			std::vector<std::pair<v3bpos_t, uint64_t>> &revisions);
+	bool findSurface(v3pos_t pos, unsigned int max_down, uint8_t max_jump,
+			uint8_t max_drop, v3bpos_t &bpos, PathNavBlock::region_t &region);
+
+	Map *m_map;
+	const NodeDefManager *m_ndef;
+
+	std::mutex m_cache_mutex;
+	uint64_t m_revision{};
+	// LRU of navigation blocks, most recent first
+	std::list<NavKey> m_nav_lru;
+	std::unordered_map<NavKey, std::pair<nav_ptr, std::list<NavKey>::iterator>,
+			NavKeyHash>
+			m_nav_blocks;
+	// Jump/drop limits navigation blocks were built for
+	std::set<std::pair<uint8_t, uint8_t>> m_nav_params;
+	// Invalidation count of blocks by hash of the position, a navigation
+	// block built while its count changed is outdated and not cached
+	std::array<uint64_t, 1024> m_invalidations{};
+	uint64_t &invalidations(const v3bpos_t &bpos)
+	{
+		return m_invalidations[v3bposHash()(bpos) % m_invalidations.size()];
+	}
+	std::list<CorridorKey> m_corridor_lru;
+	std::unordered_map<CorridorKey,
+			std::pair<Corridor, std::list<CorridorKey>::iterator>, CorridorKeyHash>
+			m_corridors;
+
+	size_t m_threads;
+	std::once_flag m_pool_started;
+	std::atomic_bool m_cancelled{false};
+	std::unique_ptr<progschj::ThreadPool> m_pool;
+	std::mutex m_results_mutex;
+	std::deque<std::pair<callback_t, path_t>> m_results;
+
+	Stats m_stats;
+};
@@ -679,13 +679,23 @@ MapDatabase *GetFarDatabase(MapDatabase *dbase, ServerMap::far_dbases_t &far_dba
 
 MapBlockPtr loadBlockNoStore(Map *smap, MapDatabase *dbase, const v3bpos_t &bpos)
 {
+	std::string blob;
 	try {
-		MapBlockPtr block{smap->createBlankBlockNoInsert(bpos)};
-		std::string blob;
 		dbase->loadBlock(bpos, &blob);
+	} catch (const std::exception &ex) {
+		errorstream << "Block load fail " << bpos << " : " << ex.what() << "\n";
+		return {};
+	}
+	return loadBlockNoStore(smap, bpos, blob);
+}
+
+MapBlockPtr loadBlockNoStore(Map *smap, const v3bpos_t &bpos, const std::string &blob)
+{
+	try {
 		if (!blob.length()) {
 			return {};
 		}
+		MapBlockPtr block{smap->createBlankBlockNoInsert(bpos)};
 
 		std::istringstream is(blob, std::ios_base::binary);
 
@@ -840,6 +850,8 @@ void *WorldMergeThread::run()
 		g_settings->getU32NoEx("world_merge_max_clients", merger.world_merge_max_clients);
 		g_settings->getU32NoEx("world_merge_lazy_up", merger.lazy_up);
 		g_settings->getU32NoEx("farlights", merger.farlights);
+		merger.threads = 0;
+		g_settings->getU32NoEx("world_merge_threads", merger.threads);
 
 		{
 			merger.world_merge_load_all = -1;
@@ -19,12 +19,15 @@ You should have received a copy of the GNU General Public License
 along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "fm_pathfinder.h"
+#include "gamedef.h"
 #include "irr_v3d.h"
 #include "map.h"
 #include "porting.h"
 #include "scripting_server.h"
 #include "serverenvironment.h"
 #include "servermap.h"
+#include "settings.h"
 #include "util/timetaker.h"
 
 size_t ServerEnvironment::blockStep(MapBlockPtr block, float dtime_s, uint8_t activate)
@@ -147,3 +150,19 @@ size_t ServerEnvironment::nodeUpdate(
 	m_nodeupdate_queue.emplace_back(pos, recursion_limit, fast, destroy);
 	return 0;
 }
+
+PathNavigator &ServerEnvironment::getPathNavigator()
+{
+	if (!m_path_navigator) {
+		m_path_navigator = std::make_unique<PathNavigator>(m_map.get(),
+				m_gamedef->ndef(), g_settings->getU16("pathfinder_threads"));
+		m_map->addEventReceiver(m_path_navigator.get());
+	}
+	return *m_path_navigator;
+}
+
+void ServerEnvironment::cancelPathRequests()
+{
+	if (m_path_navigator)
+		m_path_navigator->cancel();
+}
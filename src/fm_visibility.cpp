@@ -0,0 +1,154 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_visibility.h"
+#include <cstdlib>
+#include <deque>
+
+namespace
+{
+const v3bpos_t face_dirs[6] = {
+		{-1, 0, 0},
+		{1, 0, 0},
+		{0, -1, 0},
+		{0, 1, 0},
+		{0, 0, -1},
+		{0, 0, 1},
+};
+
+constexpr uint8_t opposite_face(uint8_t face)
+{
+	return face ^ 1;
+}
+}
+
+face_connectivity_t face_connectivity(const std::vector<uint8_t> &opaque, uint16_t side)
+{
+	const size_t volume = static_cast<size_t>(side) * side * side;
+	face_connectivity_t result = 0;
+	std::vector<uint8_t> visited(volume, 0);
+	std::vector<uint32_t> stack;
+	const uint32_t stride_y = side;
+	const uint32_t stride_z = static_cast<uint32_t>(side) * side;
+
+	for (uint32_t start = 0; start < volume && result != FACES_ALL_CONNECTED; ++start) {
+		if (opaque[start] || visited[start])
+			continue;
+
+		// Faces touched by this open region
+		uint8_t faces = 0;
+		visited[start] = 1;
+		stack.push_back(start);
+		while (!stack.empty()) {
+			const uint32_t i = stack.back();
+			stack.pop_back();
+			const uint16_t x = i % side;
+			const uint16_t y = (i / stride_y) % side;
+			const uint16_t z = i / stride_z;
+
+			const auto visit = [&](uint32_t n) {
+				if (!opaque[n] && !visited[n]) {
+					visited[n] = 1;
+					stack.push_back(n);
+				}
+			};
+			if (x == 0)
+				faces |= 1 << 0;
+			else
+				visit(i - 1);
+			if (x == side - 1)
+				faces |= 1 << 1;
+			else
+				visit(i + 1);
+			if (y == 0)
+				faces |= 1 << 2;
+			else
+				visit(i - stride_y);
+			if (y == side - 1)
+				faces |= 1 << 3;
+			else
+				visit(i + stride_y);
+			if (z == 0)
+				faces |= 1 << 4;
+			else
+				visit(i - stride_z);
+			if (z == side - 1)
+				faces |= 1 << 5;
+			else
+				visit(i + stride_z);
+		}
+
+		for (uint8_t a = 0; a < 6; ++a) {
+			if (!(faces & (1 << a)))
+				continue;
+			for (uint8_t b = a + 1; b < 6; ++b)
+				if (faces & (1 << b))
+					result |= 1 << faces_pair_bit(a, b);
+		}
+	}
+	return result;
+}
+
+void visible_cells(const v3bpos_t &camera_cell, bpos_t step, bpos_t range,
+		const std::function<face_connectivity_t(const v3bpos_t &)> &connectivity,
+		unordered_set_v3bpos &visible)
+{
+	struct Item
+	{
+		v3bpos_t pos;
+		// Face the view came in through
+		uint8_t from;
+		// Directions taken from the camera
+		uint8_t dirs;
+	};
+	std::deque<Item> queue;
+	// Faces a cell was entered through, a cell may pass more views through
+	// another face
+	unordered_map_v3bpos<uint8_t> entered;
+
+	visible.emplace(camera_cell);
+	const auto push = [&](const v3bpos_t &pos, uint8_t face, uint8_t dirs) {
+		const auto next = pos + face_dirs[face] * step;
+		const auto offset = (next - camera_cell) / step;
+		if (std::abs(offset.X) > range || std::abs(offset.Y) > range ||
+				std::abs(offset.Z) > range)
+			return;
+		const uint8_t from = opposite_face(face);
+		auto &faces = entered[next];
+		if (faces & (1 << from))
+			return;
+		faces |= 1 << from;
+		visible.emplace(next);
+		queue.push_back({next, from, static_cast<uint8_t>(dirs | (1 << face))});
+	};
+
+	for (uint8_t face = 0; face < 6; ++face)
+		push(camera_cell, face, 0);
+
+	while (!queue.empty()) {
+		const auto item = queue.front();
+		queue.pop_front();
+		const auto cell_connectivity = connectivity(item.pos);
+		for (uint8_t face = 0; face < 6; ++face) {
+			if (item.dirs & (1 << opposite_face(face)))
+				continue;
+			if (!faces_connected(cell_connectivity, item.from, face))
+				continue;
+			push(item.pos, face, item.dirs);
+		}
+	}
+}
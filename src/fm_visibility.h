@@ -0,0 +1,66 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "irr_v3d.h"
+#include "util/unordered_map_hash.h"
+
+/*
+	Visibility graph of mesh cells for cave culling.
+
+	Faces are numbered like solid_sides: -X +X -Y +Y -Z +Z. A cell keeps
+	one bit for each pair of faces joined by non-opaque nodes inside it.
+	A view can pass from one face to another only when they are joined.
+*/
+using face_connectivity_t = uint16_t;
+
+// Cell with unknown content, every view passes
+constexpr face_connectivity_t FACES_ALL_CONNECTED = 0x7fff;
+
+constexpr uint8_t faces_pair_bit(uint8_t a, uint8_t b)
+{
+	if (a > b) {
+		const auto c = a;
+		a = b;
+		b = c;
+	}
+	return a * (11 - a) / 2 + b - a - 1;
+}
+
+constexpr bool faces_connected(face_connectivity_t connectivity, uint8_t a, uint8_t b)
+{
+	return a == b || (connectivity >> faces_pair_bit(a, b)) & 1;
+}
+
+/*
+	Flood fill the non-opaque nodes of a cube, opaque holds side^3 values,
+	x fastest, non zero for opaque nodes.
+*/
+face_connectivity_t face_connectivity(const std::vector<uint8_t> &opaque, uint16_t side);
+
+/*
+	Cells seen from the camera cell, walking only through joined faces and
+	never back toward the camera. Cells are step blocks apart, range is in
+	cells. connectivity returns FACES_ALL_CONNECTED for an unknown cell.
+*/
+void visible_cells(const v3bpos_t &camera_cell, bpos_t step, bpos_t range,
+		const std::function<face_connectivity_t(const v3bpos_t &)> &connectivity,
+		unordered_set_v3bpos &visible);
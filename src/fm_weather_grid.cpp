@@ -0,0 +1,479 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_weather_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include "constants.h"
+#include "mapblock.h"
+#include "porting.h"
+#include "util/numeric.h"
+
+namespace
+{
+float clamp_weather_float(float value, float min_value, float max_value)
+{
+	return std::max(min_value, std::min(max_value, value));
+}
+
+template <typename AtomicValue>
+void store_weather_split(
+		AtomicValue &base_ref, AtomicValue &add_ref, float total, float min_value, float max_value)
+{
+	total = clamp_weather_float(total, min_value, max_value);
+
+	float add = static_cast<float>(add_ref.load());
+	float base = total - add;
+	if (base < min_value) {
+		base = min_value;
+		add = total - base;
+	} else if (base > max_value) {
+		base = max_value;
+		add = total - base;
+	}
+
+	const auto base_i = static_cast<short>(std::lround(base));
+	base_ref = base_i;
+	add_ref = static_cast<short>(std::lround(total - static_cast<float>(base_i)));
+}
+
+// Sums over the neighbours of a cell, absent ones have weight 0
+struct stencil_sums
+{
+	float heat_diffusion = 0.0f;
+	float heat_weights = 0.0f;
+	float humidity_diffusion = 0.0f;
+	float humidity_weights = 0.0f;
+	float heat_advection = 0.0f;
+	float humidity_advection = 0.0f;
+	float neighbors = 0.0f;
+
+	inline void add(float weight, float heat_delta, float humidity_delta,
+			float heat_weight, float humidity_weight, float inflow)
+	{
+		heat_weight *= weight;
+		humidity_weight *= weight;
+		inflow *= weight;
+		heat_diffusion += heat_delta * heat_weight;
+		heat_weights += heat_weight;
+		humidity_diffusion += humidity_delta * humidity_weight;
+		humidity_weights += humidity_weight;
+		heat_advection += heat_delta * inflow;
+		humidity_advection += humidity_delta * inflow;
+		neighbors += weight;
+	}
+};
+}
+
+WeatherGrid::WeatherGrid() = default;
+
+WeatherGrid::~WeatherGrid() = default;
+
+float WeatherGrid::pressure(float heat, float humidity, pos_t y)
+{
+	// Approximate low pressure from warm/humid air and lower pressure at altitude.
+	return -heat - humidity * 0.25f - static_cast<float>(y) * 0.02f;
+}
+
+weather::wind_t WeatherGrid::limitWind(weather::wind_t wind)
+{
+	constexpr float max_wind = 8.0f;
+	if (!std::isfinite(wind.X) || !std::isfinite(wind.Y) || !std::isfinite(wind.Z))
+		return {};
+	const float length = wind.getLength();
+	if (length > max_wind && length > 0.0001f)
+		wind *= max_wind / length;
+	return wind;
+}
+
+size_t WeatherGrid::cell(size_t block)
+{
+	return cell(block % REGION_SIZE + 1, block / REGION_SIZE % REGION_SIZE + 1,
+			block / REGION_SIZE / REGION_SIZE + 1);
+}
+
+v3bpos_t WeatherGrid::regionPos(const v3bpos_t &pos)
+{
+	return v3bpos_t(getContainerPos(pos.X, REGION_SIZE), getContainerPos(pos.Y, REGION_SIZE),
+			getContainerPos(pos.Z, REGION_SIZE));
+}
+
+size_t WeatherGrid::blockIndex(const v3bpos_t &pos)
+{
+	const v3bpos_t rel = pos - regionPos(pos) * REGION_SIZE;
+	return (rel.Z * REGION_SIZE + rel.Y) * REGION_SIZE + rel.X;
+}
+
+void WeatherGrid::add(const MapBlockPtr &block)
+{
+	if (!m_enabled || !block)
+		return;
+	const std::lock_guard lock(m_pending_mutex);
+	m_pending.emplace_back(block, true);
+}
+
+void WeatherGrid::remove(const MapBlockPtr &block)
+{
+	if (!m_enabled || !block)
+		return;
+	const std::lock_guard lock(m_pending_mutex);
+	m_pending.emplace_back(block, false);
+}
+
+void WeatherGrid::enable()
+{
+	m_enabled = true;
+}
+
+void WeatherGrid::disable()
+{
+	m_enabled = false;
+	{
+		const std::lock_guard lock(m_pending_mutex);
+		m_pending.clear();
+	}
+	m_regions.clear();
+	m_index.clear();
+}
+
+size_t WeatherGrid::getBlocks()
+{
+	applyPending();
+	size_t blocks = 0;
+	for (const auto &region : m_regions)
+		blocks += region->count;
+	return blocks;
+}
+
+size_t WeatherGrid::getRegions()
+{
+	applyPending();
+	size_t regions = 0;
+	for (const auto &region : m_regions)
+		regions += region->count != 0;
+	return regions;
+}
+
+void WeatherGrid::applyPending()
+{
+	std::vector<std::pair<MapBlockPtr, bool>> pending;
+	{
+		const std::lock_guard lock(m_pending_mutex);
+		pending.swap(m_pending);
+	}
+	for (const auto &[block, added] : pending) {
+		if (added)
+			insert(block);
+		else
+			erase(block);
+	}
+}
+
+void WeatherGrid::insert(const MapBlockPtr &block)
+{
+	const v3bpos_t pos = block->getPos();
+	const v3bpos_t region_pos = regionPos(pos);
+	auto found = m_index.find(region_pos);
+	if (found == m_index.end()) {
+		found = m_index.emplace(region_pos, m_regions.size()).first;
+		m_regions.emplace_back(std::make_unique<Region>());
+		m_regions.back()->pos = region_pos;
+	}
+	Region &region = *m_regions[found->second];
+	const size_t index = blockIndex(pos);
+	if (!region.blocks[index])
+		++region.count;
+	region.blocks[index] = block;
+	region.known[index] = false;
+	region.present[cell(index)] = 0.0f;
+}
+
+void WeatherGrid::erase(const MapBlockPtr &block)
+{
+	const v3bpos_t pos = block->getPos();
+	const auto found = m_index.find(regionPos(pos));
+	if (found == m_index.end())
+		return;
+	Region &region = *m_regions[found->second];
+	const size_t index = blockIndex(pos);
+	// Replaced by a block loaded again
+	if (region.blocks[index] != block)
+		return;
+	region.blocks[index].reset();
+	region.known[index] = false;
+	region.present[cell(index)] = 0.0f;
+	--region.count;
+}
+
+void WeatherGrid::dropEmpty()
+{
+	for (size_t i = 0; i < m_regions.size();) {
+		if (m_regions[i]->count) {
+			++i;
+			continue;
+		}
+		m_index.erase(m_regions[i]->pos);
+		const size_t last = m_regions.size() - 1;
+		if (i != last) {
+			m_index[m_regions[last]->pos] = i;
+			m_regions[i] = std::move(m_regions[last]);
+		}
+		m_regions.pop_back();
+	}
+}
+
+bool WeatherGrid::read(Region &region)
+{
+	bool any = false;
+	for (size_t index = 0; index < BLOCKS; ++index) {
+		const size_t c = cell(index);
+		const auto &block = region.blocks[index];
+		if (!block || !block->isGenerated()) {
+			region.present[c] = 0.0f;
+			continue;
+		}
+		const auto block_lock = block->try_lock_shared_rec();
+		if (block_lock->owns_lock()) {
+			region.heat[c] = block->heat + block->heat_add;
+			region.humidity[c] = block->humidity + block->humidity_add;
+			region.wind_x[c] = block->wind.X;
+			region.wind_y[c] = block->wind.Y;
+			region.wind_z[c] = block->wind.Z;
+			region.pressure[c] = pressure(region.heat[c], region.humidity[c],
+					(region.pos.Y * REGION_SIZE + index / REGION_SIZE % REGION_SIZE) *
+							MAP_BLOCKSIZE);
+			region.known[index] = true;
+		}
+		// Busy block, the values read last stay
+		region.present[c] = region.known[index] ? 1.0f : 0.0f;
+		any = any || region.known[index];
+	}
+	return any;
+}
+
+bool WeatherGrid::readOnce(Region &region)
+{
+	if (region.pass != m_pass) {
+		region.pass = m_pass;
+		region.any = read(region);
+	}
+	return region.any;
+}
+
+void WeatherGrid::readBorder(Region &region)
+{
+	for (int axis = 0; axis < 3; ++axis)
+		for (int side = 0; side < 2; ++side) {
+			v3bpos_t neighbor_pos = region.pos;
+			neighbor_pos[axis] += side ? 1 : -1;
+			const auto found = m_index.find(neighbor_pos);
+			Region *neighbor =
+					found == m_index.end() ? nullptr : m_regions[found->second].get();
+			if (neighbor)
+				readOnce(*neighbor);
+			const pos_t border = side ? SIDE - 1 : 0;
+			const pos_t source = side ? 1 : REGION_SIZE;
+			for (pos_t v = 1; v <= REGION_SIZE; ++v)
+				for (pos_t u = 1; u <= REGION_SIZE; ++u) {
+					v3pos_t to(u, v, 0), from(u, v, 0);
+					if (axis == 0) {
+						to = v3pos_t(border, u, v);
+						from = v3pos_t(source, u, v);
+					} else if (axis == 1) {
+						to = v3pos_t(u, border, v);
+						from = v3pos_t(u, source, v);
+					} else {
+						to.Z = border;
+						from.Z = source;
+					}
+					const size_t t = cell(to.X, to.Y, to.Z);
+					if (!neighbor) {
+						region.present[t] = 0.0f;
+						continue;
+					}
+					const size_t f = cell(from.X, from.Y, from.Z);
+					region.heat[t] = neighbor->heat[f];
+					region.humidity[t] = neighbor->humidity[f];
+					region.wind_x[t] = neighbor->wind_x[f];
+					region.wind_y[t] = neighbor->wind_y[f];
+					region.wind_z[t] = neighbor->wind_z[f];
+					region.pressure[t] = neighbor->pressure[f];
+					region.present[t] = neighbor->present[f];
+				}
+		}
+}
+
+size_t WeatherGrid::stepRegion(
+		Region &region, float dt, u32 next_update, const base_func &base)
+{
+	const v3bpos_t origin = region.pos * REGION_SIZE;
+	const auto block_pos = [&origin](size_t index) {
+		return origin + v3bpos_t(index % REGION_SIZE, index / REGION_SIZE % REGION_SIZE,
+								index / REGION_SIZE / REGION_SIZE);
+	};
+
+	// Mapgen climate, the only per block calls
+	std::array<float, BLOCKS> base_heat{}, base_humidity{}, base_wind_x{}, base_wind_z{},
+			base_wind{};
+	for (size_t index = 0; index < BLOCKS; ++index) {
+		if (!region.present[cell(index)])
+			continue;
+		base_t value;
+		base(block_pos(index), value);
+		base_heat[index] = value.heat;
+		base_humidity[index] = value.humidity;
+		if (value.has_wind) {
+			base_wind_x[index] = value.wind.X;
+			base_wind_z[index] = value.wind.Z;
+			base_wind[index] = 1.0f;
+		}
+	}
+
+	// Every cell at once, the ones without block are dropped below
+	std::array<float, BLOCKS> out_heat, out_humidity, out_wind_x, out_wind_y, out_wind_z;
+	const float *__restrict heat = region.heat.data();
+	const float *__restrict humidity = region.humidity.data();
+	const float *__restrict wind_x = region.wind_x.data();
+	const float *__restrict wind_y = region.wind_y.data();
+	const float *__restrict wind_z = region.wind_z.data();
+	const float *__restrict pressure = region.pressure.data();
+	const float *__restrict present = region.present.data();
+	constexpr size_t DX = 1, DY = SIDE, DZ = SIDE * SIDE;
+	const float wind_decay = std::exp(-0.08f * dt);
+	for (pos_t z = 1; z <= REGION_SIZE; ++z)
+		for (pos_t y = 1; y <= REGION_SIZE; ++y) {
+			const size_t row = cell(1, y, z);
+			const size_t out = ((z - 1) * REGION_SIZE + (y - 1)) * REGION_SIZE;
+			for (size_t x = 0; x < REGION_SIZE; ++x) {
+				const size_t c = row + x;
+				const float h = heat[c], m = humidity[c], p = pressure[c];
+				const float wx = wind_x[c], wy = wind_y[c], wz = wind_z[c];
+				stencil_sums sums;
+
+				// Horizontal neighbours, inflow is the wind blowing from them
+				sums.add(present[c + DX], heat[c + DX] - h, humidity[c + DX] - m, 1.0f,
+						1.0f, std::max(0.0f, -wx));
+				sums.add(present[c - DX], heat[c - DX] - h, humidity[c - DX] - m, 1.0f,
+						1.0f, std::max(0.0f, wx));
+				sums.add(present[c + DZ], heat[c + DZ] - h, humidity[c + DZ] - m, 1.0f,
+						1.0f, std::max(0.0f, -wz));
+				sums.add(present[c - DZ], heat[c - DZ] - h, humidity[c - DZ] - m, 1.0f,
+						1.0f, std::max(0.0f, wz));
+
+				// Heat is lost upward and gained from below, humidity the other way
+				const float up_heat = heat[c + DY] - h, up_humidity = humidity[c + DY] - m;
+				sums.add(present[c + DY], up_heat, up_humidity,
+						up_heat < 0.0f ? 1.8f : 0.35f, up_humidity > 0.0f ? 1.6f : 0.45f,
+						std::max(0.0f, -wy));
+				const float down_heat = heat[c - DY] - h,
+							down_humidity = humidity[c - DY] - m;
+				sums.add(present[c - DY], down_heat, down_humidity,
+						down_heat > 0.0f ? 1.8f : 0.35f, down_humidity < 0.0f ? 1.6f : 0.45f,
+						std::max(0.0f, wy));
+
+				const float gradient_x =
+						present[c + DX] * (pressure[c + DX] - p) -
+						present[c - DX] * (pressure[c - DX] - p);
+				const float gradient_y =
+						present[c + DY] * (pressure[c + DY] - p) -
+						present[c - DY] * (pressure[c - DY] - p);
+				const float gradient_z =
+						present[c + DZ] * (pressure[c + DZ] - p) -
+						present[c - DZ] * (pressure[c - DZ] - p);
+
+				// Sums are 0 without neighbours
+				const float per_neighbor = 1.0f / std::max(sums.neighbors, 1.0f);
+				const float heat_diffusion =
+						sums.heat_diffusion / std::max(sums.heat_weights, 1e-6f);
+				const float humidity_diffusion =
+						sums.humidity_diffusion / std::max(sums.humidity_weights, 1e-6f);
+
+				const size_t o = out + x;
+				const float pull = 0.015f * dt * per_neighbor;
+				float nwx = (wx - gradient_x * pull) * wind_decay;
+				const float nwy = (wy - gradient_y * pull) * wind_decay;
+				float nwz = (wz - gradient_z * pull) * wind_decay;
+				// Mapgen wind keeps the vertical part
+				nwx += base_wind[o] * 0.80f * (base_wind_x[o] - nwx);
+				nwz += base_wind[o] * 0.80f * (base_wind_z[o] - nwz);
+
+				float nh = h + heat_diffusion * (0.035f * dt) +
+						   sums.heat_advection * per_neighbor * (0.015f * dt);
+				float nm = m + humidity_diffusion * (0.055f * dt) +
+						   sums.humidity_advection * per_neighbor * (0.020f * dt);
+				nh += (base_heat[o] - nh) * (0.006f * dt);
+				nm += (base_humidity[o] - nm) * (0.006f * dt);
+
+				// Warm air can carry more water; cold blocks lose a little humidity.
+				nm += std::max(0.0f, nh - 25.0f) * (0.002f * dt);
+				nm -= std::max(0.0f, 5.0f - nh) * (0.003f * dt);
+
+				out_heat[o] = clamp_weather_float(nh, -100.0f, 100.0f);
+				out_humidity[o] = clamp_weather_float(nm, 0.0f, 100.0f);
+				out_wind_x[o] = nwx;
+				out_wind_y[o] = nwy;
+				out_wind_z[o] = nwz;
+			}
+		}
+
+	size_t active = 0;
+	for (size_t index = 0; index < BLOCKS; ++index) {
+		const size_t c = cell(index);
+		if (!region.present[c])
+			continue;
+		++active;
+		const auto &block = region.blocks[index];
+		const auto block_lock = block->try_lock_unique_rec();
+		if (!block_lock->owns_lock())
+			continue;
+
+		const weather::wind_t wind = limitWind(
+				{out_wind_x[index], out_wind_y[index], out_wind_z[index]});
+		store_weather_split(block->heat, block->heat_add, out_heat[index], -100.0f, 100.0f);
+		store_weather_split(
+				block->humidity, block->humidity_add, out_humidity[index], 0.0f, 100.0f);
+		block->wind = wind;
+		block->heat_last_update = next_update;
+		block->humidity_last_update = next_update;
+	}
+	return active;
+}
+
+size_t WeatherGrid::step(size_t cursor, float dt, uint64_t end_ms, u32 next_update,
+		const base_func &base, size_t &active)
+{
+	applyPending();
+	dt = clamp_weather_float(dt, 0.1f, 20.0f);
+	active = 0;
+	if (cursor >= m_regions.size())
+		cursor = 0;
+	if (!cursor) {
+		dropEmpty();
+		++m_pass;
+	}
+	while (cursor < m_regions.size()) {
+		Region &region = *m_regions[cursor++];
+		if (readOnce(region)) {
+			readBorder(region);
+			active += stepRegion(region, dt, next_update, base);
+		}
+		if (porting::getTimeMs() > end_ms)
+			break;
+	}
+	return cursor < m_regions.size() ? cursor : 0;
+}
@@ -0,0 +1,144 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "fm_weather.h"
+#include "irr_v3d.h"
+#include "irrlichttypes.h"
+#include "util/unordered_map_hash.h"
+
+class MapBlock;
+using MapBlockPtr = std::shared_ptr<MapBlock>;
+
+/*
+	Weather of the loaded blocks, stepped like a fluid on a grid.
+
+	Blocks are kept in dense regions of REGION_SIZE^3 blocks, each value in
+	its own array with a border of one cell for the neighbour values, so a
+	step is a few loops over contiguous floats. Blocks added or removed by
+	the map are queued and applied by the next step. Values are read from
+	the blocks once a pass over all regions, other code changes heat_add
+	and wind too. Stepped values go to the blocks only, so a region steps
+	from the values its neighbours had before the pass, whatever the order.
+*/
+class WeatherGrid
+{
+public:
+	static constexpr bpos_t REGION_SIZE = 8;
+
+	// Mapgen climate of a block the values relax to
+	struct base_t
+	{
+		float heat = 0.0f;
+		float humidity = 0.0f;
+		bool has_wind = false;
+		weather::wind_t wind;
+	};
+	using base_func = std::function<void(const v3bpos_t &pos, base_t &base)>;
+
+	WeatherGrid();
+	~WeatherGrid();
+
+	// Queued for the next step(), ignored while disabled
+	void add(const MapBlockPtr &block);
+	void remove(const MapBlockPtr &block);
+
+	bool isEnabled() const { return m_enabled; }
+	// Take add() and remove() from now on, add the loaded blocks after it
+	void enable();
+	// Forget all blocks
+	void disable();
+
+	size_t getBlocks();
+	size_t getRegions();
+
+	/*
+		Step regions from cursor until end_ms passes, for dt seconds.
+		next_update is stored as the last weather update of the blocks.
+		Returns the cursor to continue from, 0 after the last region.
+	*/
+	size_t step(size_t cursor, float dt, uint64_t end_ms, u32 next_update,
+			const base_func &base, size_t &active);
+
+	static float pressure(float heat, float humidity, pos_t y);
+	static weather::wind_t limitWind(weather::wind_t wind);
+
+private:
+	static constexpr pos_t SIDE = REGION_SIZE + 2;
+	static constexpr size_t VOLUME = SIDE * SIDE * SIDE;
+	static constexpr size_t BLOCKS = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+
+	struct Region
+	{
+		v3bpos_t pos;
+		size_t count = 0;
+		// Pass of the last read(), and what it returned
+		u32 pass = 0;
+		bool any = false;
+		std::array<MapBlockPtr, BLOCKS> blocks;
+		// Values were read from the block once
+		std::array<bool, BLOCKS> known{};
+		// Cells with the border, x fastest
+		alignas(32) std::array<float, VOLUME> heat{};
+		alignas(32) std::array<float, VOLUME> humidity{};
+		alignas(32) std::array<float, VOLUME> wind_x{};
+		alignas(32) std::array<float, VOLUME> wind_y{};
+		alignas(32) std::array<float, VOLUME> wind_z{};
+		alignas(32) std::array<float, VOLUME> pressure{};
+		// 1 for a block taking part in the step, 0 for none
+		alignas(32) std::array<float, VOLUME> present{};
+	};
+
+	static size_t cell(pos_t x, pos_t y, pos_t z) { return (z * SIDE + y) * SIDE + x; }
+	static size_t cell(size_t block);
+	static v3bpos_t regionPos(const v3bpos_t &pos);
+	static size_t blockIndex(const v3bpos_t &pos);
+
+	void applyPending();
+	void insert(const MapBlockPtr &block);
+	// An emptied region stays until dropEmpty(), a pass keeps its order
+	void erase(const MapBlockPtr &block);
+	// Called between passes only
+	void dropEmpty();
+	// Take the values of the blocks, false when none is generated
+	bool read(Region &region);
+	// read() once in the current pass
+	bool readOnce(Region &region);
+	// Neighbour regions are read first when they were not in this pass
+	void readBorder(Region &region);
+	// Returns the number of blocks stepped
+	size_t stepRegion(Region &region, float dt, u32 next_update, const base_func &base);
+
+	std::atomic_bool m_enabled{false};
+	std::mutex m_pending_mutex;
+	// Block, true for added
+	std::vector<std::pair<MapBlockPtr, bool>> m_pending;
+
+	std::vector<std::unique_ptr<Region>> m_regions;
+	unordered_map_v3bpos<size_t> m_index;
+	// Started by a step() from the first region
+	u32 m_pass = 0;
+};
@@ -29,7 +29,9 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <future>
 #include <limits>
 #include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include "constants.h"
 #include "database/database.h"
@@ -41,7 +43,9 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include "mapnode.h"
 #include "nodedef.h"
 #include "profiler.h"
+#include "serialization.h"
 #include "server.h"
+#include "servermap.h"
 #include "fm_world_merge.h"
 
 static video::SColor get_light_source_color(const ContentFeatures &cf)
@@ -66,18 +70,6 @@ static video::SColor get_light_source_color(const ContentFeatures &cf)
 	return video::SColor(255, 255, 255, 255);
 }
 
-static const auto load_block = [](Map *smap, MapDatabase *dbase,
-									   const v3bpos_t &pos) -> MapBlockPtr {
-	auto block = loadBlockNoStore(smap, dbase, pos);
-	if (!block) {
-		return {};
-	}
-	if (!block->isGenerated()) {
-		return {};
-	}
-	return block;
-};
-
 static int16_t average_climate(int64_t sum, size_t count)
 {
 	if (!count)
@@ -134,6 +126,80 @@ WorldMerger::~WorldMerger()
 WorldMerger::one_block_stat_t WorldMerger::merge_one_block(MapDatabase *dbase,
 		MapDatabase *dbase_up, const v3bpos_t &bpos_aligned, block_step_t step)
 {
+	std::vector<merge_job_t> jobs(1);
+	jobs.front().bpos_aligned = bpos_aligned;
+	read_jobs(dbase, dbase_up, jobs, step);
+	merge_job(jobs.front(), step);
+	write_jobs(dbase_up, jobs);
+	return jobs.front().stat;
+}
+
+void WorldMerger::read_jobs(MapDatabase *dbase, MapDatabase *dbase_up,
+		std::vector<merge_job_t> &jobs, block_step_t step)
+{
+	ScopeProfiler sp(g_profiler, "Server: World merge read");
+
+	const uint32_t time = get_time_func ? get_time_func() : 0;
+
+	// All children of the batch are read at once
+	std::vector<v3bpos_t> positions;
+	std::vector<std::string *> targets;
+	for (auto &job : jobs) {
+		job.time = time;
+		const auto &bpos_aligned = job.bpos_aligned;
+		size_t i = 0;
+		for (bpos_t x = 0; x < 2; ++x)
+			for (bpos_t y = 0; y < 2; ++y)
+				for (bpos_t z = 0; z < 2; ++z, ++i) {
+					const v3bpos_t nbpos(bpos_aligned.X + (x << step),
+							bpos_aligned.Y + (y << step), bpos_aligned.Z + (z << step));
+					if (!step) {
+						const auto block = smap->getBlock(nbpos);
+						if (block && block->isGenerated()) {
+							job.children[i] = block;
+							continue;
+						}
+					}
+					positions.emplace_back(nbpos);
+					targets.emplace_back(&job.children_data[i]);
+				}
+	}
+
+	std::vector<std::string> data;
+	dbase->loadBlocks(positions, data);
+	for (size_t i = 0; i < targets.size(); ++i)
+		*targets[i] = std::move(data[i]);
+
+	if (partial) {
+		positions.clear();
+		for (const auto &job : jobs)
+			positions.emplace_back(job.bpos_aligned);
+		dbase_up->loadBlocks(positions, data);
+		for (size_t i = 0; i < jobs.size(); ++i)
+			jobs[i].up_data = std::move(data[i]);
+	}
+}
+
+void WorldMerger::write_jobs(MapDatabase *dbase_up, std::vector<merge_job_t> &jobs)
+{
+	ScopeProfiler sp(g_profiler, "Server: World merge write");
+
+	std::vector<std::pair<v3bpos_t, std::string>> save;
+	for (auto &job : jobs) {
+		if (job.save) {
+			save.emplace_back(job.bpos_aligned, std::move(job.result));
+		} else if (job.remove) {
+			dbase_up->deleteBlock(job.bpos_aligned);
+		}
+	}
+	if (!save.empty()) {
+		dbase_up->saveBlocks(save);
+	}
+}
+
+void WorldMerger::merge_job(merge_job_t &job, block_step_t step)
+{
+	const auto &bpos_aligned = job.bpos_aligned;
 	const auto step_pow = 1;
 	const auto step_size = 1 << step_pow;
 	std::unordered_map<v3bpos_t, MapBlockPtr> blocks;
@@ -149,21 +215,16 @@ WorldMerger::one_block_stat_t WorldMerger::merge_one_block(MapDatabase *dbase,
 	using light_points_t = std::unordered_map<v3pos_t, MapBlock::light_t>;
 	std::unordered_map<v3bpos_t, light_points_t> generated_light_points;
 	{
+		size_t i = 0;
 		for (bpos_t x = 0; x < step_size; ++x)
 			for (bpos_t y = 0; y < step_size; ++y)
-				for (bpos_t z = 0; z < step_size; ++z) {
+				for (bpos_t z = 0; z < step_size; ++z, ++i) {
 					const v3pos_t rpos(x, y, z);
 					const v3bpos_t nbpos(bpos_aligned.X + (x << step),
 							bpos_aligned.Y + (y << step), bpos_aligned.Z + (z << step));
-					MapBlockPtr nblock;
-					if (!step) {
-						const auto block = smap->getBlock(nbpos);
-						if (block && block->isGenerated()) {
-							nblock = block;
-						}
-					}
+					auto nblock = job.children[i];
 					if (!nblock) {
-						nblock = load_block(smap, dbase, nbpos);
+						nblock = loadBlockNoStore(smap, nbpos, job.children_data[i]);
 						if (!nblock || !nblock->isGenerated()) {
 							continue;
 						}
@@ -192,21 +253,24 @@ WorldMerger::one_block_stat_t WorldMerger::merge_one_block(MapDatabase *dbase,
 				}
 	}
 
-	if (!timestamp && get_time_func) {
-		timestamp = get_time_func();
+	if (!timestamp) {
+		timestamp = job.time;
 	}
 
 	MapBlockPtr block_up;
 
 	if (partial) {
-		block_up = load_block(smap, dbase_up, bpos_aligned);
+		block_up = loadBlockNoStore(smap, bpos_aligned, job.up_data);
+		if (block_up && !block_up->isGenerated()) {
+			block_up.reset();
+		}
 		if (block_up && lazy_up) {
 			// actionstream << "s=" << step <<" at=" << block_up->getActualTimestamp() << " t=" << block_up->getTimestamp() <<  " myts=" << timestamp << "\n";
 			const auto source_time = std::max<uint64_t>(
 					timestamp, std::max<uint64_t>(valid_update_time(heat_last_update),
 									   valid_update_time(humidity_last_update)));
 			if (within_lazy_window(source_time, newest_block_time(block_up), lazy_up)) {
-				return {};
+				return;
 			}
 		}
 	}
@@ -350,7 +414,7 @@ WorldMerger::one_block_stat_t WorldMerger::merge_one_block(MapDatabase *dbase,
 				}
 	}
 	// TODO: skip full air;
-	one_block_stat_t one_step_stat;
+	auto &one_step_stat = job.stat;
 	block_up->m_light_points.clear();
 	if (farlights) {
 		constexpr auto some_magick_thinner_const = 2; // more -> less far ligts
@@ -401,12 +465,11 @@ WorldMerger::one_block_stat_t WorldMerger::merge_one_block(MapDatabase *dbase,
 
 	if (not_empty_nodes) {
 		block_up->setGenerated(true);
-		ServerMap::saveBlock(block_up.get(), dbase_up, m_map_compression_level);
+		job.result = ServerMap::serializeBlock(block_up.get(), m_map_compression_level);
+		job.save = true;
 	} else {
-		dbase_up->deleteBlock(bpos_aligned);
+		job.remove = true;
 	}
-
-	return one_step_stat;
 }
 
 bool WorldMerger::merge_one_step(
@@ -432,16 +495,35 @@ bool WorldMerger::merge_one_step(
 		return false;
 	}
 
-	size_t cur_n = 0;
+	// Target blocks in Z-order, so children of neighbour targets are read
+	// together and are near in the databases
+	std::unordered_set<v3bpos_t> blocks_processed;
+	std::vector<std::pair<u64, v3bpos_t>> targets;
+	{
+		const bpos_t shift = step + 1;
+		for (const auto &bpos : blocks_todo) {
+			v3bpos_t bpos_aligned((bpos.X >> shift) << shift,
+					(bpos.Y >> shift) << shift, (bpos.Z >> shift) << shift);
+			if (blocks_processed.emplace(bpos_aligned).second) {
+				targets.emplace_back(
+						MapDatabase::getBlockAsMorton(bpos_aligned), bpos_aligned);
+			}
+		}
+		std::sort(targets.begin(), targets.end(),
+				[](const auto &a, const auto &b) { return a.first < b.first; });
+	}
+
+	if (threads != 1 && !pool) {
+		pool = std::make_unique<progschj::ThreadPool>(
+				threads ? threads : std::max(1u, std::thread::hardware_concurrency()));
+	}
 
 	const auto blocks_size = blocks_todo.size();
 	infostream << "World merge "
-			   //<< "run " << run
-			   << " step " << (short)step << " blocks "
-			   << blocks_size
-			   //<< " per " << (porting::getTimeMs() - time_start) / 1000 << "s"
-			   << " max_clients " << world_merge_max_clients << " throttle "
-			   << world_merge_throttle << '\n';
+			   << " step " << (short)step << " blocks " << blocks_size << " targets "
+			   << targets.size() << " max_clients " << world_merge_max_clients
+			   << " throttle " << world_merge_throttle << " threads "
+			   << (pool ? threads : 1) << '\n';
 	size_t processed = 0;
 
 	const auto time_start = porting::getTimeMs();
@@ -450,57 +532,68 @@ bool WorldMerger::merge_one_step(
 		const auto time = porting::getTimeMs();
 
 		infostream << "World merge "
-				   // << "run " << run
-				   << " " << cur_n << "/"
-				   << blocks_size
-				   //<< " blocks loaded " << m_server->getMap().m_blocks.size()
-				   << " processed " << processed << " per " << (time - time_start) / 1000
+				   << " " << processed << "/" << targets.size()
+				   << " per " << (time - time_start) / 1000
 				   << " lights " << stat_step.lights_used << "/" << stat_step.lights_count
 				   << " speed " << processed / (((time - time_start) / 1000) ?: 1)
 				   << '\n';
 	};
 
-	std::unordered_set<v3bpos_t> blocks_processed;
+	const auto run_job = [this, step](merge_job_t &job) {
+		try {
+			merge_job(job, step);
+#if !EXCEPTION_DEBUG
+		} catch (const std::exception &e) {
+			errorstream << "world merge" << ": exception: " << e.what() << "\n"
+						<< stacktrace() << '\n';
+		} catch (...) {
+			errorstream << "world merge" << ": Unknown unhandled exception at "
+						<< __PRETTY_FUNCTION__ << ":" << __LINE__ << '\n'
+						<< stacktrace() << '\n';
+#else
+		} catch (int) { // nothing
+#endif
+		}
+	};
 
-	cur_n = 0;
-	for (const auto &bpos : blocks_todo) {
+	std::vector<merge_job_t> jobs;
+	std::vector<std::future<void>> futures;
+	size_t next_print = 10000;
+	for (size_t begin = 0; begin < targets.size();) {
 		if (stop()) {
 			return true;
 		}
 
-		++cur_n;
-
-		const bpos_t shift = step + 1;
-
-		v3bpos_t bpos_aligned((bpos.X >> shift) << shift, (bpos.Y >> shift) << shift,
-				(bpos.Z >> shift) << shift);
-		if (blocks_processed.contains(bpos_aligned)) {
-			continue;
+		// Throttled merge goes block by block as before
+		const bool throttled = throttle();
+		const size_t count = std::min(
+				throttled ? 1 : std::max<size_t>(1, batch_size), targets.size() - begin);
+		jobs.clear();
+		jobs.resize(count);
+		for (size_t i = 0; i < count; ++i) {
+			jobs[i].bpos_aligned = targets[begin + i].second;
 		}
-		blocks_processed.emplace(bpos_aligned);
-
-		++processed;
-		g_profiler->add("Server: World merge blocks", 1);
+		begin += count;
 
 		try {
-			const auto stat_block =
-					merge_one_block(dbase_current, dbase_up, bpos_aligned, step);
-			stat_step.lights_count += stat_block.lights_count;
-			stat_step.lights_used += stat_block.lights_used;
-
-			if (!(cur_n % 10000)) {
-				printstat();
-			}
-
-			if (throttle()) {
-				tracestream << "World merge throttle" << '\n';
-
-				std::this_thread::sleep_for(std::chrono::seconds(1));
-			} else if (world_merge_throttle) {
-				std::this_thread::sleep_for(
-						std::chrono::milliseconds(world_merge_throttle));
+			read_jobs(dbase_current, dbase_up, jobs, step);
+			{
+				ScopeProfiler sp(g_profiler, "Server: World merge merge");
+				if (pool && count > 1) {
+					futures.clear();
+					for (auto &job : jobs) {
+						futures.emplace_back(pool->enqueue([&run_job, &job]() { run_job(job); }));
+					}
+					for (auto &future : futures) {
+						future.wait();
+					}
+				} else {
+					for (auto &job : jobs) {
+						run_job(job);
+					}
+				}
 			}
-
+			write_jobs(dbase_up, jobs);
 #if !EXCEPTION_DEBUG
 		} catch (const std::exception &e) {
 			errorstream << "world merge" << ": exception: " << e.what() << "\n"
@@ -513,11 +606,39 @@ bool WorldMerger::merge_one_step(
 		} catch (int) { // nothing
 #endif
 		}
+
+		for (const auto &job : jobs) {
+			stat_step.lights_count += job.stat.lights_count;
+			stat_step.lights_used += job.stat.lights_used;
+		}
+		processed += count;
+
+		g_profiler->add("Server: World merge blocks", count);
+		const auto seconds = (porting::getTimeMs() - time_start) / 1000.0;
+		if (seconds > 0) {
+			g_profiler->avg("Server: World merge blocks per second", processed / seconds);
+		}
+		g_profiler->avg(
+				"Server: World merge progress %", processed * 100.0 / targets.size());
+
+		if (processed >= next_print) {
+			next_print = processed + 10000;
+			printstat();
+		}
+
+		if (throttled) {
+			tracestream << "World merge throttle" << '\n';
+
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		} else if (world_merge_throttle) {
+			std::this_thread::sleep_for(
+					std::chrono::milliseconds(world_merge_throttle * count));
+		}
 	}
 	if (world_merge_load_all == 1) {
 		blocks_todo.clear();
 	} else {
-		blocks_todo = blocks_processed;
+		blocks_todo = std::move(blocks_processed);
 	}
 
 	printstat();
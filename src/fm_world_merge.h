@@ -21,13 +21,16 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_set>
 #include "servermap.h"
 #include "mapblock.h"
+#include "threading/ThreadPool.h"
 
 class Server;
 class MapDatabase;
@@ -54,6 +57,11 @@ class WorldMerger
 	std::future<void> last_async;
 	std::mutex changed_blocks_mutex;
 	std::mutex merge_mutex;
+	// Downsampling threads, 0 : number of cores
+	uint32_t threads{1};
+	// Target blocks read, merged and written together
+	size_t batch_size{512};
+	std::unique_ptr<progschj::ThreadPool> pool;
 	~WorldMerger();
 	void init();
 	bool stop();
@@ -65,8 +73,28 @@ class WorldMerger
 		size_t lights_used{};
 	};
 
+	// One target block of the next step
+	struct merge_job_t
+	{
+		v3bpos_t bpos_aligned;
+		// Children in x, y, z order, live map blocks or serialized
+		std::array<MapBlockPtr, 8> children;
+		std::array<std::string, 8> children_data;
+		std::string up_data;
+		uint32_t time{};
+
+		std::string result;
+		bool save{};
+		bool remove{};
+		one_block_stat_t stat;
+	};
+
 	one_block_stat_t merge_one_block(MapDatabase *dbase, MapDatabase *dbase_up,
 			const v3bpos_t &bpos_aligned, block_step_t step);
+	void read_jobs(MapDatabase *dbase, MapDatabase *dbase_up,
+			std::vector<merge_job_t> &jobs, block_step_t step);
+	void merge_job(merge_job_t &job, block_step_t step);
+	void write_jobs(MapDatabase *dbase_up, std::vector<merge_job_t> &jobs);
 	bool merge_one_step(block_step_t step, std::unordered_set<v3bpos_t> &blocks_todo);
 	bool merge_list(std::unordered_set<v3bpos_t> &blocks_todo);
 	bool merge_all();
@@ -17,6 +17,11 @@
 
 #include <mutex>
 
+#include "config.h"
+#if USE_LEVELDB
+#include <leveldb/write_batch.h>
+#endif
+
 #include "convert_json.h"
 #include "filesys.h"
 #include "json/reader.h"
@@ -187,6 +192,53 @@ bool KeyValueStorage::del(const std::string &key)
 #endif
 }
 
+void KeyValueStorage::put_pending(const std::string &key, const std::string &data)
+{
+	if (!db)
+		return;
+	pending[key] = data;
+	limit_pending();
+}
+
+void KeyValueStorage::del_pending(const std::string &key)
+{
+	if (!db)
+		return;
+	pending[key] = std::nullopt;
+	limit_pending();
+}
+
+void KeyValueStorage::limit_pending()
+{
+	if (pending.size() < pending_max || write_pending())
+		return;
+	errorstream << "KeyValueStorage [" << db_name << "] dropping " << pending.size()
+				<< " pending changes [" << get_error() << "]" << std::endl;
+	pending.clear();
+}
+
+bool KeyValueStorage::write_pending()
+{
+	if (pending.empty())
+		return true;
+	if (!db)
+		return false;
+#if USE_LEVELDB
+	leveldb::WriteBatch batch;
+	for (const auto &[key, data] : pending) {
+		if (data)
+			batch.Put(key, *data);
+		else
+			batch.Delete(key);
+	}
+	auto status = db->Write(write_options, &batch);
+	if (!process_status(status))
+		return false;
+#endif
+	pending.clear();
+	return true;
+}
+
 #if USE_LEVELDB
 leveldb::Iterator *KeyValueStorage::new_iterator()
 {
@@ -17,7 +17,9 @@
 
 #pragma once
 
+#include <optional>
 #include <string>
+#include <unordered_map>
 
 #include "config.h"
 #if USE_LEVELDB
@@ -42,6 +44,13 @@ class KeyValueStorage
 	bool get(const std::string &key, float &data);
 	bool get_json(const std::string &key, Json::Value &data);
 	bool del(const std::string &key);
+	// Kept until write_pending(), a later change of a key replaces the earlier one.
+	// Not kept without a database, written early past pending_max
+	void put_pending(const std::string &key, const std::string &data);
+	void del_pending(const std::string &key);
+	// Write all pending changes in one batch
+	bool write_pending();
+	size_t pending_size() const { return pending.size(); }
 	std::string get_error();
 #if USE_LEVELDB
 	leveldb::Iterator *new_iterator();
@@ -62,4 +71,9 @@ class KeyValueStorage
 	//Json::Reader json_reader;
 	Json::CharReaderBuilder json_char_reader_builder;
 	std::mutex mutex;
+	// Dropped when they can not be written early
+	void limit_pending();
+	static constexpr size_t pending_max = 100000;
+	// Value or nullopt for deleted
+	std::unordered_map<std::string, std::optional<std::string>> pending;
 };
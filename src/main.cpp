@@ -129,6 +129,7 @@ static bool determine_subgame(GameParams *game_params);
 
 static bool run_dedicated_server(const GameParams &game_params, const Settings &cmd_args);
 static bool migrate_map_database(const GameParams &game_params, const Settings &cmd_args);
+static bool migrate_map_layout(const GameParams &game_params, const Settings &cmd_args);
 static bool recompress_map_database(const GameParams &game_params, const Settings &cmd_args);
 
 /**********************************************************************/
@@ -458,6 +459,8 @@ static void set_allowed_options(OptionList *allowed_options)
 		_("Migrate from current auth backend to another" SERVER_ONLY))));
 	allowed_options->insert(std::make_pair("migrate-mod-storage", ValueSpec(VALUETYPE_STRING,
 		_("Migrate from current mod storage backend to another" SERVER_ONLY))));
+	allowed_options->insert(std::make_pair("migrate-map-layout", ValueSpec(VALUETYPE_STRING,
+		_("Convert the map database to another key layout (default, morton)" SERVER_ONLY))));
 	allowed_options->insert(std::make_pair("pid", ValueSpec(VALUETYPE_STRING,
 			_("Set PID file path"))));
 	allowed_options->insert(std::make_pair("terminal", ValueSpec(VALUETYPE_FLAG,
@@ -1248,6 +1251,9 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 	if (cmd_args.exists("migrate-mod-storage"))
 		return Server::migrateModStorageDatabase(game_params, cmd_args);
 
+	if (cmd_args.exists("migrate-map-layout"))
+		return migrate_map_layout(game_params, cmd_args);
+
 	if (cmd_args.getFlag("recompress"))
 		return recompress_map_database(game_params, cmd_args);
 
@@ -1436,6 +1442,133 @@ static bool migrate_map_database(const GameParams &game_params, const Settings &
 	return true;
 }
 
+static bool migrate_map_layout(const GameParams &game_params, const Settings &cmd_args)
+{
+	const std::string layout = cmd_args.get("migrate-map-layout");
+	if (layout != "default" && layout != "morton") {
+		errorstream << "Unknown map key layout \"" << layout << "\", use"
+			<< " default or morton" << std::endl;
+		return false;
+	}
+
+	Settings world_mt;
+	const std::string world_mt_path = game_params.world_path + DIR_DELIM + "world.mt";
+	if (!world_mt.readConfigFile(world_mt_path.c_str())) {
+		errorstream << "Cannot read world.mt!" << std::endl;
+		return false;
+	}
+
+	const std::string backend = world_mt.exists("backend") ? world_mt.get("backend") : "";
+	std::string db_name;
+	if (backend == "sqlite3")
+		db_name = "map.sqlite";
+	else if (backend == "leveldb")
+		db_name = "map.db";
+	else {
+		errorstream << "Cannot migrate: key layouts are only supported by the"
+			<< " sqlite3 and leveldb backends" << std::endl;
+		return false;
+	}
+
+
+	// The new database is written next to the old one and swapped in when done
+	const std::string tmp_path = game_params.world_path + DIR_DELIM + "map_layout.tmp";
+	if (fs::PathExists(tmp_path) && !fs::RecursiveDelete(tmp_path)) {
+		errorstream << "Cannot remove " << tmp_path << std::endl;
+		return false;
+	}
+	Settings new_conf;
+	new_conf.set("map_key_layout", layout);
+
+	std::unique_ptr<MapDatabase> old_db(
+			ServerMap::createDatabase(backend, game_params.world_path, world_mt));
+
+	// The database knows its layout, world.mt only picks it for new ones
+	const std::string old_layout = old_db->getKeyLayout();
+	std::string conf_layout = "default";
+	world_mt.getNoEx("map_key_layout", conf_layout);
+	if (old_layout != conf_layout)
+		warningstream << "world.mt has map_key_layout = " << conf_layout
+			<< " but the database uses " << old_layout << std::endl;
+	if (old_layout == layout) {
+		errorstream << "Cannot migrate: new key layout is same"
+			<< " as the old one" << std::endl;
+		return false;
+	}
+
+	std::unique_ptr<MapDatabase> new_db(
+			ServerMap::createDatabase(backend, tmp_path, new_conf));
+
+	u32 count = 0;
+	u64 last_update_time = 0;
+	volatile auto &kill = *porting::signal_handler_killstatus();
+
+	std::vector<v3bpos_t> blocks;
+	old_db->listAllLoadableBlocks(blocks);
+	// Insert in key order of the morton layout
+	std::sort(blocks.begin(), blocks.end(), [](const v3bpos_t &a, const v3bpos_t &b) {
+		return MapDatabase::getBlockAsMorton(a) < MapDatabase::getBlockAsMorton(b);
+	});
+
+	constexpr size_t batch_size = 1000;
+	std::vector<v3bpos_t> batch_pos;
+	std::vector<std::string> batch_data;
+	std::vector<std::pair<v3bpos_t, std::string>> batch;
+	for (size_t i = 0; i < blocks.size(); i += batch_size) {
+		if (kill)
+			return false;
+
+		batch_pos.assign(blocks.begin() + i,
+				blocks.begin() + std::min(i + batch_size, blocks.size()));
+		old_db->loadBlocks(batch_pos, batch_data);
+		batch.clear();
+		for (size_t j = 0; j < batch_pos.size(); ++j) {
+			if (batch_data[j].empty()) {
+				errorstream << "Failed to load block " << batch_pos[j]
+					<< ", skipping it." << std::endl;
+				continue;
+			}
+			batch.emplace_back(batch_pos[j], std::move(batch_data[j]));
+		}
+		new_db->beginSave();
+		count += new_db->saveBlocks(batch);
+		new_db->endSave();
+
+		if (porting::getTimeS() - last_update_time >= 1) {
+			std::cerr << " Migrated " << count << " blocks, "
+				<< (100.0 * count / blocks.size()) << "% completed.\r" << std::flush;
+			last_update_time = porting::getTimeS();
+		}
+	}
+	std::cerr << std::endl;
+	old_db.reset();
+	new_db.reset();
+
+	const std::string db_path = game_params.world_path + DIR_DELIM + db_name;
+	const std::string backup_path = db_path + ".old";
+	if (fs::PathExists(backup_path) && !fs::RecursiveDelete(backup_path)) {
+		errorstream << "Cannot remove " << backup_path << std::endl;
+		return false;
+	}
+	if (!fs::Rename(db_path, backup_path) ||
+			!fs::Rename(tmp_path + DIR_DELIM + db_name, db_path)) {
+		errorstream << "Failed to move the new map database from " << tmp_path
+			<< " to " << db_path << std::endl;
+		return false;
+	}
+	fs::RecursiveDelete(tmp_path);
+
+	actionstream << "Successfully migrated " << count << " blocks, the old"
+		<< " database was kept as " << backup_path << std::endl;
+	world_mt.set("map_key_layout", layout);
+	if (!world_mt.updateConfigFile(world_mt_path.c_str()))
+		errorstream << "Failed to update world.mt!" << std::endl;
+	else
+		actionstream << "world.mt updated" << std::endl;
+
+	return true;
+}
+
 static bool recompress_map_database(const GameParams &game_params, const Settings &cmd_args)
 {
 	Settings world_mt;
@@ -315,6 +315,9 @@ class Map : public NodeContainer
 	MapBlockPtr createBlankBlock(const v3bpos_t &p);
 	bool insertBlock(MapBlockPtr block);
 	void eraseBlock(const MapBlockPtr block);
+	// Every block put into or taken out of m_blocks
+	virtual void onBlockInserted(const MapBlockPtr &block) {}
+	virtual void onBlockErased(const MapBlockPtr &block) {}
 	std::unordered_map<MapBlockPtr, int> *m_blocks_delete = nullptr;
 	std::unordered_map<MapBlockPtr, int> m_blocks_delete_1, m_blocks_delete_2;
 	uint64_t m_blocks_delete_time{};
@@ -128,6 +128,7 @@ void MapBlock::setNode(const v3pos_t &p, const MapNode &n, bool important)
 	const auto &f0 = nodedef->get(data[index].getContent());
 
 	data[index] = n;
+	++m_node_revision;
 
 	modified_light light = modified_light_no;
 	if (f0.light_propagates != f1.light_propagates ||
@@ -246,6 +247,7 @@ void MapBlock::setNodeNoLock(v3pos_t p, MapNode n, bool important)
 {
 	expandNodesIfNeeded();
 	data[p.Z * zstride + p.Y * ystride + p.X] = n;
+	++m_node_revision;
 	raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE, important);
 }
 
@@ -425,6 +427,7 @@ void MapBlock::copyFrom(const VoxelManipulator &src)
 	// Copy from VoxelManipulator to data
 	src.copyTo(data, data_area, v3pos_t(0,0,0),
 			getPosRelative(), data_size);
+	++m_node_revision;
 	tryShrinkNodes();
 }
 
@@ -444,6 +447,7 @@ void MapBlock::reallocate(u32 count, MapNode n)
 	data = new MapNode[count];
 
 	std::fill_n(data, count, n);
+	++m_node_revision;
 
 	m_is_mono_block = (count == 1);
 }
@@ -734,6 +738,7 @@ bool MapBlock::deSerialize(std::istream &in_compressed, u8 version, bool disk)
 	TRACESTREAM(<<"MapBlock::deSerialize "<<getPos()<<std::endl);
 
 	m_is_air_expired = true;
+	++m_node_revision;
 	expandNodesIfNeeded();
 
 	if(version <= 21)
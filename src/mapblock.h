@@ -320,6 +320,7 @@ class MapBlock
         const auto lock = lock_unique_rec();
 		expandNodesIfNeeded();
 		data[z * zstride + y * ystride + x] = n;
+		++m_node_revision;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE, false);
 	}
 
@@ -329,6 +330,7 @@ class MapBlock
 		expandNodesIfNeeded();
 
 		data[p.Z * zstride + p.Y * ystride + p.X] = n;
+		++m_node_revision;
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE, important);
 	}
 
@@ -481,6 +483,7 @@ class MapBlock
 	void fill(const MapNode & n) {
 		for (u32 i = 0; i < nodecount; ++i)
 			data[i] = n;
+		++m_node_revision;
 	}
 
 	using mesh_type = std::shared_ptr<MapBlockMesh>;
@@ -570,6 +573,8 @@ class MapBlock
 	weather::wind_t wind{};
 	// Last really changed time (need send to client)
 	std::atomic_uint m_changed_timestamp{};
+	// Incremented on every change of node data, for caches built from it
+	std::atomic_uint32_t m_node_revision{};
 	uint32_t m_next_analyze_timestamp{};
 	typedef std::list<abm_trigger_one> abm_triggers_type;
 	std::unique_ptr<abm_triggers_type> abm_triggers;
@@ -694,6 +699,10 @@ class MapBlock
 */
 	// marks the sides which are opaque: 00+Z-Z+Y-Y+X-X
 	u8 solid_sides = 0;
+	// pairs of sides joined inside the mesh, see fm_visibility.h, all of
+	// them until a mesh is made. Set by the main thread, read by the
+	// draw list thread.
+	std::atomic<u16> face_connectivity{0x7fff};
 #endif
 
 private:
@@ -49,178 +49,116 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #define HGT_DEBUG 0
 
 // bad anything but works
-// todo: prepare all data from all sources in one good tiled layer
+// raw sources are read only once per tile, to make the native tiles of hgt_cache
 
-// Thread-local container cache definition
-thread_local hgts::ThreadLocalContainerCache hgts::tl_container_cache;
-
-hgts::hgts(const std::string &folder) : folder{folder}
+hgts::hgts(const std::string &folder) :
+		folder{folder},
+		cache{folder, [this](int lat, int lon, hgt_grid &grid) {
+				  return convert(lat, lon, grid);
+			  }}
 {
 	std::error_code ec;
 	std::filesystem::create_directories(folder, ec);
 }
 
-// Get layer definitions
-std::vector<hgts::Layer> hgts::get_layers(const height::ll_t lat, const height::ll_t lon)
+const std::vector<hgts::Layer> &hgts::get_layers()
 {
-	constexpr auto layers = true;
-
-	auto place_dummy_generic =
-			[](std::map<int, std::map<int, std::shared_ptr<height>>> &map,
-					std::unordered_map<uint64_t, std::weak_ptr<height>> &cache,
-					int lat_dec, int lon_dec) {
-				const static auto hgt_dummy = std::make_shared<height_dummy>();
-				if (!map[lat_dec].contains(lon_dec)) {
-					map[lat_dec][lon_dec] = hgt_dummy;
-					cache[make_tile_key(lat_dec, lon_dec)] = hgt_dummy;
-				}
-			};
-
-	auto identity_post_process = [](height::ll_t result) { return result; };
-
-	return {Layer{
-					.container = map1,
-					.cache = tl_container_cache.map1_cache,
+	static const std::vector<Layer> layers{
+			Layer{
 					.factory =
 							[](const std::string &folder, height::ll_t lat,
 									height::ll_t lon) {
 								return std::make_shared<height_hgt>(folder, lat, lon);
 							},
-					.post_process = identity_post_process,
-					.place_dummy = place_dummy_generic,
 					.min_height = 0.0f, // Primary layer can handle very low elevations
 					.max_height = 10000.0f, // Primary layer handles high elevations
 			},
 			Layer{
-					.container = map1_seabed,
-					.cache = tl_container_cache.map1_seabed_cache,
 					.factory =
 							[](const std::string &folder, height::ll_t lat,
 									height::ll_t lon) {
 								return std::make_shared<height_seabed_tif>(
 										folder, lat, lon);
 							},
-					.post_process = identity_post_process,
-					.place_dummy = place_dummy_generic,
 					.min_height = -12000.0f, // Seabed handles deep ocean depths
 					.max_height = 0.0f,		 // Seabed only for underwater/sea level
 			}};
+	return layers;
 }
 
-height::height_t hgts::get(const height_hgt::ll_t lat, const height_hgt::ll_t lon)
+bool hgts::convert(int lat, int lon, hgt_grid &grid)
 {
-	const auto lat1 = height::lat_start(lat);
-	const auto lon1 = height::lon_start(lon);
-
-	// First try thread-local container cache
-	const uint64_t tile_key = make_tile_key(lat1, lon1);
-
-	// Get all layers
-	auto layers = get_layers(lat, lon);
-
-	// Try each layer in cycle
-	for (auto &layer : layers) {
-		// Check thread-local cache first
-		auto it = layer.cache.find(tile_key);
-		if (auto cached_height = it != layer.cache.end() ? it->second.lock()
-														 : std::shared_ptr<height>{};
-				cached_height && cached_height->ok(lat, lon)) {
-			const auto result = cached_height->get(lat, lon);
-			const auto processed_result = layer.post_process(result);
-
-			// Check if result is within layer's valid range
-			if (processed_result > layer.min_height &&
-					processed_result < layer.max_height) {
-				return processed_result;
-			}
-			// If not in range, continue to next layer
+	const auto &layers = get_layers();
+	const height::ll_t lat_center = lat + 0.5f;
+	const height::ll_t lon_center = lon + 0.5f;
+
+	// Layers are loaded when first needed, seabed is not fetched for dry land.
+	// A layer that failed to download for now makes the tile incomplete,
+	// layers missing on the server do not.
+	const auto failures = http_transient_failures();
+	const auto done = [&](bool ok) {
+		grid.complete = http_transient_failures() == failures;
+		return ok;
+	};
+	std::vector<std::shared_ptr<height>> loaded(layers.size());
+	std::vector<bool> tried(layers.size());
+	const auto layer = [&](size_t i) -> height * {
+		if (!tried[i]) {
+			tried[i] = true;
+			auto hgt = layers[i].factory(folder, lat_center, lon_center);
+			if (hgt->load(lat_center, lon_center) && hgt->cells())
+				loaded[i] = std::move(hgt);
 		}
-	}
-
-	// Try each layer with lock
-	for (auto &layer : layers) {
-		{
-			const auto lock = std::unique_lock(mutex);
-			if (const auto it = layer.container.find(lat1); it != layer.container.end()) {
-				if (const auto inner_it = it->second.find(lon1);
-						inner_it != it->second.end()) {
-					const auto result = inner_it->second->get(lat, lon);
-					const auto processed_result = layer.post_process(result);
-
-					// Check if result is within layer's valid range
-					if (processed_result > layer.min_height &&
-							processed_result < layer.max_height) {
-						// Cache the height object for future fast access
-						layer.cache[tile_key] = inner_it->second;
-						return processed_result;
-					}
-					// If not in range, continue to next layer
-				}
-			}
-		} // Lock released
-
-		// Load data outside the lock if needed and within valid range
-		if (lat <= 90 && lat >= -90 && lon <= 180 && lon >= -180) {
-			const auto &container_lat1 = layer.container[lat1];
-
-			if (!container_lat1.contains(lon1)) {
-				auto hgt = layer.factory(folder, lat, lon);
-				const int lat_dec = hgt->lat_start(lat);
-				const int lon_dec = hgt->lon_start(lon);
-				if (hgt->load(lat, lon)) {
-					// Successfully loaded, now acquire lock to store it
-					{
-						const auto lock = std::unique_lock(mutex);
-						layer.container[lat_dec][lon_dec] = std::move(hgt);
-					} // Lock released
-
-					// Now get the result with a brief lock
-					const auto lock = std::unique_lock(mutex);
-					if (const auto it = layer.container.find(lat_dec);
-							it != layer.container.end()) {
-						if (const auto inner_it = it->second.find(lon_dec);
-								inner_it != it->second.end()) {
-							const auto result = inner_it->second->get(lat, lon);
-							const auto processed_result = layer.post_process(result);
-
-							// Check if result is within layer's valid range
-							if (processed_result > layer.min_height &&
-									processed_result < layer.max_height) {
-								layer.cache[make_tile_key(lat_dec, lon_dec)] =
-										layer.container[lat_dec][lon_dec];
-								return processed_result;
-							}
-						}
-					}
-				} else {
-					// Failed to load, place dummy
-					const auto lock = std::unique_lock(mutex);
-					layer.place_dummy(layer.container, layer.cache, lat1, lon1);
-				}
-			}
+		return loaded[i].get();
+	};
 
-			// Final check with lock held
-			const auto lock = std::unique_lock(mutex);
-			if (const auto it = layer.container.find(lat1); it != layer.container.end()) {
-				if (const auto inner_it = it->second.find(lon1);
-						inner_it != it->second.end()) {
-					const auto result = inner_it->second->get(lat, lon);
-					const auto processed_result = layer.post_process(result);
-
-					// Check if result is within layer's valid range
-					if (processed_result > layer.min_height &&
-							processed_result < layer.max_height) {
-						// Cache the height object for future fast access
-						layer.cache[tile_key] = inner_it->second;
-						return processed_result;
-					}
+	// Resolution of the first layer with data
+	uint16_t cells = 0;
+	for (size_t i = 0; i < layers.size() && !cells; ++i)
+		if (const auto hgt = layer(i); hgt)
+			cells = hgt->cells();
+	if (!cells)
+		return done(false);
+
+	grid.cells_x = grid.cells_y = cells;
+	grid.values.resize(size_t(cells + 1) * (cells + 1));
+	auto *out = grid.values.data();
+	for (uint32_t y = 0; y <= cells; ++y) {
+		// The north and east edge is sampled just inside the tile
+		const height::ll_t lat_p = lat + std::min<double>(y, cells - 0.01) / cells;
+		for (uint32_t x = 0; x <= cells; ++x, ++out) {
+			const height::ll_t lon_p = lon + std::min<double>(x, cells - 0.01) / cells;
+			height::height_t value = 0;
+			for (size_t i = 0; i < layers.size(); ++i) {
+				const auto hgt = layer(i);
+				if (!hgt)
+					continue;
+				const auto h = hgt->get(lat_p, lon_p);
+				if (h > layers[i].min_height && h < layers[i].max_height) {
+					value = h;
+					break;
 				}
 			}
+			*out = std::round(value);
 		}
 	}
+	return done(true);
+}
 
-	// If all layers failed or results were out of range, return 0 as fallback
-	return 0;
+height::height_t hgts::get(const height_hgt::ll_t lat, const height_hgt::ll_t lon)
+{
+	return cache.get(lat, lon);
+}
+
+void hgts::get_area(double lat, double lon, double step_lat, double step_lon,
+		size_t size_x, size_t size_z, height::height_t *out)
+{
+	cache.get_area(lat, lon, step_lat, step_lon, size_x, size_z, out);
+}
+
+void hgts::set_cache_size(size_t bytes)
+{
+	cache.set_max_bytes(bytes);
 }
 
 std::mutex height::mutex;
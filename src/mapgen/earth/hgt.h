@@ -29,8 +29,7 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <mutex>
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <thread>
+#include "hgt_cache.h"
 
 class height
 {
@@ -59,6 +58,8 @@ class height
 	virtual bool load(ll_t lat, ll_t lon) { return true; };
 	virtual bool ok(ll_t lat, ll_t lon);
 	height_t get(ll_t lat, ll_t lon);
+	// Cells per tile side of the loaded data
+	uint16_t cells() const { return side_length_x - side_length_x_extra; }
 	static int lat_start(ll_t lat);
 	static int lon_start(ll_t lon);
 };
@@ -148,40 +149,30 @@ class height_dummy final : public height
 
 class hgts
 {
-	std::map<int, std::map<int, std::shared_ptr<height>>> map1, map1_seabed; //, map90;
 	const std::string folder;
-	std::mutex mutex;
 
-	// Thread-local cache for container access
-	struct ThreadLocalContainerCache {
-		std::unordered_map<uint64_t, std::weak_ptr<height>> map1_cache;
-		std::unordered_map<uint64_t, std::weak_ptr<height>> map1_seabed_cache;
-	};
-	
-	static thread_local ThreadLocalContainerCache tl_container_cache;
-
-	// Cache key generation for container access (lat/lon tile coordinates)
-	static uint64_t make_tile_key(int lat, int lon) {
-		return (uint64_t(static_cast<uint32_t>(lat)) << 32) | uint64_t(static_cast<uint32_t>(lon));
-	}
-
-	// Layer definition structure
-	struct Layer {
-		std::map<int, std::map<int, std::shared_ptr<height>>>& container;
-		std::unordered_map<uint64_t, std::weak_ptr<height>>& cache;
-		std::function<std::shared_ptr<height>(const std::string&, height::ll_t, height::ll_t)> factory;
-		std::function<height::height_t(height::ll_t)> post_process;
-		std::function<void(std::map<int, std::map<int, std::shared_ptr<height>>>&, 
-						  std::unordered_map<uint64_t, std::weak_ptr<height>>&, 
-						  int, int)> place_dummy;
+	// Raw sources, a value is taken from the first layer where it is in range
+	struct Layer
+	{
+		std::function<std::shared_ptr<height>(
+				const std::string &, height::ll_t, height::ll_t)>
+				factory;
 		height::height_t min_height;
 		height::height_t max_height;
 	};
-	
-	// Get layer definitions
-	std::vector<Layer> get_layers(const height::ll_t lat, const height::ll_t lon);
+
+	static const std::vector<Layer> &get_layers();
+
+	// Make the native tile of lat, lon from all layers
+	bool convert(int lat, int lon, hgt_grid &grid);
+
+	hgt_cache cache;
 
 public:
 	hgts(const std::string &folder);
 	height::height_t get(const height::ll_t lat, const height::ll_t lon);
+	// Heights of a size_x * size_z grid, see hgt_cache::get_area
+	void get_area(double lat, double lon, double step_lat, double step_lon,
+			size_t size_x, size_t size_z, height::height_t *out);
+	void set_cache_size(size_t bytes);
 };
@@ -0,0 +1,480 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "hgt_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include "log.h"
+
+#if !defined(_WIN32)
+#define HGT_CACHE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define HGT_CACHE_MMAP 0
+#endif
+
+/*
+	Native tile file:
+	char[4] magic "FMH1"
+	u16 0x0102 in host byte order, files from other hosts are made again
+	u16 cells_x, cells_y
+	u16[5] reserved
+	s16 values in BLOCK x BLOCK squares, squares row by row from the south west
+*/
+
+namespace
+{
+constexpr char MAGIC[4] = {'F', 'M', 'H', '1'};
+constexpr uint16_t ORDER_MARK = 0x0102;
+
+struct file_header
+{
+	char magic[4];
+	uint16_t byte_order;
+	uint16_t cells_x, cells_y;
+	uint16_t reserved[5];
+};
+static_assert(sizeof(file_header) == 20);
+
+size_t blocks(uint16_t cells)
+{
+	return (cells + hgt_cache::BLOCK) / hgt_cache::BLOCK;
+}
+
+size_t values_size(uint16_t cells_x, uint16_t cells_y)
+{
+	return blocks(cells_x) * blocks(cells_y) * hgt_cache::BLOCK * hgt_cache::BLOCK;
+}
+
+uint64_t now_ms()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch())
+			.count();
+}
+}
+
+struct hgt_cache::tile
+{
+	uint16_t cells_x = 1, cells_y = 1;
+	size_t blocks_x = 1;
+	const int16_t *values = nullptr;
+	// Counted against max_bytes
+	size_t bytes = 0;
+
+	void *map = nullptr;
+	size_t map_size = 0;
+	std::vector<int16_t> own;
+
+	tile() = default;
+	tile(const tile &) = delete;
+	~tile()
+	{
+#if HGT_CACHE_MMAP
+		if (map)
+			munmap(map, map_size);
+#endif
+	}
+
+	int16_t at(uint32_t x, uint32_t y) const
+	{
+		return values[((y / BLOCK) * blocks_x + x / BLOCK) * BLOCK * BLOCK +
+					  (y % BLOCK) * BLOCK + x % BLOCK];
+	}
+
+	// fx, fy in cells from the south west corner
+	height_t sample(double fx, double fy) const
+	{
+		fx = std::clamp<double>(fx, 0, cells_x);
+		fy = std::clamp<double>(fy, 0, cells_y);
+		const uint32_t x = std::min<uint32_t>(fx, cells_x - 1);
+		const uint32_t y = std::min<uint32_t>(fy, cells_y - 1);
+		const height_t dx = fx - x;
+		const height_t dy = fy - y;
+		const height_t south = at(x, y) * (1 - dx) + at(x + 1, y) * dx;
+		const height_t north = at(x, y + 1) * (1 - dx) + at(x + 1, y + 1) * dx;
+		return south * (1 - dy) + north * dy;
+	}
+
+	static std::unique_ptr<tile> from_grid(const hgt_grid &grid);
+	static std::unique_ptr<tile> from_file(const std::string &path);
+};
+
+struct hgt_cache::slot
+{
+	enum : uint8_t
+	{
+		EMPTY,
+		LOADING,
+		READY,
+		EVICTING,
+	};
+
+	std::atomic<uint32_t> users{0};
+	std::atomic<uint8_t> state{EMPTY};
+	std::atomic<uint32_t> last_use{0};
+	// now_ms() to make an incomplete tile again, 0 when complete
+	std::atomic<uint64_t> retry_at{0};
+	// Written only while LOADING or EVICTING with no users
+	const tile *data = nullptr;
+	// Incomplete loads in a row
+	uint8_t failures = 0;
+};
+
+std::unique_ptr<hgt_cache::tile> hgt_cache::tile::from_grid(const hgt_grid &grid)
+{
+	auto t = std::make_unique<tile>();
+	t->cells_x = grid.cells_x;
+	t->cells_y = grid.cells_y;
+	t->blocks_x = blocks(grid.cells_x);
+	t->own.resize(values_size(grid.cells_x, grid.cells_y));
+	t->values = t->own.data();
+	t->bytes = t->own.size() * sizeof(int16_t);
+
+	const size_t row = grid.cells_x + 1;
+	for (uint32_t y = 0; y <= grid.cells_y; ++y)
+		for (uint32_t x = 0; x <= grid.cells_x; ++x)
+			t->own[((y / BLOCK) * t->blocks_x + x / BLOCK) * BLOCK * BLOCK +
+					(y % BLOCK) * BLOCK + x % BLOCK] = grid.values[y * row + x];
+	return t;
+}
+
+std::unique_ptr<hgt_cache::tile> hgt_cache::tile::from_file(const std::string &path)
+{
+#if HGT_CACHE_MMAP
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return {};
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(file_header))
+		map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return {};
+
+	auto t = std::make_unique<tile>();
+	t->map = map;
+	t->map_size = st.st_size;
+	const auto *data = static_cast<const char *>(map);
+#else
+	std::ifstream is(path, std::ios::binary | std::ios::ate);
+	if (!is.good())
+		return {};
+	const size_t size = is.tellg();
+	if (size <= sizeof(file_header))
+		return {};
+	auto t = std::make_unique<tile>();
+	t->own.resize((size + 1) / sizeof(int16_t));
+	is.seekg(0);
+	is.read(reinterpret_cast<char *>(t->own.data()), size);
+	if (!is.good())
+		return {};
+	t->map_size = size;
+	const auto *data = reinterpret_cast<const char *>(t->own.data());
+#endif
+
+	file_header header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) || header.byte_order != ORDER_MARK ||
+			!header.cells_x || !header.cells_y ||
+			t->map_size != sizeof(header) + values_size(header.cells_x, header.cells_y) *
+														sizeof(int16_t))
+		return {};
+
+	t->cells_x = header.cells_x;
+	t->cells_y = header.cells_y;
+	t->blocks_x = blocks(header.cells_x);
+	t->values = reinterpret_cast<const int16_t *>(data + sizeof(header));
+	t->bytes = t->map_size;
+	return t;
+}
+
+const hgt_cache::tile *hgt_cache::zero_tile()
+{
+	static const auto zero = [] {
+		hgt_grid grid;
+		grid.cells_x = grid.cells_y = 1;
+		grid.values.resize(4);
+		return tile::from_grid(grid);
+	}();
+	return zero.get();
+}
+
+hgt_cache::hgt_cache(const std::string &folder, convert_func convert, size_t max_bytes) :
+		m_folder{folder + "/tiled"}, m_convert{std::move(convert)},
+		m_max_bytes{max_bytes}, m_slots{new slot[SLOTS]}
+{
+	std::error_code ec;
+	std::filesystem::create_directories(m_folder, ec);
+}
+
+hgt_cache::~hgt_cache()
+{
+	for (const int index : m_resident)
+		delete m_slots[index].data;
+}
+
+std::string hgt_cache::tile_path(int lat, int lon) const
+{
+	char buff[100];
+	std::snprintf(buff, sizeof(buff), "%c%02d%c%03d.fmh", lat >= 0 ? 'N' : 'S',
+			std::abs(lat), lon >= 0 ? 'E' : 'W', std::abs(lon));
+	return m_folder + "/" + buff;
+}
+
+void hgt_cache::set_max_bytes(size_t bytes)
+{
+	m_max_bytes = bytes;
+	evict(-1);
+}
+
+size_t hgt_cache::get_resident_tiles()
+{
+	const auto lock = std::lock_guard(m_lru_mutex);
+	return m_resident.size();
+}
+
+const hgt_cache::tile *hgt_cache::acquire(int index)
+{
+	slot &s = m_slots[index];
+	for (;;) {
+		// Pin before looking at the state, evict() waits for the pins to go
+		s.users.fetch_add(1);
+		const auto state = s.state.load();
+		if (state == slot::READY) {
+			if (auto retry = s.retry_at.load(std::memory_order_relaxed);
+					retry && now_ms() >= retry) {
+				s.users.fetch_sub(1);
+				// One thread unloads it, the next pass makes it again
+				if (s.retry_at.compare_exchange_strong(retry, 0)) {
+					const auto lock = std::lock_guard(m_lru_mutex);
+					unload(index);
+				}
+				continue;
+			}
+			const auto now = m_clock.load(std::memory_order_relaxed);
+			if (s.last_use.load(std::memory_order_relaxed) != now)
+				s.last_use.store(now, std::memory_order_relaxed);
+			return s.data;
+		}
+		s.users.fetch_sub(1);
+
+		if (state == slot::EMPTY) {
+			uint8_t expected = slot::EMPTY;
+			if (s.state.compare_exchange_strong(expected, slot::LOADING))
+				load(index);
+		} else {
+			s.state.wait(state);
+		}
+	}
+}
+
+void hgt_cache::release(int index)
+{
+	m_slots[index].users.fetch_sub(1);
+}
+
+void hgt_cache::load(int index)
+{
+	slot &s = m_slots[index];
+	const int lat = index / 360 - 90;
+	const int lon = index % 360 - 180;
+	const auto path = tile_path(lat, lon);
+
+	std::unique_ptr<tile> t;
+	bool complete = true;
+	try {
+		t = tile::from_file(path);
+		hgt_grid grid;
+		const bool converted = !t && m_convert && m_convert(lat, lon, grid);
+		complete = grid.complete;
+		if (converted && grid.cells_x && grid.cells_y &&
+				grid.values.size() == size_t(grid.cells_x + 1) * (grid.cells_y + 1)) {
+			// Incomplete tiles are never saved, a later run would keep them
+			if (complete) {
+				if (save(path, grid))
+					t = tile::from_file(path);
+				else
+					errorstream << "hgt_cache: cannot write " << path << std::endl;
+			}
+			if (!t)
+				t = tile::from_grid(grid);
+		}
+	} catch (...) {
+		// Let the waiting threads try again
+		s.state = slot::EMPTY;
+		s.state.notify_all();
+		throw;
+	}
+
+	if (complete) {
+		s.failures = 0;
+		s.retry_at = 0;
+	} else {
+		s.retry_at = now_ms() + (uint64_t(m_retry_ms) << s.failures);
+		s.failures = std::min(s.failures + 1, 6);
+	}
+
+	if (!t) {
+		// Missing in this session, not saved so it is tried again next run
+		s.data = zero_tile();
+		s.state = slot::READY;
+		s.state.notify_all();
+		return;
+	}
+
+	m_resident_bytes += t->bytes;
+	s.data = t.release();
+	{
+		const auto lock = std::lock_guard(m_lru_mutex);
+		m_resident.emplace_back(index);
+	}
+	s.last_use = ++m_clock;
+	s.state = slot::READY;
+	s.state.notify_all();
+	evict(index);
+}
+
+void hgt_cache::evict(int keep)
+{
+	const auto lock = std::lock_guard(m_lru_mutex);
+	while (m_resident_bytes > m_max_bytes && m_resident.size() > 1) {
+		auto oldest = m_resident.end();
+		for (auto it = m_resident.begin(); it != m_resident.end(); ++it) {
+			if (*it != keep &&
+					(oldest == m_resident.end() ||
+							m_slots[*it].last_use < m_slots[*oldest].last_use))
+				oldest = it;
+		}
+		if (oldest == m_resident.end())
+			return;
+
+		if (!unload(*oldest))
+			return;
+	}
+}
+
+bool hgt_cache::unload(int index)
+{
+	slot &s = m_slots[index];
+	uint8_t expected = slot::READY;
+	if (!s.state.compare_exchange_strong(expected, slot::EVICTING))
+		return false;
+	// Pins are held only while sampling, never while loading
+	while (s.users.load())
+		std::this_thread::yield();
+
+	if (s.data != zero_tile()) {
+		m_resident_bytes -= s.data->bytes;
+		delete s.data;
+		const auto it = std::find(m_resident.begin(), m_resident.end(), index);
+		*it = m_resident.back();
+		m_resident.pop_back();
+	}
+	s.data = nullptr;
+	s.state = slot::EMPTY;
+	s.state.notify_all();
+	return true;
+}
+
+hgt_cache::height_t hgt_cache::get(ll_t lat, ll_t lon)
+{
+	if (!(lat >= -90 && lat < 90 && lon >= -180 && lon < 180))
+		return 0;
+
+	const int lat_dec = std::floor(lat);
+	const int lon_dec = std::floor(lon);
+	const int index = slot_index(lat_dec, lon_dec);
+	const tile *t = acquire(index);
+	const auto h = t->sample((lon - lon_dec) * t->cells_x, (lat - lat_dec) * t->cells_y);
+	release(index);
+	return h;
+}
+
+void hgt_cache::get_area(double lat, double lon, double step_lat, double step_lon,
+		size_t size_x, size_t size_z, height_t *out)
+{
+	int index = -1;
+	const tile *t = nullptr;
+	for (size_t z = 0; z < size_z; ++z) {
+		const double la = lat + step_lat * z;
+		for (size_t x = 0; x < size_x; ++x, ++out) {
+			const double lo = lon + step_lon * x;
+			if (!(la >= -90 && la < 90 && lo >= -180 && lo < 180)) {
+				*out = 0;
+				continue;
+			}
+			const int lat_dec = std::floor(la);
+			const int lon_dec = std::floor(lo);
+			const int i = slot_index(lat_dec, lon_dec);
+			if (i != index) {
+				// Never hold a pin while another tile may be loading
+				if (t)
+					release(index);
+				index = i;
+				t = acquire(index);
+			}
+			*out = t->sample((lo - lon_dec) * t->cells_x, (la - lat_dec) * t->cells_y);
+		}
+	}
+	if (t)
+		release(index);
+}
+
+bool hgt_cache::save(const std::string &path, const hgt_grid &grid)
+{
+	if (!grid.cells_x || !grid.cells_y ||
+			grid.values.size() != size_t(grid.cells_x + 1) * (grid.cells_y + 1))
+		return false;
+
+	const auto t = tile::from_grid(grid);
+	file_header header{};
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.byte_order = ORDER_MARK;
+	header.cells_x = grid.cells_x;
+	header.cells_y = grid.cells_y;
+
+	// Other threads or a crash never see a half written tile
+	const auto tmp = path + ".tmp" +
+					 std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+	{
+		std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+		os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		os.write(reinterpret_cast<const char *>(t->own.data()),
+				t->own.size() * sizeof(int16_t));
+		if (!os.good()) {
+			os.close();
+			std::error_code ec;
+			std::filesystem::remove(tmp, ec);
+			return false;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmp, path, ec);
+	return !ec;
+}
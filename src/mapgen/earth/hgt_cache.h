@@ -0,0 +1,111 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Heights of one 1x1 degree tile, (cells_y + 1) rows of (cells_x + 1) values,
+// row 0 is the south edge, the last row and column are the north and east edge
+struct hgt_grid
+{
+	uint16_t cells_x = 0, cells_y = 0;
+	std::vector<int16_t> values;
+	// False when a source failed for now, the tile is used for a while
+	// but not saved, and made again later
+	bool complete = true;
+};
+
+/*
+	Elevation tiles in native format, memory mapped.
+
+	Every tile is made once from the raw sources by convert and saved to
+	folder/tiled/, later loads only map that file. Tiles made while a source
+	failed are kept in memory only and made again after a while. Values are stored in
+	BLOCK x BLOCK squares, so a chunk footprint touches a few pages.
+
+	Loaded tiles are found without a lock: every tile of the globe has a
+	fixed slot, readers pin it with a counter while sampling. The mapped size
+	is bounded, the least recently used tiles are unmapped first.
+*/
+class hgt_cache
+{
+public:
+	using ll_t = float;
+	using height_t = float;
+	// Fill grid for the tile with south west corner lat, lon, false when no data
+	using convert_func = std::function<bool(int lat, int lon, hgt_grid &grid)>;
+
+	static constexpr uint16_t BLOCK = 64;
+
+	hgt_cache(const std::string &folder, convert_func convert,
+			size_t max_bytes = 512 << 20);
+	~hgt_cache();
+
+	void set_max_bytes(size_t bytes);
+	// First wait before an incomplete tile is made again, doubled on every
+	// failure up to 64 times
+	void set_retry_ms(uint32_t ms) { m_retry_ms = ms; }
+	height_t get(ll_t lat, ll_t lon);
+	// size_x * size_z heights from lat, lon going by step_lat, step_lon, x first
+	void get_area(double lat, double lon, double step_lat, double step_lon,
+			size_t size_x, size_t size_z, height_t *out);
+
+	size_t get_resident_bytes() const { return m_resident_bytes; }
+	size_t get_resident_tiles();
+
+	// Write grid in native format, false on bad grid or io error
+	static bool save(const std::string &path, const hgt_grid &grid);
+
+private:
+	struct tile;
+	struct slot;
+
+	static constexpr int SLOTS = 180 * 360;
+
+	static int slot_index(int lat, int lon) { return (lat + 90) * 360 + lon + 180; }
+	std::string tile_path(int lat, int lon) const;
+	// Shared by the slots of tiles without data, never unmapped
+	static const tile *zero_tile();
+
+	const tile *acquire(int index);
+	void release(int index);
+	void load(int index);
+	void evict(int keep);
+	// Unload a READY slot with m_lru_mutex held, false if it is not READY
+	bool unload(int index);
+
+	const std::string m_folder;
+	const convert_func m_convert;
+	std::atomic<size_t> m_max_bytes;
+	std::atomic<uint32_t> m_retry_ms{60000};
+	std::atomic<size_t> m_resident_bytes{0};
+	// Bumped on every load, slots keep the value of their last use
+	std::atomic<uint32_t> m_clock{0};
+	std::unique_ptr<slot[]> m_slots;
+
+	// Guards m_resident and unmapping
+	std::mutex m_lru_mutex;
+	std::vector<int> m_resident;
+};
@@ -8,7 +8,54 @@
 #include "httpfetch.h"
 #include "log.h"
 #include "settings.h"
-#include "threading/concurrent_set.h"
+#include "porting.h"
+#include "threading/concurrent_map.h"
+
+namespace
+{
+thread_local size_t transient_failures = 0;
+
+// Names that failed and when to try them again, never for missing ones
+concurrent_map<std::string, u64> http_failed;
+constexpr u64 HTTP_RETRY_NEVER = U64_MAX;
+constexpr u64 HTTP_RETRY_SECONDS = 60;
+
+// Try links one by one, remember the failure under key
+size_t links_to_file(const std::string &key, const std::vector<std::string> &links,
+		const std::string &path)
+{
+	if (const auto retry = http_failed.get(key); retry && porting::getTimeS() < retry)
+		return 0;
+
+	const auto failures = transient_failures;
+	for (const auto &uri : links) {
+		if (const auto size = http_to_file(uri, path)) {
+			http_failed.erase(key);
+			return size;
+		}
+	}
+
+	http_failed.insert_or_assign(key, transient_failures == failures
+													  ? HTTP_RETRY_NEVER
+													  : porting::getTimeS() + HTTP_RETRY_SECONDS);
+
+	infostream
+			<< "Not found " << key << "\n"
+			<< "try to download manually: \n"
+			<< "curl -o " << path << " "
+			<< links[0]
+			//<< "curl -o " << zipfull << " https://viewfinderpanoramas.org/dem1/" << zipfile
+			//<< " || " << "curl -o " << zipfull << " https://viewfinderpanoramas.org/dem3/" << zipfile
+			<< "\n";
+
+	return 0;
+}
+}
+
+size_t http_transient_failures()
+{
+	return transient_failures;
+}
 
 size_t http_to_file(const std::string &url, const std::string &path)
 {
@@ -37,6 +84,10 @@ size_t http_to_file(const std::string &url, const std::string &path)
 	actionstream << req.url << " " << res.succeeded << " " << res.response_code << " "
 				 << res.data.size() << "\n";
 	if (!res.succeeded || res.response_code >= 300) {
+		// No answer, timeout or server error may work next time
+		if (!res.succeeded || res.response_code == 408 || res.response_code == 429 ||
+				res.response_code >= 500)
+			++transient_failures;
 		return uintmax_t{0};
 	}
 
@@ -73,28 +124,7 @@ size_t multi_http_to_file(
 		std::filesystem::remove(path, ec);
 	}
 
-	static concurrent_set<std::string> http_failed;
-	if (http_failed.contains(name))
-		return 0;
-
-	for (const auto &uri : links) {
-		if (const auto size = http_to_file(uri, path)) {
-			return size;
-		}
-	}
-
-	http_failed.insert(name);
-
-	infostream
-			<< "Not found " << name << "\n"
-			<< "try to download manually: \n"
-			<< "curl -o " << path << " "
-			<< links[0]
-			//<< "curl -o " << zipfull << " https://viewfinderpanoramas.org/dem1/" << zipfile
-			//<< " || " << "curl -o " << zipfull << " https://viewfinderpanoramas.org/dem3/" << zipfile
-			<< "\n";
-
-	return 0;
+	return links_to_file(name, links, path);
 };
 
 size_t multi_http_to_file_cdn(const std::string &dir, const std::string &name,
@@ -119,28 +149,7 @@ size_t multi_http_to_file(const std::vector<std::string> &links, const std::stri
 		std::filesystem::remove(path, ec);
 	}
 
-	static concurrent_set<std::string> http_failed;
-	if (http_failed.contains(path))
-		return 0;
-
-	for (const auto &uri : links) {
-		if (const auto size = http_to_file(uri, path)) {
-			return size;
-		}
-	}
-
-	http_failed.emplace(path);
-
-	infostream
-			<< "Not found " << path << "\n"
-			<< "try to download manually: \n"
-			<< "curl -o " << path << " "
-			<< links[0]
-			//<< "curl -o " << zipfull << " https://viewfinderpanoramas.org/dem1/" << zipfile
-			//<< " || " << "curl -o " << zipfull << " https://viewfinderpanoramas.org/dem3/" << zipfile
-			<< "\n";
-
-	return 0;
+	return links_to_file(path, links, path);
 };
 
 std::string exec_to_string(const std::string &cmd)
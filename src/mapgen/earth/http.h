@@ -11,4 +11,8 @@ size_t multi_http_to_file(
 size_t multi_http_to_file_cdn(const std::string &dir, const std::string &name,
 		std::vector<std::string> links, const std::string &path = {});
 
+// Downloads of this thread that failed for now and may work later:
+// no answer, timeout or server error. Missing files are not counted.
+size_t http_transient_failures();
+
 std::string exec_to_string(const std::string &cmd);
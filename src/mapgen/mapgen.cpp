@@ -153,6 +153,7 @@ Mapgen::Mapgen(int mapgenid, MapgenParams *params, EmergeParams *emerge) :
 
 	m_emerge  = emerge;
 	ndef      = emerge->ndef;
+	tile_placer = emerge->tile_placer;
 }
 
 Mapgen::~Mapgen()
@@ -161,6 +162,16 @@ Mapgen::~Mapgen()
 }
 
 
+void Mapgen::shareNoise2D(std::initializer_list<Noise *> noises)
+{
+	if (!m_emerge || !m_emerge->noise_cache)
+		return;
+	for (Noise *noise : noises)
+		if (noise)
+			noise->tile_cache = m_emerge->noise_cache;
+}
+
+
 MapgenType Mapgen::getMapgenType(const std::string &mgname)
 {
 	for (size_t i = 0; i != ARRLEN(g_reg_mapgens); i++) {
@@ -47,6 +47,7 @@ struct BlockMakeData;
 class VoxelArea;
 class Map;
 class ServerEnvironment;
+class TilePlacer;
 
 enum MapgenObject {
 	MGOBJ_VMANIP,
@@ -187,6 +188,8 @@ class Mapgen {
 
 	BiomeGen *biomegen = nullptr;
 	GenerateNotifier gennotify;
+	// Places ores and decorations in parallel if set, shared
+	TilePlacer *tile_placer = nullptr;
 
 	Mapgen() = default;
 	Mapgen(int mapgenid, MapgenParams *params, EmergeParams *emerge);
@@ -205,6 +208,10 @@ class Mapgen {
 
 	void updateLiquid(UniqueQueue<v3pos_t> *trans_liquid, v3pos_t nmin, v3pos_t nmax);
 
+	// fm: Share the 2D maps of these noises with the other emerge threads,
+	// null noises are skipped
+	void shareNoise2D(std::initializer_list<Noise *> noises);
+
 	/**
 	 * Set light in entire area to fixed value.
 	 * @param light Light value (contains both banks)
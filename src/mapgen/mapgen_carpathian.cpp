@@ -71,6 +71,9 @@ MapgenCarpathian::MapgenCarpathian(MapgenCarpathianParams *params, EmergeParams
 	noise_step_mnt      = new Noise(&params->np_step_mnt,      seed, csize.X, csize.Z);
 	if (spflags & MGCARPATHIAN_RIVERS)
 		noise_rivers    = new Noise(&params->np_rivers,        seed, csize.X, csize.Z);
+	shareNoise2D({noise_filler_depth, noise_height1, noise_height2, noise_height3,
+			noise_height4, noise_hills_terrain, noise_ridge_terrain, noise_step_terrain,
+			noise_hills, noise_ridge_mnt, noise_step_mnt, noise_rivers});
 
 	//// 3D terrain noise
 	// 1 up 1 down overgeneration
@@ -381,6 +381,8 @@ MapgenEarth::MapgenEarth(MapgenEarthParams *params_, EmergeParams *emerge) :
 
 	if (!maps_holder) {
 		maps_holder = std::make_unique<maps_holder_t>();
+		maps_holder->hgt_reader.set_cache_size(
+				(size_t)params.get("hgt_cache_mb", 512).asUInt() << 20);
 	}
 
 	{
@@ -616,6 +618,38 @@ pos_t MapgenEarth::get_height(pos_t x, pos_t z)
 	return ceil(y / scale.Y) - center.Y;
 }
 
+void MapgenEarth::get_heights(v2pos_t pmin, v2pos_t pmax, std::vector<pos_t> &out)
+{
+	const size_t size_x = pmax.X - pmin.X + 1;
+	const size_t size_z = pmax.Y - pmin.Y + 1;
+	out.resize(size_x * size_z);
+
+	const double step_lon = scale.X / (EQUATOR_LEN / 360.0);
+	const double step_lat = scale.Z / (EQUATOR_LEN / 360.0);
+	const double lon_min = pmin.X * step_lon + center.X;
+	const double lat_min = pmin.Y * step_lat + center.Z;
+	const double lon_max = pmax.X * step_lon + center.X;
+	const double lat_max = pmax.Y * step_lat + center.Z;
+	const auto inside = [](double lat, double lon) {
+		return lat < 90 && lat > -90 && lon < 180 && lon > -180;
+	};
+
+	if (!inside(lat_min, lon_min) || !inside(lat_max, lon_max)) {
+		// pos_to_ll clamps positions out of the globe
+		size_t i = 0;
+		for (pos_t z = pmin.Y; z <= pmax.Y; ++z)
+			for (pos_t x = pmin.X; x <= pmax.X; ++x)
+				out[i++] = get_height(x, z);
+		return;
+	}
+
+	std::vector<height::height_t> heights(out.size());
+	maps_holder->hgt_reader.get_area(
+			lat_min, lon_min, step_lat, step_lon, size_x, size_z, heights.data());
+	for (size_t i = 0; i < out.size(); ++i)
+		out[i] = ceil(heights[i] / scale.Y) - center.Y;
+}
+
 pos_t MapgenEarth::getSpawnLevelAtPoint(v2pos_t p)
 {
 	return std::max(2, get_height(p.X, p.Y) + 2);
@@ -631,6 +665,8 @@ int MapgenEarth::generateTerrain()
 	const MapNode n_ice(c_ice);
 	u32 index = 0;
 	const auto em = vm->m_area.getExtent();
+	get_heights(v2pos_t(node_min.X, node_min.Z), v2pos_t(node_max.X, node_max.Z),
+			chunk_heights);
 
 	for (pos_t z = node_min.Z; z <= node_max.Z; z++) {
 		for (pos_t x = node_min.X; x <= node_max.X; x++, index++) {
@@ -639,7 +675,7 @@ int MapgenEarth::generateTerrain()
 							? m_emerge->env->getServerMap().updateBlockHeat(m_emerge->env,
 									  v3pos_t(x, node_max.Y, z), nullptr, &heat_cache)
 							: 0;
-			const auto height = get_height(x, z);
+			const auto height = chunk_heights[index];
 			u32 i = vm->m_area.index(x, node_min.Y, z);
 			for (pos_t y = node_min.Y; y <= node_max.Y; y++) {
 				bool underground = height >= y;
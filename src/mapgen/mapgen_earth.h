@@ -26,6 +26,7 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "earth/hgt.h"
 #include "mapgen/mapgen_v7.h"
@@ -120,6 +121,7 @@ class MapgenEarth : public MapgenV7
 	v3d scale{1, 1, 1};
 	v3d center{0, 0, 0};
 	bool no_layers = false;
+	std::vector<pos_t> chunk_heights;
 
 	MapNode n_air, n_water, n_stone;
 
@@ -128,6 +130,8 @@ class MapgenEarth : public MapgenV7
 	MapNode visible_content(const v3pos_t &p, bool use_weather) override;
 
 	pos_t get_height(pos_t x, pos_t z);
+	// Heights of all columns of pmin..pmax, x first
+	void get_heights(v2pos_t pmin, v2pos_t pmax, std::vector<pos_t> &out);
 	ll pos_to_ll(pos_t x, pos_t z);
 	ll pos_to_ll(const v3pos_t &p);
 	v2pos_t ll_to_pos(const ll &l);
@@ -60,6 +60,7 @@ MapgenFlat::MapgenFlat(MapgenFlatParams *params, EmergeParams *emerge)
 
 	if ((spflags & MGFLAT_LAKES) || (spflags & MGFLAT_HILLS))
 		noise_terrain = new Noise(&params->np_terrain, seed, csize.X, csize.Z);
+	shareNoise2D({noise_filler_depth, noise_terrain});
 
 	// 3D noise
 	MapgenBasic::np_cave1    = params->np_cave1;
@@ -59,6 +59,7 @@ MapgenFractal::MapgenFractal(MapgenFractalParams *params, EmergeParams *emerge)
 		noise_seabed = new Noise(&params->np_seabed, seed, csize.X, csize.Z);
 
 	noise_filler_depth = new Noise(&params->np_filler_depth, seed, csize.X, csize.Z);
+	shareNoise2D({noise_seabed, noise_filler_depth});
 
 	//// 3D noise
 	MapgenBasic::np_dungeons = params->np_dungeons;
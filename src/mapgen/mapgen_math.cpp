@@ -21,8 +21,11 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "servermap.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <functional>
+#include <limits>
 #include <cstdint>
 
 #include "mapgen_math.h"
@@ -86,13 +89,98 @@ z: [-2.0 , 2.0]
 
 */
 
-inline double mandelbox(double x, double y, double z, double d, int nn = 10, int seed = 1)
+#if defined(__x86_64__) && defined(__GLIBC__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define MATH_KERNEL __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef MATH_KERNEL
+#define MATH_KERNEL
+#endif
+
+// Batch kernels run blocks of DE_LANES points through every iteration
+// together, results are the same as of the scalar ones. Wider vectors than
+// AVX2 has are slower.
+constexpr size_t DE_LANES = 4;
+
+#if defined(__GNUC__)
+#define MATH_VECTOR 1
+typedef double de_vec __attribute__((vector_size(DE_LANES * sizeof(double))));
+typedef s64 de_mask __attribute__((vector_size(DE_LANES * sizeof(double))));
+
+// Load a block, a short last block repeats its last point
+__attribute__((always_inline)) static inline void de_load(const double *p, size_t base, size_t count, de_vec &v)
+{
+	for (size_t l = 0; l < DE_LANES; l++)
+		v[l] = p[std::min(base + l, count - 1)];
+}
+#endif
+
+// Intervals of the values the scalar estimates take over a box of points.
+// Every step is widened by much more than its rounding error, so the
+// rounded per point values stay inside.
+struct de_range
+{
+	double lo, hi;
+};
+
+static inline de_range de_widen(de_range a, double magnitude)
+{
+	const double e = magnitude * 1e-9 + std::numeric_limits<double>::min();
+	return {a.lo - e, a.hi + e};
+}
+
+static inline double de_magnitude(de_range a)
+{
+	return std::max(fabs(a.lo), fabs(a.hi));
+}
+
+static inline de_range de_hull(de_range a, de_range b)
+{
+	return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+static inline de_range de_mul(de_range a, de_range b)
+{
+	const double p[] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+	return {*std::min_element(p, p + 4), *std::max_element(p, p + 4)};
+}
+
+static inline de_range de_sqr(de_range a)
+{
+	if (a.lo >= 0)
+		return {a.lo * a.lo, a.hi * a.hi};
+	if (a.hi <= 0)
+		return {a.hi * a.hi, a.lo * a.lo};
+	return {0, std::max(a.lo * a.lo, a.hi * a.hi)};
+}
+
+static inline de_range de_length2(const de_range *v)
+{
+	de_range r{0, 0};
+	for (int i = 0; i < 3; i++) {
+		r.lo += de_sqr(v[i]).lo;
+		r.hi += de_sqr(v[i]).hi;
+	}
+	r = de_widen(r, r.hi);
+	return {std::max(r.lo, 0.0), r.hi};
+}
+
+// Nothing is known about the estimate in the box
+constexpr de_range DE_UNBOUNDED{0, INFINITY};
+
+static inline bool de_finite(de_range a)
+{
+	return std::isfinite(a.lo) && std::isfinite(a.hi);
+}
+
+// Distance estimate of the mandelbox, in mandelbox space (7 per unit)
+double mandelbox_de(double x, double y, double z, int nn)
 {
 	int s = 7;
 	x *= s;
 	y *= s;
 	z *= s;
-	d *= s;
 
 	double posX = x;
 	double posY = y;
@@ -142,11 +230,143 @@ inline double mandelbox(double x, double y, double z, double d, int nn = 10, int
 		dr *= scale;
 	}
 	r = sqrt(x * x + y * y + z * z);
-	return ((r / fabs(dr)) < d);
+	return r / fabs(dr);
 }
 
-inline double mengersponge(
-		double x, double y, double z, double d, int MI = 10, int seed = 1)
+MATH_KERNEL
+void mandelbox_de_batch(const double *px, const double *py, const double *pz,
+		double *out, size_t count, int nn)
+{
+#if MATH_VECTOR
+	const double scale = 2;
+	const double minRadius2 = 0.25;
+
+	for (size_t base = 0; base < count; base += DE_LANES) {
+		de_vec x, y, z;
+		de_load(px, base, count, x);
+		de_load(py, base, count, y);
+		de_load(pz, base, count, z);
+		x *= 7;
+		y *= 7;
+		z *= 7;
+		const de_vec posX = x, posY = y, posZ = z;
+		de_vec dr = de_vec{} + 1.0;
+		de_vec fixedRadius2 = de_vec{} + 1.0;
+
+		for (int n = 0; n < nn; n++) {
+			// Reflect
+			x = x > 1.0 ? 2.0 - x : x < -1.0 ? -2.0 - x : x;
+			y = y > 1.0 ? 2.0 - y : y < -1.0 ? -2.0 - y : y;
+			z = z > 1.0 ? 2.0 - z : z < -1.0 ? -2.0 - z : z;
+
+			// Sphere Inversion
+			const de_vec r2 = x * x + y * y + z * z;
+			const de_mask in_min = (de_mask)(r2 < minRadius2);
+			const de_mask in_fixed = ~in_min & (de_mask)(r2 < fixedRadius2);
+			const de_mask fold = in_min | in_fixed;
+			const de_vec div = in_min ? de_vec{} + minRadius2 : r2;
+			x = fold ? x * fixedRadius2 / div : x;
+			y = fold ? y * fixedRadius2 / div : y;
+			z = fold ? z * fixedRadius2 / div : z;
+			dr = in_min ? dr * fixedRadius2 / minRadius2 : dr;
+			fixedRadius2 = in_fixed ? fixedRadius2 * (fixedRadius2 / r2) : fixedRadius2;
+
+			x = x * scale + posX;
+			y = y * scale + posY;
+			z = z * scale + posZ;
+			dr *= scale;
+		}
+
+		const size_t lanes = std::min(DE_LANES, count - base);
+		for (size_t l = 0; l < lanes; l++)
+			out[base + l] = sqrt(x[l] * x[l] + y[l] * y[l] + z[l] * z[l]) / fabs(dr[l]);
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+		out[i] = mandelbox_de(px[i], py[i], pz[i], nn);
+#endif
+}
+
+// Folds x into [-1, 1] like the reflect step, continuous and monotone
+// between the folds
+static de_range mandelbox_reflect(de_range a)
+{
+	const auto f = [](double x) { return x > 1.0 ? 2.0 - x : x < -1.0 ? -2.0 - x : x; };
+	de_range r{std::min(f(a.lo), f(a.hi)), std::max(f(a.lo), f(a.hi))};
+	if (a.lo <= 1.0 && a.hi >= 1.0)
+		r.hi = std::max(r.hi, 1.0);
+	if (a.lo <= -1.0 && a.hi >= -1.0)
+		r.lo = std::min(r.lo, -1.0);
+	return de_widen(r, 2);
+}
+
+std::pair<double, double> mandelbox_de_box(v3f pmin, v3f pmax, int nn)
+{
+	const double scale = 2;
+	const double minRadius2 = 0.25;
+
+	de_range p[3] = {{pmin.X * 7.0, pmax.X * 7.0}, {pmin.Y * 7.0, pmax.Y * 7.0},
+			{pmin.Z * 7.0, pmax.Z * 7.0}};
+	de_range v[3] = {p[0], p[1], p[2]};
+	de_range dr{1, 1};
+	de_range fixedRadius2{1, 1};
+
+	for (int n = 0; n < nn; n++) {
+		for (auto &c : v)
+			c = mandelbox_reflect(c);
+
+		const de_range r2 = de_length2(v);
+
+		// Hull of the sphere inversion branches the points can take
+		de_range out[3], out_dr, out_fixed;
+		bool any = false;
+		const auto add = [&](const de_range k, de_range d, de_range f) {
+			for (int i = 0; i < 3; i++) {
+				const de_range c = de_mul(v[i], k);
+				out[i] = any ? de_hull(out[i], c) : c;
+			}
+			out_dr = any ? de_hull(out_dr, d) : d;
+			out_fixed = any ? de_hull(out_fixed, f) : f;
+			any = true;
+		};
+		if (r2.lo < minRadius2) {
+			const de_range k{fixedRadius2.lo / minRadius2, fixedRadius2.hi / minRadius2};
+			add(k, de_mul(dr, k), fixedRadius2);
+		}
+		if (r2.hi >= minRadius2 && r2.lo < fixedRadius2.hi) {
+			const de_range r2_fixed{std::max(r2.lo, minRadius2),
+					std::min(r2.hi, fixedRadius2.hi)};
+			const de_range k{fixedRadius2.lo / r2_fixed.hi, fixedRadius2.hi / r2_fixed.lo};
+			add(k, dr, de_mul(fixedRadius2, k));
+		}
+		if (r2.hi >= fixedRadius2.lo)
+			add({1, 1}, dr, fixedRadius2);
+
+		for (int i = 0; i < 3; i++) {
+			const de_range c = de_widen(out[i], de_magnitude(out[i]));
+			v[i] = de_widen({c.lo * scale + p[i].lo, c.hi * scale + p[i].hi},
+					de_magnitude(c) * scale + de_magnitude(p[i]));
+		}
+		dr = de_widen({out_dr.lo * scale, out_dr.hi * scale}, out_dr.hi * scale);
+		fixedRadius2 = de_widen(out_fixed, out_fixed.hi);
+		if (!de_finite(v[0]) || !de_finite(v[1]) || !de_finite(v[2]) ||
+				!de_finite(dr) || dr.lo <= 0)
+			return {DE_UNBOUNDED.lo, DE_UNBOUNDED.hi};
+	}
+
+	const de_range r2 = de_length2(v);
+	const de_range de = de_widen(
+			{sqrt(r2.lo) / dr.hi, sqrt(r2.hi) / dr.lo}, sqrt(r2.hi) / dr.lo);
+	return {std::max(de.lo, 0.0), de.hi};
+}
+
+inline double mandelbox(double x, double y, double z, double d, int nn = 10, int seed = 1)
+{
+	return mandelbox_de(x, y, z, nn) < d * 7;
+}
+
+// Distance estimate of the menger sponge
+double mengersponge_de(double x, double y, double z, int MI)
 {
 	double r = x * x + y * y + z * z;
 	double scale = 3;
@@ -181,12 +401,160 @@ inline double mengersponge(
 			z -= 1 * (scale - 1);
 		r = x * x + y * y + z * z;
 	}
-	return ((sqrt(r)) * pow(scale, (-i)) < d);
+	return (sqrt(r)) * pow(scale, (-i));
+}
+
+MATH_KERNEL
+void mengersponge_de_batch(const double *px, const double *py, const double *pz,
+		double *out, size_t count, int MI)
+{
+#if MATH_VECTOR
+	const double scale = 3;
+	std::vector<double> scale_pow(MI + 1);
+	for (int i = 0; i <= MI; i++)
+		scale_pow[i] = pow(scale, (-i));
+
+	for (size_t base = 0; base < count; base += DE_LANES) {
+		de_vec x, y, z;
+		de_load(px, base, count, x);
+		de_load(py, base, count, y);
+		de_load(pz, base, count, z);
+		de_vec r = x * x + y * y + z * z;
+		de_vec iters = de_vec{};
+
+		// Lanes past the bailout keep their values
+		for (int i = 0; i < MI; i++) {
+			const de_mask active = (de_mask)(r < 9.0);
+			bool any = false;
+			for (size_t l = 0; l < DE_LANES; l++)
+				any |= active[l] != 0;
+			if (!any)
+				break;
+
+			// fabs
+			de_vec xl = (de_vec)((de_mask)x & INT64_MAX), t;
+			de_vec yl = (de_vec)((de_mask)y & INT64_MAX);
+			de_vec zl = (de_vec)((de_mask)z & INT64_MAX);
+			de_mask swap = (de_mask)(xl - yl < 0);
+			t = swap ? yl : xl;
+			yl = swap ? xl : yl;
+			xl = t;
+			swap = (de_mask)(xl - zl < 0);
+			t = swap ? zl : xl;
+			zl = swap ? xl : zl;
+			xl = t;
+			swap = (de_mask)(yl - zl < 0);
+			t = swap ? zl : yl;
+			zl = swap ? yl : zl;
+			yl = t;
+
+			xl = scale * xl - 1 * (scale - 1);
+			yl = scale * yl - 1 * (scale - 1);
+			zl = scale * zl;
+			zl = zl > 0.5 * 1 * (scale - 1) ? zl - 1 * (scale - 1) : zl;
+
+			x = active ? xl : x;
+			y = active ? yl : y;
+			z = active ? zl : z;
+			r = active ? xl * xl + yl * yl + zl * zl : r;
+			iters = active ? iters + 1.0 : iters;
+		}
+
+		const size_t lanes = std::min(DE_LANES, count - base);
+		for (size_t l = 0; l < lanes; l++)
+			out[base + l] = (sqrt(r[l])) * scale_pow[(int)iters[l]];
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+		out[i] = mengersponge_de(px[i], py[i], pz[i], MI);
+#endif
+}
+
+std::pair<double, double> mengersponge_de_box(v3f pmin, v3f pmax, int MI)
+{
+	const double scale = 3;
+	de_range v[3] = {{pmin.X, pmax.X}, {pmin.Y, pmax.Y}, {pmin.Z, pmax.Z}};
+	de_range r = de_length2(v);
+
+	// Hull of the estimates of the points that already bailed out
+	de_range de{INFINITY, -INFINITY};
+	const auto bail = [&](de_range r, int i) {
+		const double s = pow(scale, (-i));
+		de = de_hull(de, de_widen({sqrt(r.lo) * s, sqrt(r.hi) * s}, sqrt(r.hi) * s));
+	};
+
+	for (int i = 0; i < MI; i++) {
+		if (r.hi >= 9)
+			bail({std::max(r.lo, 9.0), r.hi}, i);
+		if (r.lo >= 9)
+			return {std::max(de.lo, 0.0), de.hi};
+
+		for (auto &c : v)
+			c = c.lo >= 0 ? c : c.hi <= 0 ? de_range{-c.hi, -c.lo}
+										 : de_range{0, de_magnitude(c)};
+
+		// Sorting is monotone in every coordinate
+		const auto sorted = [&v](double de_range::*end) {
+			double e[] = {v[0].*end, v[1].*end, v[2].*end};
+			std::sort(e, e + 3);
+			return std::array<double, 3>{e[2], e[1], e[0]};
+		};
+		const auto lo = sorted(&de_range::lo), hi = sorted(&de_range::hi);
+		for (int k = 0; k < 3; k++)
+			v[k] = {lo[k], hi[k]};
+
+		v[0] = {scale * v[0].lo - 1 * (scale - 1), scale * v[0].hi - 1 * (scale - 1)};
+		v[1] = {scale * v[1].lo - 1 * (scale - 1), scale * v[1].hi - 1 * (scale - 1)};
+		v[2] = {scale * v[2].lo, scale * v[2].hi};
+		const double fold = 0.5 * 1 * (scale - 1);
+		if (v[2].lo > fold)
+			v[2] = {v[2].lo - 1 * (scale - 1), v[2].hi - 1 * (scale - 1)};
+		else if (v[2].hi > fold)
+			v[2] = de_hull({v[2].lo, fold}, {fold - 1 * (scale - 1), v[2].hi - 1 * (scale - 1)});
+		for (auto &c : v)
+			c = de_widen(c, de_magnitude(c) + scale);
+		r = de_length2(v);
+		if (!de_finite(r))
+			return {DE_UNBOUNDED.lo, DE_UNBOUNDED.hi};
+	}
+	bail(r, MI);
+	return {std::max(de.lo, 0.0), de.hi};
+}
+
+inline double mengersponge(
+		double x, double y, double z, double d, int MI = 10, int seed = 1)
+{
+	return mengersponge_de(x, y, z, MI) < d;
+}
+
+double sphere_de(double x, double y, double z, int ITR)
+{
+	return v3f(x, y, z).getLength();
+}
+
+void sphere_de_batch(const double *px, const double *py, const double *pz,
+		double *out, size_t count, int ITR)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = sphere_de(px[i], py[i], pz[i], ITR);
+}
+
+std::pair<double, double> sphere_de_box(v3f pmin, v3f pmax, int ITR)
+{
+	double lo = 0, hi = 0;
+	for (const auto &[a, b] : {std::pair{pmin.X, pmax.X}, std::pair{pmin.Y, pmax.Y},
+				 std::pair{pmin.Z, pmax.Z}}) {
+		const double nearest = a > 0 ? a : b < 0 ? b : 0;
+		lo += (double)nearest * nearest;
+		hi += std::max((double)a * a, (double)b * b);
+	}
+	// sphere_de rounds to float
+	return {sqrt(lo) * (1 - 1e-6), sqrt(hi) * (1 + 1e-6)};
 }
 
 inline double sphere(double x, double y, double z, double d, int ITR = 1, int seed = 1)
 {
-	return v3f(x, y, z).getLength() < d;
+	return sphere_de(x, y, z, ITR) < d;
 }
 
 const unsigned FNV_32_PRIME = 0x01000193;
@@ -345,6 +713,8 @@ MapgenMath::MapgenMath(MapgenMathParams *params_, EmergeParams *emerge) :
 	if (params["generator"].asString() == "mengersponge") {
 		internal = 1;
 		func = &mengersponge;
+		func_de_batch = &mengersponge_de_batch;
+		func_de_box = &mengersponge_de_box;
 		size = params.get("size", (MAX_MAP_GENERATION_LIMIT - 1000) / 2).asDouble();
 		//scale = params.get("scale", 1.0 / size).asDouble();
 		iterations = params.get("N", 13).asInt();
@@ -354,6 +724,9 @@ MapgenMath::MapgenMath(MapgenMathParams *params_, EmergeParams *emerge) :
 	} else if (params["generator"].asString() == "mandelbox") {
 		internal = 1;
 		func = &mandelbox;
+		func_de_batch = &mandelbox_de_batch;
+		func_de_box = &mandelbox_de_box;
+		de_unit = 7;
 		iterations = params.get("N", 15).asInt();
 		size = params.get("size", 1000).asDouble();
 		//scale = params.get("scale", 1.0 / size).asDouble();
@@ -364,6 +737,8 @@ MapgenMath::MapgenMath(MapgenMathParams *params_, EmergeParams *emerge) :
 	} else if (params["generator"].asString() == "sphere") {
 		internal = 1;
 		func = &sphere;
+		func_de_batch = &sphere_de_batch;
+		func_de_box = &sphere_de_box;
 		invert = params.get("invert", 0).asBool();
 		size = params.get("size", 100).asDouble();
 		//scale = params.get("scale", 1.0 / size).asDouble();
@@ -375,6 +750,8 @@ MapgenMath::MapgenMath(MapgenMathParams *params_, EmergeParams *emerge) :
 		size = params.get("size", 1).asDouble();
 	}
 
+	hierarchical = params.get("hierarchical", false).asBool();
+
 #if USE_MANDELBULBER
 	sFractal &par = mg_params->par;
 	//par.minN = params.get("minN", 1).asInt();
@@ -636,13 +1013,19 @@ MapNode MapgenMath::layers_get(float value, float max)
 	return layers_node[layer_index];
 }
 
-std::pair<bool, double> MapgenMath::calc_point(pos_t x, pos_t y, pos_t z)
+v3f MapgenMath::toFractal(v3f p) const
 {
-	v3f vec = (v3f(x, y, z) - center) * scale;
+	v3f vec = (p - center) * scale;
 	if (invert_xy)
 		std::swap(vec.X, vec.Y);
 	if (invert_yz)
 		std::swap(vec.Y, vec.Z);
+	return vec;
+}
+
+std::pair<bool, double> MapgenMath::calc_point(pos_t x, pos_t y, pos_t z)
+{
+	v3f vec = toFractal(v3f(x, y, z));
 	double d = 0;
 #if USE_MANDELBULBER
 	if (!internal)
@@ -696,6 +1079,116 @@ MapNode MapgenMath::visible_content(const v3pos_t &p, bool use_weather)
 	return visible_transparent;
 }
 
+void MapgenMath::classifyChunk(v3pos_t pmin, v3pos_t pmax)
+{
+	m_solid_min = pmin;
+	m_solid_size = pmax - pmin + v3pos_t(1, 1, 1);
+	m_solid.resize((size_t)m_solid_size.X * m_solid_size.Y * m_solid_size.Z);
+
+	// Chunks far from the surface are filled at once
+	if (hierarchical && func_de_box) {
+		classifyBox(pmin, pmax);
+		return;
+	}
+
+	// Mapblock at a time to keep the buffers small
+	for (pos_t z = pmin.Z; z <= pmax.Z; z += MAP_BLOCKSIZE)
+	for (pos_t y = pmin.Y; y <= pmax.Y; y += MAP_BLOCKSIZE)
+	for (pos_t x = pmin.X; x <= pmax.X; x += MAP_BLOCKSIZE) {
+		const v3pos_t bmin(x, y, z);
+		const v3pos_t bmax(std::min<pos_t>(x + MAP_BLOCKSIZE - 1, pmax.X),
+				std::min<pos_t>(y + MAP_BLOCKSIZE - 1, pmax.Y),
+				std::min<pos_t>(z + MAP_BLOCKSIZE - 1, pmax.Z));
+		evaluateBox(bmin, bmax);
+	}
+}
+
+void MapgenMath::classifyBox(v3pos_t bmin, v3pos_t bmax)
+{
+	// Evaluating small boxes node by node is cheaper than splitting them
+	constexpr s32 LEAF_VOLUME = 64;
+	const v3pos_t size = bmax - bmin + v3pos_t(1, 1, 1);
+	if ((s32)size.X * size.Y * size.Z <= LEAF_VOLUME) {
+		evaluateBox(bmin, bmax);
+		return;
+	}
+
+	// toFractal is monotone along every axis, the corners bound all nodes
+	const v3f a = toFractal(v3f(bmin.X, bmin.Y, bmin.Z));
+	const v3f b = toFractal(v3f(bmax.X, bmax.Y, bmax.Z));
+	const auto [de_min, de_max] = func_de_box(
+			v3f(std::min(a.X, b.X), std::min(a.Y, b.Y), std::min(a.Z, b.Z)),
+			v3f(std::max(a.X, b.X), std::max(a.Y, b.Y), std::max(a.Z, b.Z)),
+			iterations);
+	// Same compare as evaluateBox
+	const double limit = (double)scale.X * de_unit;
+	if (de_min >= limit) {
+		fillBox(bmin, bmax, 0);
+		return;
+	}
+	if (de_max < limit) {
+		fillBox(bmin, bmax, 1);
+		return;
+	}
+
+	// Split along the longest side
+	v3pos_t amax = bmax, bmin2 = bmin;
+	if (size.X >= size.Y && size.X >= size.Z) {
+		amax.X = bmin.X + size.X / 2 - 1;
+		bmin2.X = amax.X + 1;
+	} else if (size.Y >= size.Z) {
+		amax.Y = bmin.Y + size.Y / 2 - 1;
+		bmin2.Y = amax.Y + 1;
+	} else {
+		amax.Z = bmin.Z + size.Z / 2 - 1;
+		bmin2.Z = amax.Z + 1;
+	}
+	classifyBox(bmin, amax);
+	classifyBox(bmin2, bmax);
+}
+
+void MapgenMath::evaluateBox(v3pos_t bmin, v3pos_t bmax)
+{
+	const size_t count = (size_t)(bmax.X - bmin.X + 1) * (bmax.Y - bmin.Y + 1) *
+						 (bmax.Z - bmin.Z + 1);
+	m_batch_x.resize(count);
+	m_batch_y.resize(count);
+	m_batch_z.resize(count);
+	m_batch_de.resize(count);
+
+	size_t i = 0;
+	for (pos_t z = bmin.Z; z <= bmax.Z; z++)
+	for (pos_t x = bmin.X; x <= bmax.X; x++)
+	for (pos_t y = bmin.Y; y <= bmax.Y; y++, i++) {
+		const v3f vec = toFractal(v3f(x, y, z));
+		m_batch_x[i] = vec.X;
+		m_batch_y[i] = vec.Y;
+		m_batch_z[i] = vec.Z;
+	}
+
+	func_de_batch(m_batch_x.data(), m_batch_y.data(), m_batch_z.data(),
+			m_batch_de.data(), count, iterations);
+
+	// Same compare as func
+	const double limit = (double)scale.X * de_unit;
+	i = 0;
+	for (pos_t z = bmin.Z; z <= bmax.Z; z++)
+	for (pos_t x = bmin.X; x <= bmax.X; x++) {
+		u8 *solid = &m_solid[solidIndex(x, bmin.Y, z)];
+		for (pos_t y = bmin.Y; y <= bmax.Y; y++, i++)
+			*solid++ = m_batch_de[i] < limit;
+	}
+}
+
+void MapgenMath::fillBox(v3pos_t bmin, v3pos_t bmax, u8 solid)
+{
+	for (pos_t z = bmin.Z; z <= bmax.Z; z++)
+	for (pos_t x = bmin.X; x <= bmax.X; x++) {
+		u8 *p = &m_solid[solidIndex(x, bmin.Y, z)];
+		std::fill(p, p + (bmax.Y - bmin.Y + 1), solid);
+	}
+}
+
 int MapgenMath::generateTerrain()
 {
 
@@ -725,6 +1218,13 @@ int MapgenMath::generateTerrain()
 	*/
 #endif
 
+	// Generators with a distance estimate are evaluated for the whole chunk
+	// at once
+	const bool batch = internal && func_de_batch;
+	if (batch)
+		classifyChunk(v3pos_t(node_min.X, node_min.Y - y_oversize_down, node_min.Z),
+				v3pos_t(node_max.X, node_max.Y + y_oversize_up, node_max.Z));
+
 	for (pos_t z = node_min.Z; z <= node_max.Z; z++) {
 		for (pos_t x = node_min.X; x <= node_max.X; x++) {
 			const auto heat =
@@ -740,7 +1240,8 @@ int MapgenMath::generateTerrain()
 					//cache_index++
 			) {
 				//for (pos_t y = node_min.Y - y_oversize_down; y <= node_max.Y + y_oversize_up; y++, index3d += ystride) {
-				auto [have, d] = calc_point(x, y, z);
+				const double d = batch ? m_solid[solidIndex(x, y, z)]
+									   : calc_point(x, y, z).second;
 				if ((!invert && d > 0) || (invert && d == 0)) {
 					if (!vm->m_data[vi]) {
 						//vm->m_data[i] = (y > water_level + biome->filler) ?
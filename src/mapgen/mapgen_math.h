@@ -22,6 +22,8 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "config.h"
+#include <utility>
+#include <vector>
 #include "irr_v3d.h"
 #include "mapgen/mapgen.h"
 #include "mapgen/mapgen_v7.h"
@@ -79,9 +81,55 @@ class MapgenMath : public MapgenV7
 	MapNode n_air, n_water, n_stone;
 
 	double (*func)(double, double, double, double, int, int);
+
+	// Distance estimate of func for many points, null if func has none.
+	// Points are solid where it is below the func distance times de_unit.
+	using de_batch_func = void (*)(const double *x, const double *y,
+			const double *z, double *out, size_t count, int iterations);
+	de_batch_func func_de_batch = nullptr;
+	// Bounds of the batch estimate over all points in a box, null if unknown
+	using de_box_func = std::pair<double, double> (*)(v3f min, v3f max, int iterations);
+	de_box_func func_de_box = nullptr;
+	double de_unit = 1;
+	// Fill boxes away from the surface without evaluating every node
+	bool hierarchical = false;
+
 	MapNode layers_get(float value, float max);
 	std::pair<bool, double> calc_point(pos_t x, pos_t y, pos_t z);
 	bool visible(const v3pos_t &p, std::optional<pos_t> surface_y) override;
 	MapNode visible_content(const v3pos_t &p, bool use_weather) override;
 	bool surface_2d() override { return false; };
+
+private:
+	v3f toFractal(v3f p) const;
+	// Fill m_solid for the whole generated area
+	void classifyChunk(v3pos_t pmin, v3pos_t pmax);
+	void classifyBox(v3pos_t bmin, v3pos_t bmax);
+	void evaluateBox(v3pos_t bmin, v3pos_t bmax);
+	void fillBox(v3pos_t bmin, v3pos_t bmax, u8 solid);
+	size_t solidIndex(pos_t x, pos_t y, pos_t z) const
+	{
+		return ((size_t)(z - m_solid_min.Z) * m_solid_size.X + (x - m_solid_min.X)) *
+					   m_solid_size.Y +
+			   (y - m_solid_min.Y);
+	}
+
+	// Solid flags of the generated area, z, x, y order
+	std::vector<u8> m_solid;
+	v3pos_t m_solid_min, m_solid_size;
+	std::vector<double> m_batch_x, m_batch_y, m_batch_z, m_batch_de;
 };
+
+// Distance estimates of the internal generators
+double mandelbox_de(double x, double y, double z, int nn);
+void mandelbox_de_batch(const double *x, const double *y, const double *z,
+		double *out, size_t count, int nn);
+std::pair<double, double> mandelbox_de_box(v3f min, v3f max, int nn);
+double mengersponge_de(double x, double y, double z, int MI);
+void mengersponge_de_batch(const double *x, const double *y, const double *z,
+		double *out, size_t count, int MI);
+std::pair<double, double> mengersponge_de_box(v3f min, v3f max, int MI);
+double sphere_de(double x, double y, double z, int ITR);
+void sphere_de_batch(const double *x, const double *y, const double *z,
+		double *out, size_t count, int ITR);
+std::pair<double, double> sphere_de_box(v3f min, v3f max, int ITR);
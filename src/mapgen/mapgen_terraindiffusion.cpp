@@ -34,11 +34,13 @@ along with Freeminer. If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 #include "emerge.h"
+#include "filesys.h"
 #include "httpfetch.h"
 #include "log.h"
 #include "mapnode.h"
 #include "noise.h"
 #include "nodedef.h"
+#include "porting.h"
 #include "serverenvironment.h"
 #include "servermap.h"
 #include "settings.h"
@@ -259,6 +261,8 @@ void MapgenTerrainDiffusionParams::readParams(const Settings *settings)
 	settings->getNoEx(
 			"mgterraindiffusion_native_conditioning_stats", native_conditioning_stats);
 	settings->getBoolNoEx("mgterraindiffusion_native_prefetch", native_prefetch);
+	settings->getU16NoEx("mgterraindiffusion_native_batch_size", native_batch_size);
+	settings->getBoolNoEx("mgterraindiffusion_native_disk_cache", native_disk_cache);
 	settings->getFloatNoEx("mgterraindiffusion_model_node_scale", model_node_scale);
 	settings->getFloatNoEx("mgterraindiffusion_model_height_scale", model_height_scale);
 	settings->getFloatNoEx("mgterraindiffusion_model_height_offset", model_height_offset);
@@ -281,6 +285,7 @@ void MapgenTerrainDiffusionParams::readParams(const Settings *settings)
 	native_cache_mb = rangelim(native_cache_mb, (u16)16, (u16)65535);
 	native_device_id = rangelim(native_device_id, (s16)0, (s16)255);
 	native_intra_threads = rangelim(native_intra_threads, (s16)1, (s16)256);
+	native_batch_size = rangelim(native_batch_size, (u16)1, (u16)64);
 	model_height_scale = rangelim(model_height_scale, -1000000.0f, 1000000.0f);
 	api_scale = rangelim(api_scale, (s16)1, (s16)64);
 	api_height_scale = rangelim(api_height_scale, -1000000.0f, 1000000.0f);
@@ -306,6 +311,8 @@ void MapgenTerrainDiffusionParams::writeParams(Settings *settings) const
 	settings->set(
 			"mgterraindiffusion_native_conditioning_stats", native_conditioning_stats);
 	settings->setBool("mgterraindiffusion_native_prefetch", native_prefetch);
+	settings->setU16("mgterraindiffusion_native_batch_size", native_batch_size);
+	settings->setBool("mgterraindiffusion_native_disk_cache", native_disk_cache);
 	settings->setFloat("mgterraindiffusion_model_node_scale", model_node_scale);
 	settings->setFloat("mgterraindiffusion_model_height_scale", model_height_scale);
 	settings->setFloat("mgterraindiffusion_model_height_offset", model_height_offset);
@@ -336,6 +343,8 @@ void MapgenTerrainDiffusionParams::setDefaultSettings(Settings *settings)
 	settings->setDefault("mgterraindiffusion_native_intra_threads", "8");
 	settings->setDefault("mgterraindiffusion_native_conditioning_stats", "");
 	settings->setDefault("mgterraindiffusion_native_prefetch", "false");
+	settings->setDefault("mgterraindiffusion_native_batch_size", "4");
+	settings->setDefault("mgterraindiffusion_native_disk_cache", "true");
 	settings->setDefault("mgterraindiffusion_model_node_scale", "1.0");
 	settings->setDefault("mgterraindiffusion_model_height_scale", "1.0");
 	settings->setDefault("mgterraindiffusion_model_height_offset", "0.0");
@@ -359,7 +368,10 @@ MapgenTerrainDiffusion::MapgenTerrainDiffusion(
 				mg_params->native_cache_tiles, mg_params->native_cache_mb,
 				mg_params->native_provider, mg_params->native_device_id,
 				mg_params->native_intra_threads, mg_params->native_conditioning_stats,
-				mg_params->native_prefetch))
+				mg_params->native_prefetch, mg_params->native_batch_size,
+				mg_params->native_disk_cache
+						? porting::path_cache + DIR_DELIM + "terraindiffusion"
+						: ""))
 {
 	if (!mg_params->native_model_dir.empty())
 		m_native->load(mg_params->native_model_dir);
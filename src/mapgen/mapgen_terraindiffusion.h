@@ -41,6 +41,8 @@ struct MapgenTerrainDiffusionParams : public MapgenV7Params
 	s16 native_intra_threads = 8;
 	std::string native_conditioning_stats;
 	bool native_prefetch = false;
+	u16 native_batch_size = 4;
+	bool native_disk_cache = true;
 	float model_node_scale = 1.0f;
 	float model_height_scale = 1.0f;
 	float model_height_offset = 0.0f;
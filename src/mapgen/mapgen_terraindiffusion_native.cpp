@@ -9,12 +9,15 @@ This file is part of Freeminer.
 #include <array>
 #include <cctype>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <deque>
 #include <fstream>
 #include <limits>
 #include <map>
 #include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <unordered_map>
 #include <unordered_set>
@@ -32,8 +35,10 @@ This file is part of Freeminer.
 #include "mapgen_terraindiffusion.h"
 #include "noise.h"
 #include "porting.h"
+#include "serialization.h"
 #include "threading/ThreadPool.h"
 #include "util/numeric.h"
+#include "util/serialize.h"
 
 namespace
 {
@@ -45,6 +50,9 @@ constexpr float SIGMA_MIN = 0.002f;
 constexpr float SIGMA_MAX = 80.0f;
 constexpr float LOWFREQ_MEAN = -31.4f;
 constexpr float LOWFREQ_STD = 38.6f;
+// Decoded tiles on disk: magic, decoder size, zstd compressed samples
+constexpr uint32_t TILE_FILE_MAGIC = 0x54445431; // "TDT1"
+constexpr size_t TILE_FILE_RECORD = 8;
 
 int floorDiv(int value, int divisor)
 {
@@ -312,6 +320,39 @@ class OnnxStage
 
 	size_t inputCount() const { return m_input_names.size(); }
 
+	// All inputs take any N in dimension 0, so items can share one run()
+	bool batchable() const
+	{
+		for (const auto &shape : m_input_shapes)
+			if (shape.empty() || shape[0] > 0)
+				return false;
+		return !m_input_shapes.empty();
+	}
+
+	// Run several items with the input shapes of one, stacked along dimension 0
+	bool runBatch(const std::vector<std::vector<std::vector<float>>> &items,
+			const std::vector<std::vector<int64_t>> &item_shapes,
+			std::vector<std::vector<float>> &outputs) const
+	{
+		outputs.resize(items.size());
+		if (items.size() == 1)
+			return run(items[0], item_shapes, outputs[0]);
+		std::vector<std::vector<float>> stacked(item_shapes.size());
+		std::vector<std::vector<int64_t>> shapes = item_shapes;
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			shapes[i][0] = static_cast<int64_t>(items.size());
+			for (const auto &item : items)
+				stacked[i].insert(stacked[i].end(), item[i].begin(), item[i].end());
+		}
+		std::vector<float> output;
+		if (!run(stacked, shapes, output) || output.size() % items.size())
+			return false;
+		const size_t size = output.size() / items.size();
+		for (size_t n = 0; n < items.size(); ++n)
+			outputs[n].assign(output.begin() + n * size, output.begin() + (n + 1) * size);
+		return true;
+	}
+
 	bool run(const std::vector<std::vector<float>> &input_data,
 			const std::vector<std::vector<int64_t>> &input_shapes,
 			std::vector<float> &output) const
@@ -364,6 +405,23 @@ bool hasProvider(const std::vector<std::string> &providers, const std::string &p
 	return std::find(providers.begin(), providers.end(), provider) != providers.end();
 }
 
+// Hash of the file contents, stable between builds unlike std::hash.
+// Missing files hash as empty.
+u64 hashFileContents(const std::string &path, u64 hash)
+{
+	std::ifstream input(path, std::ios::binary);
+	std::vector<char> buffer(1 << 20);
+	while (input) {
+		input.read(buffer.data(), buffer.size());
+		const std::streamsize got = input.gcount();
+		if (got <= 0)
+			break;
+		const u64 chunk[2] = {hash, murmur_hash_64_ua(buffer.data(), got, 0x5444)};
+		hash = murmur_hash_64_ua(chunk, sizeof(chunk), 0x5444);
+	}
+	return hash;
+}
+
 std::shared_ptr<SharedModels> acquireSharedModels(const std::string &model_dir,
 		std::string requested_provider, int device_id, int intra_threads)
 {
@@ -428,7 +486,8 @@ struct TerrainDiffusionNativePipeline::Impl
 	Impl(uint64_t seed_, int node_scale_, float height_scale_, float height_offset_,
 			float residual_std_, unsigned int cache_tiles_, unsigned int cache_mb_,
 			std::string provider_, int device_id_, int intra_threads_,
-			std::string conditioning_stats_, bool prefetch_) :
+			std::string conditioning_stats_, bool prefetch_, unsigned int batch_size_,
+			std::string disk_cache_) :
 			seed(seed_), node_scale(std::max(1, node_scale_)),
 			height_scale(height_scale_), height_offset(height_offset_),
 			residual_std(residual_std_), cache_limit(std::max(1U, cache_tiles_)),
@@ -436,7 +495,8 @@ struct TerrainDiffusionNativePipeline::Impl
 					static_cast<size_t>(std::max(16U, cache_mb_)) * 1024 * 1024),
 			provider(std::move(provider_)), device_id(device_id_),
 			intra_threads(std::max(1, intra_threads_)),
-			conditioning_stats(std::move(conditioning_stats_)), prefetch(prefetch_)
+			conditioning_stats(std::move(conditioning_stats_)), prefetch(prefetch_),
+			batch_size(rangelim(batch_size_, 1U, 64U)), disk_cache(std::move(disk_cache_))
 	{
 		if (prefetch) {
 			prefetch_pool = std::make_unique<progschj::ThreadPool>(1);
@@ -456,6 +516,10 @@ struct TerrainDiffusionNativePipeline::Impl
 	int intra_threads;
 	std::string conditioning_stats;
 	bool prefetch;
+	unsigned int batch_size;
+	// Root of the tile cache, disk_cache_dir is set per seed and models on load
+	std::string disk_cache;
+	std::string disk_cache_dir;
 	struct ConditioningStats
 	{
 		std::array<std::vector<float>, 5> noise_quantiles;
@@ -494,17 +558,34 @@ struct TerrainDiffusionNativePipeline::Impl
 	std::unordered_map<TileKey, TileCacheEntry, TileKeyHash> cache;
 	uint64_t cache_clock = 0;
 	std::mutex cache_mutex;
-	std::unordered_set<TileKey, TileKeyHash> pending_prefetch;
+	std::condition_variable tiles_ready;
+	// Missing tiles of all emerge threads, the one generating takes them in
+	// batches, demanded before prefetched. queued is true once demanded.
+	std::deque<TileKey> demand_queue;
+	std::deque<TileKey> prefetch_queue;
+	std::unordered_map<TileKey, bool, TileKeyHash> queued;
+	std::unordered_set<TileKey, TileKeyHash> in_flight;
+	std::unordered_set<TileKey, TileKeyHash> failed;
+	// Tiles read by running sampleGrid() calls, kept in the cache
+	std::unordered_map<TileKey, int, TileKeyHash> pinned;
+	bool generating = false;
+	uint64_t tiles_generated = 0;
+	// Smoothed centre of the requests in pixels, prefetch goes where it moves
+	float request_x = 0.0f;
+	float request_z = 0.0f;
+	bool has_request = false;
 
 #if USE_ONNXRUNTIME
+	// Used only by the thread generating
 	std::shared_ptr<SharedModels> models;
 	std::unordered_map<TileKey, FloatCacheEntry, TileKeyHash> coarse_cache;
 	std::unordered_map<TileKey, FloatCacheEntry, TileKeyHash> base_cache;
+	uint64_t model_clock = 0;
 #endif
 	std::unique_ptr<progschj::ThreadPool> prefetch_pool;
 
-	template <typename Cache, typename SizeFunction>
-	void trimCache(Cache &target, size_t byte_limit, const TileKey &protected_key,
+	template <typename Cache, typename ProtectedFunction, typename SizeFunction>
+	void trimCache(Cache &target, size_t byte_limit, ProtectedFunction is_protected,
 			SizeFunction size_function,
 			size_t count_limit = std::numeric_limits<size_t>::max())
 	{
@@ -518,7 +599,7 @@ struct TerrainDiffusionNativePipeline::Impl
 				target.size() > 1) {
 			auto oldest = target.end();
 			for (auto it = target.begin(); it != target.end(); ++it) {
-				if (it->first == protected_key)
+				if (is_protected(it->first))
 					continue;
 				if (oldest == target.end() ||
 						it->second.last_use < oldest->second.last_use)
@@ -797,14 +878,16 @@ struct TerrainDiffusionNativePipeline::Impl
 	{
 		auto found = coarse_cache.find(key);
 		if (found != coarse_cache.end()) {
-			found->second.last_use = ++cache_clock;
+			found->second.last_use = ++model_clock;
 			return found->second.data;
 		}
 		FloatCacheEntry entry;
 		entry.data = runCoarseRaw(key.x * 48, key.z * 48);
-		entry.last_use = ++cache_clock;
+		entry.last_use = ++model_clock;
 		auto inserted = coarse_cache.emplace(key, std::move(entry));
-		trimCache(coarse_cache, cache_bytes_limit / 5, key,
+		trimCache(
+				coarse_cache, cache_bytes_limit / 5,
+				[&](const TileKey &other) { return other == key; },
 				[](const FloatCacheEntry &item) {
 					return item.data.size() * sizeof(float);
 				});
@@ -852,9 +935,9 @@ struct TerrainDiffusionNativePipeline::Impl
 		return output;
 	}
 
-	std::vector<float> runBaseRaw(const std::vector<float> &coarse_map,
+	std::vector<float> baseCondition(const std::vector<float> &coarse_map,
 			int coarse_origin_x, int coarse_origin_z, int base_origin_x,
-			int base_origin_z)
+			int base_origin_z) const
 	{
 		static const std::array<float, 7> means{
 				14.99f, 11.65f, 15.87f, 619.26f, 833.12f, 69.40f, 0.66f};
@@ -897,60 +980,98 @@ struct TerrainDiffusionNativePipeline::Impl
 			for (float value : group)
 				condition.push_back(value * factor);
 		}
+		return condition;
+	}
 
-		auto infer_step = [&](const std::vector<float> *previous, float t,
-								  uint64_t noise_seed) {
-			std::vector<float> noise = noisePatch(noise_seed, base_origin_z,
-					base_origin_x, BASE_SIZE, BASE_SIZE, 5, BASE_SIZE, BASE_SIZE);
+	// One denoising step of the base model for the tiles of keys
+	std::vector<std::vector<float>> runBaseStep(const std::vector<TileKey> &keys,
+			const std::vector<std::vector<float>> &conditions,
+			const std::vector<std::vector<float>> *previous, float t,
+			uint64_t noise_seed)
+	{
+		std::vector<std::vector<std::vector<float>>> items(keys.size());
+		std::vector<std::vector<float>> x_t(keys.size());
+		for (size_t n = 0; n < keys.size(); ++n) {
+			std::vector<float> noise = noisePatch(noise_seed, keys[n].z * 32,
+					keys[n].x * 32, BASE_SIZE, BASE_SIZE, 5, BASE_SIZE, BASE_SIZE);
 			std::vector<float> model_input(noise.size());
-			std::vector<float> x_t(noise.size());
+			x_t[n].resize(noise.size());
 			for (size_t i = 0; i < noise.size(); ++i) {
-				const float sample = previous ? (*previous)[i] * SIGMA_DATA : 0.0f;
+				const float sample = previous ? (*previous)[n][i] * SIGMA_DATA : 0.0f;
 				const float z = noise[i] * SIGMA_DATA;
-				x_t[i] = std::cos(t) * sample + std::sin(t) * z;
-				model_input[i] = x_t[i] / SIGMA_DATA;
+				x_t[n][i] = std::cos(t) * sample + std::sin(t) * z;
+				model_input[i] = x_t[n][i] / SIGMA_DATA;
 			}
-			std::vector<float> output;
-			if (!models->base.run({model_input, {t}, condition},
-						{{1, 5, BASE_SIZE, BASE_SIZE}, {1}, {1, 58}}, output) ||
-					output.size() != noise.size())
+			items[n] = {std::move(model_input), {t}, conditions[n]};
+		}
+		std::vector<std::vector<float>> outputs;
+		if (!models->base.runBatch(
+					items, {{1, 5, BASE_SIZE, BASE_SIZE}, {1}, {1, 58}}, outputs))
+			throw std::runtime_error("base model returned an unexpected tensor");
+		for (size_t n = 0; n < keys.size(); ++n) {
+			auto &output = outputs[n];
+			if (output.size() != x_t[n].size())
 				throw std::runtime_error("base model returned an unexpected tensor");
 			for (size_t i = 0; i < output.size(); ++i)
-				output[i] =
-						(std::cos(t) * x_t[i] + std::sin(t) * SIGMA_DATA * output[i]) /
-						SIGMA_DATA;
-			return output;
-		};
-
-		const float initial_t = std::atan(SIGMA_MAX / SIGMA_DATA);
-		std::vector<float> output = infer_step(nullptr, initial_t, seed + 5819);
-		const float refinement_t = std::atan(0.35f / SIGMA_DATA);
-		return infer_step(&output, refinement_t, seed + 5820);
+				output[i] = (std::cos(t) * x_t[n][i] +
+									std::sin(t) * SIGMA_DATA * output[i]) /
+							SIGMA_DATA;
+		}
+		return outputs;
 	}
 
-	const std::vector<float> &getBaseTile(const TileKey &key)
+	// Run the base model for the missing tiles of keys, batch_size tiles per
+	// call when the model takes any batch size
+	void generateBaseTiles(const std::vector<TileKey> &keys)
 	{
-		auto found = base_cache.find(key);
-		if (found != base_cache.end()) {
-			found->second.last_use = ++cache_clock;
-			return found->second.data;
+		std::vector<TileKey> missing;
+		for (const auto &key : keys)
+			if (base_cache.find(key) == base_cache.end() &&
+					std::find(missing.begin(), missing.end(), key) == missing.end())
+				missing.push_back(key);
+		const size_t batch = models->base.batchable() ? batch_size : 1;
+		for (size_t begin = 0; begin < missing.size(); begin += batch) {
+			const std::vector<TileKey> part(missing.begin() + begin,
+					missing.begin() + std::min(missing.size(), begin + batch));
+			std::vector<std::vector<float>> conditions;
+			for (const auto &key : part) {
+				const int base_origin_x = key.x * 32;
+				const int base_origin_z = key.z * 32;
+				const int coarse_origin_x = floorDiv(base_origin_x, 32) - 25;
+				const int coarse_origin_z = floorDiv(base_origin_z, 32) - 25;
+				const std::vector<float> coarse_map = sampleCoarseRegion(
+						coarse_origin_x, coarse_origin_z, COARSE_SIZE, COARSE_SIZE);
+				conditions.push_back(baseCondition(coarse_map, coarse_origin_x,
+						coarse_origin_z, base_origin_x, base_origin_z));
+			}
+			const float initial_t = std::atan(SIGMA_MAX / SIGMA_DATA);
+			const auto first =
+					runBaseStep(part, conditions, nullptr, initial_t, seed + 5819);
+			const float refinement_t = std::atan(0.35f / SIGMA_DATA);
+			auto outputs =
+					runBaseStep(part, conditions, &first, refinement_t, seed + 5820);
+			for (size_t n = 0; n < part.size(); ++n)
+				base_cache[part[n]] = FloatCacheEntry{std::move(outputs[n]), ++model_clock};
 		}
-		const int base_origin_x = key.x * 32;
-		const int base_origin_z = key.z * 32;
-		const int coarse_origin_x = floorDiv(base_origin_x, 32) - 25;
-		const int coarse_origin_z = floorDiv(base_origin_z, 32) - 25;
-		std::vector<float> coarse_map = sampleCoarseRegion(
-				coarse_origin_x, coarse_origin_z, COARSE_SIZE, COARSE_SIZE);
-		FloatCacheEntry entry;
-		entry.data = runBaseRaw(coarse_map, coarse_origin_x, coarse_origin_z,
-				base_origin_x, base_origin_z);
-		entry.last_use = ++cache_clock;
-		auto inserted = base_cache.emplace(key, std::move(entry));
-		trimCache(base_cache, cache_bytes_limit * 3 / 10, key,
+		trimCache(
+				base_cache, cache_bytes_limit * 3 / 10,
+				[&](const TileKey &key) {
+					return std::find(keys.begin(), keys.end(), key) != keys.end();
+				},
 				[](const FloatCacheEntry &item) {
 					return item.data.size() * sizeof(float);
 				});
-		return inserted.first->second.data;
+	}
+
+	const std::vector<float> &getBaseTile(const TileKey &key)
+	{
+		auto found = base_cache.find(key);
+		if (found == base_cache.end()) {
+			generateBaseTiles({key});
+			found = base_cache.find(key);
+		}
+		found->second.last_use = ++model_clock;
+		return found->second.data;
 	}
 
 	std::vector<float> sampleBaseRegion(int origin_x, int origin_z, int width, int height)
@@ -993,21 +1114,73 @@ struct TerrainDiffusionNativePipeline::Impl
 		return output;
 	}
 
-	Tile generateTile(const TileKey &key)
+	// Decoder input of one tile, ready for the decoder model
+	struct PreparedTile
 	{
+		int decoder_origin_x = 0;
+		int decoder_origin_z = 0;
+		int latent_origin_x = 0;
+		int latent_origin_z = 0;
+		int latent_width = 0;
+		int latent_height = 0;
+		int coarse_origin_x = 0;
+		int coarse_origin_z = 0;
+		std::vector<float> coarse_map;
+		std::vector<float> latents;
+		std::vector<float> decoder_input;
+		std::vector<float> residual_noise;
+	};
+
+	PreparedTile tileRegion(const TileKey &key) const
+	{
+		PreparedTile region;
 		const int margin = (decoder_size - usable_size) / 2;
-		const int decoder_origin_x = key.x * usable_size - margin;
-		const int decoder_origin_z = key.z * usable_size - margin;
-		const int latent_origin_x = floorDiv(decoder_origin_x, LATENT_COMPRESSION) - 1;
-		const int latent_origin_z = floorDiv(decoder_origin_z, LATENT_COMPRESSION) - 1;
+		region.decoder_origin_x = key.x * usable_size - margin;
+		region.decoder_origin_z = key.z * usable_size - margin;
+		region.latent_origin_x =
+				floorDiv(region.decoder_origin_x, LATENT_COMPRESSION) - 1;
+		region.latent_origin_z =
+				floorDiv(region.decoder_origin_z, LATENT_COMPRESSION) - 1;
 		const int latent_end_x =
-				floorDiv(decoder_origin_x + decoder_size - 1, LATENT_COMPRESSION) + 2;
+				floorDiv(region.decoder_origin_x + decoder_size - 1, LATENT_COMPRESSION) +
+				2;
 		const int latent_end_z =
-				floorDiv(decoder_origin_z + decoder_size - 1, LATENT_COMPRESSION) + 2;
-		const int latent_width = latent_end_x - latent_origin_x + 1;
-		const int latent_height = latent_end_z - latent_origin_z + 1;
-		const int coarse_origin_x = floorDiv(decoder_origin_x, 32) - 24;
-		const int coarse_origin_z = floorDiv(decoder_origin_z, 32) - 24;
+				floorDiv(region.decoder_origin_z + decoder_size - 1, LATENT_COMPRESSION) +
+				2;
+		region.latent_width = latent_end_x - region.latent_origin_x + 1;
+		region.latent_height = latent_end_z - region.latent_origin_z + 1;
+		region.coarse_origin_x = floorDiv(region.decoder_origin_x, 32) - 24;
+		region.coarse_origin_z = floorDiv(region.decoder_origin_z, 32) - 24;
+		return region;
+	}
+
+	// Base tiles sampleBaseRegion() reads for the latents of a tile
+	void baseTilesFor(const TileKey &key, std::vector<TileKey> &keys) const
+	{
+		constexpr int stride = 32;
+		const PreparedTile region = tileRegion(key);
+		const int end_x = region.latent_origin_x + region.latent_width - 1;
+		const int end_z = region.latent_origin_z + region.latent_height - 1;
+		for (int tz = floorDiv(region.latent_origin_z, stride) - 1;
+				tz <= floorDiv(end_z, stride); ++tz)
+			for (int tx = floorDiv(region.latent_origin_x, stride) - 1;
+					tx <= floorDiv(end_x, stride); ++tx)
+				if (tx * stride + BASE_SIZE > region.latent_origin_x &&
+						tz * stride + BASE_SIZE > region.latent_origin_z)
+					keys.push_back({tx, tz});
+	}
+
+	PreparedTile prepareTile(const TileKey &key)
+	{
+		PreparedTile prepared = tileRegion(key);
+		const int decoder_origin_x = prepared.decoder_origin_x;
+		const int decoder_origin_z = prepared.decoder_origin_z;
+		const int latent_origin_x = prepared.latent_origin_x;
+		const int latent_origin_z = prepared.latent_origin_z;
+		const int latent_width = prepared.latent_width;
+		const int latent_height = prepared.latent_height;
+		const int coarse_origin_x = prepared.coarse_origin_x;
+		const int coarse_origin_z = prepared.coarse_origin_z;
 
 		std::vector<float> coarse_map = sampleCoarseRegion(
 				coarse_origin_x, coarse_origin_z, COARSE_SIZE, COARSE_SIZE);
@@ -1037,11 +1210,29 @@ struct TerrainDiffusionNativePipeline::Impl
 						decoder_size, 1, decoder_size, decoder_size);
 		for (size_t i = 0; i < decoder_plane; ++i)
 			decoder_input[i] = std::sin(t) * residual_noise[i];
-		std::vector<float> residual;
-		if (!models->decoder.run({decoder_input, {t}},
-					{{1, 5, decoder_size, decoder_size}, {1}}, residual) ||
-				residual.size() != decoder_plane)
-			throw std::runtime_error("decoder model returned an unexpected tensor");
+
+		prepared.coarse_map = std::move(coarse_map);
+		prepared.latents = std::move(latents);
+		prepared.decoder_input = std::move(decoder_input);
+		prepared.residual_noise = std::move(residual_noise);
+		return prepared;
+	}
+
+	Tile finishTile(const PreparedTile &prepared, std::vector<float> &residual) const
+	{
+		const int decoder_origin_x = prepared.decoder_origin_x;
+		const int decoder_origin_z = prepared.decoder_origin_z;
+		const int latent_origin_x = prepared.latent_origin_x;
+		const int latent_origin_z = prepared.latent_origin_z;
+		const int latent_width = prepared.latent_width;
+		const int latent_height = prepared.latent_height;
+		const int coarse_origin_x = prepared.coarse_origin_x;
+		const int coarse_origin_z = prepared.coarse_origin_z;
+		const auto &coarse_map = prepared.coarse_map;
+		const auto &latents = prepared.latents;
+		const auto &residual_noise = prepared.residual_noise;
+		const size_t decoder_plane = static_cast<size_t>(decoder_size) * decoder_size;
+		const float t = std::atan(SIGMA_MAX / SIGMA_DATA);
 
 		for (size_t i = 0; i < residual.size(); ++i) {
 			const float x_t = std::sin(t) * residual_noise[i] * SIGMA_DATA;
@@ -1114,42 +1305,263 @@ struct TerrainDiffusionNativePipeline::Impl
 			}
 		return tile;
 	}
+
+	// Decode the tiles of keys, base tiles of all of them first and
+	// batch_size tiles per decoder call when the models take any batch size
+	std::vector<Tile> generateTiles(const std::vector<TileKey> &keys)
+	{
+		std::vector<TileKey> base_keys;
+		for (const auto &key : keys)
+			baseTilesFor(key, base_keys);
+		generateBaseTiles(base_keys);
+
+		const size_t plane = static_cast<size_t>(decoder_size) * decoder_size;
+		const float t = std::atan(SIGMA_MAX / SIGMA_DATA);
+		const size_t batch = models->decoder.batchable() ? batch_size : 1;
+		std::vector<Tile> tiles;
+		tiles.reserve(keys.size());
+		for (size_t begin = 0; begin < keys.size(); begin += batch) {
+			const size_t end = std::min(keys.size(), begin + batch);
+			std::vector<PreparedTile> prepared;
+			std::vector<std::vector<std::vector<float>>> items;
+			for (size_t i = begin; i < end; ++i) {
+				prepared.push_back(prepareTile(keys[i]));
+				items.push_back({std::move(prepared.back().decoder_input), {t}});
+			}
+			std::vector<std::vector<float>> residuals;
+			if (!models->decoder.runBatch(items,
+						{{1, 5, decoder_size, decoder_size}, {1}}, residuals))
+				throw std::runtime_error("decoder model returned an unexpected tensor");
+			for (size_t n = 0; n < prepared.size(); ++n) {
+				if (residuals[n].size() != plane)
+					throw std::runtime_error(
+							"decoder model returned an unexpected tensor");
+				tiles.push_back(finishTile(prepared[n], residuals[n]));
+			}
+		}
+		return tiles;
+	}
 #endif
 
-	const Tile *getTile(const TileKey &key, bool generate_missing = true)
+	const Tile *getTile(const TileKey &key)
 	{
 		auto found = cache.find(key);
-		if (found != cache.end()) {
-			found->second.last_use = ++cache_clock;
-			return &found->second.tile;
-		}
-		if (!generate_missing)
+		if (found == cache.end())
 			return nullptr;
+		found->second.last_use = ++cache_clock;
+		return &found->second.tile;
+	}
+
+	// Decoded tiles samplePixel() reads for the pixels of the area
+	std::vector<TileKey> tilesFor(
+			int min_pixel_x, int min_pixel_z, int max_pixel_x, int max_pixel_z) const
+	{
+		const int margin = (decoder_size - usable_size) / 2;
+		std::vector<TileKey> keys;
+		for (int tz = floorDiv(min_pixel_z, usable_size) - 1;
+				tz <= floorDiv(max_pixel_z, usable_size) + 1; ++tz)
+			for (int tx = floorDiv(min_pixel_x, usable_size) - 1;
+					tx <= floorDiv(max_pixel_x, usable_size) + 1; ++tx) {
+				const int origin_x = tx * usable_size - margin;
+				const int origin_z = tz * usable_size - margin;
+				if (origin_x <= max_pixel_x && origin_x + decoder_size > min_pixel_x &&
+						origin_z <= max_pixel_z && origin_z + decoder_size > min_pixel_z)
+					keys.push_back({tx, tz});
+			}
+		return keys;
+	}
+
+	std::string tilePath(const TileKey &key) const
+	{
+		return disk_cache_dir + DIR_DELIM + std::to_string(key.x) + "_" +
+			   std::to_string(key.z) + ".tdt";
+	}
+
+	bool loadTileFile(const TileKey &key, Tile &tile) const
+	{
+		if (disk_cache_dir.empty())
+			return false;
+		std::ifstream input(tilePath(key), std::ios::binary);
+		if (!input.good())
+			return false;
+		char header[8];
+		if (!input.read(header, sizeof(header)) ||
+				readU32(reinterpret_cast<u8 *>(header)) != TILE_FILE_MAGIC ||
+				readU32(reinterpret_cast<u8 *>(header) + 4) !=
+						static_cast<u32>(decoder_size))
+			return false;
+		std::ostringstream raw(std::ios::binary);
+		try {
+			decompressZstd(input, raw);
+		} catch (const SerializationError &e) {
+			warningstream << "TerrainDiffusion ignoring damaged tile " << tilePath(key)
+						  << ": " << e.what() << std::endl;
+			return false;
+		}
+		const std::string data = raw.str();
+		const size_t count = static_cast<size_t>(decoder_size) * decoder_size;
+		if (data.size() != count * TILE_FILE_RECORD)
+			return false;
+		tile.samples.resize(count);
+		const u8 *record = reinterpret_cast<const u8 *>(data.data());
+		for (auto &sample : tile.samples) {
+			sample.height = readF32(record);
+			sample.heat = readS16(record + 4);
+			sample.humidity = readS16(record + 6);
+			sample.has_climate = true;
+			record += TILE_FILE_RECORD;
+		}
+		return true;
+	}
+
+	void saveTileFile(const TileKey &key, const Tile &tile) const
+	{
+		if (disk_cache_dir.empty())
+			return;
+		std::string data(tile.samples.size() * TILE_FILE_RECORD, '\0');
+		u8 *record = reinterpret_cast<u8 *>(data.data());
+		for (const auto &sample : tile.samples) {
+			writeF32(record, sample.height);
+			writeS16(record + 4, sample.heat);
+			writeS16(record + 6, sample.humidity);
+			record += TILE_FILE_RECORD;
+		}
+		std::ostringstream os(std::ios::binary);
+		char header[8];
+		writeU32(reinterpret_cast<u8 *>(header), TILE_FILE_MAGIC);
+		writeU32(reinterpret_cast<u8 *>(header) + 4, static_cast<u32>(decoder_size));
+		os.write(header, sizeof(header));
+		compressZstd(data, os);
+		if (!fs::safeWriteToFile(tilePath(key), os.str()))
+			warningstream << "TerrainDiffusion failed to write tile " << tilePath(key)
+						  << std::endl;
+	}
+
+	// Read or generate the tiles of keys, ok tells which ones succeeded
+	void generateBatch(const std::vector<TileKey> &keys, std::vector<Tile> &tiles,
+			std::vector<bool> &ok)
+	{
+		tiles.resize(keys.size());
+		ok.assign(keys.size(), false);
+		std::vector<TileKey> missing;
+		std::vector<size_t> missing_index;
+		for (size_t i = 0; i < keys.size(); ++i) {
+			if (loadTileFile(keys[i], tiles[i])) {
+				ok[i] = true;
+				continue;
+			}
+			missing.push_back(keys[i]);
+			missing_index.push_back(i);
+		}
+		if (missing.empty())
+			return;
 #if USE_ONNXRUNTIME
 		try {
-			TileCacheEntry entry;
-			entry.tile = generateTile(key);
-			entry.last_use = ++cache_clock;
-			auto inserted = cache.emplace(key, std::move(entry));
-			trimCache(
-					cache, cache_bytes_limit / 2, key,
-					[](const TileCacheEntry &item) {
-						return item.tile.samples.size() * sizeof(TerrainDiffusionSample);
-					},
-					cache_limit);
-			return &inserted.first->second.tile;
+			std::vector<Tile> generated = generateTiles(missing);
+			for (size_t n = 0; n < missing.size(); ++n) {
+				saveTileFile(missing[n], generated[n]);
+				tiles[missing_index[n]] = std::move(generated[n]);
+				ok[missing_index[n]] = true;
+			}
 		} catch (const std::exception &e) {
 			errorstream << "TerrainDiffusion native inference failed: " << e.what()
 						<< std::endl;
-			return nullptr;
 		}
-#else
-		return nullptr;
 #endif
 	}
 
-	bool samplePixel(int pixel_x, int pixel_z, TerrainDiffusionSample &result,
-			bool generate_missing = true)
+	// Take a batch of the queued tiles and generate it without the lock
+	void generateQueued(std::unique_lock<std::mutex> &lock)
+	{
+		std::vector<TileKey> batch;
+		for (auto *queue : {&demand_queue, &prefetch_queue})
+			while (!queue->empty() && batch.size() < batch_size) {
+				const TileKey key = queue->front();
+				queue->pop_front();
+				// Demanded tiles are also left in prefetch_queue
+				if (queued.erase(key) && cache.find(key) == cache.end()) {
+					in_flight.insert(key);
+					batch.push_back(key);
+				}
+			}
+		if (batch.empty())
+			return;
+
+		generating = true;
+		lock.unlock();
+		std::vector<Tile> tiles;
+		std::vector<bool> ok;
+		generateBatch(batch, tiles, ok);
+		lock.lock();
+		generating = false;
+
+		for (size_t i = 0; i < batch.size(); ++i) {
+			in_flight.erase(batch[i]);
+			if (ok[i]) {
+				cache[batch[i]] = TileCacheEntry{std::move(tiles[i]), ++cache_clock};
+				++tiles_generated;
+			} else {
+				failed.insert(batch[i]);
+			}
+		}
+		trimCache(
+				cache, cache_bytes_limit / 2,
+				[&](const TileKey &key) {
+					return pinned.count(key) ||
+						   std::find(batch.begin(), batch.end(), key) != batch.end();
+				},
+				[](const TileCacheEntry &item) {
+					return item.tile.samples.size() * sizeof(TerrainDiffusionSample);
+				},
+				cache_limit);
+		tiles_ready.notify_all();
+	}
+
+	/*
+		Make the tiles of keys available, false when one failed.
+
+		Missing tiles are queued, and while no other thread is generating this
+		one takes a batch of the queue, so tiles requested by emerge threads at
+		the same time share model runs. Without wait the tiles are only queued,
+		and generated by this thread if it is free, for prefetch.
+	*/
+	bool ensureTiles(std::unique_lock<std::mutex> &lock, const std::vector<TileKey> &keys,
+			bool wait)
+	{
+		for (;;) {
+			bool missing = false;
+			for (const auto &key : keys) {
+				if (cache.find(key) != cache.end())
+					continue;
+				if (failed.count(key)) {
+					if (!wait)
+						continue;
+					failed.erase(key);
+					return false;
+				}
+				missing = true;
+				if (in_flight.count(key))
+					continue;
+				auto [it, inserted] = queued.emplace(key, wait);
+				if (inserted) {
+					(wait ? demand_queue : prefetch_queue).push_back(key);
+				} else if (wait && !it->second) {
+					it->second = true;
+					demand_queue.push_back(key);
+				}
+			}
+			if (!missing)
+				return true;
+			if (!generating)
+				generateQueued(lock);
+			else if (!wait)
+				return true;
+			else
+				tiles_ready.wait(lock);
+		}
+	}
+
+	bool samplePixel(int pixel_x, int pixel_z, TerrainDiffusionSample &result)
 	{
 		const int center_x = floorDiv(pixel_x, usable_size);
 		const int center_z = floorDiv(pixel_z, usable_size);
@@ -1166,7 +1578,7 @@ struct TerrainDiffusionNativePipeline::Impl
 				if (local_x < 0 || local_z < 0 || local_x >= decoder_size ||
 						local_z >= decoder_size)
 					continue;
-				const Tile *tile = getTile({tx, tz}, generate_missing);
+				const Tile *tile = getTile({tx, tz});
 				if (!tile)
 					return false;
 				const TerrainDiffusionSample &sample =
@@ -1193,7 +1605,7 @@ struct TerrainDiffusionNativePipeline::Impl
 	}
 
 	bool sampleGridLocked(int min_x, int min_z, int max_x, int max_z,
-			std::vector<TerrainDiffusionSample> &samples, bool generate_missing)
+			std::vector<TerrainDiffusionSample> &samples)
 	{
 		const int width = max_x - min_x + 1;
 		const int depth = max_z - min_z + 1;
@@ -1207,10 +1619,10 @@ struct TerrainDiffusionNativePipeline::Impl
 				const float fx = model_x - x0;
 				const float fz = model_z - z0;
 				std::array<TerrainDiffusionSample, 4> corners;
-				if (!samplePixel(x0, z0, corners[0], generate_missing) ||
-						!samplePixel(x0 + 1, z0, corners[1], generate_missing) ||
-						!samplePixel(x0, z0 + 1, corners[2], generate_missing) ||
-						!samplePixel(x0 + 1, z0 + 1, corners[3], generate_missing))
+				if (!samplePixel(x0, z0, corners[0]) ||
+						!samplePixel(x0 + 1, z0, corners[1]) ||
+						!samplePixel(x0, z0 + 1, corners[2]) ||
+						!samplePixel(x0 + 1, z0 + 1, corners[3]))
 					return false;
 				TerrainDiffusionSample &sample =
 						samples[static_cast<size_t>(z - min_z) * width + x - min_x];
@@ -1233,38 +1645,61 @@ struct TerrainDiffusionNativePipeline::Impl
 		return true;
 	}
 
+	// Queue the tiles next to those of the area, two rings ahead and none
+	// behind while the requests move, one ring all around while they stay
 	void schedulePrefetch(
 			int min_pixel_x, int min_pixel_z, int max_pixel_x, int max_pixel_z)
 	{
 		if (!prefetch_pool)
 			return;
-		const int min_tx = floorDiv(min_pixel_x, usable_size) - 1;
-		const int max_tx = floorDiv(max_pixel_x, usable_size) + 1;
-		const int min_tz = floorDiv(min_pixel_z, usable_size) - 1;
-		const int max_tz = floorDiv(max_pixel_z, usable_size) + 1;
-		for (int tz = min_tz; tz <= max_tz; ++tz)
-			for (int tx = min_tx; tx <= max_tx; ++tx) {
-				if (tx > min_tx && tx < max_tx && tz > min_tz && tz < max_tz)
+		const float center_x = (min_pixel_x + max_pixel_x) * 0.5f;
+		const float center_z = (min_pixel_z + max_pixel_z) * 0.5f;
+		float move_x = 0.0f;
+		float move_z = 0.0f;
+		{
+			std::lock_guard<std::mutex> lock(cache_mutex);
+			if (has_request) {
+				move_x = center_x - request_x;
+				move_z = center_z - request_z;
+				// Emerge threads work around the player, follow them slowly
+				request_x += (center_x - request_x) * 0.25f;
+				request_z += (center_z - request_z) * 0.25f;
+			} else {
+				request_x = center_x;
+				request_z = center_z;
+				has_request = true;
+			}
+		}
+		const float min_move = usable_size * 0.25f;
+		const bool moving = move_x * move_x + move_z * move_z > min_move * min_move;
+		const int ring = moving ? 2 : 1;
+		// Tiles the area itself reads, see tilesFor()
+		const int inner_min_tx = floorDiv(min_pixel_x, usable_size) - 1;
+		const int inner_max_tx = floorDiv(max_pixel_x, usable_size) + 1;
+		const int inner_min_tz = floorDiv(min_pixel_z, usable_size) - 1;
+		const int inner_max_tz = floorDiv(max_pixel_z, usable_size) + 1;
+		std::vector<TileKey> keys;
+		for (int tz = inner_min_tz - ring; tz <= inner_max_tz + ring; ++tz)
+			for (int tx = inner_min_tx - ring; tx <= inner_max_tx + ring; ++tx) {
+				if (tx >= inner_min_tx && tx <= inner_max_tx && tz >= inner_min_tz &&
+						tz <= inner_max_tz)
 					continue;
-				const TileKey key{tx, tz};
-				{
-					std::lock_guard<std::mutex> lock(cache_mutex);
-					if (cache.find(key) != cache.end() ||
-							pending_prefetch.find(key) != pending_prefetch.end())
-						continue;
-					pending_prefetch.insert(key);
-				}
-				try {
-					prefetch_pool->enqueue([this, key]() {
-						std::lock_guard<std::mutex> lock(cache_mutex);
-						getTile(key);
-						pending_prefetch.erase(key);
-					});
-				} catch (const progschj::would_block &) {
-					std::lock_guard<std::mutex> lock(cache_mutex);
-					pending_prefetch.erase(key);
-				}
+				if (moving && ((tx + 0.5f) * usable_size - center_x) * move_x +
+										((tz + 0.5f) * usable_size - center_z) *
+												move_z <=
+								0.0f)
+					continue;
+				keys.push_back({tx, tz});
 			}
+		if (keys.empty())
+			return;
+		try {
+			prefetch_pool->enqueue([this, keys]() {
+				std::unique_lock<std::mutex> lock(cache_mutex);
+				ensureTiles(lock, keys, false);
+			});
+		} catch (const progschj::would_block &) {
+		}
 	}
 };
 
@@ -1272,10 +1707,10 @@ TerrainDiffusionNativePipeline::TerrainDiffusionNativePipeline(uint64_t seed,
 		int node_scale, float height_scale, float height_offset, float residual_std,
 		unsigned int cache_tiles, unsigned int cache_mb, const std::string &provider,
 		int device_id, int intra_threads, const std::string &conditioning_stats,
-		bool prefetch) :
-		m_impl(std::make_unique<Impl>(seed, node_scale, height_scale, height_offset,
+		bool prefetch, unsigned int batch_size, const std::string &disk_cache) :
+		m_impl(std::make_shared<Impl>(seed, node_scale, height_scale, height_offset,
 				residual_std, cache_tiles, cache_mb, provider, device_id, intra_threads,
-				conditioning_stats, prefetch))
+				conditioning_stats, prefetch, batch_size, disk_cache))
 {
 }
 
@@ -1340,6 +1775,24 @@ bool TerrainDiffusionNativePipeline::load(const std::string &model_dir)
 	if (model_dir.empty())
 		return false;
 #if USE_ONNXRUNTIME
+	// Emerge threads of one world share tiles, queue and batches
+	static std::mutex shared_mutex;
+	static std::map<std::string, std::weak_ptr<Impl>> shared;
+	std::ostringstream identity;
+	identity << m_impl->seed << "|" << m_impl->height_scale << "|"
+			 << m_impl->height_offset << "|" << m_impl->residual_std;
+	std::ostringstream settings;
+	settings << identity.str() << "|" << m_impl->conditioning_stats << "|"
+			 << model_dir << "|" << m_impl->node_scale << "|"
+			 << m_impl->cache_limit << "|" << m_impl->cache_bytes_limit << "|"
+			 << m_impl->provider << "|" << m_impl->device_id << "|"
+			 << m_impl->intra_threads << "|" << m_impl->prefetch << "|"
+			 << m_impl->batch_size << "|" << m_impl->disk_cache;
+	std::lock_guard<std::mutex> shared_lock(shared_mutex);
+	if (auto existing = shared[settings.str()].lock()) {
+		m_impl = existing;
+		return true;
+	}
 	try {
 		m_impl->loadPipelineConfig(model_dir);
 		m_impl->loadConditioningStats();
@@ -1366,7 +1819,31 @@ bool TerrainDiffusionNativePipeline::load(const std::string &model_dir)
 					"decoder x input must be static [N,5,S,S], S <= 512 and divisible by 8");
 		m_impl->decoder_size = static_cast<int>(shape[2]);
 		m_impl->usable_size = std::max(8, m_impl->decoder_size / 2);
+		if (!m_impl->disk_cache.empty()) {
+			// Tiles depend on the seed, the options shaping them and the
+			// contents of the models, not on where they are
+			u64 contents = 0;
+			for (const char *name : {"coarse_model.onnx", "base_model.onnx",
+						 "decoder_model.onnx", "config.json"})
+				contents = hashFileContents(model_dir + DIR_DELIM + name, contents);
+			if (!m_impl->conditioning_stats.empty())
+				contents = hashFileContents(m_impl->conditioning_stats, contents);
+			identity << "|" << m_impl->decoder_size << "|" << contents;
+			const std::string key = identity.str();
+			char hash[17];
+			snprintf(hash, sizeof(hash), "%016llx",
+					static_cast<unsigned long long>(
+							murmur_hash_64_ua(key.data(), key.size(), 0x5444)));
+			m_impl->disk_cache_dir = m_impl->disk_cache + DIR_DELIM +
+									 std::to_string(m_impl->seed) + "_" + hash;
+			if (!fs::CreateAllDirs(m_impl->disk_cache_dir)) {
+				warningstream << "TerrainDiffusion cannot create tile cache "
+							  << m_impl->disk_cache_dir << std::endl;
+				m_impl->disk_cache_dir.clear();
+			}
+		}
 		m_impl->is_loaded = true;
+		shared[settings.str()] = m_impl;
 		infostream << "TerrainDiffusion mapgen loaded native three-model pipeline "
 				   << model_dir << " decoder_size=" << m_impl->decoder_size
 				   << " provider=" << m_impl->models->provider << std::endl;
@@ -1394,14 +1871,32 @@ bool TerrainDiffusionNativePipeline::sampleGrid(int min_x, int min_z, int max_x,
 {
 	if (!loaded() || min_x > max_x || min_z > max_z)
 		return false;
-	std::unique_lock<std::mutex> lock(m_impl->cache_mutex);
-	if (!m_impl->sampleGridLocked(min_x, min_z, max_x, max_z, samples, true))
-		return false;
+	Impl &impl = *m_impl;
+	const int min_pixel_x = floorDiv(min_x, impl.node_scale);
+	const int min_pixel_z = floorDiv(min_z, impl.node_scale);
+	const int max_pixel_x = floorDiv(max_x, impl.node_scale);
+	const int max_pixel_z = floorDiv(max_z, impl.node_scale);
+	// Corners of the last nodes are one pixel further
+	const auto keys =
+			impl.tilesFor(min_pixel_x, min_pixel_z, max_pixel_x + 1, max_pixel_z + 1);
+	std::unique_lock<std::mutex> lock(impl.cache_mutex);
+	for (const auto &key : keys)
+		++impl.pinned[key];
+	const bool ok = impl.ensureTiles(lock, keys, true) &&
+					impl.sampleGridLocked(min_x, min_z, max_x, max_z, samples);
+	for (const auto &key : keys)
+		if (--impl.pinned[key] == 0)
+			impl.pinned.erase(key);
 	lock.unlock();
-	m_impl->schedulePrefetch(floorDiv(min_x, m_impl->node_scale),
-			floorDiv(min_z, m_impl->node_scale), floorDiv(max_x, m_impl->node_scale),
-			floorDiv(max_z, m_impl->node_scale));
-	return true;
+	if (ok)
+		impl.schedulePrefetch(min_pixel_x, min_pixel_z, max_pixel_x, max_pixel_z);
+	return ok;
+}
+
+uint64_t TerrainDiffusionNativePipeline::tilesGenerated() const
+{
+	std::lock_guard<std::mutex> lock(m_impl->cache_mutex);
+	return m_impl->tiles_generated;
 }
 
 bool TerrainDiffusionNativePipeline::sampleGridCached(int min_x, int min_z, int max_x,
@@ -1412,5 +1907,5 @@ bool TerrainDiffusionNativePipeline::sampleGridCached(int min_x, int min_z, int
 	std::unique_lock<std::mutex> lock(m_impl->cache_mutex, std::try_to_lock);
 	if (!lock.owns_lock())
 		return false;
-	return m_impl->sampleGridLocked(min_x, min_z, max_x, max_z, samples, false);
+	return m_impl->sampleGridLocked(min_x, min_z, max_x, max_z, samples);
 }
@@ -17,7 +17,8 @@ class TerrainDiffusionNativePipeline
 	TerrainDiffusionNativePipeline(uint64_t seed, int node_scale, float height_scale,
 			float height_offset, float residual_std, unsigned int cache_tiles,
 			unsigned int cache_mb, const std::string &provider, int device_id,
-			int intra_threads, const std::string &conditioning_stats, bool prefetch);
+			int intra_threads, const std::string &conditioning_stats, bool prefetch,
+			unsigned int batch_size = 4, const std::string &disk_cache = "");
 	~TerrainDiffusionNativePipeline();
 
 	bool load(const std::string &model_dir);
@@ -26,9 +27,12 @@ class TerrainDiffusionNativePipeline
 			std::vector<TerrainDiffusionSample> &samples);
 	bool sampleGridCached(int min_x, int min_z, int max_x, int max_z,
 			std::vector<TerrainDiffusionSample> &samples);
+	// Decoded tiles generated or read from disk so far, by all sharing pipelines
+	uint64_t tilesGenerated() const;
 	static bool runDeterminismSelfTest(std::string &error);
 
 private:
 	struct Impl;
-	std::unique_ptr<Impl> m_impl;
+	// Shared by the pipelines loading the same models with the same options
+	std::shared_ptr<Impl> m_impl;
 };
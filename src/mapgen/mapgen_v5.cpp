@@ -50,6 +50,7 @@ MapgenV5::MapgenV5(MapgenV5Params *params, EmergeParams *emerge)
 	noise_filler_depth = new Noise(&params->np_filler_depth, seed, csize.X, csize.Z);
 	noise_factor       = new Noise(&params->np_factor,       seed, csize.X, csize.Z);
 	noise_height       = new Noise(&params->np_height,       seed, csize.X, csize.Z);
+	shareNoise2D({noise_filler_depth, noise_factor, noise_height});
 
 	// 3D terrain noise
 	// 1-up 1-down overgeneration
@@ -105,6 +105,10 @@ MapgenV7::MapgenV7(MapgenV7Params *params, EmergeParams *emerge)
 			new Noise(&params->np_floatland,    seed, csize.X, csize.Y + 2, csize.Z);
 	}
 
+	shareNoise2D({noise_terrain_base, noise_terrain_alt, noise_terrain_persist,
+			noise_height_select, noise_filler_depth, noise_mount_height,
+			noise_ridge_uwater});
+
 
 	//freeminer:
 	sp = params;
@@ -72,6 +72,8 @@ MapgenValleys::MapgenValleys(MapgenValleysParams *params, EmergeParams *emerge)
 	noise_terrain_height     = new Noise(&params->np_terrain_height,     seed, csize.X, csize.Z);
 	noise_valley_depth       = new Noise(&params->np_valley_depth,       seed, csize.X, csize.Z);
 	noise_valley_profile     = new Noise(&params->np_valley_profile,     seed, csize.X, csize.Z);
+	shareNoise2D({noise_filler_depth, noise_inter_valley_slope, noise_rivers,
+			noise_terrain_height, noise_valley_depth, noise_valley_profile});
 
 	//// 3D Terrain noise
 	// 1-up 1-down overgeneration
@@ -227,6 +227,14 @@ Biome *BiomeGenOriginal::calcBiomeAtPoint(v3pos_t pos) const
 }
 
 
+void BiomeGenOriginal::setNoiseCache(NoiseTileCache *cache)
+{
+	for (Noise *noise : {noise_heat, noise_humidity, noise_heat_blend,
+			noise_humidity_blend})
+		noise->tile_cache = cache;
+}
+
+
 void BiomeGenOriginal::calcBiomeNoise(v3pos_t pmin)
 {
 	m_pmin = pmin;
@@ -102,6 +102,9 @@ class BiomeGen {
 	// Clone this BiomeGen and set a the new BiomeManager to be used by the copy
 	virtual BiomeGen *clone(BiomeManager *biomemgr) const = 0;
 
+	// fm: Share 2D noise maps with the other emerge threads
+	virtual void setNoiseCache(NoiseTileCache *cache) {}
+
 	// Check that the internal chunk size is what the mapgen expects, just to be sure.
 	inline void assertChunkSize(v3pos_t expect) const
 	{
@@ -182,6 +185,8 @@ class BiomeGenOriginal final : public BiomeGen {
 
 	BiomeGen *clone(BiomeManager *biomemgr) const;
 
+	void setNoiseCache(NoiseTileCache *cache);
+
 	// Slower, meant for Script API use
 	float calcHeatAtPoint(v3pos_t pos) const;
 	float calcHumidityAtPoint(v3pos_t pos) const;
@@ -6,6 +6,7 @@
 #include "mg_decoration.h"
 #include "irr_v3d.h"
 #include "mg_schematic.h"
+#include "mg_tiles.h"
 #include "mapgen.h"
 #include "noise.h"
 #include "map.h"
@@ -38,14 +39,58 @@ DecorationManager::DecorationManager(IGameDef *gamedef) :
 void DecorationManager::placeAllDecos(Mapgen *mg, u32 blockseed,
 	v3pos_t nmin, v3pos_t nmax)
 {
+	if (!mg->tile_placer) {
+		for (size_t i = 0; i != m_objects.size(); i++) {
+			Decoration *deco = (Decoration *)m_objects[i];
+			if (!deco)
+				continue;
+
+			deco->placeDeco(mg, blockseed, nmin, nmax);
+			blockseed++;
+		}
+		return;
+	}
+
+	// Runs of decorations that fit into tiles are placed in parallel,
+	// the others alone in between to keep the registration order
+	std::vector<std::pair<Decoration *, u32>> batch;
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Decoration *deco = (Decoration *)m_objects[i];
 		if (!deco)
 			continue;
 
-		deco->placeDeco(mg, blockseed, nmin, nmax);
+		if (deco->canPlaceInTiles()) {
+			batch.emplace_back(deco, blockseed);
+		} else {
+			placeDecosTiled(mg, batch, nmin, nmax);
+			batch.clear();
+			deco->placeDeco(mg, blockseed, nmin, nmax);
+		}
 		blockseed++;
 	}
+	placeDecosTiled(mg, batch, nmin, nmax);
+}
+
+
+void DecorationManager::placeDecosTiled(Mapgen *mg,
+	const std::vector<std::pair<Decoration *, u32>> &decos,
+	v3pos_t nmin, v3pos_t nmax)
+{
+	if (decos.empty())
+		return;
+
+	std::vector<std::vector<std::pair<v3pos_t, u32>>> events(
+			TilePlacer::getTileCount(nmin, nmax));
+	mg->tile_placer->run(nmin, nmax, [&](size_t tile, v2pos_t tmin, v2pos_t tmax) {
+		for (const auto &[deco, seed] : decos) {
+			PcgRandom ps(TilePlacer::getTileSeed(seed + 53, tmin));
+			deco->placeDecoTile(mg, &ps, nmin, nmax, tmin, tmax, events[tile]);
+		}
+	});
+
+	for (const auto &tile_events : events)
+		for (const auto &[pos, id] : tile_events)
+			mg->gennotify.addDecorationEvent(pos, id);
 }
 
 DecorationManager *DecorationManager::clone() const
@@ -141,120 +186,166 @@ void Decoration::placeDeco(Mapgen *mg, u32 blockseed, v3pos_t nmin, v3pos_t nmax
 	if (carea_size % sidelen != 0)
 		sidelen = carea_size;
 
-	int area = sidelen * sidelen;
-
 	for (s16 z0 = 0; z0 < carea_size; z0 += sidelen)
 	for (s16 x0 = 0; x0 < carea_size; x0 += sidelen) {
 		v2pos_t p2d_min(nmin.X + x0, nmin.Z + z0);
 		v2pos_t p2d_max(nmin.X + x0 + sidelen - 1, nmin.Z + z0 + sidelen - 1);
 
-		bool cover = false;
-		// Amount of decorations
-		float nval = (flags & DECO_USE_NOISE) ?
-			NoiseFractal2D(&np, p2d_min.X + sidelen / 2, p2d_min.Y + sidelen / 2, mapseed) :
-			fill_ratio;
-		u32 deco_count = 0;
-
-		if (nval >= 10.0f) {
-			// Complete coverage. Disable random placement to avoid
-			// redundant multiple placements at one position.
-			cover = true;
-			deco_count = area;
+		placeDecoCell(mg, &ps, nmin, nmax, p2d_min, p2d_max, false, nullptr);
+	}
+}
+
+
+void Decoration::placeDecoTile(Mapgen *mg, PcgRandom *ps, v3pos_t nmin, v3pos_t nmax,
+	v2pos_t tmin, v2pos_t tmax, std::vector<std::pair<v3pos_t, u32>> &events)
+{
+	if (nmax.Y < y_min || y_max < nmin.Y)
+		return;
+
+	// Parts bigger than the tile or not fitting into it become the whole tile.
+	// sidelen is not changed, other threads read it.
+	const pos_t tile_x = tmax.X - tmin.X + 1;
+	const pos_t tile_z = tmax.Y - tmin.Y + 1;
+	const pos_t part_x = (tile_x % sidelen == 0) ? sidelen : tile_x;
+	const pos_t part_z = (tile_z % sidelen == 0) ? sidelen : tile_z;
+
+	for (pos_t z0 = 0; z0 < tile_z; z0 += part_z)
+	for (pos_t x0 = 0; x0 < tile_x; x0 += part_x) {
+		v2pos_t p2d_min(tmin.X + x0, tmin.Y + z0);
+		v2pos_t p2d_max(p2d_min.X + part_x - 1, p2d_min.Y + part_z - 1);
+
+		placeDecoCell(mg, ps, nmin, nmax, p2d_min, p2d_max, true, &events);
+	}
+}
+
+
+bool Decoration::canPlaceInTiles() const
+{
+	const pos_t reach = getReach();
+	return reach >= 0 && reach <= TilePlacer::HALO;
+}
+
+
+void Decoration::placeDecoCell(Mapgen *mg, PcgRandom *ps, v3pos_t nmin, v3pos_t nmax,
+	v2pos_t p2d_min, v2pos_t p2d_max, bool tiled,
+	std::vector<std::pair<v3pos_t, u32>> *events)
+{
+	const int carea_size = nmax.X - nmin.X + 1;
+	const pos_t part_x = p2d_max.X - p2d_min.X + 1;
+	const pos_t part_z = p2d_max.Y - p2d_min.Y + 1;
+	const int area = part_x * part_z;
+
+	auto notify = [&](v3pos_t pos) {
+		if (events)
+			events->emplace_back(pos, index);
+		else
+			mg->gennotify.addDecorationEvent(pos, index);
+	};
+
+	bool cover = false;
+	// Amount of decorations
+	float nval = (flags & DECO_USE_NOISE) ?
+		NoiseFractal2D(&np, p2d_min.X + part_x / 2, p2d_min.Y + part_z / 2, mapseed) :
+		fill_ratio;
+	u32 deco_count = 0;
+
+	if (nval >= 10.0f) {
+		// Complete coverage. Disable random placement to avoid
+		// redundant multiple placements at one position.
+		cover = true;
+		deco_count = area;
+	} else {
+		float deco_count_f = (float)area * nval;
+		if (deco_count_f >= 1.0f) {
+			deco_count = deco_count_f;
+		} else if (deco_count_f > 0.0f) {
+			// For very low density calculate a chance for 1 decoration
+			if (ps->next() <= deco_count_f * static_cast<float>(PcgRandom::RANDOM_RANGE))
+				deco_count = 1;
+		}
+	}
+
+	pos_t x = p2d_min.X - 1;
+	pos_t z = p2d_min.Y;
+
+	for (u32 i = 0; i < deco_count; i++) {
+		if (!cover) {
+			x = ps->range(p2d_min.X, p2d_max.X);
+			z = ps->range(p2d_min.Y, p2d_max.Y);
 		} else {
-			float deco_count_f = (float)area * nval;
-			if (deco_count_f >= 1.0f) {
-				deco_count = deco_count_f;
-			} else if (deco_count_f > 0.0f) {
-				// For very low density calculate a chance for 1 decoration
-				if (ps.next() <= deco_count_f * static_cast<float>(PcgRandom::RANDOM_RANGE))
-					deco_count = 1;
+			x++;
+			if (x == p2d_max.X + 1) {
+				z++;
+				x = p2d_min.X;
 			}
 		}
-
-		pos_t x = p2d_min.X - 1;
-		pos_t z = p2d_min.Y;
-
-		for (u32 i = 0; i < deco_count; i++) {
-			if (!cover) {
-				x = ps.range(p2d_min.X, p2d_max.X);
-				z = ps.range(p2d_min.Y, p2d_max.Y);
-			} else {
-				x++;
-				if (x == p2d_max.X + 1) {
-					z++;
-					x = p2d_min.X;
-				}
+		int mapindex = carea_size * (z - nmin.Z) + (x - nmin.X);
+
+		if ((flags & DECO_ALL_FLOORS) ||
+				(flags & DECO_ALL_CEILINGS)) {
+			// All-surfaces decorations
+			// Check biome of column
+			if (mg->biomemap && !biomes.empty()) {
+				auto iter = biomes.find(mg->biomemap[mapindex]);
+				if (iter == biomes.end())
+					continue;
 			}
-			int mapindex = carea_size * (z - nmin.Z) + (x - nmin.X);
-
-			if ((flags & DECO_ALL_FLOORS) ||
-					(flags & DECO_ALL_CEILINGS)) {
-				// All-surfaces decorations
-				// Check biome of column
-				if (mg->biomemap && !biomes.empty()) {
-					auto iter = biomes.find(mg->biomemap[mapindex]);
-					if (iter == biomes.end())
-						continue;
-				}
 
-				// Get all floors and ceilings in node column
-				u16 size = (nmax.Y - nmin.Y + 1) / 2;
-				std::vector<pos_t> floors;
-				std::vector<pos_t> ceilings;
-				floors.reserve(size);
-				ceilings.reserve(size);
-
-				mg->getSurfaces(v2pos_t(x, z), nmin.Y, nmax.Y, floors, ceilings);
-
-				if (flags & DECO_ALL_FLOORS) {
-					// Floor decorations
-					for (const s16 y : floors) {
-						if (y < y_min || y > y_max)
-							continue;
-
-						v3pos_t pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, false))
-							mg->gennotify.addDecorationEvent(pos, index);
-					}
-				}
+			// Get all floors and ceilings in node column
+			u16 size = (nmax.Y - nmin.Y + 1) / 2;
+			std::vector<pos_t> floors;
+			std::vector<pos_t> ceilings;
+			floors.reserve(size);
+			ceilings.reserve(size);
+
+			mg->getSurfaces(v2pos_t(x, z), nmin.Y, nmax.Y, floors, ceilings);
 
-				if (flags & DECO_ALL_CEILINGS) {
-					// Ceiling decorations
-					for (const pos_t y : ceilings) {
-						if (y < y_min || y > y_max)
-							continue;
+			if (flags & DECO_ALL_FLOORS) {
+				// Floor decorations
+				for (const s16 y : floors) {
+					if (y < y_min || y > y_max)
+						continue;
 
-						v3pos_t pos(x, y, z);
-						if (generate(mg->vm, &ps, pos, true))
-							mg->gennotify.addDecorationEvent(pos, index);
-					}
+					v3pos_t pos(x, y, z);
+					if (generate(mg->vm, ps, pos, false, tiled))
+						notify(pos);
 				}
-			} else { // Heightmap decorations
-				pos_t y = -MAX_MAP_GENERATION_LIMIT;
-				if (flags & DECO_LIQUID_SURFACE)
-					y = mg->findLiquidSurface(v2pos_t(x, z), nmin.Y, nmax.Y);
-				else if (mg->heightmap)
-					y = mg->heightmap[mapindex];
-				else
-					y = mg->findGroundLevel(v2pos_t(x, z), nmin.Y, nmax.Y);
-
-				if (y < y_min || y > y_max || y < nmin.Y || y > nmax.Y)
-					continue;
+			}
 
-				if (mg->biomemap && !biomes.empty()) {
-					auto iter = biomes.find(mg->biomemap[mapindex]);
-					if (iter == biomes.end())
+			if (flags & DECO_ALL_CEILINGS) {
+				// Ceiling decorations
+				for (const pos_t y : ceilings) {
+					if (y < y_min || y > y_max)
 						continue;
+
+					v3pos_t pos(x, y, z);
+					if (generate(mg->vm, ps, pos, true, tiled))
+						notify(pos);
 				}
+			}
+		} else { // Heightmap decorations
+			pos_t y = -MAX_MAP_GENERATION_LIMIT;
+			if (flags & DECO_LIQUID_SURFACE)
+				y = mg->findLiquidSurface(v2pos_t(x, z), nmin.Y, nmax.Y);
+			else if (mg->heightmap)
+				y = mg->heightmap[mapindex];
+			else
+				y = mg->findGroundLevel(v2pos_t(x, z), nmin.Y, nmax.Y);
+
+			if (y < y_min || y > y_max || y < nmin.Y || y > nmax.Y)
+				continue;
 
-				v3pos_t pos(x, y, z);
-				if (generate(mg->vm, &ps, pos, false))
-					mg->gennotify.addDecorationEvent(pos, index);
+			if (mg->biomemap && !biomes.empty()) {
+				auto iter = biomes.find(mg->biomemap[mapindex]);
+				if (iter == biomes.end())
+					continue;
 			}
+
+			v3pos_t pos(x, y, z);
+			if (generate(mg->vm, ps, pos, false, tiled))
+				notify(pos);
 		}
 	}
-
-	return;
 }
 
 
@@ -302,7 +393,8 @@ void DecoSimple::resolveNodeNames()
 }
 
 
-size_t DecoSimple::generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling)
+size_t DecoSimple::generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling,
+	bool tiled)
 {
 	// Don't bother if there aren't any decorations to place
 	if (c_decos.empty())
@@ -399,7 +491,17 @@ ObjDef *DecoSchematic::clone() const
 }
 
 
-size_t DecoSchematic::generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling)
+pos_t DecoSchematic::getReach() const
+{
+	if (!schematic)
+		return 0;
+	// Covers any rotation and centering, and the spawnby check
+	return std::max(schematic->size.X, schematic->size.Z);
+}
+
+
+size_t DecoSchematic::generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling,
+	bool tiled)
 {
 	// Schematic could have been unloaded but not the decoration
 	// In this case generate() does nothing (but doesn't *fail*)
@@ -446,7 +548,7 @@ size_t DecoSchematic::generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceil
 
 	bool force_placement = (flags & DECO_FORCE_PLACEMENT);
 
-	schematic->blitToVManip(vm, p, rot, force_placement);
+	schematic->blitToVManip(vm, p, rot, force_placement, tiled ? pr : nullptr);
 
 	return 1;
 }
@@ -462,7 +564,8 @@ ObjDef *DecoLSystem::clone() const
 }
 
 
-size_t DecoLSystem::generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling)
+size_t DecoLSystem::generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling,
+	bool tiled)
 {
 	if (!canPlaceDecoration(vm, p))
 		return 0;
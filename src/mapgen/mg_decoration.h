@@ -6,6 +6,7 @@
 #pragma once
 
 #include <unordered_set>
+#include <vector>
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
@@ -45,8 +46,18 @@ class Decoration : public ObjDef, public NodeResolver {
 
 	bool canPlaceDecoration(MMVManip *vm, v3pos_t p);
 	void placeDeco(Mapgen *mg, u32 blockseed, v3pos_t nmin, v3pos_t nmax);
+	// Place in the columns tmin..tmax of the chunk nmin..nmax, from a
+	// placement thread. Events are added to events, not to mg->gennotify.
+	void placeDecoTile(Mapgen *mg, PcgRandom *ps, v3pos_t nmin, v3pos_t nmax,
+		v2pos_t tmin, v2pos_t tmax, std::vector<std::pair<v3pos_t, u32>> &events);
 
-	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling) = 0;
+	// How far out of its column a decoration reads or writes nodes, -1 if unbounded
+	virtual pos_t getReach() const = 0;
+	bool canPlaceInTiles() const;
+
+	// tiled: all randomness must come from pr
+	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling,
+		bool tiled) = 0;
 
 	u32 flags = 0;
 	int mapseed = 0;
@@ -65,6 +76,11 @@ class Decoration : public ObjDef, public NodeResolver {
 
 protected:
 	void cloneTo(Decoration *def) const;
+
+private:
+	void placeDecoCell(Mapgen *mg, PcgRandom *ps, v3pos_t nmin, v3pos_t nmax,
+		v2pos_t p2d_min, v2pos_t p2d_max, bool tiled,
+		std::vector<std::pair<v3pos_t, u32>> *events);
 };
 
 
@@ -73,7 +89,9 @@ class DecoSimple : public Decoration {
 	ObjDef *clone() const;
 
 	virtual void resolveNodeNames();
-	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling);
+	virtual pos_t getReach() const { return 1; }
+	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling,
+		bool tiled);
 
 	std::vector<content_t> c_decos;
 	s16 deco_height;
@@ -90,7 +108,9 @@ class DecoSchematic : public Decoration {
 	DecoSchematic() = default;
 	virtual ~DecoSchematic();
 
-	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling);
+	virtual pos_t getReach() const;
+	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling,
+		bool tiled);
 
 	Rotation rotation;
 	Schematic *schematic = nullptr;
@@ -102,7 +122,10 @@ class DecoLSystem : public Decoration {
 public:
 	ObjDef *clone() const;
 
-	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling);
+	// Trees can be any size
+	virtual pos_t getReach() const { return -1; }
+	virtual size_t generate(MMVManip *vm, PcgRandom *pr, v3pos_t p, bool ceiling,
+		bool tiled);
 
 	// In case it gets cloned it uses the same tree def.
 	std::shared_ptr<treegen::TreeDef> tree_def;
@@ -139,4 +162,9 @@ class DecorationManager : public ObjDefManager {
 
 private:
 	DecorationManager() {};
+
+	// Place decos with their blockseeds on mg->tile_placer
+	static void placeDecosTiled(Mapgen *mg,
+		const std::vector<std::pair<Decoration *, u32>> &decos,
+		v3pos_t nmin, v3pos_t nmax);
 };
@@ -4,6 +4,7 @@
 // Copyright (C) 2014-2016 kwolekr, Ryan Kwolek <kwolekr@minetest.net>
 
 #include "mg_ore.h"
+#include "mg_tiles.h"
 #include "mapgen.h"
 #include "noise.h"
 #include "map.h"
@@ -32,19 +33,60 @@ size_t OreManager::placeAllOres(Mapgen *mg, u32 blockseed, v3pos_t nmin, v3pos_t
 {
 	size_t nplaced = 0;
 
+	if (!mg->tile_placer) {
+		for (size_t i = 0; i != m_objects.size(); i++) {
+			Ore *ore = (Ore *)m_objects[i];
+			if (!ore)
+				continue;
+
+			nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
+			blockseed++;
+		}
+		return nplaced;
+	}
+
+	// Runs of ores that fit into tiles are placed in parallel,
+	// the others alone in between to keep the registration order
+	std::vector<TiledOre> batch;
 	for (size_t i = 0; i != m_objects.size(); i++) {
 		Ore *ore = (Ore *)m_objects[i];
 		if (!ore)
 			continue;
 
-		nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
+		if (ore->canPlaceInTiles()) {
+			TiledOre tiled{ore, blockseed, nmin, nmax};
+			if (ore->clampY(tiled.nmin, tiled.nmax)) {
+				batch.push_back(tiled);
+				nplaced++;
+			}
+		} else {
+			placeOresTiled(mg, batch, nmin, nmax);
+			batch.clear();
+			nplaced += ore->placeOre(mg, blockseed, nmin, nmax);
+		}
 		blockseed++;
 	}
+	placeOresTiled(mg, batch, nmin, nmax);
 
 	return nplaced;
 }
 
 
+void OreManager::placeOresTiled(Mapgen *mg, const std::vector<TiledOre> &ores,
+	v3pos_t nmin, v3pos_t nmax)
+{
+	if (ores.empty())
+		return;
+
+	mg->tile_placer->run(nmin, nmax, [&](size_t tile, v2pos_t tmin, v2pos_t tmax) {
+		for (const auto &tiled : ores) {
+			tiled.ore->generateTile(mg->vm, mg->seed, tiled.blockseed,
+					tiled.nmin, tiled.nmax, tmin, tmax, mg->biomemap);
+		}
+	});
+}
+
+
 void OreManager::clear()
 {
 	for (ObjDef *object : m_objects) {
@@ -81,19 +123,28 @@ void Ore::resolveNodeNames()
 
 size_t Ore::placeOre(Mapgen *mg, u32 blockseed, v3pos_t nmin, v3pos_t nmax)
 {
-	if (nmin.Y > y_max || nmax.Y < y_min)
+	if (!clampY(nmin, nmax))
 		return 0;
 
+	generate(mg->vm, mg->seed, blockseed, nmin, nmax, mg->biomemap);
+
+	return 1;
+}
+
+
+bool Ore::clampY(v3pos_t &nmin, v3pos_t &nmax) const
+{
+	if (nmin.Y > y_max || nmax.Y < y_min)
+		return false;
+
 	int actual_ymin = MYMAX(nmin.Y, y_min);
 	int actual_ymax = MYMIN(nmax.Y, y_max);
 	if (clust_size >= actual_ymax - actual_ymin + 1)
-		return 0;
+		return false;
 
 	nmin.Y = actual_ymin;
 	nmax.Y = actual_ymax;
-	generate(mg->vm, mg->seed, blockseed, nmin, nmax, mg->biomemap);
-
-	return 1;
+	return true;
 }
 
 
@@ -134,45 +185,111 @@ void OreScatter::generate(MMVManip *vm, int mapseed, u32 blockseed,
 	PcgRandom pr(blockseed);
 	MapNode n_ore(c_ore, 0, ore_param2);
 
-	u32 sizex  = (nmax.X - nmin.X + 1);
+	u32 sizex = nmax.X - nmin.X + 1;
+	u32 nclusters = getClusterCount(pr, nmin, nmax);
+
+	for (u32 i = 0; i != nclusters; i++) {
+		v3pos_t p0 = getClusterPos(pr, nmin, nmax);
+
+		if (!canPlaceCluster(mapseed, p0, nmin, sizex, biomemap))
+			continue;
+
+		placeCluster(vm, pr, p0, n_ore);
+	}
+}
+
+
+bool OreScatter::canPlaceInTiles() const
+{
+	return clust_size <= TilePlacer::TILE_SIZE;
+}
+
+
+void OreScatter::generateTile(MMVManip *vm, int mapseed, u32 blockseed,
+	v3pos_t nmin, v3pos_t nmax, v2pos_t tmin, v2pos_t tmax, biome_t *biomemap)
+{
+	// Every tile draws the same clusters as for the whole chunk and places
+	// the ones starting in it. Those reach less than a tile into the next
+	// tiles, which run in other passes.
+	PcgRandom pr(blockseed);
+	MapNode n_ore(c_ore, 0, ore_param2);
+
+	u32 sizex = nmax.X - nmin.X + 1;
+	u32 nclusters = getClusterCount(pr, nmin, nmax);
+
+	for (u32 i = 0; i != nclusters; i++) {
+		v3pos_t p0 = getClusterPos(pr, nmin, nmax);
+		if (p0.X < tmin.X || p0.X > tmax.X || p0.Z < tmin.Y || p0.Z > tmax.Y)
+			continue;
+
+		if (!canPlaceCluster(mapseed, p0, nmin, sizex, biomemap))
+			continue;
+
+		PcgRandom cpr(blockseed + i * 7919);
+		placeCluster(vm, cpr, p0, n_ore);
+	}
+}
+
+
+u32 OreScatter::getClusterCount(PcgRandom &pr, v3pos_t nmin, v3pos_t nmax) const
+{
 	u32 volume = (nmax.X - nmin.X + 1) *
 				 (nmax.Y - nmin.Y + 1) *
 				 (nmax.Z - nmin.Z + 1);
-	u32 csize     = clust_size;
-	u32 cvolume    = csize * csize * csize;
 	u32 nclusters = volume / clust_scarcity;
 
 	if (clust_scarcity > volume && 1 >= pr.range(0, clust_scarcity/volume))
 		nclusters = 1;
 
-	for (u32 i = 0; i != nclusters; i++) {
-		int x0 = pr.range(nmin.X, nmax.X - csize + 1);
-		int y0 = pr.range(nmin.Y, nmax.Y - csize + 1);
-		int z0 = pr.range(nmin.Z, nmax.Z - csize + 1);
+	return nclusters;
+}
 
-		if ((flags & OREFLAG_USE_NOISE) &&
-			(NoiseFractal3D(&np, x0, y0, z0, mapseed) < nthresh))
-			continue;
 
-		if (biomemap && !biomes.empty()) {
-			u32 index = sizex * (z0 - nmin.Z) + (x0 - nmin.X);
-			auto it = biomes.find(biomemap[index]);
-			if (it == biomes.end())
-				continue;
-		}
+v3pos_t OreScatter::getClusterPos(PcgRandom &pr, v3pos_t nmin, v3pos_t nmax) const
+{
+	u32 csize = clust_size;
+	int x0 = pr.range(nmin.X, nmax.X - csize + 1);
+	int y0 = pr.range(nmin.Y, nmax.Y - csize + 1);
+	int z0 = pr.range(nmin.Z, nmax.Z - csize + 1);
+	return v3pos_t(x0, y0, z0);
+}
 
-		for (u32 z1 = 0; z1 != csize; z1++)
-		for (u32 y1 = 0; y1 != csize; y1++)
-		for (u32 x1 = 0; x1 != csize; x1++) {
-			if (pr.range(1, cvolume) > clust_num_ores)
-				continue;
 
-			u32 i = vm->m_area.index(x0 + x1, y0 + y1, z0 + z1);
-			if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
-				continue;
+bool OreScatter::canPlaceCluster(int mapseed, v3pos_t p0, v3pos_t nmin,
+	u32 sizex, biome_t *biomemap) const
+{
+	if ((flags & OREFLAG_USE_NOISE) &&
+		(NoiseFractal3D(&np, p0.X, p0.Y, p0.Z, mapseed) < nthresh))
+		return false;
+
+	if (biomemap && !biomes.empty()) {
+		u32 index = sizex * (p0.Z - nmin.Z) + (p0.X - nmin.X);
+		auto it = biomes.find(biomemap[index]);
+		if (it == biomes.end())
+			return false;
+	}
 
-			vm->m_data[i] = n_ore;
-		}
+	return true;
+}
+
+
+void OreScatter::placeCluster(MMVManip *vm, PcgRandom &pr, v3pos_t p0,
+	MapNode n_ore) const
+{
+	u32 csize   = clust_size;
+	u32 cvolume = csize * csize * csize;
+
+	for (u32 z1 = 0; z1 != csize; z1++)
+	for (u32 y1 = 0; y1 != csize; y1++)
+	for (u32 x1 = 0; x1 != csize; x1++) {
+		if (pr.range(1, cvolume) > clust_num_ores)
+			continue;
+
+		u32 i = vm->m_area.index(p0.X + x1, p0.Y + y1, p0.Z + z1);
+		if (!CONTAINS(c_wherein, vm->m_data[i].getContent()))
+			continue;
+
+		vm->m_data[i] = n_ore;
 	}
 }
 
@@ -9,6 +9,7 @@
 #include "objdef.h"
 #include "noise.h"
 #include "nodedef.h"
+#include "irr_v2d.h"
 #include "irr_v3d.h"
 
 typedef u16 biome_t;  // copy from mg_biome.h to avoid an unnecessary include
@@ -16,6 +17,7 @@ typedef u16 biome_t;  // copy from mg_biome.h to avoid an unnecessary include
 class Noise;
 class Mapgen;
 class MMVManip;
+class PcgRandom;
 
 /////////////////// Ore generation flags
 
@@ -63,6 +65,17 @@ class Ore : public ObjDef, public NodeResolver {
 	virtual void generate(MMVManip *vm, int mapseed, u32 blockseed,
 		v3pos_t nmin, v3pos_t nmax, biome_t *biomemap) = 0;
 
+	// Clamp the y range to the ore, false if there is nothing to place
+	bool clampY(v3pos_t &nmin, v3pos_t &nmax) const;
+
+	// Ores placing nodes less than a tile out of the columns they are given
+	// can be placed per tile from placement threads with generateTile().
+	// It gets the seed and y clamped area of the whole chunk.
+	virtual bool canPlaceInTiles() const { return false; }
+	virtual void generateTile(MMVManip *vm, int mapseed, u32 blockseed,
+		v3pos_t nmin, v3pos_t nmax, v2pos_t tmin, v2pos_t tmax,
+		biome_t *biomemap) {}
+
 protected:
 	void cloneTo(Ore *def) const;
 };
@@ -75,6 +88,21 @@ class OreScatter : public Ore {
 
 	void generate(MMVManip *vm, int mapseed, u32 blockseed,
 			v3pos_t nmin, v3pos_t nmax, biome_t *biomemap) override;
+
+	// Places the chunk's clusters starting in the tile
+	bool canPlaceInTiles() const override;
+	void generateTile(MMVManip *vm, int mapseed, u32 blockseed,
+			v3pos_t nmin, v3pos_t nmax, v2pos_t tmin, v2pos_t tmax,
+			biome_t *biomemap) override;
+
+private:
+	u32 getClusterCount(PcgRandom &pr, v3pos_t nmin, v3pos_t nmax) const;
+	v3pos_t getClusterPos(PcgRandom &pr, v3pos_t nmin, v3pos_t nmax) const;
+	// Noise and biome check, biomemap starts at nmin and is sizex wide
+	bool canPlaceCluster(int mapseed, v3pos_t p0, v3pos_t nmin, u32 sizex,
+			biome_t *biomemap) const;
+	void placeCluster(MMVManip *vm, PcgRandom &pr, v3pos_t p0,
+			MapNode n_ore) const;
 };
 
 class OreSheet : public Ore {
@@ -183,4 +211,14 @@ class OreManager : public ObjDefManager {
 
 private:
 	OreManager() {};
+
+	struct TiledOre {
+		Ore *ore;
+		u32 blockseed;
+		v3pos_t nmin;
+		v3pos_t nmax;
+	};
+	// Place ores on mg->tile_placer
+	static void placeOresTiled(Mapgen *mg, const std::vector<TiledOre> &ores,
+		v3pos_t nmin, v3pos_t nmax);
 };
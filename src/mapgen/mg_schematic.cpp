@@ -109,7 +109,8 @@ void Schematic::resolveNodeNames()
 }
 
 
-void Schematic::blitToVManip(MMVManip *vm, v3pos_t p, Rotation rot, bool force_place)
+void Schematic::blitToVManip(MMVManip *vm, v3pos_t p, Rotation rot, bool force_place,
+	PcgRandom *pr)
 {
 	assert(schemdata && slice_probs);
 	sanity_check(m_ndef != NULL);
@@ -122,6 +123,11 @@ void Schematic::blitToVManip(MMVManip *vm, v3pos_t p, Rotation rot, bool force_p
 	s16 sy = size.Y;
 	s16 sz = size.Z;
 
+	auto random_prob = [pr]() {
+		return pr ? pr->range(1, MTSCHEM_PROB_ALWAYS) :
+			myrand_range(1, MTSCHEM_PROB_ALWAYS);
+	};
+
 	int i_start, i_step_x, i_step_z;
 	switch (rot) {
 		case ROTATE_90:
@@ -150,7 +156,7 @@ void Schematic::blitToVManip(MMVManip *vm, v3pos_t p, Rotation rot, bool force_p
 	s16 y_map = p.Y;
 	for (s16 y = 0; y != sy; y++) {
 		if ((slice_probs[y] != MTSCHEM_PROB_ALWAYS) &&
-			(slice_probs[y] <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+			(slice_probs[y] <= random_prob()))
 			continue;
 
 		for (s16 z = 0; z != sz; z++) {
@@ -177,7 +183,7 @@ void Schematic::blitToVManip(MMVManip *vm, v3pos_t p, Rotation rot, bool force_p
 				}
 
 				if ((placement_prob != MTSCHEM_PROB_ALWAYS) &&
-					(placement_prob <= myrand_range(1, MTSCHEM_PROB_ALWAYS)))
+					(placement_prob <= random_prob()))
 					continue;
 
 				vm->m_data[vi] = schemdata[i];
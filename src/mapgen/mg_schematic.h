@@ -92,7 +92,9 @@ class Schematic : public ObjDef, public NodeResolver {
 	bool serializeToMts(std::ostream *os) const;
 	bool serializeToLua(std::ostream *os, bool use_comments, u32 indent_spaces) const;
 
-	void blitToVManip(MMVManip *vm, v3pos_t p, Rotation rot, bool force_place);
+	// pr: random for the node and slice probabilities, the global one if null
+	void blitToVManip(MMVManip *vm, v3pos_t p, Rotation rot, bool force_place,
+		PcgRandom *pr = nullptr);
 	bool placeOnVManip(MMVManip *vm, v3pos_t p, u32 flags, Rotation rot, bool force_place);
 	void placeOnMap(ServerMap *map, v3pos_t p, u32 flags, Rotation rot, bool force_place);
 
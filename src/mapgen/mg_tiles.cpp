@@ -0,0 +1,75 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "mg_tiles.h"
+#include <future>
+#include <vector>
+#include "threading/ThreadPool.h"
+#include "threading/async.h"
+
+TilePlacer::TilePlacer(size_t threads) : m_threads(std::max<size_t>(threads, 1))
+{
+	if (m_threads > 1)
+		m_pool = std::make_unique<progschj::ThreadPool>(m_threads);
+}
+
+TilePlacer::~TilePlacer() = default;
+
+size_t TilePlacer::getTileCount(v3pos_t nmin, v3pos_t nmax)
+{
+	const pos_t sx = nmax.X - nmin.X + 1;
+	const pos_t sz = nmax.Z - nmin.Z + 1;
+	if (sx % TILE_SIZE || sz % TILE_SIZE)
+		return 1;
+	return (sx / TILE_SIZE) * (sz / TILE_SIZE);
+}
+
+void TilePlacer::run(v3pos_t nmin, v3pos_t nmax, const tile_func &fn)
+{
+	const pos_t sx = nmax.X - nmin.X + 1;
+	const pos_t sz = nmax.Z - nmin.Z + 1;
+	if (sx % TILE_SIZE || sz % TILE_SIZE) {
+		// Odd chunk size, the whole area is one tile
+		fn(0, v2pos_t(nmin.X, nmin.Z), v2pos_t(nmax.X, nmax.Z));
+		return;
+	}
+
+	const pos_t tiles_x = sx / TILE_SIZE;
+	const pos_t tiles_z = sz / TILE_SIZE;
+	std::vector<std::future<void>> futures;
+	for (int pass = 0; pass < 4; ++pass) {
+		for (pos_t tz = pass / 2; tz < tiles_z; tz += 2)
+			for (pos_t tx = pass % 2; tx < tiles_x; tx += 2) {
+				const size_t tile = tz * tiles_x + tx;
+				const v2pos_t tmin(nmin.X + tx * TILE_SIZE, nmin.Z + tz * TILE_SIZE);
+				const v2pos_t tmax = tmin + v2pos_t(TILE_SIZE - 1, TILE_SIZE - 1);
+				if (m_pool)
+					futures.emplace_back(m_pool->enqueue(fn, tile, tmin, tmax));
+				else
+					fn(tile, tmin, tmax);
+			}
+
+		wait_all(futures);
+		futures.clear();
+	}
+}
+
+u32 TilePlacer::getTileSeed(u32 seed, v2pos_t tmin)
+{
+	// Like Mapgen::getBlockSeed
+	return seed + (u32)tmin.Y * 38134234 + (u32)tmin.X * 23;
+}
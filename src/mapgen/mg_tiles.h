@@ -0,0 +1,64 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include "irr_v2d.h"
+#include "irr_v3d.h"
+
+namespace progschj
+{
+class ThreadPool;
+}
+
+/*
+	Runs ore and decoration placement on columns of a chunk in parallel.
+
+	The chunk is cut into TILE_SIZE square columns. Tiles are run in four
+	passes by the parity of their x and z index, tiles of one pass are a
+	whole tile apart, so placements reaching less than HALO nodes out of
+	their tile never touch each other. Each tile gets its own random seed
+	from its position, results do not depend on the number of threads.
+*/
+class TilePlacer
+{
+public:
+	static constexpr pos_t TILE_SIZE = 16;
+	// Max distance out of its tile a placement may read or write
+	static constexpr pos_t HALO = TILE_SIZE / 2;
+
+	using tile_func = std::function<void(size_t tile, v2pos_t tmin, v2pos_t tmax)>;
+
+	// threads: 1 runs the tiles in the calling thread
+	TilePlacer(size_t threads);
+	~TilePlacer();
+
+	size_t getThreads() const { return m_threads; }
+
+	// Number of tiles for the area, tile indices passed to fn are below this
+	static size_t getTileCount(v3pos_t nmin, v3pos_t nmax);
+	// Run fn on every tile of the xz area of nmin..nmax and wait for them
+	void run(v3pos_t nmin, v3pos_t nmax, const tile_func &fn);
+
+	static u32 getTileSeed(u32 seed, v2pos_t tmin);
+
+private:
+	const size_t m_threads;
+	std::unique_ptr<progschj::ThreadPool> m_pool;
+};
@@ -40,6 +40,20 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 
 #define myfloor(x) ((x) < 0 ? (int)(x) - 1 : (int)(x))
 
+// The bulk noise kernels below are plain loops over rows of points, which
+// the compiler vectorises (SSE2 on x86-64, NEON on arm64). They must keep the
+// exact expressions of noise2d()/noise3d() and the interpolation functions so
+// results stay bit-identical. Where the toolchain supports it an AVX2 clone is
+// selected at runtime, it must not use FMA for the same reason.
+#if defined(__x86_64__) && defined(__GLIBC__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define NOISE_KERNEL __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef NOISE_KERNEL
+#define NOISE_KERNEL
+#endif
+
 const FlagDesc flagdesc_noiseparams[] = {
 	{"defaults",    NOISE_FLAG_DEFAULTS},
 	{"eased",       NOISE_FLAG_EASED},
@@ -221,6 +235,68 @@ inline float biLinearInterpolation(
 }
 
 
+// noise2d() of count points starting at x0, y
+NOISE_KERNEL
+static void noise2dRow(float *out, s32 x0, s32 y, s32 seed, u32 count)
+{
+	// Unsigned math wraps the same as the int math in noise2d()
+	const u32 base = NOISE_MAGIC_Y * (u32)y + NOISE_MAGIC_SEED * (u32)seed;
+	for (u32 i = 0; i != count; i++) {
+		u32 n = (NOISE_MAGIC_X * ((u32)x0 + i) + base) & 0x7fffffff;
+		n = (n >> 13) ^ n;
+		n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
+		out[i] = 1.f - (float)(int)n / 0x40000000;
+	}
+}
+
+
+// noise3d() of count points starting at x0, y, z
+NOISE_KERNEL
+static void noise3dRow(float *out, s32 x0, s32 y, s32 z, s32 seed, u32 count)
+{
+	const u32 base = NOISE_MAGIC_Y * (u32)y + NOISE_MAGIC_Z * (u32)z +
+			NOISE_MAGIC_SEED * (u32)seed;
+	for (u32 i = 0; i != count; i++) {
+		u32 n = (NOISE_MAGIC_X * ((u32)x0 + i) + base) & 0x7fffffff;
+		n = (n >> 13) ^ n;
+		n = (n * (n * n * 60493 + 19990303) + 1376312589) & 0x7fffffff;
+		out[i] = 1.f - (float)(int)n / 0x40000000;
+	}
+}
+
+
+// Interpolate a lattice row along x at each point of a row
+NOISE_KERNEL
+static void lerpColumns(float *out, const float *lattice, const u32 *col,
+		const float *weight, u32 count)
+{
+	for (u32 i = 0; i != count; i++)
+		out[i] = linearInterpolation(lattice[col[i]], lattice[col[i] + 1], weight[i]);
+}
+
+
+// Second step of biLinearInterpolation() for a row of points
+NOISE_KERNEL
+static void lerpRows(float *out, const float *a, const float *b, float t, u32 count)
+{
+	for (u32 i = 0; i != count; i++)
+		out[i] = linearInterpolation(a[i], b[i], t);
+}
+
+
+// Last steps of triLinearInterpolation() for a row of points
+NOISE_KERNEL
+static void lerpRows3D(float *out, const float *a0, const float *b0,
+		const float *a1, const float *b1, float ty, float tz, u32 count)
+{
+	for (u32 i = 0; i != count; i++) {
+		float u = linearInterpolation(a0[i], b0[i], ty);
+		float v = linearInterpolation(a1[i], b1[i], ty);
+		out[i] = linearInterpolation(u, v, tz);
+	}
+}
+
+
 inline float triLinearInterpolation(
 	float v000, float v100, float v010, float v110,
 	float v001, float v101, float v011, float v111,
@@ -385,6 +461,82 @@ float NoiseFractal3D(const NoiseParams *np, float x, float y, float z, s32 seed)
 }
 
 
+bool NoiseTileCache::Key::operator==(const Key &other) const
+{
+	const auto &a = np, &b = other.np;
+	return seed == other.seed && x == other.x && y == other.y &&
+			sx == other.sx && sy == other.sy &&
+			a.offset == b.offset && a.scale == b.scale && a.spread == b.spread &&
+			a.seed == b.seed && a.octaves == b.octaves && a.persist == b.persist &&
+			a.lacunarity == b.lacunarity && a.flags == b.flags &&
+			a.far_scale == b.far_scale && a.far_spread == b.far_spread &&
+			a.far_persist == b.far_persist && a.far_lacunarity == b.far_lacunarity;
+}
+
+
+size_t NoiseTileCache::KeyHash::operator()(const Key &key) const
+{
+	// Maps of one noise differ mostly by position
+	size_t h = std::hash<float>()(key.x);
+	h = h * 31 + std::hash<float>()(key.y);
+	h = h * 31 + std::hash<s32>()(key.seed + key.np.seed);
+	h = h * 31 + std::hash<float>()(key.np.spread.X);
+	h = h * 31 + std::hash<float>()(key.np.offset);
+	h = h * 31 + key.sx * key.sy;
+	return h;
+}
+
+
+bool NoiseTileCache::get(const Key &key, float *result)
+{
+	{
+		const std::lock_guard lock(m_mutex);
+		const auto it = m_map.find(key);
+		if (it != m_map.end()) {
+			m_lru.splice(m_lru.begin(), m_lru, it->second);
+			const auto &map = it->second->second;
+			memcpy(result, map.data(), sizeof(float) * map.size());
+			++m_hits;
+			return true;
+		}
+	}
+	++m_misses;
+	return false;
+}
+
+
+void NoiseTileCache::put(const Key &key, const float *result)
+{
+	const size_t count = key.sx * key.sy;
+	const size_t bytes = sizeof(float) * count;
+	if (bytes > m_max_bytes)
+		return;
+
+	const std::lock_guard lock(m_mutex);
+	// Another thread may have made the same map meanwhile
+	if (m_map.count(key))
+		return;
+
+	while (m_bytes + bytes > m_max_bytes && !m_lru.empty()) {
+		const auto &last = m_lru.back();
+		m_bytes -= sizeof(float) * last.second.size();
+		m_map.erase(last.first);
+		m_lru.pop_back();
+	}
+
+	m_lru.emplace_front(key, std::vector<float>(result, result + count));
+	m_map.emplace(key, m_lru.begin());
+	m_bytes += bytes;
+}
+
+
+size_t NoiseTileCache::size() const
+{
+	const std::lock_guard lock(m_mutex);
+	return m_lru.size();
+}
+
+
 Noise::Noise(const NoiseParams *np_, s32 seed, u32 sx, u32 sy, u32 sz)
 {
 	np = *np_;
@@ -432,6 +584,9 @@ void Noise::allocBuffers()
 		this->persist_buf = NULL;
 		this->value_buf = new float[bufsize];
 		this->result = new float[bufsize];
+		col_index.resize(sx);
+		col_weight.resize(sx);
+		lerp_buf.resize(sx * 4);
 	} catch (std::bad_alloc &e) {
 		throw InvalidNoiseParamsException();
 	}
@@ -518,14 +673,30 @@ void Noise::resizeNoiseBuf(bool is3d)
  * values from the previous noise lattice as midpoints in the new lattice for the
  * next octave.
  */
+void Noise::prepareColumns(float u, float step_x, bool eased)
+{
+	u32 noisex = 0;
+	for (u32 i = 0; i != sx; i++) {
+		col_index[i] = noisex;
+		col_weight[i] = eased ? easeCurve(u) : u;
+
+		u += step_x;
+		if (u >= 1.0) {
+			u -= 1.0;
+			noisex++;
+		}
+	}
+}
+
+
 #define idx(x, y) ((y) * nlx + (x))
 void Noise::valueMap2D(
 		float x, float y,
 		float step_x, float step_y,
 		s32 seed)
 {
-	float v00, v01, v10, v11, u, v, orig_u;
-	u32 index, i, j, noisex, noisey;
+	float u, v;
+	u32 index, j, noisey;
 	u32 nlx, nly;
 	s32 x0, y0;
 
@@ -534,46 +705,34 @@ void Noise::valueMap2D(
 	y0 = std::floor(y);
 	u = x - (float)x0;
 	v = y - (float)y0;
-	orig_u = u;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
-	index = 0;
 	for (j = 0; j != nly; j++)
-		for (i = 0; i != nlx; i++)
-			noise_buf[index++] = noise2d(x0 + i, y0 + j, seed);
+		noise2dRow(&noise_buf[idx(0, j)], x0, y0 + j, seed, nlx);
 
 	//calculate interpolations
+	// Rows of points between the same lattice rows share the x interpolations
+	prepareColumns(u, step_x, eased);
+	float *row0 = &lerp_buf[0];
+	float *row1 = &lerp_buf[sx];
+	lerpColumns(row0, &noise_buf[idx(0, 0)], col_index.data(), col_weight.data(), sx);
+	lerpColumns(row1, &noise_buf[idx(0, 1)], col_index.data(), col_weight.data(), sx);
+
 	index  = 0;
 	noisey = 0;
 	for (j = 0; j != sy; j++) {
-		v00 = noise_buf[idx(0, noisey)];
-		v10 = noise_buf[idx(1, noisey)];
-		v01 = noise_buf[idx(0, noisey + 1)];
-		v11 = noise_buf[idx(1, noisey + 1)];
-
-		u = orig_u;
-		noisex = 0;
-		for (i = 0; i != sx; i++) {
-			value_buf[index++] =
-				biLinearInterpolation(v00, v10, v01, v11, u, v, eased);
-
-			u += step_x;
-			if (u >= 1.0) {
-				u -= 1.0;
-				noisex++;
-				v00 = v10;
-				v01 = v11;
-				v10 = noise_buf[idx(noisex + 1, noisey)];
-				v11 = noise_buf[idx(noisex + 1, noisey + 1)];
-			}
-		}
+		lerpRows(&value_buf[index], row0, row1, eased ? easeCurve(v) : v, sx);
+		index += sx;
 
 		v += step_y;
 		if (v >= 1.0) {
 			v -= 1.0;
 			noisey++;
+			std::swap(row0, row1);
+			lerpColumns(row1, &noise_buf[idx(0, noisey + 1)], col_index.data(),
+					col_weight.data(), sx);
 		}
 	}
 }
@@ -586,10 +745,8 @@ void Noise::valueMap3D(
 		float step_x, float step_y, float step_z,
 		s32 seed)
 {
-	float v000, v010, v100, v110;
-	float v001, v011, v101, v111;
-	float u, v, w, orig_u, orig_v;
-	u32 index, i, j, k, noisex, noisey, noisez;
+	float u, v, w, orig_v;
+	u32 index, j, k, noisey, noisez;
 	u32 nlx, nly, nlz;
 	s32 x0, y0, z0;
 
@@ -601,64 +758,49 @@ void Noise::valueMap3D(
 	u = x - (float)x0;
 	v = y - (float)y0;
 	w = z - (float)z0;
-	orig_u = u;
 	orig_v = v;
 
 	//calculate noise point lattice
 	nlx = (u32)(u + sx * step_x) + 2;
 	nly = (u32)(v + sy * step_y) + 2;
 	nlz = (u32)(w + sz * step_z) + 2;
-	index = 0;
 	for (k = 0; k != nlz; k++)
 		for (j = 0; j != nly; j++)
-			for (i = 0; i != nlx; i++)
-				noise_buf[index++] = noise3d(x0 + i, y0 + j, z0 + k, seed);
+			noise3dRow(&noise_buf[idx(0, j, k)], x0, y0 + j, z0 + k, seed, nlx);
 
 	//calculate interpolations
+	// Rows of points between the same lattice rows share the x interpolations
+	prepareColumns(u, step_x, eased);
+	float *row00 = &lerp_buf[0];
+	float *row10 = &lerp_buf[sx];
+	float *row01 = &lerp_buf[sx * 2];
+	float *row11 = &lerp_buf[sx * 3];
+	const auto lerp_lattice_rows = [&] (u32 noisey, u32 noisez) {
+		const u32 *col = col_index.data();
+		const float *weight = col_weight.data();
+		lerpColumns(row00, &noise_buf[idx(0, noisey,     noisez)],     col, weight, sx);
+		lerpColumns(row10, &noise_buf[idx(0, noisey + 1, noisez)],     col, weight, sx);
+		lerpColumns(row01, &noise_buf[idx(0, noisey,     noisez + 1)], col, weight, sx);
+		lerpColumns(row11, &noise_buf[idx(0, noisey + 1, noisez + 1)], col, weight, sx);
+	};
+
 	index  = 0;
-	noisey = 0;
 	noisez = 0;
 	for (k = 0; k != sz; k++) {
+		const float tz = eased ? easeCurve(w) : w;
 		v = orig_v;
 		noisey = 0;
+		lerp_lattice_rows(noisey, noisez);
 		for (j = 0; j != sy; j++) {
-			v000 = noise_buf[idx(0, noisey,     noisez)];
-			v100 = noise_buf[idx(1, noisey,     noisez)];
-			v010 = noise_buf[idx(0, noisey + 1, noisez)];
-			v110 = noise_buf[idx(1, noisey + 1, noisez)];
-			v001 = noise_buf[idx(0, noisey,     noisez + 1)];
-			v101 = noise_buf[idx(1, noisey,     noisez + 1)];
-			v011 = noise_buf[idx(0, noisey + 1, noisez + 1)];
-			v111 = noise_buf[idx(1, noisey + 1, noisez + 1)];
-
-			u = orig_u;
-			noisex = 0;
-			for (i = 0; i != sx; i++) {
-				value_buf[index++] = triLinearInterpolation(
-					v000, v100, v010, v110,
-					v001, v101, v011, v111,
-					u, v, w,
-					eased);
-
-				u += step_x;
-				if (u >= 1.0) {
-					u -= 1.0;
-					noisex++;
-					v000 = v100;
-					v010 = v110;
-					v100 = noise_buf[idx(noisex + 1, noisey,     noisez)];
-					v110 = noise_buf[idx(noisex + 1, noisey + 1, noisez)];
-					v001 = v101;
-					v011 = v111;
-					v101 = noise_buf[idx(noisex + 1, noisey,     noisez + 1)];
-					v111 = noise_buf[idx(noisex + 1, noisey + 1, noisez + 1)];
-				}
-			}
+			lerpRows3D(&value_buf[index], row00, row10, row01, row11,
+					eased ? easeCurve(v) : v, tz, sx);
+			index += sx;
 
 			v += step_y;
 			if (v >= 1.0) {
 				v -= 1.0;
 				noisey++;
+				lerp_lattice_rows(noisey, noisez);
 			}
 		}
 
@@ -682,6 +824,13 @@ float *Noise::noiseMap2D(float x, float y, float *persistence_map)
 	float f = 1.0, g = 1.0;
 	size_t bufsize = sx * sy;
 
+	NoiseTileCache::Key tile_key;
+	if (tile_cache && !persistence_map) {
+		tile_key = {np, seed, x, y, sx, sy};
+		if (tile_cache->get(tile_key, result))
+			return result;
+	}
+
 	x /= np.spread.X * far_spread;
 	y /= np.spread.Y * far_spread;
 
@@ -710,6 +859,9 @@ float *Noise::noiseMap2D(float x, float y, float *persistence_map)
 			result[i] = result[i] * np.scale * far_scale + np.offset;
 	}
 
+	if (tile_cache && !persistence_map)
+		tile_cache->put(tile_key, result);
+
 	return result;
 }
 
@@ -24,6 +24,10 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "constants.h"
 #include "irr_v3d.h"
@@ -176,6 +180,50 @@ struct NoiseParams {
 
 };
 
+// fm:
+/*
+	LRU cache of 2D noise maps, shared by the mapgens of all emerge threads.
+	2D maps do not depend on Y, so chunks stacked vertically can reuse them.
+*/
+class NoiseTileCache {
+public:
+	struct Key {
+		NoiseParams np;
+		s32 seed;
+		float x;
+		float y;
+		u32 sx;
+		u32 sy;
+
+		bool operator==(const Key &other) const;
+	};
+
+	NoiseTileCache(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+	// Copy the map to result if cached
+	bool get(const Key &key, float *result);
+	void put(const Key &key, const float *result);
+
+	size_t size() const;
+	u64 getHits() const { return m_hits; }
+	u64 getMisses() const { return m_misses; }
+
+private:
+	struct KeyHash {
+		size_t operator()(const Key &key) const;
+	};
+	using entry_t = std::pair<Key, std::vector<float>>;
+
+	const size_t m_max_bytes;
+	mutable std::mutex m_mutex;
+	// Most recently used first
+	std::list<entry_t> m_lru;
+	std::unordered_map<Key, std::list<entry_t>::iterator, KeyHash> m_map;
+	size_t m_bytes = 0;
+	std::atomic<u64> m_hits{0};
+	std::atomic<u64> m_misses{0};
+};
+
 class Noise {
 public:
 	NoiseParams np;
@@ -183,6 +231,8 @@ class Noise {
 	u32 sx;
 	u32 sy;
 	u32 sz;
+	// fm: 2D maps without a persistence map are shared through this if set
+	NoiseTileCache *tile_cache = nullptr;
 	float *noise_buf = nullptr;
 	float *value_buf = nullptr;
 	float *persist_buf = nullptr;
@@ -227,8 +277,16 @@ class Noise {
 	}
 
 private:
+	// Lattice column and x weight of each point of a row, they are the same
+	// for every row
+	std::vector<u32> col_index;
+	std::vector<float> col_weight;
+	// Lattice rows interpolated along x
+	std::vector<float> lerp_buf;
+
 	void allocBuffers();
 	void resizeNoiseBuf(bool is3d);
+	void prepareColumns(float u, float step_x, bool eased);
 	void updateResults(float g, float *gmap, const float *persistence_map,
 			size_t bufsize);
 
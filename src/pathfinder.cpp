@@ -166,7 +166,9 @@ class Pathfinder {
 
 public:
 	Pathfinder() = delete;
-	Pathfinder(Map *map, const NodeDefManager *ndef) : m_map(map), m_ndef(ndef) {}
+	Pathfinder(Map *map, const NodeDefManager *ndef,
+			const unordered_set_v3bpos *corridor = nullptr) :
+		m_map(map), m_ndef(ndef), m_corridor(corridor) {}
 
 	/**
 	 * path evaluation function
@@ -310,6 +312,9 @@ class Pathfinder {
 
 	const NodeDefManager *m_ndef = nullptr;
 
+	/** blocks the search is restricted to, nullptr for no restriction */
+	const unordered_set_v3bpos *m_corridor = nullptr;
+
 	friend class PathfinderCompareHeuristic;
 
 #ifdef PATHFINDER_DEBUG
@@ -396,9 +401,10 @@ std::vector<v3pos_t> get_path(Map* map, const NodeDefManager *ndef,
 		unsigned int searchdistance,
 		unsigned int max_jump,
 		unsigned int max_drop,
-		PathAlgorithm algo)
+		PathAlgorithm algo,
+		const unordered_set_v3bpos *corridor)
 {
-	return Pathfinder(map, ndef).getPath(source, destination,
+	return Pathfinder(map, ndef, corridor).getPath(source, destination,
 				searchdistance, max_jump, max_drop, algo);
 }
 
@@ -503,6 +509,12 @@ void GridNodeContainer::initNode(v3pos_t ipos, PathGridnode *p_node)
 
 	v3pos_t realpos = m_pathf->getRealPos(ipos);
 
+	if (m_pathf->m_corridor &&
+			!m_pathf->m_corridor->count(getNodeBlockPos(realpos))) {
+		elem.type = 'i';
+		return;
+	}
+
 	MapNode current = m_pathf->m_map->getNode(realpos);
 	MapNode below   = m_pathf->m_map->getNode(realpos + v3pos_t(0, -1, 0));
 
@@ -608,7 +620,7 @@ std::vector<v3pos_t> Pathfinder::getPath(v3pos_t source,
 	m_min_target_distance = -1;
 	m_prefetch = true;
 
-	if (algo == PA_PLAIN_NP) {
+	if (algo == PA_PLAIN_NP || algo == PA_HIERARCHICAL) {
 		m_prefetch = false;
 	}
 
@@ -709,6 +721,7 @@ std::vector<v3pos_t> Pathfinder::getPath(v3pos_t source,
 			break;
 		case PA_PLAIN_NP:
 		case PA_PLAIN:
+		case PA_HIERARCHICAL:
 			update_cost_retval = updateCostHeuristic(StartIndex, EndIndex);
 			break;
 		default:
@@ -1161,7 +1174,9 @@ bool Pathfinder::updateCostHeuristic(v3pos_t isource, v3pos_t idestination)
 			v3pos_t ineighbor = getIndexPos(neighbor);
 			PathGridnode &n_pos = getIndexElement(ineighbor);
 
-			if (cost.valid && !n_pos.is_closed && !n_pos.is_open) {
+			// Nodes outside of the corridor are not valid, the heap
+			// comparison does not order them
+			if (cost.valid && n_pos.valid && !n_pos.is_closed && !n_pos.is_open) {
 				// heuristic function; estimate cost from neighbor to destination
 				cur_manhattan = getXZManhattanDist(neighbor);
 
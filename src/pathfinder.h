@@ -9,6 +9,7 @@
 /******************************************************************************/
 #include <vector>
 #include "irr_v3d.h"
+#include "util/unordered_map_hash.h"
 
 /******************************************************************************/
 /* Forward declarations                                                       */
@@ -32,18 +33,23 @@ typedef enum {
 typedef enum {
 	PA_DIJKSTRA,           /**< Dijkstra shortest path algorithm             */
 	PA_PLAIN,            /**< A* algorithm using heuristics to find a path */
-	PA_PLAIN_NP          /**< A* algorithm without prefetching of map data */
+	PA_PLAIN_NP,         /**< A* algorithm without prefetching of map data */
+	PA_HIERARCHICAL      /**< A* over the block navigation graph, refined by A*
+	                          inside the found corridor (see fm_pathfinder.h) */
 } PathAlgorithm;
 
 /******************************************************************************/
 /* declarations                                                               */
 /******************************************************************************/
 
-/** c wrapper function to use from scriptapi */
+/** c wrapper function to use from scriptapi
+ * @param corridor if set, only nodes inside these blocks are searched
+ */
 std::vector<v3pos_t> get_path(Map *map, const NodeDefManager *ndef,
 		v3pos_t source,
 		v3pos_t destination,
 		unsigned int searchdistance,
 		unsigned int max_jump,
 		unsigned int max_drop,
-		PathAlgorithm algo);
+		PathAlgorithm algo,
+		const unordered_set_v3bpos *corridor = nullptr);
@@ -24,11 +24,16 @@ extern "C" {
 #include "script/scripting_mainmenu.h"
 #endif
 #include "lua_api/l_base.h"
+#include "profiler.h"
 
 // if a job is waiting for this duration, an additional thread will be spawned
 static constexpr int AUTOSCALE_DELAY_MS = 1000;
 // if jobs are waiting for this duration, a warning is printed
 static constexpr int STUCK_DELAY_MS = 11500;
+// a worker hands its results over at least this often
+static constexpr size_t RESULT_BATCH_SIZE = 32;
+// maximum number of deserialized functions a worker keeps around
+static constexpr size_t FUNCTION_CACHE_SIZE = 64;
 
 /******************************************************************************/
 AsyncEngine::~AsyncEngine()
@@ -55,9 +60,12 @@ AsyncEngine::~AsyncEngine()
 		delete workerThread;
 	}
 
-	jobQueueMutex.lock();
-	jobQueue.clear();
-	jobQueueMutex.unlock();
+	for (auto &queue : jobQueues) {
+		MutexAutoLock autolock(queue->mutex);
+		for (auto &lane : queue->lanes)
+			lane.clear();
+	}
+	queuedJobs = 0;
 	workerThreads.clear();
 }
 
@@ -80,7 +88,15 @@ void AsyncEngine::initialize(unsigned int numEngines)
 			autoscaleMaxWorkers -= 2;
 		infostream << "AsyncEngine: using at most " << autoscaleMaxWorkers
 			<< " threads with automatic scaling" << std::endl;
+	}
+
+	// The queue list must not change once workers run, so allocate one
+	// queue for every worker that may ever exist
+	const size_t queue_count = MYMAX(1U, MYMAX(numEngines, autoscaleMaxWorkers));
+	for (size_t i = 0; i < queue_count; ++i)
+		jobQueues.emplace_back(std::make_unique<JobQueue>());
 
+	if (numEngines == 0) {
 		addWorkerThread();
 	} else {
 		for (unsigned int i = 0; i < numEngines; i++)
@@ -92,6 +108,7 @@ void AsyncEngine::addWorkerThread()
 {
 	AsyncWorkerThread *toAdd = new AsyncWorkerThread(this,
 		std::string("AsyncWorker-") + itos(workerThreads.size()));
+	toAdd->queueIndex = workerThreads.size() % jobQueues.size();
 	workerThreads.push_back(toAdd);
 	toAdd->start();
 }
@@ -100,67 +117,102 @@ void AsyncEngine::addWorkerThread()
 
 u32 AsyncEngine::queueAsyncJob(LuaJobInfo &&job)
 {
-	MutexAutoLock autolock(jobQueueMutex);
+	assert(!jobQueues.empty());
 	u32 jobId = jobIdCounter++;
 
 	assert(!job.function.empty());
+	assert(job.priority < ASYNC_PRIORITY_COUNT);
 	job.id = jobId;
-	jobQueue.push_back(std::move(job));
+	job.queued_us = porting::getTimeUs();
+
+	auto &queue = *jobQueues[nextJobQueue++ % jobQueues.size()];
+	{
+		MutexAutoLock autolock(queue.mutex);
+		queue.lanes[job.priority].push_back(std::move(job));
+	}
+	++queuedJobs;
 
 	jobQueueCounter.post();
 	return jobId;
 }
 
 u32 AsyncEngine::queueAsyncJob(std::string &&func, std::string &&params,
-		const std::string &mod_origin)
+		const std::string &mod_origin, AsyncJobPriority priority)
 {
-	LuaJobInfo to_add(std::move(func), std::move(params), mod_origin);
+	LuaJobInfo to_add(std::move(func), std::move(params), mod_origin, priority);
 	return queueAsyncJob(std::move(to_add));
 }
 
 u32 AsyncEngine::queueAsyncJob(std::string &&func, PackedValue *params,
-		const std::string &mod_origin)
+		const std::string &mod_origin, AsyncJobPriority priority)
 {
-	LuaJobInfo to_add(std::move(func), params, mod_origin);
+	LuaJobInfo to_add(std::move(func), params, mod_origin, priority);
 	return queueAsyncJob(std::move(to_add));
 }
 
 bool AsyncEngine::cancelAsyncJob(u32 id)
 {
-	MutexAutoLock autolock(jobQueueMutex);
-	for (auto job = jobQueue.begin(); job != jobQueue.end(); job++) {
-		if (job->id == id) {
-			jobQueue.erase(job);
-			return true;
+	for (auto &queue : jobQueues) {
+		MutexAutoLock autolock(queue->mutex);
+		for (auto &lane : queue->lanes) {
+			for (auto job = lane.begin(); job != lane.end(); job++) {
+				if (job->id == id) {
+					lane.erase(job);
+					--queuedJobs;
+					return true;
+				}
+			}
 		}
 	}
 	return false;
 }
 
 /******************************************************************************/
-bool AsyncEngine::getJob(LuaJobInfo *job)
+bool AsyncEngine::popJob(JobQueue &queue, AsyncJobPriority lane, LuaJobInfo *job)
 {
-	jobQueueCounter.wait();
-	jobQueueMutex.lock();
+	MutexAutoLock autolock(queue.mutex);
+	auto &jobs = queue.lanes[lane];
+	if (jobs.empty())
+		return false;
+	*job = std::move(jobs.front());
+	jobs.pop_front();
+	--queuedJobs;
+	return true;
+}
 
-	bool retval = false;
+bool AsyncEngine::getJob(LuaJobInfo *job, size_t queue_index,
+		std::vector<LuaJobInfo> &results)
+{
+	// Hand over finished results before blocking, they could wait for
+	// the next job otherwise
+	if (!jobQueueCounter.wait(0)) {
+		putJobResults(results);
+		jobQueueCounter.wait();
+	}
 
-	if (!jobQueue.empty()) {
-		*job = std::move(jobQueue.front());
-		jobQueue.pop_front();
-		retval = true;
+	// Every lane is drained before looking at the next one, taking from the
+	// own queue first and stealing from the others otherwise
+	const size_t count = jobQueues.size();
+	for (u8 lane = 0; lane < ASYNC_PRIORITY_COUNT; ++lane) {
+		for (size_t i = 0; i < count; ++i) {
+			auto &queue = *jobQueues[(queue_index + i) % count];
+			if (popJob(queue, (AsyncJobPriority)lane, job))
+				return true;
+		}
 	}
-	jobQueueMutex.unlock();
 
-	return retval;
+	return false;
 }
 
 /******************************************************************************/
-void AsyncEngine::putJobResult(LuaJobInfo &&result)
+void AsyncEngine::putJobResults(std::vector<LuaJobInfo> &results)
 {
-	resultQueueMutex.lock();
-	resultQueue.emplace_back(std::move(result));
-	resultQueueMutex.unlock();
+	if (results.empty())
+		return;
+	MutexAutoLock autolock(resultQueueMutex);
+	for (auto &result : results)
+		resultQueue.emplace_back(std::move(result));
+	results.clear();
 }
 
 /******************************************************************************/
@@ -178,10 +230,16 @@ void AsyncEngine::stepJobResults(lua_State *L)
 
 	ScriptApiBase *script = ModApiBase::getScriptApiBase(L);
 
-	MutexAutoLock autolock(resultQueueMutex);
-	while (!resultQueue.empty()) {
-		LuaJobInfo j = std::move(resultQueue.front());
-		resultQueue.pop_front();
+	// Take all results at once so workers are not blocked by the callbacks
+	std::deque<LuaJobInfo> results;
+	{
+		MutexAutoLock autolock(resultQueueMutex);
+		results.swap(resultQueue);
+	}
+
+	while (!results.empty()) {
+		LuaJobInfo j = std::move(results.front());
+		results.pop_front();
 
 		lua_getfield(L, -1, "async_event_handler");
 		if (lua_isnil(L, -1))
@@ -198,8 +256,18 @@ void AsyncEngine::stepJobResults(lua_State *L)
 		const char *origin = j.mod_origin.empty() ? nullptr : j.mod_origin.c_str();
 		script->setOriginDirect(origin);
 		int result = lua_pcall(L, 2, 0, error_handler);
-		if (result)
-			script_error(L, result, origin, "<async>");
+		if (result) {
+			try {
+				script_error(L, result, origin, "<async>");
+			} catch (...) {
+				// Keep the remaining results for the next step
+				MutexAutoLock autolock(resultQueueMutex);
+				resultQueue.insert(resultQueue.begin(),
+						std::make_move_iterator(results.begin()),
+						std::make_move_iterator(results.end()));
+				throw;
+			}
+		}
 	}
 
 	lua_pop(L, 2); // Pop core and error handler
@@ -210,8 +278,6 @@ void AsyncEngine::stepAutoscale()
 	if (workerThreads.size() >= autoscaleMaxWorkers)
 		return;
 
-	MutexAutoLock autolock(jobQueueMutex);
-
 	// 2) If the timer elapsed, check again
 	if (autoscaleTimer && porting::getTimeMs() >= autoscaleTimer) {
 		autoscaleTimer = 0;
@@ -228,7 +294,7 @@ void AsyncEngine::stepAutoscale()
 	}
 
 	// 1) Check queue contents
-	if (!autoscaleTimer && !jobQueue.empty()) {
+	if (!autoscaleTimer && hasQueuedJobs()) {
 		autoscaleSeenJobs.clear();
 		snapshotJobs(autoscaleSeenJobs);
 		autoscaleTimer = porting::getTimeMs() + AUTOSCALE_DELAY_MS;
@@ -237,8 +303,6 @@ void AsyncEngine::stepAutoscale()
 
 void AsyncEngine::stepStuckWarning()
 {
-	MutexAutoLock autolock(jobQueueMutex);
-
 	// 2) If the timer elapsed, check again
 	if (stuckTimer && porting::getTimeMs() >= stuckTimer) {
 		stuckTimer = 0;
@@ -251,7 +315,7 @@ void AsyncEngine::stepStuckWarning()
 	}
 
 	// 1) Check queue contents
-	if (!stuckTimer && !jobQueue.empty()) {
+	if (!stuckTimer && hasQueuedJobs()) {
 		stuckSeenJobs.clear();
 		snapshotJobs(stuckSeenJobs);
 		stuckTimer = porting::getTimeMs() + STUCK_DELAY_MS;
@@ -333,6 +397,41 @@ AsyncWorkerThread::~AsyncWorkerThread()
 	sanity_check(!isRunning());
 }
 
+bool AsyncWorkerThread::pushJobFunction(lua_State *L, const std::string &code)
+{
+	// Mods tend to queue the same function over and over, so skip the
+	// bytecode loader for anything seen before
+	const size_t hash = std::hash<std::string>{}(code);
+	auto it = functionCache.find(hash);
+	if (it != functionCache.end() && it->second.code == code) {
+		lua_rawgeti(L, LUA_REGISTRYINDEX, it->second.ref);
+		return true;
+	}
+
+	if (luaL_loadbuffer(L, code.data(), code.size(), "=(async)"))
+		return false;
+
+	if (it != functionCache.end()) {
+		// Hash collision, replace the old entry
+		luaL_unref(L, LUA_REGISTRYINDEX, it->second.ref);
+		functionCache.erase(it);
+	} else if (functionCache.size() >= FUNCTION_CACHE_SIZE) {
+		clearFunctionCache(L);
+	}
+
+	lua_pushvalue(L, -1);
+	const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	functionCache.emplace(hash, CachedFunction{code, ref});
+	return true;
+}
+
+void AsyncWorkerThread::clearFunctionCache(lua_State *L)
+{
+	for (auto &it : functionCache)
+		luaL_unref(L, LUA_REGISTRYINDEX, it.second.ref);
+	functionCache.clear();
+}
+
 bool AsyncWorkerThread::checkPathInternal(const std::string &abs_path,
 	bool write_required, bool *write_allowed)
 {
@@ -372,21 +471,27 @@ void* AsyncWorkerThread::run()
 
 	// Main loop
 	LuaJobInfo j;
+	std::vector<LuaJobInfo> results;
+	results.reserve(RESULT_BATCH_SIZE);
 	while (!stopRequested()) {
 		EXCEPTION_HANDLER_BEGIN;
 		// Wait for job
-		if (!jobDispatcher->getJob(&j) || stopRequested())
+		if (!jobDispatcher->getJob(&j, queueIndex, results) || stopRequested()) {
+			jobDispatcher->putJobResults(results);
 			continue;
+		}
 
 		const bool use_ext = !!j.params_ext;
+		const u64 start_us = porting::getTimeUs();
 
 		lua_getfield(L, -1, "job_processor");
 		if (lua_isnil(L, -1))
 			FATAL_ERROR("Unable to get async job processor!");
 		luaL_checktype(L, -1, LUA_TFUNCTION);
 
-		if (luaL_loadbuffer(L, j.function.data(), j.function.size(), "=(async)")) {
+		if (!pushJobFunction(L, j.function)) {
 			errorstream << "ASYNC WORKER: Unable to deserialize function" << std::endl;
+			lua_pop(L, 1); // Pop error message
 			lua_pushnil(L);
 		}
 		if (use_ext)
@@ -421,22 +526,38 @@ void* AsyncWorkerThread::run()
 
 		lua_pop(L, 1);  // Pop retval
 
-		// Put job result
+		if (g_profiler) {
+			const u64 end_us = porting::getTimeUs();
+			const std::string &mod = j.mod_origin.empty() ? "?" : j.mod_origin;
+			g_profiler->avg("Async: queue latency [ms] " + mod,
+					(start_us - j.queued_us) / 1000.0f);
+			g_profiler->avg("Async: runtime [ms] " + mod,
+					(end_us - start_us) / 1000.0f);
+		}
+
+		// Put job result, results are handed over in batches and by
+		// getJob() before the worker waits for new jobs
 		if (result == 0)
-			jobDispatcher->putJobResult(std::move(j));
+			results.emplace_back(std::move(j));
+		if (results.size() >= RESULT_BATCH_SIZE)
+			jobDispatcher->putJobResults(results);
 		EXCEPTION_HANDLER_END;
 	}
 
+	jobDispatcher->putJobResults(results);
+	clearFunctionCache(L);
+
 	lua_pop(L, 2);  // Pop core and error handler
 
 	return 0;
 }
 
 u32 ScriptApiAsync::queueAsync(std::string &&serialized_func,
-		PackedValue *param, const std::string &mod_origin)
+		PackedValue *param, const std::string &mod_origin,
+		AsyncJobPriority priority)
 {
 	return asyncEngine.queueAsyncJob(std::move(serialized_func),
-			param, mod_origin);
+			param, mod_origin, priority);
 }
 
 bool ScriptApiAsync::cancelAsync(u32 id)
@@ -4,12 +4,15 @@
 
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <deque>
+#include <unordered_map>
 #include <unordered_set>
 #include <memory>
 
 #include <lua.h>
+#include "threading/mutex_auto_lock.h"
 #include "threading/semaphore.h"
 #include "threading/thread.h"
 #include "common/c_packer.h"
@@ -22,14 +25,25 @@ class AsyncEngine;
 
 // Declarations
 
+// Priority lanes, jobs in a lower lane are always dispatched first
+enum AsyncJobPriority : u8
+{
+	ASYNC_PRIORITY_HIGH = 0,
+	ASYNC_PRIORITY_NORMAL,
+	ASYNC_PRIORITY_LOW,
+	ASYNC_PRIORITY_COUNT
+};
+
 // Data required to queue a job
 struct LuaJobInfo
 {
 	LuaJobInfo() = default;
-	LuaJobInfo(std::string &&func, std::string &&params, const std::string &mod_origin = "") :
-		function(func), params(params), mod_origin(mod_origin) {}
-	LuaJobInfo(std::string &&func, PackedValue *params, const std::string &mod_origin = "") :
-		function(func), mod_origin(mod_origin) {
+	LuaJobInfo(std::string &&func, std::string &&params, const std::string &mod_origin = "",
+			AsyncJobPriority priority = ASYNC_PRIORITY_NORMAL) :
+		function(func), params(params), mod_origin(mod_origin), priority(priority) {}
+	LuaJobInfo(std::string &&func, PackedValue *params, const std::string &mod_origin = "",
+			AsyncJobPriority priority = ASYNC_PRIORITY_NORMAL) :
+		function(func), mod_origin(mod_origin), priority(priority) {
 		params_ext.reset(params);
 	}
 
@@ -47,6 +61,10 @@ struct LuaJobInfo
 	std::string mod_origin;
 	// JobID used to identify a job and match it to callback
 	u32 id;
+	// Lane the job is queued in
+	AsyncJobPriority priority = ASYNC_PRIORITY_NORMAL;
+	// Time the job was queued at [us], for latency profiling
+	u64 queued_us = 0;
 };
 
 // Asynchronous working environment
@@ -65,8 +83,27 @@ class AsyncWorkerThread : public Thread,
 		bool *write_allowed) override;
 
 private:
+	/**
+	 * Push the deserialized job function onto the stack, reusing a previously
+	 * loaded chunk of the same code if possible
+	 * @return false if the function could not be deserialized
+	 */
+	bool pushJobFunction(lua_State *L, const std::string &code);
+
+	void clearFunctionCache(lua_State *L);
+
+	struct CachedFunction {
+		std::string code;
+		int ref;
+	};
+
 	AsyncEngine *jobDispatcher = nullptr;
+	// Index of the job queue this worker takes jobs from first
+	size_t queueIndex = 0;
 	bool isErrored = false;
+
+	// Deserialized functions, keyed by hash of their bytecode
+	std::unordered_map<size_t, CachedFunction> functionCache;
 };
 
 // Asynchornous thread and job management
@@ -97,16 +134,19 @@ class AsyncEngine {
 	 * @return jobid The job is queued
 	 */
 	u32 queueAsyncJob(std::string &&func, std::string &&params,
-			const std::string &mod_origin = "");
+			const std::string &mod_origin = "",
+			AsyncJobPriority priority = ASYNC_PRIORITY_NORMAL);
 
 	/**
 	 * Queue an async job
 	 * @param func Serialized lua function
 	 * @param params Serialized parameters (takes ownership!)
+	 * @param priority Lane to queue the job in
 	 * @return ID of queued job
 	 */
 	u32 queueAsyncJob(std::string &&func, PackedValue *params,
-			const std::string &mod_origin = "");
+			const std::string &mod_origin = "",
+			AsyncJobPriority priority = ASYNC_PRIORITY_NORMAL);
 
 	/**
 	 * Try to cancel an async job
@@ -132,10 +172,19 @@ class AsyncEngine {
 	/**
 	 * Get a Job from queue to be processed
 	 *  this function blocks until a job is ready
+	 *  jobs are taken from the worker's own queue first and stolen from the
+	 *  other queues otherwise, always in order of priority
 	 * @param job a job to be processed
+	 * @param queue_index index of the queue owned by the calling worker
+	 * @param results results of the caller, handed over before blocking
 	 * @return whether a job was available
 	 */
-	bool getJob(LuaJobInfo *job);
+	bool getJob(LuaJobInfo *job, size_t queue_index, std::vector<LuaJobInfo> &results);
+
+	/**
+	 * Whether jobs are waiting in any queue
+	 */
+	bool hasQueuedJobs() const { return queuedJobs.load(std::memory_order_relaxed) > 0; }
 
 	/**
 	 * Queue an async job
@@ -145,10 +194,10 @@ class AsyncEngine {
 	u32 queueAsyncJob(LuaJobInfo &&job);
 
 	/**
-	 * Put a Job result back to result queue
-	 * @param result result of completed job
+	 * Put a batch of Job results back to result queue
+	 * @param results results of completed jobs, cleared on return
 	 */
-	void putJobResult(LuaJobInfo &&result);
+	void putJobResults(std::vector<LuaJobInfo> &results);
 
 	/**
 	 * Start an additional worker thread
@@ -181,18 +230,34 @@ class AsyncEngine {
 	bool prepareEnvironment(lua_State* L, int top);
 
 private:
+	// Job queue of a worker, one deque per priority lane
+	struct JobQueue {
+		std::mutex mutex;
+		std::deque<LuaJobInfo> lanes[ASYNC_PRIORITY_COUNT];
+	};
+
+	bool popJob(JobQueue &queue, AsyncJobPriority lane, LuaJobInfo *job);
+
 	template <typename T>
 	inline void snapshotJobs(T &to)
 	{
-		for (const auto &it : jobQueue)
-			to.emplace(it.id);
+		for (auto &queue : jobQueues) {
+			MutexAutoLock autolock(queue->mutex);
+			for (const auto &lane : queue->lanes)
+				for (const auto &it : lane)
+					to.emplace(it.id);
+		}
 	}
 	template <typename T>
 	inline size_t compareJobs(const T &from)
 	{
 		size_t overlap = 0;
-		for (const auto &it : jobQueue)
-			overlap += from.count(it.id);
+		for (auto &queue : jobQueues) {
+			MutexAutoLock autolock(queue->mutex);
+			for (const auto &lane : queue->lanes)
+				for (const auto &it : lane)
+					overlap += from.count(it.id);
+		}
 		return overlap;
 	}
 
@@ -215,12 +280,14 @@ class AsyncEngine {
 	std::vector<StateInitializer> stateInitializers;
 
 	// Internal counter to create job IDs
-	u32 jobIdCounter = 0;
+	std::atomic<u32> jobIdCounter{0};
 
-	// Mutex to protect job queue
-	std::mutex jobQueueMutex;
-	// Job queue
-	std::deque<LuaJobInfo> jobQueue;
+	// Per-worker job queues, allocated once for the maximum number of workers
+	std::vector<std::unique_ptr<JobQueue>> jobQueues;
+	// Queue the next job is pushed to (round robin)
+	std::atomic<size_t> nextJobQueue{0};
+	// Number of jobs waiting in all queues
+	std::atomic<size_t> queuedJobs{0};
 
 	// Mutex to protect result queue
 	std::mutex resultQueueMutex;
@@ -244,7 +311,8 @@ class ScriptApiAsync:
 	void stepAsync();
 
 	u32 queueAsync(std::string &&serialized_func,
-			PackedValue *param, const std::string &mod_origin);
+			PackedValue *param, const std::string &mod_origin,
+			AsyncJobPriority priority = ASYNC_PRIORITY_NORMAL);
 	bool cancelAsync(u32 id);
 	unsigned int getThreadingCapacity() const {
 		return asyncEngine.getThreadingCapacity();
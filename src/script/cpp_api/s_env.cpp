@@ -499,6 +499,51 @@ void ScriptApiEnv::on_emerge_area_completion(
 	}
 }
 
+void ScriptApiEnv::on_find_path_completion(
+	const std::vector<v3pos_t> &path, ScriptCallbackState *state)
+{
+	Server *server = getServer();
+
+	// Called from the environment step, envlock is already held
+
+	SCRIPTAPI_PRECHECKHEADER
+
+	int error_handler = PUSH_ERROR_HANDLER(L);
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, state->callback_ref);
+	luaL_checktype(L, -1, LUA_TFUNCTION);
+
+	if (path.empty()) {
+		lua_pushnil(L);
+	} else {
+		lua_createtable(L, path.size(), 0);
+		int i = 1;
+		for (const v3pos_t &p : path) {
+			push_v3pos(L, p);
+			lua_rawseti(L, -2, i++);
+		}
+	}
+
+	setOriginDirect(state->origin.c_str());
+
+	try {
+		PCALL_RES(lua_pcall(L, 1, 0, error_handler));
+	} catch (LuaError &e) {
+		server->setAsyncFatalError(e);
+	}
+
+	lua_pop(L, 1); // Pop error handler
+
+	luaL_unref(L, LUA_REGISTRYINDEX, state->callback_ref);
+}
+
+void ScriptApiEnv::on_find_path_cancelled(ScriptCallbackState *state)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	luaL_unref(L, LUA_REGISTRYINDEX, state->callback_ref);
+}
+
 void ScriptApiEnv::check_for_falling(v3pos_t p)
 {
 	SCRIPTAPI_PRECHECKHEADER
@@ -41,6 +41,12 @@ class ScriptApiEnv : virtual public ScriptApiBase
 	void on_emerge_area_completion(v3bpos_t blockpos, int action,
 		ScriptCallbackState *state);
 
+	// Called when a path queued from core.find_path_async() is ready
+	void on_find_path_completion(const std::vector<v3pos_t> &path,
+		ScriptCallbackState *state);
+	// Called instead when the request was dropped on shutdown
+	void on_find_path_cancelled(ScriptCallbackState *state);
+
 	void check_for_falling(v3pos_t p);
 
 	// Called after liquid transform changes
@@ -16,7 +16,7 @@ static std::string get_serialized_function(lua_State *L, int index)
 	return serialized_func;
 }
 
-// do_async_callback(func, params, mod_origin)
+// do_async_callback(func, params, mod_origin, [priority])
 int ModApiAsync::l_do_async_callback(lua_State *L)
 {
 	NO_MAP_LOCK_REQUIRED;
@@ -25,13 +25,21 @@ int ModApiAsync::l_do_async_callback(lua_State *L)
 	luaL_checktype(L, 2, LUA_TTABLE);
 	luaL_checktype(L, 3, LUA_TSTRING);
 
+	auto priority = ASYNC_PRIORITY_NORMAL;
+	if (!lua_isnoneornil(L, 4)) {
+		lua_Integer lane = luaL_checkinteger(L, 4);
+		if (lane < 0 || lane >= ASYNC_PRIORITY_COUNT)
+			return luaL_argerror(L, 4, "invalid priority");
+		priority = (AsyncJobPriority)lane;
+	}
+
 	auto serialized_func = get_serialized_function(L, 1);
 	PackedValue *param = script_pack(L, 2);
 	std::string mod_origin = readParam<std::string>(L, 3);
 
 	u32 jobId = script->queueAsync(
 		std::move(serialized_func),
-		param, mod_origin);
+		param, mod_origin, priority);
 
 	lua_pushinteger(L, jobId);
 	return 1;
@@ -10,7 +10,7 @@ class ModApiAsync : public ModApiBase
 public:
 	static void Initialize(lua_State *L, int top);
 private:
-	// do_async_callback(func, params, mod_origin)
+	// do_async_callback(func, params, mod_origin, [priority])
 	static int l_do_async_callback(lua_State *L);
 	// cancel_async_callback(id)
 	static int l_cancel_async_callback(lua_State *L);
@@ -24,7 +24,7 @@
 #include "util/pointedthing.h"
 #include "mapgen/treegen.h"
 #include "emerge_internal.h"
-#include "pathfinder.h"
+#include "fm_pathfinder.h"
 #include <unordered_set>
 #include "face_position_cache.h"
 #include "remoteplayer.h"
@@ -160,6 +160,34 @@ void LuaEmergeAreaCallback(v3bpos_t blockpos, EmergeAction action, void *param)
 		delete state;
 }
 
+// Reads (pos1, pos2, searchdistance, max_jump, max_drop, algorithm)
+static PathRequest read_path_request(lua_State *L, int index, PathAlgorithm algo)
+{
+	PathRequest request;
+	request.source         = read_v3pos(L, index);
+	request.destination    = read_v3pos(L, index + 1);
+	request.searchdistance = luaL_checkint(L, index + 2);
+	request.max_jump       = luaL_checkint(L, index + 3);
+	request.max_drop       = luaL_checkint(L, index + 4);
+	request.algo           = algo;
+	if (!lua_isnoneornil(L, index + 5)) {
+		std::string algorithm = luaL_checkstring(L, index + 5);
+
+		if (algorithm == "A*_noprefetch")
+			request.algo = PA_PLAIN_NP;
+
+		if (algorithm == "A*")
+			request.algo = PA_PLAIN;
+
+		if (algorithm == "Dijkstra")
+			request.algo = PA_DIJKSTRA;
+
+		if (algorithm == "HPA*")
+			request.algo = PA_HIERARCHICAL;
+	}
+	return request;
+}
+
 /* Exported functions
 
 The following functions will be available in the Lua API.
@@ -1266,24 +1294,14 @@ int ModApiEnv::l_find_path(lua_State *L)
 {
 	GET_ENV_PTR;
 
-	v3pos_t pos1                  = read_v3pos(L, 1);
-	v3pos_t pos2                  = read_v3pos(L, 2);
-	unsigned int searchdistance = luaL_checkint(L, 3);
-	unsigned int max_jump       = luaL_checkint(L, 4);
-	unsigned int max_drop       = luaL_checkint(L, 5);
-	PathAlgorithm algo          = PA_PLAIN_NP;
-	if (!lua_isnoneornil(L, 6)) {
-		std::string algorithm = luaL_checkstring(L,6);
-
-		if (algorithm == "A*")
-			algo = PA_PLAIN;
-
-		if (algorithm == "Dijkstra")
-			algo = PA_DIJKSTRA;
-	}
+	PathRequest request = read_path_request(L, 1, PA_PLAIN_NP);
 
-	std::vector<v3pos_t> path = get_path(&env->getServerMap(), env->getGameDef()->ndef(), pos1, pos2,
-		searchdistance, max_jump, max_drop, algo);
+	// Only the hierarchical search needs the navigation cache
+	std::vector<v3pos_t> path = request.algo == PA_HIERARCHICAL
+			? env->getPathNavigator().getPath(request)
+			: get_path(&env->getServerMap(), env->getGameDef()->ndef(),
+					  request.source, request.destination, request.searchdistance,
+					  request.max_jump, request.max_drop, request.algo);
 
 	if (!path.empty()) {
 		lua_createtable(L, path.size(), 0);
@@ -1301,6 +1319,33 @@ int ModApiEnv::l_find_path(lua_State *L)
 	return 0;
 }
 
+int ModApiEnv::l_find_path_async(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	PathRequest request = read_path_request(L, 1, PA_HIERARCHICAL);
+	luaL_checktype(L, 7, LUA_TFUNCTION);
+
+	lua_pushvalue(L, 7);
+	auto state = std::make_shared<ScriptCallbackState>();
+	state->script       = getServer(L)->getScriptIface();
+	state->callback_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	state->args_ref     = LUA_NOREF;
+	state->refcount     = 1;
+	state->origin       = getScriptApiBase(L)->getOrigin();
+
+	env->getPathNavigator().queuePath(request,
+			[state](std::vector<v3pos_t> &&path, bool cancelled) {
+				state->refcount--;
+				if (cancelled)
+					state->script->on_find_path_cancelled(state.get());
+				else
+					state->script->on_find_path_completion(path, state.get());
+			});
+
+	return 0;
+}
+
 int ModApiEnv::l_spawn_tree(lua_State *L)
 {
 	GET_ENV_PTR;
@@ -1480,6 +1525,7 @@ void ModApiEnv::Initialize(lua_State *L, int top)
 	API_FCT(clear_objects);
 	API_FCT(spawn_tree);
 	API_FCT(find_path);
+	API_FCT(find_path_async);
 	API_FCT(line_of_sight);
 	API_FCT(raycast);
 	API_FCT(transforming_liquid_add);
@@ -456,6 +456,9 @@ Server::~Server()
 		infostream << "Server: Saving environment metadata" << std::endl;
 		m_env->saveMeta();
 
+		// Pending path callbacks hold references into the script
+		m_env->cancelPathRequests();
+
 		// Delete classes that depend on the environment
 		m_inventory_mgr.reset();
 		m_script.reset();
@@ -1142,7 +1145,7 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 
 		// Key = object id
 		// Value = data sent by object
-		std::unordered_map<u16, std::vector<ActiveObjectMessage>*> buffered_messages;
+		std::unordered_map<u16, std::vector<ActiveObjectMessage>> buffered_messages;
 
 		// Get active object messages from environment
 		ActiveObjectMessage aom(0);
@@ -1155,68 +1158,110 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 			else
 				count_unreliable++;
 
-			std::vector<ActiveObjectMessage>* message_list = nullptr;
-			auto n = buffered_messages.find(aom.id);
-			if (n == buffered_messages.end()) {
-				message_list = new std::vector<ActiveObjectMessage>;
-				buffered_messages[aom.id] = message_list;
-			} else {
-				message_list = n->second;
-			}
-			message_list->push_back(std::move(aom));
+			buffered_messages[aom.id].push_back(std::move(aom));
 		}
 
 		m_aom_buffer_counter[0]->increment(count_reliable);
 		m_aom_buffer_counter[1]->increment(count_unreliable);
 
+#if MINETEST_PROTO
+		using aom_buffer_t = std::string;
+#else
+		using aom_buffer_t = ActiveObjectMessages;
+#endif
+		const auto append_buffer = [](aom_buffer_t &to, const aom_buffer_t &from) {
+#if MINETEST_PROTO
+			to.append(from);
+#else
+			to.insert(to.end(), from.begin(), from.end());
+#endif
+		};
+
+		// Messages of one object, encoded once per step and shared by all
+		// clients knowing the object. Consecutive messages without per client
+		// filtering are merged into one segment, message order is kept.
+		struct ObjectMessages
+		{
+			struct Segment
+			{
+				bool reliable;
+				// Position update, filtered for every client
+				const ActiveObjectMessage *position;
+				aom_buffer_t data;
+			};
+			ServerActiveObject *sao;
+			u16 parent_id;
+			std::vector<Segment> segments;
+		};
+		std::vector<ObjectMessages> object_messages;
+		object_messages.reserve(buffered_messages.size());
+		std::unordered_map<u16, size_t> object_index;
+		object_index.reserve(buffered_messages.size());
+
+		for (const auto &[id, list] : buffered_messages) {
+			ServerActiveObject *sao = m_env->getActiveObject(id);
+			if (!sao)
+				continue;
+			ServerActiveObject *parent = sao->getParent();
+			auto &object = object_messages.emplace_back(
+					ObjectMessages{sao, parent ? parent->getId() : u16{}, {}});
+			object_index.emplace(id, object_messages.size() - 1);
+			for (const ActiveObjectMessage &aom : list) {
+				const bool position = aom.datastring[0] == AO_CMD_UPDATE_POSITION;
+				auto &segments = object.segments;
+				if (position || segments.empty() || segments.back().position ||
+						segments.back().reliable != aom.reliable)
+					segments.push_back({aom.reliable, position ? &aom : nullptr, {}});
+				auto &buffer = segments.back().data;
+#if MINETEST_PROTO
+				char idbuf[2];
+				writeU16((u8*) idbuf, aom.id);
+				// u16 id
+				// std::string data
+				buffer.append(idbuf, sizeof(idbuf));
+				buffer.append(serializeString16(aom.datastring));
+#else
+				buffer.emplace_back(aom.id, aom.datastring);
+#endif
+			}
+		}
+
 		{
 			ClientInterface::AutoLock clientlock(m_clients);
 			const auto &clients = m_clients.getClientList();
 			// Route data to every client
-#if MINETEST_PROTO
-			std::string reliable_data, unreliable_data;
-#endif
+			aom_buffer_t reliable_data, unreliable_data;
 			const auto uptime = getUptime();
+			size_t routed = 0;
 			for (const auto &client : clients) {
-#if MINETEST_PROTO
 				reliable_data.clear();
 				unreliable_data.clear();
-#else
-				ActiveObjectMessages reliable_data;
-				ActiveObjectMessages unreliable_data;
-#endif
 				//RemoteClient *client = client_it.second;
 				PlayerSAO *player = getPlayerSAO(client.second->peer_id);
-				// Go through all objects in message buffer
-				for (const auto &buffered_message : buffered_messages) {
-					// If object does not exist or is not known by client, skip it
-					u16 id = buffered_message.first;
-					ServerActiveObject *sao = m_env->getActiveObject(id);
-					if (!sao || client.second->m_known_objects.find(id) == client.second->m_known_objects.end())
-						continue;
+				const auto &known_objects = client.second->m_known_objects;
 
-					// Get message list of object
-					std::vector<ActiveObjectMessage>* list = buffered_message.second;
-					// Go through every message
-					for (const ActiveObjectMessage &aom : *list) {
+				const auto route = [&](u16 id, const ObjectMessages &object) {
+					++routed;
+					for (const auto &segment : object.segments) {
 						// Send position updates to players who do not see the attachment
-						if (aom.datastring[0] == AO_CMD_UPDATE_POSITION) {
-							if (sao->getId() == player->getId())
+						if (segment.position) {
+							const ActiveObjectMessage &aom = *segment.position;
+							if (player && id == player->getId())
 								continue;
 
 							// Do not send position updates for attached players
 							// as long the parent is known to the client
-							ServerActiveObject *parent = sao->getParent();
-							if (parent && client.second->m_known_objects.find(parent->getId()) !=
-									client.second->m_known_objects.end())
+							if (object.parent_id && known_objects.find(object.parent_id) !=
+									known_objects.end())
 								continue;
 
 							// Limit position packets for far objects
 							constexpr static auto max_seconds_skip = 30;
 							auto &[last_time, last_dist] =
 									client.second->m_objects_last_pos_sent[id];
-						
-							if (aom.skip_by_pos && last_time && last_time + max_seconds_skip > uptime) {
+
+							if (player && aom.skip_by_pos && last_time &&
+									last_time + max_seconds_skip > uptime) {
 								int32_t dist = aom.skip_by_pos.value().getDistanceFrom(
 														player->getBasePosition()) /
 												(BS * MAP_BLOCKSIZE);
@@ -1238,26 +1283,33 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 								}
 								last_dist = dist;
 							}
-							last_time = getUptime();
+							last_time = uptime;
 						}
 
-#if MINETEST_PROTO
-						// Add full new data to appropriate buffer
-						std::string &buffer = aom.reliable ? reliable_data : unreliable_data;
-						char idbuf[2];
-						writeU16((u8*) idbuf, aom.id);
-						// u16 id
-						// std::string data
-						buffer.append(idbuf, sizeof(idbuf));
-						buffer.append(serializeString16(aom.datastring));
-#else
-					if(aom.reliable)
-						reliable_data.push_back(make_pair(aom.id, aom.datastring));
-					else
-						unreliable_data.push_back(make_pair(aom.id, aom.datastring));
-#endif
+						append_buffer(segment.reliable ? reliable_data : unreliable_data,
+								segment.data);
+					}
+				};
+
+				// Walk the smaller side of known objects and objects with messages,
+				// cost does not grow with objects * clients
+				{
+					const auto lock = known_objects.lock_shared_rec();
+					if (known_objects.size() < object_messages.size()) {
+						for (const auto id : known_objects) {
+							const auto it = object_index.find(id);
+							if (it != object_index.end())
+								route(id, object_messages[it->second]);
+						}
+					} else {
+						for (const auto &object : object_messages) {
+							const u16 id = object.sao->getId();
+							if (known_objects.find(id) != known_objects.end())
+								route(id, object);
+						}
 					}
 				}
+
 				/*
 					reliable_data and unreliable_data are now ready.
 					Send them.
@@ -1270,11 +1322,8 @@ void Server::AsyncRunStep(float dtime, bool initial_step)
 					SendActiveObjectMessages(client.second->peer_id, unreliable_data, false);
 				}
 			}
-		}
-
-		// Clear buffered_messages
-		for (auto &buffered_message : buffered_messages) {
-			delete buffered_message.second;
+			g_profiler->avg("Server: SAO messages objects", object_messages.size());
+			g_profiler->avg("Server: SAO messages routed", routed);
 		}
 	}
 
@@ -2998,8 +3047,10 @@ int Server::SendBlocks(float dtime)
 			//total_sending += client->getSendingCount();
 			const auto old_count = queue.size();
 			if (client->net_proto_version_fm) {
+				float rtt = 0;
+				getClientConInfo(client_id, con::AVG_RTT, &rtt);
 				total += client->GetNextBlocksFm(m_env, m_emerge.get(), dtime, queue,
-						m_uptime_counter->get() + m_env->m_game_time_start, max_ms);
+						m_uptime_counter->get() + m_env->m_game_time_start, max_ms, rtt);
 			} else {
 				total += client->GetNextBlocks(m_env, m_emerge.get(), dtime, queue, max_ms);
 			}
@@ -944,6 +944,8 @@ friend MapgenVoxelEarth;
 MapDatabase *GetFarDatabase(MapDatabase *dbase, Map::far_dbases_t &far_dbases,
 		const std::string &savedir, block_step_t step);
 MapBlockPtr loadBlockNoStore(Map *smap, MapDatabase *dbase, const v3bpos_t &pos);
+// Deserialize a block loaded from a database, without adding it to the map
+MapBlockPtr loadBlockNoStore(Map *smap, const v3bpos_t &pos, const std::string &blob);
 // ==
 
 
@@ -210,9 +210,7 @@ void ActiveObjectMgr::updateObjectPos(u16 id, v3opos_t pos)
 	}
 }
 
-#if 0
-
-void ActiveObjectMgr::getObjectsInsideRadius(v3f pos, float radius,
+void ActiveObjectMgr::getObjectsInsideRadius(v3opos_t pos, float radius,
 		std::vector<ServerActiveObjectPtr> &result,
 		std::function<bool(const ServerActiveObjectPtr &obj)> include_obj_cb)
 {
@@ -242,44 +240,6 @@ void ActiveObjectMgr::getObjectsInArea(const aabb3o &box,
 	});
 }
 
-#endif
-
-// Wait for fix ^ and delete:
-void ActiveObjectMgr::getObjectsInsideRadius(v3opos_t pos, float radius,
-		std::vector<ServerActiveObjectPtr> &result,
-		std::function<bool(const ServerActiveObjectPtr &obj)> include_obj_cb)
-{
-	float r2 = radius * radius;
-	for (const auto &activeObject : m_active_objects.iter()) {
-		const auto obj = activeObject.second;
-		if (!obj)
-			continue;
-		const auto &objectpos = obj->getBasePosition();
-		if (objectpos.getDistanceFromSQ(pos) > r2)
-			continue;
-
-		if (!include_obj_cb || include_obj_cb(obj))
-			result.push_back(obj);
-	}
-}
-
-void ActiveObjectMgr::getObjectsInArea(const aabb3o &box,
-		std::vector<ServerActiveObjectPtr> &result,
-		std::function<bool(const ServerActiveObjectPtr &obj)> include_obj_cb)
-{
-	for (auto &activeObject : m_active_objects.iter()) {
-		const auto obj = activeObject.second;
-		if (!obj)
-			continue;
-		const auto &objectpos = obj->getBasePosition();
-		if (!box.isPointInside(objectpos))
-			continue;
-
-		if (!include_obj_cb || include_obj_cb(obj))
-			result.push_back(obj);
-	}
-}
-
 void ActiveObjectMgr::getAddedActiveObjectsAroundPos(
 		v3opos_t player_pos, const std::string &player_name,
 		f32 radius, f32 player_radius,
@@ -10,8 +10,10 @@
 #include <vector>
 #include <set>
 #include "../activeobjectmgr.h"
+#include "constants.h"
 #include "serveractiveobject.h"
 #include "util/k_d_tree.h"
+#include "util/spatial_grid.h"
 
 namespace server
 {
@@ -51,31 +53,6 @@ class ActiveObjectMgr final : public ::ActiveObjectMgr<ServerActiveObject>
 
 private:
 	// k_d_tree::DynamicKdTrees<3, f32, u16> m_spatial_index;
-
-	// tmp:
-	template <uint8_t Dim, class Component, class Id>
-	class FakeDynamicKdTrees
-	{
-		using Tree = k_d_tree::KdTree<Dim, Component, Id>;
-
-	public:
-		using Point = typename Tree::Point;
-
-		void insert(const std::array<Component, Dim> &point, Id id) {}
-
-		void remove(Id id) {}
-
-		void update(const Point &newPos, Id id) {}
-
-		template <typename F>
-		void rangeQuery(const Point &min, const Point &max, const F &cb) const
-		{
-		}
-
-		size_t size() const { return 0; }
-	};
-
-	FakeDynamicKdTrees<3, opos_t, u16> m_spatial_index;
-	// ===
+	spatial_grid::HashGrid<3, opos_t, u16> m_spatial_index{MAP_BLOCKSIZE * BS};
 };
 } // namespace server
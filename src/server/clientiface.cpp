@@ -449,6 +449,8 @@ void RemoteClient::SentBlock(v3bpos_t p)
 
 void RemoteClient::SetBlockNotSent(v3bpos_t p, bool low_priority)
 {
+	if (net_proto_version_fm)
+		m_send_queue.setChanged(p);
 /*
 	++m_nearest_unsent_reset;
 	m_nothing_to_send_pause_timer = 0;
@@ -477,6 +479,9 @@ void RemoteClient::SetBlockNotSent(v3bpos_t p, bool low_priority)
 
 void RemoteClient::SetBlocksNotSent(const std::vector<v3bpos_t> &blocks, bool low_priority)
 {
+	if (net_proto_version_fm)
+		for (const auto &p : blocks)
+			m_send_queue.setChanged(p);
 /*
 	for (const auto &p : blocks) {
 		SetBlockNotSent(p, low_priority);
@@ -486,6 +491,8 @@ void RemoteClient::SetBlocksNotSent(const std::vector<v3bpos_t> &blocks, bool lo
 
 void RemoteClient::SetBlockDeleted(const v3bpos_t & p) {
 	m_blocks_sent.erase(p);
+	if (net_proto_version_fm)
+		m_send_queue.setChanged(p);
 }
 
 void RemoteClient::notifyEvent(ClientStateEvent event)
@@ -13,6 +13,7 @@
 #include "util/unordered_map_hash.h"
 #include <atomic>
 #include "msgpack_fix.h"
+#include "server/fm_block_send_queue.h"
 
 
 #include "irr_v3d.h"                   // for irrlicht datatypes
@@ -258,7 +259,12 @@ class RemoteClient
 			far_blocks_sent{FARMESH_STEP_MAX};
 	std::mutex far_blocks_requested_mutex;
 	int GetNextBlocksFm(ServerEnvironment *env, EmergeManager *emerge, float dtime,
-			std::vector<PrioritySortedBlockTransfer> &dest, double m_uptime, u64 max_ms);
+			std::vector<PrioritySortedBlockTransfer> &dest, double m_uptime, u64 max_ms,
+			float rtt = 0);
+	BlockSendQueue m_send_queue;
+	// Part of max_simultaneous_block_sends_per_client sent per step
+	float m_send_pace{1};
+	float m_send_rtt_min{};
 	uint32_t SendFarBlocks(const int32_t uptime);
 	// ==
 
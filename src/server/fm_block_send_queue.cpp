@@ -0,0 +1,232 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "fm_block_send_queue.h"
+#include <algorithm>
+#include "constants.h"
+#include "face_position_cache.h"
+#include "mapblock.h"
+#include "util/numeric.h"
+
+namespace
+{
+// Min heap comparators, only the key is compared
+template <typename T>
+bool heap_greater(const T &a, const T &b)
+{
+	return a.first > b.first;
+}
+}
+
+void BlockSendQueue::setView(const View &view)
+{
+	if (!m_have_view) {
+		m_view = view;
+		m_have_view = true;
+		m_scan_d = 0;
+		return;
+	}
+
+	const View old = m_view;
+	m_view = view;
+
+	if (old.center != view.center) {
+		if (int(radius_box(old.center, view.center)) > std::max(1, view.range / 2)) {
+			// Teleport or very fast move, nothing queued near the old center is
+			// worth keeping
+			clear();
+			return;
+		}
+		if (isScanComplete() && old.range == view.range) {
+			addEntering(old.center, old.range);
+			m_scan_d = view.range + 1;
+		} else {
+			m_scan_d = 0;
+		}
+		reprioritize();
+		return;
+	}
+
+	if (view.range > old.range && isScanComplete())
+		m_scan_d = old.range + 1;
+
+	if (old.camera_dir.dotProduct(view.camera_dir) < 0.9f ||
+			old.camera_fov != view.camera_fov)
+		reprioritize();
+}
+
+size_t BlockSendQueue::scan(size_t max_shells)
+{
+	size_t added = 0;
+	for (size_t i = 0; i < max_shells && !isScanComplete(); ++i, ++m_scan_d) {
+		for (const auto &rel : FacePositionCache::getFacePositions(m_scan_d)) {
+			const v3bpos_t pos = m_view.center + v3bpos_t(rel.X, rel.Y, rel.Z);
+			if (blockpos_over_max_limit(pos) || m_blocks.contains(pos))
+				continue;
+			add(pos);
+			++added;
+		}
+	}
+	return added;
+}
+
+void BlockSendQueue::addEntering(const v3bpos_t &old_center, bpos_t old_range)
+{
+	const auto &c = m_view.center;
+	const auto r = m_view.range;
+	const auto inside_old = [&](bpos_t v, bpos_t oc) {
+		return v >= oc - old_range && v <= oc + old_range;
+	};
+	for (bpos_t x = c.X - r; x <= c.X + r; ++x)
+		for (bpos_t y = c.Y - r; y <= c.Y + r; ++y) {
+			const bool xy_old = inside_old(x, old_center.X) && inside_old(y, old_center.Y);
+			for (bpos_t z = c.Z - r; z <= c.Z + r; ++z) {
+				if (xy_old && inside_old(z, old_center.Z)) {
+					// Skip to the end of the old range on this line
+					z = old_center.Z + old_range;
+					continue;
+				}
+				const v3bpos_t pos(x, y, z);
+				if (!blockpos_over_max_limit(pos) && !m_blocks.contains(pos))
+					add(pos);
+			}
+		}
+}
+
+bool BlockSendQueue::inRange(const v3bpos_t &pos) const
+{
+	return int(radius_box(pos, m_view.center)) <= m_view.range;
+}
+
+float BlockSendQueue::getPriority(const v3bpos_t &pos) const
+{
+	const v3bpos_t rel = pos - m_view.center;
+	float priority = v3f(rel.X, rel.Y, rel.Z).getLength();
+	if (priority > 1.5f &&
+			!isBlockInSight(pos, m_view.camera_pos, m_view.camera_dir,
+					m_view.camera_fov, (m_view.range + 1) * MAP_BLOCKSIZE * BS))
+		priority += OUT_OF_SIGHT_PENALTY;
+	return priority;
+}
+
+void BlockSendQueue::add(const v3bpos_t &pos)
+{
+	m_blocks.emplace(pos, Entry{State::ready, 0});
+	m_ready.emplace_back(getPriority(pos), pos);
+	std::push_heap(m_ready.begin(), m_ready.end(), heap_greater<ready_t>);
+}
+
+void BlockSendQueue::makeReady(const v3bpos_t &pos, Entry &entry)
+{
+	if (entry.state == State::ready)
+		return;
+	entry.state = State::ready;
+	m_ready.emplace_back(getPriority(pos), pos);
+	std::push_heap(m_ready.begin(), m_ready.end(), heap_greater<ready_t>);
+}
+
+void BlockSendQueue::reprioritize()
+{
+	m_ready.clear();
+	for (const auto &[pos, entry] : m_blocks)
+		if (entry.state == State::ready)
+			m_ready.emplace_back(getPriority(pos), pos);
+	std::make_heap(m_ready.begin(), m_ready.end(), heap_greater<ready_t>);
+}
+
+void BlockSendQueue::step(double time)
+{
+	std::vector<v3bpos_t> changed;
+	{
+		const std::lock_guard lock(m_changed_mutex);
+		changed.swap(m_changed);
+	}
+	for (const auto &pos : changed) {
+		if (!inRange(pos))
+			continue;
+		if (const auto it = m_blocks.find(pos); it != m_blocks.end())
+			makeReady(pos, it->second);
+		else
+			add(pos);
+	}
+
+	while (!m_recheck.empty() && m_recheck.front().first <= time) {
+		const auto [due, pos] = m_recheck.front();
+		std::pop_heap(m_recheck.begin(), m_recheck.end(), heap_greater<recheck_t>);
+		m_recheck.pop_back();
+		const auto it = m_blocks.find(pos);
+		if (it == m_blocks.end() || it->second.state != State::recheck ||
+				it->second.time != due)
+			continue;
+		if (!inRange(pos)) {
+			m_blocks.erase(it);
+			continue;
+		}
+		makeReady(pos, it->second);
+	}
+}
+
+bool BlockSendQueue::pop(v3bpos_t &pos, float &priority)
+{
+	while (!m_ready.empty()) {
+		std::pop_heap(m_ready.begin(), m_ready.end(), heap_greater<ready_t>);
+		const auto top = m_ready.back();
+		m_ready.pop_back();
+		const auto it = m_blocks.find(top.second);
+		if (it == m_blocks.end() || it->second.state != State::ready)
+			continue;
+		if (!inRange(top.second)) {
+			m_blocks.erase(it);
+			continue;
+		}
+		it->second.state = State::checking;
+		std::tie(priority, pos) = top;
+		return true;
+	}
+	return false;
+}
+
+void BlockSendQueue::push(const v3bpos_t &pos, float priority)
+{
+	auto &entry = m_blocks[pos];
+	entry.state = State::ready;
+	m_ready.emplace_back(priority, pos);
+	std::push_heap(m_ready.begin(), m_ready.end(), heap_greater<ready_t>);
+}
+
+void BlockSendQueue::recheck(const v3bpos_t &pos, double time)
+{
+	auto &entry = m_blocks[pos];
+	entry.state = State::recheck;
+	entry.time = time;
+	m_recheck.emplace_back(time, pos);
+	std::push_heap(m_recheck.begin(), m_recheck.end(), heap_greater<recheck_t>);
+}
+
+void BlockSendQueue::setChanged(const v3bpos_t &pos)
+{
+	const std::lock_guard lock(m_changed_mutex);
+	m_changed.emplace_back(pos);
+}
+
+void BlockSendQueue::clear()
+{
+	m_blocks.clear();
+	m_ready.clear();
+	m_recheck.clear();
+	m_scan_d = 0;
+}
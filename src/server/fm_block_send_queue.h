@@ -0,0 +1,114 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "irr_v3d.h"
+#include "irrlichttypes.h"
+#include "util/unordered_map_hash.h"
+
+/*
+	Per client queue of blocks to check for sending.
+
+	Blocks are ordered by distance from the (predicted) player position,
+	blocks outside of the view cone come after the visible ones. The area
+	around the player is added a few shells at a time at first, then only the
+	blocks entering the range when the player moves. Checked blocks which do
+	not need sending now are rechecked after a delay.
+*/
+class BlockSendQueue
+{
+public:
+	struct View
+	{
+		v3bpos_t center;
+		// Camera position in nodes * BS
+		v3opos_t camera_pos;
+		v3f camera_dir{0, 0, 1};
+		f32 camera_fov{};
+		// Range in blocks
+		bpos_t range{};
+	};
+
+	// Priority penalty in blocks of blocks outside of the view cone
+	static constexpr float OUT_OF_SIGHT_PENALTY = 6;
+
+	void setView(const View &view);
+	const View &getView() const { return m_view; }
+
+	// Add up to max_shells shells of blocks around the center, returns number of
+	// blocks added
+	size_t scan(size_t max_shells);
+	bool isScanComplete() const { return m_scan_d > m_view.range; }
+	bpos_t getScanDistance() const { return m_scan_d; }
+
+	// Move due rechecks and changed blocks to the queue
+	void step(double time);
+
+	// Get the block with the lowest priority value, false if nothing is due
+	bool pop(v3bpos_t &pos, float &priority);
+	// Put a popped block back, it will be returned first again
+	void push(const v3bpos_t &pos, float priority);
+	// Check a popped block again at time
+	void recheck(const v3bpos_t &pos, double time);
+
+	// Check block again as soon as possible, may be called from any thread
+	void setChanged(const v3bpos_t &pos);
+
+	float getPriority(const v3bpos_t &pos) const;
+	size_t size() const { return m_blocks.size(); }
+	size_t readySize() const { return m_ready.size(); }
+	void clear();
+
+private:
+	enum class State : u8
+	{
+		ready,
+		// Returned by pop(), waiting for push() or recheck()
+		checking,
+		recheck,
+	};
+	struct Entry
+	{
+		State state;
+		double time;
+	};
+	using ready_t = std::pair<float, v3bpos_t>;
+	using recheck_t = std::pair<double, v3bpos_t>;
+
+	bool inRange(const v3bpos_t &pos) const;
+	void add(const v3bpos_t &pos);
+	void makeReady(const v3bpos_t &pos, Entry &entry);
+	void reprioritize();
+	// Add blocks in range of the current center that were not in range of old
+	void addEntering(const v3bpos_t &old_center, bpos_t old_range);
+
+	View m_view;
+	bool m_have_view{};
+	bpos_t m_scan_d{};
+
+	unordered_map_v3bpos<Entry> m_blocks;
+	// Min heaps, entries not matching m_blocks are stale and skipped
+	std::vector<ready_t> m_ready;
+	std::vector<recheck_t> m_recheck;
+
+	std::mutex m_changed_mutex;
+	std::vector<v3bpos_t> m_changed;
+};
@@ -5,6 +5,8 @@
 #include "contrib/fallingsao.h"
 #include "contrib/itemsao.h"
 #include "environment.h"
+#include "collision.h"
+#include "fm_pathfinder.h"
 #include "log_types.h"
 
 #include <algorithm>
@@ -195,6 +197,7 @@ ServerEnvironment::ServerEnvironment(std::unique_ptr<ServerMap> map,
 {
 
     //fm:
+	m_collision_context = std::make_unique<CollisionContext>(server);
 	m_use_weather = g_settings->getBool("weather");
 	m_use_weather_biome = g_settings->getBool("weather_biome");
 
@@ -319,6 +322,11 @@ ServerEnvironment::~ServerEnvironment()
 
 	removeRemovedObjects(50000);
 
+	if (m_path_navigator) {
+		m_map->removeEventReceiver(m_path_navigator.get());
+		m_path_navigator.reset();
+	}
+
 	// Drop/delete map
 	m_map.reset();
 
@@ -639,6 +647,8 @@ void ServerEnvironment::activateBlock(MapBlock *block)
 	block->step((float)dtime_s, [&](v3pos_t p, MapNode n, NodeTimer t) -> bool {
 		return m_script->node_on_timer(p, n, t.elapsed, t.timeout);
 	});
+
+	m_circuit.addBlock(block);
 }
 
 void ServerEnvironment::addActiveBlockModifier(ActiveBlockModifier *abm)
@@ -681,7 +691,7 @@ bool ServerEnvironment::setNode(v3pos_t p, const MapNode &n, s16 fast, bool impo
 		return false;
 	}
 
-	m_circuit.addNode(p);
+	m_circuit.swapNode(p, n_old, n);
 
 	// Update active VoxelManipulator if a mapgen thread
 	m_map->updateVManip(p);
@@ -746,12 +756,11 @@ bool ServerEnvironment::removeNode(v3pos_t p, s16 fast, bool important)
 
 bool ServerEnvironment::swapNode(v3pos_t p, const MapNode &n, s16 fast)
 {
+	const MapNode n_old = m_map->getNode(p);
 	if (fast) {
 		try {
 			MapNode nn = n;
 			if (fast == 2 && !nn.param1) {
-				MapNode n_old = m_map->getNode(p);
-
 				if (n_old.param1)
 					nn.param1 = n_old.param1;
 				else if (p.Y > 0)
@@ -767,7 +776,7 @@ bool ServerEnvironment::swapNode(v3pos_t p, const MapNode &n, s16 fast)
 
 	}
 
-	m_circuit.addNode(p);
+	m_circuit.swapNode(p, n_old, n);
 
 	// Update active VoxelManipulator if a mapgen thread
 	m_map->updateVManip(p);
@@ -1028,6 +1037,9 @@ void ServerEnvironment::step(float dtime, double uptime, unsigned int max_cycle_
 	*/
 	 m_circuit.update(dtime);
 
+	if (m_path_navigator)
+		m_path_navigator->deliverResults();
+
 	 
 	/*
 		Manage active block list
@@ -1364,6 +1376,8 @@ void ServerEnvironment::step(float dtime, double uptime, unsigned int max_cycle_
 
 		u32 object_count = 0;
 
+		m_collision_context->step();
+
 		auto cb_state = [&](const ServerActiveObjectPtr &obj) {
 			if (!obj || obj->isGone())
 				return;
@@ -41,6 +41,8 @@ struct GameParams;
 struct StaticObject;
 
 class ServerMap;
+class PathNavigator;
+class CollisionContext;
 
 enum AccessDeniedCode : u8;
 typedef u16 session_t;
@@ -321,6 +323,11 @@ class ServerEnvironment final : public Environment
 	bool m_use_weather_biome = true;
 	bool m_more_threads = true;
 	ABMHandler m_abmhandler;
+	PathNavigator &getPathNavigator();
+	// Drop async path requests, their script callbacks are released
+	void cancelPathRequests();
+	CollisionContext *getCollisionContext() override
+	{ return m_collision_context.get(); }
 	uint8_t analyzeBlock(MapBlockPtr block);
 private:
 	IntervalLimiter m_analyze_blocks_interval;
@@ -358,6 +365,10 @@ class ServerEnvironment final : public Environment
 	std::mutex m_nodeupdate_queue_mutex;
 	// Circuit manager
 	Circuit m_circuit;
+	// Cached hierarchical pathfinder, created on first use
+	std::unique_ptr<PathNavigator> m_path_navigator;
+	// Node collision boxes shared by all objects
+	std::unique_ptr<CollisionContext> m_collision_context;
 	// Key-value storage
 public:
 	std::unordered_map<std::string, KeyValueStorage> m_key_value_storage;
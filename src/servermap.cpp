@@ -28,8 +28,10 @@
 #include "serverenvironment.h"
 #include "database/database.h"
 #include "database/database-dummy.h"
+#include "database/database-mmap.h"
 #include "database/database-sqlite3.h"
 #include "script/scripting_server.h"
+#include "threading/ThreadPool.h"
 #if USE_LEVELDB
 #include "database/database-leveldb.h"
 #endif
@@ -107,6 +109,9 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 
 	m_map_compression_level = rangelim(g_settings->getS16("map_compression_level_disk"), -1, 9);
 
+	if (const auto threads = g_settings->getU16("light_threads"); threads > 1)
+		m_lighting_pool = std::make_unique<progschj::ThreadPool>(threads);
+
 	try {
 		// If directory exists, check contents and load if possible
 		if (fs::PathExists(m_savedir)) {
@@ -702,6 +707,9 @@ std::vector<std::string> ServerMap::getDatabaseBackends()
 #endif
 #if USE_POSTGRESQL
 	ret.emplace_back("postgresql");
+#endif
+#if USE_MMAP_DATABASE
+	ret.emplace_back("mmap");
 #endif
 	return ret;
 }
@@ -722,16 +730,21 @@ MapDatabase *ServerMap::createDatabase(
 	MapDatabase *db = nullptr;
 	infostream << "Creating map database with backend \"" << name << "\"" << std::endl;
 
+	// Key layout of new sqlite3 and leveldb databases
+	std::string key_layout = "default";
+	conf.getNoEx("map_key_layout", key_layout);
+	const bool morton = key_layout == "morton";
+
 	if (0) { }
 #if USE_SQLITE3
 	else if (name == "sqlite3")
-		db = new MapDatabaseSQLite3(savedir);
+		db = new MapDatabaseSQLite3(savedir, morton);
 #endif
 	else if (name == "dummy")
 		db = new Database_Dummy();
 #if USE_LEVELDB
 	else if (name == "leveldb")
-		db = new Database_LevelDB(savedir);
+		db = new Database_LevelDB(savedir, morton);
 #endif
 #if USE_REDIS
 	else if (name == "redis")
@@ -744,6 +757,10 @@ MapDatabase *ServerMap::createDatabase(
 		db = new MapDatabasePostgreSQL(connect_string);
 	}
 #endif
+#if USE_MMAP_DATABASE
+	else if (name == "mmap")
+		db = new MapDatabaseMmap(savedir);
+#endif
 
 	// Constructor can't return null, only throw
 	sanity_check(db);
@@ -784,6 +801,17 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 		return true;
 	}
 
+	// FIXME: zero copy possible in c++20 or with custom rdbuf
+	bool ret = db->saveBlock(p3d, serializeBlock(block, compression_level));
+	if (ret) {
+		// We just wrote it to the disk so clear modified flag
+		block->resetModified();
+	}
+	return ret;
+}
+
+std::string ServerMap::serializeBlock(MapBlock *block, int compression_level)
+{
 	// Format used for writing
 	u8 version = SER_FMT_VER_HIGHEST_WRITE;
 
@@ -794,14 +822,7 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db, int compression_leve
 	std::ostringstream o(std::ios_base::binary);
 	o.write((char*) &version, 1);
 	block->serialize(o, version, true, compression_level);
-
-	// FIXME: zero copy possible in c++20 or with custom rdbuf
-	bool ret = db->saveBlock(p3d, o.str());
-	if (ret) {
-		// We just wrote it to the disk so clear modified flag
-		block->resetModified();
-	}
-	return ret;
+	return o.str();
 }
 
 void ServerMap::deSerializeBlock(MapBlock *block, std::istream &is)
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "fm_weather.h"
+#include "fm_weather_grid.h"
 #include "irr_v3d.h"
 #include "mapblock.h"
 #include "threading/concurrent_set.h"
@@ -26,6 +27,10 @@ class EmergeManager;
 class ServerEnvironment;
 struct BlockMakeData;
 class MetricsBackend;
+namespace progschj
+{
+class ThreadPool;
+}
 
 // TODO: this could wrap all calls to MapDatabase, including locking
 struct MapDatabaseAccessor {
@@ -91,6 +96,8 @@ class ServerMap : public Map
 	std::map<v3bpos_t, int> m_lighting_modified_blocks;
 	std::map<unsigned int, lighting_map_t> m_lighting_modified_blocks_range;
 	void lighting_modified_add(const v3bpos_t &pos, int range = 5);
+	// Lights independent block clusters of updateLighting() in parallel
+	std::unique_ptr<progschj::ThreadPool> m_lighting_pool;
 
 	void unspreadLight(enum LightBank bank, std::map<v3pos_t, u8> &from_nodes,
 			std::set<v3pos_t> &light_sources,
@@ -122,6 +129,9 @@ class ServerMap : public Map
 
 	static std::atomic_uint time_life;
 	u32 m_weather_update_last{};
+	WeatherGrid m_weather_grid;
+	void onBlockInserted(const MapBlockPtr &block) override { m_weather_grid.add(block); }
+	void onBlockErased(const MapBlockPtr &block) override { m_weather_grid.remove(block); }
 
 	// == end of freeminer
 
@@ -206,6 +216,8 @@ class ServerMap : public Map
 
 	bool saveBlock(MapBlock *block) override;
 	static bool saveBlock(MapBlock *block, MapDatabase *db, int compression_level = -1);
+	// Blob of a block as written to the database
+	static std::string serializeBlock(MapBlock *block, int compression_level = -1);
 
 	// Load block in a synchronous fashion
 	MapBlockPtr loadBlock(v3bpos_t p);
@@ -21,8 +21,10 @@ along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 #include <cstdint>
+#include <exception>
 #include <future>
 #include <chrono>
+#include <vector>
 
 #if defined(DUMP_STREAM)
 #include "log.h"
@@ -81,3 +83,20 @@ class async_step_runner
 		return future.valid();
 	}
 };
+
+// Wait for all of futures, then rethrow the first exception of them. Tasks
+// use the caller's data, none may run on after the caller unwinds.
+inline void wait_all(std::vector<std::future<void>> &futures)
+{
+	std::exception_ptr error;
+	for (auto &future : futures) {
+		try {
+			future.get();
+		} catch (...) {
+			if (!error)
+				error = std::current_exception();
+		}
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
@@ -18,6 +18,7 @@ class TestCollision : public TestBase {
 
 	void testAxisAlignedCollision();
 	void testCollisionMoveSimple(IGameDef *gamedef);
+	void testCollisionContext(IGameDef *gamedef);
 };
 
 static TestCollision g_test_instance;
@@ -26,22 +27,28 @@ void TestCollision::runTests(IGameDef *gamedef)
 {
 	TEST(testAxisAlignedCollision);
 	TEST(testCollisionMoveSimple, gamedef);
+	TEST(testCollisionContext, gamedef);
 }
 
 namespace {
 	class TestEnvironment : public Environment {
 		DummyMap map;
+		std::unique_ptr<CollisionContext> context;
 	public:
-		TestEnvironment(IGameDef *gamedef)
+		TestEnvironment(IGameDef *gamedef, bool use_context = false)
 			: Environment(gamedef), map(gamedef, {-1, -1, -1}, {1, 1, 1})
 		{
 			map.fill({-1, -1, -1}, {1, 1, 1}, MapNode(CONTENT_AIR));
+			if (use_context)
+				context = std::make_unique<CollisionContext>(gamedef);
 		}
 
 		void step(f32 dtime, double uptime, unsigned int max_cycle_ms) override {}
 
 		Map &getMap() override { return map; }
 
+		CollisionContext *getCollisionContext() override { return context.get(); }
+
 		void getSelectedActiveObjects(const core::line3d<opos_t> &shootline_on_map,
 			std::vector<PointedThing> &objects,
 			const std::optional<Pointabilities> &pointabilities) override {}
@@ -374,3 +381,62 @@ void TestCollision::testCollisionMoveSimple(IGameDef *gamedef)
 	// No warnings should have been raised during our test.
 	UASSERT(!g_collision_problems_encountered);
 }
+
+void TestCollision::testCollisionContext(IGameDef *gamedef)
+{
+	auto env = std::make_unique<TestEnvironment>(gamedef, true);
+	g_collision_problems_encountered = false;
+
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		env->getMap().setNode({x, 0, z}, MapNode(t_CONTENT_STONE));
+
+	v3opos_t pos;
+	v3f speed, accel;
+	const aabb3f box(fpos(-0.1f, 0, -0.1f), fpos(0.1f, 1.4f, 0.1f));
+	collisionMoveResult res;
+
+	const auto collide = [&](f32 dtime) {
+			return collisionMoveSimple(env.get(), gamedef, box, 0.0f, dtime,
+				&pos, &speed, accel, NULL, true, StepUpMode::LEGACY);
+	};
+
+	/* falling on cached ground */
+	pos   = opos(4, 1.2345f, 4);
+	speed = fpos(0, -3.f, 0);
+	accel = fpos(0, -9.81f, 0);
+	res = collide(0.5f);
+
+	UASSERT(res.collides);
+	UASSERT(res.touching_ground);
+	UASSERT(env->getCollisionContext()->size() > 0);
+	UASSERT(res.collisions.size() == 1);
+	UASSERTEQ(v3pos_t, res.collisions.front().node_p, v3pos_t(4, 0, 4));
+
+	/* removed node is not collided with */
+	env->getMap().setNode({4, 0, 4}, MapNode(CONTENT_AIR));
+	pos   = opos(4, 1.2345f, 4);
+	speed = fpos(0, -3.f, 0);
+	res = collide(0.5f);
+
+	UASSERT(!res.collides);
+	UASSERT(res.collisions.empty());
+
+	/* added node is collided with */
+	env->getMap().setNode({4, 0, 4}, MapNode(t_CONTENT_STONE));
+	pos   = opos(4, 1.2345f, 4);
+	speed = fpos(0, -3.f, 0);
+	res = collide(0.5f);
+
+	UASSERT(res.collides);
+	UASSERT(res.touching_ground);
+
+	/* collision in ignore */
+	pos   = opos(0, -100, 0);
+	speed = fpos(5, 0, 0);
+	accel = fpos(0, 0, 0);
+	res = collide(1/60.0f);
+	UASSERTEQ_V3F(speed, fpos(0, 0, 0));
+
+	UASSERT(!g_collision_problems_encountered);
+}
@@ -0,0 +1,166 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "constants.h"
+#include "server/fm_block_send_queue.h"
+
+class TestFmBlockSendQueue : public TestBase
+{
+public:
+	TestFmBlockSendQueue() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmBlockSendQueue"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testOrder();
+	void testRecheck();
+	void testMove();
+	void testTeleport();
+
+private:
+	static BlockSendQueue::View makeView(v3bpos_t center)
+	{
+		BlockSendQueue::View view;
+		view.center = center;
+		view.camera_pos = v3opos_t(center.X, center.Y, center.Z) * MAP_BLOCKSIZE * BS;
+		view.camera_dir = v3f(0, 0, 1);
+		view.camera_fov = 1.5f;
+		view.range = 4;
+		return view;
+	}
+
+	static void fill(BlockSendQueue &queue)
+	{
+		while (!queue.isScanComplete())
+			queue.scan(2);
+	}
+
+	// Pop everything, rechecking at time, returns count
+	static size_t drain(BlockSendQueue &queue, double time)
+	{
+		size_t count = 0;
+		v3bpos_t pos;
+		float priority;
+		while (queue.pop(pos, priority)) {
+			queue.recheck(pos, time);
+			++count;
+		}
+		return count;
+	}
+};
+
+static TestFmBlockSendQueue g_test_instance;
+
+void TestFmBlockSendQueue::runTests(IGameDef *gamedef)
+{
+	TEST(testOrder);
+	TEST(testRecheck);
+	TEST(testMove);
+	TEST(testTeleport);
+}
+
+void TestFmBlockSendQueue::testOrder()
+{
+	BlockSendQueue queue;
+	queue.setView(makeView({0, 0, 0}));
+	fill(queue);
+	UASSERTEQ(size_t, queue.size(), 9 * 9 * 9);
+
+	v3bpos_t pos;
+	float priority, last = -1;
+	bool seen_behind = false;
+	while (queue.pop(pos, priority)) {
+		UASSERT(priority >= last);
+		last = priority;
+		// All blocks in front come before the far ones behind the camera
+		if (pos.Z <= -3)
+			seen_behind = true;
+		else if (pos.Z >= 3 && std::abs(pos.X) <= 1 && std::abs(pos.Y) <= 1)
+			UASSERT(!seen_behind);
+		queue.recheck(pos, 10);
+	}
+}
+
+void TestFmBlockSendQueue::testRecheck()
+{
+	BlockSendQueue queue;
+	queue.setView(makeView({0, 0, 0}));
+	fill(queue);
+	UASSERTEQ(size_t, drain(queue, 10), 9 * 9 * 9);
+
+	queue.step(5);
+	UASSERTEQ(size_t, queue.readySize(), 0);
+
+	// Changed blocks are due at once
+	queue.setChanged({1, 1, 1});
+	queue.setChanged({100, 0, 0});
+	queue.step(5);
+	v3bpos_t pos;
+	float priority;
+	UASSERT(queue.pop(pos, priority));
+	UASSERT(pos == v3bpos_t(1, 1, 1));
+	queue.recheck(pos, 10);
+	UASSERT(!queue.pop(pos, priority));
+
+	queue.step(10);
+	UASSERTEQ(size_t, drain(queue, 20), 9 * 9 * 9);
+}
+
+void TestFmBlockSendQueue::testMove()
+{
+	BlockSendQueue queue;
+	queue.setView(makeView({0, 0, 0}));
+	fill(queue);
+	drain(queue, 10);
+
+	// Only the slab entering the range is added
+	queue.setView(makeView({1, 0, 0}));
+	UASSERT(queue.isScanComplete());
+	v3bpos_t pos;
+	float priority;
+	size_t count = 0;
+	while (queue.pop(pos, priority)) {
+		UASSERTEQ(bpos_t, pos.X, 5);
+		queue.recheck(pos, 10);
+		++count;
+	}
+	UASSERTEQ(size_t, count, 9 * 9);
+
+	// Blocks left behind are dropped when due
+	queue.step(10);
+	UASSERTEQ(size_t, drain(queue, 20), 9 * 9 * 9);
+	UASSERTEQ(size_t, queue.size(), 9 * 9 * 9);
+}
+
+void TestFmBlockSendQueue::testTeleport()
+{
+	BlockSendQueue queue;
+	queue.setView(makeView({0, 0, 0}));
+	fill(queue);
+	drain(queue, 10);
+
+	queue.setView(makeView({100, 0, 0}));
+	UASSERTEQ(size_t, queue.size(), 0);
+	UASSERT(!queue.isScanComplete());
+	queue.scan(1);
+	v3bpos_t pos;
+	float priority;
+	UASSERT(queue.pop(pos, priority));
+	UASSERT(pos == v3bpos_t(100, 0, 0));
+}
@@ -0,0 +1,129 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <random>
+#include "client/mapblock_mesh.h"
+#include "constants.h"
+
+class TestFmBsp : public TestBase
+{
+public:
+	TestFmBsp() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmBsp"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testSidesKeepOrder();
+	void testWaterSurface();
+};
+
+static TestFmBsp g_test_instance;
+
+void TestFmBsp::runTests(IGameDef *gamedef)
+{
+	TEST(testSidesKeepOrder);
+	TEST(testWaterSurface);
+}
+
+// Water surface one node below the top of the block with a wall of
+// glass faces across it, in the coordinates of block meshes
+static void make_water(scene::SMeshBuffer *buffer, std::vector<MeshTriangle> &triangles)
+{
+	const auto quad = [&](v3f p0, v3f p1, v3f p2, v3f p3) {
+		const u16 base = buffer->getVertexCount();
+		for (const auto &pos : {p0, p1, p2, p3})
+			buffer->Vertices->Data.emplace_back(pos, v3f(0, 1, 0), video::SColor(), v2f());
+		for (const u16 i : {0, 1, 2, 2, 3, 0}) {
+			buffer->Indices->Data.push_back(base + i);
+			if (buffer->Indices->Data.size() % 3)
+				continue;
+			MeshTriangle t;
+			t.buffer = buffer;
+			t.p1 = buffer->Indices->Data.end()[-3];
+			t.p2 = buffer->Indices->Data.end()[-2];
+			t.p3 = buffer->Indices->Data.end()[-1];
+			t.updateAttributes();
+			triangles.push_back(t);
+		}
+	};
+	const f32 h = BS / 2, y = (MAP_BLOCKSIZE - 2) * BS + h;
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			const v3f c(x * BS, y, z * BS);
+			quad(c + v3f(-h, 0, -h), c + v3f(-h, 0, h), c + v3f(h, 0, h), c + v3f(h, 0, -h));
+			if (x == MAP_BLOCKSIZE / 2)
+				quad(c + v3f(-h, -BS, -h), c + v3f(-h, 0, -h), c + v3f(-h, 0, h),
+						c + v3f(-h, -BS, h));
+		}
+}
+
+void TestFmBsp::testSidesKeepOrder()
+{
+	irr_ptr<scene::SMeshBuffer> buffer(new scene::SMeshBuffer());
+	std::vector<MeshTriangle> triangles;
+	make_water(buffer.get(), triangles);
+	MapBlockBspTree tree;
+	tree.buildTree(&triangles, MAP_BLOCKSIZE);
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<f32> coord(-2 * MAP_BLOCKSIZE * BS, 3 * MAP_BLOCKSIZE * BS);
+	std::uniform_real_distribution<f32> step(-BS, BS);
+	std::vector<u8> sides, last_sides;
+	std::vector<s32> order, last_order;
+	v3f viewpoint;
+	u32 same = 0;
+	for (int i = 0; i < 2000; i++) {
+		// Small steps from the last viewpoint, and exactly on node borders
+		if (i % 4)
+			viewpoint += v3f(step(rng), step(rng), step(rng));
+		else
+			viewpoint = v3f(coord(rng), coord(rng), coord(rng));
+		if (i % 7 == 0)
+			viewpoint.X = std::round(viewpoint.X / BS) * BS + BS / 2;
+		tree.getSides(viewpoint, sides);
+		order.clear();
+		tree.traverse(viewpoint, order);
+		if (i && sides == last_sides) {
+			UASSERT(order == last_order);
+			++same;
+		}
+		sides.swap(last_sides);
+		order.swap(last_order);
+	}
+	UASSERT(same > 0);
+}
+
+void TestFmBsp::testWaterSurface()
+{
+	irr_ptr<scene::SMeshBuffer> buffer(new scene::SMeshBuffer());
+	std::vector<MeshTriangle> triangles;
+	make_water(buffer.get(), triangles);
+	MapBlockBspTree tree;
+	tree.buildTree(&triangles, MAP_BLOCKSIZE);
+
+	// Walking over the water crosses few planes that change the order
+	std::vector<u8> sides, last_sides;
+	u32 changes = 0, steps = 0;
+	for (f32 x = -4 * BS; x < (MAP_BLOCKSIZE + 4) * BS; x += BS / 4, steps++) {
+		tree.getSides(v3f(x, (MAP_BLOCKSIZE + 1) * BS, 3.3f * BS), sides);
+		changes += sides != last_sides;
+		sides.swap(last_sides);
+	}
+	UASSERT(changes < steps / 2);
+}
@@ -0,0 +1,413 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <functional>
+#include <memory>
+#include "circuit.h"
+#include "dummygamedef.h"
+#include "dummymap.h"
+#include "filesys.h"
+#include "gamedef.h"
+#include "key_value_storage.h"
+#include "nodedef.h"
+#include "util/string.h"
+
+class TestFmCircuit : public TestBase
+{
+public:
+	TestFmCircuit() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmCircuit"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testDelay(IGameDef *gamedef);
+	void testSwap(IGameDef *gamedef);
+	void testUnregistered(IGameDef *gamedef);
+	void testWaiting(IGameDef *gamedef);
+	void testSave(IGameDef *gamedef);
+
+private:
+	void defineNodes(NodeDefManager *ndef);
+	// Circuit of a source, a relay and a lamp in a row along X
+	void place(Map &map, Circuit &circuit);
+	// Steps until the lamp is lit, swap is called before each step
+	int stepsToLamp(Circuit &circuit, const std::function<void(int)> &swap);
+	void step(Circuit &circuit);
+	u8 output(Circuit &circuit, v3pos_t pos);
+	// Every connected face is listed by its virtual element
+	bool isLinked(Circuit &circuit);
+	void checkLoaded(Circuit &circuit);
+
+	content_t m_source = CONTENT_IGNORE;
+	content_t m_relay = CONTENT_IGNORE;
+	content_t m_relay_on = CONTENT_IGNORE;
+	content_t m_lamp = CONTENT_IGNORE;
+	const v3pos_t m_source_pos{0, 0, 0}, m_relay_pos{1, 0, 0}, m_lamp_pos{2, 0, 0};
+};
+
+static TestFmCircuit g_test_instance;
+
+void TestFmCircuit::runTests(IGameDef *)
+{
+	// Circuit nodes are not registered with the shared node definitions
+	DummyGameDef gamedef;
+	defineNodes(gamedef.getWritableNodeDefManager());
+
+	TEST(testDelay, &gamedef);
+	TEST(testSwap, &gamedef);
+	TEST(testUnregistered, &gamedef);
+	TEST(testWaiting, &gamedef);
+	TEST(testSave, &gamedef);
+}
+
+void TestFmCircuit::defineNodes(NodeDefManager *ndef)
+{
+	ContentFeatures f;
+	f.is_circuit_element = true;
+
+	f.name = "test:circuit_source";
+	for (u8 &output : f.circuit_element_func)
+		output = 0x3F;
+	m_source = ndef->set(f.name, f);
+
+	// From the -X face to the +X face, two updates later
+	f.name = "test:circuit_relay";
+	f.param_type_2 = CPT2_FACEDIR;
+	f.circuit_element_delay = 2;
+	for (int input = 0; input < 64; ++input)
+		f.circuit_element_func[input] = input & SHIFT_TO_FACE(3) ? SHIFT_TO_FACE(2) : 0;
+	m_relay = ndef->set(f.name, f);
+	f.name = "test:circuit_relay_on";
+	m_relay_on = ndef->set(f.name, f);
+
+	f.name = "test:circuit_lamp";
+	f.param_type_2 = CPT2_NONE;
+	f.circuit_element_delay = 0;
+	for (int input = 0; input < 64; ++input)
+		f.circuit_element_func[input] = input;
+	m_lamp = ndef->set(f.name, f);
+}
+
+void TestFmCircuit::place(Map &map, Circuit &circuit)
+{
+	map.setNode(m_source_pos, MapNode(m_source));
+	circuit.addNode(m_source_pos);
+	map.setNode(m_relay_pos, MapNode(m_relay));
+	circuit.addNode(m_relay_pos);
+	map.setNode(m_lamp_pos, MapNode(m_lamp));
+	circuit.addNode(m_lamp_pos);
+}
+
+void TestFmCircuit::step(Circuit &circuit)
+{
+	circuit.m_since_last_update = circuit.m_min_update_delay * 2;
+	circuit.update(0.0f);
+}
+
+u8 TestFmCircuit::output(Circuit &circuit, v3pos_t pos)
+{
+	return circuit.m_pos_to_iterator[pos]->getOutputState();
+}
+
+bool TestFmCircuit::isLinked(Circuit &circuit)
+{
+	for (auto &element : circuit.m_elements) {
+		for (int i = 0; i < 6; ++i) {
+			const CircuitElementContainer face = element.getFace(i);
+			if (face.is_connected && (&*face.list_iterator->element_pointer != &element ||
+					face.list_iterator->shift != i))
+				return false;
+		}
+	}
+	return true;
+}
+
+void TestFmCircuit::checkLoaded(Circuit &circuit)
+{
+	UASSERTEQ(size_t, circuit.m_elements.size(), 3);
+	UASSERT(isLinked(circuit));
+	const auto relay = circuit.m_pos_to_iterator[m_relay_pos];
+	UASSERT(relay->getFace(2).is_connected && relay->getFace(3).is_connected);
+	UASSERT(output(circuit, m_lamp_pos));
+	step(circuit);
+	UASSERT(output(circuit, m_lamp_pos));
+}
+
+int TestFmCircuit::stepsToLamp(Circuit &circuit, const std::function<void(int)> &swap)
+{
+	for (int steps = 1; steps < 20; ++steps) {
+		swap(steps);
+		step(circuit);
+		if (output(circuit, m_lamp_pos))
+			return steps;
+	}
+	return 0;
+}
+
+void TestFmCircuit::testDelay(IGameDef *gamedef)
+{
+	const std::string savedir = getTestTempDirectory() + DIR_DELIM + "circuit_delay";
+	fs::RecursiveDelete(savedir);
+	fs::CreateAllDirs(savedir);
+	int plain = 0, swapped = 0;
+	{
+		DummyMap map(gamedef, {-1, -1, -1}, {1, 1, 1});
+		map.fill({-1, -1, -1}, {1, 1, 1}, MapNode(CONTENT_AIR));
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		place(map, circuit);
+		plain = stepsToLamp(circuit, [](int) {});
+	}
+	fs::RecursiveDelete(savedir);
+	fs::CreateAllDirs(savedir);
+	{
+		DummyMap map(gamedef, {-1, -1, -1}, {1, 1, 1});
+		map.fill({-1, -1, -1}, {1, 1, 1}, MapNode(CONTENT_AIR));
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		place(map, circuit);
+		// The relay turns on and off while the signal is on the way
+		swapped = stepsToLamp(circuit, [&](int steps) {
+			if (steps < 2)
+				return;
+			const MapNode n_old = map.getNode(m_relay_pos);
+			const MapNode n_new(n_old.getContent() == m_relay ? m_relay_on : m_relay);
+			map.setNode(m_relay_pos, n_new);
+			circuit.swapNode(m_relay_pos, n_old, n_new);
+		});
+	}
+	fs::RecursiveDelete(savedir);
+
+	// Source, two delayed updates of the relay and one of the lamp
+	UASSERTEQ(int, plain, 5);
+	UASSERTEQ(int, swapped, plain);
+}
+
+void TestFmCircuit::testSwap(IGameDef *gamedef)
+{
+	const std::string savedir = getTestTempDirectory() + DIR_DELIM + "circuit_swap";
+	fs::RecursiveDelete(savedir);
+	fs::CreateAllDirs(savedir);
+	{
+		DummyMap map(gamedef, {-1, -1, -1}, {1, 1, 1});
+		map.fill({-1, -1, -1}, {1, 1, 1}, MapNode(CONTENT_AIR));
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		place(map, circuit);
+		for (int i = 0; i < 10; ++i)
+			step(circuit);
+		UASSERT(!circuit.m_graph_changed);
+		UASSERT(circuit.m_worklist.empty());
+
+		// The same faces, only the relay is looked at again
+		MapNode n_old = map.getNode(m_relay_pos);
+		MapNode n_new(m_relay_on);
+		map.setNode(m_relay_pos, n_new);
+		circuit.swapNode(m_relay_pos, n_old, n_new);
+		UASSERT(!circuit.m_graph_changed);
+		UASSERTEQ(size_t, circuit.m_worklist.size(), 1);
+		UASSERT(circuit.m_graph.positions[circuit.m_worklist[0]] == m_relay_pos);
+		step(circuit);
+		UASSERT(output(circuit, m_lamp_pos));
+
+		// An element far away, compiled without looking at the others
+		const v3pos_t far_pos(0, 0, 10);
+		map.setNode(far_pos, MapNode(m_lamp));
+		circuit.addNode(far_pos);
+		UASSERT(circuit.m_graph_changed);
+		circuit.compile();
+		UASSERTEQ(size_t, circuit.m_worklist.size(), 1);
+		UASSERT(circuit.m_graph.positions[circuit.m_worklist[0]] == far_pos);
+		step(circuit);
+
+		// Turned around, the faces move
+		n_old = map.getNode(m_relay_pos);
+		n_new = MapNode(m_relay, 0, 1);
+		map.setNode(m_relay_pos, n_new);
+		circuit.swapNode(m_relay_pos, n_old, n_new);
+		UASSERT(circuit.m_graph_changed);
+	}
+	fs::RecursiveDelete(savedir);
+}
+
+void TestFmCircuit::testUnregistered(IGameDef *gamedef)
+{
+	const std::string savedir = getTestTempDirectory() + DIR_DELIM + "circuit_unregistered";
+	fs::RecursiveDelete(savedir);
+	fs::CreateAllDirs(savedir);
+	{
+		DummyMap map(gamedef, {-1, -1, -1}, {1, 1, 1});
+		map.fill({-1, -1, -1}, {1, 1, 1}, MapNode(CONTENT_AIR));
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		place(map, circuit);
+		// Written by a voxel manipulator, the circuit did not see it
+		const v3pos_t pos(3, 0, 0);
+		map.setNode(pos, MapNode(m_relay));
+		UASSERT(circuit.m_pos_to_iterator.find(pos) == circuit.m_pos_to_iterator.end());
+
+		const MapNode n_old = map.getNode(pos);
+		const MapNode n_new(m_relay_on);
+		map.setNode(pos, n_new);
+		circuit.swapNode(pos, n_old, n_new);
+		UASSERTEQ(size_t, circuit.m_elements.size(), 4);
+		UASSERT(circuit.m_pos_to_iterator.find(pos) != circuit.m_pos_to_iterator.end());
+		UASSERT(isLinked(circuit));
+		// Connected to the lamp
+		UASSERT(circuit.m_pos_to_iterator[pos]->getFace(3).is_connected);
+		step(circuit);
+
+		// Dug before the circuit saw it
+		const v3pos_t dug(5, 0, 0);
+		map.setNode(dug, MapNode(m_lamp));
+		map.setNode(dug, MapNode(CONTENT_AIR));
+		circuit.removeNode(dug, MapNode(m_lamp));
+		UASSERTEQ(size_t, circuit.m_elements.size(), 4);
+	}
+	fs::RecursiveDelete(savedir);
+}
+
+void TestFmCircuit::testWaiting(IGameDef *gamedef)
+{
+	const std::string savedir = getTestTempDirectory() + DIR_DELIM + "circuit_waiting";
+	fs::RecursiveDelete(savedir);
+	fs::CreateAllDirs(savedir);
+	{
+		DummyMap map(gamedef, {-1, -1, -1}, {1, 1, 1});
+		map.fill({-1, -1, -1}, {1, 1, 1}, MapNode(CONTENT_AIR));
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		place(map, circuit);
+
+		// The lamp reads as not loaded, the whole component waits for its block
+		const v3bpos_t bpos = getNodeBlockPos(m_lamp_pos);
+		MapBlock *block = map.getBlockNoCreateNoEx(bpos);
+		const v3pos_t rel = m_lamp_pos - getBlockPosRelative(bpos);
+		const MapNode lamp = block->getNodeNoCheck(rel);
+		block->setNodeNoCheck(rel, MapNode(CONTENT_IGNORE));
+		step(circuit);
+		UASSERT(circuit.m_worklist.empty());
+		UASSERTEQ(size_t, circuit.m_waiting_blocks.size(), 1);
+		UASSERTEQ(size_t, circuit.m_waiting_blocks[bpos].size(), 3);
+		// Nothing to look at while waiting
+		step(circuit);
+		UASSERT(circuit.m_worklist.empty());
+		UASSERT(!output(circuit, m_source_pos));
+
+		// Loaded, the component goes on
+		block->setNodeNoCheck(rel, lamp);
+		circuit.addBlock(block);
+		UASSERT(circuit.m_waiting_blocks.empty());
+		UASSERTEQ(size_t, circuit.m_worklist.size(), 3);
+		UASSERT(stepsToLamp(circuit, [](int) {}));
+	}
+	fs::RecursiveDelete(savedir);
+}
+
+void TestFmCircuit::testSave(IGameDef *gamedef)
+{
+	const std::string savedir = getTestTempDirectory() + DIR_DELIM + "circuit_save";
+	fs::RecursiveDelete(savedir);
+	fs::CreateAllDirs(savedir);
+	DummyMap map(gamedef, {-1, -1, -1}, {1, 1, 1});
+	map.fill({-1, -1, -1}, {1, 1, 1}, MapNode(CONTENT_AIR));
+	{
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		place(map, circuit);
+		UASSERT(stepsToLamp(circuit, [](int) {}));
+#if !USE_LEVELDB
+		// Nothing to write to
+		UASSERTEQ(size_t, circuit.m_database->pending_size(), 0);
+#endif
+	}
+#if USE_LEVELDB
+	MapBlock *block = map.getBlockNoCreateNoEx(getNodeBlockPos(m_relay_pos));
+
+	// As written by older versions, in three databases without key prefixes
+	{
+		KeyValueStorage database(savedir, "circuit");
+		KeyValueStorage virtual_database(savedir, "circuit_virtual");
+		KeyValueStorage state_database(savedir, "circuit_state");
+		std::vector<std::pair<std::string, std::string>> records;
+		std::unique_ptr<leveldb::Iterator> it(database.new_iterator());
+		for (it->SeekToFirst(); it->Valid(); it->Next())
+			records.emplace_back(it->key().ToString(), it->value().ToString());
+		it.reset();
+		for (const auto &[key, value] : records) {
+			UASSERT(database.del(key));
+			if (key[0] == 'e') {
+				UASSERT(database.put(key.substr(1), value));
+			} else if (key[0] == 'v') {
+				UASSERT(virtual_database.put(key.substr(1), value));
+			} else if (key[0] == 's') {
+				UASSERT(state_database.put(key.substr(1), value));
+			}
+		}
+	}
+	{
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		checkLoaded(circuit);
+	}
+	UASSERT(!fs::PathExists(savedir + DIR_DELIM + "circuit_virtual.db"));
+	UASSERT(!fs::PathExists(savedir + DIR_DELIM + "circuit_state.db"));
+
+	// Read with the block
+	{
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		UASSERT(circuit.m_elements.empty());
+		circuit.addBlock(block);
+		checkLoaded(circuit);
+	}
+
+	// Or when a node of the block changes
+	u32 relay_id = 0, lamp_virtual_id = 0;
+	{
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		const MapNode lamp = map.getNode(m_lamp_pos);
+		map.setNode(m_lamp_pos, MapNode(CONTENT_AIR));
+		circuit.removeNode(m_lamp_pos, lamp);
+		UASSERTEQ(size_t, circuit.m_elements.size(), 2);
+		UASSERT(isLinked(circuit));
+		map.setNode(m_lamp_pos, lamp);
+		circuit.addNode(m_lamp_pos);
+		UASSERT(stepsToLamp(circuit, [](int) {}));
+		relay_id = circuit.m_pos_to_iterator[m_relay_pos]->getId();
+		lamp_virtual_id = circuit.m_pos_to_iterator[m_lamp_pos]->getFace(3).list_pointer->getId();
+	}
+	{
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		circuit.addBlock(block);
+		checkLoaded(circuit);
+	}
+
+	// Saving cut short: a virtual element lists the removed relay and
+	// the lamp has a face on a virtual element not written
+	{
+		KeyValueStorage database(savedir, "circuit");
+		UASSERT(database.del("e" + itos(relay_id)));
+		UASSERT(database.del("v" + itos(lamp_virtual_id)));
+	}
+	{
+		Circuit circuit(nullptr, &map, gamedef->ndef(), savedir);
+		circuit.addBlock(block);
+		UASSERTEQ(size_t, circuit.m_elements.size(), 2);
+		UASSERT(circuit.m_pos_to_iterator.find(m_relay_pos) == circuit.m_pos_to_iterator.end());
+		UASSERT(isLinked(circuit));
+		UASSERT(circuit.m_pos_to_iterator[m_source_pos]->getFace(2).is_connected);
+		UASSERT(!circuit.m_pos_to_iterator[m_lamp_pos]->getFace(3).is_connected);
+		step(circuit);
+	}
+#endif
+	fs::RecursiveDelete(savedir);
+}
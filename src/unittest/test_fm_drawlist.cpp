@@ -0,0 +1,180 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <atomic>
+#include "client/fm_drawlist.h"
+#include "mapblock.h"
+#include "threading/ThreadPool.h"
+
+class TestFmDrawList : public TestBase
+{
+public:
+	TestFmDrawList() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmDrawList"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testOrder(IGameDef *gamedef);
+	void testIncremental(IGameDef *gamedef);
+	void testOcclusion();
+	void testParallel();
+};
+
+static TestFmDrawList g_test_instance;
+
+void TestFmDrawList::runTests(IGameDef *gamedef)
+{
+	TEST(testOrder, gamedef);
+	TEST(testIncremental, gamedef);
+	TEST(testOcclusion);
+	TEST(testParallel);
+}
+
+static std::vector<v3bpos_t> list_positions(const DrawList &list)
+{
+	std::vector<v3bpos_t> order;
+	for (const auto &[pos, block] : list)
+		order.emplace_back(pos);
+	return order;
+}
+
+void TestFmDrawList::testOrder(IGameDef *gamedef)
+{
+	const v3bpos_t camera(10, 0, -5);
+	DrawListBuilder builder;
+	builder.setCamera(camera);
+	const std::vector<v3bpos_t> positions{{10, 0, -5}, {13, 0, -5}, {10, 3, -5},
+			{11, 1, -4}, {-20, 0, -5}, {10, 0, 2}, {12, 2, -4}};
+	for (const auto &pos : positions)
+		builder.insert_or_assign(pos, std::make_shared<MapBlock>(pos, gamedef));
+
+	// Far mesh over the near one
+	const auto far = std::make_shared<MapBlock>(v3bpos_t(10, 0, 2), gamedef);
+	builder.insert_or_assign({10, 0, 2}, far);
+	UASSERT(builder.contains({10, 3, -5}));
+	UASSERT(!builder.contains({0, 0, 0}));
+	UASSERTEQ(size_t, builder.size(), positions.size());
+
+	const auto list = builder.build();
+	UASSERTEQ(size_t, list.size(), positions.size());
+	UASSERTEQ(size_t, builder.size(), 0);
+	for (const auto &[pos, block] : list)
+		UASSERT(block && block->getPos() == pos);
+	// Farthest first, same distance by position
+	const std::vector<v3bpos_t> expected{{-20, 0, -5}, {10, 0, 2}, {13, 0, -5},
+			{12, 2, -4}, {10, 3, -5}, {11, 1, -4}, {10, 0, -5}};
+	UASSERT(list_positions(list) == expected);
+	UASSERT(list.begin()[1].second == far);
+}
+
+void TestFmDrawList::testIncremental(IGameDef *gamedef)
+{
+	std::vector<MapBlockPtr> blocks;
+	for (bpos_t z = -3; z <= 3; ++z)
+		for (bpos_t x = -3; x <= 3; ++x)
+			blocks.emplace_back(std::make_shared<MapBlock>(v3bpos_t(x, z % 2, z), gamedef));
+
+	// Same list as built from nothing
+	DrawListBuilder builder;
+	const auto update = [&](const v3bpos_t &camera, size_t skip) {
+		DrawListBuilder fresh;
+		builder.setCamera(camera);
+		fresh.setCamera(camera);
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			if (skip && i % skip == 0)
+				continue;
+			builder.insert_or_assign(blocks[i]->getPos(), blocks[i]);
+			fresh.insert_or_assign(blocks[i]->getPos(), blocks[i]);
+		}
+		const auto list = builder.build();
+		UASSERT(list_positions(list) == list_positions(fresh.build()));
+		return list;
+	};
+
+	UASSERTEQ(size_t, update({0, 0, 0}, 0).size(), blocks.size());
+	// Blocks not assigned again are dropped, then come back
+	const auto list = update({0, 0, 0}, 3);
+	UASSERTEQ(size_t, list.size(), blocks.size() - (blocks.size() + 2) / 3);
+	UASSERT(!builder.contains(blocks[0]->getPos()));
+	UASSERTEQ(size_t, update({0, 0, 0}, 0).size(), blocks.size());
+	// Camera in another block
+	update({2, 0, -1}, 0);
+	update({2, 0, -1}, 4);
+
+	// A new block for a kept position
+	const auto block = std::make_shared<MapBlock>(blocks[5]->getPos(), gamedef);
+	builder.insert_or_assign(block->getPos(), block);
+	const auto replaced = builder.build();
+	UASSERTEQ(size_t, replaced.size(), 1);
+	UASSERT(replaced.begin()->second == block);
+}
+
+void TestFmDrawList::testOcclusion()
+{
+	DrawListOcclusion occlusion;
+	std::vector<std::pair<v3bpos_t, uint64_t>> meshes{
+			{{5, 0, 0}, 1}, {{-5, 0, 0}, 2}, {{6, 0, 0}, 3}};
+	// Tests run, blocks with a positive X are occluded
+	const auto update = [&](const v3pos_t &camera) {
+		occlusion.begin(camera);
+		for (const auto &[pos, generation] : meshes)
+			occlusion.add(pos, generation);
+		const auto &retest = occlusion.retest();
+		for (const auto i : retest)
+			occlusion.setOccluded(i, meshes[i].first.X > 0);
+		return retest.size();
+	};
+
+	const v3pos_t camera(1, 2, 3);
+	UASSERTEQ(size_t, update(camera), 3);
+	UASSERT(occlusion.isOccluded({5, 0, 0}));
+	UASSERT(!occlusion.isOccluded({-5, 0, 0}));
+	// Nothing changed
+	UASSERTEQ(size_t, update(camera), 0);
+	UASSERT(occlusion.isOccluded({6, 0, 0}));
+	// New mesh of a block, wherever it was allocated
+	meshes[1].second = 4;
+	UASSERTEQ(size_t, update(camera), 3);
+	UASSERTEQ(size_t, update(camera), 0);
+	// Camera on another node
+	UASSERTEQ(size_t, update(camera + v3pos_t(1, 0, 0)), 3);
+	// A mesh gone
+	meshes.pop_back();
+	UASSERTEQ(size_t, update(camera + v3pos_t(1, 0, 0)), 2);
+	UASSERTEQ(size_t, occlusion.size(), 2);
+	UASSERT(!occlusion.isOccluded({6, 0, 0}));
+}
+
+void TestFmDrawList::testParallel()
+{
+	progschj::ThreadPool pool(3);
+	std::vector<int> values(1000);
+	std::atomic_int calls{0};
+	const auto fill = [&](size_t begin, size_t end) {
+		++calls;
+		for (size_t i = begin; i < end; ++i)
+			values[i] += i;
+	};
+	drawlist_parallel(&pool, values.size(), 64, fill);
+	UASSERTEQ(int, calls, 16);
+	drawlist_parallel(nullptr, values.size(), 64, fill);
+	UASSERTEQ(int, calls, 17);
+	for (size_t i = 0; i < values.size(); ++i)
+		UASSERTEQ(int, values[i], 2 * i);
+}
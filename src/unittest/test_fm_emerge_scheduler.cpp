@@ -0,0 +1,182 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "fm_emerge_scheduler.h"
+
+class TestFmEmergeScheduler : public TestBase
+{
+public:
+	TestFmEmergeScheduler() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmEmergeScheduler"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testChunkGrouping();
+	void testPriority();
+	void testAvoidNeighbours();
+	void testWake();
+	void testRelease();
+	void testClear();
+
+private:
+	// Chunks of 5 blocks, chunk 0 is -2..2
+	static constexpr bpos_t CS = 5;
+};
+
+static TestFmEmergeScheduler g_test_instance;
+
+void TestFmEmergeScheduler::runTests(IGameDef *gamedef)
+{
+	TEST(testChunkGrouping);
+	TEST(testPriority);
+	TEST(testAvoidNeighbours);
+	TEST(testWake);
+	TEST(testRelease);
+	TEST(testClear);
+}
+
+void TestFmEmergeScheduler::testChunkGrouping()
+{
+	EmergeScheduler sched(2, v3bpos_t(CS));
+	sched.push({0, 0, 0}, 1);
+	sched.push({20, 0, 0}, 2);
+	sched.push({1, 1, 1}, 3);
+	UASSERTEQ(size_t, sched.size(), 3);
+	UASSERTEQ(size_t, sched.chunkCount(), 2);
+
+	// Thread 0 gets both blocks of the first chunk
+	v3bpos_t pos;
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(0, 0, 0));
+	UASSERT(sched.pop(1, pos));
+	UASSERT(pos == v3bpos_t(20, 0, 0));
+
+	// Blocks queued for a claimed chunk stay with its thread
+	sched.push({2, 2, 2}, 0);
+	UASSERT(!sched.pop(1, pos));
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(2, 2, 2));
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(1, 1, 1));
+	UASSERT(!sched.pop(0, pos));
+	UASSERTEQ(size_t, sched.size(), 0);
+	// Finished chunks are dropped when their thread asks for more
+	UASSERTEQ(size_t, sched.chunkCount(), 0);
+}
+
+void TestFmEmergeScheduler::testPriority()
+{
+	EmergeScheduler sched(1, v3bpos_t(CS));
+	sched.push({100, 0, 0}, 10);
+	sched.push({200, 0, 0}, 5);
+	sched.push({300, 0, 0}, 5);
+	// A more urgent block moves its whole chunk ahead
+	sched.push({101, 0, 0}, 1);
+
+	v3bpos_t pos;
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(101, 0, 0));
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(100, 0, 0));
+	// Same priority is first come first served
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(200, 0, 0));
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(300, 0, 0));
+	UASSERT(!sched.pop(0, pos));
+}
+
+void TestFmEmergeScheduler::testAvoidNeighbours()
+{
+	EmergeScheduler sched(2, v3bpos_t(CS));
+	sched.push({0, 0, 0}, 1);
+	sched.push({5, 0, 0}, 2);
+	sched.push({50, 0, 0}, 3);
+
+	v3bpos_t pos;
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(0, 0, 0));
+	// The chunk next to the one of thread 0 is passed over
+	UASSERT(sched.pop(1, pos));
+	UASSERT(pos == v3bpos_t(50, 0, 0));
+	// Nothing else left, so it is taken even though it is next to thread 1
+	UASSERT(sched.pop(1, pos));
+	UASSERT(pos == v3bpos_t(5, 0, 0));
+}
+
+void TestFmEmergeScheduler::testWake()
+{
+	EmergeScheduler sched(2, v3bpos_t(CS));
+	// Both threads start idle
+	UASSERTEQ(int, sched.push({0, 0, 0}, 0), 0);
+	UASSERTEQ(int, sched.push({50, 0, 0}, 0), 1);
+	UASSERTEQ(int, sched.push({100, 0, 0}, 0), -1);
+
+	v3bpos_t pos;
+	UASSERT(sched.pop(0, pos));
+	UASSERT(sched.pop(1, pos));
+	UASSERT(sched.pop(1, pos));
+	UASSERT(!sched.pop(1, pos));
+	// Thread 0 still has its chunk claimed, block goes to it without wake
+	UASSERTEQ(int, sched.push({1, 0, 0}, 0), -1);
+	UASSERTEQ(int, sched.push({200, 0, 0}, 0), 1);
+}
+
+void TestFmEmergeScheduler::testRelease()
+{
+	EmergeScheduler sched(1, v3bpos_t(CS));
+	sched.push({0, 0, 0}, 0);
+	sched.push({1, 0, 0}, 0);
+	sched.push({50, 0, 0}, 0);
+
+	v3bpos_t pos;
+	UASSERT(sched.pop(0, pos));
+	std::vector<v3bpos_t> dropped;
+	sched.release(0, dropped);
+	UASSERTEQ(size_t, dropped.size(), 1);
+	UASSERT(dropped[0] == v3bpos_t(1, 0, 0));
+	UASSERTEQ(size_t, sched.size(), 1);
+
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(50, 0, 0));
+}
+
+void TestFmEmergeScheduler::testClear()
+{
+	EmergeScheduler sched(2, v3bpos_t(CS));
+	sched.push({0, 0, 0}, 0);
+	sched.push({1, 0, 0}, 0);
+	sched.push({50, 0, 0}, 0);
+	sched.push({100, 0, 0}, 0);
+
+	v3bpos_t pos;
+	UASSERT(sched.pop(0, pos));
+	std::vector<v3bpos_t> dropped;
+	sched.clear(dropped);
+	UASSERTEQ(size_t, dropped.size(), 3);
+	UASSERTEQ(size_t, sched.size(), 0);
+	UASSERTEQ(size_t, sched.chunkCount(), 0);
+	UASSERT(!sched.pop(0, pos));
+	UASSERT(!sched.pop(1, pos));
+
+	// Usable again, both threads are idle
+	UASSERTEQ(int, sched.push({0, 0, 0}, 0), 0);
+	UASSERT(sched.pop(0, pos));
+	UASSERT(pos == v3bpos_t(0, 0, 0));
+}
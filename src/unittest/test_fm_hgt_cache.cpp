@@ -0,0 +1,179 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <thread>
+#include <vector>
+#include "mapgen/earth/hgt_cache.h"
+
+class TestFmHgtCache : public TestBase
+{
+public:
+	TestFmHgtCache() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmHgtCache"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testSample();
+	void testArea();
+	void testReopen();
+	void testEvict();
+	void testRetry();
+};
+
+static TestFmHgtCache g_test_instance;
+
+void TestFmHgtCache::runTests(IGameDef *gamedef)
+{
+	TEST(testSample);
+	TEST(testArea);
+	TEST(testReopen);
+	TEST(testEvict);
+	TEST(testRetry);
+}
+
+// Height is 10 * x + y in cells, tile 0,0 has no data
+static std::atomic<int> conversions;
+static bool make_tile(int lat, int lon, hgt_grid &grid)
+{
+	conversions++;
+	if (!lat && !lon)
+		return false;
+	grid.cells_x = 100;
+	grid.cells_y = 200;
+	for (uint32_t y = 0; y <= grid.cells_y; ++y)
+		for (uint32_t x = 0; x <= grid.cells_x; ++x)
+			grid.values.emplace_back(10 * x + y);
+	return true;
+}
+
+void TestFmHgtCache::testSample()
+{
+	hgt_cache cache(getTestTempDirectory(), make_tile);
+	UASSERTEQ(float, cache.get(1, 1), 0);
+	// North east corner of the tile
+	UASSERT(std::fabs(cache.get(1.999999f, 1.999999f) - 1200) < 1);
+	// Between cells
+	UASSERT(std::fabs(cache.get(1.0f + 10.5f / 200, 1.0f + 20.25f / 100) - 212.999f) < 0.1f);
+	UASSERTEQ(float, cache.get(0.5f, 0.5f), 0);
+	UASSERTEQ(float, cache.get(95, 0), 0);
+}
+
+void TestFmHgtCache::testArea()
+{
+	hgt_cache cache(getTestTempDirectory(), make_tile);
+	constexpr size_t size_x = 7, size_z = 5;
+	std::vector<hgt_cache::height_t> out(size_x * size_z);
+	// Crosses into four tiles
+	cache.get_area(-1.3, -1.4, 0.33, 0.41, size_x, size_z, out.data());
+	for (size_t z = 0; z < size_z; ++z)
+		for (size_t x = 0; x < size_x; ++x)
+			UASSERT(std::fabs(out[z * size_x + x] -
+							  cache.get(-1.3 + 0.33 * z, -1.4 + 0.41 * x)) < 0.1f);
+}
+
+void TestFmHgtCache::testReopen()
+{
+	const std::string folder = getTestTempDirectory();
+	hgt_cache::height_t expected;
+	{
+		hgt_cache cache(folder, make_tile);
+		expected = cache.get(-2.7f, 3.3f);
+	}
+	// Made once, then read from the native file
+	conversions = 0;
+	hgt_cache cache(folder, make_tile);
+	UASSERTEQ(float, cache.get(-2.7f, 3.3f), expected);
+	UASSERTEQ(int, conversions, 0);
+}
+
+void TestFmHgtCache::testEvict()
+{
+	hgt_cache cache(getTestTempDirectory(), make_tile);
+	for (int lat = 1; lat <= 4; ++lat)
+		cache.get(lat + 0.5f, 0.5f);
+	UASSERTEQ(size_t, cache.get_resident_tiles(), 4);
+
+	// Room for one tile, the most recent one stays
+	cache.set_max_bytes(1);
+	UASSERTEQ(size_t, cache.get_resident_tiles(), 1);
+	UASSERT(std::fabs(cache.get(4.5f, 0.5f) - 600) < 1);
+	UASSERTEQ(size_t, cache.get_resident_tiles(), 1);
+
+	std::vector<std::thread> threads;
+	std::atomic<int> wrong = 0;
+	for (int t = 0; t < 4; ++t)
+		threads.emplace_back([&, t] {
+			for (int i = 0; i < 200; ++i) {
+				const float lat = 1 + (i + t) % 4 + 0.5f;
+				if (std::fabs(cache.get(lat, 0.5f) - 600) > 1)
+					wrong++;
+			}
+		});
+	for (auto &thread : threads)
+		thread.join();
+	UASSERTEQ(int, wrong, 0);
+	UASSERT(cache.get_resident_bytes() <= 200000);
+}
+
+void TestFmHgtCache::testRetry()
+{
+	const std::string folder = getTestTempDirectory();
+	std::filesystem::remove(folder + "/tiled/N10E010.fmh");
+
+	// No data, then incomplete data, then the whole tile
+	int calls = 0;
+	const auto convert = [&calls](int lat, int lon, hgt_grid &grid) {
+		++calls;
+		grid.complete = calls > 2;
+		if (calls == 1)
+			return false;
+		grid.cells_x = grid.cells_y = 1;
+		grid.values.assign(4, calls * 100);
+		return true;
+	};
+	{
+		hgt_cache cache(folder, convert);
+		cache.set_retry_ms(10);
+		UASSERTEQ(float, cache.get(10.5f, 10.5f), 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		UASSERTEQ(float, cache.get(10.5f, 10.5f), 200);
+		UASSERT(!std::filesystem::exists(folder + "/tiled/N10E010.fmh"));
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		UASSERTEQ(float, cache.get(10.5f, 10.5f), 300);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		UASSERTEQ(float, cache.get(10.5f, 10.5f), 300);
+		UASSERTEQ(int, calls, 3);
+	}
+	// Only the complete tile was saved
+	hgt_cache cache(folder, convert);
+	UASSERTEQ(float, cache.get(10.5f, 10.5f), 300);
+	UASSERTEQ(int, calls, 3);
+
+	// Not made again before the wait is over
+	std::filesystem::remove(folder + "/tiled/N11E010.fmh");
+	calls = 1;
+	hgt_cache waiting(folder, convert);
+	UASSERTEQ(float, waiting.get(11.5f, 10.5f), 200);
+	UASSERTEQ(float, waiting.get(11.5f, 10.5f), 200);
+	UASSERTEQ(int, calls, 2);
+}
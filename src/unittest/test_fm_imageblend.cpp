@@ -0,0 +1,184 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <random>
+#include <SColor.h>
+#include "fm_imageblend.h"
+
+class TestFmImageBlend : public TestBase
+{
+public:
+	TestFmImageBlend() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmImageBlend"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBlit();
+	void testColor();
+	void testOverlay();
+};
+
+static TestFmImageBlend g_test_instance;
+
+void TestFmImageBlend::runTests(IGameDef *gamedef)
+{
+	TEST(testBlit);
+	TEST(testColor);
+	TEST(testOverlay);
+}
+
+// Odd length for the scalar tail, alpha mostly 0 or 255 like real textures
+static std::vector<u32> random_pixels(std::mt19937 &rng, size_t count = 1001)
+{
+	std::vector<u32> pixels(count);
+	for (auto &pixel : pixels) {
+		pixel = rng();
+		switch (rng() % 4) {
+		case 0:
+			pixel &= 0x00ffffff;
+			break;
+		case 1:
+		case 2:
+			pixel |= 0xff000000;
+			break;
+		}
+	}
+	return pixels;
+}
+
+void TestFmImageBlend::testBlit()
+{
+	std::mt19937 rng(1);
+	for (const bool overlay : {false, true}) {
+		const auto src = random_pixels(rng);
+		auto dst = random_pixels(rng);
+		auto expected = dst;
+		// Per pixel code of blit_with_alpha()
+		for (size_t i = 0; i < src.size(); ++i) {
+			video::SColor s(src[i]), d(expected[i]);
+			const u32 sa = s.getAlpha();
+			u32 da = d.getAlpha();
+			if ((overlay && da != 255) || sa == 0)
+				continue;
+			if (sa == 255 || da == 0) {
+				expected[i] = src[i];
+				continue;
+			}
+			const u32 r = (d.getRed() * (255 - sa) + s.getRed() * sa) / 255;
+			const u32 g = (d.getGreen() * (255 - sa) + s.getGreen() * sa) / 255;
+			const u32 b = (d.getBlue() * (255 - sa) + s.getBlue() * sa) / 255;
+			if (da != 255)
+				da = da + (255 - da) * sa * sa / (255 * 255);
+			expected[i] = video::SColor(da, r, g, b).color;
+		}
+		image_blit_row(src.data(), dst.data(), dst.size(), overlay);
+		UASSERT(dst == expected);
+	}
+}
+
+void TestFmImageBlend::testColor()
+{
+	std::mt19937 rng(2);
+	for (int round = 0; round < 20; ++round) {
+		const video::SColor color(rng());
+		const auto pixels = random_pixels(rng);
+
+		auto dst = pixels, expected = pixels;
+		for (auto &c : expected) {
+			video::SColor d(c);
+			d.set(d.getAlpha(), d.getRed() * color.getRed() / 255,
+					d.getGreen() * color.getGreen() / 255,
+					d.getBlue() * color.getBlue() / 255);
+			c = d.color;
+		}
+		image_multiply_row(dst.data(), dst.size(), color.color);
+		UASSERT(dst == expected);
+
+		dst = expected = pixels;
+		for (auto &c : expected) {
+			video::SColor d(c);
+			d.set(d.getAlpha(), 255 - (255 - d.getRed()) * (255 - color.getRed()) / 255,
+					255 - (255 - d.getGreen()) * (255 - color.getGreen()) / 255,
+					255 - (255 - d.getBlue()) * (255 - color.getBlue()) / 255);
+			c = d.color;
+		}
+		image_screen_row(dst.data(), dst.size(), color.color);
+		UASSERT(dst == expected);
+
+		for (const bool keep_alpha : {false, true}) {
+			dst = expected = pixels;
+			for (auto &c : expected) {
+				const u32 dst_alpha = video::SColor(c).getAlpha();
+				if (!dst_alpha)
+					continue;
+				video::SColor d = color;
+				if (keep_alpha)
+					d.setAlpha(dst_alpha * color.getAlpha() / 255);
+				c = d.color;
+			}
+			image_colorize_row(dst.data(), dst.size(), color.color, keep_alpha);
+			UASSERT(dst == expected);
+		}
+
+		const auto mask = random_pixels(rng);
+		dst = expected = pixels;
+		for (size_t i = 0; i < expected.size(); ++i)
+			expected[i] &= mask[i];
+		image_mask_row(mask.data(), dst.data(), dst.size());
+		UASSERT(dst == expected);
+	}
+
+	image_channel_tables_t tables;
+	for (int c = 0; c < 4; ++c)
+		for (int v = 0; v < 256; ++v)
+			tables[c][v] = c == 0 ? v : 255 - v;
+	std::vector<u32> dst{0x00123456, 0xff000000, 0x80ff8001, 0x80ff8001};
+	image_remap_row(dst.data(), dst.size(), tables, true);
+	UASSERT((dst == std::vector<u32>{0x00123456, 0xffffffff, 0x80007ffe, 0x80007ffe}));
+}
+
+void TestFmImageBlend::testOverlay()
+{
+	std::mt19937 rng(3);
+	const auto blend = random_pixels(rng);
+	const auto base = random_pixels(rng);
+	std::vector<u32> expected(base.size()), dst(base.size());
+	// Per pixel code of apply_overlay()
+	for (size_t i = 0; i < base.size(); ++i) {
+		video::SColor blend_c(blend[i]), base_c(base[i]);
+		f32 blend_r = blend_c.getRed() / 255.0f;
+		f32 blend_g = blend_c.getGreen() / 255.0f;
+		f32 blend_b = blend_c.getBlue() / 255.0f;
+		f32 base_r = base_c.getRed() / 255.0f;
+		f32 base_g = base_c.getGreen() / 255.0f;
+		f32 base_b = base_c.getBlue() / 255.0f;
+		base_c.set(base_c.getAlpha(),
+				(u32)((base_r < 0.5f ? 2 * base_r * blend_r : 1 - 2 * (1 - base_r) * (1 - blend_r)) * 255),
+				(u32)((base_g < 0.5f ? 2 * base_g * blend_g : 1 - 2 * (1 - base_g) * (1 - blend_g)) * 255),
+				(u32)((base_b < 0.5f ? 2 * base_b * blend_b : 1 - 2 * (1 - base_b) * (1 - blend_b)) * 255));
+		expected[i] = base_c.color;
+	}
+	image_overlay_row(blend.data(), base.data(), dst.data(), dst.size());
+	UASSERT(dst == expected);
+
+	// In place
+	dst = base;
+	image_overlay_row(blend.data(), dst.data(), dst.data(), dst.size());
+	UASSERT(dst == expected);
+}
@@ -0,0 +1,148 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+#include "client/fm_imagecache.h"
+#include "filesys.h"
+
+class TestFmImageCache : public TestBase
+{
+public:
+	TestFmImageCache() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmImageCache"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testRoundTrip();
+	void testTrim();
+
+private:
+	// Image of 64x64 pixels filled with value
+	void store(const ImageDiskCache &cache, const std::string &name, u8 value);
+	bool hit(const ImageDiskCache &cache, const std::string &name);
+	void setAge(const ImageDiskCache &cache, const std::string &name, int hours);
+};
+
+static TestFmImageCache g_test_instance;
+
+void TestFmImageCache::runTests(IGameDef *gamedef)
+{
+	TEST(testRoundTrip);
+	TEST(testTrim);
+}
+
+static u64 source_hash(const std::string &name)
+{
+	return name == "changed.png" ? 2 : 1;
+}
+
+void TestFmImageCache::store(const ImageDiskCache &cache, const std::string &name, u8 value)
+{
+	const std::vector<u8> pixels(64 * 64 * 4, value);
+	cache.write(name, {"a.png"}, source_hash, {64, 64}, pixels.data());
+}
+
+bool TestFmImageCache::hit(const ImageDiskCache &cache, const std::string &name)
+{
+	std::string data;
+	core::dimension2d<u32> dim;
+	std::set<std::string> sources;
+	return cache.read(name, source_hash, sources, data, dim) != 0;
+}
+
+void TestFmImageCache::setAge(const ImageDiskCache &cache, const std::string &name, int hours)
+{
+	std::filesystem::last_write_time(cache.getPath(cache.m_fingerprint + '\n' + name),
+			std::filesystem::file_time_type::clock::now() - std::chrono::hours(hours));
+}
+
+void TestFmImageCache::testRoundTrip()
+{
+	const std::string dir = getTestTempDirectory() + DIR_DELIM + "imagecache_round_trip";
+	fs::RecursiveDelete(dir);
+	{
+		const ImageDiskCache cache(dir, "filter=1;", 1024 * 1024);
+		u32 pixels[6];
+		for (u32 i = 0; i < 6; ++i)
+			pixels[i] = 0xff000000 | i * 0x10203;
+		cache.write("a.png^[invert:rgb", {"a.png", "changed.png"}, source_hash, {3, 2}, pixels);
+		UASSERT(cache.getSize() > sizeof(pixels));
+
+		std::string data;
+		core::dimension2d<u32> dim;
+		std::set<std::string> sources;
+		const size_t offset = cache.read("a.png^[invert:rgb", source_hash, sources, data, dim);
+		UASSERT(offset != 0);
+		UASSERT(dim == core::dimension2d<u32>(3, 2));
+		UASSERTEQ(size_t, data.size() - offset, sizeof(pixels));
+		UASSERT(!memcmp(data.data() + offset, pixels, sizeof(pixels)));
+		UASSERT(sources == std::set<std::string>({"a.png", "changed.png"}));
+
+		// Source image changed since
+		sources.clear();
+		UASSERT(!cache.read("a.png^[invert:rgb",
+				[](const std::string &name) -> u64 { return 1; }, sources, data, dim));
+		UASSERT(sources.empty());
+		UASSERT(!hit(cache, "a.png"));
+
+		// Another filter setting
+		const ImageDiskCache other(dir, "filter=0;", 1024 * 1024);
+		UASSERT(!hit(other, "a.png^[invert:rgb"));
+	}
+	fs::RecursiveDelete(dir);
+}
+
+void TestFmImageCache::testTrim()
+{
+	const std::string dir = getTestTempDirectory() + DIR_DELIM + "imagecache_trim";
+	fs::RecursiveDelete(dir);
+	u64 size = 0;
+	{
+		// Room for two images, the third one drops the one used longest ago
+		const ImageDiskCache cache(dir, "", 45000);
+		store(cache, "a", 1);
+		store(cache, "b", 2);
+		size = cache.getSize() / 2;
+		UASSERT(size > 64 * 64 * 4);
+		setAge(cache, "a", 2);
+		setAge(cache, "b", 1);
+		UASSERT(hit(cache, "a"));
+
+		store(cache, "c", 3);
+		UASSERTEQ(u64, cache.getSize(), size * 2);
+		UASSERT(hit(cache, "a"));
+		UASSERT(!hit(cache, "b"));
+		UASSERT(hit(cache, "c"));
+
+		// The same image again keeps the size
+		store(cache, "c", 4);
+		UASSERTEQ(u64, cache.getSize(), size * 2);
+	}
+	{
+		// Smaller limits on the next starts
+		const ImageDiskCache smaller(dir, "", 30000);
+		UASSERTEQ(u64, smaller.getSize(), size);
+		const ImageDiskCache smallest(dir, "", 15000);
+		UASSERTEQ(u64, smallest.getSize(), 0);
+	}
+	fs::RecursiveDelete(dir);
+}
@@ -0,0 +1,170 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <chrono>
+#include <future>
+#include <thread>
+#include "dummymap.h"
+#include "fm_light.h"
+#include "gamedef.h"
+#include "nodedef.h"
+
+class TestFmLight : public TestBase
+{
+public:
+	TestFmLight() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmLight"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testTorch(IGameDef *gamedef);
+	void testFarSources(IGameDef *gamedef);
+	void testBusyBlock(IGameDef *gamedef);
+	void testClusters();
+};
+
+static TestFmLight g_test_instance;
+
+void TestFmLight::runTests(IGameDef *gamedef)
+{
+	TEST(testTorch, gamedef);
+	TEST(testFarSources, gamedef);
+	TEST(testBusyBlock, gamedef);
+	TEST(testClusters);
+}
+
+static u8 night_light(Map &map, const NodeDefManager *ndef, const v3pos_t &p)
+{
+	const MapNode n = map.getNode(p);
+	return n.getLight(LIGHTBANK_NIGHT, ndef->getLightingFlags(n));
+}
+
+static void place_torch(Map &map, const NodeDefManager *ndef, const v3pos_t &p)
+{
+	MapNode n(t_CONTENT_TORCH);
+	n.setLight(LIGHTBANK_NIGHT, LIGHT_MAX, ndef->getLightingFlags(n));
+	map.setNode(p, n);
+}
+
+void TestFmLight::testTorch(IGameDef *gamedef)
+{
+	const v3bpos_t bpmin(-1, -1, -1), bpmax(1, 1, 1);
+	DummyMap map(gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	const NodeDefManager *ndef = gamedef->ndef();
+	std::map<v3bpos_t, MapBlock *> modified_blocks;
+
+	// Two torches, the light crosses block borders
+	place_torch(map, ndef, v3pos_t(0, 0, 0));
+	place_torch(map, ndef, v3pos_t(6, 0, 0));
+	LightPropagator propagator(&map, ndef);
+	UASSERT(propagator.spread(
+			LIGHTBANK_NIGHT, {v3pos_t(0, 0, 0), v3pos_t(6, 0, 0)}, modified_blocks));
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 1, 0)), 13);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(-3, -2, 0)), 9);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 0, -13)), 1);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 0, -14)), 0);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(3, 0, 0)), 11);
+	UASSERT(modified_blocks.size() > 1);
+
+	// Take the first one, the second one lights its place again
+	std::vector<v3pos_t> light_sources;
+	map.setNode(v3pos_t(0, 0, 0), MapNode(CONTENT_AIR));
+	propagator.unspread(LIGHTBANK_NIGHT, {{v3pos_t(0, 0, 0), LIGHT_MAX}}, light_sources,
+			modified_blocks);
+	UASSERT(!light_sources.empty());
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(-3, -2, 0)), 0);
+	propagator.spread(LIGHTBANK_NIGHT, light_sources, modified_blocks);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 0, 0)), 8);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(-3, -2, 0)), 3);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 0, -13)), 0);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(6, 0, 0)), LIGHT_MAX);
+}
+
+void TestFmLight::testFarSources(IGameDef *gamedef)
+{
+	// Further apart than one region, done in two passes
+	const v3bpos_t bpmin(-1, -1, -1), bpmax(40, 1, 1);
+	DummyMap map(gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	const NodeDefManager *ndef = gamedef->ndef();
+	std::map<v3bpos_t, MapBlock *> modified_blocks;
+
+	const v3pos_t p_near(0, 0, 0), p_far(39 * MAP_BLOCKSIZE, 0, 0);
+	place_torch(map, ndef, p_near);
+	place_torch(map, ndef, p_far);
+	LightPropagator propagator(&map, ndef);
+	UASSERT(propagator.spread(LIGHTBANK_NIGHT, {p_near, p_far}, modified_blocks));
+	UASSERTEQ(int, night_light(map, ndef, p_near + v3pos_t(0, 0, 5)), 9);
+	UASSERTEQ(int, night_light(map, ndef, p_far + v3pos_t(0, 0, 5)), 9);
+	UASSERTEQ(int, night_light(map, ndef, p_far - v3pos_t(13, 0, 0)), 1);
+}
+
+void TestFmLight::testBusyBlock(IGameDef *gamedef)
+{
+	const v3bpos_t bpmin(-1, -1, -1), bpmax(1, 1, 1);
+	DummyMap map(gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	const NodeDefManager *ndef = gamedef->ndef();
+	std::map<v3bpos_t, MapBlock *> modified_blocks;
+
+	const v3pos_t p(0, 0, 0);
+	place_torch(map, ndef, p);
+	LightPropagator propagator(&map, ndef);
+	propagator.spreadRaw(LIGHTBANK_NIGHT, {{p, LIGHT_MAX}}, modified_blocks);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 1, 0)), 13);
+
+	// The torch is taken while another thread has its block locked, its
+	// light goes all the same once the block is free
+	map.setNode(p, MapNode(CONTENT_AIR));
+	MapBlock *block = map.getBlockNoCreateNoEx(getNodeBlockPos(p));
+	std::promise<void> locked;
+	std::thread other([&] {
+		const auto lock = block->lock_unique_rec();
+		locked.set_value();
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	});
+	locked.get_future().wait();
+	propagator.unspreadRaw(LIGHTBANK_NIGHT, {{p, LIGHT_MAX}},
+			[](u8, const v3pos_t &, const v3bpos_t &, MapBlock *) {}, modified_blocks);
+	other.join();
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 1, 0)), 0);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(-3, -2, 0)), 0);
+	UASSERTEQ(int, night_light(map, ndef, v3pos_t(0, 0, -12)), 0);
+}
+
+void TestFmLight::testClusters()
+{
+	const std::vector<v3bpos_t> blocks{{0, 0, 0}, {10, 5, 0}, {0, 5, 3}, {3, -8, 5},
+			{10, 0, 3}, {20, 0, 20}, {0, 9, 0}};
+	const auto clusters = light_clusters(blocks);
+	UASSERTEQ(size_t, clusters.size(), 3);
+
+	// Chained through 0,5,3, top to bottom
+	const std::vector<v3bpos_t> first{{0, 9, 0}, {0, 5, 3}, {0, 0, 0}, {3, -8, 5}};
+	UASSERT(clusters[0] == first);
+	const std::vector<v3bpos_t> second{{10, 5, 0}, {10, 0, 3}};
+	UASSERT(clusters[1] == second);
+	UASSERTEQ(size_t, clusters[2].size(), 1);
+
+	size_t total = 0;
+	for (const auto &cluster : clusters)
+		total += cluster.size();
+	UASSERTEQ(size_t, total, blocks.size());
+}
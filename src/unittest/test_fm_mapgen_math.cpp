@@ -0,0 +1,128 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <cmath>
+#include <vector>
+#include "mapgen/mapgen_math.h"
+
+class TestFmMapgenMath : public TestBase
+{
+public:
+	TestFmMapgenMath() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmMapgenMath"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBatch();
+	void testBox();
+};
+
+static TestFmMapgenMath g_test_instance;
+
+void TestFmMapgenMath::runTests(IGameDef *gamedef)
+{
+	TEST(testBatch);
+	TEST(testBox);
+}
+
+namespace
+{
+struct Fractal
+{
+	double (*de)(double, double, double, int);
+	MapgenMath::de_batch_func batch;
+	MapgenMath::de_box_func box;
+	int iterations;
+	// Node size in fractal space, the grids cross the surface
+	float step;
+};
+
+const Fractal fractals[] = {
+		{mandelbox_de, mandelbox_de_batch, mandelbox_de_box, 15, 1.0f / 1000},
+		{mengersponge_de, mengersponge_de_batch, mengersponge_de_box, 13, 1.0f / 100},
+		{sphere_de, sphere_de_batch, sphere_de_box, 1, 1.0f / 100},
+};
+
+// Cube of n^3 nodes from p, z, x, y order like MapgenMath::evaluateBox
+void grid(v3f p, float step, int n, std::vector<double> &x, std::vector<double> &y,
+		std::vector<double> &z)
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	for (int k = 0; k < n; k++)
+	for (int i = 0; i < n; i++)
+	for (int j = 0; j < n; j++) {
+		x.push_back(p.X + i * step);
+		y.push_back(p.Y + j * step);
+		z.push_back(p.Z + k * step);
+	}
+}
+}
+
+void TestFmMapgenMath::testBatch()
+{
+	std::vector<double> x, y, z;
+	for (const auto &f : fractals) {
+		// Odd count, the last block of lanes is short
+		grid(v3f(0.2f, -0.3f, 0.4f), f.step * 3, 21, x, y, z);
+		std::vector<double> out(x.size());
+		f.batch(x.data(), y.data(), z.data(), out.data(), x.size(), f.iterations);
+		for (size_t i = 0; i < x.size(); i++)
+			UASSERT(out[i] == f.de(x[i], y[i], z[i], f.iterations));
+	}
+}
+
+void TestFmMapgenMath::testBox()
+{
+	constexpr int n = 8;
+	std::vector<double> x, y, z;
+	size_t bounded = 0;
+	for (const auto &f : fractals) {
+		for (const float start : {-0.9f, -0.5f, -0.1f, 0.3f, 0.7f})
+		for (const int size : {1, 2, 4, 8}) {
+			const v3f p(start, start * 0.7f, 0.2f - start);
+			const float step = f.step * 16 / size;
+			grid(p, step, n, x, y, z);
+			std::vector<double> out(x.size());
+			f.batch(x.data(), y.data(), z.data(), out.data(), x.size(), f.iterations);
+
+			// Every box of size^3 nodes bounds the estimate of its nodes
+			for (int bz = 0; bz < n; bz += size)
+			for (int bx = 0; bx < n; bx += size)
+			for (int by = 0; by < n; by += size) {
+				const size_t first = ((size_t)bz * n + bx) * n + by;
+				const size_t last = ((size_t)(bz + size - 1) * n + bx + size - 1) * n +
+									by + size - 1;
+				const auto [lo, hi] = f.box(v3f(x[first], y[first], z[first]),
+						v3f(x[last], y[last], z[last]), f.iterations);
+				UASSERT(lo <= hi);
+				bounded += std::isfinite(hi);
+				for (int k = bz; k < bz + size; k++)
+				for (int i = bx; i < bx + size; i++)
+				for (int j = by; j < by + size; j++) {
+					const double de = out[((size_t)k * n + i) * n + j];
+					UASSERT(de >= lo && de <= hi);
+				}
+			}
+		}
+	}
+	// Boxes away from the surface have finite bounds
+	UASSERT(bounded > 0);
+}
@@ -0,0 +1,233 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "dummymap.h"
+#include "gamedef.h"
+#include "mapgen/mapgen.h"
+#include "mapgen/mg_ore.h"
+#include "mapgen/mg_tiles.h"
+#include "noise.h"
+
+class TestFmMgTiles : public TestBase
+{
+public:
+	TestFmMgTiles() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmMgTiles"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testCoverage();
+	void testPassesApart();
+	void testOddSize();
+	void testDeterministic();
+	void testException();
+	void testScatterOre(IGameDef *gamedef);
+};
+
+static TestFmMgTiles g_test_instance;
+
+void TestFmMgTiles::runTests(IGameDef *gamedef)
+{
+	TEST(testCoverage);
+	TEST(testPassesApart);
+	TEST(testOddSize);
+	TEST(testDeterministic);
+	TEST(testException);
+	TEST(testScatterOre, gamedef);
+}
+
+static const v3pos_t nmin(-32, -32, -32);
+static const v3pos_t nmax(47, 47, 47);
+
+void TestFmMgTiles::testCoverage()
+{
+	UASSERTEQ(size_t, TilePlacer::getTileCount(nmin, nmax), 25);
+
+	TilePlacer placer(4);
+	std::vector<std::atomic<int>> columns(80 * 80);
+	std::vector<std::atomic<int>> tiles(25);
+	placer.run(nmin, nmax, [&](size_t tile, v2pos_t tmin, v2pos_t tmax) {
+		UASSERT(tile < tiles.size());
+		tiles[tile]++;
+		UASSERTEQ(pos_t, tmax.X - tmin.X + 1, TilePlacer::TILE_SIZE);
+		UASSERTEQ(pos_t, tmax.Y - tmin.Y + 1, TilePlacer::TILE_SIZE);
+		for (pos_t z = tmin.Y; z <= tmax.Y; z++)
+		for (pos_t x = tmin.X; x <= tmax.X; x++)
+			columns[(z - nmin.Z) * 80 + (x - nmin.X)]++;
+	});
+
+	for (const auto &count : tiles)
+		UASSERTEQ(int, count, 1);
+	for (const auto &count : columns)
+		UASSERTEQ(int, count, 1);
+}
+
+void TestFmMgTiles::testPassesApart()
+{
+	// Tiles running at the same time are at least one tile apart
+	TilePlacer placer(8);
+	std::mutex lock;
+	std::vector<v2pos_t> running;
+	bool overlap = false;
+	placer.run(nmin, nmax, [&](size_t tile, v2pos_t tmin, v2pos_t tmax) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for (const v2pos_t &other : running) {
+				if (std::abs(other.X - tmin.X) < 2 * TilePlacer::TILE_SIZE &&
+						std::abs(other.Y - tmin.Y) < 2 * TilePlacer::TILE_SIZE)
+					overlap = true;
+			}
+			running.push_back(tmin);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::lock_guard<std::mutex> guard(lock);
+		running.erase(std::find(running.begin(), running.end(), tmin));
+	});
+	UASSERT(!overlap);
+}
+
+void TestFmMgTiles::testOddSize()
+{
+	const v3pos_t odd_max(nmin.X + 39, nmax.Y, nmin.Z + 39);
+	UASSERTEQ(size_t, TilePlacer::getTileCount(nmin, odd_max), 1);
+
+	TilePlacer placer(4);
+	int calls = 0;
+	placer.run(nmin, odd_max, [&](size_t tile, v2pos_t tmin, v2pos_t tmax) {
+		calls++;
+		UASSERTEQ(size_t, tile, 0);
+		UASSERT(tmin == v2pos_t(nmin.X, nmin.Z));
+		UASSERT(tmax == v2pos_t(odd_max.X, odd_max.Z));
+	});
+	UASSERTEQ(int, calls, 1);
+}
+
+void TestFmMgTiles::testDeterministic()
+{
+	// Same result for any number of threads
+	auto place = [](size_t threads) {
+		TilePlacer placer(threads);
+		std::vector<u32> out(80 * 80);
+		placer.run(nmin, nmax, [&](size_t tile, v2pos_t tmin, v2pos_t tmax) {
+			PcgRandom pr(TilePlacer::getTileSeed(1234, tmin));
+			for (pos_t z = tmin.Y; z <= tmax.Y; z++)
+			for (pos_t x = tmin.X; x <= tmax.X; x++)
+				out[(z - nmin.Z) * 80 + (x - nmin.X)] = pr.next();
+		});
+		return out;
+	};
+
+	const auto expected = place(1);
+	UASSERT(place(3) == expected);
+	UASSERT(place(8) == expected);
+}
+
+void TestFmMgTiles::testException()
+{
+	TilePlacer placer(4);
+	std::atomic<int> calls = 0;
+	bool thrown = false;
+	try {
+		placer.run(nmin, nmax, [&](size_t tile, v2pos_t tmin, v2pos_t tmax) {
+			calls++;
+			if (tile == 0)
+				throw std::runtime_error("tile");
+		});
+	} catch (const std::runtime_error &) {
+		thrown = true;
+	}
+	UASSERT(thrown);
+	// The pass of the failing tile is finished, later ones are not started
+	UASSERTEQ(int, calls, 9);
+}
+
+void TestFmMgTiles::testScatterOre(IGameDef *gamedef)
+{
+	DummyMap map(gamedef, getNodeBlockPos(nmin), getNodeBlockPos(nmax));
+	MMVManip vm(&map);
+	vm.initialEmerge(getNodeBlockPos(nmin), getNodeBlockPos(nmax), false);
+
+	Mapgen mg;
+	mg.vm = &vm;
+	mg.ndef = gamedef->ndef();
+
+	OreManager oremgr(gamedef);
+	auto ore = static_cast<OreScatter *>(OreManager::create(ORE_SCATTER));
+	ore->c_ore = t_CONTENT_BRICK;
+	ore->c_wherein = {t_CONTENT_STONE};
+	ore->clust_size = 6;
+	ore->clust_num_ores = 6 * 6 * 6;
+	ore->y_min = nmin.Y;
+	ore->y_max = nmax.Y;
+	ore->ore_param2 = 0;
+	oremgr.add(ore);
+
+	auto place = [&](TilePlacer *placer, u32 seed) {
+		const u32 volume = vm.m_area.getVolume();
+		for (u32 i = 0; i < volume; i++)
+			vm.m_data[i] = MapNode(t_CONTENT_STONE);
+		mg.tile_placer = placer;
+		oremgr.placeAllOres(&mg, seed, nmin, nmax);
+		mg.tile_placer = nullptr;
+		std::vector<content_t> out;
+		for (u32 i = 0; i < volume; i++)
+			out.push_back(vm.m_data[i].getContent());
+		return out;
+	};
+
+	TilePlacer placer(4);
+
+	// One full cluster per chunk: its position is the first draw in both
+	// modes, so tiles must place exactly the serial cluster, also across
+	// a tile border, and no others
+	ore->clust_scarcity = 80 * 80 * 80;
+	int crossing = 0;
+	for (u32 seed = 0; seed < 20; seed++) {
+		const auto serial = place(nullptr, seed);
+		UASSERTEQ(size_t, std::count(serial.begin(), serial.end(),
+				t_CONTENT_BRICK), 6 * 6 * 6);
+		UASSERT(place(&placer, seed) == serial);
+
+		// The first brick in index order is the cluster corner
+		const v3s32 ext = vm.m_area.getExtent();
+		const size_t i = std::find(serial.begin(), serial.end(), t_CONTENT_BRICK) -
+				serial.begin();
+		const pos_t x0 = vm.m_area.MinEdge.X + i % ext.X;
+		const pos_t z0 = vm.m_area.MinEdge.Z + i / (ext.X * ext.Y);
+		if ((x0 - nmin.X) % TilePlacer::TILE_SIZE > TilePlacer::TILE_SIZE - 6 ||
+				(z0 - nmin.Z) % TilePlacer::TILE_SIZE > TilePlacer::TILE_SIZE - 6)
+			crossing++;
+	}
+	UASSERT(crossing > 0);
+
+	// Many clusters, the same for any number of threads
+	ore->clust_scarcity = 16 * 16 * 16;
+	const auto expected = place(&placer, 1234);
+	TilePlacer single(1);
+	UASSERT(place(&single, 1234) == expected);
+	UASSERT(std::count(expected.begin(), expected.end(), t_CONTENT_BRICK) > 0);
+}
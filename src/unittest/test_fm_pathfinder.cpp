@@ -0,0 +1,200 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include <cmath>
+#include <cstdlib>
+#include "dummymap.h"
+#include "fm_pathfinder.h"
+#include "gamedef.h"
+#include "nodedef.h"
+
+class TestFmPathfinder : public TestBase
+{
+public:
+	TestFmPathfinder() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmPathfinder"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testHills(IGameDef *gamedef);
+	void testWall(IGameDef *gamedef);
+	void testCancel(IGameDef *gamedef);
+
+private:
+	// Path has allowed steps on the surface from source to destination
+	void checkPath(Map &map, const NodeDefManager *ndef, const PathRequest &request,
+			const std::vector<v3pos_t> &path);
+	// Same length as the plain A* path
+	void checkOptimal(Map &map, const NodeDefManager *ndef, PathNavigator &navigator,
+			const PathRequest &request);
+};
+
+static TestFmPathfinder g_test_instance;
+
+void TestFmPathfinder::runTests(IGameDef *gamedef)
+{
+	TEST(testHills, gamedef);
+	TEST(testWall, gamedef);
+	TEST(testCancel, gamedef);
+}
+
+static PathRequest make_request(const v3pos_t &source, const v3pos_t &destination)
+{
+	PathRequest request;
+	request.source = source;
+	request.destination = destination;
+	request.searchdistance = 16;
+	request.max_jump = 1;
+	request.max_drop = 2;
+	request.algo = PA_HIERARCHICAL;
+	return request;
+}
+
+void TestFmPathfinder::checkPath(Map &map, const NodeDefManager *ndef,
+		const PathRequest &request, const std::vector<v3pos_t> &path)
+{
+	UASSERT(!path.empty());
+	UASSERT(path.front() == request.source);
+	UASSERT(path.back() == request.destination);
+	for (size_t i = 1; i < path.size(); ++i) {
+		const v3pos_t step = path[i] - path[i - 1];
+		UASSERTEQ(int, std::abs(step.X) + std::abs(step.Z), 1);
+		UASSERT(step.Y <= (int)request.max_jump && -step.Y <= (int)request.max_drop);
+		UASSERT(!ndef->get(map.getNode(path[i])).walkable);
+		UASSERT(ndef->get(map.getNode(path[i] + v3pos_t(0, -1, 0))).walkable);
+	}
+}
+
+void TestFmPathfinder::checkOptimal(Map &map, const NodeDefManager *ndef,
+		PathNavigator &navigator, const PathRequest &request)
+{
+	const auto path = navigator.getPath(request);
+	checkPath(map, ndef, request, path);
+	const auto plain = get_path(&map, ndef, request.source, request.destination,
+			request.searchdistance, request.max_jump, request.max_drop, PA_PLAIN_NP);
+	UASSERTEQ(size_t, path.size(), plain.size());
+}
+
+// Rolling hills with 1 node steps and some pillars
+static pos_t hill_height(pos_t x, pos_t z)
+{
+	return std::round(2 * std::sin(x / 7.0) + 2 * std::cos(z / 5.0));
+}
+
+static bool hill_pillar(pos_t x, pos_t z)
+{
+	return x % 7 == 0 && z % 5 == 0;
+}
+
+void TestFmPathfinder::testHills(IGameDef *gamedef)
+{
+	const v3bpos_t bpmin(-2, -1, -2), bpmax(1, 0, 1);
+	DummyMap map(gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	const NodeDefManager *ndef = gamedef->ndef();
+	for (pos_t z = -32; z < 32; ++z)
+		for (pos_t x = -32; x < 32; ++x) {
+			const pos_t top = hill_height(x, z) + (hill_pillar(x, z) ? 3 : 0);
+			for (pos_t y = -MAP_BLOCKSIZE; y <= top; ++y)
+				map.setNode({x, y, z}, MapNode(t_CONTENT_STONE));
+		}
+	const auto surface = [](pos_t x, pos_t z) {
+		return v3pos_t(x, hill_height(x, z) + 1, z);
+	};
+
+	PathNavigator navigator(&map, ndef, 0);
+	const pos_t points[][4] = {
+			{-30, -29, 29, 28},
+			{-25, 27, 26, -30},
+			{3, 1, -20, 22},
+			{-6, -17, 11, 18},
+	};
+	for (const auto &p : points) {
+		const auto request = make_request(surface(p[0], p[1]), surface(p[2], p[3]));
+		checkOptimal(map, ndef, navigator, request);
+		// Again from the cached corridor
+		checkOptimal(map, ndef, navigator, request);
+	}
+	UASSERT(navigator.getStats().corridor_hits > 0);
+}
+
+void TestFmPathfinder::testWall(IGameDef *gamedef)
+{
+	const v3bpos_t bpmin(-2, -1, -2), bpmax(1, 0, 1);
+	DummyMap map(gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	const NodeDefManager *ndef = gamedef->ndef();
+	for (pos_t z = -32; z < 32; ++z)
+		for (pos_t x = -32; x < 32; ++x)
+			map.setNode({x, -1, z}, MapNode(t_CONTENT_STONE));
+
+	// Wall across the area with a gap in another block than the one of
+	// the straight line
+	for (pos_t z = -32; z < 32; ++z)
+		for (pos_t y = 0; y < 3; ++y)
+			if (z < -8 || z > -5)
+				map.setNode({0, y, z}, MapNode(t_CONTENT_STONE));
+
+	PathNavigator navigator(&map, ndef, 0);
+	const auto request = make_request({-10, 0, -20}, {10, 0, -20});
+	checkOptimal(map, ndef, navigator, request);
+
+	// Closing the gap invalidates the cached blocks
+	for (pos_t z = -8; z <= -5; ++z) {
+		map.setNode({0, 0, z}, MapNode(t_CONTENT_STONE));
+		map.setNode({0, 1, z}, MapNode(t_CONTENT_STONE));
+	}
+	navigator.invalidateBlock(getNodeBlockPos(v3pos_t(0, 0, -8)));
+	UASSERT(navigator.getPath(request).empty());
+}
+
+void TestFmPathfinder::testCancel(IGameDef *gamedef)
+{
+	const v3bpos_t bpmin(-1, -1, -1), bpmax(0, 0, 0);
+	DummyMap map(gamedef, bpmin, bpmax);
+	map.fill(bpmin, bpmax, MapNode(CONTENT_AIR));
+	const NodeDefManager *ndef = gamedef->ndef();
+	for (pos_t z = -16; z < 16; ++z)
+		for (pos_t x = -16; x < 16; ++x)
+			map.setNode({x, -1, z}, MapNode(t_CONTENT_STONE));
+
+	PathNavigator navigator(&map, ndef, 2);
+	const auto request = make_request({-10, 0, -10}, {10, 0, 10});
+	size_t found = 0, cancelled = 0;
+	const auto callback = [&](std::vector<v3pos_t> &&path, bool is_cancelled) {
+		if (is_cancelled) {
+			UASSERT(path.empty());
+			++cancelled;
+		} else {
+			checkPath(map, ndef, request, path);
+			++found;
+		}
+	};
+	navigator.queuePath(request, callback);
+	while (!navigator.deliverResults())
+		;
+	UASSERTEQ(size_t, found, 1);
+
+	// Every pending request is called back once
+	for (int i = 0; i < 16; ++i)
+		navigator.queuePath(request, callback);
+	navigator.cancel();
+	UASSERTEQ(size_t, found + cancelled, 17);
+	UASSERTEQ(size_t, navigator.deliverResults(), 0);
+}
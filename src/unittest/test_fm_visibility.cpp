@@ -0,0 +1,109 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "fm_visibility.h"
+
+class TestFmVisibility : public TestBase
+{
+public:
+	TestFmVisibility() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmVisibility"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testConnectivity();
+	void testVisibleCells();
+};
+
+static TestFmVisibility g_test_instance;
+
+void TestFmVisibility::runTests(IGameDef *gamedef)
+{
+	TEST(testConnectivity);
+	TEST(testVisibleCells);
+}
+
+void TestFmVisibility::testConnectivity()
+{
+	const uint16_t side = 8;
+	std::vector<uint8_t> opaque(side * side * side, 1);
+	UASSERTEQ(int, face_connectivity(opaque, side), 0);
+
+	const auto set_open = [&](int x, int y, int z) {
+		opaque[(z * side + y) * side + x] = 0;
+	};
+	// Tunnel along X
+	for (int x = 0; x < side; ++x)
+		set_open(x, 3, 3);
+	auto connectivity = face_connectivity(opaque, side);
+	UASSERT(faces_connected(connectivity, 0, 1));
+	UASSERT(!faces_connected(connectivity, 0, 2));
+	UASSERT(!faces_connected(connectivity, 4, 5));
+
+	// Shaft up from the middle of it
+	for (int y = 3; y < side; ++y)
+		set_open(4, y, 3);
+	connectivity = face_connectivity(opaque, side);
+	UASSERT(faces_connected(connectivity, 0, 3));
+	UASSERT(faces_connected(connectivity, 3, 1));
+	UASSERT(!faces_connected(connectivity, 2, 3));
+
+	// Separate pocket on -Z and +Z does not join the others
+	for (int z = 0; z < side; ++z)
+		set_open(0, 0, z);
+	connectivity = face_connectivity(opaque, side);
+	UASSERT(faces_connected(connectivity, 4, 5));
+	UASSERT(!faces_connected(connectivity, 1, 5));
+
+	std::fill(opaque.begin(), opaque.end(), 0);
+	UASSERTEQ(int, face_connectivity(opaque, side), FACES_ALL_CONNECTED);
+}
+
+void TestFmVisibility::testVisibleCells()
+{
+	// Solid world with a tunnel along +X from the camera
+	const auto tunnel = faces_pair_bit(0, 1);
+	const auto connectivity = [&](const v3bpos_t &pos) -> face_connectivity_t {
+		if (pos.Y == 0 && pos.Z == 0 && pos.X >= 0)
+			return 1 << tunnel;
+		return 0;
+	};
+
+	unordered_set_v3bpos visible;
+	visible_cells({0, 0, 0}, 1, 10, connectivity, visible);
+	UASSERT(visible.contains({0, 0, 0}));
+	UASSERT(visible.contains({5, 0, 0}));
+	UASSERT(visible.contains({10, 0, 0}));
+	UASSERT(!visible.contains({11, 0, 0}));
+	// Cells around the camera are seen, not the ones behind them or
+	// beside the tunnel
+	UASSERT(visible.contains({0, 1, 0}));
+	UASSERT(!visible.contains({0, 2, 0}));
+	UASSERT(!visible.contains({-2, 0, 0}));
+	UASSERT(!visible.contains({5, 0, 1}));
+	UASSERTEQ(size_t, visible.size(), 16);
+
+	// Open everywhere, the whole range with mesh cells of 2 blocks
+	visible.clear();
+	visible_cells({0, 0, 0}, 2, 3,
+			[](const v3bpos_t &) { return FACES_ALL_CONNECTED; }, visible);
+	UASSERTEQ(size_t, visible.size(), 7 * 7 * 7);
+	UASSERT(visible.contains({-6, 6, 2}));
+	UASSERT(!visible.contains({1, 0, 0}));
+}
@@ -0,0 +1,185 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test.h"
+
+#include "fm_weather_grid.h"
+#include "mapblock.h"
+
+class TestFmWeatherGrid : public TestBase
+{
+public:
+	TestFmWeatherGrid() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestFmWeatherGrid"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testTrack(IGameDef *gamedef);
+	void testDiffusion(IGameDef *gamedef);
+	void testOrder(IGameDef *gamedef);
+	void testRemoveInPass(IGameDef *gamedef);
+};
+
+static TestFmWeatherGrid g_test_instance;
+
+void TestFmWeatherGrid::runTests(IGameDef *gamedef)
+{
+	TEST(testTrack, gamedef);
+	TEST(testDiffusion, gamedef);
+	TEST(testOrder, gamedef);
+	TEST(testRemoveInPass, gamedef);
+}
+
+static MapBlockPtr make_block(IGameDef *gamedef, const v3bpos_t &pos, short heat)
+{
+	auto block = std::make_shared<MapBlock>(pos, gamedef);
+	block->setGenerated(true);
+	block->heat = heat;
+	block->humidity = 50;
+	return block;
+}
+
+static void no_base(const v3bpos_t &pos, WeatherGrid::base_t &base)
+{
+	base.heat = 20;
+	base.humidity = 50;
+}
+
+void TestFmWeatherGrid::testTrack(IGameDef *gamedef)
+{
+	WeatherGrid grid;
+	const auto a = make_block(gamedef, {0, 0, 0}, 20);
+	grid.add(a);
+	UASSERTEQ(size_t, grid.getBlocks(), 0);
+
+	grid.enable();
+	grid.add(a);
+	grid.add(make_block(gamedef, {7, 7, 7}, 20));
+	grid.add(make_block(gamedef, {-1, 0, 0}, 20));
+	UASSERTEQ(size_t, grid.getBlocks(), 3);
+	UASSERTEQ(size_t, grid.getRegions(), 2);
+
+	// Loaded again, the old block goes later
+	const auto again = make_block(gamedef, {0, 0, 0}, 20);
+	grid.add(again);
+	grid.remove(a);
+	UASSERTEQ(size_t, grid.getBlocks(), 3);
+	grid.remove(again);
+	UASSERTEQ(size_t, grid.getBlocks(), 2);
+
+	grid.disable();
+	UASSERTEQ(size_t, grid.getBlocks(), 0);
+	UASSERTEQ(size_t, grid.getRegions(), 0);
+}
+
+void TestFmWeatherGrid::testDiffusion(IGameDef *gamedef)
+{
+	WeatherGrid grid;
+	grid.enable();
+	// Across a region border
+	const auto hot = make_block(gamedef, {7, 0, 0}, 60);
+	const auto cold = make_block(gamedef, {8, 0, 0}, -20);
+	const auto alone = make_block(gamedef, {30, 0, 0}, 60);
+	grid.add(hot);
+	grid.add(cold);
+	grid.add(alone);
+
+	size_t active = 0;
+	UASSERTEQ(size_t, grid.step(0, 10, U64_MAX, 100, no_base, active), 0);
+	UASSERTEQ(size_t, active, 3);
+	const int hot_heat = hot->heat + hot->heat_add;
+	const int cold_heat = cold->heat + cold->heat_add;
+	const int alone_heat = alone->heat + alone->heat_add;
+	UASSERT(hot_heat < 60);
+	UASSERT(cold_heat > -20);
+	// Only pulled to the mapgen climate
+	UASSERT(alone_heat < 60 && alone_heat > hot_heat);
+	UASSERTEQ(u32, (u32)hot->heat_last_update, 100);
+
+	// Lower pressure over the hot block pulls the wind to it
+	UASSERT(cold->wind.X < 0);
+
+	grid.remove(cold);
+	grid.step(0, 10, U64_MAX, 200, no_base, active);
+	UASSERTEQ(size_t, active, 2);
+	UASSERTEQ(u32, (u32)cold->heat_last_update, 100);
+}
+
+void TestFmWeatherGrid::testOrder(IGameDef *gamedef)
+{
+	// A row over three regions, stepped at once and one region a call
+	// in the other order
+	WeatherGrid whole, parts;
+	whole.enable();
+	parts.enable();
+	std::vector<MapBlockPtr> whole_blocks, parts_blocks;
+	for (bpos_t x = 6; x < 18; ++x) {
+		const short heat = x % 3 ? 60 : -20;
+		whole_blocks.push_back(make_block(gamedef, {x, 0, 0}, heat));
+		parts_blocks.push_back(make_block(gamedef, {x, 0, 0}, heat));
+		whole.add(whole_blocks.back());
+	}
+	for (auto it = parts_blocks.rbegin(); it != parts_blocks.rend(); ++it)
+		parts.add(*it);
+
+	size_t active = 0;
+	for (int i = 0; i < 3; ++i) {
+		whole.step(0, 10, U64_MAX, 100, no_base, active);
+		size_t cursor = 0, stepped = 0;
+		do {
+			cursor = parts.step(cursor, 10, 0, 100, no_base, active);
+			stepped += active;
+		} while (cursor);
+		UASSERTEQ(size_t, stepped, whole_blocks.size());
+	}
+	for (size_t i = 0; i < whole_blocks.size(); ++i) {
+		UASSERTEQ(int, whole_blocks[i]->heat + whole_blocks[i]->heat_add,
+				parts_blocks[i]->heat + parts_blocks[i]->heat_add);
+		UASSERT(whole_blocks[i]->wind.X == parts_blocks[i]->wind.X);
+	}
+}
+
+void TestFmWeatherGrid::testRemoveInPass(IGameDef *gamedef)
+{
+	// One block in each of three regions, stepped one region a call
+	WeatherGrid grid;
+	grid.enable();
+	std::vector<MapBlockPtr> blocks;
+	for (bpos_t x = 0; x < 3; ++x) {
+		blocks.push_back(make_block(gamedef, {x * WeatherGrid::REGION_SIZE, 0, 0}, 20));
+		grid.add(blocks.back());
+	}
+
+	size_t active = 0;
+	size_t cursor = grid.step(0, 10, 0, 100, no_base, active);
+	UASSERTEQ(size_t, cursor, 1);
+
+	// The region stepped already is emptied, the rest of the pass still
+	// gets both others
+	grid.remove(blocks[0]);
+	do {
+		cursor = grid.step(cursor, 10, 0, 100, no_base, active);
+	} while (cursor);
+	for (const auto &block : blocks)
+		UASSERTEQ(u32, (u32)block->heat_last_update, 100);
+	UASSERTEQ(size_t, grid.getRegions(), 2);
+
+	grid.step(0, 10, U64_MAX, 200, no_base, active);
+	UASSERTEQ(size_t, active, 2);
+	UASSERTEQ(u32, (u32)blocks[0]->heat_last_update, 100);
+	UASSERTEQ(u32, (u32)blocks[2]->heat_last_update, 200);
+}
@@ -6,11 +6,14 @@
 
 #include "test.h"
 
+#include <cstdio>
 #include <functional>
 #include <memory>
 #include <optional>
 #include "database/database-dummy.h"
+#include "database/database-mmap.h"
 #include "database/database-sqlite3.h"
+#include "filesys.h"
 #if USE_LEVELDB
 #include "database/database-leveldb.h"
 #endif
@@ -70,9 +73,13 @@ class TestMapDatabase : public TestBase
 
 	void testSave();
 	void testLoad();
+	void testLoadArea();
 	void testList(int expect);
 	void testRemove();
 	void testPositionEncoding();
+	void testMortonEncoding();
+	void testKeyLayout(const std::string &dir);
+	void testMmapRecovery(const std::string &dir);
 
 private:
 	MapDatabaseProvider *provider = nullptr;
@@ -92,6 +99,7 @@ void TestMapDatabase::runTests(IGameDef *gamedef)
 	sanity_check(!test_data.empty());
 
 	TEST(testPositionEncoding);
+	TEST(testMortonEncoding);
 
 	rawstream << "-------- Dummy" << std::endl;
 
@@ -111,6 +119,15 @@ void TestMapDatabase::runTests(IGameDef *gamedef)
 	runTestsForCurrentDB();
 	delete provider;
 
+	rawstream << "-------- SQLite3 (morton)" << std::endl;
+
+	const std::string morton_dir = test_dir + DIR_DELIM + "morton";
+	provider = new MapDatabaseProvider([&] () {
+		return new MapDatabaseSQLite3(morton_dir, true);
+	});
+	runTestsForCurrentDB();
+	delete provider;
+
 #if USE_LEVELDB
 	rawstream << "-------- LevelDB" << std::endl;
 
@@ -119,6 +136,28 @@ void TestMapDatabase::runTests(IGameDef *gamedef)
 	});
 	runTestsForCurrentDB();
 	delete provider;
+
+	rawstream << "-------- LevelDB (morton)" << std::endl;
+
+	provider = new MapDatabaseProvider([&] () {
+		return new Database_LevelDB(morton_dir, true);
+	});
+	runTestsForCurrentDB();
+	delete provider;
+#endif
+
+	TEST(testKeyLayout, test_dir + DIR_DELIM + "layout");
+
+#if USE_MMAP_DATABASE
+	rawstream << "-------- Mmap" << std::endl;
+
+	provider = new MapDatabaseProvider([&] () {
+		return new MapDatabaseMmap(test_dir);
+	});
+	runTestsForCurrentDB();
+	delete provider;
+
+	TEST(testMmapRecovery, test_dir + DIR_DELIM + "mmap_recovery");
 #endif
 
 #if USE_POSTGRESQL
@@ -142,6 +181,7 @@ void TestMapDatabase::runTestsForCurrentDB()
 	// order-sensitive
 	TEST(testSave);
 	TEST(testLoad);
+	TEST(testLoadArea);
 	TEST(testList, 1);
 	TEST(testRemove);
 	TEST(testList, 0);
@@ -175,6 +215,21 @@ void TestMapDatabase::testLoad()
 	}
 }
 
+void TestMapDatabase::testLoadArea()
+{
+	auto *db = provider->get();
+	std::vector<std::pair<v3bpos_t, std::string>> dest;
+
+	db->loadBlocksArea({-1, 0, -2}, {3, 2, 3}, dest);
+	UASSERTEQ(size_t, dest.size(), 1);
+	UASSERT(dest.front().first == v3bpos_t(1, 2, 3));
+	UASSERT(dest.front().second == test_data);
+
+	dest.clear();
+	db->loadBlocksArea({2, 2, 2}, {5, 5, 5}, dest);
+	UASSERT(dest.empty());
+}
+
 void TestMapDatabase::testList(int expect)
 {
 	auto *db = provider->get();
@@ -224,3 +279,149 @@ void TestMapDatabase::testPositionEncoding()
 	UASSERT(db->getIntegerAsBlock(-0x800800800) == v3bpos_t(-2048, -2048, -2048))
 	UASSERT(db->getIntegerAsBlock(-0x314e3807b) == v3bpos_t(-123, 456, -789))
 }
+
+void TestMapDatabase::testMortonEncoding()
+{
+	// Coordinates are offset by 2^20
+	UASSERTEQ(u64, MapDatabase::getBlockAsMorton({0, 0, 0}), 0x7ULL << 60);
+
+	v3bpos_t pp[] = {{0, 0, 0}, {1, 2, 3}, {-1, -2, -3}, {-123, 456, -789},
+			{2047, -2048, 1937}};
+	for (const auto &p : pp)
+		UASSERT(MapDatabase::getMortonAsBlock(MapDatabase::getBlockAsMorton(p)) == p);
+
+	// Neighbours along each axis differ in the lowest bits
+	UASSERTEQ(u64, MapDatabase::getBlockAsMorton({1, 0, 0}) ^
+			MapDatabase::getBlockAsMorton({0, 0, 0}), 1);
+	UASSERTEQ(u64, MapDatabase::getBlockAsMorton({0, 1, 0}) ^
+			MapDatabase::getBlockAsMorton({0, 0, 0}), 2);
+	UASSERTEQ(u64, MapDatabase::getBlockAsMorton({0, 0, 1}) ^
+			MapDatabase::getBlockAsMorton({0, 0, 0}), 4);
+
+	// Ranges cover the box exactly when not limited
+	const v3bpos_t min(-3, 5, -7), max(4, 9, 1);
+	std::vector<std::pair<u64, u64>> ranges;
+	MapDatabase::getMortonRanges(min, max, ranges, 10000);
+	u64 covered = 0;
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		UASSERT(ranges[i].first <= ranges[i].second);
+		if (i > 0)
+			UASSERT(ranges[i - 1].second + 1 < ranges[i].first);
+		covered += ranges[i].second - ranges[i].first + 1;
+	}
+	UASSERTEQ(u64, covered, 8 * 5 * 9);
+
+	// Fewer ranges still containing every block when limited
+	const size_t exact_count = ranges.size();
+	ranges.clear();
+	MapDatabase::getMortonRanges(min, max, ranges, 4);
+	UASSERT(ranges.size() < exact_count);
+	for (bpos_t z = min.Z; z <= max.Z; ++z)
+	for (bpos_t y = min.Y; y <= max.Y; ++y)
+	for (bpos_t x = min.X; x <= max.X; ++x) {
+		const u64 key = MapDatabase::getBlockAsMorton({x, y, z});
+		bool found = false;
+		for (const auto &[first, last] : ranges)
+			found |= key >= first && key <= last;
+		UASSERT(found);
+	}
+}
+
+void TestMapDatabase::testMmapRecovery(const std::string &dir)
+{
+#if USE_MMAP_DATABASE
+	// Small segments, the first session fills more than one
+	const size_t segment_size = 16 * 1024;
+	const std::string mmap_dir = dir + DIR_DELIM + "map.mmap";
+	std::string dest;
+	{
+		MapDatabaseMmap db(dir, segment_size);
+		for (bpos_t i = 0; i < 100; i++)
+			UASSERT(db.saveBlock({i, 0, 0}, test_data));
+		UASSERT(db.deleteBlock({5, 0, 0}));
+	}
+	const size_t segments = fs::GetDirListing(mmap_dir).size();
+	UASSERTEQ(size_t, segments, 2);
+	{
+		// Everything survives a restart, newer records win
+		MapDatabaseMmap db(dir, segment_size);
+		std::vector<v3bpos_t> list;
+		db.listAllLoadableBlocks(list);
+		UASSERTEQ(size_t, list.size(), 99);
+		db.loadBlock({5, 0, 0}, &dest);
+		UASSERT(dest.empty());
+	}
+	// The last segment is appended to again
+	UASSERTEQ(size_t, fs::GetDirListing(mmap_dir).size(), segments);
+	{
+		MapDatabaseMmap db(dir, segment_size);
+		// Make the first segment dead
+		for (bpos_t i = 0; i < 100; i++)
+			UASSERT(db.saveBlock({i, 0, 0}, "new"));
+		UASSERT(db.deleteBlock({6, 0, 0}));
+		UASSERTEQ(size_t, db.compact(), 1);
+		db.loadBlock({7, 0, 0}, &dest);
+		UASSERT(dest == "new");
+		db.saveBlock({1, 2, 3}, test_data);
+	}
+
+	// Damage the last record as if the write was torn
+	std::string last;
+	for (const auto &node : fs::GetDirListing(mmap_dir))
+		last = std::max(last, node.name);
+	FILE *f = fopen((mmap_dir + DIR_DELIM + last).c_str(), "r+b");
+	UASSERT(f);
+	fseek(f, -1, SEEK_END);
+	fputc(~test_data.back(), f);
+	fclose(f);
+
+	{
+		MapDatabaseMmap db(dir, segment_size);
+		db.loadBlock({1, 2, 3}, &dest);
+		UASSERT(dest.empty());
+		db.loadBlock({6, 0, 0}, &dest);
+		UASSERT(dest.empty());
+		db.loadBlock({7, 0, 0}, &dest);
+		UASSERT(dest == "new");
+
+		// The torn record is cut off, not replayed after new ones
+		UASSERT(db.saveBlock({8, 0, 0}, "after"));
+	}
+	{
+		MapDatabaseMmap db(dir, segment_size);
+		db.loadBlock({8, 0, 0}, &dest);
+		UASSERT(dest == "after");
+		db.loadBlock({1, 2, 3}, &dest);
+		UASSERT(dest.empty());
+	}
+#endif
+}
+
+void TestMapDatabase::testKeyLayout(const std::string &dir)
+{
+	// Blocks in the database decide the layout, not the requested one
+	for (const bool morton : {false, true}) {
+		const std::string path = dir + DIR_DELIM + (morton ? "morton" : "default");
+		const std::string expect = morton ? "morton" : "default";
+		fs::RecursiveDelete(path);
+		UASSERT(fs::CreateAllDirs(path));
+
+		const auto check = [&](MapDatabase *db, bool requested) {
+			db->verifyDatabase();
+			UASSERTEQ(std::string, db->getKeyLayout(), expect);
+			if (requested == morton) {
+				UASSERT(db->saveBlock({1, 2, 3}, test_data));
+				return;
+			}
+			std::string dest;
+			db->loadBlock({1, 2, 3}, &dest);
+			UASSERT(dest == test_data);
+		};
+		for (const bool requested : {morton, !morton}) {
+			check(std::make_unique<MapDatabaseSQLite3>(path, requested).get(), requested);
+#if USE_LEVELDB
+			check(std::make_unique<Database_LevelDB>(path, requested).get(), requested);
+#endif
+		}
+	}
+}
@@ -4,6 +4,7 @@
 
 #include "test.h"
 
+#include <algorithm>
 #include <cmath>
 #include "exceptions.h"
 #include "noise.h"
@@ -26,6 +27,7 @@ class TestNoise : public TestBase {
 	void testNoise3dPoint();
 	void testNoise3dBulk();
 	void testNoiseInvalidParams();
+	void testNoiseTileCache();
 
 	static const float expected_2d_results[10 * 10];
 	static const float expected_3d_results[10 * 10 * 10];
@@ -46,6 +48,7 @@ void TestNoise::runTests(IGameDef *gamedef)
 	TEST(testNoise3dPoint);
 	TEST(testNoise3dBulk);
 	TEST(testNoiseInvalidParams);
+	TEST(testNoiseTileCache);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -97,6 +100,46 @@ void TestNoise::testNoise2dBulk()
 	}
 }
 
+void TestNoise::testNoiseTileCache()
+{
+	// Room for two 10x10 maps
+	NoiseTileCache cache(2 * 10 * 10 * sizeof(float));
+	NoiseParams np_normal(20, 40, v3f(50, 50, 50), 9,  5, 0.6, 2.0);
+	Noise noise_a(&np_normal, 1337, 10, 10);
+	Noise noise_b(&np_normal, 1337, 10, 10);
+	noise_a.tile_cache = &cache;
+	noise_b.tile_cache = &cache;
+
+	noise_a.noiseMap2D(0, 0);
+	UASSERTEQ(u64, cache.getMisses(), 1);
+
+	// Another noise with the same params gets the same map from the cache
+	float *noisevals = noise_b.noiseMap2D(0, 0);
+	UASSERTEQ(u64, cache.getHits(), 1);
+	for (u32 i = 0; i != 10 * 10; i++)
+		UASSERT(std::fabs(noisevals[i] - expected_2d_results[i]) <= 0.00001);
+
+	// Different params or position are different maps
+	Noise noise_seed(&np_normal, 1338, 10, 10);
+	noise_seed.tile_cache = &cache;
+	noise_seed.noiseMap2D(0, 0);
+	noise_a.noiseMap2D(10, 0);
+	UASSERTEQ(u64, cache.getHits(), 1);
+	UASSERTEQ(size_t, cache.size(), 2);
+
+	// The least recently used map was dropped
+	noise_a.noiseMap2D(0, 0);
+	UASSERTEQ(u64, cache.getHits(), 1);
+	noise_a.noiseMap2D(10, 0);
+	UASSERTEQ(u64, cache.getHits(), 2);
+
+	// Maps with a persistence map are not cached
+	float persist[10 * 10];
+	std::fill_n(persist, 10 * 10, 0.5f);
+	noise_a.noiseMap2D(10, 0, persist);
+	UASSERTEQ(u64, cache.getHits(), 2);
+}
+
 void TestNoise::testNoise3dAtOriginWithZeroSeed()
 {
 	float actual{ noise2d(0, 0, 0) };
@@ -0,0 +1,198 @@
+/*
+This file is part of Freeminer.
+
+Freeminer is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Freeminer  is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Freeminer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+Uniform hash grid of points, same interface as k_d_tree::DynamicKdTrees.
+
+Updates of points staying in their cell are done in place, so objects moving
+every step are cheap to track. Queries visit the cells overlapping the box, or
+all occupied cells if the box covers more cells than that.
+Callbacks are called without the lock held.
+*/
+
+namespace spatial_grid
+{
+
+template <uint8_t Dim, class Component, class Id>
+class HashGrid
+{
+public:
+	using Point = std::array<Component, Dim>;
+
+	explicit HashGrid(Component cell_size) : m_cell_size(cell_size) {}
+
+	void insert(const Point &point, Id id)
+	{
+		const std::unique_lock lock(m_mutex);
+		insertNoLock(point, id);
+	}
+
+	void remove(Id id)
+	{
+		const std::unique_lock lock(m_mutex);
+		removeNoLock(id);
+	}
+
+	void update(const Point &point, Id id)
+	{
+		const std::unique_lock lock(m_mutex);
+		const auto it = m_entries.find(id);
+		if (it == m_entries.end()) {
+			insertNoLock(point, id);
+			return;
+		}
+		const auto cell = getCell(point);
+		if (cell != it->second) {
+			removeNoLock(id);
+			insertNoLock(point, id);
+			return;
+		}
+		for (auto &entry : m_cells[cell])
+			if (entry.second == id) {
+				entry.first = point;
+				break;
+			}
+	}
+
+	template <typename F>
+	void rangeQuery(const Point &min, const Point &max, const F &cb) const
+	{
+		std::vector<std::pair<Point, Id>> found;
+		{
+			const std::shared_lock lock(m_mutex);
+			const auto cmin = getCell(min), cmax = getCell(max);
+			double volume = 1;
+			for (uint8_t d = 0; d < Dim; ++d)
+				volume *= double(cmax[d]) - cmin[d] + 1;
+
+			const auto collect = [&](const std::vector<std::pair<Point, Id>> &cell) {
+				for (const auto &entry : cell)
+					if (isInside(entry.first, min, max))
+						found.push_back(entry);
+			};
+			if (volume > m_cells.size()) {
+				for (const auto &[pos, cell] : m_cells)
+					collect(cell);
+			} else {
+				Cell pos = cmin;
+				while (true) {
+					const auto it = m_cells.find(pos);
+					if (it != m_cells.end())
+						collect(it->second);
+					uint8_t d = 0;
+					for (; d < Dim; ++d) {
+						if (pos[d] < cmax[d]) {
+							++pos[d];
+							break;
+						}
+						pos[d] = cmin[d];
+					}
+					if (d == Dim)
+						break;
+				}
+			}
+		}
+		for (const auto &[point, id] : found)
+			cb(point, id);
+	}
+
+	size_t size() const
+	{
+		const std::shared_lock lock(m_mutex);
+		return m_entries.size();
+	}
+
+private:
+	using Cell = std::array<int32_t, Dim>;
+
+	struct CellHash
+	{
+		size_t operator()(const Cell &cell) const
+		{
+			size_t hash = 0;
+			for (const auto c : cell)
+				hash = hash * 0x9E3779B1u + uint32_t(c);
+			return hash;
+		}
+	};
+
+	Cell getCell(const Point &point) const
+	{
+		Cell cell;
+		for (uint8_t d = 0; d < Dim; ++d) {
+			const double c = std::floor(double(point[d]) / m_cell_size);
+			cell[d] = std::clamp<double>(c, std::numeric_limits<int32_t>::min(),
+					std::numeric_limits<int32_t>::max());
+		}
+		return cell;
+	}
+
+	static bool isInside(const Point &point, const Point &min, const Point &max)
+	{
+		for (uint8_t d = 0; d < Dim; ++d)
+			if (point[d] < min[d] || point[d] > max[d])
+				return false;
+		return true;
+	}
+
+	void insertNoLock(const Point &point, Id id)
+	{
+		// Ids are reused, a stale entry must not stay in its old cell
+		removeNoLock(id);
+		const auto cell = getCell(point);
+		m_cells[cell].emplace_back(point, id);
+		m_entries[id] = cell;
+	}
+
+	void removeNoLock(Id id)
+	{
+		const auto it = m_entries.find(id);
+		if (it == m_entries.end())
+			return;
+		const auto cell_it = m_cells.find(it->second);
+		auto &cell = cell_it->second;
+		for (auto &entry : cell)
+			if (entry.second == id) {
+				entry = cell.back();
+				cell.pop_back();
+				break;
+			}
+		if (cell.empty())
+			m_cells.erase(cell_it);
+		m_entries.erase(it);
+	}
+
+	const Component m_cell_size;
+	std::unordered_map<Cell, std::vector<std::pair<Point, Id>>, CellHash> m_cells;
+	std::unordered_map<Id, Cell> m_entries;
+	mutable std::shared_mutex m_mutex;
+};
+
+} // namespace spatial_grid
@@ -5,6 +5,7 @@
 #include <array>
 
 #include "voxelalgorithms.h"
+#include "fm_light.h"
 #include "nodedef.h"
 #include "mapblock.h"
 #include "map.h"
@@ -161,75 +162,6 @@ const static v3pos_t neighbor_dirs[6] = {
 	v3pos_t(-1, 0, 0), // left
 };
 
-/*!
- * Transforms the given map block offset by one node towards
- * the specified direction.
- * \param dir the direction of the transformation
- * \param rel_pos the node's relative position in its map block
- * \param block_pos position of the node's block
- */
-bool step_rel_block_pos(direction dir, relative_v3 &rel_pos,
-	mapblock_v3 &block_pos)
-{
-	switch (dir) {
-	case 0:
-		if (rel_pos.X < MAP_BLOCKSIZE - 1) {
-			rel_pos.X++;
-		} else {
-			rel_pos.X = 0;
-			block_pos.X++;
-			return true;
-		}
-		break;
-	case 1:
-		if (rel_pos.Y < MAP_BLOCKSIZE - 1) {
-			rel_pos.Y++;
-		} else {
-			rel_pos.Y = 0;
-			block_pos.Y++;
-			return true;
-		}
-		break;
-	case 2:
-		if (rel_pos.Z < MAP_BLOCKSIZE - 1) {
-			rel_pos.Z++;
-		} else {
-			rel_pos.Z = 0;
-			block_pos.Z++;
-			return true;
-		}
-		break;
-	case 3:
-		if (rel_pos.Z > 0) {
-			rel_pos.Z--;
-		} else {
-			rel_pos.Z = MAP_BLOCKSIZE - 1;
-			block_pos.Z--;
-			return true;
-		}
-		break;
-	case 4:
-		if (rel_pos.Y > 0) {
-			rel_pos.Y--;
-		} else {
-			rel_pos.Y = MAP_BLOCKSIZE - 1;
-			block_pos.Y--;
-			return true;
-		}
-		break;
-	case 5:
-		if (rel_pos.X > 0) {
-			rel_pos.X--;
-		} else {
-			rel_pos.X = MAP_BLOCKSIZE - 1;
-			block_pos.X--;
-			return true;
-		}
-		break;
-	}
-	return false;
-}
-
 /*
  * Removes all light that is potentially emitted by the specified
  * light sources. These nodes will have zero light.
@@ -244,94 +176,20 @@ void unspread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 	UnlightQueue &from_nodes, ReLightQueue &light_sources,
 	std::map<v3bpos_t, MapBlock*> &modified_blocks)
 {
-	// Stores data popped from from_nodes
-	u8 current_light;
+	std::vector<std::pair<v3pos_t, u8>> nodes;
+	u8 light;
 	ChangingLight current;
-	// Data of the current neighbor
-	mapblock_v3 neighbor_block_pos;
-	relative_v3 neighbor_rel_pos;
-	// Direction of the brightest neighbor of the node
-	direction source_dir;
-	while (from_nodes.next(current_light, current)) {
-		// For all nodes that need unlighting
-
-		// There is no brightest neighbor
-		source_dir = 6;
-		// The current node
-		const MapNode &node = current.block->getNodeNoCheck(current.rel_position);
-		ContentLightingFlags f = nodemgr->getLightingFlags(node);
-		// If the node emits light, it behaves like it had a
-		// brighter neighbor.
-		u8 brightest_neighbor_light = f.light_source + 1;
-		for (direction i = 0; i < 6; i++) {
-			//For each neighbor
-
-			// The node that changed this node has already zero light
-			// and it can't give light to this node
-			if (current.source_direction + i == 5) {
-				continue;
-			}
-			// Get the neighbor's position and block
-			neighbor_rel_pos = current.rel_position;
-			neighbor_block_pos = current.block_position;
-			MapBlock *neighbor_block;
-			if (step_rel_block_pos(i, neighbor_rel_pos, neighbor_block_pos)) {
-				neighbor_block = map->getBlockNoCreateNoEx(neighbor_block_pos);
-				if (neighbor_block == NULL) {
-					current.block->setLightingComplete(bank, i, false);
-					continue;
-				}
-			} else {
-				neighbor_block = current.block;
-			}
-
-			const auto lock = neighbor_block->try_lock_unique_rec();
-			if (!lock->owns_lock()) {
-				continue; // may cause dark areas
-			}
+	while (from_nodes.next(light, current))
+		nodes.emplace_back(getBlockPosRelative(current.block_position) +
+			current.rel_position, light);
+	if (nodes.empty())
+		return;
 
-			// Get the neighbor itself
-			MapNode neighbor = neighbor_block->getNodeNoLock(neighbor_rel_pos);
-			ContentLightingFlags neighbor_f = nodemgr->getLightingFlags(
-				neighbor.getContent());
-			u8 neighbor_light = neighbor.getLightRaw(bank, neighbor_f);
-			// If the neighbor has at least as much light as this node, then
-			// it won't lose its light, since it should have been added to
-			// from_nodes earlier, so its light would be zero.
-			if (neighbor_f.light_propagates && neighbor_light < current_light) {
-				// Unlight, but only if the node has light.
-				if (neighbor_light > 0) {
-					neighbor.setLight(bank, 0, neighbor_f);
-					neighbor_block->setNodeNoLock(neighbor_rel_pos, neighbor);
-					from_nodes.push(neighbor_light, neighbor_rel_pos,
-						neighbor_block_pos, neighbor_block, i);
-					// The current node was modified earlier, so its block
-					// is in modified_blocks.
-					if (current.block != neighbor_block) {
-						modified_blocks[neighbor_block_pos] = neighbor_block;
-					}
-				}
-			} else {
-				// The neighbor can light up this node.
-				if (neighbor_light < neighbor_f.light_source) {
-					neighbor_light = neighbor_f.light_source;
-				}
-				if (brightest_neighbor_light < neighbor_light) {
-					brightest_neighbor_light = neighbor_light;
-					source_dir = i;
-				}
-			}
-		}
-		// If the brightest neighbor is able to light up this node,
-		// then add this node to the output nodes.
-		if (brightest_neighbor_light > 1 && f.light_propagates) {
-			brightest_neighbor_light--;
-			light_sources.push(brightest_neighbor_light, current.rel_position,
-				current.block_position, current.block,
-				(source_dir == 6) ? 6 : 5 - source_dir
-				/* with opposite direction*/);
-		}
-	}
+	LightPropagator propagator(map, nodemgr);
+	propagator.unspreadRaw(bank, nodes,
+		[&](u8 light, const v3pos_t &rel, const v3bpos_t &blockpos, MapBlock *block) {
+			light_sources.push(light, rel, blockpos, block, 6);
+		}, modified_blocks);
 }
 
 /*
@@ -350,59 +208,17 @@ void spread_light(Map *map, const NodeDefManager *nodemgr, LightBank bank,
 	LightQueue &light_sources,
 	std::map<v3bpos_t, MapBlock*> &modified_blocks)
 {
-	// The light the current node can provide to its neighbors.
-	u8 spreading_light;
-	// The ChangingLight for the current node.
+	std::vector<std::pair<v3pos_t, u8>> nodes;
+	u8 light;
 	ChangingLight current;
-	// Position of the current neighbor.
-	mapblock_v3 neighbor_block_pos;
-	relative_v3 neighbor_rel_pos;
-	while (light_sources.next(spreading_light, current)) {
-		spreading_light--;
-		for (direction i = 0; i < 6; i++) {
-			// This node can't light up its light source
-			if (current.source_direction + i == 5) {
-				continue;
-			}
-			// Get the neighbor's position and block
-			neighbor_rel_pos = current.rel_position;
-			neighbor_block_pos = current.block_position;
-			MapBlock *neighbor_block;
-			if (step_rel_block_pos(i, neighbor_rel_pos, neighbor_block_pos)) {
-				neighbor_block = map->getBlockNoCreateNoEx(neighbor_block_pos);
-				if (neighbor_block == NULL) {
-					current.block->setLightingComplete(bank, i, false);
-					continue;
-				}
-			} else {
-				neighbor_block = current.block;
-			}
-
-			const auto lock = neighbor_block->try_lock_unique_rec();
-			if (!lock->owns_lock()) {
-				continue; // may cause dark areas
-			}
+	while (light_sources.next(light, current))
+		nodes.emplace_back(getBlockPosRelative(current.block_position) +
+			current.rel_position, light);
+	if (nodes.empty())
+		return;
 
-			// Get the neighbor itself
-			MapNode neighbor = neighbor_block->getNodeNoLock(neighbor_rel_pos);
-			ContentLightingFlags f = nodemgr->getLightingFlags(neighbor);
-			if (f.light_propagates) {
-				// Light up the neighbor, if it has less light than it should.
-				u8 neighbor_light = neighbor.getLightRaw(bank, f);
-				if (neighbor_light < spreading_light) {
-					neighbor.setLight(bank, spreading_light, f);
-					neighbor_block->setNodeNoLock(neighbor_rel_pos, neighbor);
-					light_sources.push(spreading_light, neighbor_rel_pos,
-						neighbor_block_pos, neighbor_block, i);
-					// The current node was modified earlier, so its block
-					// is in modified_blocks.
-					if (current.block != neighbor_block) {
-						modified_blocks[neighbor_block_pos] = neighbor_block;
-					}
-				}
-			}
-		}
-	}
+	LightPropagator propagator(map, nodemgr);
+	propagator.spreadRaw(bank, nodes, modified_blocks);
 }
 
 struct SunlightPropagationUnit{